@@ -983,6 +983,142 @@ static int seenHardLink(FileRecords files, FileListRec flp, rpm_ino_t *fileid)
     return 0;
 }
 
+/**
+ * Can this file take part in payload content dedup? Clones share one
+ * inode after install, so only plain regular files qualify: config
+ * files may diverge from each other on the installed system, ghosts
+ * have no content and files that already are hardlinks bring their
+ * own set along.
+ */
+static int cloneCandidate(FileListRec flp)
+{
+    return (S_ISREG(flp->fl_mode) && flp->fl_nlink == 1 &&
+	    flp->fl_size > 0 &&
+	    !(flp->flags & (RPMFILE_GHOST|RPMFILE_CONFIG|RPMFILE_EXCLUDE)));
+}
+
+/**
+ * Equal content alone is not enough to clone: all recorded metadata
+ * must match too, since hardlinked paths share mode, owner, caps and
+ * timestamps on disk.
+ */
+static int cloneMatch(FileListRec flp, FileListRec tlp)
+{
+    return (flp->fl_size == tlp->fl_size &&
+	    flp->fl_mode == tlp->fl_mode &&
+	    flp->fl_mtime == tlp->fl_mtime &&
+	    flp->uname == tlp->uname &&
+	    flp->gname == tlp->gname &&
+	    rstreq(flp->caps ? flp->caps : "", tlp->caps ? tlp->caps : ""));
+}
+
+struct cloneRec_s {
+    FileListRec flp;
+    char *digest;
+    int leader;		/* candidate index of the set head, -1 if none */
+};
+
+static int compareCloneRecs(const void * ap, const void * bp)
+{
+    const struct cloneRec_s *a = ap;
+    const struct cloneRec_s *b = bp;
+    int rc = strcmp(a->digest, b->digest);
+    if (rc == 0)
+	rc = (a->flp < b->flp) ? -1 : 1;
+    return rc;
+}
+
+/**
+ * Turn byte-identical files into hardlink sets so the payload stores
+ * their content only once. The clones are regular hardlink records,
+ * the archive writer and the install fsm need no special handling.
+ * @param fl		package file records
+ * @param fmc		file metadata cache (may be NULL)
+ * @param digestns	cache namespace of the digest algorithm
+ * @param digestalgo	file digest algorithm
+ */
+static void dedupPayloadClones(FileList fl, fmetaCache fmc,
+			       const char *digestns, uint32_t digestalgo)
+{
+    struct cloneRec_s *cands = xmalloc(fl->files.used * sizeof(*cands));
+    int ncands = 0;
+    int nclones = 0;
+    char buf[BUFSIZ];
+
+    for (int i = 0; i < fl->files.used; i++) {
+	FileListRec flp = fl->files.recs + i;
+	const char *cached;
+
+	if (!cloneCandidate(flp))
+	    continue;
+
+	buf[0] = '\0';
+	cached = fmetaCacheGet(fmc, digestns, flp->cpioPath,
+			       flp->fl_mtime, flp->fl_size);
+	if (cached != NULL) {
+	    rstrlcpy(buf, cached, sizeof(buf));
+	} else {
+	    (void) rpmDoDigest(digestalgo, flp->diskPath, 1,
+			       (unsigned char *)buf);
+	    if (buf[0] != '\0')
+		fmetaCachePut(fmc, digestns, flp->cpioPath,
+			      flp->fl_mtime, flp->fl_size, buf);
+	}
+	/* unreadable files get their error from the header loop */
+	if (buf[0] == '\0')
+	    continue;
+
+	cands[ncands].flp = flp;
+	cands[ncands].digest = xstrdup(buf);
+	cands[ncands].leader = -1;
+	ncands++;
+    }
+
+    if (ncands > 1) {
+	qsort(cands, ncands, sizeof(*cands), compareCloneRecs);
+
+	/* find the first equal-content, equal-metadata file for each */
+	for (int i = 1; i < ncands; i++) {
+	    for (int j = i - 1; j >= 0; j--) {
+		if (!rstreq(cands[j].digest, cands[i].digest))
+		    break;
+		if (cloneMatch(cands[j].flp, cands[i].flp)) {
+		    cands[i].leader = (cands[j].leader >= 0) ?
+			cands[j].leader : j;
+		    break;
+		}
+	    }
+	}
+
+	/* graft the clones onto their set head's inode */
+	for (int i = 0; i < ncands; i++) {
+	    FileListRec lead, flp;
+	    if (cands[i].leader < 0)
+		continue;
+	    lead = cands[cands[i].leader].flp;
+	    flp = cands[i].flp;
+	    flp->fl_st.st_ino = lead->fl_ino;
+	    flp->fl_st.st_dev = lead->fl_dev;
+	    lead->fl_st.st_nlink++;
+	    nclones++;
+	}
+	/* isHardLink() wants matching link counts across the set */
+	for (int i = 0; i < ncands; i++) {
+	    if (cands[i].leader >= 0)
+		cands[i].flp->fl_st.st_nlink =
+		    cands[cands[i].leader].flp->fl_nlink;
+	}
+    }
+
+    if (nclones > 0)
+	rpmlog(RPMLOG_DEBUG, "stored %d duplicate file(s) as hardlinks\n",
+	       nclones);
+
+    for (int i = 0; i < ncands; i++)
+	free(cands[i].digest);
+    free(cands);
+}
+
 /**
  * Add file entries to header.
  * @todo Should directories have %doc/%config attributes? (#14531)
@@ -1002,6 +1138,8 @@ static void genCpioListAndHeader(FileList fl, Package pkg, int isSrc)
     Header h = pkg->header; /* just a shortcut */
     time_t source_date_epoch = 0;
     char *srcdate = getenv("SOURCE_DATE_EPOCH");
+    fmetaCache fmc = NULL;
+    char *digestns = NULL;
 
     /* Limit the maximum date to SOURCE_DATE_EPOCH if defined
      * similar to the tar --clamp-mtime option
@@ -1029,11 +1167,15 @@ static void genCpioListAndHeader(FileList fl, Package pkg, int isSrc)
 
     if (rpmDigestLength(digestalgo) == 0) {
 	rpmlog(RPMLOG_WARNING,
-		_("Unknown file digest algorithm %u, falling back to MD5\n"), 
+		_("Unknown file digest algorithm %u, falling back to MD5\n"),
 		digestalgo);
 	digestalgo = defaultalgo;
     }
 
+    /* Cached digests are only valid for the same algorithm */
+    fmc = fmetaCacheOpen();
+    rasprintf(&digestns, "digest%u", digestalgo);
+
     /* Adjust paths if needed */
     if (!isSrc && pkg->removePostfixes) {
 	pkg->fileRenameMap = fileRenameHashCreate(fl->files.used,
@@ -1066,6 +1208,10 @@ static void genCpioListAndHeader(FileList fl, Package pkg, int isSrc)
 	      sizeof(*(fl->files.recs)), compareFileListRecs);
     }
     
+    /* Optionally store byte-identical files as hardlink sets */
+    if (!isSrc && rpmExpandNumeric("%{?_build_payload_dedup}") > 0)
+	dedupPayloadClones(fl, fmc, digestns, digestalgo);
+
     pkg->dpaths = xmalloc((fl->files.used + 1) * sizeof(*pkg->dpaths));
 
     /* Generate the header. */
@@ -1201,9 +1347,19 @@ static void genCpioListAndHeader(FileList fl, Package pkg, int isSrc)
 	}
 	
 	buf[0] = '\0';
-	if (S_ISREG(flp->fl_mode) && !(flp->flags & RPMFILE_GHOST))
-	    (void) rpmDoDigest(digestalgo, flp->diskPath, 1, 
-			       (unsigned char *)buf);
+	if (S_ISREG(flp->fl_mode) && !(flp->flags & RPMFILE_GHOST)) {
+	    const char *cached = fmetaCacheGet(fmc, digestns, flp->cpioPath,
+					       flp->fl_mtime, flp->fl_size);
+	    if (cached != NULL) {
+		rstrlcpy(buf, cached, sizeof(buf));
+	    } else {
+		(void) rpmDoDigest(digestalgo, flp->diskPath, 1,
+				   (unsigned char *)buf);
+		if (buf[0] != '\0')
+		    fmetaCachePut(fmc, digestns, flp->cpioPath,
+				  flp->fl_mtime, flp->fl_size, buf);
+	    }
+	}
 	headerPutString(h, RPMTAG_FILEDIGESTS, buf);
 	
 	buf[0] = '\0';
@@ -1244,6 +1400,22 @@ static void genCpioListAndHeader(FileList fl, Package pkg, int isSrc)
 	/* Strip internal parse data */
 	flp->flags &= PARSEATTR_MASK;
 
+#ifdef SEEK_HOLE
+	/* Mark files stored sparse so install can keep them that way.
+	 * The block count filters out dense files without extra
+	 * syscalls, SEEK_HOLE confirms an actual hole. */
+	if (S_ISREG(flp->fl_mode) && !(flp->flags & RPMFILE_GHOST) &&
+		flp->fl_size > 0 &&
+		(rpm_loff_t)flp->fl_st.st_blocks * 512 < flp->fl_size) {
+	    int fdno = open(flp->diskPath, O_RDONLY);
+	    if (fdno >= 0) {
+		if (lseek(fdno, 0, SEEK_HOLE) < (off_t)flp->fl_size)
+		    flp->flags |= RPMFILE_SPARSE;
+		close(fdno);
+	    }
+	}
+#endif
+
 	headerPutUint32(h, RPMTAG_FILEFLAGS, &(flp->flags) ,1);
     }
     pkg->dpaths[npaths] = NULL;
@@ -1284,6 +1456,9 @@ static void genCpioListAndHeader(FileList fl, Package pkg, int isSrc)
 	/* Binary packages with dirNames cannot be installed by legacy rpm. */
 	(void) rpmlibNeedsFeature(pkg, "CompressedFileNames", "3.0.4-1");
     }
+
+    fmc = fmetaCacheFree(fmc);
+    free(digestns);
 }
 
 static FileRecords FileRecordsFree(FileRecords files)
@@ -1573,9 +1748,18 @@ static rpmRC recurseDir(FileList fl, const char * diskPath)
     char * ftsSet[2];
     FTS * ftsp;
     FTSENT * fts;
-    int myFtsOpts = (FTS_COMFOLLOW | FTS_NOCHDIR | FTS_PHYSICAL);
+    int myFtsOpts = (FTS_COMFOLLOW | FTS_NOCHDIR | FTS_PHYSICAL | FTS_NOSTAT);
+    ARGV_t paths = NULL;
+    struct stat *sbs = NULL;
+    int npaths, i;
     rpmRC rc = RPMRC_FAIL;
 
+    /*
+     * Walk the tree without statting (d_type is enough for the descent),
+     * then stat the collected entries in parallel before the serial
+     * addFile() pass in traversal order: the stat calls dominate the
+     * buildroot walk by a wide margin on high latency filesystems.
+     */
     ftsSet[0] = (char *) diskPath;
     ftsSet[1] = NULL;
     ftsp = Fts_open(ftsSet, myFtsOpts, NULL);
@@ -1586,7 +1770,9 @@ static rpmRC recurseDir(FileList fl, const char * diskPath)
 	case FTS_SL:		/* symbolic link */
 	case FTS_SLNONE:	/* symbolic link without target */
 	case FTS_DEFAULT:	/* none of the above */
-	    rc = addFile(fl, fts->fts_accpath, fts->fts_statp);
+	case FTS_NSOK:		/* no stat(2) requested */
+	    argvAdd(&paths, fts->fts_accpath);
+	    rc = RPMRC_OK;
 	    break;
 	case FTS_DOT:		/* dot or dot-dot */
 	case FTS_DP:		/* postorder directory */
@@ -1596,7 +1782,6 @@ static rpmRC recurseDir(FileList fl, const char * diskPath)
 	case FTS_DNR:		/* unreadable directory */
 	case FTS_ERR:		/* error; errno is set */
 	case FTS_DC:		/* directory that causes cycles */
-	case FTS_NSOK:		/* no stat(2) requested */
 	case FTS_INIT:		/* initialized only */
 	case FTS_W:		/* whiteout object */
 	default:
@@ -1609,7 +1794,37 @@ static rpmRC recurseDir(FileList fl, const char * diskPath)
 	    break;
     }
     (void) Fts_close(ftsp);
+    if (rc)
+	goto exit;
 
+    npaths = argvCount(paths);
+    sbs = xcalloc(npaths + 1, sizeof(*sbs));
+    #pragma omp parallel for schedule(dynamic)
+    for (i = 0; i < npaths; i++) {
+	if (lstat(paths[i], &sbs[i]) != 0)
+	    sbs[i].st_mode = 0;
+    }
+    /* A symlinked root is followed, as with FTS_COMFOLLOW */
+    if (npaths > 0 && S_ISLNK(sbs[0].st_mode)) {
+	if (stat(paths[0], &sbs[0]) != 0)
+	    (void) lstat(paths[0], &sbs[0]);
+    }
+
+    for (i = 0; i < npaths; i++) {
+	if (sbs[i].st_mode == 0) {
+	    rpmlog(RPMLOG_ERR, _("Can't read content of file: %s\n"),
+		paths[i]);
+	    rc = RPMRC_FAIL;
+	} else {
+	    rc = addFile(fl, paths[i], &sbs[i]);
+	}
+	if (rc)
+	    break;
+    }
+
+exit:
+    free(sbs);
+    argvFree(paths);
     return rc;
 }
 
@@ -2202,9 +2417,29 @@ static rpmRC processBinaryFile(Package pkg, FileList fl, const char * fileName)
 	}
 
 	if (rpmGlob(diskPath, &argc, &argv) == 0) {
+	    /*
+	     * Stat the glob results in parallel before the serial
+	     * addFile() pass, the syscalls dominate on large globs.
+	     * Directories (and explicit %dir entries) must go through
+	     * addFile()'s own stat logic for recursion and validation,
+	     * so only hits on plain entries are reused.
+	     */
+	    struct stat *sbs = NULL;
+	    if (!fl->cur.devtype && !fl->cur.isDir && argc > 1) {
+		sbs = xcalloc(argc, sizeof(*sbs));
+		#pragma omp parallel for schedule(dynamic)
+		for (i = 0; i < argc; i++) {
+		    if (lstat(argv[i], &sbs[i]) != 0)
+			sbs[i].st_mode = 0;
+		}
+	    }
 	    for (i = 0; i < argc; i++) {
-		rc = addFile(fl, argv[i], NULL);
+		struct stat *statp = NULL;
+		if (sbs && sbs[i].st_mode != 0 && !S_ISDIR(sbs[i].st_mode))
+		    statp = &sbs[i];
+		rc = addFile(fl, argv[i], statp);
 	    }
+	    free(sbs);
 	    argvFree(argv);
 	} else {
 	    const char *msg = (fl->cur.isDir) ?
@@ -0,0 +1,203 @@
+/** \ingroup rpmbuild
+ * \file build/fmetacache.c
+ *  Persistent per-file metadata cache (optional, see %_fmetacache_path):
+ *  expensive per-file build results such as libmagic classifications and
+ *  file digests are carried from one build to the next in a simple text
+ *  file. Entries are keyed by namespace, mtime, size and path, so files
+ *  that changed in any visible way are simply recomputed and refreshed.
+ */
+
+#include "system.h"
+
+#include <stdio.h>
+#include <pthread.h>
+#include <errno.h>
+
+#include <rpm/rpmstring.h>
+#include <rpm/rpmmacro.h>
+#include <rpm/rpmlog.h>
+
+#include "build/rpmbuild_internal.h"
+
+#include "debug.h"
+
+#undef HASHTYPE
+#undef HTKEYTYPE
+#undef HTDATATYPE
+#define HASHTYPE fmetaHash
+#define HTKEYTYPE const char *
+#define HTDATATYPE const char *
+#include "lib/rpmhash.H"
+#include "lib/rpmhash.C"
+#undef HASHTYPE
+#undef HTKEYTYPE
+#undef HTDATATYPE
+
+struct fmetaCache_s {
+    char *path;			/*!< cache file location */
+    fmetaHash entries;		/*!< entries loaded from disk */
+    fmetaHash added;		/*!< new/refreshed entries */
+    pthread_mutex_t mutex;	/*!< protects added */
+    FILE *savefp;		/*!< only set while saving */
+};
+
+/*
+ * One "<key>\t<value>" pair per line. The key embeds everything the
+ * entry is valid for, the path last as it may contain spaces. Keys and
+ * values containing tabs or newlines can't be represented, such entries
+ * are simply not cached (see fmetaCachePut()).
+ */
+static char *fmetaKey(const char *ns, const char *path,
+		      time_t mtime, off_t size)
+{
+    char *key = NULL;
+    rasprintf(&key, "%s %lld %lld %s",
+	      ns, (long long) mtime, (long long) size, path);
+    return key;
+}
+
+fmetaCache fmetaCacheOpen(void)
+{
+    fmetaCache fmc = NULL;
+    char *path = rpmExpand("%{?_fmetacache_path}", NULL);
+    char line[BUFSIZ];
+    FILE *fp = NULL;
+    int nent = 0;
+
+    if (*path == '\0')
+	goto exit;
+
+    fmc = xcalloc(1, sizeof(*fmc));
+    fmc->path = path;
+    path = NULL;
+    fmc->entries = fmetaHashCreate(1001, rstrhash, strcmp,
+				   (fmetaHashFreeKey)rfree,
+				   (fmetaHashFreeData)rfree);
+    fmc->added = fmetaHashCreate(101, rstrhash, strcmp,
+				 (fmetaHashFreeKey)rfree,
+				 (fmetaHashFreeData)rfree);
+    pthread_mutex_init(&fmc->mutex, NULL);
+
+    if ((fp = fopen(fmc->path, "r")) == NULL)
+	goto exit;
+
+    while (fgets(line, sizeof(line), fp) != NULL) {
+	char *val = strchr(line, '\t');
+	if (val == NULL)
+	    continue;
+	*val++ = '\0';
+	val[strcspn(val, "\n")] = '\0';
+	if (*line == '\0' || *val == '\0')
+	    continue;
+	if (fmetaHashHasEntry(fmc->entries, line))
+	    continue;
+	fmetaHashAddEntry(fmc->entries, xstrdup(line), xstrdup(val));
+	nent++;
+    }
+    fclose(fp);
+    rpmlog(RPMLOG_DEBUG, "loaded %d entries from file metadata cache %s\n",
+	   nent, fmc->path);
+
+exit:
+    free(path);
+    return fmc;
+}
+
+const char *fmetaCacheGet(fmetaCache fmc, const char *ns, const char *path,
+			  time_t mtime, off_t size)
+{
+    const char *val = NULL;
+    char *key;
+    const char **data;
+
+    if (fmc == NULL)
+	return NULL;
+
+    key = fmetaKey(ns, path, mtime, size);
+    if (fmetaHashGetEntry(fmc->entries, key, &data, NULL, NULL))
+	val = data[0];
+    free(key);
+    return val;
+}
+
+void fmetaCachePut(fmetaCache fmc, const char *ns, const char *path,
+		   time_t mtime, off_t size, const char *value)
+{
+    char *key;
+
+    if (fmc == NULL)
+	return;
+    /* Tabs and newlines can't be represented, skip such entries */
+    if (strpbrk(path, "\t\n") != NULL || strchr(value, '\n') != NULL)
+	return;
+
+    key = fmetaKey(ns, path, mtime, size);
+    pthread_mutex_lock(&fmc->mutex);
+    if (fmetaHashHasEntry(fmc->added, key)) {
+	free(key);
+    } else {
+	fmetaHashAddEntry(fmc->added, key, xstrdup(value));
+    }
+    pthread_mutex_unlock(&fmc->mutex);
+}
+
+static void fmetaWriteEntry(const char *key, const char **data, int dataCount,
+			    void *userdata)
+{
+    FILE *fp = userdata;
+    if (dataCount > 0)
+	fprintf(fp, "%s\t%s\n", key, data[0]);
+}
+
+static void fmetaWriteOldEntry(const char *key, const char **data, int dataCount,
+			       void *userdata)
+{
+    fmetaCache fmc = userdata;
+    /* refreshed entries were already written from fmc->added */
+    if (!fmetaHashHasEntry(fmc->added, key))
+	fmetaWriteEntry(key, data, dataCount, fmc->savefp);
+}
+
+static void fmetaCacheSave(fmetaCache fmc)
+{
+    char *tmppath = NULL;
+    FILE *fp = NULL;
+
+    if (fmetaHashNumKeys(fmc->added) == 0)
+	return;
+
+    rasprintf(&tmppath, "%s.tmp.%d", fmc->path, (int) getpid());
+    if ((fp = fopen(tmppath, "w")) == NULL)
+	goto exit;
+
+    fmc->savefp = fp;
+    fmetaHashForEach(fmc->added, fmetaWriteEntry, fp);
+    fmetaHashForEach(fmc->entries, fmetaWriteOldEntry, fmc);
+    fmc->savefp = NULL;
+
+    if (fclose(fp) == 0) {
+	if (rename(tmppath, fmc->path) != 0)
+	    unlink(tmppath);
+    } else {
+	unlink(tmppath);
+    }
+    fp = NULL;
+
+exit:
+    if (fp)
+	fclose(fp);
+    free(tmppath);
+}
+
+fmetaCache fmetaCacheFree(fmetaCache fmc)
+{
+    if (fmc) {
+	fmetaCacheSave(fmc);
+	fmetaHashFree(fmc->entries);
+	fmetaHashFree(fmc->added);
+	pthread_mutex_destroy(&fmc->mutex);
+	free(fmc->path);
+	free(fmc);
+    }
+    return NULL;
+}
@@ -12,28 +12,104 @@
 #include <rpm/rpmlib.h>			/* RPMSIGTAG*, rpmReadPackageFile */
 #include <rpm/rpmfileutil.h>
 #include <rpm/rpmlog.h>
+#include <rpm/rpmsw.h>
+#include <rpm/argv.h>
 
 #include "rpmio/rpmio_internal.h"	/* fdInitDigest, fdFiniDigest */
 #include "lib/fsm.h"
 #include "lib/signature.h"
+#include "lib/header_internal.h"	/* headerWriteRegion */
 #include "lib/rpmlead.h"
 #include "build/rpmbuild_internal.h"
 #include "build/rpmbuild_misc.h"
 
 #include "debug.h"
 
+struct sizeOrderEnt_s {
+    int fx;
+    int sclass;
+};
+
+static int sizeOrderCmp(const void *a, const void *b)
+{
+    const struct sizeOrderEnt_s *oa = a, *ob = b;
+
+    if (oa->sclass != ob->sclass)
+	return (ob->sclass - oa->sclass);	/* larger classes first */
+    return (oa->fx - ob->fx);			/* path order within a class */
+}
+
+/*
+ * Payload file order for the "size" sort policy: power-of-two size
+ * classes at one megabyte granularity, largest first, keeping the
+ * path-sorted order (and thus directory locality) within each class.
+ * Files below the granularity all fall into class zero and retain the
+ * traditional order. Returns NULL if the policy is not enabled.
+ */
+static int * payloadSizeOrder(rpmfiles files)
+{
+    struct sizeOrderEnt_s *ents;
+    int *order;
+    int fc = rpmfilesFC(files);
+    char *sort = rpmExpand("%{?_payload_sort}", NULL);
+    int active = rstreq(sort, "size");
+
+    free(sort);
+    if (!active || fc < 2)
+	return NULL;
+
+    ents = xmalloc(fc * sizeof(*ents));
+    for (int i = 0; i < fc; i++) {
+	const int *links = NULL;
+	rpm_loff_t size = 0;
+	int ox = i;
+
+	/* Hard link sets travel as one unit, keyed by their first member */
+	if (rpmfilesFLinks(files, i, &links) > 1)
+	    ox = links[0];
+	if (S_ISREG(rpmfilesFMode(files, ox)))
+	    size = rpmfilesFSize(files, ox);
+
+	ents[i].fx = i;
+	ents[i].sclass = 0;
+	for (rpm_loff_t s = size >> 20; s; s >>= 1)
+	    ents[i].sclass++;
+    }
+    qsort(ents, fc, sizeof(*ents), sizeOrderCmp);
+
+    order = xmalloc(fc * sizeof(*order));
+    for (int i = 0; i < fc; i++)
+	order[i] = ents[i].fx;
+    free(ents);
+
+    return order;
+}
+
 static int rpmPackageFilesArchive(rpmfiles fi, int isSrc,
 				  FD_t cfd, ARGV_t dpaths,
-				  rpm_loff_t * archiveSize, char ** failedFile)
+				  rpm_loff_t * archiveSize, char ** failedFile,
+				  uint64_t * fileOffsets)
 {
     int rc = 0;
     rpmfi archive = rpmfiNewArchiveWriter(cfd, fi);
 
+    if (!isSrc) {
+	int *order = payloadSizeOrder(fi);
+	if (order) {
+	    rpmfiArchiveSetWriteOrder(archive, order);
+	    free(order);
+	}
+    }
+
     while (!rc && (rc = rpmfiNext(archive)) >= 0) {
         /* Copy file into archive. */
 	FD_t rfd = NULL;
 	const char *path = dpaths[rpmfiFX(archive)];
 
+	/* The cpio header is out, this is where the file data starts */
+	if (fileOffsets)
+	    fileOffsets[rpmfiFX(archive)] = rpmfiArchiveTell(archive);
+
 	rfd = Fopen(path, "r.ufdio");
 	if (Ferror(rfd)) {
 	    rc = RPMERR_OPEN_FAILED;
@@ -70,7 +146,10 @@ static int rpmPackageFilesArchive(rpmfiles fi, int isSrc,
  */
 static rpmRC cpio_doio(FD_t fdo, Package pkg, const char * fmodeMacro,
 			int pld_algo,
-			rpm_loff_t *archiveSize, char ** pldig)
+			rpm_loff_t *archiveSize, char ** pldig,
+			uint64_t * fileOffsets,
+			uint64_t ** framecofs, uint64_t ** frameuofs,
+			size_t * nframes)
 {
     char *failedFile = NULL;
     FD_t cfd;
@@ -85,9 +164,16 @@ static rpmRC cpio_doio(FD_t fdo, Package pkg, const char * fmodeMacro,
     fdInitDigestID(cfd, pld_algo, RPMTAG_PAYLOADDIGESTALT, 0);
     fsmrc = rpmPackageFilesArchive(pkg->cpioList, headerIsSource(pkg->header),
 				   cfd, pkg->dpaths,
-				   archiveSize, &failedFile);
+				   archiveSize, &failedFile, fileOffsets);
     fdFiniDigest(cfd, RPMTAG_PAYLOADDIGESTALT, (void **)pldig, NULL, 1);
 
+    /* Collect the compressed frame index for the payload index tags */
+    if (fsmrc == 0 && framecofs) {
+	(void) Fflush(cfd);
+	if (fdZstdFrameIndex(cfd, framecofs, frameuofs, nframes))
+	    *nframes = 0;
+    }
+
     if (fsmrc) {
 	char *emsg = rpmfileStrerror(fsmrc);
 	if (failedFile)
@@ -271,6 +357,153 @@ static int haveRichDep(Package pkg)
     return 0;
 }
 
+/*
+ * Auto-selected payload compression ("auto" in %_binary_payload): read
+ * the head of the staged payload (%_payload_auto_sample megabytes, in
+ * file index order), trial-compress that sample with every candidate
+ * from %_payload_auto_candidates and take the fastest candidate whose
+ * compressed size stays within %_payload_auto_margin percent of the
+ * smallest. On incompressible payloads the sizes all but tie and the
+ * cheap setting wins, on compressible ones the strong settings keep
+ * their edge. Trials run one after the other on purpose: concurrent
+ * trials would contend for the CPU and skew the timings. Returns NULL
+ * if no sample could be taken, the caller falls back to the default.
+ */
+static char *autoIOFlags(Package pkg)
+{
+    rpmfiles fi = pkg->cpioList;
+    char *cands = NULL;
+    ARGV_t av = NULL;
+    int ncand;
+    char *sample = NULL;
+    size_t samplemax, sampled = 0;
+    int64_t mb = rpmExpandNumeric("%{?_payload_auto_sample}");
+    int64_t margin;
+    rpm_loff_t *sizes = NULL;
+    rpmtime_t *usecs = NULL;
+    rpm_loff_t minsize = 0, limit;
+    char *pick = NULL;
+    int pickx = -1;
+    int fc;
+
+    if (fi == NULL)
+	return NULL;
+
+    {
+	char *s = rpmExpand("%{?_payload_auto_margin}", NULL);
+	margin = (*s != '\0') ? strtoll(s, NULL, 0) : 5;
+	free(s);
+    }
+    if (mb <= 0)
+	mb = 16;
+    samplemax = (size_t)mb * 1024 * 1024;
+
+    /* Gather the sample from the staged files */
+    sample = xmalloc(samplemax);
+    fc = rpmfilesFC(fi);
+    for (int i = 0; i < fc && sampled < samplemax; i++) {
+	rpm_loff_t fsize = rpmfilesFSize(fi, i);
+	size_t n = samplemax - sampled;
+	FD_t rfd;
+
+	if (!S_ISREG(rpmfilesFMode(fi, i)) ||
+		(rpmfilesFFlags(fi, i) & RPMFILE_GHOST) || fsize == 0)
+	    continue;
+	if (n > fsize)
+	    n = fsize;
+	rfd = Fopen(pkg->dpaths[i], "r.ufdio");
+	if (rfd == NULL || Ferror(rfd)) {
+	    /* Leave the problem for the payload writer to report */
+	    if (rfd)
+		Fclose(rfd);
+	    continue;
+	}
+	if (Fread(sample + sampled, 1, n, rfd) == n)
+	    sampled += n;
+	Fclose(rfd);
+    }
+    if (sampled == 0)
+	goto exit;
+
+    cands = rpmExpand("%{?_payload_auto_candidates}", NULL);
+    if (*cands == '\0') {
+	free(cands);
+	cands = xstrdup("w9.gzdio"
+#if HAVE_LZMA_H
+			" w6.xzdio"
+#endif
+#ifdef HAVE_ZSTD
+			" w19.zstdio w3.zstdio"
+#endif
+			);
+    }
+    argvSplit(&av, cands, " \t");
+    ncand = argvCount(av);
+    sizes = xcalloc(ncand ? ncand : 1, sizeof(*sizes));
+    usecs = xcalloc(ncand ? ncand : 1, sizeof(*usecs));
+
+    for (int i = 0; i < ncand; i++) {
+	char *tfn = NULL;
+	FD_t tfd, cfd;
+	struct rpmsw_s begin, end;
+	struct stat sb;
+
+	if (av[i][0] != 'w' || strchr(av[i], '.') == NULL)
+	    continue;
+	tfd = rpmMkTempFile(NULL, &tfn);
+	if (tfd == NULL || Ferror(tfd)) {
+	    if (tfd)
+		Fclose(tfd);
+	    free(tfn);
+	    continue;
+	}
+	unlink(tfn);
+	free(tfn);
+
+	rpmswNow(&begin);
+	cfd = Fdopen(fdDup(Fileno(tfd)), av[i]);
+	if (cfd != NULL && !Ferror(cfd) &&
+		Fwrite(sample, 1, sampled, cfd) == sampled &&
+		Fclose(cfd) == 0) {
+	    rpmswNow(&end);
+	    if (fstat(Fileno(tfd), &sb) == 0 && sb.st_size > 0) {
+		sizes[i] = sb.st_size;
+		usecs[i] = rpmswDiff(&end, &begin);
+	    }
+	} else if (cfd != NULL) {
+	    Fclose(cfd);
+	}
+	Fclose(tfd);
+    }
+
+    for (int i = 0; i < ncand; i++)
+	if (sizes[i] > 0 && (minsize == 0 || sizes[i] < minsize))
+	    minsize = sizes[i];
+    if (minsize == 0)
+	goto exit;
+
+    limit = minsize + minsize * margin / 100;
+    for (int i = 0; i < ncand; i++) {
+	if (sizes[i] == 0 || sizes[i] > limit)
+	    continue;
+	if (pickx < 0 || usecs[i] < usecs[pickx])
+	    pickx = i;
+    }
+    pick = xstrdup(av[pickx]);
+    rpmlog(RPMLOG_DEBUG,
+	    "auto payload compression: %s (%zu byte sample -> %llu bytes in %lu ms)\n",
+	    pick, sampled, (long long unsigned) sizes[pickx],
+	    (unsigned long) (usecs[pickx] / 1000));
+
+exit:
+    free(sizes);
+    free(usecs);
+    argvFree(av);
+    free(cands);
+    free(sample);
+    return pick;
+}
+
 static char *getIOFlags(Package pkg)
 {
     char *rpmio_flags;
@@ -279,9 +512,17 @@ static char *getIOFlags(Package pkg)
     /* Save payload information */
     if (headerIsSource(pkg->header))
 	rpmio_flags = rpmExpand("%{?_source_payload}", NULL);
-    else 
+    else
 	rpmio_flags = rpmExpand("%{?_binary_payload}", NULL);
 
+    /* Trial-compress a payload sample to pick the settings */
+    if (rstreq(rpmio_flags, "auto")) {
+	free(rpmio_flags);
+	rpmio_flags = autoIOFlags(pkg);
+	if (rpmio_flags == NULL)
+	    rpmio_flags = xstrdup("");
+    }
+
     /* If not configured or bogus, fall back to gz */
     if (rpmio_flags[0] != 'w') {
 	free(rpmio_flags);
@@ -407,26 +648,78 @@ static rpmRC fdConsume(FD_t fd, off_t start, off_t nbytes)
 
 static rpmRC writeHdr(FD_t fd, Header pkgh)
 {
-    /* Reallocate the header into one contiguous region for writing. */
-    Header h = headerReload(headerCopy(pkgh), RPMTAG_HEADERIMMUTABLE);
-    rpmRC rc = RPMRC_FAIL;
-
-    if (h == NULL) {
-	rpmlog(RPMLOG_ERR,_("Unable to create immutable header region\n"));
-	goto exit;
-    }
-
-    if (headerWrite(fd, h, HEADER_MAGIC_YES)) {
+    /* Write the header wrapped in one contiguous immutable region,
+     * without materializing the reloaded copy. */
+    if (headerWriteRegion(fd, pkgh, RPMTAG_HEADERIMMUTABLE, HEADER_MAGIC_YES)) {
 	rpmlog(RPMLOG_ERR, _("Unable to write header to %s: %s\n"),
 		Fdescr(fd), Fstrerror(fd));
-	goto exit;
+	return RPMRC_FAIL;
     }
     (void) Fflush(fd);
-    rc = RPMRC_OK;
+    return RPMRC_OK;
+}
 
-exit:
-    headerFree(h);
-    return rc;
+/*
+ * Tiny payloads (%_inline_payload_max): when the content of all regular
+ * files in a package fits the configured budget, embed it into the header
+ * as one blob in file index order. The payload is still written as usual
+ * so the package installs and unpacks anywhere, but an rpm that knows the
+ * tag can lay the files down without ever opening the payload stream -
+ * for one-file configuration packages that setup dwarfs the byte count.
+ * Ghost files carry no content and hardlink content association is left
+ * to the payload, a package with hardlinks is not embedded.
+ */
+static void addInlinePayload(Package pkg)
+{
+    rpmfiles fi = pkg->cpioList;
+    int64_t max = rpmExpandNumeric("%{?_inline_payload_max}");
+    rpm_loff_t total = 0;
+    uint8_t *data = NULL;
+    size_t off = 0;
+    int fc;
+
+    if (max <= 0 || fi == NULL || headerIsSource(pkg->header))
+	return;
+
+    fc = rpmfilesFC(fi);
+    for (int i = 0; i < fc; i++) {
+	if (!S_ISREG(rpmfilesFMode(fi, i)) ||
+		(rpmfilesFFlags(fi, i) & RPMFILE_GHOST))
+	    continue;
+	if (rpmfilesFNlink(fi, i) > 1)
+	    return;
+	total += rpmfilesFSize(fi, i);
+	if (total > (rpm_loff_t)max)
+	    return;
+    }
+    if (total == 0)
+	return;
+
+    data = xmalloc(total);
+    for (int i = 0; i < fc; i++) {
+	rpm_loff_t fsize = rpmfilesFSize(fi, i);
+	FD_t rfd;
+
+	if (!S_ISREG(rpmfilesFMode(fi, i)) ||
+		(rpmfilesFFlags(fi, i) & RPMFILE_GHOST) || fsize == 0)
+	    continue;
+
+	rfd = Fopen(pkg->dpaths[i], "r.ufdio");
+	if (Ferror(rfd) || Fread(data + off, 1, fsize, rfd) != fsize) {
+	    /* Leave the problem for the payload writer to report */
+	    if (rfd)
+		Fclose(rfd);
+	    free(data);
+	    return;
+	}
+	Fclose(rfd);
+	off += fsize;
+    }
+
+    headerPutBin(pkg->header, RPMTAG_FILEDATA, data, total);
+    rpmlog(RPMLOG_DEBUG, "embedded %u bytes of file data in header\n",
+	   (unsigned)total);
+    free(data);
 }
 
 /*
@@ -457,6 +750,11 @@ static rpmRC writeRPM(Package pkg, unsigned char ** pkgidp,
     rpmRC rc = RPMRC_FAIL; /* assume failure */
     rpm_loff_t archiveSize = 0;
     off_t sigStart, hdrStart, payloadStart, payloadEnd;
+    uint64_t *fileOffsets = NULL;
+    uint64_t *framecofs = NULL;
+    uint64_t *frameuofs = NULL;
+    size_t nframes = 0;
+    rpm_count_t nfiles = 0;
 
     if (pkgidp)
 	*pkgidp = NULL;
@@ -465,6 +763,27 @@ static rpmRC writeRPM(Package pkg, unsigned char ** pkgidp,
     if (!rpmio_flags)
 	goto exit;
 
+    /* Record the payload file ordering if a non-default policy is used */
+    if (!headerIsSource(pkg->header)) {
+	char *sort = rpmExpand("%{?_payload_sort}", NULL);
+	if (rstreq(sort, "size"))
+	    headerPutString(pkg->header, RPMTAG_PAYLOADSORT, sort);
+	else if (*sort != '\0')
+	    rpmlog(RPMLOG_WARNING,
+		   _("Unknown payload sort policy: %s\n"), sort);
+	free(sort);
+
+	/* Tiny payloads can ride along in the header */
+	addInlinePayload(pkg);
+    }
+
+    /* Chunked payloads get an index for seeking to individual files */
+    {	const char *dot = strchr(rpmio_flags, '.');
+	if (dot && rstreq(dot + 1, "zstdio") &&
+		memchr(rpmio_flags, 'C', dot - rpmio_flags))
+	    nfiles = rpmfilesFC(pkg->cpioList);
+    }
+
     finalizeDeps(pkg);
 
     /* Create and add the cookie */
@@ -479,7 +798,18 @@ static rpmRC writeRPM(Package pkg, unsigned char ** pkgidp,
     headerPutString(pkg->header, RPMTAG_PAYLOADDIGEST, pld);
     headerPutString(pkg->header, RPMTAG_PAYLOADDIGESTALT, pld);
     pld = _free(pld);
-    
+
+    /* Create dummy payload index tags, also just to get the size right */
+    if (nfiles > 0) {
+	fileOffsets = xmalloc(nfiles * sizeof(*fileOffsets));
+	for (rpm_count_t i = 0; i < nfiles; i++)
+	    fileOffsets[i] = UINT64_MAX;
+	headerPutUint64(pkg->header, RPMTAG_PAYLOADFRAMEOFFSETS,
+			fileOffsets, nfiles);
+	headerPutUint64(pkg->header, RPMTAG_PAYLOADFILEOFFSETS,
+			fileOffsets, nfiles);
+    }
+
     /* Check for UTF-8 encoding of string tags, add encoding tag if all good */
     if (checkForEncoding(pkg->header, 1))
 	goto exit;
@@ -518,7 +848,9 @@ static rpmRC writeRPM(Package pkg, unsigned char ** pkgidp,
 
     /* Write payload section (cpio archive) */
     payloadStart = Ftell(fd);
-    if (cpio_doio(fd, pkg, rpmio_flags, pld_algo, &archiveSize, &upld))
+    if (cpio_doio(fd, pkg, rpmio_flags, pld_algo, &archiveSize, &upld,
+		  fileOffsets, nfiles ? &framecofs : NULL, &frameuofs,
+		  &nframes))
 	goto exit;
     payloadEnd = Ftell(fd);
 
@@ -535,22 +867,52 @@ static rpmRC writeRPM(Package pkg, unsigned char ** pkgidp,
     headerPutString(pkg->header, RPMTAG_PAYLOADDIGESTALT, upld);
     pld = _free(pld);
 
-    /* Write the final header */
+    /* Fill in the payload index now that the frame locations are known */
+    if (nfiles > 0) {
+	uint64_t *frames = xmalloc(nfiles * sizeof(*frames));
+	for (rpm_count_t i = 0; i < nfiles; i++) {
+	    frames[i] = UINT64_MAX;
+	    if (fileOffsets[i] == UINT64_MAX || nframes == 0) {
+		fileOffsets[i] = UINT64_MAX;
+		continue;
+	    }
+	    /* Find the frame holding the file's first data byte */
+	    size_t lo = 0, hi = nframes - 1;
+	    while (lo < hi) {
+		size_t mid = (lo + hi + 1) / 2;
+		if (frameuofs[mid] <= fileOffsets[i])
+		    lo = mid;
+		else
+		    hi = mid - 1;
+	    }
+	    frames[i] = framecofs[lo];
+	    fileOffsets[i] -= frameuofs[lo];
+	}
+	headerDel(pkg->header, RPMTAG_PAYLOADFRAMEOFFSETS);
+	headerPutUint64(pkg->header, RPMTAG_PAYLOADFRAMEOFFSETS,
+			frames, nfiles);
+	headerDel(pkg->header, RPMTAG_PAYLOADFILEOFFSETS);
+	headerPutUint64(pkg->header, RPMTAG_PAYLOADFILEOFFSETS,
+			fileOffsets, nfiles);
+	free(frames);
+    }
+
+    /* Write the final header with the digests teed off the write:
+     * SHA1/SHA256 cover the header region alone and finish here, the
+     * legacy MD5 continues over the payload below. No need to re-read
+     * what we just wrote. */
     if (fdJump(fd, hdrStart))
 	goto exit;
-    if (writeHdr(fd, pkg->header))
-	goto exit;
-
-    /* Calculate digests: SHA on header, legacy MD5 on header + payload */
     fdInitDigestID(fd, PGPHASHALGO_MD5, RPMTAG_SIGMD5, 0);
     fdInitDigestID(fd, PGPHASHALGO_SHA1, RPMTAG_SHA1HEADER, 0);
     fdInitDigestID(fd, PGPHASHALGO_SHA256, RPMTAG_SHA256HEADER, 0);
-    if (fdConsume(fd, hdrStart, payloadStart - hdrStart))
+    if (writeHdr(fd, pkg->header))
 	goto exit;
     fdFiniDigest(fd, RPMTAG_SHA1HEADER, (void **)&SHA1, NULL, 1);
     fdFiniDigest(fd, RPMTAG_SHA256HEADER, (void **)&SHA256, NULL, 1);
 
-    if (fdConsume(fd, 0, payloadEnd - payloadStart))
+    /* The payload is already on disk, one re-read finishes the MD5 */
+    if (fdConsume(fd, payloadStart, payloadEnd - payloadStart))
 	goto exit;
     fdFiniDigest(fd, RPMTAG_SIGMD5, (void **)&MD5, NULL, 0);
 
@@ -568,6 +930,9 @@ exit:
     free(SHA1);
     free(SHA256);
     free(upld);
+    free(fileOffsets);
+    free(framecofs);
+    free(frameuofs);
 
     /* XXX Fish the pkgid out of the signature header. */
     if (pkgidp != NULL) {
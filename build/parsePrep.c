@@ -222,6 +222,33 @@ exit:
 		    "fi") : NULL;
 }
 
+/**
+ * Append an extraction command as a background job, collecting its pid
+ * for a later appendUntarWait() barrier.
+ * @param sbuf		script fragment to append to
+ * @param cmd		extraction command(s)
+ */
+static void appendBackgroundUntar(StringBuf sbuf, const char *cmd)
+{
+    appendLineStringBuf(sbuf, "(");
+    appendLineStringBuf(sbuf, cmd);
+    appendLineStringBuf(sbuf, ") &");
+    appendLineStringBuf(sbuf, "RPMSETUPPIDS=\"$RPMSETUPPIDS $!\"");
+}
+
+/**
+ * Wait for background extractions, failing the script if any failed.
+ * @param sbuf		script fragment to append to
+ */
+static void appendUntarWait(StringBuf sbuf)
+{
+    appendLineStringBuf(sbuf,
+	"for RPMSETUPPID in $RPMSETUPPIDS; do\n"
+	"  wait $RPMSETUPPID || exit 1\n"
+	"done\n"
+	"RPMSETUPPIDS=");
+}
+
 /**
  * Parse %setup macro.
  * @param spec		build info
@@ -242,6 +269,8 @@ static int doSetupMacro(rpmSpec spec, const char *line)
     uint32_t num;
     int leaveDirs = 0, skipDefaultAction = 0;
     int createDir = 0, quietly = 0;
+    int jobs = 0;
+    int nbefore = 0, nafter = 0;
     char * dirName = NULL;
     struct poptOption optionsTable[] = {
 	    { NULL, 'a', POPT_ARG_STRING, NULL, 'a',	NULL, NULL},
@@ -266,6 +295,8 @@ static int doSetupMacro(rpmSpec spec, const char *line)
 	goto exit;
     }
 
+    jobs = rpmExpandNumeric("%{?_setup_unpack_jobs}");
+
     optCon = poptGetContext(NULL, argc, argv, optionsTable, 0);
     while ((arg = poptGetNextOpt(optCon)) > 0) {
 	char *optArg = poptGetOptArg(optCon);
@@ -279,10 +310,23 @@ static int doSetupMacro(rpmSpec spec, const char *line)
 	}
 
 	{   char *chptr = doUntar(spec, num, quietly);
+	    StringBuf sb = (arg == 'a' ? after : before);
 	    if (chptr == NULL)
 		goto exit;
 
-	    appendLineStringBuf((arg == 'a' ? after : before), chptr);
+	    /*
+	     * Extractions within the same group (-a resp. -b) are
+	     * independent, run them as background jobs up to the
+	     * configured width and barrier before the group ends.
+	     */
+	    if (jobs > 1) {
+		int *n = (arg == 'a' ? &nafter : &nbefore);
+		appendBackgroundUntar(sb, chptr);
+		if (++(*n) % jobs == 0)
+		    appendUntarWait(sb);
+	    } else {
+		appendLineStringBuf(sb, chptr);
+	    }
 	    free(chptr);
 	}
 	free(optArg);
@@ -291,11 +335,17 @@ static int doSetupMacro(rpmSpec spec, const char *line)
     if (arg < -1) {
 	rpmlog(RPMLOG_ERR, _("line %d: Bad %%setup option %s: %s\n"),
 		 spec->lineNum,
-		 poptBadOption(optCon, POPT_BADOPTION_NOALIAS), 
+		 poptBadOption(optCon, POPT_BADOPTION_NOALIAS),
 		 poptStrerror(arg));
 	goto exit;
     }
 
+    /* All -b extractions must land before the cd, -a ones before the end */
+    if (jobs > 1 && nbefore % jobs)
+	appendUntarWait(before);
+    if (jobs > 1 && nafter % jobs)
+	appendUntarWait(after);
+
     if (dirName) {
 	spec->buildSubdir = xstrdup(dirName);
     } else {
@@ -201,6 +201,12 @@ int specExpand(rpmSpec spec, int lineno, const char *sbuf,
     char lnobuf[16];
     int rc;
 
+    /* Lines without macros are their own expansion */
+    if (strchr(sbuf, '%') == NULL) {
+	*obuf = xstrdup(sbuf);
+	return 0;
+    }
+
     snprintf(lnobuf, sizeof(lnobuf), "%d", lineno);
     rpmPushMacroFlags(spec->macros, "__file_lineno", NULL, lnobuf, RMIL_SPEC, RPMMACRO_LITERAL);
 
@@ -233,6 +239,14 @@ static int expandMacrosInSpecBuf(rpmSpec spec, int strip)
 		condition->text, spec->lineNum, lbuf);
     }
 
+    /*
+     * Caller only wants control flow: expand nothing but conditionals,
+     * %include and section markers. Everything else (including any
+     * embedded Lua) is passed through untouched and skimmed over.
+     */
+    if ((strip & STRIP_NOEXPAND) && condition == NULL && !isPart(lbuf))
+	return 0;
+
     /* Don't expand macros after %elif (resp. %elifarch, %elifos) in a false branch */
     if (condition && (condition->id & LINE_ELIFANY)) {
 	if (!spec->readStack->readable)
@@ -243,6 +257,10 @@ static int expandMacrosInSpecBuf(rpmSpec spec, int strip)
 	    return 0;
     }
 
+    /* Skip the expansion machinery if there's nothing to expand */
+    if (strchr(spec->lbuf, '%') == NULL)
+	return 0;
+
     if (specExpand(spec, ofi->lineNum, spec->lbuf, &lbuf))
 	return 1;
 
@@ -414,19 +432,20 @@ retry:
     return 0;
 }
 
-#define ARGMATCH(s,token,match) \
+/* The target is fixed for the duration of a parse (buildarch re-parses
+ * get a fresh spec), expand it once instead of on every conditional. */
+#define ARGMATCH(s,cache,token,match) \
 do { \
     char *os = s; \
-    char *exp = rpmExpand(token, NULL); \
+    if ((cache) == NULL) \
+	(cache) = rpmExpand(token, NULL); \
     while (*s && !risblank(*s)) s++; \
     while (*s && risblank(*s)) s++; \
     if (!*s) { \
 	rpmlog(RPMLOG_ERR, _("%s:%d: Argument expected for %s\n"), ofi->fileName, ofi->lineNum, os); \
-	free(exp); \
 	return PART_ERROR; \
     } \
-    match = matchTok(exp, s); \
-    free(exp); \
+    match = matchTok(cache, s); \
 } while (0)
 
 
@@ -490,14 +509,14 @@ retry:
     }
 
     if (lineType->id & (LINE_IFARCH | LINE_ELIFARCH)) {
-	ARGMATCH(s, "%{_target_cpu}", match);
+	ARGMATCH(s, spec->targetCpu, "%{_target_cpu}", match);
     } else if (lineType->id == LINE_IFNARCH) {
-	ARGMATCH(s, "%{_target_cpu}", match);
+	ARGMATCH(s, spec->targetCpu, "%{_target_cpu}", match);
 	match = !match;
     } else if (lineType->id & (LINE_IFOS | LINE_ELIFOS)) {
-	ARGMATCH(s, "%{_target_os}", match);
+	ARGMATCH(s, spec->targetOs, "%{_target_os}", match);
     } else if (lineType->id == LINE_IFNOS) {
-	ARGMATCH(s, "%{_target_os}", match);
+	ARGMATCH(s, spec->targetOs, "%{_target_os}", match);
 	match = !match;
     } else if (lineType->id & (LINE_IF | LINE_ELIF)) {
 	s += lineType->textLen;
@@ -883,6 +902,48 @@ exit:
     return res;
 }
 
+/* Section bodies that carry no dependency data, skimmable in partial parse */
+static int isBodyPart(int part)
+{
+    int rc;
+
+    switch (part) {
+    case PART_PREP:
+    case PART_BUILDREQUIRES:
+    case PART_BUILD:
+    case PART_INSTALL:
+    case PART_CHECK:
+    case PART_CLEAN:
+    case PART_CHANGELOG:
+    case PART_DESCRIPTION:
+    case PART_PRE:
+    case PART_POST:
+    case PART_PREUN:
+    case PART_POSTUN:
+    case PART_PRETRANS:
+    case PART_POSTTRANS:
+    case PART_VERIFYSCRIPT:
+    case PART_TRIGGERPREIN:
+    case PART_TRIGGERIN:
+    case PART_TRIGGERUN:
+    case PART_TRIGGERPOSTUN:
+    case PART_FILETRIGGERIN:
+    case PART_FILETRIGGERUN:
+    case PART_FILETRIGGERPOSTUN:
+    case PART_TRANSFILETRIGGERIN:
+    case PART_TRANSFILETRIGGERUN:
+    case PART_TRANSFILETRIGGERPOSTUN:
+    case PART_FILES:
+    case PART_POLICIES:
+	rc = 1;
+	break;
+    default:
+	rc = 0;
+	break;
+    }
+    return rc;
+}
+
 static rpmSpec parseSpec(const char *specFile, rpmSpecFlags flags,
 			 const char *buildRoot, int recursing)
 {
@@ -915,6 +976,10 @@ static rpmSpec parseSpec(const char *specFile, rpmSpecFlags flags,
     while (parsePart != PART_NONE) {
 	int goterror = 0;
 	storedParsePart = parsePart;
+	if ((spec->flags & RPMSPEC_PARTIAL) && isBodyPart(parsePart)) {
+	    /* Partial parse: skim the section body without expanding it */
+	    parsePart = parseLines(spec, STRIP_NOEXPAND, NULL, NULL);
+	} else
 	switch (parsePart) {
 	case PART_ERROR: /* fallthrough */
 	default:
@@ -1077,12 +1142,14 @@ static rpmSpec parseSpec(const char *specFile, rpmSpecFlags flags,
 	free(body);
     }
 
-    /* Check for description in each package */
-    for (Package pkg = spec->packages; pkg != NULL; pkg = pkg->next) {
-	if (!headerIsEntry(pkg->header, RPMTAG_DESCRIPTION)) {
-	    rpmlog(RPMLOG_ERR, _("Package has no %%description: %s\n"),
-		   headerGetString(pkg->header, RPMTAG_NAME));
-	    goto errxit;
+    /* Check for description in each package (skimmed over in partial parse) */
+    if (!(spec->flags & RPMSPEC_PARTIAL)) {
+	for (Package pkg = spec->packages; pkg != NULL; pkg = pkg->next) {
+	    if (!headerIsEntry(pkg->header, RPMTAG_DESCRIPTION)) {
+		rpmlog(RPMLOG_ERR, _("Package has no %%description: %s\n"),
+		       headerGetString(pkg->header, RPMTAG_NAME));
+		goto errxit;
+	    }
 	}
     }
 
@@ -119,6 +119,9 @@ struct rpmSpec_s {
 
     struct ReadLevelEntry * readStack;
 
+    char * targetCpu;	/*!< Cached %{_target_cpu} for arch conditionals */
+    char * targetOs;	/*!< Cached %{_target_os} for os conditionals */
+
     Header buildRestrictions;
     rpmSpec * BASpecs;
     const char ** BANames;
@@ -248,6 +251,7 @@ typedef enum rpmParseState_e {
 #define STRIP_NOTHING             0
 #define STRIP_TRAILINGSPACE (1 << 0)
 #define STRIP_COMMENTS      (1 << 1)
+#define STRIP_NOEXPAND      (1 << 2)
 
 #define ALLOW_EMPTY         (1 << 16)
 
@@ -605,6 +609,52 @@ void * specLuaFini(rpmSpec spec);
 
 RPM_GNUC_INTERNAL
 void addLuaSource(rpmlua lua, const struct Source *p);
+
+/** \ingroup rpmbuild
+ * Persistent per-file metadata cache (see build/fmetacache.c)
+ */
+typedef struct fmetaCache_s * fmetaCache;
+
+/** \ingroup rpmbuild
+ * Open the file metadata cache, loading previously saved entries.
+ * @return		cache handle, NULL if disabled (%_fmetacache_path unset)
+ */
+RPM_GNUC_INTERNAL
+fmetaCache fmetaCacheOpen(void);
+
+/** \ingroup rpmbuild
+ * Look up a cached value. Thread-safe wrt other lookups and fmetaCachePut().
+ * @param fmc		cache handle (NULL is fine)
+ * @param ns		value namespace (eg "class", "digest8")
+ * @param path		file path the value was computed from
+ * @param mtime		file modification time at computation
+ * @param size		file size at computation
+ * @return		cached value, NULL on miss (valid until cache freed)
+ */
+RPM_GNUC_INTERNAL
+const char *fmetaCacheGet(fmetaCache fmc, const char *ns, const char *path,
+			  time_t mtime, off_t size);
+
+/** \ingroup rpmbuild
+ * Add a freshly computed value, to be saved when the cache is freed.
+ * @param fmc		cache handle (NULL is fine)
+ * @param ns		value namespace
+ * @param path		file path the value was computed from
+ * @param mtime		file modification time at computation
+ * @param size		file size at computation
+ * @param value		value to cache (copied)
+ */
+RPM_GNUC_INTERNAL
+void fmetaCachePut(fmetaCache fmc, const char *ns, const char *path,
+		   time_t mtime, off_t size, const char *value);
+
+/** \ingroup rpmbuild
+ * Save new entries to disk and free the cache.
+ * @param fmc		cache handle (NULL is fine)
+ * @return		NULL always
+ */
+RPM_GNUC_INTERNAL
+fmetaCache fmetaCacheFree(fmetaCache fmc);
 #ifdef __cplusplus
 }
 #endif
@@ -313,19 +313,26 @@ static int getOutputFrom(ARGV_t argv,
 	dup2(fromProg[1], STDOUT_FILENO); /* Make stdout the out pipe */
 	close(fromProg[1]);
 
-	rpmlog(RPMLOG_DEBUG, "\texecv(%s) pid %d\n",
-                        argv[0], (unsigned)getpid());
-
 	if (buildRoot)
 	    setenv("RPM_BUILD_ROOT", buildRoot, 1);
 
 	unsetenv("MALLOC_CHECK_");
 	execvp(argv[0], (char *const *)argv);
-	rpmlog(RPMLOG_ERR, _("Couldn't exec %s: %s\n"),
-		argv[0], strerror(errno));
+	/* Keep stdio, gettext and rpmlog locks out of the forked child
+	 * of what may be a threaded process */
+	{
+	    char errbuf[BUFSIZ];
+	    int nb = snprintf(errbuf, sizeof(errbuf),
+			      "Couldn't exec %s: %s\n",
+			      argv[0], strerror(errno));
+	    if (nb > 0)
+		nb = write(STDERR_FILENO, errbuf, nb);
+	}
 	_exit(EXIT_FAILURE);
     }
 
+    rpmlog(RPMLOG_DEBUG, "\texecv(%s) pid %d\n", argv[0], (unsigned)child);
+
     if (!doio)
 	goto reap;
 
@@ -500,7 +507,7 @@ static void argvAddUniq(ARGV_t * argvp, const char * key)
 static void rpmfcAddFileDep(rpmfcFileDeps *fileDeps, rpmds ds, int ix)
 {
     if (fileDeps->size == fileDeps->alloced) {
-	fileDeps->alloced <<= 2;
+	fileDeps->alloced = fileDeps->alloced ? (fileDeps->alloced << 2) : 10;
 	fileDeps->data  = xrealloc(fileDeps->data,
 	    fileDeps->alloced * sizeof(fileDeps->data[0]));
     }
@@ -557,6 +564,7 @@ static ARGV_t runCall(const char *name, const char *buildRoot, const char *fn)
 
 struct addReqProvDataFc {
     rpmfc fc;
+    rpmfcFileDeps *deps;
     const char *namespace;
     regex_t *exclude;
 };
@@ -573,7 +581,7 @@ static rpmRC addReqProvFc(void *cbdata, rpmTagVal tagN,
     rpmds ds = rpmdsSingleNS(fc->pool, tagN, namespace, N, EVR, Flags);
     /* Add to package and file dependencies unless filtered */
     if (regMatch(exclude, rpmdsDNEVR(ds)+2) == 0)
-	rpmfcAddFileDep(&fc->fileDeps, ds, index);
+	rpmfcAddFileDep(data->deps, ds, index);
 
     return RPMRC_OK;
 }
@@ -601,7 +609,8 @@ static void exclFini(struct exclreg_s *excl)
 
 static int rpmfcHelper(rpmfc fc, int ix, const struct exclreg_s *excl,
 		       rpmsenseFlags dsContext, rpmTagVal tagN,
-		       const char *namespace, const char *mname)
+		       const char *namespace, const char *mname,
+		       rpmfcFileDeps *deps)
 {
     ARGV_t pav = NULL;
     const char * fn = fc->fn[ix];
@@ -628,6 +637,7 @@ static int rpmfcHelper(rpmfc fc, int ix, const struct exclreg_s *excl,
 
     struct addReqProvDataFc data;
     data.fc = fc;
+    data.deps = deps;
     data.namespace = namespace;
     data.exclude = excl->exclude;
 
@@ -1035,11 +1045,25 @@ static int applyAttr(rpmfc fc, int aix, const char *aname,
 
 	if (rpmMacroIsDefined(NULL, mname)) {
 	    char *ns = rpmfcAttrMacro(aname, "namespace", NULL);
+	    rpmfcFileDeps *deps = xcalloc(n, sizeof(*deps));
+
+	    /* Run the helpers concurrently, collecting into per-file
+	     * accumulators; merged in file order below so the resulting
+	     * dependency set is deterministic. */
+	    #pragma omp parallel for schedule(dynamic) reduction(|:rc)
 	    for (int i = 0; i < n; i++) {
-		if (rpmfcHelper(fc, ixs[i], excl, dep->type, dep->tag,
-				ns, mname))
-		    rc = 1;
+		rc |= (rpmfcHelper(fc, ixs[i], excl, dep->type, dep->tag,
+				   ns, mname, &deps[i]) != 0);
 	    }
+
+	    for (int i = 0; i < n; i++) {
+		for (int j = 0; j < deps[i].size; j++) {
+		    rpmfcAddFileDep(&fc->fileDeps, deps[i].data[j].dep,
+				    deps[i].data[j].fileIx);
+		}
+		free(deps[i].data);
+	    }
+	    free(deps);
 	    free(ns);
 	}
 	free(mname);
@@ -1165,6 +1189,7 @@ rpmRC rpmfcClassify(rpmfc fc, ARGV_t argv, rpm_mode_t * fmode)
     int mimeflags = msflags | MAGIC_MIME_TYPE;
     int nerrors = 0;
     rpmRC rc = RPMRC_FAIL;
+    fmetaCache fmc = NULL;
 
     if (fc == NULL) {
 	rpmlog(RPMLOG_ERR, _("Empty file classifier\n"));
@@ -1195,6 +1220,8 @@ rpmRC rpmfcClassify(rpmfc fc, ARGV_t argv, rpm_mode_t * fmode)
     /* Build (sorted) file class dictionary. */
     fc->cdict = rpmstrPoolCreate();
 
+    fmc = fmetaCacheOpen();
+
     #pragma omp parallel
     {
     /* libmagic is not thread-safe, each thread needs to a private handle */
@@ -1225,66 +1252,95 @@ rpmRC rpmfcClassify(rpmfc fc, ARGV_t argv, rpm_mode_t * fmode)
 	int fcolor = RPMFC_BLACK;
 	rpm_mode_t mode = (fmode ? fmode[ix] : 0);
 	int is_executable = (mode & (S_IXUSR|S_IXGRP|S_IXOTH));
+	struct stat sb;
+	int statok = 0;
+	int ecolor = -1;
+	char *cval = NULL;
+
+	/* Reuse the previous classification for unchanged files */
+	if (fmc && (S_ISREG(mode) || S_ISLNK(mode)) && lstat(s, &sb) == 0) {
+	    const char *cached;
+	    statok = 1;
+	    cached = fmetaCacheGet(fmc, "class", s + fc->brlen,
+				   sb.st_mtime, sb.st_size);
+	    if (cached) {
+		/* "<elf color>\t<classification>\t<mime type>" */
+		char *se = cval = xstrdup(cached);
+		ecolor = strtol(cval, &se, 10);
+		if (*se == '\t' && (se = strchr(++se, '\t')) != NULL) {
+		    *se = '\0';
+		} else {
+		    /* malformed entry, classify anew */
+		    ecolor = -1;
+		    cval = _free(cval);
+		}
+	    }
+	}
 
-	switch (mode & S_IFMT) {
-	case S_IFCHR:	ftype = "character special";	break;
-	case S_IFBLK:	ftype = "block special";	break;
-	case S_IFIFO:	ftype = "fifo (named pipe)";	break;
-	case S_IFSOCK:	ftype = "socket";		break;
-	case S_IFDIR:	ftype = "directory";		break;
-	case S_IFLNK:
-	case S_IFREG:
-	default:
-	    /* XXX all files with extension ".pm" are perl modules for now. */
-	    if (rpmFileHasSuffix(s, ".pm"))
-		ftype = "Perl5 module source text";
-
-	    /* XXX all files with extension ".la" are libtool for now. */
-	    else if (rpmFileHasSuffix(s, ".la"))
-		ftype = "libtool library file";
-
-	    /* XXX all files with extension ".pc" are pkgconfig for now. */
-	    else if (rpmFileHasSuffix(s, ".pc"))
-		ftype = "pkgconfig file";
+	if (cval != NULL) {
+	    ftype = strchr(cval, '\t') + 1;
+	    fmime = ftype + strlen(ftype) + 1;
+	} else {
+	    switch (mode & S_IFMT) {
+	    case S_IFCHR:	ftype = "character special";	break;
+	    case S_IFBLK:	ftype = "block special";	break;
+	    case S_IFIFO:	ftype = "fifo (named pipe)";	break;
+	    case S_IFSOCK:	ftype = "socket";		break;
+	    case S_IFDIR:	ftype = "directory";		break;
+	    case S_IFLNK:
+	    case S_IFREG:
+	    default:
+		/* XXX all files with extension ".pm" are perl modules for now. */
+		if (rpmFileHasSuffix(s, ".pm"))
+		    ftype = "Perl5 module source text";
+
+		/* XXX all files with extension ".la" are libtool for now. */
+		else if (rpmFileHasSuffix(s, ".la"))
+		    ftype = "libtool library file";
+
+		/* XXX all files with extension ".pc" are pkgconfig for now. */
+		else if (rpmFileHasSuffix(s, ".pc"))
+		    ftype = "pkgconfig file";
+
+		/* XXX skip all files in /dev/ which are (or should be) %dev dummies. */
+		else if (slen >= fc->brlen+sizeof("/dev/") && rstreqn(s+fc->brlen, "/dev/", sizeof("/dev/")-1))
+		    ftype = "";
+		else
+		    ftype = magic_file(ms, s);
+
+		/* Silence errors from immaterial %ghosts */
+		if (ftype == NULL && errno == ENOENT)
+		    ftype = "";
+
+		if (ftype == NULL) {
+		    rpmlog(is_executable ? RPMLOG_ERR : RPMLOG_WARNING,
+			   _("Recognition of file \"%s\" failed: mode %06o %s\n"),
+			   s, mode, magic_error(ms));
+		    /* only executable files are critical to dep extraction */
+		    if (is_executable) {
+			nerrors++;
+		    }
+		    /* unrecognized non-executables get treated as "data" */
+		    ftype = "data";
+		}
+	    }
 
-	    /* XXX skip all files in /dev/ which are (or should be) %dev dummies. */
-	    else if (slen >= fc->brlen+sizeof("/dev/") && rstreqn(s+fc->brlen, "/dev/", sizeof("/dev/")-1))
-		ftype = "";
-	    else
-		ftype = magic_file(ms, s);
+	    fmime = magic_file(mime, s);
 
 	    /* Silence errors from immaterial %ghosts */
-	    if (ftype == NULL && errno == ENOENT)
-		ftype = "";
+	    if (fmime == NULL && errno == ENOENT)
+		fmime = "";
 
-	    if (ftype == NULL) {
-		rpmlog(is_executable ? RPMLOG_ERR : RPMLOG_WARNING, 
+	    if (fmime == NULL) {
+		rpmlog(is_executable ? RPMLOG_ERR : RPMLOG_WARNING,
 		       _("Recognition of file \"%s\" failed: mode %06o %s\n"),
 		       s, mode, magic_error(ms));
 		/* only executable files are critical to dep extraction */
 		if (is_executable) {
 		    nerrors++;
 		}
-		/* unrecognized non-executables get treated as "data" */
-		ftype = "data";
-	    }
-	}
-
-	fmime = magic_file(mime, s);
-
-	/* Silence errors from immaterial %ghosts */
-	if (fmime == NULL && errno == ENOENT)
-	    fmime = "";
-
-	if (fmime == NULL) {
-	    rpmlog(is_executable ? RPMLOG_ERR : RPMLOG_WARNING,
-		   _("Recognition of file \"%s\" failed: mode %06o %s\n"),
-		   s, mode, magic_error(ms));
-	    /* only executable files are critical to dep extraction */
-	    if (is_executable) {
-		nerrors++;
+		fmime = "application/octet-stream";
 	    }
-	    fmime = "application/octet-stream";
 	}
 
 	rpmlog(RPMLOG_DEBUG, "%s: %s (%s)\n", s, fmime, ftype);
@@ -1302,8 +1358,22 @@ rpmRC rpmfcClassify(rpmfc fc, ARGV_t argv, rpm_mode_t * fmode)
 	    fc->ftype[ix] = xstrdup(ftype);
 
 	/* Add ELF colors */
-	if (S_ISREG(mode) && is_executable)
-	    fc->fcolor[ix] = getElfColor(s);
+	if (S_ISREG(mode) && is_executable) {
+	    if (ecolor < 0)
+		ecolor = getElfColor(s);
+	    fc->fcolor[ix] = ecolor;
+	}
+
+	/* Remember the result for the next build of an unchanged file */
+	if (cval == NULL && statok &&
+		strchr(ftype, '\t') == NULL && strchr(fmime, '\t') == NULL) {
+	    char *nval = NULL;
+	    rasprintf(&nval, "%d\t%s\t%s", ecolor, ftype, fmime);
+	    fmetaCachePut(fmc, "class", s + fc->brlen,
+			  sb.st_mtime, sb.st_size, nval);
+	    free(nval);
+	}
+	free(cval);
     }
 
     if (ms != NULL)
@@ -1313,6 +1383,8 @@ rpmRC rpmfcClassify(rpmfc fc, ARGV_t argv, rpm_mode_t * fmode)
 
     } /* omp parallel */
 
+    fmc = fmetaCacheFree(fmc);
+
     /* Add to file class dictionary and index array */
     for (int ix = 0; ix < fc->nfiles; ix++) {
 	const char *ftype = fc->ftype[ix] ? fc->ftype[ix] : "";
@@ -37,6 +37,8 @@ enum rpmSpecFlags_e {
     RPMSPEC_FORCE	= (1 << 1),
     RPMSPEC_NOLANG	= (1 << 2),
     RPMSPEC_NOUTF8	= (1 << 3),
+    /* parse preambles only, skim over section bodies without expansion */
+    RPMSPEC_PARTIAL	= (1 << 4),
 };
 
 typedef rpmFlags rpmSpecFlags;
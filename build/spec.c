@@ -215,6 +215,8 @@ rpmSpec newSpec(void)
     spec->readStack->reading = 1;
     spec->readStack->lastConditional = lineTypes;
     spec->readStack->readable = 1;
+    spec->targetCpu = NULL;
+    spec->targetOs = NULL;
 
     spec->rootDir = NULL;
     spec->prep = NULL;
@@ -279,6 +281,8 @@ rpmSpec rpmSpecFree(rpmSpec spec)
 	free(rl);
     }
     spec->lbuf = _free(spec->lbuf);
+    spec->targetCpu = _free(spec->targetCpu);
+    spec->targetOs = _free(spec->targetOs);
     
     spec->sourceRpmName = _free(spec->sourceRpmName);
     spec->sourcePkgId = _free(spec->sourcePkgId);
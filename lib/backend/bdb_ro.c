@@ -12,6 +12,7 @@
 #include "lib/rpmdb_internal.h"
 #include <rpm/rpmstring.h>
 #include <rpm/rpmlog.h>
+#include <rpm/rpmmacro.h>
 
 #define BDB_HASH 0
 #define BDB_BTREE 1
@@ -23,6 +24,13 @@ struct bdb_kv {
     unsigned int len;
 };
 
+struct bdb_pcent {
+    unsigned int pageno;	/* 0: empty slot */
+    unsigned int lastuse;
+    int internal;		/* btree interior page, evicted last */
+    unsigned char *page;	/* already swapped and validated */
+};
+
 struct bdb_db {
     int fd;			/* file descriptor of database */
     int type;			/* BDB_HASH / BDB_BTREE */
@@ -36,6 +44,10 @@ struct bdb_db {
     unsigned int highmask;
     unsigned int lowmask;
     unsigned int spares[32];	/* spare pages for each splitpoint */
+    /* page cache */
+    struct bdb_pcent *pcache;
+    unsigned int npcache;
+    unsigned int pcacheuse;	/* lru clock */
 };
 
 struct bdb_cur {
@@ -131,10 +143,8 @@ static void bdb_swappage(struct bdb_db *db, unsigned char *page)
     }
 }
 
-static int bdb_getpage(struct bdb_db *db, unsigned char *page, unsigned int pageno)
+static int bdb_readpage(struct bdb_db *db, unsigned char *page, unsigned int pageno)
 {
-    if (!pageno || pageno > db->lastpage)
-	return -1;
     if (pread(db->fd, page, db->pagesize, (off_t)pageno * db->pagesize) != db->pagesize) {
 	rpmlog(RPMLOG_ERR, "pread: %s\n", strerror(errno));
 	return -1;
@@ -146,8 +156,52 @@ static int bdb_getpage(struct bdb_db *db, unsigned char *page, unsigned int page
     return 0;
 }
 
+static int bdb_getpage(struct bdb_db *db, unsigned char *page, unsigned int pageno)
+{
+    struct bdb_pcent *ent, *victim = NULL;
+    unsigned int i;
+
+    if (!pageno || pageno > db->lastpage)
+	return -1;
+    if (!db->pcache)
+	return bdb_readpage(db, page, pageno);
+
+    /* serve (and re-validate nothing) from the cache if we can */
+    for (i = 0, ent = db->pcache; i < db->npcache; i++, ent++) {
+	if (ent->pageno == pageno) {
+	    ent->lastuse = ++db->pcacheuse;
+	    memcpy(page, ent->page, db->pagesize);
+	    return 0;
+	}
+	/* prefer empty slots, then the oldest leaf, then the oldest page */
+	if (!victim || !ent->pageno ||
+	    (victim->pageno &&
+	     (victim->internal > ent->internal ||
+	      (victim->internal == ent->internal &&
+	       ent->lastuse < victim->lastuse))))
+	    victim = ent;
+	if (!ent->pageno)
+	    break;
+    }
+    if (bdb_readpage(db, victim->page, pageno)) {
+	victim->pageno = 0;
+	return -1;
+    }
+    victim->pageno = pageno;
+    victim->lastuse = ++db->pcacheuse;
+    victim->internal = (victim->page[25] == 3);
+    memcpy(page, victim->page, db->pagesize);
+    return 0;
+}
+
 static void bdb_close(struct bdb_db *db)
 {
+    if (db->pcache) {
+	unsigned int i;
+	for (i = 0; i < db->npcache; i++)
+	    free(db->pcache[i].page);
+	free(db->pcache);
+    }
     if (db->fd >= 0)
 	close(db->fd);
     free(db);
@@ -205,6 +259,19 @@ static struct bdb_db *bdb_open(const char *name)
 	}
 	db->root = meta[22];
     }
+    {
+	/* Cache pages in user space, %_bdb_ro_cache_pages overrides the
+	 * default of 64 pages per database, <= 0 disables the cache. */
+	char *val = rpmExpand("%{?_bdb_ro_cache_pages}", NULL);
+	int ncache = (*val != '\0') ? atoi(val) : 64;
+	free(val);
+	if (ncache > 0) {
+	    db->pcache = xcalloc(ncache, sizeof(*db->pcache));
+	    for (i = 0; i < ncache; i++)
+		db->pcache[i].page = xmalloc(db->pagesize);
+	    db->npcache = ncache;
+	}
+    }
     return db;
 }
 
@@ -197,6 +197,20 @@ unsigned int pkgdbKey(dbiIndex dbi, dbiCursor dbc)
     return dbi->dbi_rpmdb->db_ops->pkgdbKey(dbi, dbc);
 }
 
+rpmRC pkgdbCount(dbiIndex dbi, unsigned int *countp)
+{
+    if (dbi->dbi_rpmdb->db_ops->pkgdbCount == NULL)
+	return RPMRC_NOTFOUND;
+    return dbi->dbi_rpmdb->db_ops->pkgdbCount(dbi, countp);
+}
+
+rpmRC pkgdbSizeHint(dbiIndex dbi, unsigned int count)
+{
+    if (dbi->dbi_rpmdb->db_ops->pkgdbSizeHint == NULL)
+	return RPMRC_NOTFOUND;
+    return dbi->dbi_rpmdb->db_ops->pkgdbSizeHint(dbi, count);
+}
+
 rpmRC idxdbGet(dbiIndex dbi, dbiCursor dbc, const char *keyp, size_t keylen, dbiIndexSet *set, int curFlags)
 {
     return dbi->dbi_rpmdb->db_ops->idxdbGet(dbi, dbc, keyp, keylen, set, curFlags);
@@ -42,6 +42,12 @@ struct rpmdb_s {
     int		db_perms;	/*!< open permissions */
     const char	* db_descr;	/*!< db backend description (for error msgs) */
     struct dbChk_s * db_checked;/*!< headerCheck()'ed package instances */
+    struct bnBloom_s * db_bnbloom;/*!< basenames negative lookup filter */
+    int		db_bnbloomfail;	/*!< filter build failed, don't retry */
+    int		db_bnlookups;	/*!< file lookups seen (filter trigger) */
+    struct hdrShmCache_s * db_shmcache;/*!< shared header blob cache */
+    int		db_shmcachefail;/*!< cache attach failed, don't retry */
+    struct rpmdbDsCache_s * db_dscache;/*!< per-instance dependency sets */
     rpmdb	db_next;
     int		db_opens;
     dbiIndex	db_pkgs;	/*!< Package db */
@@ -96,6 +102,7 @@ struct dbiIndex_s {
     int dbi_flags;
 
     void * dbi_db;		/*!< Backend private handle */
+    void * dbi_priv;		/*!< Backend private per-dbi data */
 };
 
 union _dbswap {
@@ -220,6 +227,12 @@ rpmRC pkgdbGet(dbiIndex dbi, dbiCursor dbc, unsigned int hdrNum,
 RPM_GNUC_INTERNAL
 unsigned int pkgdbKey(dbiIndex dbi, dbiCursor dbc);
 
+/* Optional ops, return RPMRC_NOTFOUND if the backend doesn't support them */
+RPM_GNUC_INTERNAL
+rpmRC pkgdbCount(dbiIndex dbi, unsigned int *countp);
+RPM_GNUC_INTERNAL
+rpmRC pkgdbSizeHint(dbiIndex dbi, unsigned int count);
+
 RPM_GNUC_INTERNAL
 rpmRC idxdbGet(dbiIndex dbi, dbiCursor dbc, const char *keyp, size_t keylen,
                dbiIndexSet *set, int curFlags);
@@ -249,6 +262,10 @@ struct rpmdbOps_s {
     rpmRC (*pkgdbPut)(dbiIndex dbi, dbiCursor dbc, unsigned int *hdrNum, unsigned char *hdrBlob, unsigned int hdrLen);
     rpmRC (*pkgdbDel)(dbiIndex dbi, dbiCursor dbc,  unsigned int hdrNum);
     unsigned int (*pkgdbKey)(dbiIndex dbi, dbiCursor dbc);
+    /* optional: number of packages in the db */
+    rpmRC (*pkgdbCount)(dbiIndex dbi, unsigned int *countp);
+    /* optional: pre-size the db for an expected number of packages */
+    rpmRC (*pkgdbSizeHint)(dbiIndex dbi, unsigned int count);
 
     rpmRC (*idxdbGet)(dbiIndex dbi, dbiCursor dbc, const char *keyp, size_t keylen, dbiIndexSet *set, int curFlags);
     rpmRC (*idxdbPut)(dbiIndex dbi, rpmTagVal rpmtag, unsigned int hdrNum, Header h);
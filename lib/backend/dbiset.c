@@ -41,17 +41,88 @@ static int hdrNumCmp(const void * one, const void * two)
 
 void dbiIndexSetSort(dbiIndexSet set)
 {
+    if (set == NULL)
+	return;
     /*
      * mergesort is much (~10x with lots of identical basenames) faster
      * than pure quicksort, but glibc uses msort_with_tmp() on stack.
      */
-    if (set && set->recs && set->count > 1) {
+    if (set->recs && set->count > 1) {
 #if HAVE_MERGESORT
 	mergesort(set->recs, set->count, sizeof(*set->recs), hdrNumCmp);
 #else
 	qsort(set->recs, set->count, sizeof(*set->recs), hdrNumCmp);
 #endif
     }
+    set->sorted = 1;
+}
+
+/*
+ * Find the index of the first record in sorted recs[lo..nrecs) not
+ * comparing below key: gallop ahead in exponentially growing steps and
+ * binary search the final bracket. When the keys themselves arrive in
+ * sorted order this costs O(log(gap)) per lookup instead of O(log(nrecs)),
+ * which is what makes the merge loops below linear overall.
+ */
+static unsigned int dbiIndexGallop(dbiIndexItem recs, unsigned int nrecs,
+				   unsigned int lo, dbiIndexItem key)
+{
+    unsigned int hi = lo;
+    unsigned int step = 1;
+
+    while (hi < nrecs && hdrNumCmp(&recs[hi], key) < 0) {
+	lo = hi + 1;
+	hi += step;
+	step <<= 1;
+    }
+    if (hi > nrecs)
+	hi = nrecs;
+
+    while (lo < hi) {
+	unsigned int mid = lo + (hi - lo) / 2;
+	if (hdrNumCmp(&recs[mid], key) < 0)
+	    lo = mid + 1;
+	else
+	    hi = mid;
+    }
+    return lo;
+}
+
+/*
+ * Restore sort order after appending ntail records at the end of set.
+ * If the set was sorted before the append, sort just the tail and merge
+ * it in from the back, otherwise fall back to a full sort.
+ */
+static void dbiIndexSetMergeTail(dbiIndexSet set, unsigned int ntail)
+{
+    unsigned int head = set->count - ntail;
+    size_t recsize = sizeof(*set->recs);
+
+    if (!set->sorted && head > 1) {
+	if (set->count > 1)
+	    qsort(set->recs, set->count, recsize, hdrNumCmp);
+	set->sorted = 1;
+	return;
+    }
+
+    if (ntail > 1)
+	qsort(set->recs + head, ntail, recsize, hdrNumCmp);
+
+    if (head > 0 && ntail > 0 &&
+	hdrNumCmp(&set->recs[head - 1], &set->recs[head]) > 0) {
+	dbiIndexItem tmp = xmalloc(ntail * recsize);
+	unsigned int i = head, j = ntail, k = set->count;
+
+	memcpy(tmp, set->recs + head, ntail * recsize);
+	while (j > 0) {
+	    if (i > 0 && hdrNumCmp(&set->recs[i - 1], &tmp[j - 1]) > 0)
+		set->recs[--k] = set->recs[--i]; /* structure assignment */
+	    else
+		set->recs[--k] = tmp[--j];
+	}
+	free(tmp);
+    }
+    set->sorted = 1;
 }
 
 void dbiIndexSetUniq(dbiIndexSet set, int sorted)
@@ -60,11 +131,15 @@ void dbiIndexSetUniq(dbiIndexSet set, int sorted)
     unsigned int to = 0;
     unsigned int num = set->count;
 
-    if (set->count < 2)
+    if (set->count < 2) {
+	set->sorted = 1;
 	return;
+    }
 
     if (!sorted)
 	dbiIndexSetSort(set);
+    else
+	set->sorted = 1;
 
     for (from = 0; from < num; from++) {
 	if (from > 0 && set->recs[from - 1].hdrNum == set->recs[from].hdrNum) {
@@ -87,10 +162,12 @@ int dbiIndexSetAppend(dbiIndexSet set, dbiIndexItem recs,
 	dbiIndexSetGrow(set, nrecs);
 	memcpy(set->recs + set->count, recs, nrecs * sizeof(*(set->recs)));
 	set->count += nrecs;
+	if (!sortset)
+	    set->sorted = (set->count < 2);
     }
-    
-    if (sortset && set->count > 1)
-	qsort(set->recs, set->count, sizeof(*(set->recs)), hdrNumCmp);
+
+    if (sortset)
+	dbiIndexSetMergeTail(set, nrecs);
 
     return 0;
 }
@@ -113,8 +190,10 @@ int dbiIndexSetAppendOne(dbiIndexSet set, unsigned int hdrNum,
     set->recs[set->count].tagNum = tagNum;
     set->count += 1;
 
-    if (sortset && set->count > 1)
-	qsort(set->recs, set->count, sizeof(*(set->recs)), hdrNumCmp);
+    if (sortset)
+	dbiIndexSetMergeTail(set, 1);
+    else
+	set->sorted = (set->count < 2);
 
     return 0;
 }
@@ -134,15 +213,31 @@ int dbiIndexSetPrune(dbiIndexSet set, dbiIndexItem recs,
     if (nrecs > 1 && !sorted)
 	qsort(recs, nrecs, recsize, hdrNumCmp);
 
-    for (from = 0; from < num; from++) {
-	if (bsearch(&set->recs[from], recs, nrecs, recsize, hdrNumCmp)) {
-	    set->count--;
-	    continue;
+    if (set->sorted) {
+	/* both sides sorted: linear merge, galloping across size skews */
+	unsigned int j = 0;
+	for (from = 0; from < num; from++) {
+	    j = dbiIndexGallop(recs, nrecs, j, &set->recs[from]);
+	    if (j < nrecs && hdrNumCmp(&set->recs[from], &recs[j]) == 0) {
+		set->count--;
+		continue;
+	    }
+	    if (from != to)
+		set->recs[to] = set->recs[from]; /* structure assignment */
+	    to++;
+	    numCopied++;
+	}
+    } else {
+	for (from = 0; from < num; from++) {
+	    if (bsearch(&set->recs[from], recs, nrecs, recsize, hdrNumCmp)) {
+		set->count--;
+		continue;
+	    }
+	    if (from != to)
+		set->recs[to] = set->recs[from]; /* structure assignment */
+	    to++;
+	    numCopied++;
 	}
-	if (from != to)
-	    set->recs[to] = set->recs[from]; /* structure assignment */
-	to++;
-	numCopied++;
     }
     return (numCopied == num);
 }
@@ -169,15 +264,32 @@ int dbiIndexSetFilter(dbiIndexSet set, dbiIndexItem recs,
     }
     if (nrecs > 1 && !sorted)
 	qsort(recs, nrecs, recsize, hdrNumCmp);
-    for (from = 0; from < num; from++) {
-	if (!bsearch(&set->recs[from], recs, nrecs, recsize, hdrNumCmp)) {
-	    set->count--;
-	    continue;
+
+    if (set->sorted) {
+	/* both sides sorted: linear merge, galloping across size skews */
+	unsigned int j = 0;
+	for (from = 0; from < num; from++) {
+	    j = dbiIndexGallop(recs, nrecs, j, &set->recs[from]);
+	    if (j >= nrecs || hdrNumCmp(&set->recs[from], &recs[j]) != 0) {
+		set->count--;
+		continue;
+	    }
+	    if (from != to)
+		set->recs[to] = set->recs[from]; /* structure assignment */
+	    to++;
+	    numCopied++;
+	}
+    } else {
+	for (from = 0; from < num; from++) {
+	    if (!bsearch(&set->recs[from], recs, nrecs, recsize, hdrNumCmp)) {
+		set->count--;
+		continue;
+	    }
+	    if (from != to)
+		set->recs[to] = set->recs[from]; /* structure assignment */
+	    to++;
+	    numCopied++;
 	}
-	if (from != to)
-	    set->recs[to] = set->recs[from]; /* structure assignment */
-	to++;
-	numCopied++;
     }
     return (numCopied == num);
 }
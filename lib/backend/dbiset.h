@@ -14,6 +14,7 @@ typedef struct dbiIndexSet_s {
     dbiIndexItem recs;			/*!< array of records */
     unsigned int count;			/*!< number of records */
     size_t alloced;			/*!< alloced size */
+    int sorted;				/*!< recs known to be sorted? */
 } * dbiIndexSet;
 
 #ifdef __cplusplus
@@ -5,8 +5,10 @@
 #include <fcntl.h>
 
 #include "lib/rpmdb_internal.h"
+#include <rpm/header.h>
 #include <rpm/rpmstring.h>
 #include <rpm/rpmlog.h>
+#include <rpm/rpmmacro.h>
 
 #include "lib/backend/ndb/rpmpkg.h"
 #include "lib/backend/ndb/rpmxdb.h"
@@ -147,6 +149,8 @@ static int ndb_Open(rpmdb rdb, rpmDbiTagVal rpmtag, dbiIndex * dbip, int flags)
 	free(path);
 	dbi->dbi_db = ndbenv->pkgdb = pkgdb;
 	rpmpkgSetFsync(pkgdb, ndbenv->dofsync);
+	rpmpkgSetCompression(pkgdb,
+			rpmExpandNumeric("%{?_ndb_header_compression}"));
     } else {
 	unsigned int id;
 	rpmidxdb idxdb = 0;
@@ -395,6 +399,16 @@ static unsigned int ndb_pkgdbKey(dbiIndex dbi, dbiCursor dbc)
     return dbc->hdrNum;
 }
 
+static rpmRC ndb_pkgdbCount(dbiIndex dbi, unsigned int *countp)
+{
+    return rpmpkgCount(dbi->dbi_db, countp);
+}
+
+static rpmRC ndb_pkgdbSizeHint(dbiIndex dbi, unsigned int count)
+{
+    return rpmpkgSizeHint(dbi->dbi_db, count);
+}
+
 
 static void addtoset(dbiIndexSet *set, unsigned int *pkglist, unsigned int pkglistn)
 {
@@ -415,13 +429,13 @@ static void addtoset(dbiIndexSet *set, unsigned int *pkglist, unsigned int pkgli
 	*set = newset;
 }
 
-/* Iterate over all index entries */
+/* Iterate over all index entries in key order */
 static rpmRC ndb_idxdbIter(dbiIndex dbi, dbiCursor dbc, dbiIndexSet *set)
 {
     int rc;
     if (!dbc->list) {
 	/* setup iteration list on first call */
-	rc = rpmidxList(dbc->dbi->dbi_db, &dbc->list, &dbc->nlist, &dbc->listdata);
+	rc = rpmidxSortedList(dbc->dbi->dbi_db, &dbc->list, &dbc->nlist, &dbc->listdata);
 	if (rc)
 	    return rc;
 	dbc->ilist = 0;
@@ -509,7 +523,26 @@ static rpmRC ndb_idxdbPutOne(dbiIndex dbi, dbiCursor dbc, const char *keyp, size
 
 static rpmRC ndb_idxdbPut(dbiIndex dbi, rpmTagVal rpmtag, unsigned int hdrNum, Header h)
 {
-    return tag2index(dbi, rpmtag, hdrNum, h, ndb_idxdbPutOne);
+    struct rpmtd_s tagdata;
+    unsigned int nkeys = 0, keybytes = 0;
+    rpmRC rc;
+
+    /* announce the key count up front so that rpmidx can size the hash
+     * to its final size instead of splitting it while we insert */
+    if (headerGet(h, rpmtag, &tagdata, HEADERGET_MINMEM)) {
+	const char *str;
+	while ((str = rpmtdNextString(&tagdata)) != NULL) {
+	    nkeys++;
+	    keybytes += strlen(str) + 7;	/* worst case key encoding */
+	}
+	rpmtdFreeData(&tagdata);
+    }
+    if (nkeys && rpmidxPutBatchStart(dbi->dbi_db, nkeys, keybytes))
+	return RPMRC_FAIL;
+    rc = tag2index(dbi, rpmtag, hdrNum, h, ndb_idxdbPutOne);
+    if (nkeys)
+	rpmidxPutBatchEnd(dbi->dbi_db);
+    return rc;
 }
 
 static rpmRC ndb_idxdbDelOne(dbiIndex dbi, dbiCursor dbc, const char *keyp, size_t keylen, dbiIndexItem rec)
@@ -548,6 +581,8 @@ struct rpmdbOps_s ndb_dbops = {
     .pkgdbDel	= ndb_pkgdbDel,
     .pkgdbGet	= ndb_pkgdbGet,
     .pkgdbKey	= ndb_pkgdbKey,
+    .pkgdbCount	= ndb_pkgdbCount,
+    .pkgdbSizeHint = ndb_pkgdbSizeHint,
 
     .idxdbGet	= ndb_idxdbGet,
     .idxdbPut	= ndb_idxdbPut,
@@ -89,6 +89,13 @@ typedef struct rpmidxdb_s {
     unsigned int key_size;
     unsigned int file_size;
 
+    /* sorted key table */
+    unsigned char *sort_mapped;
+    unsigned int sort_size;
+    unsigned int sortid;
+    int sortdirty;
+    int sortfail;
+
     unsigned int generation;
     unsigned int nslots;
     unsigned int usedslots;
@@ -151,6 +158,7 @@ static inline void h2lea(unsigned int x, unsigned char *p)
 
 #define IDXDB_XDB_SUBTAG		0
 #define IDXDB_XDB_SUBTAG_REBUILD	1
+#define IDXDB_XDB_SUBTAG_SORT		2
 
 static void set_mapped(rpmidxdb idxdb, unsigned char *addr, unsigned int size)
 {
@@ -430,6 +438,232 @@ static inline unsigned int decodedata(rpmidxdb idxdb, unsigned int data, unsigne
 }
 
 
+/*** Sorted key table ***
+ *
+ * An auxiliary blob containing the offsets of all keys sorted in
+ * lexicographical key order. Writers keep it in sync with the hash,
+ * so that ordered iteration does not have to collect and qsort all
+ * of the keys on every cursor open. The table is stamped with the
+ * generation of the index it reflects, a stale stamp (e.g. from an
+ * old rpm writing the index) makes readers fall back to sorting the
+ * keys themselves and the next writer rebuild the table.
+ */
+
+#define IDXSORT_MAGIC     ('R' | 'p' << 8 | 'm' << 16 | 'S' << 24)
+#define IDXSORT_VERSION	0
+
+#define IDXSORT_OFFSET_MAGIC		0
+#define IDXSORT_OFFSET_VERSION		4
+#define IDXSORT_OFFSET_GENERATION	8
+#define IDXSORT_OFFSET_NKEYS		12
+#define IDXSORT_ENTRY_OFFSET		16
+
+static void sortmapcb(rpmxdb xdb, void *data, void *newaddr, size_t newsize)
+{
+    rpmidxdb idxdb = data;
+    idxdb->sort_mapped = newaddr;
+    idxdb->sort_size = newaddr ? (unsigned int)newsize : 0;
+}
+
+/* Map the table blob. Creating it needs the exclusive lock, so only
+ * the writers may pass create, readers just attach an existing blob. */
+static int rpmidxSortMap(rpmidxdb idxdb, int create)
+{
+    unsigned int id;
+    int rc;
+    if (idxdb->sortid)
+	return RPMRC_OK;
+    if (idxdb->sortfail)
+	return RPMRC_FAIL;
+    rc = rpmxdbLookupBlob(idxdb->xdb, &id, idxdb->xdbtag, IDXDB_XDB_SUBTAG_SORT,
+			  create ? O_CREAT : 0);
+    if (rc == RPMRC_NOTFOUND)
+	return RPMRC_FAIL;	/* may get created later */
+    if (rc || rpmxdbMapBlob(idxdb->xdb, id, idxdb->rdonly ? O_RDONLY : O_RDWR,
+			    sortmapcb, idxdb)) {
+	idxdb->sortfail = 1;
+	return RPMRC_FAIL;
+    }
+    idxdb->sortid = id;
+    return RPMRC_OK;
+}
+
+/* check that the table exists and reflects the current generation */
+static int rpmidxSortValid(rpmidxdb idxdb, int create, unsigned int *nkeysp)
+{
+    unsigned int nkeys;
+    if (rpmidxSortMap(idxdb, create) || idxdb->sort_size < IDXSORT_ENTRY_OFFSET)
+	return 0;
+    if (le2ha(idxdb->sort_mapped + IDXSORT_OFFSET_MAGIC) != IDXSORT_MAGIC ||
+	le2ha(idxdb->sort_mapped + IDXSORT_OFFSET_VERSION) != IDXSORT_VERSION ||
+	le2ha(idxdb->sort_mapped + IDXSORT_OFFSET_GENERATION) != idxdb->generation)
+	return 0;
+    nkeys = le2ha(idxdb->sort_mapped + IDXSORT_OFFSET_NKEYS);
+    if (IDXSORT_ENTRY_OFFSET + (unsigned long long)nkeys * 4 > idxdb->sort_size)
+	return 0;
+    if (nkeysp)
+	*nkeysp = nkeys;
+    return 1;
+}
+
+/* compare two length prefixed keys in lexicographical key order */
+static int sortkeycmp(const void *va, const void *vb)
+{
+    unsigned char *a = *(unsigned char **)va;
+    unsigned char *b = *(unsigned char **)vb;
+    unsigned int hla, hlb;
+    unsigned int la = decodekeyl(a, &hla);
+    unsigned int lb = decodekeyl(b, &hlb);
+    unsigned int l = la < lb ? la : lb;
+    int r = l ? memcmp(a + hla, b + hlb, l) : 0;
+    return r ? r : la < lb ? -1 : la > lb ? 1 : 0;
+}
+
+/* rebuild the table from scratch by scanning the key space */
+static void rpmidxSortRebuild(rpmidxdb idxdb)
+{
+    unsigned char **keys = 0;
+    unsigned int nkeys = 0, need, i;
+    unsigned char *key, *keyendp;
+
+    if (idxdb->rdonly || rpmidxSortMap(idxdb, 1))
+	return;
+    for (key = idxdb->key_mapped + 1, keyendp = idxdb->key_mapped + idxdb->keyend; key < keyendp; ) {
+	unsigned int hl, keyl;
+	if (!*key) {
+	    key++;
+	    continue;
+	}
+	if ((nkeys & 15) == 0)
+	    keys = xrealloc(keys, (nkeys + 16) * sizeof(*keys));
+	keys[nkeys++] = key;
+	keyl = decodekeyl(key, &hl);
+	key += hl + keyl;
+    }
+    if (nkeys > 1)
+	qsort(keys, nkeys, sizeof(*keys), sortkeycmp);
+    need = IDXSORT_ENTRY_OFFSET + nkeys * 4;
+    if (idxdb->sort_size < need) {
+	unsigned int newsize = (need + idxdb->pagesize - 1) & ~(idxdb->pagesize - 1);
+	if (rpmxdbResizeBlob(idxdb->xdb, idxdb->sortid, newsize)) {
+	    free(keys);
+	    return;
+	}
+    }
+    for (i = 0; i < nkeys; i++)
+	h2lea((unsigned int)(keys[i] - idxdb->key_mapped), idxdb->sort_mapped + IDXSORT_ENTRY_OFFSET + 4 * i);
+    free(keys);
+    h2lea(IDXSORT_MAGIC,      idxdb->sort_mapped + IDXSORT_OFFSET_MAGIC);
+    h2lea(IDXSORT_VERSION,    idxdb->sort_mapped + IDXSORT_OFFSET_VERSION);
+    h2lea(nkeys,              idxdb->sort_mapped + IDXSORT_OFFSET_NKEYS);
+    h2lea(idxdb->generation,  idxdb->sort_mapped + IDXSORT_OFFSET_GENERATION);
+    idxdb->sortdirty = 0;
+}
+
+/* find the table position of the key at keyoff. Sets *matchp to 1 if
+ * the key is already present, to -1 if the table is corrupt. */
+static unsigned int rpmidxSortFind(rpmidxdb idxdb, unsigned int nkeys, unsigned int keyoff, int *matchp)
+{
+    unsigned int lo = 0, hi = nkeys;
+    unsigned char *key = idxdb->key_mapped + keyoff;
+    *matchp = 0;
+    while (lo < hi) {
+	unsigned int mid = lo + (hi - lo) / 2;
+	unsigned int off = le2ha(idxdb->sort_mapped + IDXSORT_ENTRY_OFFSET + 4 * mid);
+	unsigned char *mkey;
+	int r;
+	if (!off || off >= idxdb->keyend) {
+	    *matchp = -1;
+	    return lo;
+	}
+	if (off == keyoff) {
+	    *matchp = 1;
+	    return mid;
+	}
+	mkey = idxdb->key_mapped + off;
+	r = sortkeycmp(&mkey, &key);
+	if (r < 0)
+	    lo = mid + 1;
+	else if (r > 0)
+	    hi = mid;
+	else {
+	    *matchp = 1;
+	    return mid;
+	}
+    }
+    return lo;
+}
+
+/* a new key was added to the key space */
+static void rpmidxSortAdd(rpmidxdb idxdb, unsigned int keyoff)
+{
+    unsigned int nkeys, pos;
+    int match;
+    if (idxdb->rdonly || idxdb->sortdirty)
+	return;
+    if (!rpmidxSortValid(idxdb, 1, &nkeys)) {
+	idxdb->sortdirty = 1;
+	return;
+    }
+    if (idxdb->sort_size < IDXSORT_ENTRY_OFFSET + (nkeys + 1) * 4) {
+	if (rpmxdbResizeBlob(idxdb->xdb, idxdb->sortid, idxdb->sort_size + idxdb->pagesize)) {
+	    idxdb->sortdirty = 1;
+	    return;
+	}
+    }
+    pos = rpmidxSortFind(idxdb, nkeys, keyoff, &match);
+    if (match) {	/* can't happen, the key was not in the key space */
+	idxdb->sortdirty = 1;
+	return;
+    }
+    if (pos < nkeys)
+	memmove(idxdb->sort_mapped + IDXSORT_ENTRY_OFFSET + 4 * (pos + 1),
+		idxdb->sort_mapped + IDXSORT_ENTRY_OFFSET + 4 * pos,
+		4 * (nkeys - pos));
+    h2lea(keyoff, idxdb->sort_mapped + IDXSORT_ENTRY_OFFSET + 4 * pos);
+    h2lea(nkeys + 1, idxdb->sort_mapped + IDXSORT_OFFSET_NKEYS);
+}
+
+/* a key is about to be freed from the key space */
+static void rpmidxSortDel(rpmidxdb idxdb, unsigned int keyoff)
+{
+    unsigned int nkeys, pos;
+    int match;
+    if (idxdb->rdonly || idxdb->sortdirty)
+	return;
+    if (!rpmidxSortValid(idxdb, 1, &nkeys)) {
+	idxdb->sortdirty = 1;
+	return;
+    }
+    pos = rpmidxSortFind(idxdb, nkeys, keyoff, &match);
+    if (match != 1) {
+	idxdb->sortdirty = 1;
+	return;
+    }
+    if (pos + 1 < nkeys)
+	memmove(idxdb->sort_mapped + IDXSORT_ENTRY_OFFSET + 4 * pos,
+		idxdb->sort_mapped + IDXSORT_ENTRY_OFFSET + 4 * (pos + 1),
+		4 * (nkeys - pos - 1));
+    h2lea(nkeys - 1, idxdb->sort_mapped + IDXSORT_OFFSET_NKEYS);
+}
+
+/* re-stamp (or rebuild) the table after bumpGeneration() */
+static void rpmidxSortStamp(rpmidxdb idxdb)
+{
+    if (idxdb->rdonly || idxdb->sortfail)
+	return;
+    if (!idxdb->sortdirty && rpmidxSortMap(idxdb, 1) == RPMRC_OK &&
+	idxdb->sort_size >= IDXSORT_ENTRY_OFFSET &&
+	le2ha(idxdb->sort_mapped + IDXSORT_OFFSET_MAGIC) == IDXSORT_MAGIC &&
+	le2ha(idxdb->sort_mapped + IDXSORT_OFFSET_VERSION) == IDXSORT_VERSION &&
+	le2ha(idxdb->sort_mapped + IDXSORT_OFFSET_GENERATION) == idxdb->generation - 1) {
+	h2lea(idxdb->generation, idxdb->sort_mapped + IDXSORT_OFFSET_GENERATION);
+    } else {
+	rpmidxSortRebuild(idxdb);
+    }
+}
+
+
 /*** Rebuild helpers ***/
 
 /* copy a single data entry into the new database */
@@ -479,7 +713,7 @@ static inline void copykeyentries(const unsigned char *key, unsigned int keyl, r
     }
 }
 
-static int rpmidxRebuildInternal(rpmidxdb idxdb)
+static int rpmidxRebuildInternal(rpmidxdb idxdb, unsigned int extraslots, unsigned int extrakeysize)
 {
     struct rpmidxdb_s nidxdb_s, *nidxdb;
     unsigned int i, nslots;
@@ -499,6 +733,7 @@ static int rpmidxRebuildInternal(rpmidxdb idxdb)
 	if (x != 0 && x != -1)
 	    nslots++;
     }
+    nslots += extraslots;	/* size for already announced entries */
     if (nslots < 256)
 	nslots = 256;
     while (nslots & (nslots - 1))
@@ -509,7 +744,7 @@ static int rpmidxRebuildInternal(rpmidxdb idxdb)
     nidxdb->hmask = nslots - 1;
 
     /* calculate the new key space size */
-    key_size = idxdb->keyend;
+    key_size = idxdb->keyend + extrakeysize;
     if (key_size < IDXDB_KEY_CHUNKSIZE)
 	key_size = IDXDB_KEY_CHUNKSIZE;
     file_size = IDXDB_SLOT_OFFSET + nslots * 12 + key_size;
@@ -580,6 +815,11 @@ static int rpmidxRebuildInternal(rpmidxdb idxdb)
     idxdb->xdbid = nidxdb->xdbid;
     if (rpmidxReadHeader(idxdb))
 	return RPMRC_FAIL;
+    /* all key offsets changed, the sorted key table must start over */
+    if (!idxdb->rdonly) {
+	idxdb->sortdirty = 1;
+	rpmidxSortRebuild(idxdb);
+    }
     return RPMRC_OK;
 }
 
@@ -593,7 +833,22 @@ static int rpmidxCheck(rpmidxdb idxdb)
     if (idxdb->usedslots * 2 > idxdb->nslots ||
 	(idxdb->keyexcess > 4096 && idxdb->keyexcess * 4 > idxdb->keyend) ||
 	idxdb->keyend >= ~idxdb->xmask) {
-	if (rpmidxRebuildInternal(idxdb))
+	if (rpmidxRebuildInternal(idxdb, 0, 0))
+	    return RPMRC_FAIL;
+    }
+    return RPMRC_OK;
+}
+
+/* Make sure that the hash has room for nkeys extra entries taking up to
+ * keybytes of new key space, so that a batch of puts does not trigger
+ * a rebuild every few insertions. The numbers are just hints to size
+ * the rebuild, rpmidxCheck() still guards every single put.
+ */
+static int rpmidxEnsureSpace(rpmidxdb idxdb, unsigned int nkeys, unsigned int keybytes)
+{
+    if ((idxdb->usedslots + nkeys) * 2 > idxdb->nslots ||
+	idxdb->keyend + keybytes >= ~idxdb->xmask) {
+	if (rpmidxRebuildInternal(idxdb, nkeys, keybytes))
 	    return RPMRC_FAIL;
     }
     return RPMRC_OK;
@@ -603,6 +858,7 @@ static int rpmidxPutInternal(rpmidxdb idxdb, const unsigned char *key, unsigned
 {
     unsigned int keyh = murmurhash(key, keyl);
     unsigned int keyoff = 0;
+    unsigned int newkeyoff = 0;
     unsigned int freeh = -1;
     unsigned int x, h, hh = 7;
     unsigned int hmask;
@@ -646,6 +902,7 @@ static int rpmidxPutInternal(rpmidxdb idxdb, const unsigned char *key, unsigned
 	/* we did not find this key. add it */
 	if (addnewkey(idxdb, key, keyl, &keyoff))
 	    return RPMRC_FAIL;
+	newkeyoff = keyoff;
 	keyoff |= keyh & xmask;		/* tag it with the extra bits */
 	/* re-calculate ent, addnewkey may have changed the mapping! */
 	ent = idxdb->slot_mapped + 8 * h;
@@ -667,7 +924,10 @@ static int rpmidxPutInternal(rpmidxdb idxdb, const unsigned char *key, unsigned
     h2lea(data, ent + 4);
     if (ovldata)
 	h2lea(ovldata, idxdb->slot_mapped + idxdb->nslots * 8 + 4 * h);
+    if (newkeyoff)
+	rpmidxSortAdd(idxdb, newkeyoff);
     bumpGeneration(idxdb);
+    rpmidxSortStamp(idxdb);
     return RPMRC_OK;
 }
 
@@ -725,12 +985,15 @@ static int rpmidxDelInternal(rpmidxdb idxdb, const unsigned char *key, unsigned
     if (keyoff && !otherusers) {
 	/* key is no longer in use. free it */
 	int hl = keylsize(keyl);
+	rpmidxSortDel(idxdb, keyoff & ~xmask);	/* before the key is cleared */
 	memset(idxdb->key_mapped + (keyoff & ~xmask), 0, hl + keyl);
 	idxdb->keyexcess += hl + keyl;
 	updateKeyexcess(idxdb);
     }
-    if (keyoff)
+    if (keyoff) {
 	bumpGeneration(idxdb);
+	rpmidxSortStamp(idxdb);
+    }
     return RPMRC_OK;
 }
 
@@ -841,6 +1104,77 @@ static int rpmidxListInternal(rpmidxdb idxdb, unsigned int **keylistp, unsigned
 }
 
 
+/* Like rpmidxListInternal, but return the keys in lexicographical key
+ * order. Uses the sorted key table when it is current, otherwise the
+ * keys are sorted the hard way. */
+static int rpmidxSortedListInternal(rpmidxdb idxdb, unsigned int **keylistp, unsigned int *nkeylistp, unsigned char **datap)
+{
+    unsigned int *keylist = 0;
+    unsigned int nkeylist = 0;
+    unsigned int nkeys = 0, i;
+    unsigned char *data;
+    int usable;
+
+    data = xmalloc(idxdb->keyend + 1);	/* +1 so we can terminate the last key */
+    if (idxdb->keyend)
+	memcpy(data, idxdb->key_mapped, idxdb->keyend);
+    data[idxdb->keyend] = 0;
+    usable = rpmidxSortValid(idxdb, 0, &nkeys);
+    if (usable) {
+	keylist = xmalloc((2 * (size_t)nkeys + 2) * sizeof(*keylist));
+	for (i = 0; i < nkeys; i++) {
+	    unsigned int off = le2ha(idxdb->sort_mapped + IDXSORT_ENTRY_OFFSET + 4 * i);
+	    unsigned int hl, keyl;
+	    if (!off || off >= idxdb->keyend || !data[off]) {
+		usable = 0;	/* corrupt table, sort ourselves */
+		break;
+	    }
+	    keyl = decodekeyl(data + off, &hl);
+	    if (off + hl + keyl > idxdb->keyend) {
+		usable = 0;
+		break;
+	    }
+	    keylist[nkeylist++] = off + hl;
+	    keylist[nkeylist++] = keyl;
+	}
+    }
+    if (!usable) {
+	unsigned char **keys = 0;
+	unsigned char *key, *keyendp;
+	nkeys = 0;
+	nkeylist = 0;
+	for (key = data + 1, keyendp = data + idxdb->keyend; key < keyendp; ) {
+	    unsigned int hl, keyl;
+	    if (!*key) {
+		key++;
+		continue;
+	    }
+	    if ((nkeys & 15) == 0)
+		keys = xrealloc(keys, (nkeys + 16) * sizeof(*keys));
+	    keys[nkeys++] = key;
+	    keyl = decodekeyl(key, &hl);
+	    key += hl + keyl;
+	}
+	if (nkeys > 1)
+	    qsort(keys, nkeys, sizeof(*keys), sortkeycmp);
+	keylist = xrealloc(keylist, (2 * (size_t)nkeys + 2) * sizeof(*keylist));
+	for (i = 0; i < nkeys; i++) {
+	    unsigned int hl, keyl = decodekeyl(keys[i], &hl);
+	    keylist[nkeylist++] = keys[i] + hl - data;
+	    keylist[nkeylist++] = keyl;
+	}
+	free(keys);
+    }
+    /* all keys are decoded now, terminate them in place */
+    for (i = 0; i < nkeylist; i += 2)
+	data[keylist[i] + keylist[i + 1]] = 0;
+    *keylistp = keylist;
+    *nkeylistp = nkeylist;
+    *datap = data;
+    return RPMRC_OK;
+}
+
+
 static int rpmidxInitInternal(rpmidxdb idxdb)
 {
     unsigned int id;
@@ -851,7 +1185,7 @@ static int rpmidxInitInternal(rpmidxdb idxdb)
     }
     if (rc && rc != RPMRC_NOTFOUND)
 	return rc;
-    return rpmidxRebuildInternal(idxdb);
+    return rpmidxRebuildInternal(idxdb, 0, 0);
 }
 
 static int rpmidxLock(rpmidxdb idxdb, int excl)
@@ -948,6 +1282,8 @@ int rpmidxDelXdb(rpmpkgdb pkgdb, rpmxdb xdb, unsigned int xdbtag)
 	rpmxdbUnlock(xdb, 1);
 	return RPMRC_FAIL;
     }
+    if (!rpmxdbLookupBlob(xdb, &id, xdbtag, IDXDB_XDB_SUBTAG_SORT, 0) && id)
+	rpmxdbDelBlob(xdb, id);		/* just auxiliary data */
     rpmxdbUnlock(xdb, 1);
     return RPMRC_OK;
 }
@@ -955,6 +1291,10 @@ int rpmidxDelXdb(rpmpkgdb pkgdb, rpmxdb xdb, unsigned int xdbtag)
 void rpmidxClose(rpmidxdb idxdb)
 {
     rpmidxUnmap(idxdb);
+    if (idxdb->sortid) {
+	rpmxdbUnmapBlob(idxdb->xdb, idxdb->sortid);
+	idxdb->sortid = 0;
+    }
     free(idxdb);
 }
 
@@ -971,6 +1311,27 @@ int rpmidxPut(rpmidxdb idxdb, const unsigned char *key, unsigned int keyl, unsig
     return rc;
 }
 
+/* Start a batch of puts. We grab the (recursive) lock and resize the
+ * hash to the announced final size in one go, so that the individual
+ * puts neither re-lock nor split the hash over and over again. The
+ * lock is held until rpmidxPutBatchEnd() is called.
+ */
+int rpmidxPutBatchStart(rpmidxdb idxdb, unsigned int nkeys, unsigned int keybytes)
+{
+    if (rpmidxLockReadHeader(idxdb, 1))
+	return RPMRC_FAIL;
+    if (rpmidxEnsureSpace(idxdb, nkeys, keybytes)) {
+	rpmidxUnlock(idxdb, 1);
+	return RPMRC_FAIL;
+    }
+    return RPMRC_OK;
+}
+
+int rpmidxPutBatchEnd(rpmidxdb idxdb)
+{
+    return rpmidxUnlock(idxdb, 1);
+}
+
 int rpmidxDel(rpmidxdb idxdb, const unsigned char *key, unsigned int keyl, unsigned int pkgidx, unsigned int datidx)
 {
     int rc;
@@ -1008,6 +1369,18 @@ int rpmidxList(rpmidxdb idxdb, unsigned int **keylistp, unsigned int *nkeylistp,
     return rc;
 }
 
+int rpmidxSortedList(rpmidxdb idxdb, unsigned int **keylistp, unsigned int *nkeylistp, unsigned char **datap)
+{
+    int rc;
+    *keylistp = 0;
+    *nkeylistp = 0;
+    if (rpmidxLockReadHeader(idxdb, 0))
+	return RPMRC_FAIL;
+    rc = rpmidxSortedListInternal(idxdb, keylistp, nkeylistp, datap);
+    rpmidxUnlock(idxdb, 0);
+    return rc;
+}
+
 int rpmidxStats(rpmidxdb idxdb)
 {
     if (rpmidxLockReadHeader(idxdb, 0))
@@ -1021,6 +1394,10 @@ int rpmidxStats(rpmidxdb idxdb)
     printf("Key data size: %u, left %u\n", idxdb->keyend, idxdb->key_size - idxdb->keyend);
     printf("Key excess: %u\n", idxdb->keyexcess);
     printf("XMask: 0x%08x\n", idxdb->xmask);
+    if (rpmidxSortValid(idxdb, 0, 0))
+	printf("Sorted key table: current\n");
+    else
+	printf("Sorted key table: %s\n", idxdb->sortid ? "stale" : "none");
     rpmidxUnlock(idxdb, 0);
     return RPMRC_OK;
 }
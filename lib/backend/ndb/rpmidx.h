@@ -11,8 +11,11 @@ void rpmidxClose(rpmidxdb idxdbp);
 
 int rpmidxGet(rpmidxdb idxdb, const unsigned char *key, unsigned int keyl, unsigned int **pkgidxlist, unsigned int *pkgidxnum);
 int rpmidxPut(rpmidxdb idxdb, const unsigned char *key, unsigned int keyl, unsigned int pkgidx, unsigned int datidx);
+int rpmidxPutBatchStart(rpmidxdb idxdb, unsigned int nkeys, unsigned int keybytes);
+int rpmidxPutBatchEnd(rpmidxdb idxdb);
 int rpmidxDel(rpmidxdb idxdb, const unsigned char *key, unsigned int keyl, unsigned int pkgidx, unsigned int datidx);
 int rpmidxList(rpmidxdb idxdb, unsigned int **keylistp, unsigned int *nkeylistp, unsigned char **datap);
+int rpmidxSortedList(rpmidxdb idxdb, unsigned int **keylistp, unsigned int *nkeylistp, unsigned char **datap);
 
 int rpmidxStats(rpmidxdb idxdb);
 
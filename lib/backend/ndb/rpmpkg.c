@@ -13,6 +13,10 @@
 #include <libgen.h>
 #include <dirent.h>
 
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+
 #include "rpmpkg.h"
 
 #define RPMRC_FAIL 2
@@ -54,6 +58,7 @@ typedef struct rpmpkgdb_s {
     char *filename;
     unsigned int fileblks;	/* file size in blks */
     int dofsync;
+    int compress;		/* zstd level for new blobs, 0 is off */
 } * rpmpkgdb;
 
 
@@ -242,6 +247,10 @@ static int rpmpkgReadSlots(rpmpkgdb pkgdb)
 	return RPMRC_FAIL;	/* hmm */
     fileblks = stb.st_size / BLK_SIZE;
 
+    /* stage all slot pages, the loop below reads them back to back */
+    (void) posix_fadvise(pkgdb->fd, 0, (off_t)slotnpages * PAGE_SIZE,
+			 POSIX_FADV_WILLNEED);
+
     /* read (and somewhat verify) all slots */
     pkgdb->slots = xcalloc(slotnpages * (PAGE_SIZE / SLOT_SIZE), sizeof(*pkgdb->slots));
     i = 0;
@@ -529,6 +538,9 @@ static int rpmpkgReadBlob(rpmpkgdb pkgdb, unsigned int pkgidx, unsigned int blko
     /* sanity */
     if (blkcnt <  (BLOBHEAD_SIZE + BLOBTAIL_SIZE + BLK_SIZE - 1) / BLK_SIZE)
 	return RPMRC_FAIL;	/* blkcnt too small */
+    /* stage the whole blob so the head/body/tail reads do not fault lock-step */
+    (void) posix_fadvise(pkgdb->fd, (off_t)blkoff * BLK_SIZE,
+			 (off_t)blkcnt * BLK_SIZE, POSIX_FADV_WILLNEED);
     /* read header */
     fileoff = (off_t)blkoff * BLK_SIZE;
     if (pread(pkgdb->fd, buf, BLOBHEAD_SIZE, fileoff) != BLOBHEAD_SIZE)
@@ -1238,6 +1250,8 @@ static int rpmpkgListInternal(rpmpkgdb pkgdb, unsigned int **pkgidxlistp, unsign
 	return RPMRC_OK;
     }
     rpmpkgOrderSlots(pkgdb);
+    /* a full list is almost always followed by reading every blob */
+    (void) posix_fadvise(pkgdb->fd, 0, 0, POSIX_FADV_WILLNEED);
     nslots = pkgdb->nslots;
     pkgidxlist = xcalloc(nslots + 1, sizeof(unsigned int));
     for (i = 0, slot = pkgdb->slots; i < nslots; i++, slot++) {
@@ -1264,19 +1278,184 @@ static int rpmpkgVerifyInternal(rpmpkgdb pkgdb)
     return RPMRC_OK;
 }
 
+/* Optimistic lockless variant of rpmpkgGet for concurrent read access.
+ * Writers always write new data before they flip the slot and bump the
+ * generation count, and only erase the old data after the bump. Thus a
+ * read is known to be consistent if the generation count did not change
+ * while we were reading, and readers do not need to take the lock at
+ * all. If a writer interferes we simply retry, the caller falls back
+ * to the locking path if the database stays too busy.
+ */
+static int rpmpkgGetLockless(rpmpkgdb pkgdb, unsigned int pkgidx, unsigned char **blobp, unsigned int *bloblp)
+{
+    unsigned char header[PKGDB_HEADER_SIZE];
+    unsigned char pagebuf[PAGE_SIZE];
+    struct stat stb;
+    unsigned int generation, slotnpages;
+    unsigned int blkoff = 0, blkcnt = 0;
+    unsigned int page, o;
+    unsigned char *blob;
+
+    /* read and check the header */
+    if (pread(pkgdb->fd, header, PKGDB_HEADER_SIZE, 0) != PKGDB_HEADER_SIZE)
+	return RPMRC_FAIL;
+    if (le2h(header + PKGDB_OFFSET_MAGIC) != PKGDB_MAGIC)
+	return RPMRC_FAIL;
+    if (le2h(header + PKGDB_OFFSET_VERSION) != PKGDB_VERSION)
+	return RPMRC_FAIL;
+    generation = le2h(header + PKGDB_OFFSET_GENERATION);
+    slotnpages = le2h(header + PKGDB_OFFSET_SLOTNPAGES);
+
+    /* scan the slot pages for our package index */
+    for (page = 0; page < slotnpages && !blkoff; page++) {
+	if (pread(pkgdb->fd, pagebuf, PAGE_SIZE, (off_t)page * PAGE_SIZE) != PAGE_SIZE)
+	    return RPMRC_FAIL;
+	for (o = page ? 0 : SLOT_START * SLOT_SIZE; o < PAGE_SIZE; o += SLOT_SIZE) {
+	    unsigned char *pp = pagebuf + o;
+	    if (le2h(pp) != SLOT_MAGIC)
+		return RPMRC_FAIL;
+	    if (le2h(pp + 4) != pkgidx || !le2h(pp + 8))
+		continue;
+	    blkoff = le2h(pp + 8);
+	    blkcnt = le2h(pp + 12);
+	    break;
+	}
+    }
+    if (!blkoff) {
+	/* not in the database. only valid if no writer interfered */
+	if (pread(pkgdb->fd, header, PKGDB_HEADER_SIZE, 0) != PKGDB_HEADER_SIZE)
+	    return RPMRC_FAIL;
+	if (le2h(header + PKGDB_OFFSET_GENERATION) != generation)
+	    return RPMRC_FAIL;	/* writer interfered, retry */
+	return RPMRC_NOTFOUND;
+    }
+    /* sanity check the slot data, we may have raced with a slot update */
+    if (fstat(pkgdb->fd, &stb))
+	return RPMRC_FAIL;
+    if (!blkcnt || (unsigned long long)blkoff + blkcnt > (unsigned long long)stb.st_size / BLK_SIZE)
+	return RPMRC_FAIL;
+    blob = xmalloc((size_t)blkcnt * BLK_SIZE);
+    if (rpmpkgReadBlob(pkgdb, pkgidx, blkoff, blkcnt, blob, bloblp, (unsigned int *)0)) {
+	free(blob);
+	return RPMRC_FAIL;
+    }
+    /* the blob is only valid if the generation did not change */
+    if (pread(pkgdb->fd, header, PKGDB_HEADER_SIZE, 0) != PKGDB_HEADER_SIZE ||
+	le2h(header + PKGDB_OFFSET_GENERATION) != generation) {
+	free(blob);
+	return RPMRC_FAIL;
+    }
+    *blobp = blob;
+    return RPMRC_OK;
+}
+
+/*** Blob compression ***/
+
+/*
+ * Header blobs are mostly repetitive tag data (paths, dependency
+ * strings) and compress very well. Compressed blobs are stored with a
+ * small envelope in front of the zstd frame; the envelope magic cannot
+ * collide with a raw header blob, whose leading index count keeps the
+ * first byte zero. Mixed databases are fine, each blob is handled by
+ * its own envelope, so enabling or disabling compression only affects
+ * new writes.
+ */
+
+/* envelope: magic + uncompressed length, followed by the zstd frame */
+#define BLOBCOMP_MAGIC	('Z' | 'h' << 8 | 'd' << 16 | 'R' << 24)
+#define BLOBCOMP_SIZE	8
+
+#ifdef HAVE_ZSTD
+static unsigned char *rpmpkgCompressBlob(unsigned char *blob, unsigned int blobl, int level, unsigned int *cbloblp)
+{
+    size_t bound = ZSTD_compressBound(blobl);
+    unsigned char *cblob = xmalloc(BLOBCOMP_SIZE + bound);
+    size_t clen = ZSTD_compress(cblob + BLOBCOMP_SIZE, bound, blob, blobl, level);
+
+    /* store uncompressed if compression fails or doesn't pay off */
+    if (ZSTD_isError(clen) || BLOBCOMP_SIZE + clen >= blobl) {
+	free(cblob);
+	return 0;
+    }
+    h2le(BLOBCOMP_MAGIC, cblob);
+    h2le(blobl, cblob + 4);
+    *cbloblp = BLOBCOMP_SIZE + clen;
+    return cblob;
+}
+#endif
+
+static int rpmpkgDecompressBlob(unsigned char **blobp, unsigned int *bloblp)
+{
+    unsigned char *blob = *blobp;
+    unsigned int blobl = *bloblp;
+
+    if (blobl < BLOBCOMP_SIZE || le2h(blob) != BLOBCOMP_MAGIC)
+	return RPMRC_OK;	/* stored uncompressed */
+#ifdef HAVE_ZSTD
+    {
+	unsigned int rawlen = le2h(blob + 4);
+	unsigned char *rawblob = xmalloc(rawlen ? rawlen : 1);
+	size_t dlen = ZSTD_decompress(rawblob, rawlen,
+			blob + BLOBCOMP_SIZE, blobl - BLOBCOMP_SIZE);
+
+	if (ZSTD_isError(dlen) || dlen != rawlen) {
+	    free(rawblob);
+	    return RPMRC_FAIL;	/* bad blob */
+	}
+	free(blob);
+	*blobp = rawblob;
+	*bloblp = rawlen;
+	return RPMRC_OK;
+    }
+#else
+    rpmlog(RPMLOG_ERR, _("rpmpkg: compressed blob, but zstd support is not built in\n"));
+    return RPMRC_FAIL;
+#endif
+}
+
+void rpmpkgSetCompression(rpmpkgdb pkgdb, int level)
+{
+#ifdef HAVE_ZSTD
+    if (level > 19)
+	level = 19;
+    pkgdb->compress = level;
+#endif
+}
+
 int rpmpkgGet(rpmpkgdb pkgdb, unsigned int pkgidx, unsigned char **blobp, unsigned int *bloblp)
 {
-    int rc;
+    int rc, retries;
 
     *blobp = 0;
     *bloblp = 0;
     if (!pkgidx)
 	return RPMRC_FAIL;
+    /* try the lockless path first, but not if we are inside a
+     * transaction that already holds the lock */
+    if (!pkgdb->locked_shared && !pkgdb->locked_excl) {
+	for (retries = 0; retries < 10; retries++) {
+	    rc = rpmpkgGetLockless(pkgdb, pkgidx, blobp, bloblp);
+	    if (rc == RPMRC_OK)
+		goto found;
+	    if (rc == RPMRC_NOTFOUND)
+		return rc;
+	}
+	/* too much write activity, fall back to the locking path */
+    }
     if (rpmpkgLockReadHeader(pkgdb, 0))
 	return RPMRC_FAIL;
     rc = rpmpkgGetInternal(pkgdb, pkgidx, blobp, bloblp);
     rpmpkgUnlock(pkgdb, 0);
-    return rc;
+    if (rc != RPMRC_OK)
+	return rc;
+found:
+    if (rpmpkgDecompressBlob(blobp, bloblp)) {
+	free(*blobp);
+	*blobp = 0;
+	*bloblp = 0;
+	return RPMRC_FAIL;
+    }
+    return RPMRC_OK;
 }
 
 int rpmpkgPut(rpmpkgdb pkgdb, unsigned int pkgidx, unsigned char *blob, unsigned int blobl)
@@ -1286,6 +1465,22 @@ int rpmpkgPut(rpmpkgdb pkgdb, unsigned int pkgidx, unsigned char *blob, unsigned
     if (!pkgidx) {
 	return RPMRC_FAIL;
     }
+#ifdef HAVE_ZSTD
+    if (pkgdb->compress > 0) {
+	unsigned int cblobl = 0;
+	unsigned char *cblob = rpmpkgCompressBlob(blob, blobl, pkgdb->compress, &cblobl);
+	if (cblob) {
+	    if (rpmpkgLockReadHeader(pkgdb, 1)) {
+		free(cblob);
+		return RPMRC_FAIL;
+	    }
+	    rc = rpmpkgPutInternal(pkgdb, pkgidx, cblob, cblobl);
+	    rpmpkgUnlock(pkgdb, 1);
+	    free(cblob);
+	    return rc;
+	}
+    }
+#endif
     if (rpmpkgLockReadHeader(pkgdb, 1))
 	return RPMRC_FAIL;
     rc = rpmpkgPutInternal(pkgdb, pkgidx, blob, blobl);
@@ -1320,6 +1515,42 @@ int rpmpkgList(rpmpkgdb pkgdb, unsigned int **pkgidxlistp, unsigned int *npkgidx
     return rc;
 }
 
+int rpmpkgCount(rpmpkgdb pkgdb, unsigned int *countp)
+{
+    int rc;
+    *countp = 0;
+    if (rpmpkgLockReadHeader(pkgdb, 0))
+	return RPMRC_FAIL;
+    rc = rpmpkgReadSlots(pkgdb);
+    if (rc == RPMRC_OK)
+	*countp = pkgdb->nslots;
+    rpmpkgUnlock(pkgdb, 0);
+    return rc;
+}
+
+/*
+ * Pre-allocate slot pages for an expected number of packages. Only
+ * effective on an empty database (i.e. at the start of a rebuild):
+ * growing the slot area one page at a time relocates already written
+ * blobs out of the way, which gets expensive as the database fills up.
+ */
+int rpmpkgSizeHint(rpmpkgdb pkgdb, unsigned int count)
+{
+    unsigned int slotsperpage = PAGE_SIZE / SLOT_SIZE;
+    unsigned int npages = (count + SLOT_START + slotsperpage - 1) / slotsperpage;
+    int rc;
+
+    if (rpmpkgLockReadHeader(pkgdb, 1))
+	return RPMRC_FAIL;
+    rc = rpmpkgReadSlots(pkgdb);
+    if (rc == RPMRC_OK && pkgdb->nslots == 0) {
+	while (pkgdb->slotnpages < npages && rc == RPMRC_OK)
+	    rc = rpmpkgAddSlotPage(pkgdb);
+    }
+    rpmpkgUnlock(pkgdb, 1);
+    return rc;
+}
+
 int rpmpkgVerify(rpmpkgdb pkgdb)
 {
     int rc;
@@ -5,6 +5,7 @@ int rpmpkgOpen(rpmpkgdb *pkgdbp, const char *filename, int flags, int mode);
 int rpmpkgSalvage(rpmpkgdb *pkgdbp, const char *filename);
 void rpmpkgClose(rpmpkgdb pkgdbp);
 void rpmpkgSetFsync(rpmpkgdb pkgdbp, int dofsync);
+void rpmpkgSetCompression(rpmpkgdb pkgdb, int level);
 
 int rpmpkgLock(rpmpkgdb pkgdb, int excl);
 int rpmpkgUnlock(rpmpkgdb pkgdb, int excl);
@@ -13,6 +14,8 @@ int rpmpkgGet(rpmpkgdb pkgdb, unsigned int pkgidx, unsigned char **blobp, unsign
 int rpmpkgPut(rpmpkgdb pkgdb, unsigned int pkgidx, unsigned char *blob, unsigned int blobl);
 int rpmpkgDel(rpmpkgdb pkgdb, unsigned int pkgidx);
 int rpmpkgList(rpmpkgdb pkgdb, unsigned int **pkgidxlistp, unsigned int *npkgidxlistp);
+int rpmpkgCount(rpmpkgdb pkgdb, unsigned int *countp);
+int rpmpkgSizeHint(rpmpkgdb pkgdb, unsigned int count);
 int rpmpkgVerify(rpmpkgdb pkgdb);
 
 int rpmpkgNextPkgIdx(rpmpkgdb pkgdb, unsigned int *pkgidxp);
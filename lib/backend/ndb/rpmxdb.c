@@ -144,6 +144,8 @@ static int mapheader(rpmxdb xdb, unsigned int slotnpages, int rw)
     mapped = mapmem(xdb->mapped, xdb->mappedlen, mappedlen, mapflags, xdb->fd, 0);
     if ((void *)mapped == MAP_FAILED)
 	return RPMRC_FAIL;
+    /* the slot pages get scanned right after mapping, fault them in bulk */
+    (void) madvise(mapped, mappedlen, MADV_WILLNEED);
     xdb->mapped = mapped;
     xdb->mappedlen = mappedlen;
     xdb->mappedrw = rw;
@@ -177,6 +179,8 @@ static int mapslot(rpmxdb xdb, struct xdb_slot *slot)
     mapped = mapmem(0, 0, size, slot->mapflags, xdb->fd, off);
     if (mapped == MAP_FAILED)
 	return RPMRC_FAIL;
+    /* index blobs are read on-demand, stage them instead of lock-step faults */
+    (void) madvise(mapped, size, MADV_WILLNEED);
     slot->mapped = (unsigned char *)mapped + shift;
     return RPMRC_OK;
 }
@@ -428,6 +432,13 @@ static int rpmxdbWriteEmptyPages(rpmxdb xdb, unsigned int pageno, unsigned int c
     unsigned char *page;
     if (!count)
 	return RPMRC_OK;
+#if defined(HAVE_FALLOCATE) && defined(FALLOC_FL_ZERO_RANGE)
+    /* zero (and allocate) the range in-kernel instead of writing
+     * zero-filled pages one by one. also extends the file if needed. */
+    if (!fallocate(xdb->fd, FALLOC_FL_ZERO_RANGE, (off_t)pageno * xdb->pagesize, (off_t)count * xdb->pagesize))
+	return RPMRC_OK;
+    /* fall back to explicit writes if the filesystem does not support it */
+#endif
     page = xmalloc(xdb->pagesize);
     memset(page, 0, xdb->pagesize);
     for (; count; count--, pageno++) {
@@ -652,10 +663,27 @@ static int moveblobto(rpmxdb xdb, struct xdb_slot *oldslot, struct xdb_slot *aft
 #if 0
     printf("moveblobto %d %d %d %d, afterslot %d\n", oldslot->startpage, oldslot->pagecnt, newstartpage, newpagecnt, afterslot->slotno);
 #endif
-    /* map old content */
     didmap = 0;
     oldpagecnt = oldslot->pagecnt;
-    if (!oldslot->mapped && oldpagecnt) {
+    tocopy = newpagecnt > oldpagecnt ? oldpagecnt : newpagecnt;
+#ifdef HAVE_COPY_FILE_RANGE
+    if (tocopy && !oldslot->mapped) {
+	/* copy in-kernel, the blob and the free area never overlap */
+	off_t inoff = (off_t)oldslot->startpage * xdb->pagesize;
+	off_t outoff = (off_t)newstartpage * xdb->pagesize;
+	size_t left = (size_t)tocopy * xdb->pagesize;
+	while (left > 0) {
+	    ssize_t copied = copy_file_range(xdb->fd, &inoff, xdb->fd, &outoff, left, 0);
+	    if (copied <= 0)
+		break;		/* fall back to the mapped copy */
+	    left -= copied;
+	}
+	if (!left)
+	    tocopy = 0;
+    }
+#endif
+    /* map old content */
+    if (tocopy && !oldslot->mapped) {
 	if (!oldslot->mapcallback)
 	    oldslot->mapflags = PROT_READ;
 	if (mapslot(xdb, oldslot))
@@ -664,7 +692,6 @@ static int moveblobto(rpmxdb xdb, struct xdb_slot *oldslot, struct xdb_slot *aft
     }
 
     /* copy content */
-    tocopy = newpagecnt > oldpagecnt ? oldpagecnt : newpagecnt;
     if (tocopy && pwrite(xdb->fd, oldslot->mapped, tocopy * xdb->pagesize, newstartpage * xdb->pagesize) != tocopy * xdb->pagesize) {
 	if (didmap)
 	    unmapslot(xdb, oldslot);
@@ -27,6 +27,61 @@ struct dbiCursor_s {
 
 static int sqlexec(sqlite3 *sdb, const char *fmt, ...);
 
+#define STMT_CACHE_SIZE 4
+
+/* Per-dbi stash of prepared statements, reused across cursors */
+struct sqlite_priv {
+    sqlite3_stmt *stmts[STMT_CACHE_SIZE];
+};
+
+static struct sqlite_priv *stmtCache(dbiIndex dbi)
+{
+    if (dbi->dbi_priv == NULL)
+	dbi->dbi_priv = xcalloc(1, sizeof(struct sqlite_priv));
+    return dbi->dbi_priv;
+}
+
+static sqlite3_stmt *stmtCacheGet(dbiIndex dbi, const char *cmd)
+{
+    struct sqlite_priv *priv = stmtCache(dbi);
+    for (int i = 0; i < STMT_CACHE_SIZE; i++) {
+	sqlite3_stmt *stmt = priv->stmts[i];
+	if (stmt && rstreq(sqlite3_sql(stmt), cmd)) {
+	    priv->stmts[i] = NULL;
+	    return stmt;
+	}
+    }
+    return NULL;
+}
+
+/* Stash a statement for later reuse, finalize if there's no room */
+static sqlite3_stmt *stmtCachePut(dbiIndex dbi, sqlite3_stmt *stmt)
+{
+    if (stmt) {
+	struct sqlite_priv *priv = stmtCache(dbi);
+	sqlite3_reset(stmt);
+	sqlite3_clear_bindings(stmt);
+	for (int i = 0; i < STMT_CACHE_SIZE; i++) {
+	    if (priv->stmts[i] == NULL) {
+		priv->stmts[i] = stmt;
+		return NULL;
+	    }
+	}
+	sqlite3_finalize(stmt);
+    }
+    return NULL;
+}
+
+static void stmtCacheFree(dbiIndex dbi)
+{
+    if (dbi->dbi_priv) {
+	struct sqlite_priv *priv = dbi->dbi_priv;
+	for (int i = 0; i < STMT_CACHE_SIZE; i++)
+	    sqlite3_finalize(priv->stmts[i]);
+	dbi->dbi_priv = _free(dbi->dbi_priv);
+    }
+}
+
 static void rpm_match3(sqlite3_context *sctx, int argc, sqlite3_value **argv)
 {
     int match = 0;
@@ -70,16 +125,21 @@ static int dbiCursorResult(dbiCursor dbc)
     return err ? RPMRC_FAIL : RPMRC_OK;
 }
 
-static int dbiCursorPrep(dbiCursor dbc, const char *fmt, ...)
+static int dbiCursorPrep(dbiIndex dbi, dbiCursor dbc, const char *fmt, ...)
 {
     if (dbc->stmt == NULL) {
 	char *cmd = NULL;
 	va_list ap;
 
-	va_start(ap, fmt); 
+	va_start(ap, fmt);
 	cmd = sqlite3_vmprintf(fmt, ap);
 	va_end(ap);
 
+	dbc->stmt = stmtCacheGet(dbi, cmd);
+	if (dbc->stmt) {
+	    sqlite3_free(cmd);
+	    return RPMRC_OK;
+	}
 	sqlite3_prepare_v2(dbc->sdb, cmd, -1, &dbc->stmt, NULL);
 	sqlite3_free(cmd);
     } else {
@@ -181,6 +241,25 @@ static int sqlite_init(rpmdb rdb, const char * dbhome)
 	    }
 	}
 
+	{   /* Apply user performance tuning (see macros.in) */
+	    char *val = rpmExpand("%{?_sqlite_synchronous}", NULL);
+	    if (*val && sqlite3_db_readonly(sdb, NULL) == 0)
+		sqlexec(sdb, "PRAGMA synchronous = %q", val);
+	    val = _free(val);
+
+	    val = rpmExpand("%{?_sqlite_mmap_size}", NULL);
+	    if (*val)
+		sqlexec(sdb, "PRAGMA mmap_size = %lld",
+			(long long)strtoll(val, NULL, 0));
+	    val = _free(val);
+
+	    val = rpmExpand("%{?_sqlite_cache_size}", NULL);
+	    if (*val)
+		sqlexec(sdb, "PRAGMA cache_size = %lld",
+			(long long)strtoll(val, NULL, 0));
+	    val = _free(val);
+	}
+
 	rdb->db_dbenv = sdb;
     }
     rdb->db_opens++;
@@ -332,6 +411,7 @@ static int sqlite_Close(dbiIndex dbi, unsigned int flags)
     int rc = 0;
     if (rdb->db_flags & RPMDB_FLAG_REBUILD)
 	rc = init_index(dbi, rpmTagGetValue(dbi->dbi_file));
+    stmtCacheFree(dbi);
     sqlite_fini(dbi->dbi_rpmdb);
     dbiFree(dbi);
     return rc;
@@ -386,8 +466,12 @@ exit:
 
 static void sqlite_SetFSync(rpmdb rdb, int enable)
 {
-    sqlexec(rdb->db_dbenv,
-	    "PRAGMA synchronous = %s", enable ? "FULL" : "OFF");
+    /* %_sqlite_synchronous overrides the default FULL when re-enabling */
+    char *mode = rpmExpand(enable ?
+		"%{?_sqlite_synchronous}%{!?_sqlite_synchronous:FULL}" :
+		"OFF", NULL);
+    sqlexec(rdb->db_dbenv, "PRAGMA synchronous = %q", mode);
+    free(mode);
 }
 
 static int sqlite_Ctrl(rpmdb rdb, dbCtrlOp ctrl)
@@ -427,7 +511,7 @@ static dbiCursor sqlite_CursorInit(dbiIndex dbi, unsigned int flags)
 static dbiCursor sqlite_CursorFree(dbiIndex dbi, dbiCursor dbc)
 {
     if (dbc) {
-	sqlite3_finalize(dbc->stmt);
+	dbc->stmt = stmtCachePut(dbi, dbc->stmt);
 	if (dbc->subc)
 	    dbiCursorFree(dbi, dbc->subc);
 	if (dbc->flags & DBC_WRITE)
@@ -449,7 +533,7 @@ static rpmRC sqlite_pkgdbPut(dbiIndex dbi, dbiCursor dbc,  unsigned int *hdrNum,
     }
 
     if (!rc) {
-	rc = dbiCursorPrep(dbc, "INSERT OR REPLACE INTO '%q' VALUES(?, ?)",
+	rc = dbiCursorPrep(dbi, dbc, "INSERT OR REPLACE INTO '%q' VALUES(?, ?)",
 			    dbi->dbi_file);
     }
 
@@ -473,7 +557,7 @@ static rpmRC sqlite_pkgdbPut(dbiIndex dbi, dbiCursor dbc,  unsigned int *hdrNum,
 
 static rpmRC sqlite_pkgdbDel(dbiIndex dbi, dbiCursor dbc,  unsigned int hdrNum)
 {
-    int rc = dbiCursorPrep(dbc, "DELETE FROM '%q' WHERE hnum=?;",
+    int rc = dbiCursorPrep(dbi, dbc, "DELETE FROM '%q' WHERE hnum=?;",
 			    dbi->dbi_file);
 
     if (!rc)
@@ -500,7 +584,7 @@ static rpmRC sqlite_stepPkg(dbiCursor dbc, unsigned char **hdrBlob, unsigned int
 
 static rpmRC sqlite_pkgdbByKey(dbiIndex dbi, dbiCursor dbc, unsigned int hdrNum, unsigned char **hdrBlob, unsigned int *hdrLen)
 {
-    int rc = dbiCursorPrep(dbc, "SELECT hnum, blob FROM '%q' WHERE hnum=?",
+    int rc = dbiCursorPrep(dbi, dbc, "SELECT hnum, blob FROM '%q' WHERE hnum=?",
 				dbi->dbi_file);
 
     if (!rc)
@@ -517,7 +601,7 @@ static rpmRC sqlite_pkgdbIter(dbiIndex dbi, dbiCursor dbc,
 {
     int rc = RPMRC_OK;
     if (dbc->stmt == NULL) {
-	rc = dbiCursorPrep(dbc, "SELECT hnum, blob FROM '%q'", dbi->dbi_file);
+	rc = dbiCursorPrep(dbi, dbc, "SELECT hnum, blob FROM '%q'", dbi->dbi_file);
     }
 
     if (!rc)
@@ -557,12 +641,12 @@ static rpmRC sqlite_idxdbByKey(dbiIndex dbi, dbiCursor dbc,
     int rc = RPMRC_NOTFOUND;
 
     if (searchType == DBC_PREFIX_SEARCH) {
-	rc = dbiCursorPrep(dbc, "SELECT hnum, idx FROM '%q' "
+	rc = dbiCursorPrep(dbi, dbc, "SELECT hnum, idx FROM '%q' "
 				"WHERE MATCH(key,'%q',%d) "
 				"ORDER BY key",
 				dbi->dbi_file, keyp, keylen);
     } else {
-	rc = dbiCursorPrep(dbc, "SELECT hnum, idx FROM '%q' WHERE key=?",
+	rc = dbiCursorPrep(dbi, dbc, "SELECT hnum, idx FROM '%q' WHERE key=?",
 			dbi->dbi_file);
 	if (!rc)
 	    rc = dbiCursorBindIdx(dbc, keyp, keylen, NULL);
@@ -594,7 +678,7 @@ static rpmRC sqlite_idxdbIter(dbiIndex dbi, dbiCursor dbc, dbiIndexSet *set)
     int rc = RPMRC_OK;
 
     if (dbc->stmt == NULL) {
-	rc = dbiCursorPrep(dbc, "SELECT DISTINCT key FROM '%q' ORDER BY key",
+	rc = dbiCursorPrep(dbi, dbc, "SELECT DISTINCT key FROM '%q' ORDER BY key",
 				dbi->dbi_file);
 	if (set)
 	    dbc->subc = dbiCursorInit(dbi, 0);
@@ -639,7 +723,7 @@ static rpmRC sqlite_idxdbGet(dbiIndex dbi, dbiCursor dbc, const char *keyp, size
 
 static rpmRC sqlite_idxdbPutOne(dbiIndex dbi, dbiCursor dbc, const char *keyp, size_t keylen, dbiIndexItem rec)
 {
-    int rc = dbiCursorPrep(dbc, "INSERT INTO '%q' VALUES(?, ?, ?)",
+    int rc = dbiCursorPrep(dbi, dbc, "INSERT INTO '%q' VALUES(?, ?, ?)",
 			dbi->dbi_file);
 
     if (!rc)
@@ -659,7 +743,7 @@ static rpmRC sqlite_idxdbPut(dbiIndex dbi, rpmTagVal rpmtag, unsigned int hdrNum
 static rpmRC sqlite_idxdbDel(dbiIndex dbi, rpmTagVal rpmtag, unsigned int hdrNum, Header h)
 {
     dbiCursor dbc = dbiCursorInit(dbi, DBC_WRITE);
-    int rc = dbiCursorPrep(dbc, "DELETE FROM '%q' WHERE hnum=?", dbi->dbi_file);
+    int rc = dbiCursorPrep(dbi, dbc, "DELETE FROM '%q' WHERE hnum=?", dbi->dbi_file);
 
     if (!rc)
 	rc = dbiCursorBindPkg(dbc, hdrNum, NULL, 0);
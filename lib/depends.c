@@ -4,13 +4,19 @@
 
 #include "system.h"
 
+#include <fcntl.h>
+#include <pthread.h>
+
 #include <rpm/rpmlib.h>		/* rpmVersionCompare, rpmlib provides */
 #include <rpm/rpmtag.h>
 #include <rpm/rpmlog.h>
 #include <rpm/rpmdb.h>
 #include <rpm/rpmds.h>
 #include <rpm/rpmfi.h>
+#include <rpm/rpmmacro.h>
+#include <rpm/rpmfileutil.h>
 
+#include "lib/rpmdb_internal.h"
 #include "lib/rpmts_internal.h"
 #include "lib/rpmte_internal.h"
 #include "lib/rpmds_internal.h"
@@ -37,7 +43,7 @@ const int rpmFLAGS = RPMSENSE_EQUAL;
 #define HTKEYTYPE const char *
 #define HTDATATYPE int
 #include "lib/rpmhash.H"
-#include "lib/rpmhash.C"
+#include "lib/rpmohash.C"
 #undef HASHTYPE
 #undef HTKEYTYPE
 #undef HTDATATYPE
@@ -54,7 +60,7 @@ const int rpmFLAGS = RPMSENSE_EQUAL;
 #define HTKEYTYPE rpmsid
 #define HTDATATYPE rpmsid
 #include "rpmhash.H"
-#include "rpmhash.C"
+#include "rpmohash.C"
 #undef HASHTYPE
 #undef HTKEYTYPE
 #undef HTDATATYPE
@@ -62,7 +68,7 @@ const int rpmFLAGS = RPMSENSE_EQUAL;
 #define HASHTYPE depexistsHash
 #define HTKEYTYPE rpmsid
 #include "lib/rpmhash.H"
-#include "lib/rpmhash.C"
+#include "lib/rpmohash.C"
 #undef HASHTYPE
 #undef HTKEYTYPE
 
@@ -127,7 +133,10 @@ static int removePackage(rpmts ts, Header h, rpmte depends)
     packageHashAddEntry(tsmem->removedPackages, dboffset, p);
 
     if (tsmem->orderCount >= tsmem->orderAlloced) {
-	tsmem->orderAlloced += (tsmem->orderCount - tsmem->orderAlloced) + tsmem->delta;
+	/* Grow geometrically, mass erasures add tens of thousands here */
+	tsmem->orderAlloced = (tsmem->orderAlloced > 0) ?
+				tsmem->orderAlloced * 2 :
+				tsmem->orderCount + tsmem->delta;
 	tsmem->order = xrealloc(tsmem->order, sizeof(*tsmem->order) * tsmem->orderAlloced);
     }
 
@@ -135,6 +144,7 @@ static int removePackage(rpmts ts, Header h, rpmte depends)
 
     tsmem->order[tsmem->orderCount] = p;
     tsmem->orderCount++;
+    packageHashAddEntry(tsmem->nevraIndex, rpmteNEVRAId(p), p);
     rpmtsNotifyChange(ts, RPMTS_EVENT_ADD, p, depends);
 
     return 0;
@@ -442,7 +452,10 @@ static int addPackage(rpmts ts, Header h,
     }
 
     if (oc >= tsmem->orderAlloced) {
-	tsmem->orderAlloced += (oc - tsmem->orderAlloced) + tsmem->delta;
+	/* Grow geometrically, same as on the erasure side */
+	tsmem->orderAlloced = (tsmem->orderAlloced > 0) ?
+				tsmem->orderAlloced * 2 :
+				oc + tsmem->delta;
 	tsmem->order = xrealloc(tsmem->order,
 			tsmem->orderAlloced * sizeof(*tsmem->order));
     }
@@ -452,6 +465,7 @@ static int addPackage(rpmts ts, Header h,
     if (oc == tsmem->orderCount) {
 	tsmem->orderCount++;
     }
+    packageHashAddEntry(tsmem->nevraIndex, rpmteNEVRAId(p), p);
     rpmtsNotifyChange(ts, RPMTS_EVENT_ADD, p, NULL);
 
     
@@ -496,25 +510,215 @@ int rpmtsAddEraseElement(rpmts ts, Header h, int dboffset)
     return removePackage(ts, h, NULL);
 }
 
-/* Cached rpmdb provide lookup, returns 0 if satisfied, 1 otherwise */
-static int rpmdbProvides(rpmts ts, depCache dcache, rpmds dep, dbiIndexSet *matches)
+/*
+ * The dependency check cache is sharded by key hash with one lock per
+ * shard, so the parallel cache warming workers rarely contend on it.
+ * The serial check phase goes through the same accessors.
+ */
+#define DEPCACHE_SHARDS 16
+
+struct depCacheStore_s {
+    depCache shards[DEPCACHE_SHARDS];
+    pthread_mutex_t locks[DEPCACHE_SHARDS];
+};
+
+static struct depCacheStore_s *depCacheStoreCreate(void)
+{
+    struct depCacheStore_s *st = xcalloc(1, sizeof(*st));
+
+    /* XXX FIXME: figure some kind of heuristic for the cache size */
+    for (int i = 0; i < DEPCACHE_SHARDS; i++) {
+	st->shards[i] = depCacheCreate(5001 / DEPCACHE_SHARDS,
+				rstrhash, strcmp, (depCacheFreeKey)rfree, NULL);
+	pthread_mutex_init(&st->locks[i], NULL);
+    }
+    return st;
+}
+
+static struct depCacheStore_s *depCacheStoreFree(struct depCacheStore_s *st)
+{
+    if (st != NULL) {
+	for (int i = 0; i < DEPCACHE_SHARDS; i++) {
+	    depCacheFree(st->shards[i]);
+	    pthread_mutex_destroy(&st->locks[i]);
+	}
+	free(st);
+    }
+    return NULL;
+}
+
+static int depCacheStoreGet(struct depCacheStore_s *st, const char *DNEVR,
+			    int *rcp)
+{
+    unsigned int keyhash = depCacheKeyHash(st->shards[0], DNEVR);
+    int sx = keyhash % DEPCACHE_SHARDS;
+    int *cachedrc = NULL;
+    int found;
+
+    pthread_mutex_lock(&st->locks[sx]);
+    found = depCacheGetHEntry(st->shards[sx], DNEVR, keyhash,
+			      &cachedrc, NULL, NULL);
+    if (found)
+	*rcp = *cachedrc;
+    pthread_mutex_unlock(&st->locks[sx]);
+    return found;
+}
+
+static void depCacheStoreAdd(struct depCacheStore_s *st, const char *DNEVR,
+			     int rc)
+{
+    unsigned int keyhash = depCacheKeyHash(st->shards[0], DNEVR);
+    int sx = keyhash % DEPCACHE_SHARDS;
+
+    pthread_mutex_lock(&st->locks[sx]);
+    /* a racing worker may have beaten us to it */
+    if (!depCacheHasEntry(st->shards[sx], DNEVR))
+	depCacheAddHEntry(st->shards[sx], xstrdup(DNEVR), keyhash, rc);
+    pthread_mutex_unlock(&st->locks[sx]);
+}
+
+/*
+ * Persistent dependency check cache (optional, see %_depcache_path):
+ * rpmdb provide lookup results are carried from one transaction to the
+ * next in a simple text file under the rpmdb directory, invalidated by
+ * the rpmdb cookie. Pruning of to-be-erased packages changes what a
+ * lookup may legitimately return, so only transactions that don't erase
+ * anything consult and refresh the cache.
+ */
+static char *depCachePath(rpmts ts)
+{
+    char *path = NULL;
+    char *fn = rpmExpand("%{?_depcache_path}", NULL);
+    if (*fn != '\0')
+	path = rpmGenPath(rpmtsRootDir(ts), fn, NULL);
+    free(fn);
+    return path;
+}
+
+static void depCacheLoadPersistent(rpmts ts, struct depCacheStore_s *dcache)
+{
+    char *path = depCachePath(ts);
+    char *cookie = NULL;
+    char line[BUFSIZ];
+    FILE *fp = NULL;
+    int nent = 0;
+
+    if (path == NULL)
+	goto exit;
+    if ((fp = fopen(path, "r")) == NULL)
+	goto exit;
+    if ((cookie = rpmdbCookie(rpmtsGetRdb(ts))) == NULL)
+	goto exit;
+
+    /* First line carries the rpmdb cookie the entries are valid for */
+    if (fgets(line, sizeof(line), fp) == NULL)
+	goto exit;
+    line[strcspn(line, "\n")] = '\0';
+    if (!rstreq(line, cookie)) {
+	rpmlog(RPMLOG_DEBUG, "dep cache %s: stale cookie, ignoring\n", path);
+	goto exit;
+    }
+
+    while (fgets(line, sizeof(line), fp) != NULL) {
+	char *dnevr = line + 2;
+	if ((line[0] != '0' && line[0] != '1') || line[1] != ' ')
+	    continue;
+	line[strcspn(line, "\n")] = '\0';
+	if (*dnevr == '\0')
+	    continue;
+	depCacheStoreAdd(dcache, dnevr, line[0] - '0');
+	nent++;
+    }
+    rpmlog(RPMLOG_DEBUG, "loaded %d entries from dep cache %s\n", nent, path);
+
+exit:
+    if (fp)
+	fclose(fp);
+    free(cookie);
+    free(path);
+}
+
+static void depCacheWriteEntry(const char *key, int *data, int dataCount,
+			       void *userdata)
+{
+    FILE *fp = userdata;
+    if (dataCount > 0)
+	fprintf(fp, "%d %s\n", data[0] ? 1 : 0, key);
+}
+
+static void depCacheSavePersistent(rpmts ts, struct depCacheStore_s *dcache)
+{
+    char *path = depCachePath(ts);
+    char *tmppath = NULL;
+    char *cookie = NULL;
+    FILE *fp = NULL;
+
+    if (path == NULL)
+	goto exit;
+    if ((cookie = rpmdbCookie(rpmtsGetRdb(ts))) == NULL)
+	goto exit;
+
+    rasprintf(&tmppath, "%s.tmp.%d", path, (int) getpid());
+    if ((fp = fopen(tmppath, "w")) == NULL)
+	goto exit;
+
+    fprintf(fp, "%s\n", cookie);
+    for (int i = 0; i < DEPCACHE_SHARDS; i++)
+	depCacheForEach(dcache->shards[i], depCacheWriteEntry, fp);
+
+    if (fclose(fp) == 0) {
+	if (rename(tmppath, path) != 0)
+	    unlink(tmppath);
+    } else {
+	unlink(tmppath);
+    }
+    fp = NULL;
+
+exit:
+    if (fp)
+	fclose(fp);
+    free(tmppath);
+    free(cookie);
+    free(path);
+}
+
+/* Return rpmdb iterator for dependency lookups, optionally on a private
+ * read handle (parallel cache warming) instead of the ts database. */
+static rpmdbMatchIterator depIterator(rpmts ts, rpmdb db, rpmDbiTagVal tag,
+				      const char *key, int prune)
+{
+    rpmdbMatchIterator mi;
+
+    if (db != NULL) {
+	mi = rpmdbInitIterator(db, tag, key, 0);
+	/* ts-free probes have no removals to prune */
+	if (prune && ts != NULL)
+	    rpmdbPruneIterator(mi, rpmtsMembers(ts)->removedPackages);
+    } else {
+	mi = rpmtsPrunedIterator(ts, tag, key, prune);
+    }
+    return mi;
+}
+
+/* Cached rpmdb provide lookup, returns 0 if satisfied, 1 otherwise.
+ * db and pool are normally NULL (use those of ts); the parallel cache
+ * warming workers pass their own private handle and pool. */
+static int rpmdbProvides(rpmts ts, rpmdb db, rpmstrPool pool,
+			 struct depCacheStore_s *dcache,
+			 rpmds dep, dbiIndexSet *matches)
 {
     const char * Name = rpmdsN(dep);
     const char * DNEVR = rpmdsDNEVR(dep);
     rpmTagVal deptag = rpmdsTagN(dep);
-    int *cachedrc = NULL;
     rpmdbMatchIterator mi = NULL;
     Header h = NULL;
     int rc = 0;
     /* pretrans deps are provided by current packages, don't prune erasures */
     int prune = (rpmdsFlags(dep) & RPMSENSE_PRETRANS) ? 0 : 1;
-    unsigned int keyhash = 0;
 
     /* See if we already looked this up */
     if (prune && !matches) {
-	keyhash = depCacheKeyHash(dcache, DNEVR);
-	if (depCacheGetHEntry(dcache, DNEVR, keyhash, &cachedrc, NULL, NULL)) {
-	    rc = *cachedrc;
+	if (depCacheStoreGet(dcache, DNEVR, &rc)) {
 	    rpmdsNotify(dep, "(cached)", rc);
 	    return rc;
 	}
@@ -528,7 +732,7 @@ static int rpmdbProvides(rpmts ts, depCache dcache, rpmds dep, dbiIndexSet *matc
      * not installed files can not satisfy a dependency.
      */
     if (deptag != RPMTAG_OBSOLETENAME && Name[0] == '/') {
-	mi = rpmtsPrunedIterator(ts, RPMDBI_INSTFILENAMES, Name, prune);
+	mi = depIterator(ts, db, RPMDBI_INSTFILENAMES, Name, prune);
 	while ((h = rpmdbNextIterator(mi)) != NULL) {
 	    /* Ignore self-conflicts */
 	    if (deptag == RPMTAG_CONFLICTNAME) {
@@ -548,7 +752,6 @@ static int rpmdbProvides(rpmts ts, depCache dcache, rpmds dep, dbiIndexSet *matc
 
     /* Otherwise look in provides no matter what the dependency looks like */
     if (h == NULL) {
-	rpmstrPool tspool = rpmtsPool(ts);
 	/* Obsoletes use just name alone, everything else uses provides */
 	rpmTagVal dbtag = RPMDBI_PROVIDENAME;
 	int selfevr = 0;
@@ -556,12 +759,14 @@ static int rpmdbProvides(rpmts ts, depCache dcache, rpmds dep, dbiIndexSet *matc
 	    dbtag = RPMDBI_NAME;
 	    selfevr = 1;
 	}
+	if (pool == NULL)
+	    pool = rpmtsPool(ts);
 
-	mi = rpmtsPrunedIterator(ts, dbtag, Name, prune);
+	mi = depIterator(ts, db, dbtag, Name, prune);
 	while ((h = rpmdbNextIterator(mi)) != NULL) {
 	    /* Provide-indexes can't be used with nevr-only matching */
 	    int prix = (selfevr) ? -1 : rpmdbGetIteratorFileNum(mi);
-	    int match = rpmdsMatches(tspool, h, prix, dep, selfevr);
+	    int match = rpmdsMatches(pool, h, prix, dep, selfevr);
 	    /* Ignore self-obsoletes and self-conflicts */
 	    if (match && (deptag == RPMTAG_OBSOLETENAME || deptag == RPMTAG_CONFLICTNAME)) {
 		unsigned int instance = headerGetInstance(h);
@@ -589,7 +794,7 @@ static int rpmdbProvides(rpmts ts, depCache dcache, rpmds dep, dbiIndexSet *matc
     /* Cache the relatively expensive rpmdb lookup results */
     /* Caching the oddball non-pruned case would mess up other results */
     if (prune && !matches)
-	depCacheAddHEntry(dcache, xstrdup(DNEVR), keyhash, rc);
+	depCacheStoreAdd(dcache, DNEVR, rc);
     return rc;
 }
 
@@ -639,7 +844,7 @@ exit_rich:
     }
 
     /* match database entries */
-    rpmdbProvides(ts, NULL, dep, &set1);
+    rpmdbProvides(ts, NULL, NULL, NULL, dep, &set1);
 
     /* Pretrans dependencies can't be satisfied by added packages. */
     if (!(dsflags & RPMSENSE_PRETRANS)) {
@@ -663,7 +868,7 @@ exit:
  * @param dep		dependency
  * @return		0 if satisfied, 1 if not satisfied
  */
-static int unsatisfiedDepend(rpmts ts, depCache dcache, rpmds dep)
+static int unsatisfiedDepend(rpmts ts, struct depCacheStore_s *dcache, rpmds dep)
 {
     tsMembers tsmem = rpmtsMembers(ts);
     int rc;
@@ -765,7 +970,7 @@ exitrich:
     }
 
     /* See if the rpmdb provides it */
-    if (rpmdbProvides(ts, dcache, dep, NULL) == 0)
+    if (rpmdbProvides(ts, NULL, NULL, dcache, dep, NULL) == 0)
 	goto exit;
 
     /* Search for an unsatisfied dependency. */
@@ -793,8 +998,173 @@ exit:
     return rc;
 }
 
+/*
+ * Lighter cousins of unsatisfiedDepend(Set): probe dependencies
+ * against the installed packages alone, with no transaction set,
+ * transaction elements or problem sets behind them.
+ */
+static int dbDepSatisfied(rpmdb db, rpmstrPool pool,
+			  struct depCacheStore_s *dcache,
+			  rpmds *rpmlibp, rpmds dep);
+
+static dbiIndexSet dbSatisfierSet(rpmdb db, rpmstrPool pool, rpmds dep)
+{
+    dbiIndexSet set1 = NULL, set2 = NULL;
+
+    if (rpmdsFlags(dep) & RPMSENSE_RPMLIB)
+	goto exit;
+
+    if (rpmdsIsRich(dep)) {
+	rpmds ds1, ds2;
+	rpmrichOp op;
+	char *emsg = 0;
+
+	if (rpmdsParseRichDep(dep, &ds1, &ds2, &op, &emsg) != RPMRC_OK) {
+	    rpmdsNotify(dep, emsg ? emsg : "(parse error)", 1);
+	    _free(emsg);
+	    goto exit;
+	}
+	/* only a subset of ops is supported in set mode */
+	if (op != RPMRICHOP_WITH && op != RPMRICHOP_WITHOUT
+	    && op != RPMRICHOP_OR && op != RPMRICHOP_SINGLE) {
+	    rpmdsNotify(dep, "(unsupported op in set mode)", 1);
+	    goto exit_rich;
+	}
+
+	set1 = dbSatisfierSet(db, pool, ds1);
+	if (op == RPMRICHOP_SINGLE)
+	    goto exit_rich;
+	if (op != RPMRICHOP_OR && dbiIndexSetCount(set1) == 0)
+	    goto exit_rich;
+	set2 = dbSatisfierSet(db, pool, ds2);
+	if (op == RPMRICHOP_WITH) {
+	    dbiIndexSetFilterSet(set1, set2, 0);
+	} else if (op == RPMRICHOP_WITHOUT) {
+	    dbiIndexSetPruneSet(set1, set2, 0);
+	} else if (op == RPMRICHOP_OR) {
+	    dbiIndexSetAppendSet(set1, set2, 0);
+	}
+exit_rich:
+	ds1 = rpmdsFree(ds1);
+	ds2 = rpmdsFree(ds2);
+	goto exit;
+    }
+
+    /* match database entries */
+    rpmdbProvides(NULL, db, pool, NULL, dep, &set1);
+
+exit:
+    set2 = dbiIndexSetFree(set2);
+    return set1 ? set1 : dbiIndexSetNew(0);
+}
+
+static int dbDepSatisfied(rpmdb db, rpmstrPool pool,
+			  struct depCacheStore_s *dcache,
+			  rpmds *rpmlibp, rpmds dep)
+{
+    int rc = 1;		/* assume unsatisfied */
+
+    /* rpmlib() features are provided by rpm itself */
+    if (rpmdsFlags(dep) & RPMSENSE_RPMLIB) {
+	if (*rpmlibp == NULL)
+	    rpmdsRpmlibPool(pool, rpmlibp, NULL);
+	rc = !(*rpmlibp != NULL && rpmdsSearch(*rpmlibp, dep) >= 0);
+	rpmdsNotify(dep, "(rpmlib provides)", rc);
+	return rc;
+    }
+
+    /* Handle rich dependencies */
+    if (rpmdsIsRich(dep)) {
+	rpmds ds1, ds2;
+	rpmrichOp op;
+	char *emsg = 0;
+
+	if (rpmdsParseRichDep(dep, &ds1, &ds2, &op, &emsg) != RPMRC_OK) {
+	    rpmdsNotify(dep, emsg ? emsg : "(parse error)", 1);
+	    _free(emsg);
+	    return 1;
+	}
+	if (op == RPMRICHOP_WITH || op == RPMRICHOP_WITHOUT) {
+	    /* switch to set mode processing */
+	    dbiIndexSet set = dbSatisfierSet(db, pool, dep);
+	    rc = dbiIndexSetCount(set) ? 0 : 1;
+	    dbiIndexSetFree(set);
+	} else if (op == RPMRICHOP_IF || op == RPMRICHOP_UNLESS) {
+	    /* A IF B -> A OR NOT(B) */
+	    /* A UNLESS B -> A AND NOT(B) */
+	    int haselse = 0;
+	    if (rpmdsIsRich(ds2)) {
+		/* check if this has an ELSE clause */
+		rpmds ds21 = NULL, ds22 = NULL;
+		rpmrichOp op2;
+		if (rpmdsParseRichDep(ds2, &ds21, &ds22, &op2, NULL) == RPMRC_OK
+		    && op2 == RPMRICHOP_ELSE) {
+		    /* A IF B ELSE C -> (A OR NOT(B)) AND (C OR B) */
+		    /* A UNLESS B ELSE C -> (A AND NOT(B)) OR (C AND B) */
+		    rc = !dbDepSatisfied(db, pool, dcache, rpmlibp, ds21);
+		    if ((rc && op == RPMRICHOP_IF) ||
+			(!rc && op == RPMRICHOP_UNLESS)) {
+			rc = dbDepSatisfied(db, pool, dcache, rpmlibp, ds1);
+		    } else {
+			rc = dbDepSatisfied(db, pool, dcache, rpmlibp, ds22);
+		    }
+		    haselse = 1;
+		}
+		rpmdsFree(ds21);
+		rpmdsFree(ds22);
+	    }
+	    if (!haselse) {
+		rc = !dbDepSatisfied(db, pool, dcache, rpmlibp, ds2);
+		if ((rc && op == RPMRICHOP_IF) ||
+		    (!rc && op == RPMRICHOP_UNLESS))
+		    rc = dbDepSatisfied(db, pool, dcache, rpmlibp, ds1);
+	    }
+	} else {
+	    rc = dbDepSatisfied(db, pool, dcache, rpmlibp, ds1);
+	    if ((rc && op == RPMRICHOP_OR) || (!rc && op == RPMRICHOP_AND))
+		rc = dbDepSatisfied(db, pool, dcache, rpmlibp, ds2);
+	}
+	ds1 = rpmdsFree(ds1);
+	ds2 = rpmdsFree(ds2);
+	rpmdsNotify(dep, "(rich)", rc);
+	return rc;
+    }
+
+    if (rpmdsFlags(dep) & RPMSENSE_MISSINGOK)
+	return 0;
+
+    return rpmdbProvides(NULL, db, pool, dcache, dep, NULL);
+}
+
+int rpmdsCheckInstalled(rpmdb db, rpmds ds)
+{
+    struct depCacheStore_s *dcache;
+    rpmstrPool pool;
+    rpmds rpmlib = NULL;
+    int unsatisfied = 0;
+
+    if (db == NULL)
+	return -1;
+    if (ds == NULL)
+	return 0;
+
+    dcache = depCacheStoreCreate();
+    pool = rpmstrPoolLink(rpmdsPool(ds));
+
+    ds = rpmdsInit(ds);
+    while (rpmdsNext(ds) >= 0) {
+	if (dbDepSatisfied(db, pool, dcache, &rpmlib, ds))
+	    unsatisfied++;
+    }
+
+    rpmdsFree(rpmlib);
+    rpmstrPoolFree(pool);
+    depCacheStoreFree(dcache);
+    return unsatisfied;
+}
+
 /* Check a dependency set for problems */
-static void checkDS(rpmts ts, depCache dcache, rpmte te,
+static void checkDS(rpmts ts, struct depCacheStore_s *dcache, rpmte te,
 		const char * pkgNEVRA, rpmds ds,
 		rpm_color_t tscolor)
 {
@@ -815,7 +1185,7 @@ static void checkDS(rpmts ts, depCache dcache, rpmte te,
 }
 
 /* Check a given dependency against installed packages */
-static void checkInstDeps(rpmts ts, depCache dcache, rpmte te,
+static void checkInstDeps(rpmts ts, struct depCacheStore_s *dcache, rpmte te,
 			  rpmTag depTag, const char *dep, rpmds depds, int neg)
 {
     Header h;
@@ -846,7 +1216,7 @@ static void checkInstDeps(rpmts ts, depCache dcache, rpmte te,
 		continue;
 	}
 
-	ds = rpmdsNewPool(pool, h, depTag, 0);
+	ds = rpmdbInstanceDs(rpmtsGetRdb(ts), h, depTag, pool);
 	rpmdsSetIx(ds, rpmdbGetIteratorFileNum(mi));
 
 	/* Is it in our range at all? (but file deps have no range) */
@@ -865,7 +1235,7 @@ static void checkInstDeps(rpmts ts, depCache dcache, rpmte te,
     free(ndep);
 }
 
-static void checkInstFileDeps(rpmts ts, depCache dcache, rpmte te,
+static void checkInstFileDeps(rpmts ts, struct depCacheStore_s *dcache, rpmte te,
 			      rpmTag depTag, rpmfi fi, int is_not,
 			      filedepHash cache, fingerPrintCache *fpcp)
 {
@@ -965,6 +1335,129 @@ static int sidCmp(rpmsid a, rpmsid b)
     return (a != b);
 }
 
+/*
+ * Parallel warming of the dependency cache: the added-package dependencies
+ * are looked up in the rpmdb by worker threads ahead of the serial check
+ * pass, which then finds nearly everything answered from the cache.
+ * Workers only ever fill the (locked, sharded) cache; problems are still
+ * detected and recorded by the serial pass so their order is unchanged.
+ */
+struct depWarmJob_s {
+    rpmts ts;
+    struct depCacheStore_s *dcache;
+    rpmte *elems;
+    int nelem;
+    int nthreads;
+    rpm_color_t tscolor;
+};
+
+struct depWarmArg_s {
+    struct depWarmJob_s *job;
+    int tid;
+};
+
+static void *depWarmWorker(void *data)
+{
+    struct depWarmArg_s *arg = data;
+    struct depWarmJob_s *job = arg->job;
+    rpmts ts = job->ts;
+    tsMembers tsmem = rpmtsMembers(ts);
+    static const rpmTagVal deptags[] = {
+	RPMTAG_REQUIRENAME, RPMTAG_CONFLICTNAME, RPMTAG_OBSOLETENAME, 0
+    };
+    rpmdb db = NULL;
+    rpmstrPool pool;
+
+    /* Private db handle and string pool: the shared ones aren't
+     * thread safe, and interning must stay out of the workers. */
+    if (rpmdbOpen(rpmtsRootDir(ts), &db, O_RDONLY, 0644) != 0)
+	return NULL;
+    pool = rpmstrPoolCreate();
+
+    for (int i = arg->tid; i < job->nelem; i += job->nthreads) {
+	rpmte p = job->elems[i];
+
+	for (const rpmTagVal *tagp = deptags; *tagp; tagp++) {
+	    rpmds ds = rpmdsInit(rpmteDS(p, *tagp));
+
+	    while (rpmdsNext(ds) >= 0) {
+		rpmsenseFlags dsflags = rpmdsFlags(ds);
+		rpm_color_t dscolor = rpmdsColor(ds);
+
+		if (job->tscolor && dscolor && !(job->tscolor & dscolor))
+		    continue;
+		/* rpmlib deps don't hit the db, pretrans results aren't
+		 * cached, and parsing rich deps interns into the shared
+		 * pool; all are left to the serial pass. */
+		if (dsflags & (RPMSENSE_RPMLIB | RPMSENSE_PRETRANS))
+		    continue;
+		if (rpmdsIsRich(ds))
+		    continue;
+		/* file dependency lookups intern the dirname into the
+		 * shared pool, serial pass only for them too */
+		if (*rpmdsN(ds) == '/')
+		    continue;
+		/* answered from added packages, no db lookup to warm */
+		if (rpmalSatisfiesDepend(tsmem->addedPackages, NULL, ds))
+		    continue;
+
+		rpmdbProvides(ts, db, pool, job->dcache, ds, NULL);
+	    }
+	}
+    }
+
+    rpmstrPoolFree(pool);
+    rpmdbClose(db);
+    return NULL;
+}
+
+static void depCheckWarm(rpmts ts, struct depCacheStore_s *dcache,
+			 rpm_color_t tscolor)
+{
+    int nthreads = rpmExpandNumeric("%{?_depcheck_threads}");
+    struct depWarmJob_s job = { ts, dcache, NULL, 0, 0, tscolor };
+    pthread_t *threads = NULL;
+    rpmtsi pi;
+    rpmte p;
+
+    if (nthreads <= 1)
+	return;
+
+    pi = rpmtsiInit(ts);
+    while ((p = rpmtsiNext(pi, TR_ADDED)) != NULL) {
+	job.elems = xrealloc(job.elems, (job.nelem + 1) * sizeof(*job.elems));
+	job.elems[job.nelem++] = p;
+	/* Instantiate the dependency sets serially: lazy creation in the
+	 * workers would intern into the shared pool concurrently. */
+	rpmteDS(p, RPMTAG_REQUIRENAME);
+	rpmteDS(p, RPMTAG_CONFLICTNAME);
+	rpmteDS(p, RPMTAG_OBSOLETENAME);
+    }
+    rpmtsiFree(pi);
+
+    if (job.nelem > 1) {
+	struct depWarmArg_s *args;
+
+	if (nthreads > job.nelem)
+	    nthreads = job.nelem;
+	job.nthreads = nthreads;
+	threads = xcalloc(nthreads, sizeof(*threads));
+	args = xcalloc(nthreads, sizeof(*args));
+	for (int i = 0; i < nthreads; i++) {
+	    args[i].job = &job;
+	    args[i].tid = i;
+	    if (pthread_create(&threads[i], NULL, depWarmWorker, &args[i]) != 0)
+		threads[i] = 0;
+	}
+	for (int i = 0; i < nthreads; i++) {
+	    if (threads[i])
+		pthread_join(threads[i], NULL);
+	}
+	free(args);
+	free(threads);
+    }
+    free(job.elems);
+}
 
 int rpmtsCheck(rpmts ts)
 {
@@ -972,7 +1465,7 @@ int rpmtsCheck(rpmts ts)
     rpmtsi pi = NULL; rpmte p;
     int closeatexit = 0;
     int rc = 0;
-    depCache dcache = NULL;
+    struct depCacheStore_s *dcache = NULL;
     filedepHash confilehash = NULL;	/* file conflicts of installed packages */
     filedepHash connotfilehash = NULL;	/* file conflicts of installed packages */
     depexistsHash connothash = NULL;
@@ -996,9 +1489,11 @@ int rpmtsCheck(rpmts ts)
     if (rdb)
 	rpmdbCtrl(rdb, RPMDB_CTRL_LOCK_RO);
 
-    /* XXX FIXME: figure some kind of heuristic for the cache size */
-    dcache = depCacheCreate(5001, rstrhash, strcmp,
-				     (depCacheFreeKey)rfree, NULL);
+    dcache = depCacheStoreCreate();
+
+    /* Pure-install transactions can reuse previous rpmdb lookup results */
+    if (rdb && packageHashNumKeys(rpmtsMembers(ts)->removedPackages) == 0)
+	depCacheLoadPersistent(ts, dcache);
 
     /* build hashes of all confilict sdependencies */
     confilehash = filedepHashCreate(257, sidHash, sidCmp, NULL, NULL);
@@ -1024,6 +1519,14 @@ int rpmtsCheck(rpmts ts)
     if (!filedepHashNumKeys(reqnotfilehash))
 	reqnotfilehash = filedepHashFree(reqnotfilehash);
 
+    /* Build the added package indexes up front instead of on first use,
+       they are read-only for the rest of the check. */
+    rpmalMakeIndex(rpmtsMembers(ts)->addedPackages);
+
+    /* Pre-answer the expensive rpmdb lookups with worker threads */
+    if (rdb)
+	depCheckWarm(ts, dcache, tscolor);
+
     /*
      * Look at all of the added packages and make sure their dependencies
      * are satisfied.
@@ -1109,8 +1612,11 @@ int rpmtsCheck(rpmts ts)
     if (rdb)
 	rpmdbCtrl(rdb, RPMDB_CTRL_UNLOCK_RO);
 
+    if (rdb && packageHashNumKeys(rpmtsMembers(ts)->removedPackages) == 0)
+	depCacheSavePersistent(ts, dcache);
+
 exit:
-    depCacheFree(dcache);
+    depCacheStoreFree(dcache);
     filedepHashFree(confilehash);
     filedepHashFree(connotfilehash);
     depexistsHashFree(connothash);
@@ -581,6 +581,61 @@ headerFmt rpmHeaderFormatByValue(rpmtdFormats fmt)
     return NULL;
 }
 
+int rpmHeaderFormatCallBuf(headerFmt fmt, rpmtd td, char *buf, size_t buflen)
+{
+    int n = -1;
+
+    if (fmt->class != RPM_ANY_CLASS && rpmtdClass(td) != fmt->class)
+	return -1;
+
+    switch (fmt->fmt) {
+    case RPMTD_FORMAT_STRING:
+	switch (rpmtdClass(td)) {
+	case RPM_NUMERIC_CLASS:
+	    n = snprintf(buf, buflen, "%" PRIu64, rpmtdGetNumber(td));
+	    break;
+	case RPM_STRING_CLASS: {
+	    const char *str = rpmtdGetString(td);
+	    size_t len = (str != NULL) ? strlen(str) : 0;
+	    if (str != NULL && len < buflen) {
+		memcpy(buf, str, len + 1);
+		n = len;
+	    }
+	    break;
+	}
+	default:
+	    break;	/* binary hex dumps keep the malloc path */
+	}
+	break;
+    case RPMTD_FORMAT_OCTAL:
+	n = snprintf(buf, buflen, "%o", (unsigned int)rpmtdGetNumber(td));
+	break;
+    case RPMTD_FORMAT_HEX:
+	n = snprintf(buf, buflen, "%x", (unsigned int)rpmtdGetNumber(td));
+	break;
+    case RPMTD_FORMAT_DATE:
+    case RPMTD_FORMAT_DAY: {
+	const char *sfmt = (fmt->fmt == RPMTD_FORMAT_DATE) ?
+				"%c" : "%a %b %d %Y";
+	struct tm _tm, * tstruct;
+	time_t dateint = rpmtdGetNumber(td);
+	size_t len;
+
+	/* Conversion and sizing oddities get the full treatment instead */
+	if ((tstruct = localtime_r(&dateint, &_tm)) != NULL &&
+		(len = strftime(buf, buflen, sfmt, tstruct)) > 0)
+	    n = len;
+	break;
+    }
+    default:
+	break;
+    }
+
+    if (n >= (int)buflen)
+	n = -1;		/* truncated, let the malloc path size it */
+    return n;
+}
+
 char *rpmHeaderFormatCall(headerFmt fmt, rpmtd td)
 {
     char *ret = NULL;
@@ -5,6 +5,7 @@
 #include "system.h"
 
 #include <rpm/rpmfileutil.h>	/* for rpmCleanPath */
+#include <rpm/rpmlog.h>
 #include <rpm/rpmts.h>
 #include <rpm/rpmsq.h>
 
@@ -97,7 +98,8 @@ fingerPrintCache fpCacheCreate(int sizeHint, rpmstrPool pool)
     fpc = xcalloc(1, sizeof(*fpc));
     fpc->ht = rpmFpEntryHashCreate(sizeHint, sidHash, sidCmp,
 				   NULL, (rpmFpEntryHashFreeData)free);
-    fpc->pool = (pool != NULL) ? rpmstrPoolLink(pool) : rpmstrPoolCreate();
+    fpc->pool = (pool != NULL) ? rpmstrPoolLink(pool) :
+				 rpmstrPoolCreateSized(sizeHint);
     return fpc;
 }
 
@@ -452,6 +454,133 @@ fingerPrint * fpCacheGetByFp(fingerPrintCache cache,
 	return NULL;
 }
 
+struct fpCacheForEachData_s {
+    fpCacheForEachFpFn fn;
+    void *userdata;
+};
+
+static void fpCacheForEachFpCB(const fingerPrint * key, struct rpmffi_s *data,
+			       int dataCount, void *userdata)
+{
+    struct fpCacheForEachData_s *fed = userdata;
+    fed->fn(data, dataCount, fed->userdata);
+}
+
+void fpCacheForEachFp(fingerPrintCache cache, fpCacheForEachFpFn fn,
+		      void *userdata)
+{
+    struct fpCacheForEachData_s fed = { fn, userdata };
+    if (cache->fp)
+	rpmFpHashForEach(cache->fp, fpCacheForEachFpCB, &fed);
+}
+
+/*
+ * Persistent fingerprint cache (optional, see %_fpcache_path):
+ * the resolved directory -> dev/ino mappings are carried from one
+ * transaction to the next in a simple text file, invalidated by the
+ * rpmdb cookie. Loaded entries pre-populate the directory hash so
+ * warm lookups do not have to stat(2) every directory again; anything
+ * not covered falls back to the normal stat path.
+ */
+int fpCacheLoad(fingerPrintCache cache, const char *path, const char *cookie)
+{
+    char line[BUFSIZ];
+    FILE *fp;
+    int nent = 0;
+
+    if (path == NULL || cookie == NULL)
+	return -1;
+    if ((fp = fopen(path, "r")) == NULL)
+	return -1;
+
+    /* First line carries the rpmdb cookie the entries are valid for */
+    if (fgets(line, sizeof(line), fp) == NULL) {
+	fclose(fp);
+	return -1;
+    }
+    line[strcspn(line, "\n")] = '\0';
+    if (!rstreq(line, cookie)) {
+	rpmlog(RPMLOG_DEBUG, "fp cache %s: stale cookie, ignoring\n", path);
+	fclose(fp);
+	return -1;
+    }
+
+    while (fgets(line, sizeof(line), fp) != NULL) {
+	unsigned long long dev, ino;
+	struct fprintCacheEntry_s *entry;
+	rpmsid dirId;
+	char *end;
+
+	line[strcspn(line, "\n")] = '\0';
+	dev = strtoull(line, &end, 16);
+	if (end == line || *end != ' ')
+	    continue;
+	ino = strtoull(end + 1, &end, 16);
+	if (*end != ' ' || end[1] != '/')
+	    continue;
+	dirId = rpmstrPoolId(cache->pool, end + 1, 1);
+	if (cacheContainsDirectory(cache, dirId))
+	    continue;
+	entry = xmalloc(sizeof(*entry));
+	entry->dirId = dirId;
+	entry->dev = (dev_t)dev;
+	entry->ino = (ino_t)ino;
+	rpmFpEntryHashAddEntry(cache->ht, dirId, entry);
+	nent++;
+    }
+    fclose(fp);
+    rpmlog(RPMLOG_DEBUG, "loaded %d entries from fp cache %s\n", nent, path);
+    return 0;
+}
+
+struct fpCacheSaveData_s {
+    FILE *fp;
+    rpmstrPool pool;
+};
+
+static void fpCacheWriteEntry(rpmsid key,
+			      const struct fprintCacheEntry_s ** data,
+			      int dataCount, void *userdata)
+{
+    struct fpCacheSaveData_s *sd = userdata;
+    if (dataCount > 0)
+	fprintf(sd->fp, "%llx %llx %s\n",
+		(unsigned long long)data[0]->dev,
+		(unsigned long long)data[0]->ino,
+		rpmstrPoolStr(sd->pool, data[0]->dirId));
+}
+
+int fpCacheSave(fingerPrintCache cache, const char *path, const char *cookie)
+{
+    struct fpCacheSaveData_s sd;
+    char *tmppath = NULL;
+    int rc = -1;
+
+    if (path == NULL || cookie == NULL)
+	return -1;
+
+    rasprintf(&tmppath, "%s.tmp.%d", path, (int) getpid());
+    if ((sd.fp = fopen(tmppath, "w")) == NULL) {
+	free(tmppath);
+	return -1;
+    }
+    sd.pool = cache->pool;
+
+    fprintf(sd.fp, "%s\n", cookie);
+    rpmFpEntryHashForEach(cache->ht, fpCacheWriteEntry, &sd);
+
+    if (fclose(sd.fp) == 0) {
+	if (rename(tmppath, path) == 0)
+	    rc = 0;
+	else
+	    unlink(tmppath);
+    } else {
+	unlink(tmppath);
+    }
+    free(tmppath);
+    return rc;
+}
+
 void fpCachePopulate(fingerPrintCache fpc, rpmts ts, int fileCount)
 {
     rpmtsi pi;
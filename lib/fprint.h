@@ -51,6 +51,40 @@ fingerPrint * fpCacheGetByFp(fingerPrintCache cache,
 RPM_GNUC_INTERNAL
 void fpCachePopulate(fingerPrintCache cache, rpmts ts, int fileCount);
 
+typedef void (*fpCacheForEachFpFn)(struct rpmffi_s *recs, int numRecs,
+				   void *userdata);
+
+/**
+ * Call a function for every fingerprint in a populated cache, with the
+ * transaction element / file number pairs sharing that fingerprint.
+ * @param cache		pointer to fingerprint cache
+ * @param fn		function to call per fingerprint
+ * @param userdata	opaque pointer passed through to fn
+ */
+RPM_GNUC_INTERNAL
+void fpCacheForEachFp(fingerPrintCache cache, fpCacheForEachFpFn fn,
+		      void *userdata);
+
+/**
+ * Load resolved directory entries saved by a previous transaction.
+ * @param cache		pointer to fingerprint cache
+ * @param path		cache file path
+ * @param cookie	rpmdb cookie the entries must be valid for
+ * @return		0 on success
+ */
+RPM_GNUC_INTERNAL
+int fpCacheLoad(fingerPrintCache cache, const char *path, const char *cookie);
+
+/**
+ * Save the resolved directory entries for the next transaction.
+ * @param cache		pointer to fingerprint cache
+ * @param path		cache file path
+ * @param cookie	rpmdb cookie to stamp the entries with
+ * @return		0 on success
+ */
+RPM_GNUC_INTERNAL
+int fpCacheSave(fingerPrintCache cache, const char *path, const char *cookie);
+
 /* compare an existing fingerprint with a looked-up fingerprint for db/bn */
 RPM_GNUC_INTERNAL
 int fpLookupEquals(fingerPrintCache cache, fingerPrint * fp,
@@ -14,6 +14,8 @@
 #include <inttypes.h>
 #include <rpm/rpmtypes.h>
 #include <rpm/rpmstring.h>
+#include <rpm/rpmlog.h>
+#include "rpmio/rpmio_internal.h"	/* Fwritev */
 #include "lib/header_internal.h"
 #include "lib/misc.h"			/* tag function proto */
 
@@ -73,6 +75,10 @@ enum headerFlags_e {
     HEADERFLAG_ALLOCATED = (1 << 1), /*!< Is 1st header region allocated? */
     HEADERFLAG_LEGACY    = (1 << 2), /*!< Header came from legacy source? */
     HEADERFLAG_DEBUG     = (1 << 3), /*!< Debug this header? */
+    HEADERFLAG_LAZY      = (1 << 4), /*!< Index not imported yet, lookups
+					  resolve against the region blob */
+    HEADERFLAG_MAPPED    = (1 << 5), /*!< Blob is externally owned read-only
+					  memory, never freed or modified */
 };
 
 typedef rpmFlags headerFlags;
@@ -85,23 +91,46 @@ struct indexEntry_s {
     struct entryInfo_s info;	/*!< Description of tag data. */
     rpm_data_t data; 		/*!< Location of tag data. */
     int length;			/*!< No. bytes of data. */
+    int caplen;			/*!< Allocated bytes of data (0: == length) */
     int rdlen;			/*!< No. bytes of data in region. */
 };
 
 /** \ingroup header
  * The Header data structure.
  */
+typedef struct extCacheEntry_s {
+    rpmTagVal tag;		/*!< extension tag */
+    struct rpmtd_s td;		/*!< memoized result (owns its data) */
+    struct extCacheEntry_s *next;
+} * extCacheEntry;
+
 struct headerToken_s {
     void * blob;		/*!< Header region blob. */
+    struct hdrblob_s *lazyblob;	/*!< Unimported blob layout (lazy only) */
     indexEntry index;		/*!< Array of tags. */
     int indexUsed;		/*!< Current size of tag array. */
     int indexAlloced;		/*!< Allocated size of tag array. */
     unsigned int instance;	/*!< Rpmdb instance (offset) */
     headerFlags flags;
     int sorted;			/*!< Current sort method */
+    int sortedTo;		/*!< While unsorted: entries [0,sortedTo)
+				     are still in tag order */
     int nrefs;			/*!< Reference count. */
+    extCacheEntry extcache;	/*!< Memoized derived tags, see headerGet() */
 };
 
+/* Invalidate memoized derived tags, called on any header modification */
+static void extCacheFree(Header h)
+{
+    extCacheEntry ce, next;
+    for (ce = h->extcache; ce != NULL; ce = next) {
+	next = ce->next;
+	rpmtdFreeData(&ce->td);
+	free(ce);
+    }
+    h->extcache = NULL;
+}
+
 /** \ingroup header
  * Maximum no. of bytes permitted in a header.
  */
@@ -160,6 +189,7 @@ static const size_t headerMaxbytes = (256*1024*1024);
 
 static int dataLength(rpm_tagtype_t type, rpm_constdata_t p, rpm_count_t count,
 			 int onDisk, rpm_constdata_t pend);
+static void headerRealize(Header h);
 
 /* Check tag type matches our definition */
 static int hdrchkTagType(rpm_tag_t tag, rpm_tagtype_t type)
@@ -217,6 +247,7 @@ Header headerFree(Header h)
     if (h == NULL || h->nrefs > 0)
 	return NULL;
 
+    extCacheFree(h);
     if (h->index) {
 	indexEntry entry = h->index;
 	int i;
@@ -233,7 +264,11 @@ Header headerFree(Header h)
 	    entry->data = NULL;
 	}
 	h->index = _free(h->index);
+    } else if (h->flags & HEADERFLAG_ALLOCATED) {
+	/* Lazy header that never got realized */
+	h->blob = _free(h->blob);
     }
+    h->lazyblob = _free(h->lazyblob);
 
     h = _free(h);
     return NULL;
@@ -252,6 +287,7 @@ static Header headerCreate(void *blob, int32_t indexLen)
     }
     h->instance = 0;
     h->sorted = 0;
+    h->sortedTo = 0;
     h->index = xcalloc(h->indexAlloced, sizeof(*h->index));
 
     h->nrefs = 0;
@@ -328,10 +364,35 @@ static int indexCmp(const void * avp, const void * bvp)
     return (ap->info.tag - bp->info.tag);
 }
 
+/* Short out-of-order tails are common (sequential headerPut with a few
+ * stragglers); binary-insert those into the sorted prefix instead of
+ * re-sorting the whole index. */
+#define SORT_TAIL_MAX 16
+
 static void headerSort(Header h)
 {
     if (!h->sorted) {
-	qsort(h->index, h->indexUsed, sizeof(*h->index), indexCmp);
+	int tail = h->indexUsed - h->sortedTo;
+
+	if (h->sortedTo > tail && tail <= SORT_TAIL_MAX) {
+	    for (int i = h->sortedTo; i < h->indexUsed; i++) {
+		struct indexEntry_s e = h->index[i];
+		int lo = 0, hi = i;
+
+		while (lo < hi) {
+		    int mid = lo + (hi - lo) / 2;
+		    if (h->index[mid].info.tag <= e.info.tag)
+			lo = mid + 1;
+		    else
+			hi = mid;
+		}
+		memmove(h->index + lo + 1, h->index + lo,
+			(i - lo) * sizeof(*h->index));
+		h->index[lo] = e;
+	    }
+	} else {
+	    qsort(h->index, h->indexUsed, sizeof(*h->index), indexCmp);
+	}
 	h->sorted = 1;
     }
 }
@@ -372,6 +433,14 @@ unsigned headerSizeof(Header h, int magicp)
     if (h == NULL)
 	return size;
 
+    /* An unmodified lazy header exports verbatim, the size is known */
+    if (h->flags & HEADERFLAG_LAZY) {
+	size = h->lazyblob->pvlen;
+	if (magicp == HEADER_MAGIC_YES)
+	    size += sizeof(rpm_header_magic);
+	return size;
+    }
+
     headerSort(h);
 
     if (magicp == HEADER_MAGIC_YES)
@@ -536,6 +605,7 @@ static int regionSwab(indexEntry entry, int il, int dl,
 	if (ie.length < 0 || hdrchkData(ie.length))
 	    return -1;
 
+	ie.caplen = 0;
 	ie.rdlen = 0;
 
 	if (entry) {
@@ -808,10 +878,27 @@ void * headerExport(Header h, unsigned int *bsize)
 {
     void *blob = NULL;
 
-    if (h) {
-	blob = doExport(h->index, h->indexUsed, h->flags, bsize);
+    if (h == NULL)
+	return NULL;
+
+    /*
+     * A lazy header is still the verbatim imported bytes: any
+     * modification realizes it first (clearing the lazy flag), and
+     * lazy lookups only ever swab private copies. Hand out those bytes
+     * as they are instead of rebuilding the blob from the index - the
+     * big winner is rpmdbAdd() on unmodified headers (db rebuild),
+     * which used to pay a full unload cycle per package.
+     */
+    if (h->flags & HEADERFLAG_LAZY) {
+	struct hdrblob_s *lblob = h->lazyblob;
+	blob = memcpy(xmalloc(lblob->pvlen), lblob->ei, lblob->pvlen);
+	if (bsize)
+	    *bsize = lblob->pvlen;
+	return blob;
     }
 
+    blob = doExport(h->index, h->indexUsed, h->flags, bsize);
+
     return blob;
 }
 
@@ -834,6 +921,7 @@ indexEntry findEntry(Header h, rpmTagVal tag, rpm_tagtype_t type)
     struct indexEntry_s key;
 
     if (h == NULL) return NULL;
+    headerRealize(h);
     headerSort(h);
 
     key.info.tag = tag;
@@ -861,6 +949,8 @@ int headerDel(Header h, rpmTagVal tag)
     indexEntry entry, first;
     int ne;
 
+    extCacheFree(h);
+
     entry = findEntry(h, tag, RPM_NULL_TYPE);
     if (!entry) return 1;
 
@@ -911,6 +1001,7 @@ rpmRC hdrblobImport(hdrblob blob, int fast, Header *hdrp, char **emsg)
 
 	entry->data = blob->pe;
 	entry->length = blob->pvlen - sizeof(blob->il) - sizeof(blob->dl);
+	entry->caplen = 0;
 	rdlen = regionSwab(entry+1, blob->il, 0, blob->pe,
 			   blob->dataStart, blob->dataEnd,
 			   entry->info.offset, fast);
@@ -929,6 +1020,7 @@ rpmRC hdrblobImport(hdrblob blob, int fast, Header *hdrp, char **emsg)
 	entry->info.offset = -(ril * sizeof(*blob->pe)); /* negative offset */
 	entry->data = blob->pe;
 	entry->length = blob->pvlen - sizeof(blob->il) - sizeof(blob->dl);
+	entry->caplen = 0;
 	rdlen = regionSwab(entry+1, ril-1, 0, blob->pe+1,
 			   blob->dataStart, blob->dataEnd,
 			   entry->info.offset, fast);
@@ -976,6 +1068,7 @@ rpmRC hdrblobImport(hdrblob blob, int fast, Header *hdrp, char **emsg)
 
     /* Force sorting, dribble lookups can cause early sort on partial header */
     h->sorted = 0;
+    h->sortedTo = 0;
     headerSort(h);
     h->flags |= HEADERFLAG_ALLOCATED;
     *hdrp = h;
@@ -994,6 +1087,89 @@ errxit:
     return RPMRC_FAIL;
 }
 
+/*
+ * Import a header blob without building the index: remember the blob
+ * layout and let lookups resolve directly against the on-disk index,
+ * swabbing data lazily per access. The first operation that needs the
+ * real in-memory index (iteration, export, any modification) imports
+ * the header for real via headerRealize().
+ */
+static rpmRC hdrblobImportLazy(hdrblob blob, int mapped, Header *hdrp,
+			       char **emsg)
+{
+    Header h;
+
+    /* Legacy v3 headers need conversion work upfront, import for real */
+    if (!(htonl(blob->pe->tag) < RPMTAG_HEADERI18NTABLE))
+	return hdrblobImport(blob, 1, hdrp, emsg);
+
+    h = xcalloc(1, sizeof(*h));
+    h->blob = blob->ei;
+    h->flags = HEADERFLAG_LAZY;
+    h->flags |= mapped ? HEADERFLAG_MAPPED : HEADERFLAG_ALLOCATED;
+    h->lazyblob = xmalloc(sizeof(*h->lazyblob));
+    *h->lazyblob = *blob;	/* struct assignment */
+    headerLink(h);
+    *hdrp = h;
+
+    /* We own the memory now, avoid double-frees */
+    blob->ei = NULL;
+
+    return RPMRC_OK;
+}
+
+static void headerRealize(Header h)
+{
+    struct hdrblob_s *blob;
+    Header nh = NULL;
+    char *emsg = NULL;
+
+    if (h == NULL || !(h->flags & HEADERFLAG_LAZY))
+	return;
+
+    blob = h->lazyblob;
+    h->flags &= ~HEADERFLAG_LAZY;
+    h->lazyblob = NULL;
+
+    /*
+     * A mapped blob is read-only foreign memory, but the real import
+     * swabs integer data in place: switch to a private copy first.
+     */
+    if (h->flags & HEADERFLAG_MAPPED) {
+	void *copy = memcpy(xmalloc(blob->pvlen), blob->ei, blob->pvlen);
+	if (hdrblobInit(copy, blob->pvlen, 0, 0, blob, &emsg) != RPMRC_OK) {
+	    /* Can't happen: the mapped blob passed the same checks */
+	    rpmlog(RPMLOG_ERR, _("lazy hdr import: %s\n"), emsg);
+	    free(copy);
+	    free(emsg);
+	    free(blob);
+	    h->flags &= ~HEADERFLAG_MAPPED;
+	    return;
+	}
+	h->blob = copy;
+	h->flags &= ~HEADERFLAG_MAPPED;
+	h->flags |= HEADERFLAG_ALLOCATED;
+    }
+
+    if (hdrblobImport(blob, 1, &nh, &emsg) == RPMRC_OK) {
+	/* Move the guts over and get rid of the shell */
+	h->index = nh->index;
+	h->indexUsed = nh->indexUsed;
+	h->indexAlloced = nh->indexAlloced;
+	h->sorted = nh->sorted;
+	h->sortedTo = nh->sortedTo;
+	h->flags |= nh->flags;
+	free(nh);
+    } else {
+	/* Can't happen: the blob passed the same checks on lazy import */
+	rpmlog(RPMLOG_ERR, _("lazy hdr import: %s\n"), emsg);
+	h->blob = _free(h->blob);
+	h->flags &= ~HEADERFLAG_ALLOCATED;
+    }
+    free(emsg);
+    free(blob);
+}
+
 Header headerReload(Header h, rpmTagVal tag)
 {
     Header nh;
@@ -1061,8 +1237,101 @@ exit:
     return (nb == length ? 0 : 1);
 }
 
+int headerWriteRegion(FD_t fd, Header h, rpmTagVal regionTag, int magicp)
+{
+    void *blob = NULL;
+    unsigned int bsize = 0;
+    int32_t *ei;
+    int32_t il, dl;
+    int32_t intro[2];
+    struct entryInfo_s region, trailer;
+    struct iovec iov[5];
+    int iovcnt = 0;
+    ssize_t nb, expected = 0;
+    int rc = 1;
+
+    if (h == NULL)
+	return 1;
+
+    /* An already wrapped header can be written as it is; a lazy one
+     * knows from its blob layout whether it is wrapped, don't realize */
+    if (h->flags & HEADERFLAG_LAZY) {
+	if (h->lazyblob->regionTag != 0)
+	    return headerWrite(fd, h, magicp);
+	headerRealize(h);
+    }
+    if (h->indexUsed > 0 && ENTRY_IS_REGION(h->index))
+	return headerWrite(fd, h, magicp);
+
+    if ((blob = headerExport(h, &bsize)) == NULL)
+	return 1;
+
+    ei = blob;
+    il = ntohl(ei[0]);
+    dl = ntohl(ei[1]);
+    if (hdrchkTags(il + 1) || hdrchkData(dl + REGION_TAG_COUNT))
+	goto exit;
+
+    /*
+     * Emit the blob wrapped in a region without materializing the
+     * wrapped copy: intro accounting for the region entry and trailer,
+     * the region entry, the original index and data verbatim (the data
+     * offsets do not change), and the region trailer. Byte for byte
+     * the same as exporting a headerReload()ed copy.
+     */
+    intro[0] = htonl(il + 1);
+    intro[1] = htonl(dl + REGION_TAG_COUNT);
+
+    region.tag = htonl(regionTag);
+    region.type = htonl(REGION_TAG_TYPE);
+    region.offset = htonl(dl);
+    region.count = htonl(REGION_TAG_COUNT);
+
+    trailer.tag = region.tag;
+    trailer.type = region.type;
+    trailer.offset = htonl(-((il + 1) * sizeof(struct entryInfo_s)));
+    trailer.count = region.count;
+
+    if (magicp == HEADER_MAGIC_YES) {
+	iov[iovcnt].iov_base = (void *) rpm_header_magic;
+	iov[iovcnt].iov_len = sizeof(rpm_header_magic);
+	iovcnt++;
+    }
+    iov[iovcnt].iov_base = intro;
+    iov[iovcnt].iov_len = sizeof(intro);
+    iovcnt++;
+    iov[iovcnt].iov_base = &region;
+    iov[iovcnt].iov_len = sizeof(region);
+    iovcnt++;
+    iov[iovcnt].iov_base = ei + 2;
+    iov[iovcnt].iov_len = bsize - sizeof(intro);
+    iovcnt++;
+    iov[iovcnt].iov_base = &trailer;
+    iov[iovcnt].iov_len = sizeof(trailer);
+    iovcnt++;
+
+    for (int i = 0; i < iovcnt; i++)
+	expected += iov[i].iov_len;
+
+    nb = Fwritev(fd, iov, iovcnt);
+    rc = (nb == expected) ? 0 : 1;
+
+exit:
+    free(blob);
+    return rc;
+}
+
 int headerIsEntry(Header h, rpmTagVal tag)
 {
+    /* Presence can be answered from the on-disk index of a lazy header */
+    if (h && (h->flags & HEADERFLAG_LAZY) && !(tag < RPMTAG_HEADERI18NTABLE)) {
+	uint32_t ntag = htonl(tag);
+	for (int i = 0; i < h->lazyblob->il; i++) {
+	    if (h->lazyblob->pe[i].tag == ntag)
+		return 1;
+	}
+	return 0;
+    }
    		/* FIX: h modified by sort. */
     return (findEntry(h, tag, RPM_NULL_TYPE) ? 1 : 0);
    	
@@ -1078,10 +1347,39 @@ int headerIsSourceHeuristic(Header h)
     return entry && entry->info.count == 1 && entry->data && !*(const char *)entry->data;
 }
 
+int headerIdentical(Header h1, Header h2)
+{
+    const char *d1, *d2;
+    struct rpmtd_s td1, td2;
+    int rc = 0;
+
+    if (h1 == h2)
+	return (h1 != NULL);
+    if (h1 == NULL || h2 == NULL)
+	return 0;
+
+    /* The header digest identifies the immutable region content exactly */
+    d1 = headerGetString(h1, RPMTAG_SHA256HEADER);
+    d2 = headerGetString(h2, RPMTAG_SHA256HEADER);
+    if (d1 && d2)
+	return rstreq(d1, d2);
+
+    /* No digests to compare, fall back to the region bytes themselves */
+    if (headerGet(h1, RPMTAG_HEADERIMMUTABLE, &td1, HEADERGET_MINMEM)) {
+	if (headerGet(h2, RPMTAG_HEADERIMMUTABLE, &td2, HEADERGET_MINMEM)) {
+	    rc = (td1.count == td2.count &&
+		  memcmp(td1.data, td2.data, td1.count) == 0);
+	    rpmtdFreeData(&td2);
+	}
+	rpmtdFreeData(&td1);
+    }
+    return rc;
+}
+
 /** \ingroup header
  * Retrieve data from header entry.
  * Relevant flags (others are ignored), if neither is set allocation
- * behavior depends on data type(!) 
+ * behavior depends on data type(!)
  *     HEADERGET_MINMEM: return pointers to header memory
  *     HEADERGET_ALLOC: always return malloced memory, overrides MINMEM
  * 
@@ -1328,6 +1626,90 @@ exit:
     return 1;
 }
 
+/* Endian conversion of raw entry data (cf. regionSwab on import) */
+static void swabEntryData(rpm_tagtype_t type, rpm_data_t data,
+			  rpm_count_t count)
+{
+    switch (type) {
+    case RPM_INT64_TYPE:
+    {	uint64_t * it = data;
+	for (; count > 0; count--, it += 1)
+	    *it = htonll(*it);
+    }	break;
+    case RPM_INT32_TYPE:
+    {	int32_t * it = data;
+	for (; count > 0; count--, it += 1)
+	    *it = htonl(*it);
+    }	break;
+    case RPM_INT16_TYPE:
+    {	int16_t * it = data;
+	for (; count > 0; count--, it += 1)
+	    *it = htons(*it);
+    }	break;
+    }
+}
+
+/**
+ * Retrieve tag data straight from the on-disk index of a lazy header.
+ * @param h		header (lazy)
+ * @param[out] td	tag data container
+ * @param flags		flags to control retrieval
+ * @return		1 on success, 0 on not found, -1 if the lookup
+ *			needs a realized header
+ */
+static int lazyGet(Header h, rpmtd td, headerGetFlags flags)
+{
+    struct hdrblob_s *blob = h->lazyblob;
+    uint32_t ntag = htonl(td->tag);
+    int rc = 0;
+
+    /* Region tags need the real thing */
+    if (td->tag < RPMTAG_HEADERI18NTABLE)
+	return -1;
+
+    /* Scan backwards so dribble entries override region entries */
+    for (int i = blob->il - 1; i >= 0; i--) {
+	struct indexEntry_s entry;
+	int needswab;
+
+	if (blob->pe[i].tag != ntag)
+	    continue;
+
+	memset(&entry, 0, sizeof(entry));
+	ei2h(blob->pe + i, &entry.info);
+
+	/* I18n lookups need the i18n table, go through the real path */
+	if (entry.info.type == RPM_I18NSTRING_TYPE && !(flags & HEADERGET_RAW))
+	    return -1;
+
+	entry.data = blob->dataStart + entry.info.offset;
+	entry.length = dataLength(entry.info.type, entry.data,
+				  entry.info.count, 1, blob->dataEnd);
+	if (entry.length < 0)
+	    break;
+
+	/* Integer data is still in network byte order, swab a copy */
+	needswab = (typeSizes[entry.info.type] > 1);
+	if (needswab) {
+	    entry.data = memcpy(xmalloc(entry.length),
+				blob->dataStart + entry.info.offset,
+				entry.length);
+	    swabEntryData(entry.info.type, entry.data, entry.info.count);
+	}
+
+	td->tag = entry.info.tag;
+	rc = copyTdEntry(&entry, td, flags);
+	if (needswab) {
+	    if (rc == 1 && td->data == entry.data)
+		td->flags |= RPMTD_ALLOCED;	/* hand over our copy */
+	    else
+		free(entry.data);
+	}
+	break;
+    }
+    return rc;
+}
+
 /**
  * Retrieve tag data from header.
  * @param h		header
@@ -1340,6 +1722,14 @@ static int intGetTdEntry(Header h, rpmtd td, headerGetFlags flags)
     indexEntry entry;
     int rc;
 
+    /* Resolve directly against the blob while we can */
+    if (h != NULL && (h->flags & HEADERFLAG_LAZY)) {
+	rc = lazyGet(h, td, flags);
+	if (rc >= 0)
+	    return rc;
+	/* Lookup needs the index, fall through to a real import */
+    }
+
     /* First find the tag */
     /* FIX: h modified by sort. */
     entry = findEntry(h, td->tag, RPM_NULL_TYPE);
@@ -1360,21 +1750,110 @@ static int intGetTdEntry(Header h, rpmtd td, headerGetFlags flags)
     return ((rc == 1) ? 1 : 0);
 }
 
+/* Derived tags worth memoizing: full filelist assembly is the costly one */
+static int extCacheable(rpmTagVal tag)
+{
+    switch (tag) {
+    case RPMTAG_FILENAMES:
+    case RPMTAG_ORIGFILENAMES:
+    case RPMTAG_INSTFILENAMES:
+    case RPMTAG_FILECLASS:
+    case RPMTAG_LONGFILESIZES:
+    case RPMTAG_NVRA:
+	return 1;
+    default:
+	return 0;
+    }
+}
+
+/*
+ * Memoize an extension tag result, stealing the data from td. The
+ * caller's copy turns into a borrow from the cache, which stays valid
+ * until the header is modified - only done for HEADERGET_BORROW gets
+ * where the td holds a reference on the header anyway.
+ */
+static void extCachePut(Header h, rpmtd td)
+{
+    extCacheEntry ce;
+
+    if (!(td->flags & RPMTD_ALLOCED) || td->data == NULL)
+	return;
+    if (!(td->type == RPM_STRING_ARRAY_TYPE || td->type == RPM_STRING_TYPE ||
+	  (td->type < 16 && typeSizes[td->type] > 0)))
+	return;
+
+    ce = xmalloc(sizeof(*ce));
+    ce->tag = td->tag;
+    ce->td = *td;	/* struct assignment */
+    ce->next = h->extcache;
+    h->extcache = ce;
+
+    td->flags &= ~(RPMTD_ALLOCED | RPMTD_PTR_ALLOCED);
+}
+
+static int extCacheGet(Header h, rpmTagVal tag, rpmtd td, headerGetFlags flags)
+{
+    for (extCacheEntry ce = h->extcache; ce != NULL; ce = ce->next) {
+	if (ce->tag != tag)
+	    continue;
+
+	*td = ce->td;	/* struct assignment */
+	if (flags & HEADERGET_BORROW) {
+	    td->flags &= ~(RPMTD_ALLOCED | RPMTD_PTR_ALLOCED);
+	} else if (td->type == RPM_STRING_ARRAY_TYPE) {
+	    const char **src = ce->td.data;
+	    char **data = xmalloc(td->count * sizeof(*data));
+	    for (rpm_count_t i = 0; i < td->count; i++)
+		data[i] = xstrdup(src[i]);
+	    td->data = data;
+	    td->flags = RPMTD_ALLOCED | RPMTD_PTR_ALLOCED;
+	} else if (td->type == RPM_STRING_TYPE) {
+	    td->data = xstrdup(ce->td.data);
+	    td->flags = RPMTD_ALLOCED;
+	} else {
+	    size_t len = typeSizes[td->type] * td->count;
+	    td->data = memcpy(xmalloc(len), ce->td.data, len);
+	    td->flags = RPMTD_ALLOCED;
+	}
+	return 1;
+    }
+    return 0;
+}
+
 int headerGet(Header h, rpmTagVal tag, rpmtd td, headerGetFlags flags)
 {
     int rc;
     headerTagTagFunction tagfunc = intGetTdEntry;
+    int cacheable = 0;
 
     if (td == NULL) return 0;
 
     rpmtdReset(td);
     td->tag = tag;
 
+    /* Borrowed data lives in the header, no need to copy it out */
+    if (flags & HEADERGET_BORROW)
+	flags |= HEADERGET_MINMEM;
+
     if (flags & HEADERGET_EXT) {
 	headerTagTagFunction extfunc = rpmHeaderTagFunc(tag);
-	if (extfunc) tagfunc = extfunc;
+	if (extfunc) {
+	    tagfunc = extfunc;
+	    cacheable = (h != NULL && extCacheable(tag));
+	}
+    }
+    if (cacheable && extCacheGet(h, tag, td, flags)) {
+	rc = 1;
+    } else {
+	rc = tagfunc(h, td, flags);
+	if (rc && cacheable && (flags & HEADERGET_BORROW))
+	    extCachePut(h, td);
+    }
+
+    if (rc && (flags & HEADERGET_BORROW)) {
+	td->h = headerLink(h);
+	td->flags |= RPMTD_BORROWED;
     }
-    rc = tagfunc(h, td, flags);
 
     assert(tag == td->tag);
     return rc;
@@ -1438,6 +1917,9 @@ static int intAddEntry(Header h, rpmtd td)
     rpm_data_t data;
     int length = 0;
 
+    headerRealize(h);
+    extCacheFree(h);
+
     /* Count must always be >= 1 for headerAddEntry. */
     if (td->count <= 0)
 	return 0;
@@ -1465,9 +1947,15 @@ static int intAddEntry(Header h, rpmtd td)
     entry->info.offset = 0;
     entry->data = data;
     entry->length = length;
+    entry->caplen = 0;
 
-    if (h->indexUsed > 0 && td->tag < h->index[h->indexUsed-1].info.tag)
+    if (h->indexUsed > 0 && td->tag < h->index[h->indexUsed-1].info.tag) {
+	/* Remember where the ordered prefix ends, headerSort() can then
+	 * merge a short tail instead of re-sorting everything */
+	if (h->sorted)
+	    h->sortedTo = h->indexUsed;
 	h->sorted = 0;
+    }
     h->indexUsed++;
 
     return 1;
@@ -1478,6 +1966,8 @@ static int intAppendEntry(Header h, rpmtd td)
     indexEntry entry;
     int length;
 
+    extCacheFree(h);
+
     if (td->type == RPM_STRING_TYPE || td->type == RPM_I18NSTRING_TYPE) {
 	/* we can't do this */
 	return 0;
@@ -1492,15 +1982,27 @@ static int intAppendEntry(Header h, rpmtd td)
     if (length < 0)
 	return 0;
 
+    /* Grow with headroom: appending one element at a time is the norm
+     * (eg per-file tags at build time), an exact realloc per append
+     * turns that quadratic. caplen tracks the slack. */
     if (ENTRY_IN_REGION(entry)) {
-	char * t = xmalloc(entry->length + length);
+	int newcap = entry->length + length;
+	char * t = xmalloc(newcap + newcap / 2);
 	memcpy(t, entry->data, entry->length);
 	entry->data = t;
 	entry->info.offset = 0;
-    } else
-	entry->data = xrealloc(entry->data, entry->length + length);
+	entry->caplen = newcap + newcap / 2;
+    } else if (entry->length + length >
+	    (entry->caplen ? entry->caplen : entry->length)) {
+	int newcap = entry->caplen ? entry->caplen : entry->length;
+	newcap += newcap / 2;
+	if (newcap < entry->length + length)
+	    newcap = entry->length + length;
+	entry->data = xrealloc(entry->data, newcap);
+	entry->caplen = newcap;
+    }
 
-    copyData(td->type, ((char *) entry->data) + entry->length, 
+    copyData(td->type, ((char *) entry->data) + entry->length,
 	     td->data, td->count, length);
 
     entry->length += length;
@@ -1535,6 +2037,8 @@ int headerAddI18NString(Header h, rpmTagVal tag, const char * string,
     rpm_count_t i, langNum;
     char * buf;
 
+    extCacheFree(h);
+
     table = findEntry(h, RPMTAG_HEADERI18NTABLE, RPM_STRING_ARRAY_TYPE);
     entry = findEntry(h, tag, RPM_I18NSTRING_TYPE);
 
@@ -1619,6 +2123,7 @@ int headerAddI18NString(Header h, rpmTagVal tag, const char * string,
 	memmove(((char *)entry->data) + entry->length + ghosts, string, strlen(string)+1);
 
 	entry->length += length;
+	entry->caplen = 0;
 	entry->info.count = langNum + 1;
     } else {
 	char *b, *be, *e, *ee, *t;
@@ -1658,6 +2163,7 @@ int headerAddI18NString(Header h, rpmTagVal tag, const char * string,
 	} else
 	    entry->data = _free(entry->data);
 	entry->data = buf;
+	entry->caplen = 0;
     }
 
     return 0;
@@ -1670,6 +2176,8 @@ int headerMod(Header h, rpmtd td)
     rpm_data_t data;
     int length = 0;
 
+    extCacheFree(h);
+
     /* First find the tag */
     entry = findEntry(h, td->tag, td->type);
     if (!entry)
@@ -1691,6 +2199,7 @@ int headerMod(Header h, rpmtd td)
     entry->info.type = td->type;
     entry->data = data;
     entry->length = length;
+    entry->caplen = 0;
 
     if (ENTRY_IN_REGION(entry)) {
 	entry->info.offset = 0;
@@ -1721,6 +2230,7 @@ HeaderIterator headerInitIterator(Header h)
 {
     HeaderIterator hi = xmalloc(sizeof(*hi));
 
+    headerRealize(h);
     headerSort(h);
 
     hi->h = headerLink(h);
@@ -1991,8 +2501,8 @@ exit:
     return rc;
 }
 
-rpmRC hdrblobInit(const void *uh, size_t uc,
-		rpmTagVal regionTag, int exact_size,
+static rpmRC hdrblobInitFlags(const void *uh, size_t uc,
+		rpmTagVal regionTag, int exact_size, int trusted,
 		struct hdrblob_s *blob, char **emsg)
 {
     rpmRC rc = RPMRC_FAIL;
@@ -2025,7 +2535,7 @@ rpmRC hdrblobInit(const void *uh, size_t uc,
 	goto exit;
 
     /* Sanity check the rest of the header structure. */
-    if (hdrblobVerifyInfo(blob, emsg))
+    if (!trusted && hdrblobVerifyInfo(blob, emsg))
 	goto exit;
 
     rc = RPMRC_OK;
@@ -2034,6 +2544,13 @@ exit:
     return rc;
 }
 
+rpmRC hdrblobInit(const void *uh, size_t uc,
+		rpmTagVal regionTag, int exact_size,
+		struct hdrblob_s *blob, char **emsg)
+{
+    return hdrblobInitFlags(uh, uc, regionTag, exact_size, 0, blob, emsg);
+}
+
 rpmRC hdrblobGet(hdrblob blob, uint32_t tag, rpmtd td)
 {
     rpmRC rc = RPMRC_NOTFOUND;
@@ -2068,24 +2585,45 @@ rpmRC hdrblobGet(hdrblob blob, uint32_t tag, rpmtd td)
     return rc;
 }
 
-Header headerImport(void * blob, unsigned int bsize, headerImportFlags flags)
+static Header headerImportInternal(void * blob, unsigned int bsize,
+				   headerImportFlags flags)
 {
     Header h = NULL;
     struct hdrblob_s hblob;
     char *buf = NULL;
     void * b = blob;
+    int trusted = (flags & HEADERIMPORT_TRUSTED) != 0;
 
     if (flags & HEADERIMPORT_COPY) {
-	if (bsize == 0 && hdrblobInit(b, 0, 0, 0, &hblob, &buf) == RPMRC_OK)
+	if (bsize == 0 &&
+	    hdrblobInitFlags(b, 0, 0, 0, trusted, &hblob, &buf) == RPMRC_OK)
 	    bsize = hblob.pvlen;
 	if (bsize == 0)
 	    goto exit;
 	b = memcpy(xmalloc(bsize), b, bsize);
+	flags &= ~HEADERIMPORT_MAPPED;
     }
 
+    /* Mapped blobs must not be swabbed in place, index on demand only */
+    if (flags & HEADERIMPORT_MAPPED)
+	flags |= HEADERIMPORT_LAZY;
+
     /* Sanity checks on header intro. */
-    if (hdrblobInit(b, bsize, 0, 0, &hblob, &buf) == RPMRC_OK)
-	hdrblobImport(&hblob, (flags & HEADERIMPORT_FAST), &h, &buf);
+    if (hdrblobInitFlags(b, bsize, 0, 0, trusted, &hblob, &buf) == RPMRC_OK) {
+	/* Legacy v3 blobs need in-place conversion, take a private copy */
+	if ((flags & HEADERIMPORT_MAPPED) &&
+	    !(htonl(hblob.pe->tag) < RPMTAG_HEADERI18NTABLE)) {
+	    b = memcpy(xmalloc(hblob.pvlen), b, hblob.pvlen);
+	    flags &= ~HEADERIMPORT_MAPPED;
+	    if (hdrblobInitFlags(b, hblob.pvlen, 0, 0, trusted,
+				 &hblob, &buf) != RPMRC_OK)
+		goto exit;
+	}
+	if (flags & HEADERIMPORT_LAZY)
+	    hdrblobImportLazy(&hblob, (flags & HEADERIMPORT_MAPPED), &h, &buf);
+	else
+	    hdrblobImport(&hblob, (flags & HEADERIMPORT_FAST), &h, &buf);
+    }
 
 exit:
     if (h == NULL && b != blob)
@@ -2094,3 +2632,13 @@ exit:
 
     return h;
 }
+
+Header headerImport(void * blob, unsigned int bsize, headerImportFlags flags)
+{
+    Header h;
+
+    rpmMemTagPush(RPMMEM_HEADER);
+    h = headerImportInternal(blob, bsize, flags);
+    rpmMemTagPop();
+    return h;
+}
@@ -116,6 +116,15 @@ Header headerCopyLoad(const void * uh);
 enum headerImportFlags_e {
     HEADERIMPORT_COPY		= (1 << 0), /* Make copy of blob on import? */
     HEADERIMPORT_FAST		= (1 << 1), /* Faster but less safe? */
+    HEADERIMPORT_LAZY		= (1 << 2), /* Defer index construction until
+					       needed (read-mostly headers) */
+    HEADERIMPORT_MAPPED		= (1 << 3), /* Blob is externally owned,
+					       read-only memory that outlives
+					       the header (implies LAZY) */
+    HEADERIMPORT_TRUSTED	= (1 << 4), /* Skip per-entry validation,
+					       blob comes from a source that
+					       was verified at write time
+					       (eg the local rpmdb) */
 };
 
 typedef rpmFlags headerImportFlags;
@@ -154,6 +163,18 @@ int headerWrite(FD_t fd, Header h, int magicp);
  */
 int headerIsEntry(Header h, rpmTagVal tag);
 
+/** \ingroup header
+ * Check whether two headers carry identical content, cheaply.
+ * Compares the build-time digests of the immutable header regions when
+ * both headers have one, falling back to a byte comparison of the
+ * regions themselves. Headers without an immutable region (eg created
+ * in memory) are never reported identical.
+ * @param h1		1st header
+ * @param h2		2nd header
+ * @return		1 if identical, 0 otherwise
+ */
+int headerIdentical(Header h1, Header h2);
+
 /** \ingroup header
  * Modifier flags for headerGet() operation.
  * For consistent behavior you'll probably want to use ALLOC to ensure
@@ -170,6 +191,8 @@ enum headerGetFlags_e {
     HEADERGET_RAW 	= (1 << 2), /* return raw contents (no i18n lookups) */
     HEADERGET_ALLOC	= (1 << 3), /* always allocate memory for all data */
     HEADERGET_ARGV	= (1 << 4), /* return string arrays NULL-terminated */
+    HEADERGET_BORROW	= (1 << 5), /* pointers can refer to header memory,
+				       the td keeps the header alive */
 };
 
 typedef rpmFlags headerGetFlags;
@@ -92,6 +92,20 @@ void headerSetInstance(Header h, unsigned int instance);
 RPM_GNUC_INTERNAL
 ssize_t Freadall(FD_t fd, void * buf, ssize_t size);
 
+/** \ingroup header
+ * Write a header wrapped in a region tag, emitting the wrapper, index
+ * and data as an io vector instead of materializing the reloaded copy.
+ * Produces the same bytes as headerWrite() on a headerReload()ed copy.
+ * Used across the library boundary by the package build code, hence
+ * not hidden.
+ * @param fd		file handle
+ * @param h		header
+ * @param regionTag	region tag to wrap the header in
+ * @param magicp	write header magic?
+ * @return		0 on success, 1 on error
+ */
+int headerWriteRegion(FD_t fd, Header h, rpmTagVal regionTag, int magicp);
+
 RPM_GNUC_INTERNAL
 int headerIsSourceHeuristic(Header h);
 #ifdef __cplusplus
@@ -5,6 +5,7 @@
 #include "system.h"
 
 #include <stdarg.h>
+#include <pthread.h>
 #include <rpm/header.h>
 #include <rpm/rpmtag.h>
 #include <rpm/rpmstring.h>
@@ -71,11 +72,23 @@ struct sprintfToken_s {
 #undef HTKEYTYPE
 #undef HTDATATYPE
 
+/** \ingroup header
+ * A compiled format: the parsed token tree with tags bound to numeric
+ * ids and formatter functions, plus the working copy of the format
+ * string the tokens point into. Independent of any particular header,
+ * so it can be reused for formatting any number of headers.
+ */
+typedef struct compiledFmt_s {
+    char * src;			/*!< Original format string (cache key) */
+    char * buf;			/*!< Working copy, chopped up by the parser */
+    sprintfToken format;
+    int numTokens;
+} * compiledFmt;
+
 /**
  */
 typedef struct headerSprintfArgs_s {
     Header h;
-    char * fmt;
     const char * errmsg;
     tagCache cache;
     sprintfToken format;
@@ -159,7 +172,9 @@ static void hsaInit(headerSprintfArgs hsa)
     if (tag != NULL && tag->tag == -2)
 	hsa->hi = headerInitIterator(hsa->h);
     /* Normally with bells and whistles enabled, but raw dump on iteration. */
-    hsa->hgflags = (hsa->hi == NULL) ? HEADERGET_EXT : HEADERGET_RAW;
+    /* Format straight out of the header, the td cache pins it for us */
+    hsa->hgflags = (hsa->hi == NULL) ?
+	(HEADERGET_EXT | HEADERGET_BORROW) : HEADERGET_RAW;
 }
 
 /**
@@ -197,6 +212,18 @@ static sprintfToken hsaNext(headerSprintfArgs hsa)
  */
 static void hsaFini(headerSprintfArgs hsa)
 {
+    if (hsa->hi != NULL) {
+	/* Reset the "*" iteration tag clobbered by hsaNext() so the
+	 * compiled format can be reused on another header. */
+	sprintfTag tag =
+	    (hsa->format->type == PTOK_TAG
+		? &hsa->format->u.tag :
+	    (hsa->format->type == PTOK_ARRAY
+		? &hsa->format->u.array.format->u.tag :
+	    NULL));
+	if (tag != NULL)
+	    tag->tag = -2;
+    }
     hsa->hi = headerFreeIterator(hsa->hi);
     hsa->i = 0;
 }
@@ -640,15 +667,25 @@ static rpmtd getData(headerSprintfArgs hsa, rpmTagVal tag)
 static char * formatValue(headerSprintfArgs hsa, sprintfTag tag, int element)
 {
     char * val = NULL;
+    const char * s = NULL;
+    char buf[256];
+    int blen = -1;
     size_t need = 0;
     char * t, * te;
     rpmtd td;
 
     if ((td = getData(hsa, tag->tag)) && td->count > element) {
 	td->ix = element; /* Ick, use iterators instead */
-	val = rpmHeaderFormatCall(tag->fmt, td);
+	/* Hot formatters land in the stack buffer without a malloc */
+	blen = rpmHeaderFormatCallBuf(tag->fmt, td, buf, sizeof(buf));
+	if (blen >= 0) {
+	    s = buf;
+	} else {
+	    val = rpmHeaderFormatCall(tag->fmt, td);
+	    s = val;
+	}
     } else {
-	val = xstrdup("(none)");
+	s = "(none)";
     }
 
     /* Handle field width + justification formatting if specified */
@@ -658,16 +695,18 @@ static char * formatValue(headerSprintfArgs hsa, sprintfTag tag, int element)
 	char fmtbuf[strlen(tag->format) + 3];
 
 	sprintf(fmtbuf, "%%%ss", tag->format);
-	rasprintf(&tval, fmtbuf, val);
+	rasprintf(&tval, fmtbuf, s);
 	free(val);
 	val = tval;
+	s = val;
+	blen = -1;
     }
-	
-    need = strlen(val);
 
-    if (val && need > 0) {
+    need = (blen >= 0) ? blen : strlen(s);
+
+    if (need > 0) {
 	t = hsaReserve(hsa, need);
-	te = stpcpy(t, val);
+	te = stpcpy(t, s);
 	hsa->vallen += (te - t);
     }
     free(val);
@@ -819,23 +858,97 @@ static unsigned int tagId(rpmTagVal tag)
     return tag;
 }
 
-char * headerFormat(Header h, const char * fmt, errmsg_t * errmsg) 
+/* Single-slot cache of the most recently used compiled format, so that
+ * formatting thousands of headers with one query format (think
+ * "rpm -qa --qf ...") parses and resolves the format just once. */
+static pthread_mutex_t fmtCacheLock = PTHREAD_MUTEX_INITIALIZER;
+static compiledFmt fmtCache = NULL;
+
+/**
+ * Destroy a compiled format.
+ * @param cfmt		compiled format (or NULL)
+ * @return		NULL always
+ */
+static compiledFmt freeFmt(compiledFmt cfmt)
+{
+    if (cfmt != NULL) {
+	cfmt->format = freeFormat(cfmt->format, cfmt->numTokens);
+	free(cfmt->buf);
+	free(cfmt->src);
+	free(cfmt);
+    }
+    return NULL;
+}
+
+/**
+ * Grab a compiled format for a format string, either from the cache
+ * or by parsing it. The caller owns the result exclusively until it
+ * is handed back through releaseFmt().
+ * @param hsa		headerSprintf args (for error reporting)
+ * @param fmt		format string to compile
+ * @return		compiled format, NULL on parse failure
+ */
+static compiledFmt compileFmt(headerSprintfArgs hsa, const char * fmt)
+{
+    compiledFmt cfmt = NULL;
+
+    pthread_mutex_lock(&fmtCacheLock);
+    if (fmtCache != NULL && rstreq(fmtCache->src, fmt)) {
+	cfmt = fmtCache;
+	fmtCache = NULL;
+    }
+    pthread_mutex_unlock(&fmtCacheLock);
+
+    if (cfmt == NULL) {
+	cfmt = xcalloc(1, sizeof(*cfmt));
+	cfmt->src = xstrdup(fmt);
+	cfmt->buf = xstrdup(fmt);
+	if (parseFormat(hsa, cfmt->buf, &cfmt->format, &cfmt->numTokens,
+			NULL, PARSER_BEGIN))
+	    cfmt = freeFmt(cfmt);
+    }
+    return cfmt;
+}
+
+/**
+ * Hand a compiled format back: stash it for the next call with the
+ * same format string, or free it if the cache slot is taken.
+ * @param cfmt		compiled format
+ * @return		NULL always
+ */
+static compiledFmt releaseFmt(compiledFmt cfmt)
+{
+    pthread_mutex_lock(&fmtCacheLock);
+    if (cfmt != NULL) {
+	compiledFmt old = fmtCache;
+	fmtCache = cfmt;
+	cfmt = old;
+    }
+    pthread_mutex_unlock(&fmtCacheLock);
+
+    return freeFmt(cfmt);
+}
+
+char * headerFormat(Header h, const char * fmt, errmsg_t * errmsg)
 {
     struct headerSprintfArgs_s hsa;
+    compiledFmt cfmt;
     sprintfToken nextfmt;
     sprintfTag tag;
     char * t, * te;
     int isxml;
     size_t need;
- 
+
     memset(&hsa, 0, sizeof(hsa));
     hsa.h = headerLink(h);
-    hsa.fmt = xstrdup(fmt);
     hsa.errmsg = NULL;
 
-    if (parseFormat(&hsa, hsa.fmt, &hsa.format, &hsa.numTokens, NULL, PARSER_BEGIN))
+    if ((cfmt = compileFmt(&hsa, fmt)) == NULL)
 	goto exit;
 
+    hsa.format = cfmt->format;
+    hsa.numTokens = cfmt->numTokens;
+
     hsa.cache = tagCacheCreate(128, tagId, tagCmp, NULL, rpmtdFree);
     hsa.val = xstrdup("");
 
@@ -875,13 +988,12 @@ char * headerFormat(Header h, const char * fmt, errmsg_t * errmsg)
 	hsa.val = xrealloc(hsa.val, hsa.vallen+1);	
 
     hsa.cache = tagCacheFree(hsa.cache);
-    hsa.format = freeFormat(hsa.format, hsa.numTokens);
+    cfmt = releaseFmt(cfmt);
 
 exit:
     if (errmsg)
 	*errmsg = hsa.errmsg;
     hsa.h = headerFree(hsa.h);
-    hsa.fmt = _free(hsa.fmt);
     return hsa.val;
 }
 
@@ -41,6 +41,11 @@ headerFmt rpmHeaderFormatByValue(rpmtdFormats fmt);
 RPM_GNUC_INTERNAL
 char * rpmHeaderFormatCall(headerFmt fmt, rpmtd td);
 
+/* Allocation-free variant for the hot formatters: format into buf,
+ * return the length, or -1 when the value needs the malloc path. */
+RPM_GNUC_INTERNAL
+int rpmHeaderFormatCallBuf(headerFmt fmt, rpmtd td, char *buf, size_t buflen);
+
 RPM_GNUC_INTERNAL
 int headerFindSpec(Header h);
 
@@ -4,10 +4,13 @@
 
 #include "system.h"
 
+#include <pthread.h>
+
 #include <rpm/rpmtag.h>
 #include <rpm/rpmmacro.h>
 #include <rpm/rpmlog.h>
 #include <rpm/rpmds.h>
+#include <rpm/rpmfi.h>
 
 #include "lib/rpmte_internal.h"	/* XXX tsortInfo_s */
 #include "lib/rpmts_internal.h"
@@ -43,6 +46,7 @@ struct tsortInfo_s {
     struct relation_s * tsi_relations;
     struct relation_s * tsi_forward_relations;
     tsortInfo tsi_suc;        // used for queuing (addQ)
+    rpm_loff_t tsi_weight;   // estimated cost, 0 unless LPT ordering
     int      tsi_SccIdx;     // # of the SCC the node belongs to
                              // (1 for trivial SCCs)
     int      tsi_SccLowlink; // used for SCC detection
@@ -67,13 +71,12 @@ static void rpmTSIFree(tsortInfo tsi)
 
 static inline int addSingleRelation(rpmte p,
 				    rpmte q,
-				    rpmds dep)
+				    rpmsenseFlags dsflags,
+				    int reversed)
 {
     struct tsortInfo_s *tsi_p, *tsi_q;
     relation rel;
     rpmElementType teType = rpmteType(p);
-    rpmsenseFlags dsflags = rpmdsFlags(dep);
-    int reversed = rpmdsIsReverse(dep);
     rpmsenseFlags flags;
 
     /* Avoid deps outside this transaction and self dependencies */
@@ -208,13 +211,158 @@ static inline int addRelation(rpmts ts,
     if (q == NULL || q == p)
 	return 0;
 
-    addSingleRelation(p, q, dep);
+    addSingleRelation(p, q, rpmdsFlags(dep), rpmdsIsReverse(dep));
 
     return 0;
 }
 
+static const rpmTag ordertags[] = {
+    RPMTAG_REQUIRENAME,
+    RPMTAG_RECOMMENDNAME,
+    RPMTAG_SUGGESTNAME,
+    RPMTAG_SUPPLEMENTNAME,
+    RPMTAG_ENHANCENAME,
+    RPMTAG_ORDERNAME,
+    0,
+};
+
+struct resolvedDep_s {
+    rpmte q;			/* provider within the transaction (or NULL) */
+    rpmsenseFlags flags;	/* dependency flags at resolution time */
+    int reversed;		/* ordering direction of the dependency */
+    int deferred;		/* must be resolved on the serial path */
+};
+
+struct resolveJob_s {
+    rpmte *order;		/* transaction elements */
+    int nelem;
+    rpmal added;
+    rpmal erased;
+    struct resolvedDep_s **deps;	/* per element resolution results */
+    int *ndeps;				/* per element result counts */
+    int nthreads;
+    int tid;
+};
+
+/*
+ * Resolve the ordering dependencies of every nthreads'th element against
+ * rpmal. Resolution is read-only on the pre-built indexes with two
+ * exceptions which are left to the serial replay: rich dependencies
+ * (parsing creates new dependency sets) and file dependencies (lookups
+ * can intern strings into the shared pool). Each element's dependency
+ * sets are iterated by exactly one thread.
+ */
+static void * resolveWorker(void *data)
+{
+    struct resolveJob_s *job = data;
+
+    for (int e = job->tid; e < job->nelem; e += job->nthreads) {
+	rpmte p = job->order[e];
+	rpmal al = (rpmteType(p) == TR_REMOVED) ? job->erased : job->added;
+	int n = 0, alloced = 16;
+	struct resolvedDep_s *rd = xmalloc(alloced * sizeof(*rd));
+
+	for (int i = 0; ordertags[i]; i++) {
+	    rpmds dep = rpmdsInit(rpmteDS(p, ordertags[i]));
+	    while (rpmdsNext(dep) >= 0) {
+		struct resolvedDep_s *r;
+		const char *name;
+
+		if (n == alloced) {
+		    alloced <<= 1;
+		    rd = xrealloc(rd, alloced * sizeof(*rd));
+		}
+		r = &rd[n++];
+		r->q = NULL;
+		r->flags = rpmdsFlags(dep);
+		r->reversed = rpmdsIsReverse(dep);
+		r->deferred = 0;
+
+		if (isUnorderedReq(r->flags))
+		    continue;
+		name = rpmdsN(dep);
+		if (rpmdsIsRich(dep) || (name && name[0] == '/')) {
+		    r->deferred = 1;
+		    continue;
+		}
+		r->q = rpmalSatisfiesDepend(al, p, dep);
+	    }
+	}
+	job->deps[e] = rd;
+	job->ndeps[e] = n;
+    }
+    return NULL;
+}
+
+/* Resolve ordering dependencies of all elements across a thread pool */
+static int resolveRelations(rpmts ts, rpmal erased, int nthreads,
+			    struct resolvedDep_s ***depsp, int **ndepsp)
+{
+    tsMembers tsmem = rpmtsMembers(ts);
+    int nelem = rpmtsNElements(ts);
+    pthread_t *threads = xcalloc(nthreads, sizeof(*threads));
+    struct resolveJob_s *jobs = xcalloc(nthreads, sizeof(*jobs));
+    struct resolvedDep_s **deps = xcalloc(nelem, sizeof(*deps));
+    int *ndeps = xcalloc(nelem, sizeof(*ndeps));
+    int started = 0;
+
+    /* Make sure no lookup needs to build an index concurrently */
+    rpmalMakeIndex(tsmem->addedPackages);
+    rpmalMakeIndex(erased);
+
+    for (int i = 0; i < nthreads; i++) {
+	jobs[i].order = tsmem->order;
+	jobs[i].nelem = nelem;
+	jobs[i].added = tsmem->addedPackages;
+	jobs[i].erased = erased;
+	jobs[i].deps = deps;
+	jobs[i].ndeps = ndeps;
+	jobs[i].nthreads = nthreads;
+	jobs[i].tid = i;
+	if (pthread_create(&threads[i], NULL, resolveWorker, &jobs[i]))
+	    break;
+	started++;
+    }
+    for (int i = 0; i < started; i++)
+	pthread_join(threads[i], NULL);
+    free(threads);
+    free(jobs);
+
+    if (started < nthreads) {
+	/* Thread creation failed, fall back to the serial path */
+	for (int e = 0; e < nelem; e++)
+	    free(deps[e]);
+	free(deps);
+	free(ndeps);
+	return 0;
+    }
+
+    *depsp = deps;
+    *ndepsp = ndeps;
+    return 1;
+}
+
+/*
+ * Estimated relative processing cost of an element, in payload byte
+ * equivalents. The conversion factors mirror the default rates of the
+ * progress prediction cost model in transaction.c: one created or
+ * removed file costs as much as 25k unpacked bytes, one scriptlet as
+ * much as 25M.
+ */
+static rpm_loff_t elemWeight(rpmte te)
+{
+    rpmfiles files = rpmteFiles(te);
+    rpm_loff_t weight = rpmfilesFC(files) * 25000;
+
+    rpmfilesFree(files);
+    if (rpmteType(te) == TR_ADDED)
+	weight += rpmteArchiveSize(te);
+    weight += rpmteScriptCount(te) * 25000000;
+    return weight;
+}
+
 /**
- * Add element to list sorting by tsi_qcnt.
+ * Add element to list sorting by tsi_weight and tsi_qcnt.
  * @param p		new element
  * @param[out] qp		address of first element
  * @param[out] rp		address of last element
@@ -241,7 +389,7 @@ static void addQ(tsortInfo p, tsortInfo * qp, tsortInfo * rp,
     else
 	tailcond = (pcolor && pcolor == prefcolor);
 
-    /* Find location in queue using metric tsi_qcnt and color. */
+    /* Find location in queue using metrics tsi_weight, tsi_qcnt and color. */
     for (qprev = NULL, q = (*qp);
 	 q != NULL;
 	 qprev = q, q = q->tsi_suc)
@@ -250,7 +398,9 @@ static void addQ(tsortInfo p, tsortInfo * qp, tsortInfo * rp,
 	if (tailcond && (pcolor != rpmteColor(q->te)))
 	    continue;
 
-	if (q->tsi_qcnt <= p->tsi_qcnt)
+	/* Costly elements first, within equal cost the most depended on */
+	if (q->tsi_weight < p->tsi_weight ||
+	    (q->tsi_weight == p->tsi_weight && q->tsi_qcnt <= p->tsi_qcnt))
 	    break;
     }
 
@@ -568,6 +718,8 @@ int rpmtsOrder(rpmts ts)
     scc SCCs;
     int nelem = rpmtsNElements(ts);
     tsortInfo sortInfo = xcalloc(nelem, sizeof(struct tsortInfo_s));
+    struct resolvedDep_s **resolved = NULL;
+    int *nresolved = NULL;
 
     (void) rpmswEnter(rpmtsOp(ts, RPMTS_OP_ORDER), 0);
 
@@ -579,30 +731,54 @@ int rpmtsOrder(rpmts ts)
 	rpmteSetTSI(tsmem->order[i], &sortInfo[i]);
     }
 
+    /*
+     * Optionally order ready elements longest-processing-time-first so
+     * parallel consumers of the transaction get the expensive elements
+     * early. Weights of zero leave the traditional tsi_qcnt order.
+     */
+    if (rpmExpandNumeric("%{?_order_by_cost}") > 0) {
+	for (int i = 0; i < nelem; i++)
+	    sortInfo[i].tsi_weight = elemWeight(sortInfo[i].te);
+    }
+
+    /* Resolve providers in parallel if configured and worthwhile */
+    {	int nthreads = rpmExpandNumeric("%{?_order_threads}");
+	if (nthreads > 1 && nelem >= 64)
+	    resolveRelations(ts, erasedPackages, nthreads, &resolved, &nresolved);
+    }
+
     /* Record relations. */
     rpmlog(RPMLOG_DEBUG, "========== recording tsort relations\n");
     pi = rpmtsiInit(ts);
-    while ((p = rpmtsiNext(pi, 0)) != NULL) {
-	rpmal al = (rpmteType(p) == TR_REMOVED) ? 
+    for (int e = 0; (p = rpmtsiNext(pi, 0)) != NULL; e++) {
+	rpmal al = (rpmteType(p) == TR_REMOVED) ?
 		   erasedPackages : tsmem->addedPackages;
-	rpmTag ordertags[] = {
-		RPMTAG_REQUIRENAME,
-		RPMTAG_RECOMMENDNAME,
-		RPMTAG_SUGGESTNAME,
-		RPMTAG_SUPPLEMENTNAME,
-		RPMTAG_ENHANCENAME,
-		RPMTAG_ORDERNAME,
-		0,
-	};
+	int cursor = 0;
 
 	for (int i = 0; ordertags[i]; i++) {
 	    rpmds dep = rpmdsInit(rpmteDS(p, ordertags[i]));
-	    while (rpmdsNext(dep) >= 0)
-		addRelation(ts, al, p, dep);
+	    while (rpmdsNext(dep) >= 0) {
+		if (resolved == NULL) {
+		    addRelation(ts, al, p, dep);
+		    continue;
+		}
+		/* Replay the precomputed resolution in deterministic order */
+		struct resolvedDep_s *r = &resolved[e][cursor++];
+		if (r->deferred)
+		    addRelation(ts, al, p, dep);
+		else if (r->q != NULL && r->q != p)
+		    addSingleRelation(p, r->q, r->flags, r->reversed);
+	    }
+	}
+	if (resolved) {
+	    assert(cursor == nresolved[e]);
+	    resolved[e] = _free(resolved[e]);
 	}
     }
 
     rpmtsiFree(pi);
+    free(resolved);
+    free(nresolved);
 
     newOrder = xcalloc(tsmem->orderCount, sizeof(*newOrder));
     SCCs = detectSCCs(sortInfo, nelem, (rpmtsFlags(ts) & RPMTRANS_FLAG_DEPLOOPS));
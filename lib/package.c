@@ -10,6 +10,7 @@
 #include <rpm/rpmlib.h>			/* XXX RPMSIGTAG, other sig stuff */
 #include <rpm/rpmts.h>
 #include <rpm/rpmlog.h>
+#include <rpm/rpmmacro.h>
 #include <rpm/rpmstring.h>
 #include <rpm/rpmkeyring.h>
 
@@ -351,18 +352,31 @@ rpmRC rpmReadPackageFile(rpmts ts, FD_t fd, const char * fn, Header * hdrp)
 	.msg = NULL,
 	.rc = RPMRC_OK,
     };
+    struct rpmop_s sigop;
+    int vfyrc;
+
+    memset(&sigop, 0, sizeof(sigop));
 
     /* XXX: lots of 3rd party software relies on the behavior */
     if (hdrp)
 	*hdrp = NULL;
 
+    /* Package data is read exactly once, keep it out of the page cache */
+    if (rpmExpandNumeric("%{?_pkg_nocache}"))
+	fdSetNoCache(fd);
+
     rpmRC rc = rpmpkgRead(vs, fd, &sigblob, &blob, &msg);
     if (rc)
 	goto exit;
 
     /* Actually all verify discovered signatures and digests */
     rc = RPMRC_FAIL;
-    if (!rpmvsVerify(vs, RPMSIG_VERIFIABLE_TYPE, handleHdrVS, &pkgdata)) {
+    rpmswEnter(&sigop, 0);
+    vfyrc = rpmvsVerify(vs, RPMSIG_VERIFIABLE_TYPE, handleHdrVS, &pkgdata);
+    rpmswExit(&sigop, 0);
+    /* This can run concurrently, keep the shared counter update small */
+    rpmswAdd(rpmtsOp(ts, RPMTS_OP_SIGNATURE), &sigop);
+    if (!vfyrc) {
 	/* Finally import the headers and do whatever required retrofits etc */
 	if (hdrp) {
 	    if (hdrblobImport(sigblob, 0, &sigh, &msg))
@@ -21,6 +21,7 @@
 #define POPT_UNDEFINE		-994
 #define POPT_PIPE		-993
 #define POPT_LOAD		-992
+#define POPT_DUMPMACROS_COMPILED	-991
 
 static int _debug = 0;
 
@@ -49,6 +50,10 @@ rpmVSFlags rpmcliVSFlags;
 
 int rpmcliVfyLevelMask;
 
+int rpmcliVerifyJobs = 1;
+
+const char * rpmcliVerifyLevel = NULL;
+
 extern int _rpmio_debug;
 
 static int rpmcliInitialized = -1;
@@ -149,6 +154,12 @@ static void rpmcliAllArgCallback( poptContext con,
 	    exit(EXIT_FAILURE);
 	}
 	break;
+    case POPT_DUMPMACROS_COMPILED:
+	rpmcliConfigured();
+	if (rpmDumpMacrosCompiled(NULL, arg))
+	    exit(EXIT_FAILURE);
+	exit(EXIT_SUCCESS);
+	break;
     case POPT_DBPATH:
 	rpmcliConfigured();
 	if (arg && arg[0] != '/') {
@@ -225,6 +236,9 @@ struct poptOption rpmcliAllPoptTable[] = {
  { "load", '\0', POPT_ARG_STRING, 0, POPT_LOAD,
 	N_("load a single macro file"),
 	N_("<FILE>") },
+ { "dumpmacros-compiled", '\0', POPT_ARG_STRING, 0, POPT_DUMPMACROS_COMPILED,
+	N_("write the configured macro files as a compiled bundle"),
+	N_("<FILE>") },
 
  /* XXX this is a bit out of place here but kinda unavoidable... */
  { "noplugins", '\0', POPT_BIT_SET,
@@ -173,6 +173,10 @@ struct poptOption rpmInstallPoptTable[] = {
  { "install", 'i', 0, NULL, 'i',
 	N_("install package(s)"), N_("<packagefile>+") },
 
+ { "jsonstats", '\0', POPT_BIT_SET|POPT_ARGFLAG_DOC_HIDDEN,
+	&rpmIArgs.transFlags, RPMTRANS_FLAG_JSONSTATS,
+	N_("print machine-readable transaction statistics"), NULL},
+
  { "justdb", '\0', POPT_BIT_SET, &rpmIArgs.transFlags, RPMTRANS_FLAG_JUSTDB,
 	N_("update the database, but do not modify the filesystem"), NULL},
 
@@ -240,6 +244,10 @@ struct poptOption rpmInstallPoptTable[] = {
 	&rpmIArgs.probFilter, RPMPROB_FILTER_OLDPACKAGE,
 	N_("upgrade to an old version of the package (--force on upgrades does this automatically)"),
 	NULL},
+ { "parallelpayload", '\0', POPT_BIT_SET,
+	&rpmIArgs.transFlags, RPMTRANS_FLAG_PARALLELPAYLOAD,
+	N_("unpack payloads with multiple threads"), NULL},
+
  { "percent", '\0', POPT_BIT_SET,
 	&rpmIArgs.installInterfaceFlags, INSTALL_PERCENT,
 	N_("print percentages as package installs"), NULL},
@@ -255,6 +263,9 @@ struct poptOption rpmInstallPoptTable[] = {
  { "replacepkgs", '\0', POPT_BIT_SET,
 	&rpmIArgs.probFilter, RPMPROB_FILTER_REPLACEPKG,
 	N_("reinstall if the package is already present"), NULL},
+ { "syscallstats", '\0', POPT_BIT_SET|POPT_ARGFLAG_DOC_HIDDEN,
+	&rpmIArgs.transFlags, RPMTRANS_FLAG_SYSCALLSTATS,
+	N_("account file syscalls during payload processing"), NULL},
  { "test", '\0', POPT_BIT_SET, &rpmIArgs.transFlags, RPMTRANS_FLAG_TEST,
 	N_("don't install, but tell if it would work or not"), NULL},
  { "upgrade", 'U', POPT_BIT_SET,
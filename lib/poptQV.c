@@ -27,6 +27,8 @@ struct rpmQVKArguments_s rpmQVKArgs;
 #define POPT_WHATENHANCES	-1014
 #define POPT_WHATOBSOLETES	-1015
 #define POPT_WHATCONFLICTS	-1016
+#define POPT_PRINT0		-1017
+#define POPT_LENPREFIX		-1018
 
 /* ========== Query/Verify/Signature source args */
 static void rpmQVSourceArgCallback( poptContext con,
@@ -146,6 +148,14 @@ static void queryArgCallback(poptContext con,
 	rstrcat(&qva->qva_queryFormat, arg);
 	break;
 
+    case POPT_PRINT0:
+	qva->qva_outmode = QUERY_OUT_NUL;
+	break;
+
+    case POPT_LENPREFIX:
+	qva->qva_outmode = QUERY_OUT_LENPREFIX;
+	break;
+
     case 'i':
 	if (qva->qva_mode == 'q') {
 	    const char * infoCommand[] = { "--info", NULL };
@@ -229,6 +239,10 @@ struct poptOption rpmQueryPoptTable[] = {
 	POPT_QUERYFORMAT, NULL, NULL },
  { "queryformat", '\0', POPT_ARG_STRING, 0, POPT_QUERYFORMAT,
 	N_("use the following query format"), "QUERYFORMAT" },
+ { "print0", '\0', 0, 0, POPT_PRINT0,
+	N_("terminate formatted output records with NUL"), NULL },
+ { "lenprefix", '\0', 0, 0, POPT_LENPREFIX,
+	N_("prefix formatted output records with their byte length"), NULL },
  { "state", 's', 0, 0, 's',
 	N_("display the states of the listed files"), NULL },
    POPT_TABLEEND
@@ -283,5 +297,11 @@ struct poptOption rpmVerifyPoptTable[] = {
  { "noscripts", '\0', POPT_ARGFLAG_DOC_HIDDEN, NULL, RPMCLI_POPT_NOSCRIPTS,
         N_("don't execute verify script(s)"), NULL },
 
+ { "jobs", '\0', POPT_ARG_INT, &rpmcliVerifyJobs, 0,
+	N_("verify up to N files concurrently"), N_("N") },
+
+ { "level", '\0', POPT_ARG_STRING, &rpmcliVerifyLevel, 0,
+	N_("file verification level (fast, paranoid)"), N_("LEVEL") },
+
     POPT_TABLEEND
 };
@@ -6,6 +6,7 @@
 #include "system.h"
 
 #include <errno.h>
+#include <pthread.h>
 
 #include <rpm/rpmlib.h>		/* rpmvercmp and others */
 #include <rpm/rpmmacro.h>
@@ -48,7 +49,300 @@ struct rpmpsm_s {
 static rpmpsm rpmpsmNew(rpmts ts, rpmte te, pkgGoal goal);
 static rpmRC rpmpsmUnpack(rpmpsm psm);
 static rpmpsm rpmpsmFree(rpmpsm psm);
+static rpmpsm rpmpsmLink(rpmpsm psm);
 static const char * pkgGoalString(pkgGoal goal);
+static rpmRC dbAddExec(rpmts ts, rpmte te, Header h);
+static rpmRC dbRemoveExec(rpmts ts, rpmte te, Header h);
+
+/*
+ * Asynchronous %post execution (experimental, %_pipeline_scriptlets):
+ * hand one element's %post scriptlet off to a helper thread so that it
+ * can overlap with unpacking the next element. All scriptlet execution
+ * funnels through runScript() which reaps the in-flight scriptlet
+ * first, so scriptlets never run concurrently with each other and keep
+ * their transaction order. rpmpsmRun() additionally reaps before any
+ * element that depends on the in-flight element's package.
+ */
+static struct asyncPost_s {
+    pthread_t thread;
+    rpmpsm psm;			/*!< scriptlet owner, alive until reaped */
+    Header h;
+    rpmScript script;
+    struct rpmtd_s pfx;		/*!< install prefixes */
+    rpmds provides;		/*!< provides of the in-flight element */
+    rpmfiles files;		/*!< files of the in-flight element */
+    int active;
+} asyncPost;
+
+/* Set in the helper thread so its own runScript() call doesn't self-wait */
+static __thread int inAsyncPost = 0;
+
+static void * asyncPostWorker(void * arg)
+{
+    rpmpsm psm = asyncPost.psm;
+
+    inAsyncPost = 1;
+    /* Non-critical %post: failure is warn-only, just as when run in-line */
+    (void) runScript(psm->ts, psm->te, asyncPost.h, asyncPost.pfx.data,
+		     asyncPost.script, psm->scriptArg, -1);
+    return NULL;
+}
+
+static void asyncPostReset(void)
+{
+    rpmtdFreeData(&asyncPost.pfx);
+    asyncPost.script = rpmScriptFree(asyncPost.script);
+    asyncPost.h = headerFree(asyncPost.h);
+    asyncPost.provides = rpmdsFree(asyncPost.provides);
+    asyncPost.files = rpmfilesFree(asyncPost.files);
+    asyncPost.psm = rpmpsmFree(asyncPost.psm);
+    asyncPost.active = 0;
+}
+
+void rpmpsmWaitAsync(void)
+{
+    if (!inAsyncPost && asyncPost.active) {
+	pthread_join(asyncPost.thread, NULL);
+	asyncPostReset();
+    }
+}
+
+static int asyncPostEnabled(void)
+{
+    static int enabled = -1;
+    if (enabled < 0)
+	enabled = (rpmExpandNumeric("%{?_pipeline_scriptlets}") > 0);
+    return enabled;
+}
+
+/**
+ * Try to start the element's %post scriptlet on the helper thread.
+ * @param psm		package state machine data
+ * @return		RPMRC_OK when handed off, RPMRC_NOTFOUND when the
+ *			scriptlet (if any) must run synchronously
+ */
+static rpmRC asyncPostStart(rpmpsm psm)
+{
+    Header h;
+    rpmScript script;
+    struct rpmtd_s td;
+    int lua = 0;
+
+    if (!asyncPostEnabled() || asyncPost.active)
+	return RPMRC_NOTFOUND;
+
+    h = rpmteHeader(psm->te);
+    script = rpmScriptFromTag(h, RPMTAG_POSTIN);
+
+    if (headerGet(h, RPMTAG_POSTINPROG, &td, HEADERGET_MINMEM)) {
+	const char *prog = rpmtdNextString(&td);
+	lua = (prog != NULL && rstreq(prog, "<lua>"));
+	rpmtdFreeData(&td);
+    }
+
+    /*
+     * Embedded lua runs in-process and critical scriptlets need their
+     * exit status before proceeding: both must stay synchronous.
+     */
+    if (script == NULL || lua ||
+	    (rpmScriptFlags(script) & RPMSCRIPT_FLAG_CRITICAL)) {
+	rpmScriptFree(script);
+	headerFree(h);
+	return RPMRC_NOTFOUND;
+    }
+
+    asyncPost.h = h;
+    asyncPost.script = script;
+    headerGet(h, RPMTAG_INSTPREFIXES, &asyncPost.pfx,
+	      HEADERGET_ALLOC|HEADERGET_ARGV);
+    asyncPost.psm = rpmpsmLink(psm);
+    asyncPost.provides = rpmdsLink(rpmteDS(psm->te, RPMTAG_PROVIDENAME));
+    asyncPost.files = rpmteFiles(psm->te);
+
+    /* The scriptlet may read the database: flush queued commits first */
+    rpmpsmWaitDb();
+
+    if (pthread_create(&asyncPost.thread, NULL, asyncPostWorker, NULL)) {
+	/* Fall back to synchronous execution */
+	asyncPostReset();
+	return RPMRC_NOTFOUND;
+    }
+    asyncPost.active = 1;
+    return RPMRC_OK;
+}
+
+/**
+ * Does the element depend on the package whose %post is in flight?
+ * @param te		transaction element
+ * @return		1 if a dependency exists, 0 otherwise
+ */
+static int asyncPostRequired(rpmte te)
+{
+    rpmds req = rpmdsInit(rpmteDS(te, RPMTAG_REQUIRENAME));
+    int required = 0;
+
+    while (!required && rpmdsNext(req) >= 0) {
+	const char *N = rpmdsN(req);
+	if (N == NULL)
+	    continue;
+	if (*N == '/')
+	    required = (rpmfilesFindFN(asyncPost.files, N) >= 0);
+	else
+	    required = (rpmdsSearch(asyncPost.provides, req) >= 0);
+    }
+    return required;
+}
+
+/*
+ * Asynchronous rpmdb commits (experimental, %_pipeline_dbwrites):
+ * queue rpmdbAdd()/rpmdbRemove() of completed elements to a single
+ * writer thread so database index maintenance can overlap with
+ * unpacking the next element. Commits are applied strictly in queue
+ * order and everything reading the database drains the queue first
+ * (rpmpsmWaitDb()), so readers observe exactly the state synchronous
+ * commits would have produced.
+ */
+struct dbJob_s {
+    struct dbJob_s *next;
+    rpmts ts;
+    rpmte te;
+    Header h;			/*!< prepared header, owned by the job */
+    int erase;
+};
+
+static struct dbWriter_s {
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;	/*!< signalled on new jobs and on drain */
+    struct dbJob_s *head;
+    struct dbJob_s *tail;
+    int running;		/*!< writer thread exists */
+    int draining;		/*!< writer exits once the queue is empty */
+    rpmRC rc;			/*!< first failed commit, sticky */
+} dbWriter = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .cond = PTHREAD_COND_INITIALIZER,
+    .rc = RPMRC_OK,
+};
+
+static void * dbWriterThread(void * arg)
+{
+    pthread_mutex_lock(&dbWriter.lock);
+    while (dbWriter.head != NULL || !dbWriter.draining) {
+	struct dbJob_s *job = dbWriter.head;
+	rpmRC rc;
+
+	if (job == NULL) {
+	    pthread_cond_wait(&dbWriter.cond, &dbWriter.lock);
+	    continue;
+	}
+	if ((dbWriter.head = job->next) == NULL)
+	    dbWriter.tail = NULL;
+	pthread_mutex_unlock(&dbWriter.lock);
+
+	rc = job->erase ? dbRemoveExec(job->ts, job->te, job->h)
+			: dbAddExec(job->ts, job->te, job->h);
+	free(job);
+
+	pthread_mutex_lock(&dbWriter.lock);
+	if (rc != RPMRC_OK && dbWriter.rc == RPMRC_OK)
+	    dbWriter.rc = rc;
+    }
+    pthread_mutex_unlock(&dbWriter.lock);
+    return NULL;
+}
+
+rpmRC rpmpsmWaitDb(void)
+{
+    /* The %post helper must not join, asyncPostStart() already drained */
+    if (inAsyncPost || !dbWriter.running)
+	return dbWriter.rc;
+    pthread_mutex_lock(&dbWriter.lock);
+    dbWriter.draining = 1;
+    pthread_cond_signal(&dbWriter.cond);
+    pthread_mutex_unlock(&dbWriter.lock);
+    pthread_join(dbWriter.thread, NULL);
+    dbWriter.running = 0;
+    dbWriter.draining = 0;
+    return dbWriter.rc;
+}
+
+rpmRC rpmpsmFinishDb(void)
+{
+    rpmRC rc;
+
+    rpmpsmWaitDb();
+    rc = dbWriter.rc;
+    dbWriter.rc = RPMRC_OK;
+    return rc;
+}
+
+static int dbWriterEnabled(rpmts ts)
+{
+    static int enabled = -1;
+    const char *root = rpmtsRootDir(ts);
+
+    if (enabled < 0)
+	enabled = (rpmExpandNumeric("%{?_pipeline_dbwrites}") > 0);
+    /*
+     * rpmdbAdd() may open database files by path and chroot(2) affects
+     * all threads: commit in-line when the transaction enters an
+     * install root.
+     */
+    return enabled && (root == NULL || rstreq(root, "/"));
+}
+
+/**
+ * Queue a database commit for the writer thread.
+ * @param ts		transaction set
+ * @param te		transaction element
+ * @param h		prepared header (ownership is transferred)
+ * @param erase		remove instead of add?
+ * @return		RPMRC_OK when queued (the commit result is deferred)
+ */
+static rpmRC dbEnqueue(rpmts ts, rpmte te, Header h, int erase)
+{
+    struct dbJob_s *job;
+
+    /*
+     * Surface an earlier failed commit on the next one: the wrong
+     * element gets the blame, but the transaction fails as it must.
+     */
+    pthread_mutex_lock(&dbWriter.lock);
+    if (dbWriter.rc != RPMRC_OK) {
+	rpmRC rc = dbWriter.rc;
+	dbWriter.rc = RPMRC_OK;
+	pthread_mutex_unlock(&dbWriter.lock);
+	headerFree(h);
+	return rc;
+    }
+    pthread_mutex_unlock(&dbWriter.lock);
+
+    if (!dbWriter.running) {
+	if (pthread_create(&dbWriter.thread, NULL, dbWriterThread, NULL)) {
+	    /* No helper thread, commit in-line */
+	    return erase ? dbRemoveExec(ts, te, h) : dbAddExec(ts, te, h);
+	}
+	dbWriter.running = 1;
+    }
+
+    job = xcalloc(1, sizeof(*job));
+    job->ts = ts;
+    job->te = te;
+    job->h = h;
+    job->erase = erase;
+
+    pthread_mutex_lock(&dbWriter.lock);
+    if (dbWriter.tail)
+	dbWriter.tail->next = job;
+    else
+	dbWriter.head = job;
+    dbWriter.tail = job;
+    pthread_cond_signal(&dbWriter.cond);
+    pthread_mutex_unlock(&dbWriter.lock);
+
+    return RPMRC_OK;
+}
 
 /**
  * Adjust file states in database for files shared with this package:
@@ -350,9 +644,12 @@ static rpmRC runTriggers(rpmpsm psm, rpmsenseFlags sense)
 
     if (psm->te) 	/* XXX can't happen */
 	N = rpmteN(psm->te);
-    if (N) 		/* XXX can't happen */
+    if (N) {		/* XXX can't happen */
+	/* Counting reads the database, flush queued commits first */
+	rpmpsmWaitDb();
 	numPackage = rpmdbCountPackages(rpmtsGetRdb(ts), N)
 				+ psm->countCorrection;
+    }
     if (numPackage < 0)
 	return RPMRC_NOTFOUND;
 
@@ -426,7 +723,7 @@ exit:
 
 static rpmpsm rpmpsmFree(rpmpsm psm)
 {
-    if (psm) {
+    if (psm && --psm->nrefs <= 0) {
 	rpmfilesFree(psm->files);
 	rpmtsFree(psm->ts),
 	/* XXX rpmte not refcounted yet */
@@ -436,9 +733,17 @@ static rpmpsm rpmpsmFree(rpmpsm psm)
     return NULL;
 }
 
+static rpmpsm rpmpsmLink(rpmpsm psm)
+{
+    if (psm)
+	psm->nrefs++;
+    return psm;
+}
+
 static rpmpsm rpmpsmNew(rpmts ts, rpmte te, pkgGoal goal)
 {
     rpmpsm psm = xcalloc(1, sizeof(*psm));
+    psm->nrefs = 1;
     psm->ts = rpmtsLink(ts);
     psm->files = rpmteFiles(te);
     psm->te = te; /* XXX rpmte not refcounted yet */
@@ -533,6 +838,57 @@ static void markReplacedInstance(rpmts ts, rpmte te)
     rpmdbFreeIterator(mi);
 }
 
+/*
+ * Record the post-install inode change times of regular files so that
+ * the fast verify level can trust an unchanged stat() without re-reading
+ * file contents. Only done when %_verify_level is set to fast, files
+ * not installed as-is (%ghost, netshared etc) are recorded as zero.
+ */
+static void dbAddFileCtimes(rpmte te, Header h)
+{
+    static int record = -1;
+    rpmfiles files;
+    rpmfs fs;
+    rpm_time_t *ctimes;
+    int fc;
+
+    if (record < 0) {
+	char *level = rpmExpand("%{?_verify_level}", NULL);
+	record = rstreq(level, "fast");
+	free(level);
+    }
+    if (!record)
+	return;
+
+    files = rpmteFiles(te);
+    fs = rpmteGetFileStates(te);
+    fc = rpmfilesFC(files);
+    if (fc <= 0 || rpmChrootIn() != 0) {
+	rpmfilesFree(files);
+	return;
+    }
+
+    ctimes = xcalloc(fc, sizeof(*ctimes));
+    for (int ix = 0; ix < fc; ix++) {
+	struct stat sb;
+	char *fn;
+
+	if (rpmfsGetState(fs, ix) != RPMFILE_STATE_NORMAL)
+	    continue;
+	if (!S_ISREG(rpmfilesFMode(files, ix)))
+	    continue;
+
+	fn = rpmfilesFN(files, ix);
+	if (fn && lstat(fn, &sb) == 0 && S_ISREG(sb.st_mode))
+	    ctimes[ix] = sb.st_ctime;
+	free(fn);
+    }
+    headerPutUint32(h, RPMTAG_INSTALLFILECTIMES, ctimes, fc);
+    free(ctimes);
+    rpmfilesFree(files);
+    rpmChrootOut();
+}
+
 static rpmRC dbAdd(rpmts ts, rpmte te)
 {
     Header h = rpmteHeader(te);
@@ -551,6 +907,21 @@ static rpmRC dbAdd(rpmts ts, rpmte te)
     headerPutUint32(h, RPMTAG_INSTALLTID, &tid, 1);
     headerPutUint32(h, RPMTAG_INSTALLTIME, &installTime, 1);
     headerPutUint32(h, RPMTAG_INSTALLCOLOR, &tscolor, 1);
+    dbAddFileCtimes(te, h);
+
+    /* Triggers added now must fire for later transaction elements */
+    rpmtrigCacheInvalidate(ts, h);
+
+    if (dbWriterEnabled(ts))
+	rc = dbEnqueue(ts, te, h, 0);
+    else
+	rc = dbAddExec(ts, te, h);
+    return rc;
+}
+
+static rpmRC dbAddExec(rpmts ts, rpmte te, Header h)
+{
+    rpmRC rc;
 
     (void) rpmswEnter(rpmtsOp(ts, RPMTS_OP_DBADD), 0);
     rc = (rpmdbAdd(rpmtsGetRdb(ts), h) == 0) ? RPMRC_OK : RPMRC_FAIL;
@@ -566,6 +937,21 @@ static rpmRC dbAdd(rpmts ts, rpmte te)
 }
 
 static rpmRC dbRemove(rpmts ts, rpmte te)
+{
+    Header h = rpmteHeader(te);
+    rpmRC rc;
+
+    /* Triggers removed now must not fire for later transaction elements */
+    rpmtrigCacheInvalidate(ts, h);
+
+    if (dbWriterEnabled(ts))
+	rc = dbEnqueue(ts, te, h, 1);
+    else
+	rc = dbRemoveExec(ts, te, h);
+    return rc;
+}
+
+static rpmRC dbRemoveExec(rpmts ts, rpmte te, Header h)
 {
     rpmRC rc;
 
@@ -576,6 +962,7 @@ static rpmRC dbRemove(rpmts ts, rpmte te)
 
     if (rc == RPMRC_OK)
 	rpmteSetDBInstance(te, 0);
+    headerFree(h);
     return rc;
 }
 
@@ -704,8 +1091,10 @@ static rpmRC rpmPackageInstall(rpmts ts, rpmpsm psm)
 	}
 
 	if (!(rpmtsFlags(ts) & RPMTRANS_FLAG_NOPOST)) {
-	    rc = runInstScript(psm, RPMTAG_POSTIN);
-	    if (rc) break;
+	    if (asyncPostStart(psm) != RPMRC_OK) {
+		rc = runInstScript(psm, RPMTAG_POSTIN);
+		if (rc) break;
+	    }
 	}
 
 	if (!(rpmtsFlags(ts) & RPMTRANS_FLAG_NOTRIGGERIN)) {
@@ -873,6 +1262,10 @@ rpmRC rpmpsmRun(rpmts ts, rpmte te, pkgGoal goal)
     if (rpmtsFlags(ts) & RPMTRANS_FLAG_TEST)
 	return RPMRC_OK;
 
+    /* Barrier: only installs independent of the in-flight %post overlap */
+    if (asyncPost.active && (goal != PKG_INSTALL || asyncPostRequired(te)))
+	rpmpsmWaitAsync();
+
     psm = rpmpsmNew(ts, te, goal);
     /* Run pre transaction element hook for all plugins */
     if (rpmChrootIn() == 0) {
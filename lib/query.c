@@ -6,6 +6,7 @@
 #include "system.h"
 
 #include <errno.h>
+#include <fcntl.h>
 #include <inttypes.h>
 #include <ctype.h>
 
@@ -18,12 +19,80 @@
 #include <rpm/rpmlog.h>
 #include <rpm/rpmfileutil.h>	/* rpmCleanPath */
 
+#include "lib/rpmdb_internal.h"	/* rpmdbGetIteratorOffsetFor */
 #include "lib/rpmgi.h"
 #include "lib/manifest.h"
 
 #include "debug.h"
 
 
+/*
+ * Batched output for formatted query records: instead of a stdio round
+ * trip per package, records collect in a reusable buffer flushed to
+ * stdout with write(2) in large batches. Optional framing (a NUL
+ * terminator or a big-endian uint32 length prefix per record, see
+ * --print0/--lenprefix) saves downstream consumers of mass query
+ * output from scanning for record boundaries.
+ */
+#define QFMT_BATCH (64 * 1024)
+
+static struct qfmtOut_s {
+    char *buf;
+    size_t len;
+    size_t alloced;
+} qfmtOut = { NULL, 0, 0 };
+
+static void qfmtFlush(void)
+{
+    size_t off = 0;
+
+    if (qfmtOut.len == 0)
+	return;
+
+    /* rpmlog's stdout output must not overtake ours */
+    fflush(stdout);
+    while (off < qfmtOut.len) {
+	ssize_t n = write(STDOUT_FILENO, qfmtOut.buf + off, qfmtOut.len - off);
+	if (n < 0) {
+	    if (errno == EINTR)
+		continue;
+	    break;
+	}
+	off += n;
+    }
+    qfmtOut.len = 0;
+}
+
+static void qfmtPut(const void *data, size_t len)
+{
+    if (qfmtOut.len + len > qfmtOut.alloced) {
+	qfmtOut.alloced = 2 * QFMT_BATCH;
+	while (qfmtOut.alloced < qfmtOut.len + len)
+	    qfmtOut.alloced *= 2;
+	qfmtOut.buf = xrealloc(qfmtOut.buf, qfmtOut.alloced);
+    }
+    memcpy(qfmtOut.buf + qfmtOut.len, data, len);
+    qfmtOut.len += len;
+    if (qfmtOut.len >= QFMT_BATCH)
+	qfmtFlush();
+}
+
+static void qfmtRecord(QVA_t qva, const char *str)
+{
+    size_t len = strlen(str);
+
+    if (qva->qva_outmode == QUERY_OUT_LENPREFIX) {
+	uint8_t nlen[4] = {
+	    (len >> 24) & 0xff, (len >> 16) & 0xff,
+	    (len >> 8) & 0xff, len & 0xff,
+	};
+	qfmtPut(nlen, sizeof(nlen));
+    }
+    qfmtPut(str, len);
+    if (qva->qva_outmode == QUERY_OUT_NUL)
+	qfmtPut("", 1);
+}
+
 /**
  */
 static void printFileInfo(const char * name,
@@ -102,7 +171,7 @@ int showQueryPackage(QVA_t qva, rpmts ts, Header h)
 	char *str = headerFormat(h, qva->qva_queryFormat, &errstr);
 
 	if ( str != NULL ) {
-	    rpmlog(RPMLOG_NOTICE, "%s", str);
+	    qfmtRecord(qva, str);
 	    free(str);
 	} else {
 	    rpmlog(RPMLOG_ERR, _("incorrect format: %s\n"), errstr);
@@ -116,6 +185,9 @@ int showQueryPackage(QVA_t qva, rpmts ts, Header h)
     if (!(qva->qva_flags & QUERY_FOR_LIST))
 	goto exit;
 
+    /* List output goes through rpmlog, it must not overtake our records */
+    qfmtFlush();
+
     if (!(qva->qva_flags & QUERY_FOR_DUMPFILES))
 	fiflags |= RPMFI_NOFILEDIGESTS;
 
@@ -294,6 +366,454 @@ static int rpmcliShowMatches(QVA_t qva, rpmts ts, rpmdbMatchIterator mi)
     return ec;
 }
 
+/*
+ * Derived column cache for mass queries (optional, see %_tagcache_path):
+ * the hot scalar tags of every installed package are kept as packed
+ * mini headers in a sidecar file, so query formats touching only those
+ * tags are answered without loading any full header blob. The file is
+ * validated against rpmdbCookie() and rebuilt transparently (while
+ * answering the query from the full headers) when the rpmdb changed.
+ * Each mini header is stored with its rpmdb instance number, so indexed
+ * lookups (--whatprovides etc) can be answered from the cache as well.
+ */
+
+static const char tagcache_magic[8] = "RPMTagC\002";
+
+/* Tags stored in the cache, in mini header form */
+static const rpmTagVal tagcacheTags[] = {
+    RPMTAG_NAME,
+    RPMTAG_EPOCH,
+    RPMTAG_VERSION,
+    RPMTAG_RELEASE,
+    RPMTAG_ARCH,
+    RPMTAG_INSTALLTIME,
+    RPMTAG_SIZE,
+    RPMTAG_LONGSIZE,
+    RPMTAG_SOURCERPM,
+    0,
+};
+
+/* Extension tags computed entirely from the stored ones */
+static const rpmTagVal tagcacheExtTags[] = {
+    RPMTAG_EPOCHNUM,
+    RPMTAG_EVR,
+    RPMTAG_NVR,
+    RPMTAG_NVRA,
+    RPMTAG_NEVR,
+    RPMTAG_NEVRA,
+    0,
+};
+
+static int tagcacheUsableTag(const char *name, size_t namelen)
+{
+    char tagname[64];
+    const char *tn = tagname;
+    rpmTagVal tag;
+
+    if (namelen == 0 || namelen >= sizeof(tagname))
+	return 0;
+    memcpy(tagname, name, namelen);
+    tagname[namelen] = '\0';
+
+    /* Accept the RPMTAG_ prefix the same way headerFormat() does */
+    if (rstreqn(tn, "RPMTAG_", sizeof("RPMTAG_")-1))
+	tn += sizeof("RPMTAG");
+
+    tag = rpmTagGetValue(tn);
+    for (const rpmTagVal *t = tagcacheTags; *t; t++)
+	if (tag == *t)
+	    return 1;
+    for (const rpmTagVal *t = tagcacheExtTags; *t; t++)
+	if (tag == *t)
+	    return 1;
+    return 0;
+}
+
+/*
+ * Decide whether a query format can be answered from the column cache,
+ * ie references nothing beyond the cached tags and their derivatives.
+ * Anything the scan doesn't understand disqualifies the format.
+ */
+static int tagcacheUsableFormat(const char *fmt)
+{
+    const char *s = fmt;
+
+    while (*s != '\0') {
+	size_t namelen;
+
+	if (*s == '\\') {		/* escape */
+	    if (*(++s) != '\0')
+		s++;
+	    continue;
+	}
+	if (*s != '%') {
+	    s++;
+	    continue;
+	}
+	if (*(++s) == '%') {		/* %% literal */
+	    s++;
+	    continue;
+	}
+	while (*s == '-' || *s == '.' || risdigit(*s))	/* field width */
+	    s++;
+	if (*s == '{') {
+	    /* %{tag}, %{tag:format} */
+	    namelen = strcspn(++s, ":}");
+	    if (s[namelen] == '\0' || !tagcacheUsableTag(s, namelen))
+		return 0;
+	    if ((s = strchr(s + namelen, '}')) == NULL)
+		return 0;
+	    s++;
+	} else if (*s == '|') {
+	    /* %|tag?{...}:{...}|, the arms are scanned by the main walk */
+	    namelen = strcspn(++s, "?");
+	    if (s[namelen] == '\0' || !tagcacheUsableTag(s, namelen))
+		return 0;
+	    s += namelen + 1;
+	} else {
+	    return 0;
+	}
+    }
+    return 1;
+}
+
+/*
+ * Load the cached mini headers and their rpmdb instance numbers.
+ * Returns the number of packages, or -1 if the file is corrupt or out
+ * of date wrt the cookie. Imports everything before returning anything:
+ * a corrupt cache must fall back to the normal path without output.
+ */
+static int tagcacheLoad(FILE *fp, const char *cookie,
+			Header **hdrsp, unsigned int **instsp)
+{
+    char magic[sizeof(tagcache_magic)];
+    uint32_t npkgs, len;
+    Header *hdrs = NULL;
+    unsigned int *insts = NULL;
+    uint32_t nhdrs = 0;
+
+    if (fread(magic, 1, sizeof(magic), fp) != sizeof(magic) ||
+	    memcmp(magic, tagcache_magic, sizeof(magic)) != 0)
+	return -1;
+
+    if (fread(&len, sizeof(len), 1, fp) != 1 || len != strlen(cookie))
+	return -1;
+    {
+	char fcookie[len + 1];
+	if (fread(fcookie, 1, len, fp) != len)
+	    return -1;
+	fcookie[len] = '\0';
+	if (!rstreq(fcookie, cookie))
+	    return -1;
+    }
+
+    if (fread(&npkgs, sizeof(npkgs), 1, fp) != 1)
+	return -1;
+
+    hdrs = xcalloc(npkgs ? npkgs : 1, sizeof(*hdrs));
+    insts = xcalloc(npkgs ? npkgs : 1, sizeof(*insts));
+    for (nhdrs = 0; nhdrs < npkgs; nhdrs++) {
+	uint32_t inst;
+	void *blob;
+	if (fread(&inst, sizeof(inst), 1, fp) != 1)
+	    goto err;
+	if (fread(&len, sizeof(len), 1, fp) != 1 || len == 0)
+	    goto err;
+	blob = xmalloc(len);
+	if (fread(blob, 1, len, fp) != len) {
+	    free(blob);
+	    goto err;
+	}
+	hdrs[nhdrs] = headerImport(blob, len, HEADERIMPORT_COPY);
+	free(blob);
+	if (hdrs[nhdrs] == NULL)
+	    goto err;
+	insts[nhdrs] = inst;
+    }
+
+    *hdrsp = hdrs;
+    *instsp = insts;
+    return npkgs;
+
+err:
+    for (uint32_t i = 0; i < nhdrs; i++)
+	headerFree(hdrs[i]);
+    free(hdrs);
+    free(insts);
+    return -1;
+}
+
+/*
+ * Load and display the cached mini headers. Returns -1 (without output)
+ * if the file is corrupt or out of date wrt the cookie.
+ */
+static int tagcacheShowFile(QVA_t qva, rpmts ts, FILE *fp, const char *cookie)
+{
+    Header *hdrs = NULL;
+    unsigned int *insts = NULL;
+    int npkgs = tagcacheLoad(fp, cookie, &hdrs, &insts);
+    int ec = 0;
+
+    if (npkgs < 0)
+	return -1;
+
+    for (int i = 0; i < npkgs; i++) {
+	int rc;
+	rpmsqPoll();
+	if ((rc = qva->qva_showPackage(qva, ts, hdrs[i])) != 0)
+	    ec = rc;
+    }
+
+    for (int i = 0; i < npkgs; i++)
+	headerFree(hdrs[i]);
+    free(hdrs);
+    free(insts);
+    return ec;
+}
+
+static void tagcacheWriteFile(const char *path, const char *cookie,
+			      Header *hdrs, const unsigned int *insts,
+			      uint32_t nhdrs)
+{
+    char *tmppath = NULL;
+    FILE *fp = NULL;
+    uint32_t len = strlen(cookie);
+    int ok = 1;
+
+    rasprintf(&tmppath, "%s.tmp.%d", path, (int) getpid());
+    if ((fp = fopen(tmppath, "w")) == NULL)
+	goto exit;
+
+    ok &= (fwrite(tagcache_magic, 1, sizeof(tagcache_magic), fp)
+		== sizeof(tagcache_magic));
+    ok &= (fwrite(&len, sizeof(len), 1, fp) == 1);
+    ok &= (fwrite(cookie, 1, len, fp) == len);
+    ok &= (fwrite(&nhdrs, sizeof(nhdrs), 1, fp) == 1);
+    for (uint32_t i = 0; ok && i < nhdrs; i++) {
+	uint32_t inst = insts[i];
+	void *blob = headerExport(hdrs[i], &len);
+	ok &= (blob != NULL && len > 0);
+	ok &= ok && (fwrite(&inst, sizeof(inst), 1, fp) == 1);
+	ok &= ok && (fwrite(&len, sizeof(len), 1, fp) == 1);
+	ok &= ok && (fwrite(blob, 1, len, fp) == len);
+	free(blob);
+    }
+    if (fclose(fp) != 0)
+	ok = 0;
+    if (!ok || rename(tmppath, path) != 0)
+	unlink(tmppath);
+
+exit:
+    free(tmppath);
+}
+
+/*
+ * Answer the query from the full headers while collecting their hot
+ * tags into mini headers for the next time around.
+ */
+static int tagcacheRebuild(QVA_t qva, rpmts ts, const char *path,
+			   const char *cookie)
+{
+    rpmdbMatchIterator mi = rpmtsInitIterator(ts, RPMDBI_PACKAGES, NULL, 0);
+    Header h;
+    Header *hdrs = NULL;
+    unsigned int *insts = NULL;
+    uint32_t nhdrs = 0, nalloced = 0;
+    int ec = 0;
+
+    if (mi == NULL)
+	return -1;
+
+    while ((h = rpmdbNextIterator(mi)) != NULL) {
+	int rc;
+
+	if (nhdrs == nalloced) {
+	    nalloced += 1024;
+	    hdrs = xrealloc(hdrs, nalloced * sizeof(*hdrs));
+	    insts = xrealloc(insts, nalloced * sizeof(*insts));
+	}
+	hdrs[nhdrs] = headerNew();
+	headerCopyTags(h, hdrs[nhdrs], tagcacheTags);
+	insts[nhdrs] = rpmdbGetIteratorOffset(mi);
+	nhdrs++;
+
+	rpmsqPoll();
+	if ((rc = qva->qva_showPackage(qva, ts, h)) != 0)
+	    ec = rc;
+    }
+    rpmdbFreeIterator(mi);
+
+    if (ec == 0)
+	tagcacheWriteFile(path, cookie, hdrs, insts, nhdrs);
+
+    for (uint32_t i = 0; i < nhdrs; i++)
+	headerFree(hdrs[i]);
+    free(hdrs);
+    free(insts);
+    return ec;
+}
+
+/*
+ * Try to answer an unfiltered -qa from the column cache. Returns -1
+ * if the query is out of the cache's league, the cache is disabled or
+ * the database cannot be opened; the caller then runs the normal path.
+ */
+static int tagcacheShowAll(QVA_t qva, rpmts ts)
+{
+    char *path = NULL;
+    char *cookie = NULL;
+    FILE *fp = NULL;
+    int ec = -1;
+
+    if (qva->qva_showPackage != showQueryPackage ||
+	    qva->qva_queryFormat == NULL)
+	return -1;
+    if ((qva->qva_flags & _QUERY_FOR_BITS) || qva->qva_incattr ||
+	    qva->qva_excattr)
+	return -1;
+
+    path = rpmExpand("%{?_tagcache_path}", NULL);
+    if (*path == '\0')
+	goto exit;
+
+    if (!tagcacheUsableFormat(qva->qva_queryFormat))
+	goto exit;
+
+    if (rpmtsGetRdb(ts) == NULL && rpmtsOpenDB(ts, O_RDONLY) != 0)
+	goto exit;
+    if ((cookie = rpmdbCookie(rpmtsGetRdb(ts))) == NULL)
+	goto exit;
+
+    if ((fp = fopen(path, "r")) != NULL) {
+	ec = tagcacheShowFile(qva, ts, fp, cookie);
+	fclose(fp);
+    }
+
+    if (ec < 0)
+	ec = tagcacheRebuild(qva, ts, path, cookie);
+
+exit:
+    free(cookie);
+    free(path);
+    return ec;
+}
+
+/*
+ * Try to answer a dependency query (--whatprovides and friends) from
+ * the dependency index plus the column cache: the index lookup supplies
+ * the package offsets and the cache supplies the hot tags, so no full
+ * header blob is ever loaded. Returns -1 to have the caller run the
+ * normal iterator path instead. Unlike -qa, a missing or stale cache is
+ * not rebuilt here: that would turn an indexed lookup into a full
+ * database walk, populating the cache remains a mass query's job.
+ */
+static int tagcacheShowDeps(QVA_t qva, rpmts ts, const char *arg)
+{
+    rpmDbiTag dbi;
+    const char *notfound;
+    char *path = NULL;
+    char *cookie = NULL;
+    FILE *fp = NULL;
+    Header *hdrs = NULL;
+    unsigned int *insts = NULL;
+    rpmdbMatchIterator mi = NULL;
+    int npkgs = -1;
+    int ec = -1;
+
+    switch (qva->qva_source) {
+    case RPMQV_WHATPROVIDES:
+	/* path arguments need the file index, take the normal route */
+	if (arg[0] == '/' || arg[0] == '.')
+	    return -1;
+	dbi = RPMDBI_PROVIDENAME;
+	notfound = _("no package provides %s\n");
+	break;
+    case RPMQV_WHATREQUIRES:
+	dbi = RPMDBI_REQUIRENAME;
+	notfound = _("no package requires %s\n");
+	break;
+    case RPMQV_WHATCONFLICTS:
+	dbi = RPMDBI_CONFLICTNAME;
+	notfound = _("no package conflicts %s\n");
+	break;
+    default:
+	return -1;
+    }
+
+    if (qva->qva_showPackage != showQueryPackage ||
+	    qva->qva_queryFormat == NULL)
+	return -1;
+    if ((qva->qva_flags & _QUERY_FOR_BITS) || qva->qva_incattr ||
+	    qva->qva_excattr)
+	return -1;
+
+    path = rpmExpand("%{?_tagcache_path}", NULL);
+    if (*path == '\0')
+	goto exit;
+
+    if (!tagcacheUsableFormat(qva->qva_queryFormat))
+	goto exit;
+
+    if (rpmtsGetRdb(ts) == NULL && rpmtsOpenDB(ts, O_RDONLY) != 0)
+	goto exit;
+    if ((cookie = rpmdbCookie(rpmtsGetRdb(ts))) == NULL)
+	goto exit;
+
+    if ((fp = fopen(path, "r")) == NULL)
+	goto exit;
+    if ((npkgs = tagcacheLoad(fp, cookie, &hdrs, &insts)) < 0)
+	goto exit;
+
+    /* The iterator is only walked for its offset set, no header loads */
+    mi = rpmtsInitIterator(ts, dbi, arg, 0);
+    if (mi == NULL) {
+	rpmlog(RPMLOG_NOTICE, notfound, arg);
+	ec = 1;		/* what rpmcliShowMatches() says to a NULL mi */
+	goto exit;
+    }
+
+    /* Resolve every offset before showing anything: an index/cache
+     * mismatch must fall back to the normal path without output. */
+    {
+	int nmatches = rpmdbGetIteratorCount(mi);
+	Header matches[nmatches ? nmatches : 1];
+
+	for (int i = 0; i < nmatches; i++) {
+	    unsigned int offset = rpmdbGetIteratorOffsetFor(mi, i);
+
+	    matches[i] = NULL;
+	    for (int j = 0; j < npkgs; j++) {
+		if (insts[j] == offset) {
+		    matches[i] = hdrs[j];
+		    break;
+		}
+	    }
+	    if (matches[i] == NULL)
+		goto exit;
+	}
+
+	ec = 0;
+	for (int i = 0; i < nmatches; i++) {
+	    int rc;
+	    rpmsqPoll();
+	    if ((rc = qva->qva_showPackage(qva, ts, matches[i])) != 0)
+		ec = rc;
+	}
+    }
+
+exit:
+    rpmdbFreeIterator(mi);
+    for (int i = 0; i < npkgs; i++)
+	headerFree(hdrs[i]);
+    free(hdrs);
+    free(insts);
+    if (fp)
+	fclose(fp);
+    free(cookie);
+    free(path);
+    return ec;
+}
+
 static rpmdbMatchIterator matchesIterator(rpmts ts, rpmDbiTag dbi,
 					const void *arg, size_t arglen)
 {
@@ -551,7 +1071,14 @@ int rpmcliArgIter(rpmts ts, QVA_t qva, ARGV_const_t argv)
 
     switch (qva->qva_source) {
     case RPMQV_ALL: {
-	rpmdbMatchIterator mi = initFilterIterator(ts, argv);
+	rpmdbMatchIterator mi;
+
+	/* Hot-tag-only formats can be answered from the column cache */
+	if ((argv == NULL || *argv == NULL) &&
+		(ec = tagcacheShowAll(qva, ts)) >= 0)
+	    break;
+
+	mi = initFilterIterator(ts, argv);
 	ec = rpmcliShowMatches(qva, ts, mi);
 	rpmdbFreeIterator(mi);
 	break;
@@ -578,8 +1105,14 @@ int rpmcliArgIter(rpmts ts, QVA_t qva, ARGV_const_t argv)
     default:
 	for (ARGV_const_t arg = argv; arg && *arg; arg++) {
 	    int ecLocal;
-	    rpmdbMatchIterator mi = initQueryIterator(qva, ts, *arg);
-	    ecLocal = rpmcliShowMatches(qva, ts, mi);
+	    rpmdbMatchIterator mi = NULL;
+
+	    /* Indexed dependency queries with a hot-tag-only format are
+	       answered from the column cache, no header loads at all */
+	    if ((ecLocal = tagcacheShowDeps(qva, ts, *arg)) < 0) {
+		mi = initQueryIterator(qva, ts, *arg);
+		ecLocal = rpmcliShowMatches(qva, ts, mi);
+	    }
 	    if (mi == NULL && qva->qva_source == RPMQV_PACKAGE) {
 		if (rpmFileHasSuffix(*arg, ".rpm")) {
 		    char * const argFirst[2] = { arg[0], NULL };
@@ -621,6 +1154,7 @@ int rpmcliQuery(rpmts ts, QVA_t qva, char * const * argv)
 
     ovsflags = rpmtsSetVSFlags(ts, vsflags);
     ec = rpmcliArgIter(ts, qva, argv);
+    qfmtFlush();
     rpmtsSetVSFlags(ts, ovsflags);
 
     if (qva->qva_showPackage == showQueryPackage)
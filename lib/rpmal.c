@@ -4,6 +4,7 @@
 
 #include "system.h"
 
+#include <pthread.h>
 
 #include <rpm/rpmte.h>
 #include <rpm/rpmfi.h>
@@ -46,7 +47,16 @@ typedef struct availableIndexEntry_s {
 #define HTKEYTYPE rpmsid
 #define HTDATATYPE struct availableIndexEntry_s
 #include "lib/rpmhash.H"
-#include "lib/rpmhash.C"
+#include "lib/rpmohash.C"
+
+#undef HASHTYPE
+#undef HTKEYTYPE
+#undef HTDATATYPE
+#define HASHTYPE rpmalMissHash
+#define HTKEYTYPE rpmsid
+#define HTDATATYPE int
+#include "lib/rpmhash.H"
+#include "lib/rpmohash.C"
 
 typedef struct availableIndexFileEntry_s {
     rpmsid dirName;
@@ -61,7 +71,7 @@ typedef struct availableIndexFileEntry_s {
 #define HTKEYTYPE rpmsid
 #define HTDATATYPE struct availableIndexFileEntry_s
 #include "lib/rpmhash.H"
-#include "lib/rpmhash.C"
+#include "lib/rpmohash.C"
 
 /** \ingroup rpmdep
  * Set of available packages, items, and directories.
@@ -72,6 +82,7 @@ struct rpmal_s {
     rpmalDepHash providesHash;
     rpmalDepHash obsoletesHash;
     rpmalFileHash fileHash;
+    rpmalMissHash missHash;	/*!< Cached negative lookup results. */
     int delta;			/*!< Delta for pkg list reallocation. */
     int size;			/*!< No. of pkgs in list. */
     int alloced;		/*!< No. of pkgs allocated for list. */
@@ -79,6 +90,8 @@ struct rpmal_s {
     rpm_color_t tscolor;	/*!< Transaction color. */
     rpm_color_t prefcolor;	/*!< Transaction preferred color. */
     fingerPrintCache fpc;
+    pthread_mutex_t fplock;	/*!< Serializes fingerprint cache access */
+    pthread_mutex_t misslock;	/*!< Serializes negative-result cache access */
 };
 
 /**
@@ -90,6 +103,7 @@ static void rpmalFreeIndex(rpmal al)
     al->providesHash = rpmalDepHashFree(al->providesHash);
     al->obsoletesHash = rpmalDepHashFree(al->obsoletesHash);
     al->fileHash = rpmalFileHashFree(al->fileHash);
+    al->missHash = rpmalMissHashFree(al->missHash);
     al->fpc = fpCacheFree(al->fpc);
 }
 
@@ -106,9 +120,12 @@ rpmal rpmalCreate(rpmts ts, int delta)
     al->providesHash = NULL;
     al->obsoletesHash = NULL;
     al->fileHash = NULL;
+    al->missHash = NULL;
     al->tsflags = rpmtsFlags(ts);
     al->tscolor = rpmtsColor(ts);
     al->prefcolor = rpmtsPrefColor(ts);
+    pthread_mutex_init(&al->fplock, NULL);
+    pthread_mutex_init(&al->misslock, NULL);
 
     return al;
 }
@@ -132,6 +149,8 @@ rpmal rpmalFree(rpmal al)
     al->alloced = 0;
 
     rpmalFreeIndex(al);
+    pthread_mutex_destroy(&al->fplock);
+    pthread_mutex_destroy(&al->misslock);
     al = _free(al);
     return NULL;
 }
@@ -146,6 +165,54 @@ static int sidCmp(rpmsid a, rpmsid b)
     return (a != b);
 }
 
+/**
+ * Remember (or forget) that nothing in the set provides a name.
+ * Cached misses let depsolver retries skip lookups that cannot succeed,
+ * the flag is flipped in place as entries can't be removed from the hash.
+ * @param al		available list
+ * @param nameId	dependency name id
+ * @param miss		1 to record a miss, 0 to invalidate a recorded one
+ */
+static void rpmalMissCacheSet(rpmal al, rpmsid nameId, int miss)
+{
+    int *flags = NULL;
+    int nflags = 0;
+
+    pthread_mutex_lock(&al->misslock);
+    if (al->missHash == NULL) {
+	if (!miss)
+	    goto exit;
+	al->missHash = rpmalMissHashCreate(128, sidHash, sidCmp, NULL, NULL);
+    }
+
+    if (rpmalMissHashGetEntry(al->missHash, nameId, &flags, &nflags, NULL))
+	flags[0] = miss;
+    else if (miss)
+	rpmalMissHashAddEntry(al->missHash, nameId, miss);
+exit:
+    pthread_mutex_unlock(&al->misslock);
+}
+
+/**
+ * Is a name known to have no provider in the set?
+ * @param al		available list
+ * @param nameId	dependency name id
+ * @return		1 if a miss is cached for the name, 0 otherwise
+ */
+static int rpmalMissCacheGet(rpmal al, rpmsid nameId)
+{
+    int *flags = NULL;
+    int nflags = 0;
+    int miss = 0;
+
+    pthread_mutex_lock(&al->misslock);
+    if (al->missHash != NULL &&
+	rpmalMissHashGetEntry(al->missHash, nameId, &flags, &nflags, NULL))
+	miss = flags[0];
+    pthread_mutex_unlock(&al->misslock);
+    return miss;
+}
+
 void rpmalDel(rpmal al, rpmte p)
 {
     availablePackage alp;
@@ -219,6 +286,8 @@ static void rpmalAddProvides(rpmal al, rpmalNum pkgNum, rpmds provides)
 	indexEntry.entryIx = i;;
 	rpmalDepHashAddEntry(al->providesHash,
 				  rpmdsNIdIndex(provides, i), indexEntry);
+	/* This name has a provider now, forget any cached miss */
+	rpmalMissCacheSet(al, rpmdsNIdIndex(provides, i), 0);
     }
 }
 
@@ -263,15 +332,18 @@ void rpmalAdd(rpmal al, rpmte p)
 
     alp->provides = rpmdsLink(rpmteDS(p, RPMTAG_PROVIDENAME));
     alp->obsoletes = rpmdsLink(rpmteDS(p, RPMTAG_OBSOLETENAME));
-    alp->fi = rpmteFiles(p);
+    /* File lists are materialized lazily, don't grab them before needed */
+    alp->fi = NULL;
 
     /* Try to be lazy as delayed hash creation is cheaper */
     if (al->providesHash != NULL)
 	rpmalAddProvides(al, pkgNum, alp->provides);
     if (al->obsoletesHash != NULL)
 	rpmalAddObsoletes(al, pkgNum, alp->obsoletes);
-    if (al->fileHash != NULL)
+    if (al->fileHash != NULL) {
+	alp->fi = rpmteFiles(p);
 	rpmalAddFiles(al, pkgNum, alp->fi);
+    }
 }
 
 static void rpmalMakeFileIndex(rpmal al)
@@ -281,11 +353,13 @@ static void rpmalMakeFileIndex(rpmal al)
 
     for (i = 0; i < al->size; i++) {
 	alp = al->list + i;
+	if (alp->fi == NULL)
+	    alp->fi = rpmteFiles(alp->p);
 	if (alp->fi != NULL)
 	    fileCnt += rpmfilesFC(alp->fi);
     }
-    al->fileHash = rpmalFileHashCreate(fileCnt/4+128,
-				       sidHash, sidCmp, NULL, NULL);
+    al->fileHash = rpmalFileHashCreate(128, sidHash, sidCmp, NULL, NULL);
+    rpmalFileHashReserve(al->fileHash, fileCnt);
     for (i = 0; i < al->size; i++) {
 	alp = al->list + i;
 	rpmalAddFiles(al, i, alp->fi);
@@ -302,8 +376,8 @@ static void rpmalMakeProvidesIndex(rpmal al)
 	providesCnt += rpmdsCount(alp->provides);
     }
 
-    al->providesHash = rpmalDepHashCreate(providesCnt/4+128,
-					       sidHash, sidCmp, NULL, NULL);
+    al->providesHash = rpmalDepHashCreate(128, sidHash, sidCmp, NULL, NULL);
+    rpmalDepHashReserve(al->providesHash, providesCnt);
     for (i = 0; i < al->size; i++) {
 	alp = al->list + i;
 	rpmalAddProvides(al, i, alp->provides);
@@ -320,14 +394,71 @@ static void rpmalMakeObsoletesIndex(rpmal al)
 	obsoletesCnt += rpmdsCount(alp->obsoletes);
     }
 
-    al->obsoletesHash = rpmalDepHashCreate(obsoletesCnt/4+128,
-					       sidHash, sidCmp, NULL, NULL);
+    al->obsoletesHash = rpmalDepHashCreate(128, sidHash, sidCmp, NULL, NULL);
+    rpmalDepHashReserve(al->obsoletesHash, obsoletesCnt);
     for (i = 0; i < al->size; i++) {
 	alp = al->list + i;
 	rpmalAddObsoletes(al, i, alp->obsoletes);
     }
 }
 
+static void * makeFileIndexThread(void *al)
+{
+    rpmalMakeFileIndex(al);
+    return NULL;
+}
+
+static void * makeObsoletesIndexThread(void *al)
+{
+    rpmalMakeObsoletesIndex(al);
+    return NULL;
+}
+
+void rpmalMakeIndex(rpmal al)
+{
+    pthread_t fthread, othread;
+    int hasf = 0, haso = 0;
+
+    if (al == NULL)
+	return;
+
+    /* The indexes are independent, build the two big ones concurrently */
+    if (al->fileHash == NULL)
+	hasf = (pthread_create(&fthread, NULL, makeFileIndexThread, al) == 0);
+    if (al->obsoletesHash == NULL)
+	haso = (pthread_create(&othread, NULL,
+			       makeObsoletesIndexThread, al) == 0);
+
+    if (al->providesHash == NULL)
+	rpmalMakeProvidesIndex(al);
+    if (al->fpc == NULL)
+	al->fpc = fpCacheCreate(1001, al->pool);
+
+    if (hasf)
+	pthread_join(fthread, NULL);
+    else if (al->fileHash == NULL)
+	rpmalMakeFileIndex(al);
+    if (haso)
+	pthread_join(othread, NULL);
+    else if (al->obsoletesHash == NULL)
+	rpmalMakeObsoletesIndex(al);
+
+    /*
+     * Parse the EVR caches of every set the lockless lookups compare
+     * against while still single threaded: rpmdsCompareIndex() fills
+     * them lazily with unsynchronized writes, which concurrent callers
+     * of rpmalSatisfiesDepend() and friends must never trigger.
+     */
+    for (int i = 0; i < al->size; i++) {
+	availablePackage alp = al->list + i;
+	if (alp->p == NULL) /* deleted */
+	    continue;
+	rpmdsPrimeVerCache(alp->provides);
+	rpmdsPrimeVerCache(alp->obsoletes);
+	rpmdsPrimeVerCache(rpmteDS(alp->p, RPMTAG_NAME));
+    }
+}
+
 rpmte * rpmalAllObsoletes(rpmal al, rpmds ds)
 {
     rpmte * ret = NULL;
@@ -411,12 +542,18 @@ static rpmte * rpmalAllFileSatisfiesDepend(const rpmal al, const char *fileName,
 		if (filterds && rpmteDS(alp->p, rpmdsTagN(filterds)) == filterds)
 		    continue;
 		if (result[i].dirName != dirName) {
-		    /* if the directory is different check the fingerprints */
+		    int fpeq;
+		    /* if the directory is different check the fingerprints,
+		       the lookups modify the shared cache */
+		    pthread_mutex_lock(&al->fplock);
 		    if (!al->fpc)
 			al->fpc = fpCacheCreate(1001, al->pool);
 		    if (!fp)
 			fpLookupId(al->fpc, dirName, baseName, &fp);
-		    if (!fpLookupEqualsId(al->fpc, fp, result[i].dirName, baseName))
+		    fpeq = fpLookupEqualsId(al->fpc, fp,
+					    result[i].dirName, baseName);
+		    pthread_mutex_unlock(&al->fplock);
+		    if (!fpeq)
 			continue;
 		}
 		ret[found] = alp->p;
@@ -453,6 +590,15 @@ rpmte * rpmalAllSatisfiesDepend(const rpmal al, const rpmds ds)
     if (dtag == RPMTAG_OBSOLETENAME || dtag == RPMTAG_CONFLICTNAME)
 	filterds = ds;
     name = rpmstrPoolStr(al->pool, nameId);
+
+    /*
+     * Cached misses are only valid for plain provide lookups: file
+     * dependencies may be satisfied behind rpmalAddProvides()'s back and
+     * filtered lookups depend on who is asking, so neither is cached.
+     */
+    if (filterds == NULL && *name != '/' && rpmalMissCacheGet(al, nameId))
+	return NULL;
+
     if (!obsolete && *name == '/') {
 	/* First, look for files "contained" in package ... */
 	ret = rpmalAllFileSatisfiesDepend(al, name, filterds);
@@ -470,7 +616,12 @@ rpmte * rpmalAllSatisfiesDepend(const rpmal al, const rpmds ds)
     rpmalDepHashGetEntry(al->providesHash, nameId, &result,
 			      &resultCnt, NULL);
 
-    if (resultCnt==0) return NULL;
+    if (resultCnt==0) {
+	/* Nothing here even has the name, remember that for the retries */
+	if (filterds == NULL && *name != '/')
+	    rpmalMissCacheSet(al, nameId, 1);
+	return NULL;
+    }
 
     ret = xmalloc((resultCnt+1) * sizeof(*ret));
 
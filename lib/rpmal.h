@@ -48,6 +48,17 @@ void rpmalDel(rpmal al, rpmte p);
 RPM_GNUC_INTERNAL
 void rpmalAdd(rpmal al, rpmte p);
 
+/**
+ * Eagerly build the lookup indexes of the available list, using a
+ * thread per independent index. Normally the indexes are created
+ * lazily on first lookup; concurrent callers of the lookup functions
+ * must call this first (after the last rpmalAdd()) so the hashes are
+ * immutable while shared between threads.
+ * @param al		available list
+ */
+RPM_GNUC_INTERNAL
+void rpmalMakeIndex(rpmal al);
+
 /**
  * Lookup all obsoleters for a dependency in the available list
  * @param al		available list
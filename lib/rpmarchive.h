@@ -74,6 +74,19 @@ char * rpmfileStrerror(int rc);
  */
 rpmfi rpmfiNewArchiveWriter(FD_t fd, rpmfiles files);
 
+/** \ingroup payload
+ * Set the order in which an archive writer emits the files.
+ * By default files are written in file info set order. Must be called
+ * before the first rpmfiNext() on the iterator. Hard link sets are
+ * always emitted in one go, at the position of their first member.
+ * Readers locate files by name so any permutation produces a valid
+ * archive.
+ * @param fi		file info iterator from rpmfiNewArchiveWriter()
+ * @param order		permutation of all file indexes of the set
+ * @return		0 on success
+ */
+int rpmfiArchiveSetWriteOrder(rpmfi fi, const int * order);
+
 /** \ingroup payload
  * Get new file iterator for looping over the archive content.
  * Returned rpmfi visites files in the order they are read from the payload.
@@ -41,6 +41,8 @@ typedef enum rpmCallbackType_e {
     RPMCALLBACK_VERIFY_PROGRESS	= (1 << 20),
     RPMCALLBACK_VERIFY_START	= (1 << 21),
     RPMCALLBACK_VERIFY_STOP	= (1 << 22),
+    RPMCALLBACK_PREDICT_PROGRESS = (1 << 23), /* elapsed/predicted total (ms),
+						 only with %_txnrate_path */
 } rpmCallbackType;
 
 /** \ingroup rpmts
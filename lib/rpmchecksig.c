@@ -6,6 +6,10 @@
 #include "system.h"
 
 #include <ctype.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
 
 #include <rpm/rpmlib.h>			/* RPMSIGTAG & related */
 #include <rpm/rpmpgp.h>
@@ -24,7 +28,24 @@
 
 #include "debug.h"
 
-static int doImport(rpmts ts, const char *fn, char *buf, ssize_t blen)
+struct importCert_s {
+    uint8_t *pkt;		/* raw certificate packet */
+    size_t pktlen;
+    char *fn;			/* owning file, for diagnostics */
+    int keyno;			/* key number within fn */
+    rpmPubkey key;		/* parsed form, filled by the workers */
+};
+
+struct importJob_s {
+    struct importCert_s *certs;
+    int ncerts;
+    int alloced;
+    int next;			/* next unclaimed cert, under lock */
+    pthread_mutex_t lock;
+};
+
+static int collectCerts(struct importJob_s *job, const char *fn,
+			char *buf, ssize_t blen)
 {
     char const * const pgpmark = "-----BEGIN PGP ";
     size_t marklen = strlen(pgpmark);
@@ -37,13 +58,15 @@ static int doImport(rpmts ts, const char *fn, char *buf, ssize_t blen)
 	uint8_t *pkti = NULL;
 	size_t pktlen = 0;
 	size_t certlen;
-	
+
 	/* Read pgp packet. */
 	if (pgpParsePkts(start, &pkt, &pktlen) == PGPARMOR_PUBKEY) {
 	    pkti = pkt;
 
 	    /* Iterate over certificates in pkt */
 	    while (pktlen > 0) {
+		struct importCert_s *cert;
+
 		if (pgpPubKeyCertLen(pkti, pktlen, &certlen)) {
 		    rpmlog(RPMLOG_ERR, _("%s: key %d import failed.\n"), fn,
 			    keyno);
@@ -51,12 +74,19 @@ static int doImport(rpmts ts, const char *fn, char *buf, ssize_t blen)
 		    break;
 		}
 
-		/* Import pubkey certificate. */
-		if (rpmtsImportPubkey(ts, pkti, certlen) != RPMRC_OK) {
-		    rpmlog(RPMLOG_ERR, _("%s: key %d import failed.\n"), fn,
-			    keyno);
-		    res++;
+		/* Stash pubkey certificate for the import batch. */
+		if (job->ncerts == job->alloced) {
+		    job->alloced = job->alloced ? job->alloced * 2 : 16;
+		    job->certs = xrealloc(job->certs,
+				    job->alloced * sizeof(*job->certs));
 		}
+		cert = &job->certs[job->ncerts++];
+		cert->pkt = memcpy(xmalloc(certlen), pkti, certlen);
+		cert->pktlen = certlen;
+		cert->fn = xstrdup(fn);
+		cert->keyno = keyno;
+		cert->key = NULL;
+
 		pkti += certlen;
 		pktlen -= certlen;
 	    }
@@ -65,7 +95,7 @@ static int doImport(rpmts ts, const char *fn, char *buf, ssize_t blen)
 		   fn, keyno);
 	    res++;
 	}
-	
+
 	/* See if there are more keys in the buffer */
 	if (start && start + marklen < buf + blen) {
 	    start = strstr(start + marklen, pgpmark);
@@ -80,9 +110,31 @@ static int doImport(rpmts ts, const char *fn, char *buf, ssize_t blen)
     return res;
 }
 
+static void *importWorker(void *data)
+{
+    struct importJob_s *job = data;
+
+    pthread_mutex_lock(&job->lock);
+    while (job->next < job->ncerts) {
+	struct importCert_s *cert = &job->certs[job->next++];
+
+	pthread_mutex_unlock(&job->lock);
+	cert->key = rpmPubkeyNew(cert->pkt, cert->pktlen);
+	pthread_mutex_lock(&job->lock);
+    }
+    pthread_mutex_unlock(&job->lock);
+    return NULL;
+}
+
 int rpmcliImportPubkeys(rpmts ts, ARGV_const_t argv)
 {
     int res = 0;
+    struct importJob_s job;
+    int nthreads = rpmExpandNumeric("%{?_import_threads}");
+
+    memset(&job, 0, sizeof(job));
+
+    /* Read all files and collect the certificates they contain */
     for (ARGV_const_t arg = argv; arg && *arg; arg++) {
 	const char *fn = *arg;
 	uint8_t *buf = NULL;
@@ -103,18 +155,68 @@ int rpmcliImportPubkeys(rpmts ts, ARGV_const_t argv)
 	    }
 	}
 
-	/* Read the file and try to import all contained keys */
 	iorc = rpmioSlurp(fn, &buf, &blen);
 	if (iorc || buf == NULL || blen < 64) {
 	    rpmlog(RPMLOG_ERR, _("%s: import read failed(%d).\n"), fn, iorc);
 	    res++;
 	} else {
-	    res += doImport(ts, fn, (char *)buf, blen);
+	    res += collectCerts(&job, fn, (char *)buf, blen);
 	}
-	
+
 	free(t);
 	free(buf);
     }
+
+    /* Parse and validate the certificates, possibly in parallel */
+    if (nthreads > job.ncerts)
+	nthreads = job.ncerts;
+    if (nthreads > 1) {
+	pthread_t *tids = xcalloc(nthreads, sizeof(*tids));
+
+	pthread_mutex_init(&job.lock, NULL);
+	for (int i = 0; i < nthreads; i++)
+	    pthread_create(&tids[i], NULL, importWorker, &job);
+	for (int i = 0; i < nthreads; i++)
+	    pthread_join(tids[i], NULL);
+	pthread_mutex_destroy(&job.lock);
+	free(tids);
+    } else {
+	for (int i = 0; i < job.ncerts; i++)
+	    job.certs[i].key = rpmPubkeyNew(job.certs[i].pkt,
+					    job.certs[i].pktlen);
+    }
+
+    /* Import everything that parsed in one keyring/database update */
+    if (job.ncerts > 0) {
+	rpmPubkey *keys = xcalloc(job.ncerts, sizeof(*keys));
+	int nkeys = 0;
+
+	for (int i = 0; i < job.ncerts; i++) {
+	    struct importCert_s *cert = &job.certs[i];
+
+	    if (cert->key != NULL) {
+		keys[nkeys++] = cert->key;
+	    } else {
+		rpmlog(RPMLOG_ERR, _("%s: key %d import failed.\n"),
+			cert->fn, cert->keyno);
+		res++;
+	    }
+	}
+
+	if (nkeys > 0 && rpmtsImportPubkeys(ts, keys, nkeys) != RPMRC_OK) {
+	    rpmlog(RPMLOG_ERR, _("key import failed.\n"));
+	    res++;
+	}
+	free(keys);
+    }
+
+    for (int i = 0; i < job.ncerts; i++) {
+	rpmPubkeyFree(job.certs[i].key);
+	free(job.certs[i].pkt);
+	free(job.certs[i].fn);
+    }
+    free(job.certs);
+
     return res;
 }
 
@@ -132,6 +234,7 @@ static int readFile(FD_t fd, char **msg)
 }
 
 struct vfydata_s {
+    char *buf;
     int seen;
     int bad;
     int verbose;
@@ -145,21 +248,364 @@ static int vfyCb(struct rpmsinfo_s *sinfo, void *cbdata)
 	vd->bad |= sinfo->type;
     if (vd->verbose) {
 	char *vsmsg = rpmsinfoMsg(sinfo);
-	rpmlog(RPMLOG_NOTICE, "    %s\n", vsmsg);
+	rstrscat(&vd->buf, "    ", vsmsg, "\n", NULL);
 	free(vsmsg);
     }
     return 1;
 }
 
-rpmRC rpmpkgRead(struct rpmvs_s *vs, FD_t fd,
+/* Initialize a header blob directly from a mapped package, mirroring
+ * the bounds handling of hdrblobRead() against the mapping. */
+static rpmRC mapBlobInit(unsigned char *buf, size_t avail,
+			 rpmTagVal regionTag, int exact_size,
+			 hdrblob blob, char **emsg)
+{
+    uint32_t il, dl;
+    uint64_t nb;
+    rpmRC rc = RPMRC_FAIL;
+
+    if (avail < sizeof(rpm_header_magic) + 2 * sizeof(uint32_t)) {
+	rasprintf(emsg, _("hdr size(%zu): BAD, file too small"), avail);
+	goto exit;
+    }
+    if (memcmp(buf, rpm_header_magic, sizeof(rpm_header_magic))) {
+	rasprintf(emsg, _("hdr magic: BAD"));
+	goto exit;
+    }
+    memcpy(&il, buf + sizeof(rpm_header_magic), sizeof(il));
+    memcpy(&dl, buf + sizeof(rpm_header_magic) + sizeof(il), sizeof(dl));
+    nb = 2 * sizeof(uint32_t) +
+	 (uint64_t)ntohl(il) * sizeof(struct entryInfo_s) + ntohl(dl);
+    if (nb > avail - sizeof(rpm_header_magic)) {
+	rasprintf(emsg, _("hdr blob(%llu): BAD, file too small"),
+		  (unsigned long long)nb);
+	goto exit;
+    }
+
+    /* hdrblobInit() does all further validation against the mapping */
+    rc = hdrblobInit(buf + sizeof(rpm_header_magic), nb, regionTag, exact_size,
+		     blob, emsg);
+
+exit:
+    if (rc != RPMRC_OK && emsg && *emsg && regionTag == RPMTAG_HEADERSIGNATURES) {
+	/* rstrscat() cannot handle overlap even if it claims so */
+	char *tmp = rstrscat(NULL, _("signature "), *emsg, NULL);
+	free(*emsg);
+	*emsg = tmp;
+    }
+    return rc;
+}
+
+/*
+ * Mapped variant of rpmpkgRead() for plain local files: the package is
+ * mapped once, the lead, signature header and main header are validated
+ * directly in the mapping and the payload is digested straight from it,
+ * saving the small sequential reads and, for verify-only callers, the
+ * blob copies of the streaming reader. The descriptor is repositioned to
+ * wherever the streaming reader would have left it, so the payload can
+ * be consumed without re-seeking.
+ */
+static rpmRC rpmpkgReadMapped(struct rpmvs_s *vs, FD_t fd,
+		unsigned char *mapped, size_t msize, size_t pos,
 		hdrblob *sigblobp, hdrblob *blobp, char **emsg)
 {
+    char * msg = NULL;
+    rpmRC xx, rc = RPMRC_FAIL; /* assume failure */
+    struct hdrblob_s sigblob, blob;	/* point into the mapping */
+    rpmDigestBundle bundle = fdGetBundle(fd, 1); /* freed with fd */
+    size_t sigsize, hdrsize, pad;
+
+    if ((xx = rpmLeadCheckMem(mapped + pos, msize - pos, &msg)) != RPMRC_OK) {
+	/* Avoid message spew on manifests */
+	if (xx == RPMRC_NOTFOUND)
+	    msg = _free(msg);
+	rc = xx;
+	pos = (msize - pos < RPMLEAD_SIZE) ? msize : pos + RPMLEAD_SIZE;
+	goto exit;
+    }
+    pos += RPMLEAD_SIZE;
+
+    /* Validate the signature header, skip the alignment padding after it */
+    if (mapBlobInit(mapped + pos, msize - pos, RPMTAG_HEADERSIGNATURES, 0,
+		    &sigblob, &msg))
+	goto exit;
+    sigsize = sizeof(rpm_header_magic) + sigblob.pvlen;
+    pad = (8 - (sigsize % 8)) % 8;
+    if (pad > msize - (pos + sigsize)) {
+	rasprintf(&msg, _("signature pad(%zu): BAD, file too small"), pad);
+	goto exit;
+    }
+    pos += sigsize + pad;
+
+    rpmvsInit(vs, &sigblob, bundle);
+
+    /* Initialize digests ranging over the header */
+    rpmvsInitRange(vs, RPMSIG_HEADER);
+
+    /* Validate the main header and digest it from the mapping */
+    if (mapBlobInit(mapped + pos, msize - pos, RPMTAG_HEADERIMMUTABLE, 1,
+		    &blob, &msg))
+	goto exit;
+    hdrsize = sizeof(rpm_header_magic) + blob.pvlen;
+    rpmDigestBundleUpdate(bundle, mapped + pos, hdrsize);
+    pos += hdrsize;
+
+    /* Finalize header range */
+    rpmvsFiniRange(vs, RPMSIG_HEADER);
+
+    /* Fish interesting tags from the main header. This is a bit hacky... */
+    rpmvsAppendTag(vs, &blob, RPMTAG_PAYLOADDIGEST);
+    rpmvsAppendTag(vs, &blob, RPMTAG_PAYLOADDIGESTALT);
+
+    /* If needed and not explicitly disabled, digest the payload as well. */
+    if (rpmvsRange(vs) & RPMSIG_PAYLOAD) {
+	/* Initialize digests ranging over the payload only */
+	rpmvsInitRange(vs, RPMSIG_PAYLOAD);
 
+	rpmDigestBundleUpdate(bundle, mapped + pos, msize - pos);
+
+	/* Finalize payload range */
+	rpmvsFiniRange(vs, RPMSIG_PAYLOAD);
+	rpmvsFiniRange(vs, RPMSIG_HEADER|RPMSIG_PAYLOAD);
+	pos = msize;
+    }
+
+    /* Callers keeping the blobs get copies detached from the mapping */
+    if (sigblobp && blobp) {
+	hdrblob sigcopy = hdrblobCreate();
+	hdrblob copy = hdrblobCreate();
+	void *ei = memcpy(xmalloc(sigblob.pvlen), sigblob.ei, sigblob.pvlen);
+
+	xx = hdrblobInit(ei, sigblob.pvlen, RPMTAG_HEADERSIGNATURES, 0,
+			 sigcopy, &msg);
+	if (xx == RPMRC_OK) {
+	    ei = memcpy(xmalloc(blob.pvlen), blob.ei, blob.pvlen);
+	    xx = hdrblobInit(ei, blob.pvlen, RPMTAG_HEADERIMMUTABLE, 1,
+			     copy, &msg);
+	}
+	if (xx != RPMRC_OK) {
+	    hdrblobFree(sigcopy);
+	    hdrblobFree(copy);
+	    goto exit;
+	}
+	*sigblobp = sigcopy;
+	*blobp = copy;
+    }
+    rc = RPMRC_OK;
+
+exit:
+    /* Leave the descriptor where the streaming reader would */
+    if (lseek(Fileno(fd), (off_t)pos, SEEK_SET) == (off_t)-1 && rc == RPMRC_OK) {
+	rasprintf(&msg, _("lseek failed: %s (%d)"), strerror(errno), errno);
+	rc = RPMRC_FAIL;
+    }
+    if (emsg)
+	*emsg = msg;
+    else
+	free(msg);
+    return rc;
+}
+
+/* How much to read up front at package open: one read covers the lead
+ * and both headers of all but the most file-laden packages. */
+#define PKGREAD_BUF (64 * 1024)
+
+/*
+ * Buffered variant of rpmpkgRead() for seekable files that could not
+ * be mapped: parse lead + signature header + main header from one
+ * large read, mirroring the mapped path. When the headers don't fit
+ * the buffer of a larger file, *incomplete is set and the caller
+ * falls back to the streaming reader (the descriptor is then expected
+ * to be repositioned by the caller); otherwise the descriptor is left
+ * where the streaming reader would have left it.
+ */
+static rpmRC rpmpkgReadBuffered(struct rpmvs_s *vs, FD_t fd,
+		unsigned char *buf, size_t blen, int eof, off_t off,
+		int *incomplete, hdrblob *sigblobp, hdrblob *blobp,
+		char **emsg)
+{
     char * msg = NULL;
     rpmRC xx, rc = RPMRC_FAIL; /* assume failure */
-    hdrblob sigblob = hdrblobCreate();
-    hdrblob blob = hdrblobCreate();
+    struct hdrblob_s sigblob, blob;	/* point into the buffer */
     rpmDigestBundle bundle = fdGetBundle(fd, 1); /* freed with fd */
+    size_t pos = 0, sigsize, hdrsize, hdrpos, pad;
+    int streamed = 0;
+
+    *incomplete = 0;
+
+    if ((xx = rpmLeadCheckMem(buf, blen, &msg)) != RPMRC_OK) {
+	/* Avoid message spew on manifests */
+	if (xx == RPMRC_NOTFOUND)
+	    msg = _free(msg);
+	rc = xx;
+	pos = (blen < RPMLEAD_SIZE) ? blen : RPMLEAD_SIZE;
+	goto exit;
+    }
+    pos = RPMLEAD_SIZE;
+
+    /* Validate the signature header, skip the alignment padding after it */
+    if (mapBlobInit(buf + pos, blen - pos, RPMTAG_HEADERSIGNATURES, 0,
+		    &sigblob, &msg)) {
+	if (!eof)
+	    *incomplete = 1;
+	goto exit;
+    }
+    sigsize = sizeof(rpm_header_magic) + sigblob.pvlen;
+    pad = (8 - (sigsize % 8)) % 8;
+    if (pad > blen - (pos + sigsize)) {
+	if (!eof)
+	    *incomplete = 1;
+	else
+	    rasprintf(&msg, _("signature pad(%zu): BAD, file too small"), pad);
+	goto exit;
+    }
+    pos += sigsize + pad;
+
+    /* Validate the main header before touching verification state so
+     * that an incomplete buffer can still fall back cleanly */
+    if (mapBlobInit(buf + pos, blen - pos, RPMTAG_HEADERIMMUTABLE, 1,
+		    &blob, &msg)) {
+	if (!eof)
+	    *incomplete = 1;
+	goto exit;
+    }
+    hdrpos = pos;
+    hdrsize = sizeof(rpm_header_magic) + blob.pvlen;
+    pos += hdrsize;
+
+    rpmvsInit(vs, &sigblob, bundle);
+
+    /* Initialize digests ranging over the header, digest from the buffer */
+    rpmvsInitRange(vs, RPMSIG_HEADER);
+    rpmDigestBundleUpdate(bundle, buf + hdrpos, hdrsize);
+    rpmvsFiniRange(vs, RPMSIG_HEADER);
+
+    /* Fish interesting tags from the main header. This is a bit hacky... */
+    rpmvsAppendTag(vs, &blob, RPMTAG_PAYLOADDIGEST);
+    rpmvsAppendTag(vs, &blob, RPMTAG_PAYLOADDIGESTALT);
+
+    /* If needed and not explicitly disabled, digest the payload as well:
+     * the buffered part explicitly, the rest through the descriptor. */
+    if (rpmvsRange(vs) & RPMSIG_PAYLOAD) {
+	/* Initialize digests ranging over the payload only */
+	rpmvsInitRange(vs, RPMSIG_PAYLOAD);
+
+	rpmDigestBundleUpdate(bundle, buf + pos, blen - pos);
+	streamed = 1;
+	if (!eof && readFile(fd, &msg))
+	    goto exit;
+
+	/* Finalize payload range */
+	rpmvsFiniRange(vs, RPMSIG_PAYLOAD);
+	rpmvsFiniRange(vs, RPMSIG_HEADER|RPMSIG_PAYLOAD);
+    }
+
+    /* Callers keeping the blobs get copies detached from the buffer */
+    if (sigblobp && blobp) {
+	hdrblob sigcopy = hdrblobCreate();
+	hdrblob copy = hdrblobCreate();
+	void *ei = memcpy(xmalloc(sigblob.pvlen), sigblob.ei, sigblob.pvlen);
+
+	xx = hdrblobInit(ei, sigblob.pvlen, RPMTAG_HEADERSIGNATURES, 0,
+			 sigcopy, &msg);
+	if (xx == RPMRC_OK) {
+	    ei = memcpy(xmalloc(blob.pvlen), blob.ei, blob.pvlen);
+	    xx = hdrblobInit(ei, blob.pvlen, RPMTAG_HEADERIMMUTABLE, 1,
+			     copy, &msg);
+	}
+	if (xx != RPMRC_OK) {
+	    hdrblobFree(sigcopy);
+	    hdrblobFree(copy);
+	    goto exit;
+	}
+	*sigblobp = sigcopy;
+	*blobp = copy;
+    }
+    rc = RPMRC_OK;
+
+exit:
+    /* Leave the descriptor where the streaming reader would */
+    if (!*incomplete && !streamed &&
+	lseek(Fileno(fd), off + (off_t)pos, SEEK_SET) == (off_t)-1 &&
+	rc == RPMRC_OK)
+    {
+	rasprintf(&msg, _("lseek failed: %s (%d)"), strerror(errno), errno);
+	rc = RPMRC_FAIL;
+    }
+    if (*incomplete) {
+	msg = _free(msg);
+    } else if (emsg) {
+	*emsg = msg;
+	msg = NULL;
+    }
+    free(msg);
+    return rc;
+}
+
+rpmRC rpmpkgRead(struct rpmvs_s *vs, FD_t fd,
+		hdrblob *sigblobp, hdrblob *blobp, char **emsg)
+{
+
+    char * msg = NULL;
+    rpmRC xx, rc = RPMRC_FAIL; /* assume failure */
+    hdrblob sigblob;
+    hdrblob blob;
+    rpmDigestBundle bundle;
+
+    /* Verify plain local files in place through a single mapping */
+    if (fdPlain(fd)) {
+	struct stat sb;
+	int fdno = Fileno(fd);
+	off_t off = lseek(fdno, 0, SEEK_CUR);
+
+	if (off >= 0 && fstat(fdno, &sb) == 0 && S_ISREG(sb.st_mode) &&
+	    off < sb.st_size && sb.st_size == (off_t)(size_t)sb.st_size)
+	{
+	    unsigned char *mapped = mmap(NULL, sb.st_size, PROT_READ,
+					 MAP_PRIVATE, fdno, 0);
+	    if (mapped != MAP_FAILED) {
+		rc = rpmpkgReadMapped(vs, fd, mapped, sb.st_size, off,
+				      sigblobp, blobp, emsg);
+		munmap(mapped, sb.st_size);
+		return rc;
+	    }
+
+	    /* Could not map: one large read still covers the lead and
+	     * both headers of typical packages in a single syscall */
+	    {
+		unsigned char *buf = xmalloc(PKGREAD_BUF);
+		ssize_t n = 0, r = 0;
+		int incomplete = 0;
+
+		while (n < PKGREAD_BUF &&
+		       (r = read(fdno, buf + n, PKGREAD_BUF - n)) > 0)
+		    n += r;
+
+		if (r >= 0) {
+		    rc = rpmpkgReadBuffered(vs, fd, buf, n, (r == 0), off,
+					    &incomplete, sigblobp, blobp,
+					    emsg);
+		} else {
+		    incomplete = 1;	/* let the streaming reader report */
+		}
+		free(buf);
+		if (!incomplete)
+		    return rc;
+
+		/* Headers exceed the buffer, restart the streaming reader */
+		if (lseek(fdno, off, SEEK_SET) == (off_t)-1) {
+		    if (emsg)
+			rasprintf(emsg, _("lseek failed: %s (%d)"),
+				  strerror(errno), errno);
+		    return RPMRC_FAIL;
+		}
+	    }
+	}
+    }
+
+    sigblob = hdrblobCreate();
+    blob = hdrblobCreate();
+    bundle = fdGetBundle(fd, 1); /* freed with fd */
 
     if ((xx = rpmLeadRead(fd, &msg)) != RPMRC_OK) {
 	/* Avoid message spew on manifests */
@@ -220,18 +666,25 @@ exit:
     return rc;
 }
 
-static int rpmpkgVerifySigs(rpmKeyring keyring, int vfylevel, rpmVSFlags flags,
-			   FD_t fd, const char *fn)
+/*
+ * Verify one package, accumulating the report into *outp (normal output)
+ * and *errp (error output) instead of logging, so callers can verify
+ * several packages concurrently and still emit results in order.
+ */
+static int rpmpkgVerifySigsBuffered(rpmKeyring keyring, int vfylevel,
+				    rpmVSFlags flags, FD_t fd, const char *fn,
+				    char **outp, char **errp)
 {
     char *msg = NULL;
-    struct vfydata_s vd = { .seen = 0,
+    struct vfydata_s vd = { .buf = NULL,
+			    .seen = 0,
 			    .bad = 0,
 			    .verbose = rpmIsVerbose(),
     };
     int rc;
     struct rpmvs_s *vs = rpmvsCreate(vfylevel, flags, keyring);
 
-    rpmlog(RPMLOG_NOTICE, "%s:%s", fn, vd.verbose ? "\n" : "");
+    rstrscat(outp, fn, ":", vd.verbose ? "\n" : "", NULL);
 
     rc = rpmpkgRead(vs, fd, NULL, NULL, &msg);
 
@@ -240,26 +693,47 @@ static int rpmpkgVerifySigs(rpmKeyring keyring, int vfylevel, rpmVSFlags flags,
 
     rc = rpmvsVerify(vs, RPMSIG_VERIFIABLE_TYPE, vfyCb, &vd);
 
+    if (vd.buf) {
+	rstrscat(outp, vd.buf, NULL);
+	vd.buf = _free(vd.buf);
+    }
+
     if (!vd.verbose) {
 	if (vd.seen & RPMSIG_DIGEST_TYPE) {
-	    rpmlog(RPMLOG_NOTICE, " %s", (vd.bad & RPMSIG_DIGEST_TYPE) ?
-					_("DIGESTS") : _("digests"));
+	    rstrscat(outp, " ", (vd.bad & RPMSIG_DIGEST_TYPE) ?
+				_("DIGESTS") : _("digests"), NULL);
 	}
 	if (vd.seen & RPMSIG_SIGNATURE_TYPE) {
-	    rpmlog(RPMLOG_NOTICE, " %s", (vd.bad & RPMSIG_SIGNATURE_TYPE) ?
-					_("SIGNATURES") : _("signatures"));
+	    rstrscat(outp, " ", (vd.bad & RPMSIG_SIGNATURE_TYPE) ?
+				_("SIGNATURES") : _("signatures"), NULL);
 	}
-	rpmlog(RPMLOG_NOTICE, " %s\n", rc ? _("NOT OK") : _("OK"));
+	rstrscat(outp, " ", rc ? _("NOT OK") : _("OK"), "\n", NULL);
     }
 
 exit:
     if (rc && msg)
-	rpmlog(RPMLOG_ERR, "%s: %s\n", Fdescr(fd), msg);
+	rasprintf(errp, "%s: %s\n", Fdescr(fd), msg);
     rpmvsFree(vs);
     free(msg);
     return rc;
 }
 
+static int rpmpkgVerifySigs(rpmKeyring keyring, int vfylevel, rpmVSFlags flags,
+			   FD_t fd, const char *fn)
+{
+    char *out = NULL;
+    char *err = NULL;
+    int rc = rpmpkgVerifySigsBuffered(keyring, vfylevel, flags, fd, fn,
+				      &out, &err);
+    if (out)
+	rpmlog(RPMLOG_NOTICE, "%s", out);
+    if (err)
+	rpmlog(RPMLOG_ERR, "%s", err);
+    free(out);
+    free(err);
+    return rc;
+}
+
 /* Wrapper around rpmkVerifySigs to preserve API */
 int rpmVerifySignatures(QVA_t qva, rpmts ts, FD_t fd, const char * fn)
 {
@@ -274,6 +748,130 @@ int rpmVerifySignatures(QVA_t qva, rpmts ts, FD_t fd, const char * fn)
     return rc;
 }
 
+struct vfyjob_s {
+    const char *fn;
+    char *out;
+    char *err;
+    int rc;
+    int done;
+};
+
+struct vfypool_s {
+    struct vfyjob_s *jobs;
+    int njobs;
+    int next;
+    rpmKeyring keyring;
+    rpmVSFlags vsflags;
+    int vfylevel;
+    pthread_mutex_t lock;
+    pthread_cond_t done_cv;
+};
+
+static void *vfyWorker(void *data)
+{
+    struct vfypool_s *pool = data;
+
+    pthread_mutex_lock(&pool->lock);
+    while (pool->next < pool->njobs) {
+	struct vfyjob_s *job = &pool->jobs[pool->next++];
+	pthread_mutex_unlock(&pool->lock);
+
+	FD_t fd = Fopen(job->fn, "r.ufdio");
+	if (fd == NULL || Ferror(fd)) {
+	    rasprintf(&job->err, _("%s: open failed: %s\n"),
+		      job->fn, Fstrerror(fd));
+	    job->rc = 1;
+	} else {
+	    job->rc = rpmpkgVerifySigsBuffered(pool->keyring, pool->vfylevel,
+					       pool->vsflags, fd, job->fn,
+					       &job->out, &job->err);
+	}
+	Fclose(fd);
+
+	pthread_mutex_lock(&pool->lock);
+	job->done = 1;
+	pthread_cond_broadcast(&pool->done_cv);
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+static int rpmcliVerifySignaturesPool(rpmKeyring keyring, int vfylevel,
+				      rpmVSFlags vsflags, ARGV_const_t argv)
+{
+    int res = 0;
+    struct vfypool_s pool = {
+	.njobs = argvCount(argv),
+	.next = 0,
+	.keyring = keyring,
+	.vsflags = vsflags,
+	.vfylevel = vfylevel,
+    };
+    int nthreads = (rpmcliVerifyJobs < pool.njobs) ?
+			rpmcliVerifyJobs : pool.njobs;
+    pthread_t *threads = xcalloc(nthreads, sizeof(*threads));
+
+    pool.jobs = xcalloc(pool.njobs, sizeof(*pool.jobs));
+    for (int i = 0; i < pool.njobs; i++)
+	pool.jobs[i].fn = argv[i];
+    pthread_mutex_init(&pool.lock, NULL);
+    pthread_cond_init(&pool.done_cv, NULL);
+
+    for (int i = 0; i < nthreads; i++) {
+	if (pthread_create(&threads[i], NULL, vfyWorker, &pool) != 0) {
+	    nthreads = i;
+	    break;
+	}
+    }
+
+    /* Emit results strictly in argument order as they become available */
+    for (int i = 0; i < pool.njobs; i++) {
+	struct vfyjob_s *job = &pool.jobs[i];
+
+	pthread_mutex_lock(&pool.lock);
+	if (nthreads > 0) {
+	    while (!job->done)
+		pthread_cond_wait(&pool.done_cv, &pool.lock);
+	} else if (!job->done) {
+	    /* No workers could be started, verify in-line */
+	    pool.next = i + 1;
+	    pthread_mutex_unlock(&pool.lock);
+	    FD_t fd = Fopen(job->fn, "r.ufdio");
+	    if (fd == NULL || Ferror(fd)) {
+		rasprintf(&job->err, _("%s: open failed: %s\n"),
+			  job->fn, Fstrerror(fd));
+		job->rc = 1;
+	    } else {
+		job->rc = rpmpkgVerifySigsBuffered(keyring, vfylevel, vsflags,
+						   fd, job->fn,
+						   &job->out, &job->err);
+	    }
+	    Fclose(fd);
+	    pthread_mutex_lock(&pool.lock);
+	}
+	pthread_mutex_unlock(&pool.lock);
+
+	if (job->out)
+	    rpmlog(RPMLOG_NOTICE, "%s", job->out);
+	if (job->err)
+	    rpmlog(RPMLOG_ERR, "%s", job->err);
+	if (job->rc)
+	    res++;
+	job->out = _free(job->out);
+	job->err = _free(job->err);
+	rpmsqPoll();
+    }
+
+    for (int i = 0; i < nthreads; i++)
+	pthread_join(threads[i], NULL);
+    pthread_cond_destroy(&pool.done_cv);
+    pthread_mutex_destroy(&pool.lock);
+    free(pool.jobs);
+    free(threads);
+
+    return res;
+}
+
 int rpmcliVerifySignatures(rpmts ts, ARGV_const_t argv)
 {
     const char * arg;
@@ -288,10 +886,16 @@ int rpmcliVerifySignatures(rpmts ts, ARGV_const_t argv)
 	rpmtsSetVfyLevel(ts, vfylevel);
     }
 
+    if (rpmcliVerifyJobs > 1 && argvCount(argv) > 1) {
+	res = rpmcliVerifySignaturesPool(keyring, vfylevel, vsflags, argv);
+	rpmKeyringFree(keyring);
+	return res;
+    }
+
     while ((arg = *argv++) != NULL) {
 	FD_t fd = Fopen(arg, "r.ufdio");
 	if (fd == NULL || Ferror(fd)) {
-	    rpmlog(RPMLOG_ERR, _("%s: open failed: %s\n"), 
+	    rpmlog(RPMLOG_ERR, _("%s: open failed: %s\n"),
 		     arg, Fstrerror(fd));
 	    res++;
 	} else if (rpmpkgVerifySigs(keyring, vfylevel, vsflags, fd, arg)) {
@@ -2,6 +2,7 @@
 #include <sched.h>
 #include <stdlib.h>
 #include <fcntl.h>
+#include <pthread.h>
 #include <rpm/rpmstring.h>
 #include <rpm/rpmlog.h>
 #include "lib/rpmchroot.h"
@@ -21,7 +22,13 @@ static struct rootState_s rootState = {
    .rootDir = NULL,
    .chrootDone = 0,
    .cwd = -1,
-}; 
+};
+
+/*
+ * Protects the chroot refcount: scriptlets may execute on a helper
+ * thread concurrently with the main transaction thread (see psm.c).
+ */
+static pthread_mutex_t chrootLock = PTHREAD_MUTEX_INITIALIZER;
 
 #if defined(HAVE_UNSHARE) && defined(CLONE_NEWUSER)
 /*
@@ -123,6 +130,7 @@ int rpmChrootIn(void)
 	return -1;
     }
 
+    pthread_mutex_lock(&chrootLock);
     /* "refcounted" entry to chroot */
     if (rootState.chrootDone > 0) {
 	rootState.chrootDone++;
@@ -138,6 +146,7 @@ int rpmChrootIn(void)
 	    rc = -1;
 	}
     }
+    pthread_mutex_unlock(&chrootLock);
     return rc;
 }
 
@@ -152,6 +161,7 @@ int rpmChrootOut(void)
 	return -1;
     }
 
+    pthread_mutex_lock(&chrootLock);
     /* "refcounted" return from chroot */
     if (rootState.chrootDone > 1) {
 	rootState.chrootDone--;
@@ -164,6 +174,7 @@ int rpmChrootOut(void)
 	    rc = -1;
 	}
     }
+    pthread_mutex_unlock(&chrootLock);
     return rc;
 }
 
@@ -125,6 +125,15 @@ typedef rpmFlags rpmQueryFlags;
 #define	_QUERY_FOR_BITS	\
    (QUERY_FOR_LIST|QUERY_FOR_STATE|QUERY_FOR_DUMPFILES)
 
+/** \ingroup rpmcli
+ * Framing of formatted query output records, stored in qva_outmode.
+ */
+enum rpmQueryOutMode_e {
+    QUERY_OUT_DEFAULT	= 0,	/*!< records emitted as-is */
+    QUERY_OUT_NUL	= 1,	/*!< NUL terminator after each record */
+    QUERY_OUT_LENPREFIX	= 2,	/*!< big-endian uint32 length before each record */
+};
+
 /** \ingroup rpmcli
  * Bit(s) from common command line options.
  */
@@ -134,6 +143,19 @@ extern rpmVSFlags rpmcliVSFlags;
 
 extern int rpmcliVfyLevelMask;
 
+/** \ingroup rpmcli
+ * No. of concurrent verification jobs: packages in
+ * rpmcliVerifySignatures(), files in --verify mode.
+ */
+extern int rpmcliVerifyJobs;
+
+/** \ingroup rpmcli
+ * File verification level: "fast" trusts files whose stat() matches the
+ * install record without digesting, "paranoid" always digests contents.
+ * NULL (the default) uses the %_verify_level macro, paranoid if unset.
+ */
+extern const char * rpmcliVerifyLevel;
+
 /** \ingroup rpmcli
  */
 typedef struct rpmQVKArguments_s * QVA_t;
@@ -181,6 +203,7 @@ struct rpmQVKArguments_s {
 		- 'I'	from --import
 		- 'K'	from --checksig, -K
 		*/
+    int qva_outmode;	/*!< Formatted record framing (rpmQueryOutMode_e). */
 };
 
 /** \ingroup rpmcli
@@ -5,6 +5,8 @@
 #include "system.h"
 
 #include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
 #include <utime.h>
 #include <errno.h>
 #include <dirent.h>
@@ -15,6 +17,7 @@
 #endif
 
 #include <regex.h>
+#include <pthread.h>
 
 #include <rpm/rpmtypes.h>
 #include <rpm/rpmurl.h>
@@ -25,11 +28,13 @@
 #include <rpm/rpmstring.h>
 #include <rpm/rpmfileutil.h>
 #include <rpm/rpmds.h>			/* XXX isInstallPreReq macro only */
+#include <rpm/rpmstrpool.h>
 #include <rpm/rpmlog.h>
 #include <rpm/rpmdb.h>
 #include <rpm/rpmts.h>
 #include <rpm/argv.h>
 
+#include "rpmio/rpmio_internal.h"	/* XXX Fwritev */
 #include "lib/rpmchroot.h"
 #include "lib/rpmdb_internal.h"
 #include "lib/fprint.h"
@@ -52,6 +57,9 @@
 #undef HTDATATYPE
 
 static rpmdb rpmdbUnlink(rpmdb db);
+static void miStopPrefetch(rpmdbMatchIterator mi);
+static struct bnBloom_s * bnBloomFree(struct bnBloom_s *bf);
+static struct hdrShmCache_s * shmcacheFree(struct hdrShmCache_s *cache);
 
 static int buildIndexes(rpmdb db)
 {
@@ -271,6 +279,12 @@ typedef struct miRE_s {
     int			fnflags;	/*!< fnmatch(3) flags */
 } * miRE;
 
+/* A header prefetched (and imported) ahead of the iteration */
+struct pfItem_s {
+    Header h;
+    unsigned int offset;
+};
+
 struct rpmdbMatchIterator_s {
     rpmdbMatchIterator	mi_next;
     rpmdb		mi_db;
@@ -290,6 +304,18 @@ struct rpmdbMatchIterator_s {
     rpmts		mi_ts;
     rpmRC (*mi_hdrchk) (rpmts ts, const void * uh, size_t uc, char ** msg);
 
+    /* Header prefetch for sequential scans (see rpmdbNextIterator) */
+    int			mi_prefetch;	/* queue depth (0: disabled) */
+    int			mi_pfrunning;	/* prefetch thread exists */
+    int			mi_pfstop;	/* tell the thread to quit */
+    int			mi_pfeof;	/* thread hit end of packages */
+    struct pfItem_s *	mi_pfqueue;	/* ring buffer of mi_prefetch items */
+    int			mi_pfhead;
+    int			mi_pfcount;
+    pthread_t		mi_pfthread;
+    pthread_mutex_t	mi_pflock;
+    pthread_cond_t	mi_pffill;	/* producer waits: queue full */
+    pthread_cond_t	mi_pfdrain;	/* consumer waits: queue empty */
 };
 
 struct rpmdbIndexIterator_s {
@@ -384,6 +410,78 @@ static int dbiForeach(dbiIndex *dbis, int ndbi,
     return rc;
 }
 
+/*
+ * Per-instance dependency set cache: obsoletes/conflicts checks parse
+ * the same popular installed packages' dependency sets over and over
+ * within one transaction. The open handle keeps one refcounted rpmds
+ * per (instance, tag) pair handed out so far; entries are linked out
+ * to callers and the whole cache is dropped on any database change
+ * (outstanding links keep their sets alive).
+ */
+struct dsCacheEnt_s {
+    unsigned int hdrNum;
+    rpmTagVal tag;
+    rpmds ds;
+};
+
+struct rpmdbDsCache_s {
+    rpmstrPool pool;		/*!< pool the cached sets live in (no ref) */
+    struct dsCacheEnt_s *ents;
+    int count;
+    int alloced;
+};
+
+static void dsCacheFree(rpmdb db)
+{
+    struct rpmdbDsCache_s *c = db->db_dscache;
+
+    if (c != NULL) {
+	for (int i = 0; i < c->count; i++)
+	    rpmdsFree(c->ents[i].ds);
+	free(c->ents);
+	free(c);
+	db->db_dscache = NULL;
+    }
+}
+
+rpmds rpmdbInstanceDs(rpmdb db, Header h, rpmTagVal tagN, rpmstrPool pool)
+{
+    unsigned int hdrNum = headerGetInstance(h);
+    struct rpmdbDsCache_s *c;
+    struct dsCacheEnt_s *e;
+
+    if (db == NULL || hdrNum == 0)
+	return rpmdsNewPool(pool, h, tagN, 0);
+
+    c = db->db_dscache;
+    if (c == NULL) {
+	c = db->db_dscache = xcalloc(1, sizeof(*c));
+	c->pool = pool;
+    }
+    /* Everything in one process shares the ts pool, but play it safe */
+    if (pool != c->pool)
+	return rpmdsNewPool(pool, h, tagN, 0);
+
+    for (int i = 0; i < c->count; i++) {
+	if (c->ents[i].hdrNum == hdrNum && c->ents[i].tag == tagN)
+	    return rpmdsLink(c->ents[i].ds);
+    }
+
+    if (c->count == c->alloced) {
+	c->alloced += 64;
+	c->ents = xrealloc(c->ents, c->alloced * sizeof(*c->ents));
+    }
+    e = &c->ents[c->count];
+    e->ds = rpmdsNewPool(pool, h, tagN, 0);
+    if (e->ds == NULL)
+	return NULL;
+    e->hdrNum = hdrNum;
+    e->tag = tagN;
+    c->count++;
+
+    return rpmdsLink(e->ds);
+}
+
 int rpmdbClose(rpmdb db)
 {
     rpmdb * prev, next;
@@ -415,6 +513,9 @@ int rpmdbClose(rpmdb db)
     db->db_home = _free(db->db_home);
     db->db_fullpath = _free(db->db_fullpath);
     db->db_checked = dbChkFree(db->db_checked);
+    db->db_bnbloom = bnBloomFree(db->db_bnbloom);
+    db->db_shmcache = shmcacheFree(db->db_shmcache);
+    dsCacheFree(db);
     db->db_indexes = _free(db->db_indexes);
 
     if (next) {
@@ -591,6 +692,363 @@ Header rpmdbGetHeaderAt(rpmdb db, unsigned int offset)
     return h;
 }
 
+/*
+ * Bloom filter over the basenames index. File dependency resolution
+ * asks for huge numbers of paths of which the vast majority are not in
+ * the database at all; the filter answers those misses from memory
+ * without touching the index. Built lazily from one sequential key
+ * walk once a database handle has seen enough file lookups to pay for
+ * the walk, and extended as headers are added. Removals are ignored:
+ * a stale bit can only cause a redundant index lookup, never a wrong
+ * answer.
+ */
+#define BNBLOOM_HASHES		4
+#define BNBLOOM_BITSPERKEY	16
+#define BNBLOOM_THRESHOLD	256	/* lookups before building */
+
+struct bnBloom_s {
+    unsigned char * bits;
+    size_t mask;		/* number of bits - 1 (a power of two) */
+};
+
+static void bnBloomHash(const void *key, size_t keylen,
+			uint32_t *h1, uint32_t *h2)
+{
+    const unsigned char *s = key;
+    uint32_t a = 2166136261u;	/* FNV-1a */
+    uint32_t b = 5381;		/* djb2 */
+
+    for (size_t i = 0; i < keylen; i++) {
+	a = (a ^ s[i]) * 16777619u;
+	b = b * 33 + s[i];
+    }
+    *h1 = a;
+    *h2 = b | 1;
+}
+
+static void bnBloomSet(struct bnBloom_s *bf, uint32_t h1, uint32_t h2)
+{
+    for (int i = 0; i < BNBLOOM_HASHES; i++) {
+	size_t bit = (h1 + (uint32_t)i * h2) & bf->mask;
+	bf->bits[bit >> 3] |= (1 << (bit & 7));
+    }
+}
+
+static void bnBloomAdd(struct bnBloom_s *bf, const void *key, size_t keylen)
+{
+    uint32_t h1, h2;
+    bnBloomHash(key, keylen, &h1, &h2);
+    bnBloomSet(bf, h1, h2);
+}
+
+/* Return 1 if key may be in the set, 0 if definitely not */
+static int bnBloomTest(struct bnBloom_s *bf, const void *key, size_t keylen)
+{
+    uint32_t h1, h2;
+    bnBloomHash(key, keylen, &h1, &h2);
+    for (int i = 0; i < BNBLOOM_HASHES; i++) {
+	size_t bit = (h1 + (uint32_t)i * h2) & bf->mask;
+	if (!(bf->bits[bit >> 3] & (1 << (bit & 7))))
+	    return 0;
+    }
+    return 1;
+}
+
+static struct bnBloom_s * bnBloomFree(struct bnBloom_s *bf)
+{
+    if (bf) {
+	free(bf->bits);
+	free(bf);
+    }
+    return NULL;
+}
+
+static void bnBloomCreate(rpmdb db)
+{
+    rpmdbIndexIterator ii = rpmdbIndexKeyIteratorInit(db, RPMDBI_BASENAMES);
+    uint64_t *hashes = NULL;
+    size_t n = 0, alloced = 0;
+    size_t nbits;
+    const void * key;
+    size_t keylen;
+    struct bnBloom_s *bf;
+
+    if (ii == NULL) {
+	db->db_bnbloomfail = 1;
+	return;
+    }
+
+    /* Key count isn't known up front, collect the hashes first */
+    while (rpmdbIndexIteratorNext(ii, &key, &keylen) == 0) {
+	uint32_t h1, h2;
+	if (n == alloced) {
+	    alloced = alloced ? alloced * 2 : 4096;
+	    hashes = xrealloc(hashes, alloced * sizeof(*hashes));
+	}
+	bnBloomHash(key, keylen, &h1, &h2);
+	hashes[n++] = ((uint64_t)h1 << 32) | h2;
+    }
+    rpmdbIndexIteratorFree(ii);
+
+    nbits = 1024;
+    while (nbits < n * BNBLOOM_BITSPERKEY)
+	nbits <<= 1;
+
+    bf = xmalloc(sizeof(*bf));
+    bf->mask = nbits - 1;
+    bf->bits = xcalloc(1, nbits / 8);
+    for (size_t i = 0; i < n; i++)
+	bnBloomSet(bf, hashes[i] >> 32, hashes[i] & 0xffffffff);
+    free(hashes);
+
+    db->db_bnbloom = bf;
+    rpmlog(RPMLOG_DEBUG, "basenames filter: %zu keys, %zu kB\n",
+	   n, nbits / 8 / 1024);
+}
+
+/*
+ * Shared immutable header blob cache (%_db_shmcache).
+ *
+ * Concurrent rpm processes on one host (e.g. parallel chroot installs
+ * against bind-mounted rpmdbs) each read and import the same header
+ * blobs. The first process to load a blob publishes it into a POSIX
+ * shared memory segment keyed by the database cookie; later processes
+ * find it there and import it zero-copy straight from the read-only
+ * mapping (HEADERIMPORT_MAPPED). Blobs are stored verbatim in their
+ * on-disk (network) byte order, so a shared blob is never modified
+ * after publication and the segment contents never need invalidation:
+ * a database change gives a new cookie and thus a new segment.
+ *
+ * Slots are published lock free for readers (instance number stored
+ * last, with release semantics); a process-shared robust mutex only
+ * serializes writers appending to the arena.
+ */
+#define SHMCACHE_MAGIC		0x52706863	/* "Rphc" */
+#define SHMCACHE_VERSION	1
+#define SHMCACHE_NPROBES	64
+
+struct shmcacheSlot_s {
+    unsigned int instance;	/* package instance, 0 = empty */
+    unsigned int blen;		/* blob length in bytes */
+    uint64_t boff;		/* blob offset from segment base */
+};
+
+struct shmcacheSeg_s {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t nslots;		/* slot count (a power of two) */
+    uint32_t ready;		/* creator finished initializing */
+    uint64_t size;		/* total segment size */
+    uint64_t used;		/* arena high water mark */
+    uint32_t dead;		/* writer died mid-append, stop using */
+    uint32_t pad;
+    pthread_mutex_t lock;	/* serializes writers across processes */
+    struct shmcacheSlot_s slots[];
+};
+
+struct hdrShmCache_s {
+    struct shmcacheSeg_s *seg;
+    size_t size;
+    int writable;
+};
+
+static struct hdrShmCache_s *shmcacheFree(struct hdrShmCache_s *cache)
+{
+    /*
+     * The mapping itself is left in place for the life of the process:
+     * headers imported zero-copy from it may outlive the db handle.
+     */
+    free(cache);
+    return NULL;
+}
+
+static void shmcacheCreate(rpmdb db)
+{
+    char *cookie = NULL;
+    char *name = NULL;
+    struct shmcacheSeg_s *seg = MAP_FAILED;
+    struct stat sb;
+    size_t size;
+    int mb = rpmExpandNumeric("%{?_db_shmcache_mb}");
+    int fd = -1;
+    int writable = 1;
+    int created = 0;
+
+    db->db_shmcachefail = 1;	/* cleared on success */
+
+    if (mb <= 0)
+	mb = 64;
+    size = (size_t)mb << 20;
+
+    if ((cookie = rpmdbCookie(db)) == NULL)
+	goto exit;
+    rasprintf(&name, "/rpm-hdrcache-%.32s", cookie);
+
+    fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (fd >= 0) {
+	created = 1;
+	if (ftruncate(fd, size) != 0)
+	    goto exit;
+    } else if (errno == EEXIST) {
+	fd = shm_open(name, O_RDWR, 0);
+	if (fd < 0 && errno == EACCES) {
+	    fd = shm_open(name, O_RDONLY, 0);
+	    writable = 0;
+	}
+	if (fd < 0)
+	    goto exit;
+	/*
+	 * The segment name is predictable, so never trust one somebody
+	 * else could have created or can still write to: headers are
+	 * imported zero-copy from this mapping.
+	 */
+	if (fstat(fd, &sb) != 0 || (size_t)sb.st_size != size ||
+		(sb.st_uid != geteuid() && sb.st_uid != 0) ||
+		(sb.st_mode & (S_IWGRP|S_IWOTH)) != 0)
+	    goto exit;
+    } else {
+	goto exit;
+    }
+
+    seg = mmap(NULL, size, PROT_READ | (writable ? PROT_WRITE : 0),
+	       MAP_SHARED, fd, 0);
+    if (seg == MAP_FAILED)
+	goto exit;
+
+    if (created) {
+	pthread_mutexattr_t attr;
+	uint32_t nslots = 1024;
+
+	/* One slot per 8 kB of segment, headers average far above that */
+	while (nslots < (size >> 13))
+	    nslots <<= 1;
+
+	seg->magic = SHMCACHE_MAGIC;
+	seg->version = SHMCACHE_VERSION;
+	seg->nslots = nslots;
+	seg->size = size;
+	seg->used = sizeof(*seg) + nslots * sizeof(seg->slots[0]);
+	pthread_mutexattr_init(&attr);
+	pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+	pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST);
+	pthread_mutex_init(&seg->lock, &attr);
+	pthread_mutexattr_destroy(&attr);
+	__atomic_store_n(&seg->ready, 1, __ATOMIC_RELEASE);
+    } else {
+	/* Creator may still be initializing, don't wait around for it */
+	if (__atomic_load_n(&seg->ready, __ATOMIC_ACQUIRE) != 1 ||
+		seg->magic != SHMCACHE_MAGIC ||
+		seg->version != SHMCACHE_VERSION ||
+		seg->size != size)
+	    goto exit;
+    }
+
+    db->db_shmcache = xmalloc(sizeof(*db->db_shmcache));
+    db->db_shmcache->seg = seg;
+    db->db_shmcache->size = size;
+    db->db_shmcache->writable = writable;
+    db->db_shmcachefail = 0;
+    rpmlog(RPMLOG_DEBUG, "shared header cache: %s (%d MB, %s)\n",
+	   name, mb, created ? "created" : "attached");
+
+exit:
+    if (db->db_shmcache == NULL) {
+	if (seg != MAP_FAILED)
+	    munmap(seg, size);
+	if (created)
+	    shm_unlink(name);
+    }
+    if (fd >= 0)
+	close(fd);
+    free(name);
+    free(cookie);
+}
+
+/**
+ * Look up a header blob in the shared cache.
+ * @param cache		shared header cache
+ * @param instance	package instance number
+ * @param[out] uhlen	blob length in bytes
+ * @return		blob in the read-only mapping, NULL on miss
+ */
+static const unsigned char *shmcacheGet(struct hdrShmCache_s *cache,
+					unsigned int instance,
+					unsigned int *uhlen)
+{
+    struct shmcacheSeg_s *seg = cache->seg;
+    uint32_t h = instance * 2654435761u;
+
+    if (__atomic_load_n(&seg->dead, __ATOMIC_ACQUIRE))
+	return NULL;
+
+    for (int i = 0; i < SHMCACHE_NPROBES; i++) {
+	struct shmcacheSlot_s *slot = seg->slots + ((h + i) & (seg->nslots - 1));
+	unsigned int si = __atomic_load_n(&slot->instance, __ATOMIC_ACQUIRE);
+	if (si == 0)
+	    break;
+	if (si == instance) {
+	    *uhlen = slot->blen;
+	    return (const unsigned char *)seg + slot->boff;
+	}
+    }
+    return NULL;
+}
+
+/**
+ * Publish a header blob into the shared cache (best effort).
+ * @param cache		shared header cache
+ * @param instance	package instance number
+ * @param uh		header blob in on-disk byte order
+ * @param uhlen		blob length in bytes
+ */
+static void shmcachePut(struct hdrShmCache_s *cache, unsigned int instance,
+			const unsigned char *uh, unsigned int uhlen)
+{
+    struct shmcacheSeg_s *seg = cache->seg;
+    struct shmcacheSlot_s *slot = NULL;
+    uint32_t h = instance * 2654435761u;
+    uint64_t boff;
+    int rc;
+
+    if (!cache->writable || __atomic_load_n(&seg->dead, __ATOMIC_ACQUIRE))
+	return;
+
+    rc = pthread_mutex_lock(&seg->lock);
+    if (rc == EOWNERDEAD) {
+	/* Previous owner died mid-append, its slot was never published */
+	if (pthread_mutex_consistent(&seg->lock) != 0) {
+	    __atomic_store_n(&seg->dead, 1, __ATOMIC_RELEASE);
+	    pthread_mutex_unlock(&seg->lock);
+	    return;
+	}
+    } else if (rc != 0)
+	return;
+
+    for (int i = 0; i < SHMCACHE_NPROBES; i++) {
+	struct shmcacheSlot_s *s = seg->slots + ((h + i) & (seg->nslots - 1));
+	if (s->instance == instance)
+	    goto unlock;	/* another process won the race */
+	if (s->instance == 0) {
+	    slot = s;
+	    break;
+	}
+    }
+
+    boff = (seg->used + 7) & ~(uint64_t)7;	/* blobs are int32 aligned */
+    if (slot == NULL || boff + uhlen > seg->size)
+	goto unlock;	/* probe chain or arena full, cache what we have */
+
+    memcpy((unsigned char *)seg + boff, uh, uhlen);
+    seg->used = boff + uhlen;
+    slot->boff = boff;
+    slot->blen = uhlen;
+    /* Publish last: readers probe without taking the lock */
+    __atomic_store_n(&slot->instance, instance, __ATOMIC_RELEASE);
+
+unlock:
+    pthread_mutex_unlock(&seg->lock);
+}
+
 /**
  * Find file matches in database.
  * @param db		rpm database
@@ -625,6 +1083,16 @@ static rpmRC rpmdbFindByFile(rpmdb db, dbiIndex dbi, const char *filespec,
     if (baseName == NULL)
 	goto exit;
 
+    /* Most file dependency lookups miss, answer those from the filter */
+    if (db->db_bnbloom == NULL && !db->db_bnbloomfail &&
+	    ++db->db_bnlookups > BNBLOOM_THRESHOLD)
+	bnBloomCreate(db);
+    if (db->db_bnbloom &&
+	    !bnBloomTest(db->db_bnbloom, baseName, strlen(baseName))) {
+	rc = RPMRC_NOTFOUND;
+	goto exit;
+    }
+
     rc = indexGet(dbi, baseName, 0, &allMatches);
 
     if (rc || allMatches == NULL) goto exit;
@@ -1015,6 +1483,8 @@ rpmdbMatchIterator rpmdbFreeIterator(rpmdbMatchIterator mi)
 
     pkgdbOpen(mi->mi_db, 0, &dbi);
 
+    miStopPrefetch(mi);
+
     miFreeHeader(mi, dbi);
 
     mi->mi_dbc = dbiCursorFree(dbi, mi->mi_dbc);
@@ -1221,11 +1691,85 @@ static char * mireDup(rpmTagVal tag, rpmMireMode *modep,
     return pat;
 }
 
-int rpmdbSetIteratorRE(rpmdbMatchIterator mi, rpmTagVal tag,
-		rpmMireMode mode, const char * pattern)
+/**
+ * Extract the literal anchored prefix of a pattern, if any.
+ * @param mode		pattern match mode (as stored in the mire)
+ * @param pattern	pattern string (as stored in the mire)
+ * @return		malloc'd prefix, NULL if the pattern has none
+ */
+static char * mirePrefix(rpmMireMode mode, const char * pattern)
+{
+    const char *start = pattern;
+    size_t n = 0;
+
+    switch (mode) {
+    case RPMMIRE_STRCMP:
+	n = strlen(start);
+	break;
+    case RPMMIRE_GLOB:
+	n = strcspn(start, "*?[\\");
+	break;
+    case RPMMIRE_REGEX:
+	/* Unanchored patterns can match anywhere, nothing to bound */
+	if (*start != '^')
+	    break;
+	start++;
+	n = strcspn(start, ".*+?[\\^$(){}|");
+	/* Quantifiers make the preceding character optional, drop it */
+	if (n > 0 && strchr("*+?{", start[n]) != NULL)
+	    n--;
+	break;
+    default:
+	break;
+    }
+
+    return (n > 0) ? rstrndup(start, n) : NULL;
+}
+
+/**
+ * Bound a full scan by an anchored name pattern: the Name index tells
+ * which packages can possibly match, everything else needs no loading.
+ * The pattern itself still runs on whatever the index returned.
+ * @param mi		rpm database iterator (Packages, not yet started)
+ * @param mode		pattern match mode (as stored in the mire)
+ * @param pattern	pattern string (as stored in the mire)
+ */
+static void miPruneByName(rpmdbMatchIterator mi, rpmMireMode mode,
+		const char * pattern)
+{
+    char *pfx = mirePrefix(mode, pattern);
+    dbiIndex dbi = NULL;
+
+    if (pfx == NULL)
+	return;
+
+    if (indexOpen(mi->mi_db, RPMTAG_NAME, 0, &dbi) == 0) {
+	dbiIndexSet set = NULL;
+	rpmRC rc = indexPrefixGet(dbi, pfx, strlen(pfx), &set);
+
+	if (rc == RPMRC_OK || rc == RPMRC_NOTFOUND) {
+	    /* No matches means an empty set, not a full scan */
+	    if (set == NULL)
+		set = dbiIndexSetNew(0);
+	    mi->mi_set = set;
+	    rpmdbSortIterator(mi);
+	}
+    }
+    free(pfx);
+}
+
+/**
+ * Compile one pattern into a match selector.
+ * @param tag		rpm tag
+ * @param mode		type of pattern match
+ * @param pattern	pattern to match (leading '!' inverts the sense)
+ * @param[out] mire	compiled selector (caller-allocated)
+ * @return		0 on success
+ */
+static int mireInit(rpmTagVal tag, rpmMireMode mode, const char * pattern,
+		miRE mire)
 {
     static rpmMireMode defmode = (rpmMireMode)-1;
-    miRE mire = NULL;
     char * allpat = NULL;
     int notmatch = 0;
     regex_t * preg = NULL;
@@ -1250,9 +1794,6 @@ int rpmdbSetIteratorRE(rpmdbMatchIterator mi, rpmTagVal tag,
 	free(t);
      }
 
-    if (mi == NULL || pattern == NULL)
-	return rc;
-
     /* Leading '!' inverts pattern match sense, like "grep -v". */
     if (*pattern == '!') {
 	notmatch = 1;
@@ -1297,10 +1838,6 @@ int rpmdbSetIteratorRE(rpmdbMatchIterator mi, rpmTagVal tag,
 	return rc;
     }
 
-    mi->mi_re = xrealloc(mi->mi_re, (mi->mi_nre + 1) * sizeof(*mi->mi_re));
-    mire = mi->mi_re + mi->mi_nre;
-    mi->mi_nre++;
-    
     mire->tag = tag;
     mire->mode = mode;
     mire->pattern = allpat;
@@ -1310,12 +1847,129 @@ int rpmdbSetIteratorRE(rpmdbMatchIterator mi, rpmTagVal tag,
     mire->eflags = eflags;
     mire->fnflags = fnflags;
 
+    return rc;
+}
+
+/**
+ * Release resources held by a compiled match selector.
+ * @param mire		compiled selector
+ */
+static void mireClean(miRE mire)
+{
+    mire->pattern = _free(mire->pattern);
+    if (mire->preg != NULL) {
+	regfree(mire->preg);
+	mire->preg = _free(mire->preg);
+    }
+}
+
+int rpmdbSetIteratorRE(rpmdbMatchIterator mi, rpmTagVal tag,
+		rpmMireMode mode, const char * pattern)
+{
+    struct miRE_s mire_s;
+    miRE mire = NULL;
+    int rc = 0;
+
+    if (mi == NULL || pattern == NULL)
+	return rc;
+
+    rc = mireInit(tag, mode, pattern, &mire_s);
+    if (rc)
+	return rc;
+
+    mi->mi_re = xrealloc(mi->mi_re, (mi->mi_nre + 1) * sizeof(*mi->mi_re));
+    mire = mi->mi_re + mi->mi_nre;
+    mi->mi_nre++;
+
+    *mire = mire_s;	/* struct assignment */
+
     if (mi->mi_nre > 1)
 	qsort(mi->mi_re, mi->mi_nre, sizeof(*mi->mi_re), mireCmp);
 
+    /* An anchored name pattern lets the Name index bound a full scan */
+    if (tag == RPMTAG_NAME && !mire_s.notmatch &&
+	    mi->mi_rpmtag == RPMDBI_PACKAGES && mi->mi_set == NULL &&
+	    mi->mi_dbc == NULL && mi->mi_h == NULL)
+	miPruneByName(mi, mire_s.mode, mire_s.pattern);
+
     return rc;
 }
 
+int rpmdbMatchPatterns(rpmdb db, rpmTagVal tag, rpmMireMode mode,
+		const char * const * patterns,
+		rpmdbPatternMatchFunction match, void * data)
+{
+    rpmdbMatchIterator mi;
+    miRE mires = NULL;
+    Header h;
+    int npats = 0;
+    int nmatched = 0;
+
+    if (db == NULL || patterns == NULL)
+	return -1;
+
+    while (patterns[npats] != NULL)
+	npats++;
+    if (npats == 0)
+	return 0;
+
+    /* Compile all patterns up front, the scan evaluates them together */
+    mires = xcalloc(npats, sizeof(*mires));
+    for (int i = 0; i < npats; i++) {
+	if (mireInit(tag, mode, patterns[i], &mires[i])) {
+	    while (--i >= 0)
+		mireClean(&mires[i]);
+	    free(mires);
+	    return -1;
+	}
+    }
+
+    mi = rpmdbInitIterator(db, RPMDBI_PACKAGES, NULL, 0);
+    while ((h = rpmdbNextIterator(mi)) != NULL) {
+	uint32_t zero = 0;
+	struct rpmtd_s td;
+
+	if (!headerGet(h, tag, &td, HEADERGET_MINMEM)) {
+	    if (tag != RPMTAG_EPOCH)
+		continue;
+	    /* Missing epoch matches as zero, like iterator selectors */
+	    td.count = 1;
+	    td.type = RPM_INT32_TYPE;
+	    td.data = &zero;
+	}
+
+	/* Each header loads once, all patterns run on the same data */
+	for (int i = 0; i < npats; i++) {
+	    miRE mire = &mires[i];
+	    int anymatch = 0;
+
+	    rpmtdInit(&td);
+	    while (anymatch == 0 && rpmtdNext(&td) >= 0) {
+		char *str = rpmtdFormat(&td, RPMTD_FORMAT_STRING, NULL);
+		if (str) {
+		    int rc = miregexec(mire, str);
+		    if ((!rc && !mire->notmatch) || (rc && mire->notmatch))
+			anymatch = 1;
+		    free(str);
+		}
+	    }
+	    if (anymatch) {
+		nmatched++;
+		if (match)
+		    match(i, h, data);
+	    }
+	}
+	rpmtdFreeData(&td);
+    }
+    rpmdbFreeIterator(mi);
+
+    for (int i = 0; i < npats; i++)
+	mireClean(&mires[i]);
+    free(mires);
+
+    return nmatched;
+}
+
 /**
  * Return iterator selector match.
  * @param mi		rpm database iterator
@@ -1415,7 +2069,8 @@ int rpmdbSetHdrChk(rpmdbMatchIterator mi, rpmts ts,
     return rc;
 }
 
-static rpmRC miVerifyHeader(rpmdbMatchIterator mi, const void *uh, size_t uhlen)
+static rpmRC miVerifyHeader(rpmdbMatchIterator mi, unsigned int offset,
+			    const void *uh, size_t uhlen)
 {
     rpmRC rpmrc = RPMRC_NOTFOUND;
 
@@ -1425,7 +2080,7 @@ static rpmRC miVerifyHeader(rpmdbMatchIterator mi, const void *uh, size_t uhlen)
     /* Don't bother re-checking a previously read header. */
     if (mi->mi_db->db_checked) {
 	rpmRC *res;
-	if (dbChkGetEntry(mi->mi_db->db_checked, mi->mi_offset,
+	if (dbChkGetEntry(mi->mi_db->db_checked, offset,
 			  &res, NULL, NULL)) {
 	    rpmrc = res[0];
 	}
@@ -1440,46 +2095,227 @@ static rpmRC miVerifyHeader(rpmdbMatchIterator mi, const void *uh, size_t uhlen)
 	lvl = (rpmrc == RPMRC_FAIL ? RPMLOG_ERR : RPMLOG_DEBUG);
 	rpmlog(lvl, "%s h#%8u %s\n",
 	    (rpmrc == RPMRC_FAIL ? _("rpmdbNextIterator: skipping") : " read"),
-		    mi->mi_offset, (msg ? msg : ""));
+		    offset, (msg ? msg : ""));
 	msg = _free(msg);
 
 	/* Mark header checked. */
 	if (mi->mi_db && mi->mi_db->db_checked) {
-	    dbChkAddEntry(mi->mi_db->db_checked, mi->mi_offset, rpmrc);
+	    dbChkAddEntry(mi->mi_db->db_checked, offset, rpmrc);
 	}
     }
     return rpmrc;
 }
 
-/* FIX: mi->mi_key.data may be NULL */
-Header rpmdbNextIterator(rpmdbMatchIterator mi)
+/**
+ * Prefetch thread: walk the package db sequentially, reading and
+ * importing header blobs ahead of the consumer so that formatting
+ * and the like overlaps with I/O and blob conversion work. Owns the
+ * iterator cursor (and on ndb the per-db blob cache) exclusively,
+ * which is why prefetch is only enabled for read-only full scans.
+ */
+static void * miPrefetchThread(void *arg)
 {
+    rpmdbMatchIterator mi = arg;
     dbiIndex dbi = NULL;
-    unsigned char * uh;
-    unsigned int uhlen;
-    int rc;
-    headerImportFlags importFlags = HEADERIMPORT_FAST;
-
-    if (mi == NULL)
-	return NULL;
-
-    if (pkgdbOpen(mi->mi_db, 0, &dbi))
-	return NULL;
+    /* The local db was validated when written, skip per-entry checks */
+    headerImportFlags importFlags =
+	HEADERIMPORT_FAST | HEADERIMPORT_LAZY | HEADERIMPORT_TRUSTED;
 
 #if defined(_USE_COPY_LOAD)
     importFlags |= HEADERIMPORT_COPY;
 #endif
-    /*
-     * Cursors are per-iterator, not per-dbi, so get a cursor for the
-     * iterator on 1st call. If the iteration is to rewrite headers,
-     * then the cursor needs to marked with DBC_WRITE as well.
-     */
-    if (mi->mi_dbc == NULL)
-	mi->mi_dbc = dbiCursorInit(dbi, mi->mi_cflags);
+    if (pkgdbOpen(mi->mi_db, 0, &dbi) == 0)
+    for (;;) {
+	unsigned char * uh = NULL;
+	unsigned int uhlen = 0;
+	unsigned int offset;
+	Header h;
+	int tail;
 
-top:
+	if (pkgdbGet(dbi, mi->mi_dbc, 0, &uh, &uhlen))
+	    break;
+	offset = pkgdbKey(dbi, mi->mi_dbc);
+	if (offset == 0)
+	    continue;
+
+	/* Verify header if enabled, skip damaged and inconsistent headers */
+	if (miVerifyHeader(mi, offset, uh, uhlen) == RPMRC_FAIL)
+	    continue;
+
+	/* Make the blob available to concurrent processes */
+	if (mi->mi_db->db_shmcache)
+	    shmcachePut(mi->mi_db->db_shmcache, offset, uh, uhlen);
+
+	/* Did the header blob load correctly? */
+	h = headerImport(uh, uhlen, importFlags);
+	if (h == NULL || !headerIsEntry(h, RPMTAG_NAME)) {
+	    rpmlog(RPMLOG_ERR,
+		    _("rpmdb: damaged header #%u retrieved -- skipping.\n"),
+		    offset);
+	    h = headerFree(h);
+	    continue;
+	}
+
+	pthread_mutex_lock(&mi->mi_pflock);
+	while (mi->mi_pfcount == mi->mi_prefetch && !mi->mi_pfstop)
+	    pthread_cond_wait(&mi->mi_pffill, &mi->mi_pflock);
+	if (mi->mi_pfstop) {
+	    pthread_mutex_unlock(&mi->mi_pflock);
+	    headerFree(h);
+	    break;
+	}
+	tail = (mi->mi_pfhead + mi->mi_pfcount) % mi->mi_prefetch;
+	mi->mi_pfqueue[tail].h = h;
+	mi->mi_pfqueue[tail].offset = offset;
+	mi->mi_pfcount++;
+	pthread_cond_signal(&mi->mi_pfdrain);
+	pthread_mutex_unlock(&mi->mi_pflock);
+    }
+
+    pthread_mutex_lock(&mi->mi_pflock);
+    mi->mi_pfeof = 1;
+    pthread_cond_signal(&mi->mi_pfdrain);
+    pthread_mutex_unlock(&mi->mi_pflock);
+    return NULL;
+}
+
+/**
+ * Start a prefetch thread for the iteration if configured.
+ * @param mi		database iterator positioned before the first header
+ */
+static void miStartPrefetch(rpmdbMatchIterator mi)
+{
+    int depth = rpmExpandNumeric("%{?_db_prefetch}");
+
+    /* Rebuild has the db to itself, always overlap read and import */
+    if (depth <= 1 && (mi->mi_db->db_flags & RPMDB_FLAG_REBUILD))
+	depth = 8;
+
+    if (depth <= 1)
+	return;
+
+    mi->mi_prefetch = depth;
+    mi->mi_pfqueue = xcalloc(depth, sizeof(*mi->mi_pfqueue));
+    pthread_mutex_init(&mi->mi_pflock, NULL);
+    pthread_cond_init(&mi->mi_pffill, NULL);
+    pthread_cond_init(&mi->mi_pfdrain, NULL);
+
+    if (pthread_create(&mi->mi_pfthread, NULL, miPrefetchThread, mi) == 0) {
+	mi->mi_pfrunning = 1;
+    } else {
+	pthread_cond_destroy(&mi->mi_pfdrain);
+	pthread_cond_destroy(&mi->mi_pffill);
+	pthread_mutex_destroy(&mi->mi_pflock);
+	mi->mi_pfqueue = _free(mi->mi_pfqueue);
+	mi->mi_prefetch = 0;
+    }
+}
+
+/**
+ * Stop the prefetch thread (if any) and drop undelivered headers.
+ * @param mi		database iterator
+ */
+static void miStopPrefetch(rpmdbMatchIterator mi)
+{
+    if (mi->mi_pfrunning) {
+	pthread_mutex_lock(&mi->mi_pflock);
+	mi->mi_pfstop = 1;
+	pthread_cond_signal(&mi->mi_pffill);
+	pthread_mutex_unlock(&mi->mi_pflock);
+	pthread_join(mi->mi_pfthread, NULL);
+
+	while (mi->mi_pfcount > 0) {
+	    headerFree(mi->mi_pfqueue[mi->mi_pfhead].h);
+	    mi->mi_pfhead = (mi->mi_pfhead + 1) % mi->mi_prefetch;
+	    mi->mi_pfcount--;
+	}
+	pthread_cond_destroy(&mi->mi_pfdrain);
+	pthread_cond_destroy(&mi->mi_pffill);
+	pthread_mutex_destroy(&mi->mi_pflock);
+	mi->mi_pfqueue = _free(mi->mi_pfqueue);
+	mi->mi_pfrunning = 0;
+	mi->mi_prefetch = 0;
+    }
+}
+
+/* FIX: mi->mi_key.data may be NULL */
+Header rpmdbNextIterator(rpmdbMatchIterator mi)
+{
+    dbiIndex dbi = NULL;
+    unsigned char * uh;
+    unsigned int uhlen;
+    int rc;
+    int mapped;
+    /* The local db was validated when written, skip per-entry checks */
+    headerImportFlags importFlags =
+	HEADERIMPORT_FAST | HEADERIMPORT_LAZY | HEADERIMPORT_TRUSTED;
+
+    if (mi == NULL)
+	return NULL;
+
+    if (pkgdbOpen(mi->mi_db, 0, &dbi))
+	return NULL;
+
+#if defined(_USE_COPY_LOAD)
+    importFlags |= HEADERIMPORT_COPY;
+#endif
+    /*
+     * Cursors are per-iterator, not per-dbi, so get a cursor for the
+     * iterator on 1st call. If the iteration is to rewrite headers,
+     * then the cursor needs to marked with DBC_WRITE as well.
+     */
+    if (mi->mi_dbc == NULL) {
+	mi->mi_dbc = dbiCursorInit(dbi, mi->mi_cflags);
+	/* Read-only iterations can share imported blobs across processes */
+	if (!(mi->mi_cflags & DBC_WRITE) &&
+		mi->mi_db->db_shmcache == NULL &&
+		!mi->mi_db->db_shmcachefail &&
+		rpmExpandNumeric("%{?_db_shmcache}"))
+	    shmcacheCreate(mi->mi_db);
+	/* Read-only sequential scans can read and import ahead */
+	if (mi->mi_set == NULL && !(mi->mi_cflags & DBC_WRITE))
+	    miStartPrefetch(mi);
+    }
+
+    /* With a prefetch thread running, deliver from its queue */
+    if (mi->mi_pfrunning) {
+	miFreeHeader(mi, dbi);
+	for (;;) {
+	    struct pfItem_s item;
+
+	    pthread_mutex_lock(&mi->mi_pflock);
+	    while (mi->mi_pfcount == 0 && !mi->mi_pfeof)
+		pthread_cond_wait(&mi->mi_pfdrain, &mi->mi_pflock);
+	    if (mi->mi_pfcount == 0) {
+		pthread_mutex_unlock(&mi->mi_pflock);
+		return NULL;
+	    }
+	    item = mi->mi_pfqueue[mi->mi_pfhead];
+	    mi->mi_pfhead = (mi->mi_pfhead + 1) % mi->mi_prefetch;
+	    mi->mi_pfcount--;
+	    pthread_cond_signal(&mi->mi_pffill);
+	    pthread_mutex_unlock(&mi->mi_pflock);
+
+	    mi->mi_h = item.h;
+	    mi->mi_offset = item.offset;
+	    mi->mi_setx++;
+
+	    /* Skip this header if iterator selector (if any) doesn't match */
+	    if (mireSkip(mi)) {
+		mi->mi_h = headerFree(mi->mi_h);
+		continue;
+	    }
+	    headerSetInstance(mi->mi_h, mi->mi_offset);
+	    mi->mi_prevoffset = mi->mi_offset;
+	    mi->mi_modified = 0;
+	    return mi->mi_h;
+	}
+    }
+
+top:
     uh = NULL;
     uhlen = 0;
+    mapped = 0;
 
     do {
 	if (mi->mi_set) {
@@ -1505,9 +2341,17 @@ top:
 
     /* Retrieve next header blob for index iterator. */
     if (uh == NULL) {
-	rc = pkgdbGet(dbi, mi->mi_dbc, mi->mi_offset, &uh, &uhlen);
-	if (rc)
-	    return NULL;
+	/* Another process may have imported this blob already */
+	if (mi->mi_db->db_shmcache && !(mi->mi_cflags & DBC_WRITE)) {
+	    uh = (unsigned char *) shmcacheGet(mi->mi_db->db_shmcache,
+					      mi->mi_offset, &uhlen);
+	    mapped = (uh != NULL);
+	}
+	if (uh == NULL) {
+	    rc = pkgdbGet(dbi, mi->mi_dbc, mi->mi_offset, &uh, &uhlen);
+	    if (rc)
+		return NULL;
+	}
     }
 
     /* Rewrite current header (if necessary) and unlink. */
@@ -1518,12 +2362,17 @@ top:
 	return NULL;
 
     /* Verify header if enabled, skip damaged and inconsistent headers */
-    if (miVerifyHeader(mi, uh, uhlen) == RPMRC_FAIL) {
+    if (miVerifyHeader(mi, mi->mi_offset, uh, uhlen) == RPMRC_FAIL) {
 	goto top;
     }
 
+    /* Make the blob available to concurrent processes */
+    if (!mapped && mi->mi_db->db_shmcache && !(mi->mi_cflags & DBC_WRITE))
+	shmcachePut(mi->mi_db->db_shmcache, mi->mi_offset, uh, uhlen);
+
     /* Did the header blob load correctly? */
-    mi->mi_h = headerImport(uh, uhlen, importFlags);
+    mi->mi_h = headerImport(uh, uhlen,
+			    importFlags | (mapped ? HEADERIMPORT_MAPPED : 0));
     if (mi->mi_h == NULL || !headerIsEntry(mi->mi_h, RPMTAG_NAME)) {
 	rpmlog(RPMLOG_ERR,
 		_("rpmdb: damaged header #%u retrieved -- skipping.\n"),
@@ -2034,6 +2883,9 @@ rpmdbIndexIterator rpmdbIndexIteratorFree(rpmdbIndexIterator ii)
     return NULL;
 }
 
+static void changelogAppend(rpmdb db, uint32_t op, unsigned int hdrNum,
+			    Header h);
+
 static void logAddRemove(const char *dbiname, int removing, rpmtd tagdata)
 {
     rpm_count_t c = rpmtdCount(tagdata);
@@ -2097,6 +2949,12 @@ int rpmdbRemove(rpmdb db, unsigned int hdrNum)
     dbCtrl(db, DB_CTRL_UNLOCK_RW);
     rpmsqBlock(SIG_UNBLOCK);
 
+    if (ret == 0) {
+	changelogAppend(db, RPMDB_CHANGE_REMOVED, hdrNum, h);
+	/* Cached dependency sets may refer to the removed package */
+	dsCacheFree(db);
+    }
+
     headerFree(h);
 
     /* XXX return ret; */
@@ -2344,10 +3202,24 @@ int rpmdbAdd(rpmdb db, Header h)
     /* If everything ok, mark header as installed now */
     if (ret == 0) {
 	headerSetInstance(h, hdrNum);
+	changelogAppend(db, RPMDB_CHANGE_ADDED, hdrNum, h);
+	/* Instance numbers can be reused after a removal, drop the
+	 * cached dependency sets rather than risk a stale hit */
+	dsCacheFree(db);
 	/* Purge our verification cache on added public keys */
 	if (db->db_checked && headerIsEntry(h, RPMTAG_PUBKEYS)) {
 	    dbChkEmpty(db->db_checked);
 	}
+	/* Keep the basenames filter in sync with added headers */
+	if (db->db_bnbloom) {
+	    struct rpmtd_s bn;
+	    if (headerGet(h, RPMTAG_BASENAMES, &bn, HEADERGET_MINMEM)) {
+		const char *b;
+		while ((b = rpmtdNextString(&bn)) != NULL)
+		    bnBloomAdd(db->db_bnbloom, b, strlen(b));
+		rpmtdFreeData(&bn);
+	    }
+	}
     }
 
 exit:
@@ -2533,6 +3405,19 @@ int rpmdbRebuild(const char * prefix, rpmts ts,
 	goto exit;
     }
 
+    {	/* Pre-size the new package db from the old package count */
+	dbiIndex olddbi = NULL;
+	dbiIndex newdbi = NULL;
+	unsigned int npkgs = 0;
+
+	if (pkgdbOpen(olddb, 0, &olddbi) == 0 &&
+	    pkgdbOpen(newdb, 0, &newdbi) == 0 &&
+	    pkgdbCount(olddbi, &npkgs) == RPMRC_OK && npkgs > 0)
+	{
+	    (void) pkgdbSizeHint(newdbi, npkgs);
+	}
+    }
+
     {	Header h = NULL;
 	rpmdbMatchIterator mi;
 
@@ -2658,6 +3543,740 @@ char *rpmdbCookie(rpmdb db)
     return cookie;
 }
 
+/*
+ * Installed-provides snapshot (optional, see %_provsnapshot_path):
+ * a binary sidecar under the rpmdb directory holding every installed
+ * Provides, Obsoletes and file name, with the strings deduplicated
+ * through a string pool at build time. The file is validated against
+ * the rpmdb cookie and mapped read-only, so a depsolver gets the whole
+ * installed-provides picture without iterating any headers.
+ *
+ * Layout: header, cookie string (padded to 8 bytes), entry array,
+ * string offset table indexed by 1-based string id, string data.
+ */
+
+#define PROVSNAP_MAGIC		0x50725376	/* "PrSv" */
+#define PROVSNAP_VERSION	1
+
+struct provsnapHdr_s {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t nentries;
+    uint32_t nstrings;
+    uint32_t strsize;		/* string data bytes */
+    uint32_t cookielen;		/* cookie strlen, NUL excluded */
+};
+
+struct provsnapEnt_s {
+    uint32_t name;		/* string id, always set */
+    uint32_t evr;		/* string id, 0 if none */
+    uint32_t flags;		/* RPMSENSE_* bits */
+    uint32_t instance;		/* header instance in the rpmdb */
+    uint32_t kind;		/* rpmdbProvSnapKind */
+};
+
+struct rpmdbProvSnapshot_s {
+    void *map;
+    size_t mapsize;
+    const struct provsnapEnt_s *entries;
+    const uint32_t *stroffs;
+    const char *strs;
+    uint32_t nentries;
+    uint32_t nstrings;
+};
+
+static size_t provsnapPad8(size_t len)
+{
+    return (len + 7) & ~(size_t)7;
+}
+
+static char *provsnapPath(rpmdb db)
+{
+    char *path = NULL;
+    char *fn = rpmExpand("%{?_provsnapshot_path}", NULL);
+    if (*fn != '\0')
+	path = rpmGenPath(db->db_root, fn, NULL);
+    free(fn);
+    return path;
+}
+
+static void provsnapAddEnt(struct provsnapEnt_s **ents,
+			   uint32_t *nents, uint32_t *nalloc,
+			   uint32_t name, uint32_t evr, uint32_t flags,
+			   uint32_t instance, uint32_t kind)
+{
+    struct provsnapEnt_s *ent;
+
+    if (*nents == *nalloc) {
+	*nalloc = *nalloc ? *nalloc * 2 : 4096;
+	*ents = xrealloc(*ents, *nalloc * sizeof(**ents));
+    }
+    ent = *ents + (*nents)++;
+    ent->name = name;
+    ent->evr = evr;
+    ent->flags = flags;
+    ent->instance = instance;
+    ent->kind = kind;
+}
+
+static void provsnapAddDs(Header h, rpmTagVal tagN, uint32_t kind,
+			  uint32_t instance, rpmstrPool pool,
+			  struct provsnapEnt_s **ents,
+			  uint32_t *nents, uint32_t *nalloc)
+{
+    rpmds ds = rpmdsNew(h, tagN, 0);
+
+    ds = rpmdsInit(ds);
+    while (rpmdsNext(ds) >= 0) {
+	const char *evr = rpmdsEVR(ds);
+	uint32_t evrid = (evr && *evr) ? rpmstrPoolId(pool, evr, 1) : 0;
+	provsnapAddEnt(ents, nents, nalloc,
+		       rpmstrPoolId(pool, rpmdsN(ds), 1), evrid,
+		       rpmdsFlags(ds), instance, kind);
+    }
+    rpmdsFree(ds);
+}
+
+static int provsnapBuild(rpmdb db, const char *path, const char *cookie)
+{
+    rpmstrPool pool = rpmstrPoolCreate();
+    struct provsnapEnt_s *ents = NULL;
+    uint32_t nents = 0, nalloc = 0;
+    rpmdbMatchIterator mi;
+    struct provsnapHdr_s hdr;
+    char *tmppath = NULL;
+    FILE *fp = NULL;
+    Header h;
+    uint32_t nstrings, off;
+    int rc = -1;
+
+    mi = rpmdbInitIterator(db, RPMDBI_PACKAGES, NULL, 0);
+    while ((h = rpmdbNextIterator(mi)) != NULL) {
+	uint32_t instance = rpmdbGetIteratorOffset(mi);
+	struct rpmtd_s fns;
+
+	provsnapAddDs(h, RPMTAG_PROVIDENAME, RPMDB_PROVSNAP_PROVIDE,
+		      instance, pool, &ents, &nents, &nalloc);
+	provsnapAddDs(h, RPMTAG_OBSOLETENAME, RPMDB_PROVSNAP_OBSOLETE,
+		      instance, pool, &ents, &nents, &nalloc);
+
+	if (headerGet(h, RPMTAG_FILENAMES, &fns,
+		      HEADERGET_EXT | HEADERGET_MINMEM)) {
+	    const char *fn;
+	    while ((fn = rpmtdNextString(&fns)) != NULL) {
+		provsnapAddEnt(&ents, &nents, &nalloc,
+			       rpmstrPoolId(pool, fn, 1), 0, 0,
+			       instance, RPMDB_PROVSNAP_FILE);
+	    }
+	    rpmtdFreeData(&fns);
+	}
+    }
+    rpmdbFreeIterator(mi);
+
+    nstrings = rpmstrPoolNumStr(pool);
+
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.magic = PROVSNAP_MAGIC;
+    hdr.version = PROVSNAP_VERSION;
+    hdr.nentries = nents;
+    hdr.nstrings = nstrings;
+    hdr.cookielen = strlen(cookie);
+    for (uint32_t sid = 1; sid <= nstrings; sid++)
+	hdr.strsize += rpmstrPoolStrlen(pool, sid) + 1;
+
+    rasprintf(&tmppath, "%s.tmp.%d", path, (int) getpid());
+    if ((fp = fopen(tmppath, "w")) == NULL)
+	goto exit;
+
+    if (fwrite(&hdr, sizeof(hdr), 1, fp) != 1)
+	goto exit;
+    {
+	static const char pad[8] = "";
+	size_t padlen = provsnapPad8(hdr.cookielen + 1) - (hdr.cookielen + 1);
+	if (fwrite(cookie, hdr.cookielen + 1, 1, fp) != 1)
+	    goto exit;
+	if (padlen > 0 && fwrite(pad, padlen, 1, fp) != 1)
+	    goto exit;
+    }
+    if (nents > 0 && fwrite(ents, sizeof(*ents), nents, fp) != nents)
+	goto exit;
+
+    /* Offset table: entry 0 is unused, ids are 1-based */
+    off = 0;
+    if (fwrite(&off, sizeof(off), 1, fp) != 1)
+	goto exit;
+    for (uint32_t sid = 1; sid <= nstrings; sid++) {
+	if (fwrite(&off, sizeof(off), 1, fp) != 1)
+	    goto exit;
+	off += rpmstrPoolStrlen(pool, sid) + 1;
+    }
+    for (uint32_t sid = 1; sid <= nstrings; sid++) {
+	const char *s = rpmstrPoolStr(pool, sid);
+	if (fwrite(s, strlen(s) + 1, 1, fp) != 1)
+	    goto exit;
+    }
+
+    if (fclose(fp) == 0 && rename(tmppath, path) == 0) {
+	rc = 0;
+	rpmlog(RPMLOG_DEBUG,
+	       "provides snapshot %s: %u entries, %u strings\n",
+	       path, nents, nstrings);
+    } else {
+	unlink(tmppath);
+    }
+    fp = NULL;
+
+exit:
+    if (fp) {
+	fclose(fp);
+	unlink(tmppath);
+    }
+    free(tmppath);
+    free(ents);
+    rpmstrPoolFree(pool);
+    return rc;
+}
+
+static rpmdbProvSnapshot provsnapLoad(const char *path, const char *cookie)
+{
+    rpmdbProvSnapshot snap = NULL;
+    const struct provsnapHdr_s *hdr;
+    const char *base;
+    struct stat sb;
+    void *map = MAP_FAILED;
+    size_t want, cookiepad;
+    int fd;
+
+    if ((fd = open(path, O_RDONLY)) < 0)
+	return NULL;
+    if (fstat(fd, &sb) != 0 || (size_t)sb.st_size < sizeof(*hdr))
+	goto exit;
+    map = mmap(NULL, sb.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map == MAP_FAILED)
+	goto exit;
+
+    hdr = map;
+    base = map;
+    if (hdr->magic != PROVSNAP_MAGIC || hdr->version != PROVSNAP_VERSION)
+	goto exit;
+
+    cookiepad = provsnapPad8(hdr->cookielen + 1);
+    want = sizeof(*hdr) + cookiepad +
+	   (size_t)hdr->nentries * sizeof(struct provsnapEnt_s) +
+	   ((size_t)hdr->nstrings + 1) * sizeof(uint32_t) +
+	   hdr->strsize;
+    if ((size_t)sb.st_size != want)
+	goto exit;
+    if (strlen(cookie) != hdr->cookielen ||
+	memcmp(base + sizeof(*hdr), cookie, hdr->cookielen + 1) != 0) {
+	rpmlog(RPMLOG_DEBUG,
+	       "provides snapshot %s: stale cookie, ignoring\n", path);
+	goto exit;
+    }
+    /* String data must be NUL terminated for the accessors to be safe */
+    if (hdr->strsize > 0 && base[want - 1] != '\0')
+	goto exit;
+
+    snap = xcalloc(1, sizeof(*snap));
+    snap->map = map;
+    snap->mapsize = sb.st_size;
+    snap->nentries = hdr->nentries;
+    snap->nstrings = hdr->nstrings;
+    snap->entries = (const struct provsnapEnt_s *)
+			(base + sizeof(*hdr) + cookiepad);
+    snap->stroffs = (const uint32_t *)
+			(snap->entries + snap->nentries);
+    snap->strs = (const char *)(snap->stroffs + snap->nstrings + 1);
+    map = MAP_FAILED;
+
+exit:
+    if (map != MAP_FAILED)
+	munmap(map, sb.st_size);
+    close(fd);
+    return snap;
+}
+
+rpmdbProvSnapshot rpmdbProvidesSnapshot(rpmdb db)
+{
+    rpmdbProvSnapshot snap = NULL;
+    char *cookie = NULL;
+    char *path;
+
+    if (db == NULL)
+	return NULL;
+    if ((path = provsnapPath(db)) == NULL)
+	return NULL;
+    if ((cookie = rpmdbCookie(db)) == NULL)
+	goto exit;
+
+    snap = provsnapLoad(path, cookie);
+    if (snap == NULL && provsnapBuild(db, path, cookie) == 0)
+	snap = provsnapLoad(path, cookie);
+
+exit:
+    free(cookie);
+    free(path);
+    return snap;
+}
+
+unsigned int rpmdbProvSnapshotCount(rpmdbProvSnapshot snap)
+{
+    return snap ? snap->nentries : 0;
+}
+
+int rpmdbProvSnapshotEntry(rpmdbProvSnapshot snap, unsigned int ix,
+			   const char **name, const char **evr,
+			   uint32_t *flags, unsigned int *instance,
+			   rpmdbProvSnapKind *kind)
+{
+    const struct provsnapEnt_s *ent;
+
+    if (snap == NULL || ix >= snap->nentries)
+	return -1;
+    ent = snap->entries + ix;
+    if (name)
+	*name = snap->strs + snap->stroffs[ent->name];
+    if (evr)
+	*evr = ent->evr ? snap->strs + snap->stroffs[ent->evr] : NULL;
+    if (flags)
+	*flags = ent->flags;
+    if (instance)
+	*instance = ent->instance;
+    if (kind)
+	*kind = ent->kind;
+    return 0;
+}
+
+rpmdbProvSnapshot rpmdbProvSnapshotFree(rpmdbProvSnapshot snap)
+{
+    if (snap) {
+	munmap(snap->map, snap->mapsize);
+	free(snap);
+    }
+    return NULL;
+}
+
+/*
+ * Package change log (optional, see %_rpmdb_changelog_path):
+ * a small append-only sidecar under the rpmdb directory recording one
+ * entry per package instance added to or removed from the database.
+ * Inventory agents remember the cookie of their last poll and fetch
+ * only the entries appended since, instead of dumping every installed
+ * package each time. The cookie encodes the log identity and an end
+ * offset; whenever the two no longer line up (log disabled meanwhile,
+ * rotated, or from a different database) rpmdbChangesSince() returns
+ * NULL and the caller falls back to a full walk.
+ */
+
+#define CHANGELOG_MAGIC		0x5270436c	/* "RpCl" */
+#define CHANGELOG_VERSION	1
+#define CHANGELOG_MAXSIZE	(1024 * 1024)
+
+struct changelogHdr_s {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t logid[2];
+};
+
+struct changelogRec_s {
+    uint32_t reclen;		/* total record length, multiple of 8 */
+    uint32_t op;		/* rpmdbChangeOp */
+    uint32_t instance;
+    uint32_t nevralen;		/* NUL terminated NEVRA follows, padded */
+};
+
+struct rpmdbChanges_s {
+    char *data;			/* log tail, record storage */
+    const struct changelogRec_s **recs;
+    unsigned int nrecs;
+};
+
+static char *changelogPath(rpmdb db)
+{
+    char *path = NULL;
+    char *fn = rpmExpand("%{?_rpmdb_changelog_path}", NULL);
+    if (*fn != '\0')
+	path = rpmGenPath(db->db_root, fn, NULL);
+    free(fn);
+    return path;
+}
+
+static int changelogReadHdr(int fd, struct changelogHdr_s *hdr, off_t *sizep)
+{
+    struct stat sb;
+
+    if (fstat(fd, &sb) != 0 || (size_t)sb.st_size < sizeof(*hdr))
+	return -1;
+    if (pread(fd, hdr, sizeof(*hdr), 0) != (ssize_t)sizeof(*hdr))
+	return -1;
+    if (hdr->magic != CHANGELOG_MAGIC || hdr->version != CHANGELOG_VERSION)
+	return -1;
+    if (sizep)
+	*sizep = sb.st_size;
+    return 0;
+}
+
+static int changelogInit(int fd, struct changelogHdr_s *hdr)
+{
+    if (ftruncate(fd, 0) != 0)
+	return -1;
+    memset(hdr, 0, sizeof(*hdr));
+    hdr->magic = CHANGELOG_MAGIC;
+    hdr->version = CHANGELOG_VERSION;
+    hdr->logid[0] = (uint32_t)time(NULL);
+    hdr->logid[1] = (uint32_t)getpid();
+    return (write(fd, hdr, sizeof(*hdr)) == (ssize_t)sizeof(*hdr)) ? 0 : -1;
+}
+
+static void changelogAppend(rpmdb db, uint32_t op, unsigned int hdrNum, Header h)
+{
+    char *path = changelogPath(db);
+    char *nevra = NULL;
+    struct changelogRec_s *rec;
+    struct changelogHdr_s hdr;
+    size_t nevralen, reclen;
+    off_t size;
+    int fd = -1;
+
+    if (path == NULL)
+	return;
+
+    if ((fd = open(path, O_RDWR|O_CREAT|O_APPEND, 0644)) < 0)
+	goto exit;
+
+    /* Start over when new, unrecognized or oversized. Rotation hands
+     * readers a fresh log identity, sending them back to one full
+     * walk before incremental polls resume. */
+    if (changelogReadHdr(fd, &hdr, &size) != 0 || size > CHANGELOG_MAXSIZE) {
+	if (changelogInit(fd, &hdr) != 0)
+	    goto exit;
+    }
+
+    nevra = headerGetAsString(h, RPMTAG_NEVRA);
+    nevralen = strlen(nevra) + 1;
+    reclen = provsnapPad8(sizeof(*rec) + nevralen);
+    rec = xcalloc(1, reclen);
+    rec->reclen = reclen;
+    rec->op = op;
+    rec->instance = hdrNum;
+    rec->nevralen = nevralen;
+    memcpy(rec + 1, nevra, nevralen);
+    /* A single O_APPEND write keeps concurrent appends intact */
+    if (write(fd, rec, reclen) != (ssize_t)reclen)
+	rpmlog(RPMLOG_DEBUG, "failed to append to %s: %s\n",
+	       path, strerror(errno));
+    free(rec);
+
+exit:
+    if (fd >= 0)
+	close(fd);
+    free(nevra);
+    free(path);
+}
+
+char *rpmdbChangesCookie(rpmdb db)
+{
+    char *cookie = NULL;
+    char *path;
+    struct changelogHdr_s hdr;
+    off_t size = 0;
+    int fd;
+
+    if (db == NULL || (path = changelogPath(db)) == NULL)
+	return NULL;
+
+    fd = open(path, O_RDONLY);
+    if (fd >= 0 && changelogReadHdr(fd, &hdr, &size) != 0) {
+	close(fd);
+	fd = -1;
+    }
+    /* No usable log yet: create one so the caller gets a baseline */
+    if (fd < 0 && (fd = open(path, O_RDWR|O_CREAT|O_APPEND, 0644)) >= 0) {
+	if (changelogReadHdr(fd, &hdr, &size) != 0) {
+	    if (changelogInit(fd, &hdr) == 0) {
+		size = sizeof(hdr);
+	    } else {
+		close(fd);
+		fd = -1;
+	    }
+	}
+    }
+    if (fd >= 0) {
+	rasprintf(&cookie, "%08x%08x:%llx",
+		  hdr.logid[0], hdr.logid[1], (long long)size);
+	close(fd);
+    }
+    free(path);
+    return cookie;
+}
+
+rpmdbChanges rpmdbChangesSince(rpmdb db, const char *cookie)
+{
+    rpmdbChanges chs = NULL;
+    struct changelogHdr_s hdr;
+    unsigned int id0, id1;
+    long long off;
+    off_t size;
+    char *path = NULL;
+    char *data = NULL;
+    size_t len, pos;
+    unsigned int nrecs;
+    int fd = -1;
+
+    if (db == NULL || cookie == NULL)
+	return NULL;
+    if (sscanf(cookie, "%8x%8x:%llx", &id0, &id1, &off) != 3)
+	return NULL;
+    if ((path = changelogPath(db)) == NULL)
+	return NULL;
+    if ((fd = open(path, O_RDONLY)) < 0)
+	goto exit;
+    if (changelogReadHdr(fd, &hdr, &size) != 0)
+	goto exit;
+    /* Rotated or different log: the tail since the cookie is gone */
+    if (hdr.logid[0] != id0 || hdr.logid[1] != id1)
+	goto exit;
+    if (off < (long long)sizeof(hdr) || off > size)
+	goto exit;
+
+    len = size - off;
+    data = xmalloc(len + 1);
+    if (len > 0 && pread(fd, data, len, off) != (ssize_t)len)
+	goto exit;
+    data[len] = '\0';
+
+    /* Validate record structure before handing anything out */
+    nrecs = 0;
+    for (pos = 0; pos < len; pos += ((const struct changelogRec_s *)(data + pos))->reclen) {
+	const struct changelogRec_s *rec = (const struct changelogRec_s *)(data + pos);
+	if (len - pos < sizeof(*rec) ||
+	    (rec->reclen & 7) != 0 || rec->reclen > len - pos ||
+	    rec->nevralen == 0 ||
+	    rec->reclen < sizeof(*rec) + rec->nevralen ||
+	    *((const char *)(rec + 1) + rec->nevralen - 1) != '\0')
+	    goto exit;
+	nrecs++;
+    }
+
+    chs = xcalloc(1, sizeof(*chs));
+    chs->data = data;
+    chs->nrecs = nrecs;
+    chs->recs = xmalloc((nrecs ? nrecs : 1) * sizeof(*chs->recs));
+    nrecs = 0;
+    for (pos = 0; pos < len; pos += chs->recs[nrecs - 1]->reclen)
+	chs->recs[nrecs++] = (const struct changelogRec_s *)(data + pos);
+    data = NULL;
+
+exit:
+    free(data);
+    free(path);
+    if (fd >= 0)
+	close(fd);
+    return chs;
+}
+
+unsigned int rpmdbChangesCount(rpmdbChanges chs)
+{
+    return chs ? chs->nrecs : 0;
+}
+
+int rpmdbChangesEntry(rpmdbChanges chs, unsigned int ix, rpmdbChangeOp *op,
+		      unsigned int *instance, const char **nevra)
+{
+    const struct changelogRec_s *rec;
+
+    if (chs == NULL || ix >= chs->nrecs)
+	return -1;
+    rec = chs->recs[ix];
+    if (op)
+	*op = rec->op;
+    if (instance)
+	*instance = rec->instance;
+    if (nevra)
+	*nevra = (const char *)(rec + 1);
+    return 0;
+}
+
+rpmdbChanges rpmdbChangesFree(rpmdbChanges chs)
+{
+    if (chs) {
+	free(chs->data);
+	free(chs->recs);
+	free(chs);
+    }
+    return NULL;
+}
+
+int rpmdbExportToFd(rpmdb db, FD_t fd)
+{
+    dbiIndex dbi = NULL;
+    dbiCursor dbc = NULL;
+    int failed = 0;
+    int rc = -1;
+
+    if (db == NULL || fd == NULL)
+	return rc;
+
+    if (pkgdbOpen(db, 0, &dbi))
+	return rc;
+
+    dbc = dbiCursorInit(dbi, DBC_READ);
+    rc = 0;
+    for (;;) {
+	unsigned char *uh = NULL;
+	unsigned int uhlen = 0;
+	unsigned int offset;
+	struct hdrblob_s blob;
+	char *emsg = NULL;
+	struct iovec iov[2];
+
+	if (pkgdbGet(dbi, dbc, 0, &uh, &uhlen))
+	    break;
+	offset = pkgdbKey(dbi, dbc);
+	if (offset == 0)
+	    continue;
+
+	/* Cheap structural verification, the blob itself goes out as-is */
+	if (hdrblobInit(uh, uhlen, 0, 0, &blob, &emsg) != RPMRC_OK) {
+	    rpmlog(RPMLOG_ERR,
+		   _("rpmdb: skipping damaged header #%u: %s\n"),
+		   offset, (emsg ? emsg : ""));
+	    free(emsg);
+	    failed++;
+	    continue;
+	}
+
+	/* The stored blob is the header wire format, minus the magic */
+	iov[0].iov_base = (void *) rpm_header_magic;
+	iov[0].iov_len = sizeof(rpm_header_magic);
+	iov[1].iov_base = uh;
+	iov[1].iov_len = uhlen;
+
+	if (Fwritev(fd, iov, 2) !=
+		(ssize_t)(sizeof(rpm_header_magic) + uhlen)) {
+	    rpmlog(RPMLOG_ERR, _("error writing package headers: %s\n"),
+		   Fstrerror(fd));
+	    rc = -1;
+	    break;
+	}
+    }
+    dbiCursorFree(dbi, dbc);
+
+    return rc ? rc : failed;
+}
+
+int rpmdbImportFromFd(rpmdb db, FD_t fd)
+{
+    dbiIndex dbi = NULL;
+    dbiCursor dbc = NULL;
+    unsigned int npkgs = 0;
+    struct hdrblob_s *blobs = NULL;
+    int nblobs = 0;
+    int nalloced = 0;
+    int rc = 0;
+
+    if (db == NULL || fd == NULL)
+	return -1;
+
+    if (pkgdbOpen(db, 0, &dbi))
+	return -1;
+
+    /* A nonempty db has live indexes, those need updating per package */
+    if (pkgdbCount(dbi, &npkgs) != RPMRC_OK || npkgs > 0) {
+	Header h;
+	while ((h = headerRead(fd, HEADER_MAGIC_YES)) != NULL) {
+	    rc += rpmdbAdd(db, h);
+	    headerFree(h);
+	}
+	return rc;
+    }
+
+    /* Stage the raw blobs, the load needs no header instances at all */
+    for (;;) {
+	char magic[sizeof(rpm_header_magic)];
+	struct hdrblob_s blob;
+	char *emsg = NULL;
+	ssize_t nb = Freadall(fd, magic, sizeof(magic));
+
+	if (nb == 0)
+	    break;	/* clean end of the header list */
+	if (nb != sizeof(magic) ||
+		memcmp(magic, rpm_header_magic, sizeof(magic))) {
+	    rpmlog(RPMLOG_ERR,
+		   _("rpmdb: bad header magic after %d headers\n"), nblobs);
+	    rc = -1;
+	    break;
+	}
+	if (hdrblobRead(fd, 0, 0, 0, &blob, &emsg) != RPMRC_OK) {
+	    rpmlog(RPMLOG_ERR, _("rpmdb: bad header #%d: %s\n"),
+		   nblobs, (emsg ? emsg : ""));
+	    free(emsg);
+	    rc = -1;
+	    break;
+	}
+	if (nblobs >= nalloced) {
+	    nalloced = nalloced ? nalloced * 2 : 1024;
+	    blobs = xrealloc(blobs, nalloced * sizeof(*blobs));
+	}
+	blobs[nblobs++] = blob;
+    }
+
+    if (rc == 0 && nblobs > 0) {
+	rpmsqBlock(SIG_BLOCK);
+	dbCtrl(db, DB_CTRL_LOCK_RW);
+	dbSetFSync(db, 0);
+
+	/* The exact count is known now, lay out Packages in one go */
+	(void) pkgdbSizeHint(dbi, nblobs);
+
+	dbc = dbiCursorInit(dbi, DBC_WRITE);
+	for (int i = 0; i < nblobs && rc == 0; i++) {
+	    unsigned int hdrNum = 0;
+	    rc = pkgdbPut(dbi, dbc, &hdrNum,
+			  (unsigned char *)blobs[i].ei, blobs[i].pvlen);
+	}
+	dbiCursorFree(dbi, dbc);
+
+	/*
+	 * Regenerate all indexes in one pass over what was just loaded.
+	 * buildIndexes() only handles freshly created index files, but
+	 * initdb leaves empty ones behind, so on a known-empty db the
+	 * unconditional version is both necessary and safe.
+	 */
+	if (rc == 0) {
+	    Header h;
+	    rpmdbMatchIterator mi;
+
+	    /* Keep indexOpen() from kicking off buildIndexes() halfway */
+	    db->db_flags |= RPMDB_FLAG_REBUILD;
+	    rc += rpmdbOpenAll(db);
+
+	    mi = rpmdbInitIterator(db, RPMDBI_PACKAGES, NULL, 0);
+	    while ((h = rpmdbNextIterator(mi))) {
+		unsigned int hdrNum = headerGetInstance(h);
+		for (int dbix = 0; dbix < db->db_ndbi; dbix++) {
+		    dbiIndex idxdbi = db->db_indexes[dbix];
+		    if (idxdbi)
+			rc += idxdbPut(idxdbi, db->db_tags[dbix], hdrNum, h);
+		}
+	    }
+	    rpmdbFreeIterator(mi);
+	    db->db_flags &= ~RPMDB_FLAG_REBUILD;
+	}
+
+	dbCtrl(db, DB_CTRL_INDEXSYNC);
+	dbCtrl(db, DB_CTRL_UNLOCK_RW);
+	dbSetFSync(db, !db->cfg.db_no_fsync);
+	rpmsqBlock(SIG_UNBLOCK);
+    }
+
+    for (int i = 0; i < nblobs; i++)
+	free(blobs[i].ei);
+    free(blobs);
+
+    return rc;
+}
+
 int rpmdbFStat(rpmdb db, struct stat *statbuf)
 {
     int rc = -1;
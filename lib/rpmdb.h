@@ -101,6 +101,32 @@ int rpmdbAppendIterator(rpmdbMatchIterator mi,
 int rpmdbSetIteratorRE(rpmdbMatchIterator mi, rpmTagVal tag,
 		rpmMireMode mode, const char * pattern);
 
+/** \ingroup rpmdb
+ * Called for each pattern/header pair matched by rpmdbMatchPatterns().
+ * @param patix		index of the matched pattern
+ * @param h		matched header (borrowed reference)
+ * @param data		opaque callback data
+ */
+typedef void (*rpmdbPatternMatchFunction) (int patix, Header h, void * data);
+
+/** \ingroup rpmdb
+ * Match a set of patterns against a header tag in one database pass.
+ * All patterns are compiled up front, each installed header is loaded
+ * once and evaluated against every pattern, and the callback fires for
+ * each matching pattern/header pair. Patterns behave exactly as with
+ * rpmdbSetIteratorRE(), including the leading '!' inverting the sense.
+ * @param db		rpm database
+ * @param tag		rpm tag to match on (e.g. RPMTAG_NAME)
+ * @param mode		type of pattern match (applies to all patterns)
+ * @param patterns	NULL-terminated array of patterns
+ * @param match		match callback (NULL to only count matches)
+ * @param data		opaque data passed to the callback
+ * @return		number of matched pairs, -1 on error
+ */
+int rpmdbMatchPatterns(rpmdb db, rpmTagVal tag, rpmMireMode mode,
+		const char * const * patterns,
+		rpmdbPatternMatchFunction match, void * data);
+
 /** \ingroup rpmdb
  * Prepare iterator for lazy writes.
  * @note Must be called before rpmdbNextIterator() with CDB model database.
@@ -235,6 +261,150 @@ int rpmdbCtrl(rpmdb db, rpmdbCtrlOp ctrl);
  */
 char *rpmdbCookie(rpmdb db);
 
+/** \ingroup rpmdb
+ * Installed-provides snapshot entry kind.
+ */
+typedef enum rpmdbProvSnapKind_e {
+    RPMDB_PROVSNAP_PROVIDE	= 0,	/*!< Provides: entry */
+    RPMDB_PROVSNAP_OBSOLETE	= 1,	/*!< Obsoletes: entry */
+    RPMDB_PROVSNAP_FILE		= 2	/*!< installed file name */
+} rpmdbProvSnapKind;
+
+typedef struct rpmdbProvSnapshot_s * rpmdbProvSnapshot;
+
+/** \ingroup rpmdb
+ * Return a snapshot of all installed Provides, Obsoletes and file
+ * names, intended for depsolvers that would otherwise rebuild this
+ * picture by iterating every installed header at startup. The snapshot
+ * is kept in a memory-mapped sidecar file under the rpmdb directory
+ * (see %_provsnapshot_path) which is validated against rpmdbCookie()
+ * and rebuilt transparently when the database has changed, so loading
+ * an up-to-date snapshot costs no header iteration at all.
+ * Returns NULL when %_provsnapshot_path is unset.
+ * @param db		rpm database
+ * @return		provides snapshot, NULL on error or when disabled
+ */
+rpmdbProvSnapshot rpmdbProvidesSnapshot(rpmdb db);
+
+/** \ingroup rpmdb
+ * Return number of entries in a provides snapshot.
+ * @param snap		provides snapshot
+ * @return		number of entries
+ */
+unsigned int rpmdbProvSnapshotCount(rpmdbProvSnapshot snap);
+
+/** \ingroup rpmdb
+ * Retrieve one provides snapshot entry. The returned strings point
+ * into the snapshot mapping and are valid until the snapshot is freed.
+ * @param snap		provides snapshot
+ * @param ix		entry index
+ * @param[out] name	provide/obsolete name or file path (or NULL)
+ * @param[out] evr	version string, NULL if none (or NULL)
+ * @param[out] flags	RPMSENSE_* bits (or NULL)
+ * @param[out] instance	header instance in the rpmdb (or NULL)
+ * @param[out] kind	entry kind (or NULL)
+ * @return		0 on success, -1 on invalid index
+ */
+int rpmdbProvSnapshotEntry(rpmdbProvSnapshot snap, unsigned int ix,
+			   const char **name, const char **evr,
+			   uint32_t *flags, unsigned int *instance,
+			   rpmdbProvSnapKind *kind);
+
+/** \ingroup rpmdb
+ * Free a provides snapshot.
+ * @param snap		provides snapshot
+ * @return		NULL always
+ */
+rpmdbProvSnapshot rpmdbProvSnapshotFree(rpmdbProvSnapshot snap);
+
+/** \ingroup rpmdb
+ * Package change log entry operation.
+ */
+typedef enum rpmdbChangeOp_e {
+    RPMDB_CHANGE_ADDED	 = 0,	/*!< package instance was added */
+    RPMDB_CHANGE_REMOVED = 1	/*!< package instance was removed */
+} rpmdbChangeOp;
+
+typedef struct rpmdbChanges_s * rpmdbChanges;
+
+/** \ingroup rpmdb
+ * Return a change log cookie describing the current end of the rpmdb
+ * package change log (see %_rpmdb_changelog_path), for a later
+ * rpmdbChangesSince() call. Creates an empty log when none exists so
+ * the caller has a baseline to poll from.
+ * Returns NULL when %_rpmdb_changelog_path is unset.
+ * @param db		rpm database
+ * @return		cookie string (malloced), NULL on error or when
+ *			disabled
+ */
+char *rpmdbChangesCookie(rpmdb db);
+
+/** \ingroup rpmdb
+ * Return the package instances added to or removed from the database
+ * since a change log cookie was taken, in the order they happened.
+ * This reads only the change log entries appended since the cookie,
+ * not the database itself, so polling for changes costs O(changes)
+ * rather than a walk over every installed package. Returns NULL when
+ * the question cannot be answered from the log (log disabled, rotated
+ * or from a different database); the caller must then fall back to a
+ * full walk and take a fresh cookie.
+ * @param db		rpm database
+ * @param cookie	cookie from a previous rpmdbChangesCookie()
+ * @return		change set, NULL when a full walk is needed
+ */
+rpmdbChanges rpmdbChangesSince(rpmdb db, const char *cookie);
+
+/** \ingroup rpmdb
+ * Return number of entries in a change set.
+ * @param chs		change set
+ * @return		number of entries
+ */
+unsigned int rpmdbChangesCount(rpmdbChanges chs);
+
+/** \ingroup rpmdb
+ * Retrieve one change set entry. The returned string points into the
+ * change set and is valid until it is freed.
+ * @param chs		change set
+ * @param ix		entry index
+ * @param[out] op	operation (or NULL)
+ * @param[out] instance	header instance in the rpmdb (or NULL)
+ * @param[out] nevra	package NEVRA string (or NULL)
+ * @return		0 on success, -1 on invalid index
+ */
+int rpmdbChangesEntry(rpmdbChanges chs, unsigned int ix, rpmdbChangeOp *op,
+		      unsigned int *instance, const char **nevra);
+
+/** \ingroup rpmdb
+ * Free a change set.
+ * @param chs		change set
+ * @return		NULL always
+ */
+rpmdbChanges rpmdbChangesFree(rpmdbChanges chs);
+
+/** \ingroup rpmdb
+ * Export all package headers to a file handle in header list format
+ * (as consumed by rpmdb --importdb). The header blobs are streamed
+ * straight out of the database without an import/export round trip,
+ * each one is structurally verified before it is written.
+ * @param db		rpm database
+ * @param fd		file handle to write to
+ * @return		number of damaged (skipped) headers, -1 on error
+ */
+int rpmdbExportToFd(rpmdb db, FD_t fd);
+
+/** \ingroup rpmdb
+ * Import package headers from a file handle in header list format
+ * (as produced by rpmdb --exportdb). On an empty database the header
+ * blobs are bulk-loaded: staged in memory, written to the package db
+ * sequentially with an exact size hint and the indexes regenerated in
+ * a single pass at the end, instead of paying per-package index
+ * maintenance. A nonempty database falls back to per-package adds.
+ * @param db		rpm database
+ * @param fd		file handle to read from
+ * @return		0 on success
+ */
+int rpmdbImportFromFd(rpmdb db, FD_t fd);
+
 /** \ingroup rpmdb
  * Perform stat() on rpm database
  * @param prefix	prefix or NULL for /
@@ -208,6 +208,21 @@ void rpmdbSetIteratorIndex(rpmdbMatchIterator mi, unsigned int ix);
 RPM_GNUC_INTERNAL
 unsigned int rpmdbGetIteratorOffsetFor(rpmdbMatchIterator mi, unsigned int ix);
 
+/** \ingroup rpmdb
+ * Return the dependency set of an installed package, shared through a
+ * per-handle cache so repeated checks against the same package reuse
+ * the parsed set. The cache is dropped on any database change; the
+ * returned set is a reference the caller must free with rpmdsFree(),
+ * and its iteration index is shared - set it before use.
+ * @param db		rpm database
+ * @param h		header of an installed package
+ * @param tagN		dependency tag
+ * @param pool		string pool to create the set in
+ * @return		dependency set (NULL if the tag is empty)
+ */
+RPM_GNUC_INTERNAL
+rpmds rpmdbInstanceDs(rpmdb db, Header h, rpmTagVal tagN, rpmstrPool pool);
+
 /** \ingroup rpmdb
  * Return header located in rpmdb at given offset.
  * @param db		rpm database
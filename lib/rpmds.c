@@ -23,9 +23,12 @@ int _rpmds_nopromote = 1;
 struct rpmds_s {
     rpmstrPool pool;		/*!< String pool. */
     const char * Type;		/*!< Tag name. */
-    char * DNEVR;		/*!< Formatted dependency string. */
+    char * DNEVR;		/*!< Formatted dependency string (scratch) */
+    size_t DNEVRalloced;	/*!< Allocated size of DNEVR buffer. */
+    int DNEVRix;		/*!< Element the DNEVR buffer holds. */
     rpmsid * N;			/*!< Dependency name id's (pool) */
     rpmsid * EVR;		/*!< Dependency EVR id's (pool) */
+    rpmver * vers;		/*!< Parsed EVR triples (lazily cached) */
     rpmsenseFlags * Flags;	/*!< Bit(s) identifying context/comparison. */
     rpm_color_t * Color;	/*!< Bit(s) calculated from file color(s). */
     rpmTagVal tagN;		/*!< Header tag. */
@@ -219,6 +222,16 @@ rpmds rpmdsLink(rpmds ds)
     return ds;
 }
 
+/* Drop the parsed EVR cache (elements about to move or go away) */
+static void rpmdsDropVers(rpmds ds)
+{
+    if (ds->vers) {
+	for (int i = 0; i < ds->Count; i++)
+	    rpmverFree(ds->vers[i]);
+	ds->vers = _free(ds->vers);
+    }
+}
+
 rpmds rpmdsFree(rpmds ds)
 {
     rpmTagVal tagEVR, tagF, tagTi;
@@ -233,6 +246,7 @@ rpmds rpmdsFree(rpmds ds)
 	return NULL;
 
     if (ds->Count > 0) {
+	rpmdsDropVers(ds);
 	ds->N = _free(ds->N);
 	ds->EVR = _free(ds->EVR);
 	ds->Flags = _free(ds->Flags);
@@ -261,6 +275,7 @@ static rpmds rpmdsCreate(rpmstrPool pool,
     ds->Count = Count;
     ds->instance = instance;
     ds->i = -1;
+    ds->DNEVRix = -1;
 
     return rpmdsLink(ds);
 }
@@ -334,7 +349,13 @@ rpmds rpmdsNew(Header h, rpmTagVal tagN, int flags)
     return rpmdsNewPool(NULL, h, tagN, flags);
 }
 
-char * rpmdsNewDNEVR(const char * dspfx, const rpmds ds)
+/**
+ * Format "N <op> EVR" for the current element. With bufp the string is
+ * written into the caller's buffer (grown as needed, tracked through
+ * allocedp), otherwise a fresh allocation is returned.
+ */
+static char * rpmdsFormatDNEVR(const char * dspfx, const rpmds ds,
+			       char ** bufp, size_t * allocedp)
 {
     const char * N = rpmdsN(ds);
     const char * EVR = rpmdsEVR(ds);
@@ -358,7 +379,16 @@ char * rpmdsNewDNEVR(const char * dspfx, const rpmds ds)
 	nb += strlen(EVR);
     }
 
-    t = tbuf = xmalloc(nb + 1);
+    if (bufp) {
+	if (*bufp == NULL || *allocedp < nb + 1) {
+	    *allocedp = nb + 1;
+	    *bufp = xrealloc(*bufp, *allocedp);
+	}
+	tbuf = *bufp;
+    } else {
+	tbuf = xmalloc(nb + 1);
+    }
+    t = tbuf;
     if (dspfx) {
 	t = stpcpy(t, dspfx);
 	*t++ = ' ';
@@ -381,6 +411,11 @@ char * rpmdsNewDNEVR(const char * dspfx, const rpmds ds)
     return tbuf;
 }
 
+char * rpmdsNewDNEVR(const char * dspfx, const rpmds ds)
+{
+    return rpmdsFormatDNEVR(dspfx, ds, NULL, NULL);
+}
+
 static rpmds singleDSPool(rpmstrPool pool, rpmTagVal tagN,
 			  rpmsid N, rpmsid EVR, rpmsenseFlags Flags,
 			  unsigned int instance, rpm_color_t Color,
@@ -556,7 +591,6 @@ int rpmdsSetIx(rpmds ds, int ix)
     if (ds != NULL) {
 	i = ds->i;
 	ds->i = ix;
-	ds->DNEVR = _free(ds->DNEVR);
     }
     return i;
 }
@@ -575,9 +609,11 @@ const char * rpmdsDNEVR(const rpmds ds)
     const char * DNEVR = NULL;
 
     if (ds != NULL && ds->i >= 0 && ds->i < ds->Count) {
-	if (ds->DNEVR == NULL) {
+	if (ds->DNEVR == NULL || ds->DNEVRix != ds->i) {
 	    char t[2] = { tagNToChar(ds->tagN), '\0' };
-	    ds->DNEVR = rpmdsNewDNEVR(t, ds);
+	    /* Reformat into the scratch buffer, no per-element malloc */
+	    rpmdsFormatDNEVR(t, ds, &ds->DNEVR, &ds->DNEVRalloced);
+	    ds->DNEVRix = ds->i;
 	}
 	DNEVR = ds->DNEVR;
     }
@@ -708,12 +744,11 @@ int rpmdsNext(rpmds ds)
     if (ds != NULL && ++ds->i >= 0) {
 	if (ds->i < ds->Count) {
 	    i = ds->i;
-	    ds->DNEVR = _free(ds->DNEVR);
 	} else
 	    ds->i = -1;
 
 if (_rpmds_debug  < 0 && i != -1)
-fprintf(stderr, "*** ds %p\t%s[%d]: %s\n", ds, (ds->Type ? ds->Type : "?Type?"), i, (ds->DNEVR ? ds->DNEVR : "?DNEVR?"));
+fprintf(stderr, "*** ds %p\t%s[%d]: %s\n", ds, (ds->Type ? ds->Type : "?Type?"), i, (ds->DNEVR && ds->DNEVRix == i ? ds->DNEVR : "?DNEVR?"));
 
     }
 
@@ -724,7 +759,6 @@ rpmds rpmdsInit(rpmds ds)
 {
     if (ds != NULL) {
 	ds->i = -1;
-	ds->DNEVR = _free(ds->DNEVR);
     }
     return ds;
 }
@@ -833,6 +867,9 @@ int rpmdsMerge(rpmds * dsp, rpmds ods)
     if (ds == NULL)
 	return -1;
 
+    /* Insertions below shift elements around, parsed EVRs can't stay */
+    rpmdsDropVers(ds);
+
     /* Ensure EVR and Flags exist */
     if (ds->EVR == NULL)
 	ds->EVR = xcalloc(ds->Count, sizeof(*ds->EVR));
@@ -945,22 +982,40 @@ int rpmdsSearch(rpmds ds, rpmds ods)
     /* Check each member of [l,u) subset for ranges overlap. */
     i = -1;
     if (l < u) {
-	int save = rpmdsSetIx(ds, l-1);
-	while ((l = rpmdsNext(ds)) >= 0 && (l < u)) {
-	    if ((i = rpmdsCompare(ods, ds)) != 0)
-		break;
-	}
-	/* Return element index that overlaps, or -1. */
-	if (i)
-	    i = rpmdsIx(ds);
-	else {
-	    (void) rpmdsSetIx(ds, save);
-	    i = -1;
-	}
+	i = rpmdsCompareRange(ods, ods->i, ds, l, u);
+	/* Leave ds on the element that overlaps (if any). */
+	if (i >= 0)
+	    (void) rpmdsSetIx(ds, i);
     }
     return i;
 }
 
+/**
+ * Return the parsed EVR of an element, caching the triple in the set.
+ * During dependency checking the same installed-provide EVRs are
+ * compared against many requires; parsing each element at most once
+ * per set avoids re-splitting the string on every comparison.
+ * @param ds		dependency set
+ * @param ix		element index
+ * @return		parsed EVR (owned by ds), NULL on unparsable EVR
+ */
+static rpmver rpmdsVerIndex(rpmds ds, int ix)
+{
+    if (ds->vers == NULL)
+	ds->vers = xcalloc(ds->Count, sizeof(*ds->vers));
+    if (ds->vers[ix] == NULL)
+	ds->vers[ix] = rpmverParse(rpmdsEVRIndex(ds, ix));
+    return ds->vers[ix];
+}
+
+void rpmdsPrimeVerCache(rpmds ds)
+{
+    if (ds != NULL && ds->Count > 0 && ds->EVR != NULL) {
+	for (int i = 0; i < ds->Count; i++)
+	    (void) rpmdsVerIndex(ds, i);
+    }
+}
+
 int rpmdsCompareIndex(rpmds A, int aix, rpmds B, int bix)
 {
     const char *AEVR, *BEVR;
@@ -995,19 +1050,54 @@ int rpmdsCompareIndex(rpmds A, int aix, rpmds B, int bix)
 	result = 1;
     } else {
 	/* Both AEVR and BEVR exist, compare [epoch:]version[-release]. */
-	rpmver av = rpmverParse(AEVR);
-	rpmver bv = rpmverParse(BEVR);
-
-	result = rpmverOverlap(av, AFlags, bv, BFlags);
-
-	rpmverFree(av);
-	rpmverFree(bv);
+	result = rpmverOverlap(rpmdsVerIndex(A, aix), AFlags,
+			       rpmdsVerIndex(B, bix), BFlags);
     }
 
 exit:
     return result;
 }
 
+int rpmdsCompareRange(rpmds A, int aix, rpmds B, int blo, int bhi)
+{
+    rpmsid AId = rpmdsNIdIndex(A, aix);
+    rpmsenseFlags AFlags = rpmdsFlagsIndex(A, aix);
+    const char *AEVR = rpmdsEVRIndex(A, aix);
+    rpmver av = (AEVR && *AEVR) ? rpmdsVerIndex(A, aix) : NULL;
+    int degenerate = !(A->EVR && A->Flags && B->EVR && B->Flags);
+
+    if (bhi > B->Count)
+	bhi = B->Count;
+
+    for (int bix = blo; bix < bhi; bix++) {
+	rpmsenseFlags BFlags;
+	const char *BEVR;
+
+	/* Different names don't overlap. */
+	if (!rpmstrPoolStreq(A->pool, AId, B->pool, rpmdsNIdIndex(B, bix)))
+	    continue;
+
+	/* XXX rpm prior to 3.0.2 did not always supply EVR and Flags. */
+	if (degenerate)
+	    return bix;
+
+	/* Same name. If either A or B is an existence test, always overlap. */
+	BFlags = rpmdsFlagsIndex(B, bix);
+	if (!((AFlags & RPMSENSE_SENSEMASK) && (BFlags & RPMSENSE_SENSEMASK)))
+	    return bix;
+
+	/* If either EVR is non-existent or empty, always overlap. */
+	BEVR = rpmdsEVRIndex(B, bix);
+	if (!(av && BEVR && *BEVR))
+	    return bix;
+
+	/* Both EVRs exist, compare [epoch:]version[-release]. */
+	if (rpmverOverlap(av, AFlags, rpmdsVerIndex(B, bix), BFlags))
+	    return bix;
+    }
+    return -1;
+}
+
 int rpmdsCompare(const rpmds A, const rpmds B)
 {
     return rpmdsCompareIndex(A, A->i, B, B->i);
@@ -1035,13 +1125,8 @@ int rpmdsMatches(rpmstrPool pool, Header h, int prix,
 	    rpmdsSetIx(provides, prix);
 	result = rpmdsCompare(provides, req);
     } else {
-	provides = rpmdsInit(provides);
-	while (rpmdsNext(provides) >= 0) {
-	    result = rpmdsCompare(provides, req);
-	    /* If this provide matches the require, we're done. */
-	    if (result)
-		break;
-	}
+	result = (rpmdsCompareRange(req, req->i, provides,
+				    0, provides->Count) >= 0);
     }
 
     rpmdsFree(provides);
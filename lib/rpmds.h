@@ -368,6 +368,19 @@ int rpmdsMerge(rpmds * dsp, rpmds ods);
  **/
 int rpmdsSearch(rpmds ds, rpmds ods);
 
+/** \ingroup rpmds
+ * Check a dependency set against the installed packages alone: no
+ * transaction set is constructed and no problem set is materialized,
+ * making this suitable for cheap "is this buildable now" style probes
+ * over many dependency sets (e.g. build requires of queued specs).
+ * rpmlib() features provided by rpm itself count as satisfied, rich
+ * dependencies are evaluated, MISSINGOK elements never count against.
+ * @param db		open rpm database
+ * @param ds		dependency set to check
+ * @return		number of unsatisfied elements, -1 on error
+ */
+int rpmdsCheckInstalled(rpmdb db, rpmds ds);
+
 /** \ingroup rpmds
  * Compare two versioned dependency ranges, looking for overlap.
  * @param A		1st dependency
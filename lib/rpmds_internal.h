@@ -37,6 +37,16 @@ void rpmdsNotify(rpmds ds, const char * where, int rc);
 RPM_GNUC_INTERNAL
 rpmsid rpmdsNId(rpmds ds);
 
+/** \ingroup rpmds
+ * Parse the EVR cache of all elements. The cache is otherwise filled
+ * lazily with unsynchronized writes from the compare functions; sets
+ * that are compared against from multiple threads must be primed
+ * while still single threaded.
+ * @param ds		dependency set
+ */
+RPM_GNUC_INTERNAL
+void rpmdsPrimeVerCache(rpmds ds);
+
 /** \ingroup rpmds
  * Return current dependency epoch-version-release pool id.
  * @param ds            dependency set
@@ -77,6 +87,19 @@ rpm_color_t rpmdsColorIndex(rpmds ds, int i);
 RPM_GNUC_INTERNAL
 int rpmdsCompareIndex(rpmds A, int aix, rpmds B, int bix);
 
+/** \ingroup rpmds
+ * Compare one dependency against a range of another set in one pass,
+ * reusing parsed EVRs cached in the sets.
+ * @param A		1st dependency set
+ * @param aix		1st dependency index
+ * @param B		2nd dependency set
+ * @param blo		first 2nd set index to compare
+ * @param bhi		first 2nd set index not to compare
+ * @return		index in [blo,bhi) of first overlap, -1 on none
+ */
+RPM_GNUC_INTERNAL
+int rpmdsCompareRange(rpmds A, int aix, rpmds B, int blo, int bhi);
+
 /** \ingroup rpmds
  * Filter dependency set and return new dependency set containing only items
  * with given trigger index.
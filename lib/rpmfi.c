@@ -13,6 +13,7 @@
 #include <rpm/rpmds.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <pthread.h>
 
 #include "lib/rpmfi_internal.h"
 #include "lib/rpmte_internal.h"	/* relocations */
@@ -58,9 +59,16 @@ struct rpmfi_s {
     rpmfiles files;		/*!< File info set */
     rpmcpio_t archive;		/*!< Archive with payload */
     unsigned char * found;	/*!< Bit field of files found in the archive */
+    int * writeOrder;		/*!< Custom file order for archive writing */
+    int writeOrderIx;		/*!< Next index into writeOrder */
     int nrefs;			/*!< Reference count */
 };
 
+struct fnbx_s {
+    rpmsid id;			/*!< Base name id */
+    int ix;			/*!< File index */
+};
+
 struct rpmfn_s {
     rpm_count_t dc;		/*!< No. of directories. */
     rpm_count_t fc;		/*!< No. of files. */
@@ -68,6 +76,7 @@ struct rpmfn_s {
     rpmsid * bnid;		/*!< Index to base name(s) (pool) */
     rpmsid * dnid;		/*!< Index to directory name(s) (pool) */
     uint32_t * dil;		/*!< Directory indice(s) (from header) */
+    struct fnbx_s * bnx;	/*!< Sorted base name id index (lazy) */
 };
 
 typedef struct rpmfn_s * rpmfn;
@@ -88,6 +97,7 @@ struct rpmfiles_s {
     rpm_off_t * fsizes;		/*!< File size(s) (from header) */
     rpm_loff_t * lfsizes;	/*!< File size(s) (from header) */
     rpm_time_t * fmtimes;	/*!< File modification time(s) (from header) */
+    rpm_time_t * fctimes;	/*!< File change time(s) at install (from header) */
     rpm_mode_t * fmodes;	/*!< File mode(s) (from header) */
     rpm_rdev_t * frdevs;	/*!< File rdev(s) (from header) */
     rpm_ino_t * finodes;	/*!< File inodes(s) (from header) */
@@ -126,6 +136,10 @@ struct rpmfiles_s {
     struct nlinkHash_s * nlinks;/*!< Files connected by hardlinks */
     rpm_off_t * replacedSizes;	/*!< (TR_ADDED) */
     rpm_loff_t * replacedLSizes;/*!< (TR_ADDED) */
+
+    int * dirfds;		/*!< Cached per-directory fds (lazy) */
+    pthread_mutex_t dirfdlock;	/*!< Protects dirfds */
+
     int magic;
     int nrefs;		/*!< Reference count. */
 };
@@ -214,6 +228,7 @@ static void rpmfnClear(rpmfn fndata)
 	free(fndata->bnid);
 	free(fndata->dnid);
 	free(fndata->dil);
+	free(fndata->bnx);
 	memset(fndata, 0, sizeof(*fndata));
     }
 }
@@ -352,6 +367,37 @@ int rpmfilesODI(rpmfiles fi, int ix)
     return (fi != NULL) ? rpmfnDI(fi->ofndata, ix) : -1;
 }
 
+int rpmfilesDirFd(rpmfiles fi, int ix)
+{
+    int fd = -1;
+    int dx = rpmfilesDI(fi, ix);
+    int dc = rpmfilesDC(fi);
+
+    if (fi == NULL || dx < 0 || dx >= dc)
+	return -1;
+
+    pthread_mutex_lock(&fi->dirfdlock);
+    if (fi->dirfds == NULL) {
+	fi->dirfds = xmalloc(dc * sizeof(*fi->dirfds));
+	for (int i = 0; i < dc; i++)
+	    fi->dirfds[i] = -1;
+    }
+    if (fi->dirfds[dx] < 0) {
+	/* Failures are retried: the directory may appear later (fsm) */
+	const char *dn = rpmfilesDN(fi, dx);
+	if (dn != NULL) {
+#ifdef O_PATH
+	    fi->dirfds[dx] = open(dn, O_PATH|O_DIRECTORY|O_CLOEXEC);
+#else
+	    fi->dirfds[dx] = open(dn, O_RDONLY|O_DIRECTORY|O_CLOEXEC);
+#endif
+	}
+    }
+    fd = fi->dirfds[dx];
+    pthread_mutex_unlock(&fi->dirfdlock);
+    return fd;
+}
+
 rpmsid rpmfilesBNId(rpmfiles fi, int ix)
 {
     return (fi != NULL) ? rpmfnBNId(&fi->fndata, ix) : 0;
@@ -415,9 +461,55 @@ static int cmpPoolFn(rpmstrPool pool, rpmfn files, int ix, const char * fn)
     return cmp;
 }
 
+static int fnbxCmp(const void *a, const void *b)
+{
+    const struct fnbx_s *fa = a, *fb = b;
+
+    if (fa->id != fb->id)
+	return (fa->id < fb->id) ? -1 : 1;
+    return (fa->ix - fb->ix);
+}
+
+/*
+ * Grab the lazily built, sorted base name id index of a file set.
+ * Lookups can come from a scriptlet pipelining thread concurrently with
+ * the main thread, so the index is published with a compare-and-swap to
+ * make a build race harmless.
+ */
+static struct fnbx_s * rpmfnIndex(rpmfn files)
+{
+    struct fnbx_s *bnx = __atomic_load_n(&files->bnx, __ATOMIC_ACQUIRE);
+
+    if (bnx == NULL) {
+	struct fnbx_s *expected = NULL;
+	int fc = rpmfnFC(files);
+
+	bnx = xmalloc(fc * sizeof(*bnx));
+	for (int i = 0; i < fc; i++) {
+	    bnx[i].id = files->bnid[i];
+	    bnx[i].ix = i;
+	}
+	qsort(bnx, fc, sizeof(*bnx), fnbxCmp);
+
+	if (!__atomic_compare_exchange_n(&files->bnx, &expected, bnx, 0,
+					 __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+	    free(bnx);
+	    bnx = expected;
+	}
+    }
+    return bnx;
+}
+
 static int rpmfnFindFN(rpmstrPool pool, rpmfn files, const char * fn)
 {
     int fc = rpmfnFC(files);
+    const char *bn;
+    rpmsid bnid;
+    struct fnbx_s *bnx;
+    int lo, hi;
+
+    if (fc <= 0)
+	return -1;
 
     /*
      * Skip payload prefix, turn absolute paths into relative. This
@@ -429,28 +521,29 @@ static int rpmfnFindFN(rpmstrPool pool, rpmfn files, const char * fn)
     if (fn[0] == '/')
 	fn += 1;
 
-    /* try binary search */
-
-    int lo = 0;
-    int hi = fc;
-    int mid, cmp;
+    /* A base name unknown to the pool cannot match anything */
+    bn = strrchr(fn, '/');
+    bn = (bn != NULL) ? bn + 1 : fn;
+    bnid = rpmstrPoolId(pool, bn, 0);
+    if (bnid == 0)
+	return -1;
 
+    /* Find the first entry with this base name id */
+    bnx = rpmfnIndex(files);
+    lo = 0;
+    hi = fc;
     while (hi > lo) {
-	mid = (hi + lo) / 2 ;
-	cmp = cmpPoolFn(pool, files, mid, fn);
-	if (cmp < 0) {
-	    lo = mid+1;
-	} else if (cmp > 0) {
+	int mid = (hi + lo) / 2;
+	if (bnx[mid].id < bnid)
+	    lo = mid + 1;
+	else
 	    hi = mid;
-	} else {
-	    return mid;
-	}
     }
 
-    /* not found: try linear search */
-    for (int i=0; i < fc; i++) {
-	if (cmpPoolFn(pool, files, i, fn) == 0)
-	    return i;
+    /* Compare the directories of the (usually lone) candidates */
+    for (; lo < fc && bnx[lo].id == bnid; lo++) {
+	if (cmpPoolFn(pool, files, bnx[lo].ix, fn) == 0)
+	    return bnx[lo].ix;
     }
     return -1;
 }
@@ -754,6 +847,17 @@ rpm_time_t rpmfilesFMtime(rpmfiles fi, int ix)
     return fmtime;
 }
 
+rpm_time_t rpmfilesFCtime(rpmfiles fi, int ix)
+{
+    rpm_time_t fctime = 0;
+
+    if (fi != NULL && ix >= 0 && ix < rpmfilesFC(fi)) {
+	if (fi->fctimes != NULL)
+	    fctime = fi->fctimes[ix];
+    }
+    return fctime;
+}
+
 const char * rpmfilesFUser(rpmfiles fi, int ix)
 {
     const char * fuser = NULL;
@@ -1046,6 +1150,58 @@ exit:
     return equal;
 }
 
+int rpmfileRecordedContentsEqual(rpmfiles ofi, int oix, rpmfiles nfi, int nix)
+{
+    char * fn = rpmfilesFN(nfi, nix);
+    rpmFileTypes diskWhat, newWhat, oldWhat;
+    struct stat sb;
+    int equal = 0;
+
+    if (fn == NULL || (lstat(fn, &sb))) {
+	goto exit; /* The file doesn't exist on the disk */
+    }
+
+    if (rpmfilesFSize(nfi, nix) != sb.st_size ||
+	rpmfilesFSize(ofi, oix) != sb.st_size) {
+	goto exit;
+    }
+
+    diskWhat = rpmfiWhatis((rpm_mode_t)sb.st_mode);
+    newWhat = rpmfiWhatis(rpmfilesFMode(nfi, nix));
+    oldWhat = rpmfiWhatis(rpmfilesFMode(ofi, oix));
+    if ((diskWhat != newWhat) || (diskWhat != oldWhat)) {
+	goto exit;
+    }
+
+    if (diskWhat == REG) {
+	int oalgo, nalgo;
+	size_t odiglen, ndiglen;
+	const unsigned char * odigest, * ndigest;
+
+	/*
+	 * See if the file in the old pkg is identical to the one in the
+	 * new pkg. The digest the old pkg recorded for the disk file is
+	 * trusted, the contents are not re-read.
+	 */
+	odigest = rpmfilesFDigest(ofi, oix, &oalgo, &odiglen);
+	ndigest = rpmfilesFDigest(nfi, nix, &nalgo, &ndiglen);
+	if (odigest && ndigest && oalgo == nalgo && odiglen == ndiglen &&
+	    memcmp(odigest, ndigest, ndiglen) == 0) {
+	    equal = 1;
+	}
+    } else if (diskWhat == LINK) {
+	const char * oFLink = rpmfilesFLink(ofi, oix);
+	const char * nFLink = rpmfilesFLink(nfi, nix);
+
+	if (oFLink && nFLink && rstreq(oFLink, nFLink)) {
+	    equal = 1;
+	}
+    }
+
+exit:
+    free(fn);
+    return equal;
+}
 
 rpmFileAction rpmfilesDecideFate(rpmfiles ofi, int oix,
 				   rpmfiles nfi, int nix,
@@ -1266,6 +1422,15 @@ rpmfiles rpmfilesFree(rpmfiles fi)
     if (fi->nrefs > 1)
 	return rpmfilesUnlink(fi);
 
+    if (fi->dirfds) {
+	for (int i = 0; i < rpmfilesDC(fi); i++) {
+	    if (fi->dirfds[i] >= 0)
+		close(fi->dirfds[i]);
+	}
+	fi->dirfds = _free(fi->dirfds);
+    }
+    pthread_mutex_destroy(&fi->dirfdlock);
+
     if (rpmfilesFC(fi) > 0) {
 	if (fi->ofndata != &fi->fndata) {
 	    rpmfnClear(fi->ofndata);
@@ -1291,6 +1456,7 @@ rpmfiles rpmfilesFree(rpmfiles fi)
 	/* these point to header memory if KEEPHEADER is used, dont free */
 	if (!(fi->fiflags & RPMFI_KEEPHEADER) && fi->h == NULL) {
 	    fi->fmtimes = _free(fi->fmtimes);
+	    fi->fctimes = _free(fi->fctimes);
 	    fi->fmodes = _free(fi->fmodes);
 	    fi->fflags = _free(fi->fflags);
 	    fi->vflags = _free(fi->vflags);
@@ -1334,6 +1500,7 @@ rpmfi rpmfiFree(rpmfi fi)
     fi->fn = _free(fi->fn);
     fi->ofn = _free(fi->ofn);
     fi->found = _free(fi->found);
+    fi->writeOrder = _free(fi->writeOrder);
     fi->archive = rpmcpioFree(fi->archive);
 
     free(fi);
@@ -1667,8 +1834,10 @@ static int rpmfilesPopulate(rpmfiles fi, Header h, rpmfiFlags flags)
     }
 
     /* XXX TR_REMOVED doesn;t need fmtimes, frdevs, finodes */
-    if (!(flags & RPMFI_NOFILEMTIMES))
+    if (!(flags & RPMFI_NOFILEMTIMES)) {
 	_hgfi(h, RPMTAG_FILEMTIMES, &td, scareFlags, fi->fmtimes);
+	_hgfi(h, RPMTAG_INSTALLFILECTIMES, &td, scareFlags, fi->fctimes);
+    }
     if (!(flags & RPMFI_NOFILERDEVS))
 	_hgfi(h, RPMTAG_FILERDEVS, &td, scareFlags, fi->frdevs);
     if (!(flags & RPMFI_NOFILEINODES)) {
@@ -1689,13 +1858,15 @@ static int rpmfilesPopulate(rpmfiles fi, Header h, rpmfiFlags flags)
     return -1;
 }
 
-rpmfiles rpmfilesNew(rpmstrPool pool, Header h, rpmTagVal tagN, rpmfiFlags flags)
+static rpmfiles rpmfilesNewInternal(rpmstrPool pool, Header h,
+				    rpmTagVal tagN, rpmfiFlags flags)
 {
-    rpmfiles fi = xcalloc(1, sizeof(*fi)); 
+    rpmfiles fi = xcalloc(1, sizeof(*fi));
     int fc;
 
     fi->magic = RPMFIMAGIC;
     fi->fiflags = flags;
+    pthread_mutex_init(&fi->dirfdlock, NULL);
     /* private or shared pool? */
     fi->pool = (pool != NULL) ? rpmstrPoolLink(pool) : rpmstrPoolCreate();
 
@@ -1741,6 +1912,16 @@ err:
     return NULL;
 }
 
+rpmfiles rpmfilesNew(rpmstrPool pool, Header h, rpmTagVal tagN, rpmfiFlags flags)
+{
+    rpmfiles fi;
+
+    rpmMemTagPush(RPMMEM_FILES);
+    fi = rpmfilesNewInternal(pool, h, tagN, flags);
+    rpmMemTagPop();
+    return fi;
+}
+
 static int iterWriteArchiveNext(rpmfi fi);
 static int iterReadArchiveNext(rpmfi fi);
 static int iterReadArchiveNextContentFirst(rpmfi fi);
@@ -2035,6 +2216,21 @@ rpmfi rpmfiNewArchiveWriter(FD_t fd, rpmfiles files)
     return fi;
 }
 
+int rpmfiArchiveSetWriteOrder(rpmfi fi, const int * order)
+{
+    if (fi == NULL || fi->archive == NULL || order == NULL)
+	return -1;
+    /* Only makes sense on a writer that hasn't started iterating yet */
+    if (fi->next != iterWriteArchiveNext || fi->i >= 0)
+	return -1;
+
+    free(fi->writeOrder);
+    fi->writeOrder = xmalloc(rpmfiFC(fi) * sizeof(*fi->writeOrder));
+    memcpy(fi->writeOrder, order, rpmfiFC(fi) * sizeof(*fi->writeOrder));
+    fi->writeOrderIx = 0;
+    return 0;
+}
+
 int rpmfiArchiveClose(rpmfi fi)
 {
     if (fi == NULL)
@@ -2081,8 +2277,28 @@ static int iterWriteArchiveNextFile(rpmfi fi)
     const int * hardlinks;
     int numHardlinks = 0;
 
+    if (fi->writeOrder != NULL) {
+	/* follow the explicitly requested file order */
+	fi->i = -1;
+	while (fi->writeOrderIx < fc) {
+	    int i = fi->writeOrder[fi->writeOrderIx++];
+
+	    if (i < 0 || i >= fc)
+		continue;
+	    /* no ghosts */
+	    if (rpmfilesFFlags(files, i) & RPMFILE_GHOST)
+		continue;
+	    numHardlinks = rpmfilesFLinks(files, i, &hardlinks);
+	    /* hard link sets are emitted in one go, with their first member */
+	    if (numHardlinks > 1 && hardlinks[0] != i) {
+		numHardlinks = 0;
+		continue;
+	    }
+	    rpmfiSetFX(fi, i);
+	    break;
+	}
     /* already processing hard linked files */
-    if (rpmfiFNlink(fi) > 1) {
+    } else if (rpmfiFNlink(fi) > 1) {
 	/* search next hard linked file */
 	fi->i = -1;
 	for (int i=fx+1; i<fc; i++) {
@@ -2366,13 +2582,20 @@ int rpmfiArchiveReadToFilePsm(rpmfi fi, FD_t fd, int nodigest, rpmpsm psm)
     rpm_loff_t left = rpmfiFSize(fi);
     const unsigned char * fidigest = NULL;
     pgpHashAlgo digestalgo = 0;
+    DIGEST_CTX ctx = NULL;
+    int sparse = (rpmfiFFlags(fi) & RPMFILE_SPARSE) ? 1 : 0;
+    int hole = 0;
     int rc = 0;
     char buf[BUFSIZ*4];
 
     if (!nodigest) {
 	digestalgo = rpmfiDigestAlgo(fi);
 	fidigest = rpmfilesFDigest(fi->files, rpmfiFX(fi), NULL, NULL);
-	fdInitDigest(fd, digestalgo, 0);
+	/* Holes are never written, digest the archive data directly */
+	if (sparse)
+	    ctx = rpmDigestInit(digestalgo, RPMDIGEST_NONE);
+	else
+	    fdInitDigest(fd, digestalgo, 0);
     }
 
     while (left) {
@@ -2382,20 +2605,42 @@ int rpmfiArchiveReadToFilePsm(rpmfi fi, FD_t fd, int nodigest, rpmpsm psm)
 	    rc = RPMERR_READ_FAILED;
 	    goto exit;
 	}
-	if ((Fwrite(buf, sizeof(*buf), len, fd) != len) || Ferror(fd)) {
-	    rc = RPMERR_WRITE_FAILED;
-	    goto exit;
+	if (ctx)
+	    rpmDigestUpdate(ctx, buf, len);
+	if (sparse && buf[0] == '\0' && memcmp(buf, buf + 1, len - 1) == 0) {
+	    if (lseek(Fileno(fd), (off_t)len, SEEK_CUR) < 0) {
+		rc = RPMERR_WRITE_FAILED;
+		goto exit;
+	    }
+	    hole = 1;
+	} else {
+	    if ((Fwrite(buf, sizeof(*buf), len, fd) != len) || Ferror(fd)) {
+		rc = RPMERR_WRITE_FAILED;
+		goto exit;
+	    }
+	    hole = 0;
 	}
 
 	rpmpsmNotify(psm, RPMCALLBACK_INST_PROGRESS, rpmfiArchiveTell(fi));
 	left -= len;
     }
 
+    /* A trailing hole only materializes once the size says so */
+    if (hole && ftruncate(Fileno(fd), (off_t)rpmfiFSize(fi)) != 0) {
+	rc = RPMERR_WRITE_FAILED;
+	goto exit;
+    }
+
     if (!nodigest) {
 	void * digest = NULL;
 
 	(void) Fflush(fd);
-	fdFiniDigest(fd, digestalgo, &digest, NULL, 0);
+	if (ctx) {
+	    rpmDigestFinal(ctx, &digest, NULL, 0);
+	    ctx = NULL;
+	} else {
+	    fdFiniDigest(fd, digestalgo, &digest, NULL, 0);
+	}
 
 	if (digest != NULL && fidigest != NULL) {
 	    size_t diglen = rpmDigestLength(digestalgo);
@@ -2417,6 +2662,8 @@ int rpmfiArchiveReadToFilePsm(rpmfi fi, FD_t fd, int nodigest, rpmpsm psm)
     }
 
 exit:
+    if (ctx)
+	rpmDigestFinal(ctx, NULL, NULL, 0);
     return rc;
 }
 
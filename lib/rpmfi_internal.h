@@ -40,6 +40,20 @@ rpmsid rpmfiDNId(rpmfi fi);
 RPM_GNUC_INTERNAL
 rpmsid rpmfilesBNId(rpmfiles fi, int ix);
 
+/** \ingroup rpmfi
+ * Return a cached open fd for the directory of a file, for
+ * dirfd-relative stat/open calls that skip the shared path prefix
+ * walk. Opened lazily, one per directory, kept open (and retried on
+ * earlier failure, directories can appear mid-transaction) until the
+ * file info set is freed. Thread safe.
+ * @param fi		file info set
+ * @param ix		file index
+ * @return		directory fd, -1 when unavailable (caller must
+ *			fall back to full path calls, and not close it)
+ */
+RPM_GNUC_INTERNAL
+int rpmfilesDirFd(rpmfiles fi, int ix);
+
 RPM_GNUC_INTERNAL
 rpmsid rpmfilesDNId(rpmfiles fi, int jx);
 
@@ -79,6 +93,19 @@ struct fingerPrint_s *rpmfilesFps(rpmfiles fi);
 RPM_GNUC_INTERNAL
 int rpmfileContentsEqual(rpmfiles ofi, int oix, rpmfiles nfi, int nix);
 
+/** \ingroup rpmfi
+ * Check if the recorded contents (digest or link target) of the file in
+ * the new and old package are the same, without reading file data from
+ * the disk. Only a cheap lstat() sanity check is done on the disk file.
+ * @param 	old file info set
+ * @param 	old file index
+ * @param 	new file info set
+ * @param 	new file index
+ * @return	1 if the condition is satisfied, 0 otherwise
+ */
+RPM_GNUC_INTERNAL
+int rpmfileRecordedContentsEqual(rpmfiles ofi, int oix, rpmfiles nfi, int nix);
+
 
 RPM_GNUC_INTERNAL
 rpmFileAction rpmfilesDecideFate(rpmfiles ofi, int oix,
@@ -57,7 +57,8 @@ enum rpmfileAttrs_e {
     RPMFILE_GHOST	= (1 <<  6),	/*!< from %%ghost */
     RPMFILE_LICENSE	= (1 <<  7),	/*!< from %%license */
     RPMFILE_README	= (1 <<  8),	/*!< from %%readme */
-    /* bits 9-10 unused */
+    RPMFILE_SPARSE	= (1 <<  9),	/*!< stored sparse at build time */
+    /* bit 10 unused */
     RPMFILE_PUBKEY	= (1 << 11),	/*!< from %%pubkey */
     RPMFILE_ARTIFACT	= (1 << 12),	/*!< from %%artifact */
 };
@@ -512,6 +513,14 @@ rpm_ino_t rpmfilesFInode(rpmfiles fi, int ix);
  */
 rpm_time_t rpmfilesFMtime(rpmfiles fi, int ix);
 
+/** \ingroup rpmfiles
+ * Return file change time recorded after install from file info set.
+ * @param fi		file info set
+ * @param ix		file index
+ * @return		file change time, 0 if not recorded or invalid
+ */
+rpm_time_t rpmfilesFCtime(rpmfiles fi, int ix);
+
 /** \ingroup rpmfiles
  * Return file owner from file info set.
  * @param fi		file info set
@@ -7,17 +7,23 @@ struct rpmfs_s {
 
     rpm_fstate_t * states;
     rpmFileAction * actions;	/*!< File disposition(s). */
+    uint64_t * skips;		/*!< Packed XFA_SKIPPING() bits per file */
 
     sharedFileInfo replaced;	/*!< (TR_ADDED) to be replaced files in the rpmdb */
     int numReplaced;
     int allocatedReplaced;
 };
 
+#define SKIP_WORD(_ix)	((_ix) >> 6)
+#define SKIP_BIT(_ix)	(UINT64_C(1) << ((_ix) & 63))
+#define SKIP_NWORDS(_fc) (SKIP_WORD(_fc) + 1)
+
 rpmfs rpmfsNew(rpm_count_t fc, int initState)
 {
     rpmfs fs = xcalloc(1, sizeof(*fs));
     fs->fc = fc;
     fs->actions = xmalloc(fs->fc * sizeof(*fs->actions));
+    fs->skips = xcalloc(SKIP_NWORDS(fs->fc), sizeof(*fs->skips));
     rpmfsResetActions(fs);
     if (initState) {
 	fs->states = xmalloc(sizeof(*fs->states) * fs->fc);
@@ -32,6 +38,7 @@ rpmfs rpmfsFree(rpmfs fs)
 	free(fs->replaced);
 	free(fs->states);
 	free(fs->actions);
+	free(fs->skips);
 	memset(fs, 0, sizeof(*fs)); /* trash and burn */
 	free(fs);
     }
@@ -113,12 +120,42 @@ void rpmfsSetAction(rpmfs fs, unsigned int ix, rpmFileAction action)
 {
     if (fs->actions != NULL && ix < fs->fc) {
 	fs->actions[ix] = action;
+	if (XFA_SKIPPING(action))
+	    fs->skips[SKIP_WORD(ix)] |= SKIP_BIT(ix);
+	else
+	    fs->skips[SKIP_WORD(ix)] &= ~SKIP_BIT(ix);
+    }
+}
+
+unsigned int rpmfsSkippedRun(rpmfs fs, unsigned int ix)
+{
+    unsigned int end = ix;
+
+    if (fs == NULL || fs->actions == NULL || ix >= fs->fc)
+	return 0;
+
+    while (end < fs->fc) {
+	uint64_t w = fs->skips[SKIP_WORD(end)];
+	uint64_t rest = ~UINT64_C(0) << (end & 63);
+
+	/* Rest of the word all skipped: take it in one go */
+	if ((w & rest) == rest) {
+	    end = (end | 63) + 1;
+	    continue;
+	}
+	if (!(w & SKIP_BIT(end)))
+	    break;
+	end++;
     }
+    if (end > fs->fc)
+	end = fs->fc;
+    return end - ix;
 }
 
 void rpmfsResetActions(rpmfs fs)
 {
     if (fs && fs->actions) {
 	memset(fs->actions, FA_UNKNOWN, fs->fc * sizeof(*fs->actions));
+	memset(fs->skips, 0, SKIP_NWORDS(fs->fc) * sizeof(*fs->skips));
     }
 }
@@ -57,6 +57,15 @@ rpmFileAction rpmfsGetAction(rpmfs fs, unsigned int ix);
 RPM_GNUC_INTERNAL
 void rpmfsSetAction(rpmfs fs, unsigned int ix, rpmFileAction action);
 
+/** \ingroup rpmfs
+ * Length of the run of skipped (XFA_SKIPPING) files starting at ix,
+ * 0 if the file at ix is not skipped. Evaluated word-at-a-time from
+ * a packed bitset, so scans can jump over skipped stretches without
+ * visiting each file.
+ */
+RPM_GNUC_INTERNAL
+unsigned int rpmfsSkippedRun(rpmfs fs, unsigned int ix);
+
 RPM_GNUC_INTERNAL
 void rpmfsResetActions(rpmfs fs);
 
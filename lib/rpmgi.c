@@ -4,6 +4,7 @@
 #include "system.h"
 
 #include <errno.h>
+#include <pthread.h>
 
 #include <rpm/rpmtypes.h>
 #include <rpm/rpmlib.h>		/* rpmReadPackageFile */
@@ -15,6 +16,10 @@
 #include "lib/rpmgi.h"
 #include "lib/manifest.h"
 
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+
 #include "debug.h"
 
 #define MANIFEST_RECURSIONS 1000 /* Max. number of allowed manifest recursions */
@@ -22,6 +27,47 @@
 RPM_GNUC_INTERNAL
 rpmgiFlags giFlags = RPMGI_NONE;
 
+/*
+ * One retained header: the export blob, zstd-compressed when that
+ * actually shrinks it, plus the NEVRA kept uncompressed for bookkeeping
+ * between passes without inflating the header.
+ */
+struct giRetained_s {
+    void *blob;			/*!< Header export blob */
+    unsigned int clen;		/*!< Stored (possibly compressed) size */
+    unsigned int ulen;		/*!< Uncompressed size (0: stored as is) */
+    char *nevra;		/*!< Uncompressed hot-tag sidecar */
+};
+
+/* Slots of prefetched results per reader thread */
+#define GI_PREFETCH_DEPTH 4
+
+struct giSlot_s {
+    Header h;			/*!< Parsed header (NULL on failure) */
+    int opened;			/*!< Could the file at least be opened? */
+    int done;			/*!< Slot filled by a reader */
+};
+
+/*
+ * Look-ahead reader pool (%_query_threads). Readers claim argument
+ * indices in order and park the parsed headers in a bounded ring the
+ * consumer drains in argument order, so output stays stable. Anything
+ * that doesn't parse as a package (a manifest, say) stops the pool and
+ * is redone serially, since manifest expansion rewrites the arg list.
+ */
+struct giPrefetch_s {
+    pthread_t *tids;
+    int nthreads;
+    int window;			/*!< Ring size (covers [consumer,+window)) */
+    struct giSlot_s *slots;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    int next;			/*!< Next index to claim */
+    int consumer;		/*!< Consumer position */
+    int limit;			/*!< Argument count at spawn */
+    int stop;
+};
+
 /** \ingroup rpmgi
  */
 struct rpmgi_s {
@@ -37,6 +83,13 @@ struct rpmgi_s {
     int curLvl;			/*!< Current recursion level */
     int	recLvls[MANIFEST_RECURSIONS]; /*!< Reversed end index for given level */
 
+    struct giRetained_s *retained; /*!< Retained headers (RPMGI_RETAIN) */
+    int nretained;
+    int retainAlloced;
+    int retainDone;		/*!< First pass complete, serve from memory */
+
+    int nthreads;		/*!< Configured reader threads */
+    struct giPrefetch_s *prefetch; /*!< Active reader pool (or NULL) */
 };
 
 /**
@@ -162,6 +215,108 @@ static Header rpmgiLoadReadHeader(rpmgi gi)
 }
 
 
+static void *giPrefetchWorker(void *data)
+{
+    rpmgi gi = data;
+    struct giPrefetch_s *pf = gi->prefetch;
+
+    pthread_mutex_lock(&pf->lock);
+    while (!pf->stop && pf->next < pf->limit) {
+	struct giSlot_s *slot;
+	Header h = NULL;
+	int ix, opened;
+
+	if (pf->next >= pf->consumer + pf->window) {
+	    pthread_cond_wait(&pf->cond, &pf->lock);
+	    continue;
+	}
+	ix = pf->next++;
+	pthread_mutex_unlock(&pf->lock);
+
+	opened = rpmgiReadHeader(gi, gi->argv[ix], &h);
+
+	pthread_mutex_lock(&pf->lock);
+	slot = &pf->slots[ix % pf->window];
+	slot->h = h;
+	slot->opened = opened;
+	slot->done = 1;
+	pthread_cond_broadcast(&pf->cond);
+    }
+    pthread_mutex_unlock(&pf->lock);
+    return NULL;
+}
+
+static void giPrefetchStart(rpmgi gi)
+{
+    struct giPrefetch_s *pf = xcalloc(1, sizeof(*pf));
+
+    pf->nthreads = gi->nthreads;
+    if (pf->nthreads > gi->argc - gi->i)
+	pf->nthreads = gi->argc - gi->i;
+    pf->window = pf->nthreads * GI_PREFETCH_DEPTH;
+    pf->slots = xcalloc(pf->window, sizeof(*pf->slots));
+    pf->next = gi->i;
+    pf->consumer = gi->i;
+    pf->limit = gi->argc;
+    pthread_mutex_init(&pf->lock, NULL);
+    pthread_cond_init(&pf->cond, NULL);
+
+    gi->prefetch = pf;
+    pf->tids = xcalloc(pf->nthreads, sizeof(*pf->tids));
+    for (int i = 0; i < pf->nthreads; i++)
+	pthread_create(&pf->tids[i], NULL, giPrefetchWorker, gi);
+}
+
+static void giPrefetchStop(rpmgi gi)
+{
+    struct giPrefetch_s *pf = gi->prefetch;
+
+    if (pf == NULL)
+	return;
+
+    pthread_mutex_lock(&pf->lock);
+    pf->stop = 1;
+    pthread_cond_broadcast(&pf->cond);
+    pthread_mutex_unlock(&pf->lock);
+    for (int i = 0; i < pf->nthreads; i++)
+	pthread_join(pf->tids[i], NULL);
+
+    for (int i = 0; i < pf->window; i++)
+	headerFree(pf->slots[i].h);
+    pthread_mutex_destroy(&pf->lock);
+    pthread_cond_destroy(&pf->cond);
+    free(pf->slots);
+    free(pf->tids);
+    free(pf);
+    gi->prefetch = NULL;
+}
+
+/**
+ * Fetch the result for the current element, waiting for its reader.
+ * @param gi		generalized iterator
+ * @param[out] opened	could the file be opened?
+ * @return		header, NULL on failure
+ */
+static Header giPrefetchNext(rpmgi gi, int *opened)
+{
+    struct giPrefetch_s *pf = gi->prefetch;
+    struct giSlot_s *slot;
+    Header h;
+
+    pthread_mutex_lock(&pf->lock);
+    pf->consumer = gi->i;
+    pthread_cond_broadcast(&pf->cond);
+    slot = &pf->slots[gi->i % pf->window];
+    while (!slot->done)
+	pthread_cond_wait(&pf->cond, &pf->lock);
+    h = slot->h;
+    *opened = slot->opened;
+    slot->h = NULL;
+    slot->done = 0;
+    pthread_mutex_unlock(&pf->lock);
+    return h;
+}
+
 /**
  * Append globbed arg list to iterator.
  * @param gi		generalized iterator
@@ -192,12 +347,89 @@ static void rpmgiGlobArgv(rpmgi gi, ARGV_const_t argv)
     return;
 }
 
+/**
+ * Retain a header for later passes.
+ * @param gi		generalized iterator
+ * @param h		header to retain
+ */
+static void giRetainHeader(rpmgi gi, Header h)
+{
+    struct giRetained_s *r;
+    unsigned int blen = 0;
+    void *blob = headerExport(h, &blen);
+
+    if (blob == NULL)
+	return;
+
+    if (gi->nretained == gi->retainAlloced) {
+	gi->retainAlloced = gi->retainAlloced ? gi->retainAlloced * 2 : 64;
+	gi->retained = xrealloc(gi->retained,
+				gi->retainAlloced * sizeof(*gi->retained));
+    }
+    r = &gi->retained[gi->nretained++];
+    r->blob = blob;
+    r->clen = blen;
+    r->ulen = 0;
+    r->nevra = headerGetAsString(h, RPMTAG_NEVRA);
+
+#ifdef HAVE_ZSTD
+    {
+	size_t maxc = ZSTD_compressBound(blen);
+	void *cblob = xmalloc(maxc);
+	size_t clen = ZSTD_compress(cblob, maxc, blob, blen, 3);
+
+	if (!ZSTD_isError(clen) && clen < blen) {
+	    free(blob);
+	    r->blob = xrealloc(cblob, clen);
+	    r->clen = clen;
+	    r->ulen = blen;
+	} else {
+	    free(cblob);
+	}
+    }
+#endif
+}
+
+/**
+ * Instantiate a retained header, decompressing on demand.
+ * @param r		retained element
+ * @return		header (new reference), NULL on failure
+ */
+static Header giRetainedHeader(struct giRetained_s *r)
+{
+    Header h = NULL;
+
+    if (r->ulen > 0) {
+#ifdef HAVE_ZSTD
+	void *ublob = xmalloc(r->ulen);
+
+	if (!ZSTD_isError(ZSTD_decompress(ublob, r->ulen, r->blob, r->clen))) {
+	    /* zero-copy import: the header takes ownership of the buffer */
+	    h = headerImport(ublob, r->ulen, HEADERIMPORT_FAST);
+	}
+	if (h == NULL)
+	    free(ublob);
+#endif
+    } else {
+	/* stored uncompressed, import a copy to keep the blob reusable */
+	h = headerImport(r->blob, r->clen, HEADERIMPORT_COPY);
+    }
+    return h;
+}
+
 rpmgi rpmgiFree(rpmgi gi)
 {
     if (gi != NULL) {
+	giPrefetchStop(gi);
 	rpmtsFree(gi->ts);
 	argvFree(gi->argv);
 
+	for (int i = 0; i < gi->nretained; i++) {
+	    free(gi->retained[i].blob);
+	    free(gi->retained[i].nevra);
+	}
+	free(gi->retained);
+
 	memset(gi, 0, sizeof(*gi)); /* XXX trash and burn */
 	free(gi);
     }
@@ -221,6 +453,8 @@ rpmgi rpmgiNew(rpmts ts, rpmgiFlags flags, ARGV_const_t argv)
     gi->curLvl = 0;
     gi->recLvls[gi->curLvl] = 1;
 
+    gi->nthreads = rpmExpandNumeric("%{?_query_threads}");
+
     return gi;
 }
 
@@ -228,21 +462,58 @@ Header rpmgiNext(rpmgi gi)
 {
     Header h = NULL;
 
-    if (gi != NULL && ++gi->i >= 0) {
-	/* 
+    if (gi == NULL)
+	return NULL;
+
+    /* Repeat passes are served from the retained set, no I/O involved */
+    if (gi->retainDone) {
+	if (++gi->i >= 0 && gi->i < gi->nretained)
+	    h = giRetainedHeader(&gi->retained[gi->i]);
+	if (h == NULL)
+	    gi->i = -1;
+	return h;
+    }
+
+    if (++gi->i >= 0) {
+	/*
  	 * Read next header, lazily expanding manifests as found,
  	 * count + skip errors.
  	 */
 	while (gi->i < gi->argc) {
-	    if ((h = rpmgiLoadReadHeader(gi)) != NULL) 
+	    if (gi->nthreads > 1 && gi->prefetch == NULL &&
+		    gi->argc - gi->i > 1)
+		giPrefetchStart(gi);
+
+	    if (gi->prefetch != NULL) {
+		int opened = 0;
+		if ((h = giPrefetchNext(gi, &opened)) != NULL)
+		    break;
+		if (!opened) {
+		    /* Open failed (already reported), on to the next */
+		    gi->errors++;
+		    gi->i++;
+		    continue;
+		}
+		/* Not a package: possibly a manifest, redo serially */
+		giPrefetchStop(gi);
+	    }
+
+	    if ((h = rpmgiLoadReadHeader(gi)) != NULL)
 		break;
 	    gi->errors++;
 	    gi->i++;
         }
 
+	if (h != NULL && (gi->flags & RPMGI_RETAIN))
+	    giRetainHeader(gi, h);
+
 	/* Out of things to try, end of iteration */
-	if (h == NULL)
+	if (h == NULL) {
+	    giPrefetchStop(gi);
 	    gi->i = -1;
+	    if (gi->flags & RPMGI_RETAIN)
+		gi->retainDone = 1;
+	}
     }
 
     return h;
@@ -252,3 +523,15 @@ int rpmgiNumErrors(rpmgi gi)
 {
     return (gi != NULL ? gi->errors : -1);
 }
+
+const char * rpmgiNEVRA(rpmgi gi)
+{
+    const char *nevra = NULL;
+
+    if (gi != NULL && (gi->flags & RPMGI_RETAIN)) {
+	int i = gi->retainDone ? gi->i : gi->nretained - 1;
+	if (i >= 0 && i < gi->nretained)
+	    nevra = gi->retained[i].nevra;
+    }
+    return nevra;
+}
@@ -18,6 +18,11 @@ enum rpmgiFlags_e {
     RPMGI_NONE		= 0,
     RPMGI_NOGLOB	= (1 << 2),
     RPMGI_NOMANIFEST	= (1 << 3),
+    RPMGI_RETAIN	= (1 << 4),	/*!< Retain headers in memory
+					  (zstd-compressed); once the first
+					  pass completes, further passes are
+					  served from the retained set with
+					  no file I/O. */
 };
 
 typedef rpmFlags rpmgiFlags;
@@ -58,6 +63,15 @@ Header rpmgiNext(rpmgi gi);
 RPM_GNUC_INTERNAL
 int rpmgiNumErrors(rpmgi gi);
 
+/** \ingroup rpmgi
+ * Return the NEVRA of the current element of a retaining iterator.
+ * Available on any pass without decompressing the retained header.
+ * @param gi		generalized iterator (RPMGI_RETAIN mode)
+ * @return		NEVRA string (or NULL), owned by the iterator
+ */
+RPM_GNUC_INTERNAL
+const char * rpmgiNEVRA(rpmgi gi);
+
 #ifdef __cplusplus
 }
 #endif
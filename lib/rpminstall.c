@@ -4,11 +4,14 @@
 
 #include "system.h"
 
+#include <pthread.h>
+
 #include <rpm/rpmcli.h>
 #include <rpm/rpmtag.h>
 #include <rpm/rpmlib.h>		/* rpmReadPackageFile, vercmp etc */
 #include <rpm/rpmdb.h>
 #include <rpm/rpmds.h>
+#include <rpm/rpmkeyring.h>
 #include <rpm/rpmts.h>
 #include <rpm/rpmsq.h>
 #include <rpm/rpmlog.h>
@@ -233,6 +236,16 @@ static void setNotifyFlag(struct rpmInstallArguments_s * ia,
     rpmtsSetNotifyCallback(ts, rpmShowProgress, (void *) ((long)notifyFlags));
 }
 
+/**
+ * Package header read ahead of the transaction building loop,
+ * indexed like rpmEIU.pkgURL.
+ */
+struct hdrPrefetch_s {
+    Header h;
+    rpmRC rpmrc;
+    int done;
+};
+
 struct rpmEIU {
     int numFailed;
     int numPkgs;
@@ -248,6 +261,8 @@ struct rpmEIU {
     char ** argv;
     rpmRelocation * relocations;
     rpmRC rpmrc;
+    struct hdrPrefetch_s * prefetch;
+    int prefetchAlloced;
 };
 
 static int rpmcliTransaction(rpmts ts, struct rpmInstallArguments_s * ia,
@@ -336,25 +351,36 @@ static int tryReadManifest(struct rpmEIU * eiu)
 
 static int tryReadHeader(rpmts ts, struct rpmEIU * eiu, Header * hdrp)
 {
-   /* Try to read the header from a package file. */
-   FD_t fd = Fopen(*eiu->fnp, "r.ufdio");
-   if (fd == NULL || Ferror(fd)) {
-       rpmlog(RPMLOG_ERR, _("open of %s failed: %s\n"), *eiu->fnp,
-	      Fstrerror(fd));
-       if (fd != NULL) {
-           Fclose(fd);
-	   fd = NULL;
+   /* Use the header read ahead by prefetchHeaders() if there is one. */
+   if (eiu->prefetch != NULL && eiu->prefetch[eiu->prevx].done) {
+       struct hdrPrefetch_s * slot = &eiu->prefetch[eiu->prevx];
+
+       eiu->rpmrc = slot->rpmrc;
+       *hdrp = slot->h;
+       slot->h = NULL;
+       slot->done = 0;
+   } else {
+       /* Try to read the header from a package file. */
+       FD_t fd = Fopen(*eiu->fnp, "r.ufdio");
+       if (fd == NULL || Ferror(fd)) {
+	   rpmlog(RPMLOG_ERR, _("open of %s failed: %s\n"), *eiu->fnp,
+		  Fstrerror(fd));
+	   if (fd != NULL) {
+	       Fclose(fd);
+	       fd = NULL;
+	   }
+	   eiu->numFailed++;
+	   *eiu->fnp = NULL;
+	   return RPMRC_FAIL;
        }
-       eiu->numFailed++;
-       *eiu->fnp = NULL;
-       return RPMRC_FAIL;
+
+       /* Read the header, verifying signatures (if present). */
+       eiu->rpmrc = rpmReadPackageFile(ts, fd, *eiu->fnp, hdrp);
+       Fclose(fd);
+       fd = NULL;
    }
 
-   /* Read the header, verifying signatures (if present). */
-   eiu->rpmrc = rpmReadPackageFile(ts, fd, *eiu->fnp, hdrp);
-   Fclose(fd);
-   fd = NULL;
-   
+
    /* Honor --nomanifest */
    if (eiu->rpmrc == RPMRC_NOTFOUND && (giFlags & RPMGI_NOMANIFEST))
        eiu->rpmrc = RPMRC_FAIL;
@@ -368,6 +394,97 @@ static int tryReadHeader(rpmts ts, struct rpmEIU * eiu, Header * hdrp)
    return RPMRC_OK;
 }
 
+struct hdrPrefetchJob_s {
+    rpmts ts;
+    char ** pkgURL;
+    struct hdrPrefetch_s * slots;
+    int first;
+    int last;
+    int nthreads;
+    int tid;
+};
+
+static void * prefetchWorker(void * data)
+{
+    struct hdrPrefetchJob_s * job = data;
+
+    for (int i = job->first + job->tid; i < job->last; i += job->nthreads) {
+	struct hdrPrefetch_s * slot = &job->slots[i];
+	FD_t fd = Fopen(job->pkgURL[i], "r.ufdio");
+
+	/* Leave open failures for the serial pass to diagnose. */
+	if (fd == NULL || Ferror(fd)) {
+	    if (fd != NULL)
+		Fclose(fd);
+	    continue;
+	}
+	slot->rpmrc = rpmReadPackageFile(job->ts, fd, job->pkgURL[i], &slot->h);
+	Fclose(fd);
+	slot->done = 1;
+    }
+    return NULL;
+}
+
+/**
+ * Read the headers of the current batch of package arguments on worker
+ * threads, ahead of the serial transaction building loop. Concurrent
+ * rpmReadPackageFile() calls only share the transaction keyring (which
+ * is rwlock protected), elements are independent until the add step.
+ * The keyring is loaded up front to keep the lazy load out of the
+ * workers. Controlled by the %_install_readahead macro, off by default.
+ * @param ts		transaction set
+ * @param eiu		install state, batch is [prevx..pkgx)
+ */
+static void prefetchHeaders(rpmts ts, struct rpmEIU * eiu)
+{
+    int nthreads = rpmExpandNumeric("%{?_install_readahead}");
+    int count = eiu->pkgx - eiu->prevx;
+    struct hdrPrefetchJob_s *jobs = NULL;
+    pthread_t *threads = NULL;
+    int started = 0;
+
+    /* Manifest restarts must find valid slots for the new range. */
+    if (eiu->prefetch != NULL && eiu->numPkgs > eiu->prefetchAlloced) {
+	eiu->prefetch = xrealloc(eiu->prefetch,
+			eiu->numPkgs * sizeof(*eiu->prefetch));
+	memset(eiu->prefetch + eiu->prefetchAlloced, 0,
+	       (eiu->numPkgs - eiu->prefetchAlloced) * sizeof(*eiu->prefetch));
+	eiu->prefetchAlloced = eiu->numPkgs;
+    }
+
+    if (nthreads <= 1 || count < 16)
+	return;
+    if (nthreads > count)
+	nthreads = count;
+
+    if (eiu->prefetch == NULL) {
+	eiu->prefetch = xcalloc(eiu->numPkgs, sizeof(*eiu->prefetch));
+	eiu->prefetchAlloced = eiu->numPkgs;
+    }
+
+    rpmKeyringFree(rpmtsGetKeyring(ts, 1));
+
+    jobs = xcalloc(nthreads, sizeof(*jobs));
+    threads = xcalloc(nthreads, sizeof(*threads));
+    for (started = 0; started < nthreads; started++) {
+	struct hdrPrefetchJob_s *job = &jobs[started];
+	job->ts = ts;
+	job->pkgURL = eiu->pkgURL;
+	job->slots = eiu->prefetch;
+	job->first = eiu->prevx;
+	job->last = eiu->pkgx;
+	job->nthreads = nthreads;
+	job->tid = started;
+	if (pthread_create(&threads[started], NULL, prefetchWorker, job))
+	    break;
+    }
+    /* Unfetched slots just fall back to the serial read. */
+    for (int i = 0; i < started; i++)
+	pthread_join(threads[i], NULL);
+
+    free(threads);
+    free(jobs);
+}
 
 /* On --freshen, verify package is installed and newer */
 static int checkFreshenStatus(rpmts ts, Header h)
@@ -483,56 +600,94 @@ restart:
 			((eiu->argc + 1) * sizeof(*eiu->pkgState)));
     }
 
-    /* Retrieve next set of args, cache on local storage. */
-    for (i = 0; i < eiu->argc; i++) {
-	fileURL = _free(fileURL);
-	fileURL = eiu->argv[i];
-	eiu->argv[i] = NULL;
-
-	switch (urlIsURL(fileURL)) {
-	case URL_IS_HTTPS:
-	case URL_IS_HTTP:
-	case URL_IS_FTP:
-	{   char *tfn = NULL;
+    /* Retrieve next set of args, cache on local storage. Remote
+     * transfers run through a window of concurrent url helpers so the
+     * next download starts while the previous one is still in flight. */
+    {	urlFetch *fetches = xcalloc(eiu->argc + 1, sizeof(*fetches));
+	char **tfns = xcalloc(eiu->argc + 1, sizeof(*tfns));
+	int maxfetch = rpmExpandNumeric("%{?_url_prefetch}");
+	int inflight = 0;
+	int lag = 0;
+
+	if (maxfetch < 1)
+	    maxfetch = 2;
+
+	for (i = 0; i < eiu->argc; i++) {
 	    FD_t tfd;
 
-	    if (rpmIsVerbose())
-		fprintf(stdout, _("Retrieving %s\n"), fileURL);
+	    switch (urlIsURL(eiu->argv[i])) {
+	    case URL_IS_HTTPS:
+	    case URL_IS_HTTP:
+	    case URL_IS_FTP:
+		if (rpmIsVerbose())
+		    fprintf(stdout, _("Retrieving %s\n"), eiu->argv[i]);
+
+		tfd = rpmMkTempFile(rpmtsRootDir(ts), &tfns[i]);
+		if (tfd && tfns[i]) {
+		    Fclose(tfd);
+		    fetches[i] = urlGetFileAsync(eiu->argv[i], tfns[i]);
+		    inflight++;
+		} else {
+		    tfns[i] = _free(tfns[i]);
+		}
 
-	    tfd = rpmMkTempFile(rpmtsRootDir(ts), &tfn);
-	    if (tfd && tfn) {
-		Fclose(tfd);
-	    	rc = urlGetFile(fileURL, tfn);
-	    } else {
-		rc = -1;
+		/* Window full, reap the oldest transfer first */
+		while (inflight >= maxfetch) {
+		    while (fetches[lag] == NULL)
+			lag++;
+		    if (urlGetFileWait(&fetches[lag]) != 0)
+			tfns[lag] = _free(tfns[lag]);
+		    inflight--;
+		}
+		break;
+	    default:
+		break;
 	    }
+	}
 
-	    if (rc != 0) {
-		rpmlog(RPMLOG_ERR,
-			_("skipping %s - transfer failed\n"), fileURL);
-		eiu->numFailed++;
-		eiu->pkgURL[eiu->pkgx] = NULL;
-		tfn = _free(tfn);
+	for (i = 0; i < eiu->argc; i++) {
+	    fileURL = _free(fileURL);
+	    fileURL = eiu->argv[i];
+	    eiu->argv[i] = NULL;
+
+	    switch (urlIsURL(fileURL)) {
+	    case URL_IS_HTTPS:
+	    case URL_IS_HTTP:
+	    case URL_IS_FTP:
+		if (fetches[i] != NULL && urlGetFileWait(&fetches[i]) != 0)
+		    tfns[i] = _free(tfns[i]);
+
+		if (tfns[i] == NULL) {
+		    rpmlog(RPMLOG_ERR,
+			    _("skipping %s - transfer failed\n"), fileURL);
+		    eiu->numFailed++;
+		    eiu->pkgURL[eiu->pkgx] = NULL;
+		    break;
+		}
+		eiu->pkgState[eiu->pkgx] = 1;
+		eiu->pkgURL[eiu->pkgx] = tfns[i];
+		tfns[i] = NULL;
+		eiu->pkgx++;
+		break;
+	    case URL_IS_PATH:
+	    case URL_IS_DASH:	/* WRONG WRONG WRONG */
+	    case URL_IS_HKP:	/* WRONG WRONG WRONG */
+	    default:
+		eiu->pkgURL[eiu->pkgx] = fileURL;
+		fileURL = NULL;
+		eiu->pkgx++;
 		break;
 	    }
-	    eiu->pkgState[eiu->pkgx] = 1;
-	    eiu->pkgURL[eiu->pkgx] = tfn;
-	    eiu->pkgx++;
-	}   break;
-	case URL_IS_PATH:
-	case URL_IS_DASH:	/* WRONG WRONG WRONG */
-	case URL_IS_HKP:	/* WRONG WRONG WRONG */
-	default:
-	    eiu->pkgURL[eiu->pkgx] = fileURL;
-	    fileURL = NULL;
-	    eiu->pkgx++;
-	    break;
 	}
+	free(fetches);
+	free(tfns);
     }
     fileURL = _free(fileURL);
 
     if (eiu->numFailed) goto exit;
 
+    prefetchHeaders(ts, eiu);
+
     /* Continue processing file arguments, building transaction set. */
     for (eiu->fnp = eiu->pkgURL+eiu->prevx;
 	 *eiu->fnp != NULL;
@@ -661,6 +816,11 @@ exit:
 	    eiu->pkgURL[i] = _free(eiu->pkgURL[i]);
 	}
     }
+    if (eiu->prefetch != NULL) {
+	for (i = 0; i < eiu->prefetchAlloced; i++)
+	    headerFree(eiu->prefetch[i].h);
+	eiu->prefetch = _free(eiu->prefetch);
+    }
     eiu->pkgState = _free(eiu->pkgState);
     eiu->pkgURL = _free(eiu->pkgURL);
     eiu->argv = _free(eiu->argv);
@@ -138,3 +138,31 @@ rpmRC rpmLeadRead(FD_t fd, char **emsg)
 
     return rc;
 }
+
+rpmRC rpmLeadCheckMem(const void *buf, size_t blen, char **emsg)
+{
+    rpmRC rc;
+    struct rpmlead_s l;
+    char *err = NULL;
+
+    if (blen < sizeof(l)) {
+	err = xstrdup(_("not an rpm package\n"));
+	rc = RPMRC_NOTFOUND;
+    } else {
+	memcpy(&l, buf, sizeof(l));
+	l.type = ntohs(l.type);
+	l.archnum = ntohs(l.archnum);
+	l.osnum = ntohs(l.osnum);
+	l.signature_type = ntohs(l.signature_type);
+	rc = rpmLeadCheck(&l, &err);
+    }
+
+    if (rc != RPMRC_OK) {
+	if (emsg != NULL)
+	    *emsg = err;
+	else
+	    free(err);
+    }
+
+    return rc;
+}
@@ -35,6 +35,15 @@ rpmRC rpmLeadWrite(FD_t fd, Header h);
  */
 rpmRC rpmLeadRead(FD_t fd, char **emsg);
 
+/** \ingroup lead
+ * Check an in-memory lead, e.g. from a mapped package.
+ * @param buf		buffer holding the lead
+ * @param blen		number of bytes in buf
+ * @param[out] emsg		failure message on error (malloced)
+ * @return		RPMRC_OK on success, RPMRC_FAIL/RPMRC_NOTFOUND on error
+ */
+rpmRC rpmLeadCheckMem(const void *buf, size_t blen, char **emsg);
+
 #ifdef __cplusplus
 }
 #endif
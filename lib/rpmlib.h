@@ -99,6 +99,18 @@ void rpmGetOsInfo( const char ** name,
  */
 int rpmMachineScore(int type, const char * name);
 
+/** \ingroup rpmrc
+ * Score an array of machine names against the precomputed rpmrc
+ * compatibility tables, taking the configuration lock only once.
+ * Meant for depsolvers scoring many candidate packages.
+ * @param type		any of the RPM_MACHTABLE_* constants
+ * @param count		number of names
+ * @param names		machine names to score
+ * @param[out] scores	arch score per name (0 is no match, lower is preferred)
+ */
+void rpmMachineScores(int type, int count,
+		      const char * const * names, int * scores);
+
 /** \ingroup rpmrc
  * Display current rpmrc (and macro) configuration.
  * @param fp		output file handle
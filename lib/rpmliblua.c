@@ -0,0 +1,137 @@
+#include "system.h"
+
+#include <lua.h>
+#include <lauxlib.h>
+
+#include <rpm/header.h>
+#include <rpm/rpmtd.h>
+#include <rpm/rpmlog.h>
+
+#include "rpmio/rpmlua.h"
+#include "lib/rpmliblua.h"
+
+#include "debug.h"
+
+/*
+ * Lua header bindings (the rpm.hdr class): a userdata wrapping a
+ * refcounted Header whose __index resolves tag names straight through
+ * headerGet(), so <lua> scriptlets read NEVRA, file lists and other
+ * package facts in-process instead of shelling out to rpm -q. These
+ * live in librpm rather than rpmio/rpmlua.c because the header code
+ * does.
+ */
+
+static Header * checkhdr(lua_State *L, int ix)
+{
+    Header *hp = lua_touserdata(L, ix);
+    luaL_checkudata(L, ix, "rpm.hdr");
+    return hp;
+}
+
+/* Same shape as the class helpers in rpmio/rpmlua.c */
+static int newinstance(lua_State *L, const char *name, void *p)
+{
+    if (p != NULL) {
+	intptr_t **pp = lua_newuserdata(L, sizeof(*pp));
+	*pp = p;
+	luaL_getmetatable(L, name);
+	lua_setmetatable(L, -2);
+    }
+    return (p != NULL) ? 1 : 0;
+}
+
+static void pushtdval(lua_State *L, rpmtd td)
+{
+    switch (rpmtdClass(td)) {
+    case RPM_NUMERIC_CLASS:
+	lua_pushinteger(L, rpmtdGetNumber(td));
+	break;
+    case RPM_STRING_CLASS:
+	lua_pushstring(L, rpmtdGetString(td));
+	break;
+    case RPM_BINARY_CLASS:
+	lua_pushlstring(L, td->data, td->count);
+	break;
+    default:
+	lua_pushnil(L);
+	break;
+    }
+}
+
+static int hdr_index(lua_State *L)
+{
+    Header *hp = checkhdr(L, 1);
+    const char *name = luaL_checkstring(L, 2);
+    rpmTagVal tag = rpmTagGetValue(name);
+    struct rpmtd_s td;
+
+    if (tag == RPMTAG_NOT_FOUND)
+	return luaL_error(L, "unknown rpm tag: %s", name);
+
+    /* Borrow the tag data out of the header where possible */
+    if (!headerGet(*hp, tag, &td, HEADERGET_EXT | HEADERGET_MINMEM)) {
+	lua_pushnil(L);
+	return 1;
+    }
+
+    if (rpmTagGetReturnType(tag) == RPM_ARRAY_RETURN_TYPE) {
+	lua_createtable(L, rpmtdCount(&td), 0);
+	rpmtdInit(&td);
+	while (rpmtdNext(&td) >= 0) {
+	    pushtdval(L, &td);
+	    lua_rawseti(L, -2, rpmtdGetIndex(&td) + 1);
+	}
+    } else {
+	rpmtdInit(&td);
+	if (rpmtdNext(&td) >= 0)
+	    pushtdval(L, &td);
+	else
+	    lua_pushnil(L);
+    }
+    rpmtdFreeData(&td);
+
+    return 1;
+}
+
+static int hdr_tostring(lua_State *L)
+{
+    Header *hp = checkhdr(L, 1);
+    char *nevra = headerGetAsString(*hp, RPMTAG_NEVRA);
+    lua_pushstring(L, nevra ? nevra : "(none)");
+    free(nevra);
+    return 1;
+}
+
+static int hdr_gc(lua_State *L)
+{
+    Header *hp = checkhdr(L, 1);
+    *hp = headerFree(*hp);
+    return 0;
+}
+
+static const luaL_Reg hdr_m[] = {
+    {"__index", hdr_index},
+    {"__tostring", hdr_tostring},
+    {"__gc", hdr_gc},
+    {NULL, NULL}
+};
+
+void rpmLuaInit(void)
+{
+    lua_State *L = rpmluaGetLua(rpmluaGetGlobalState());
+
+    luaL_newmetatable(L, "rpm.hdr");
+    luaL_setfuncs(L, hdr_m, 0);
+    lua_pop(L, 1);
+}
+
+void rpmLuaSetPkgHeader(Header h)
+{
+    lua_State *L = rpmluaGetLua(rpmluaGetGlobalState());
+
+    if (h != NULL)
+	newinstance(L, "rpm.hdr", headerLink(h));
+    else
+	lua_pushnil(L);
+    lua_setglobal(L, "pkg");
+}
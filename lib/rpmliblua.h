@@ -0,0 +1,22 @@
+#ifndef _RPMLIBLUA_H
+#define _RPMLIBLUA_H
+
+#include <rpm/rpmtypes.h>
+
+/** \ingroup lib
+ * Register librpm's Lua bindings (the rpm.hdr header class) into the
+ * global Lua state. Safe to call repeatedly.
+ */
+RPM_GNUC_INTERNAL
+void rpmLuaInit(void);
+
+/** \ingroup lib
+ * Publish a package header as the global "pkg" variable for <lua>
+ * scriptlets, NULL retracts it. The header is referenced for as long
+ * as the Lua side holds on to it.
+ * @param h		package header (or NULL)
+ */
+RPM_GNUC_INTERNAL
+void rpmLuaSetPkgHeader(Header h);
+
+#endif /* _RPMLIBLUA_H */
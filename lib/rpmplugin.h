@@ -60,6 +60,7 @@ typedef rpmRC (*plugin_fsm_file_prepare_func)(rpmPlugin plugin, rpmfi fi,
 					      const char* path,
 					      const char *dest,
 					      mode_t file_mode, rpmFsmOp op);
+typedef rpmRC (*plugin_fsm_files_pre_func)(rpmPlugin plugin, rpmfiles files);
 
 typedef struct rpmPluginHooks_s * rpmPluginHooks;
 struct rpmPluginHooks_s {
@@ -80,6 +81,10 @@ struct rpmPluginHooks_s {
     plugin_fsm_file_pre_func		fsm_file_pre;
     plugin_fsm_file_post_func		fsm_file_post;
     plugin_fsm_file_prepare_func	fsm_file_prepare;
+    /* per package file set hooks, called before any per file hooks so
+     * plugins can bulk-resolve whatever they'd otherwise look up on
+     * every file (eg selinux contexts) */
+    plugin_fsm_files_pre_func		fsm_files_pre;
 };
 
 #ifdef __cplusplus
@@ -27,9 +27,36 @@ struct rpmPlugin_s {
 struct rpmPlugins_s {
     rpmPlugin *plugins;
     int count;
+    rpmPluginHook hookmask;	/* union of hooks the plugins implement */
     rpmts ts;
 };
 
+static rpmPluginHook pluginHookMask(rpmPluginHooks hooks)
+{
+    rpmPluginHook mask = PLUGINHOOK_NONE;
+
+    if (hooks->init)		mask |= PLUGINHOOK_INIT;
+    if (hooks->cleanup)		mask |= PLUGINHOOK_CLEANUP;
+    if (hooks->tsm_pre)		mask |= PLUGINHOOK_TSM_PRE;
+    if (hooks->tsm_post)	mask |= PLUGINHOOK_TSM_POST;
+    if (hooks->psm_pre)		mask |= PLUGINHOOK_PSM_PRE;
+    if (hooks->psm_post)	mask |= PLUGINHOOK_PSM_POST;
+    if (hooks->scriptlet_pre)	mask |= PLUGINHOOK_SCRIPTLET_PRE;
+    if (hooks->scriptlet_fork_post) mask |= PLUGINHOOK_SCRIPTLET_FORK_POST;
+    if (hooks->scriptlet_post)	mask |= PLUGINHOOK_SCRIPTLET_POST;
+    if (hooks->fsm_file_pre)	mask |= PLUGINHOOK_FSM_FILE_PRE;
+    if (hooks->fsm_file_post)	mask |= PLUGINHOOK_FSM_FILE_POST;
+    if (hooks->fsm_file_prepare) mask |= PLUGINHOOK_FSM_FILE_PREPARE;
+    if (hooks->fsm_files_pre)	mask |= PLUGINHOOK_FSM_FILES_PRE;
+
+    return mask;
+}
+
+int rpmpluginsHooked(rpmPlugins plugins, rpmPluginHook hook)
+{
+    return (plugins != NULL && (plugins->hookmask & hook) != 0);
+}
+
 static rpmPlugin rpmpluginsGetPlugin(rpmPlugins plugins, const char *name)
 {
     int i;
@@ -141,6 +168,7 @@ rpmRC rpmpluginsAdd(rpmPlugins plugins, const char *name, const char *path,
 			    (plugins->count + 1) * sizeof(*plugins->plugins));
 	plugins->plugins[plugins->count] = plugin;
 	plugins->count++;
+	plugins->hookmask |= pluginHookMask(plugin->hooks);
     } else {
 	rpmPluginFree(plugin);
     }
@@ -357,6 +385,10 @@ rpmRC rpmpluginsCallFsmFilePre(rpmPlugins plugins, rpmfi fi, const char *path,
     int i;
     rpmRC rc = RPMRC_OK;
 
+    /* This runs per file, don't walk the plugins for nothing */
+    if (!(plugins->hookmask & PLUGINHOOK_FSM_FILE_PRE))
+	return rc;
+
     for (i = 0; i < plugins->count; i++) {
 	rpmPlugin plugin = plugins->plugins[i];
 	RPMPLUGINS_SET_HOOK_FUNC(fsm_file_pre);
@@ -376,6 +408,9 @@ rpmRC rpmpluginsCallFsmFilePost(rpmPlugins plugins, rpmfi fi, const char *path,
     int i;
     rpmRC rc = RPMRC_OK;
 
+    if (!(plugins->hookmask & PLUGINHOOK_FSM_FILE_POST))
+	return rc;
+
     for (i = 0; i < plugins->count; i++) {
 	rpmPlugin plugin = plugins->plugins[i];
 	RPMPLUGINS_SET_HOOK_FUNC(fsm_file_post);
@@ -387,6 +422,27 @@ rpmRC rpmpluginsCallFsmFilePost(rpmPlugins plugins, rpmfi fi, const char *path,
     return rc;
 }
 
+rpmRC rpmpluginsCallFsmFilesPre(rpmPlugins plugins, rpmfiles files)
+{
+    plugin_fsm_files_pre_func hookFunc;
+    int i;
+    rpmRC rc = RPMRC_OK;
+
+    if (!(plugins->hookmask & PLUGINHOOK_FSM_FILES_PRE))
+	return rc;
+
+    for (i = 0; i < plugins->count; i++) {
+	rpmPlugin plugin = plugins->plugins[i];
+	RPMPLUGINS_SET_HOOK_FUNC(fsm_files_pre);
+	if (hookFunc && hookFunc(plugin, files) == RPMRC_FAIL) {
+	    rpmlog(RPMLOG_ERR, "Plugin %s: hook fsm_files_pre failed\n", plugin->name);
+	    rc = RPMRC_FAIL;
+	}
+    }
+
+    return rc;
+}
+
 rpmRC rpmpluginsCallFsmFilePrepare(rpmPlugins plugins, rpmfi fi,
 				   const char *path, const char *dest,
 				   mode_t file_mode, rpmFsmOp op)
@@ -395,6 +451,9 @@ rpmRC rpmpluginsCallFsmFilePrepare(rpmPlugins plugins, rpmfi fi,
     int i;
     rpmRC rc = RPMRC_OK;
 
+    if (!(plugins->hookmask & PLUGINHOOK_FSM_FILE_PREPARE))
+	return rc;
+
     for (i = 0; i < plugins->count; i++) {
 	rpmPlugin plugin = plugins->plugins[i];
 	RPMPLUGINS_SET_HOOK_FUNC(fsm_file_prepare);
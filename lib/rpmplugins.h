@@ -9,6 +9,28 @@
 extern "C" {
 #endif
 
+/** \ingroup rpmplugins
+ * Bits for the hooks implemented by the loaded plugins, one per slot
+ * of struct rpmPluginHooks_s. Used to skip hook calls entirely when
+ * no plugin implements a slot.
+ */
+typedef enum rpmPluginHook_e {
+    PLUGINHOOK_NONE		= 0,
+    PLUGINHOOK_INIT		= (1 << 0),
+    PLUGINHOOK_CLEANUP		= (1 << 1),
+    PLUGINHOOK_TSM_PRE		= (1 << 2),
+    PLUGINHOOK_TSM_POST		= (1 << 3),
+    PLUGINHOOK_PSM_PRE		= (1 << 4),
+    PLUGINHOOK_PSM_POST		= (1 << 5),
+    PLUGINHOOK_SCRIPTLET_PRE	= (1 << 6),
+    PLUGINHOOK_SCRIPTLET_FORK_POST = (1 << 7),
+    PLUGINHOOK_SCRIPTLET_POST	= (1 << 8),
+    PLUGINHOOK_FSM_FILE_PRE	= (1 << 9),
+    PLUGINHOOK_FSM_FILE_POST	= (1 << 10),
+    PLUGINHOOK_FSM_FILE_PREPARE	= (1 << 11),
+    PLUGINHOOK_FSM_FILES_PRE	= (1 << 12),
+} rpmPluginHook;
+
 /** \ingroup rpmplugins
  * Create a new plugins structure
  * @param ts		transaction set
@@ -55,6 +77,15 @@ rpmRC rpmpluginsAddPlugin(rpmPlugins plugins, const char *type, const char *name
 RPM_GNUC_INTERNAL
 int rpmpluginsPluginAdded(rpmPlugins plugins, const char *name);
 
+/** \ingroup rpmplugins
+ * Determine if any loaded plugin implements a hook slot
+ * @param plugins	plugins structure
+ * @param hook		hook slot bit(s) to check
+ * @return		1 if some plugin implements the slot, 0 otherwise
+ */
+RPM_GNUC_INTERNAL
+int rpmpluginsHooked(rpmPlugins plugins, rpmPluginHook hook);
+
 /** \ingroup rpmplugins
  * Call the pre transaction plugin hook
  * @param plugins	plugins structure
@@ -167,6 +198,16 @@ rpmRC rpmpluginsCallFsmFilePrepare(rpmPlugins plugins, rpmfi fi,
                                    const char *path, const char *dest,
                                    mode_t mode, rpmFsmOp op);
 
+/** \ingroup rpmplugins
+ * Call the fsm files pre plugin hook. Called once per package with the
+ * whole file set, before any per file hooks.
+ * @param plugins	plugins structure
+ * @param files		file info set of the package
+ * @return		RPMRC_OK on success, RPMRC_FAIL otherwise
+ */
+RPM_GNUC_INTERNAL
+rpmRC rpmpluginsCallFsmFilesPre(rpmPlugins plugins, rpmfiles files);
+
 #ifdef __cplusplus
 }
 #endif
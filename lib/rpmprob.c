@@ -8,6 +8,7 @@
 #include <stdlib.h>
 
 #include <rpm/rpmstring.h>
+#include <rpm/rpmstrpool.h>
 #include <rpm/rpmprob.h>
 
 #include "debug.h"
@@ -19,12 +20,18 @@ struct rpmProblem_s {
     rpmProblemType type;
     char * str1;
     uint64_t num1;
+    rpmstrPool pool;
     int nrefs;
 };
 
 static rpmProblem rpmProblemUnlink(rpmProblem prob);
 
-rpmProblem rpmProblemCreate(rpmProblemType type,
+static char * poolStr(rpmstrPool pool, const char * s)
+{
+    return (s ? (char *) rpmstrPoolStr(pool, rpmstrPoolId(pool, s, 1)) : NULL);
+}
+
+rpmProblem rpmProblemCreatePool(rpmstrPool pool, rpmProblemType type,
                             const char * pkgNEVR, fnpyKey key,
                             const char * altNEVR,
                             const char * str, uint64_t number)
@@ -35,13 +42,30 @@ rpmProblem rpmProblemCreate(rpmProblemType type,
     p->key = key;
     p->num1 = number;
 
-    p->pkgNEVR = (pkgNEVR ? xstrdup(pkgNEVR) : NULL);
-    p->altNEVR = (altNEVR ? xstrdup(altNEVR) : NULL);
-    p->str1 = (str ? xstrdup(str) : NULL);
+    if (pool != NULL) {
+	/* Interned strings are owned by the pool, not the problem */
+	p->pool = rpmstrPoolLink(pool);
+	p->pkgNEVR = poolStr(pool, pkgNEVR);
+	p->altNEVR = poolStr(pool, altNEVR);
+	p->str1 = poolStr(pool, str);
+    } else {
+	p->pkgNEVR = (pkgNEVR ? xstrdup(pkgNEVR) : NULL);
+	p->altNEVR = (altNEVR ? xstrdup(altNEVR) : NULL);
+	p->str1 = (str ? xstrdup(str) : NULL);
+    }
 
     return rpmProblemLink(p);
 }
 
+rpmProblem rpmProblemCreate(rpmProblemType type,
+                            const char * pkgNEVR, fnpyKey key,
+                            const char * altNEVR,
+                            const char * str, uint64_t number)
+{
+    return rpmProblemCreatePool(NULL, type, pkgNEVR, key, altNEVR,
+				str, number);
+}
+
 rpmProblem rpmProblemFree(rpmProblem prob)
 {
     if (prob == NULL) return NULL;
@@ -49,9 +73,13 @@ rpmProblem rpmProblemFree(rpmProblem prob)
     if (prob->nrefs > 1) {
 	return rpmProblemUnlink(prob);
     }
-    prob->pkgNEVR = _free(prob->pkgNEVR);
-    prob->altNEVR = _free(prob->altNEVR);
-    prob->str1 = _free(prob->str1);
+    if (prob->pool != NULL) {
+	prob->pool = rpmstrPoolFree(prob->pool);
+    } else {
+	prob->pkgNEVR = _free(prob->pkgNEVR);
+	prob->altNEVR = _free(prob->altNEVR);
+	prob->str1 = _free(prob->str1);
+    }
     free(prob);
     return NULL;
 }
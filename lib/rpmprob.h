@@ -68,6 +68,25 @@ rpmProblem rpmProblemCreate(rpmProblemType type,
                             const char * altNEVR,
                             const char * str, uint64_t number);
 
+/** \ingroup rpmprob
+ * Create a problem item with strings interned in a string pool.
+ * Problems of a large set repeat the same NEVRAs over and over, interning
+ * shares a single copy between them. The problem holds a reference to the
+ * pool for the lifetime of its strings.
+ * @param pool		shared string pool (or NULL to malloc the strings)
+ * @param type		type of problem
+ * @param pkgNEVR	package name
+ * @param key		filename or python object address
+ * @param altNEVR	related (e.g. through a dependency) package name
+ * @param str		generic string attribute
+ * @param number	generic number attribute
+ * @return		rpmProblem
+ */
+rpmProblem rpmProblemCreatePool(rpmstrPool pool, rpmProblemType type,
+                            const char * pkgNEVR, fnpyKey key,
+                            const char * altNEVR,
+                            const char * str, uint64_t number);
+
 /** \ingroup rpmprob
  * Destroy a problem item.
  * @param prob		rpm problem
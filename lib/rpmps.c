@@ -8,6 +8,7 @@
 #include <stdlib.h>
 
 #include <rpm/rpmstring.h>
+#include <rpm/rpmstrpool.h>
 #include <rpm/rpmps.h>
 
 #include "debug.h"
@@ -16,6 +17,11 @@ struct rpmps_s {
     int numProblems;		/*!< Current probs array size. */
     int numProblemsAlloced;	/*!< Allocated probs array size. */
     rpmProblem *probs;		/*!< Array of pointers to specific problems. */
+    rpmstrPool pool;		/*!< String pool for interned problem strings. */
+    rpmpsCallback cb;		/*!< Streaming delivery callback (or NULL). */
+    void *cbdata;		/*!< Callback private data. */
+    int cap;			/*!< Problems to retain when streaming. */
+    int numDropped;		/*!< Problems delivered but not retained. */
     int nrefs;			/*!< Reference count. */
 };
 
@@ -44,8 +50,8 @@ rpmps rpmpsLink(rpmps ps)
 int rpmpsNumProblems(rpmps ps)
 {
     int numProblems = 0;
-    if (ps && ps->probs)
-	numProblems = ps->numProblems;
+    if (ps)
+	numProblems = ps->numProblems + ps->numDropped;
     return numProblems;
 }
 
@@ -103,6 +109,27 @@ rpmps rpmpsCreate(void)
     return rpmpsLink(ps);
 }
 
+rpmps rpmpsCreatePool(rpmstrPool pool)
+{
+    rpmps ps = rpmpsCreate();
+    ps->pool = rpmstrPoolLink(pool);
+    return ps;
+}
+
+rpmstrPool rpmpsPool(rpmps ps)
+{
+    return (ps != NULL) ? ps->pool : NULL;
+}
+
+void rpmpsSetCallback(rpmps ps, rpmpsCallback cb, void *data, int cap)
+{
+    if (ps != NULL) {
+	ps->cb = cb;
+	ps->cbdata = data;
+	ps->cap = cap;
+    }
+}
+
 rpmps rpmpsFree(rpmps ps)
 {
     if (ps == NULL) return NULL;
@@ -118,6 +145,7 @@ rpmps rpmpsFree(rpmps ps)
 	rpmpsFreeIterator(psi);
 	ps->probs = _free(ps->probs);
     }
+    ps->pool = rpmstrPoolFree(ps->pool);
     ps = _free(ps);
     return NULL;
 }
@@ -126,6 +154,15 @@ void rpmpsAppendProblem(rpmps ps, rpmProblem prob)
 {
     if (ps == NULL || prob == NULL) return;
 
+    if (ps->cb != NULL) {
+	ps->cb(prob, ps->cbdata);
+	/* A streaming set only materializes up to its cap */
+	if (ps->numProblems >= ps->cap) {
+	    ps->numDropped++;
+	    return;
+	}
+    }
+
     if (ps->numProblems == ps->numProblemsAlloced) {
 	if (ps->numProblemsAlloced)
 	    ps->numProblemsAlloced *= 2;
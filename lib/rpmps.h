@@ -19,6 +19,13 @@ extern "C" {
  */
 typedef struct rpmpsi_s * rpmpsi;
 
+/** \ingroup rpmps
+ * Problem delivery callback for streaming problem sets.
+ * @param prob		problem (weak ref, valid for the duration of the call)
+ * @param data		callback private data
+ */
+typedef void (*rpmpsCallback)(rpmProblem prob, void *data);
+
 /** \ingroup rpmps
  * Reference a problem set instance.
  * @param ps		transaction set
@@ -74,6 +81,35 @@ rpmProblem rpmpsGetProblem(rpmpsi psi);
  */
 rpmps rpmpsCreate(void);
 
+/** \ingroup rpmps
+ * Create a problem set tied to a string pool.
+ * Problems created through the set's pool (see rpmProblemCreatePool())
+ * share their strings, the set keeps the pool alive for as long as any
+ * of them might need it.
+ * @param pool		shared string pool (or NULL for a plain set)
+ * @return		new problem set
+ */
+rpmps rpmpsCreatePool(rpmstrPool pool);
+
+/** \ingroup rpmps
+ * Return the string pool of a problem set.
+ * @param ps		problem set
+ * @return		string pool (weak ref), NULL for plain sets
+ */
+rpmstrPool rpmpsPool(rpmps ps);
+
+/** \ingroup rpmps
+ * Put a problem set into capped streaming mode.
+ * Appended problems are handed to the callback as they arrive and only
+ * the first cap problems are retained in the set, the rest are counted
+ * but not materialized. rpmpsNumProblems() still reports the full count.
+ * @param ps		problem set
+ * @param cb		problem delivery callback (NULL disables streaming)
+ * @param data		callback private data
+ * @param cap		maximum number of problems to retain in the set
+ */
+void rpmpsSetCallback(rpmps ps, rpmpsCallback cb, void *data, int cap);
+
 /** \ingroup rpmps
  * Destroy a problem set.
  * @param ps		problem set
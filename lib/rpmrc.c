@@ -34,6 +34,7 @@
 
 #include "rpmio/rpmlua.h"
 #include "rpmio/rpmio_internal.h"	/* XXX for rpmioSlurp */
+#include "lib/rpmliblua.h"
 #include "lib/misc.h"
 
 #include "debug.h"
@@ -53,6 +54,36 @@ typedef struct machCache_s {
     int size;
 } * machCache;
 
+/* Case-insensitive Jenkins one-at-a-time, equiv names compare with
+ * rstrcasecmp() and the score hash must agree with that. */
+static unsigned int nameCaseHash(const char * name)
+{
+    unsigned int hash = 0xe4721b68;
+
+    for (const char * s = name; *s != '\0'; s++) {
+	hash += rtolower(*s);
+	hash += (hash << 10);
+	hash ^= (hash >> 6);
+    }
+    hash += (hash << 3);
+    hash ^= (hash >> 11);
+    hash += (hash << 15);
+
+    return hash;
+}
+
+#undef HASHTYPE
+#undef HTKEYTYPE
+#undef HTDATATYPE
+#define HASHTYPE machScoreHash
+#define HTKEYTYPE const char *
+#define HTDATATYPE int
+#include "lib/rpmhash.H"
+#include "lib/rpmohash.C"
+#undef HASHTYPE
+#undef HTKEYTYPE
+#undef HTDATATYPE
+
 typedef struct machEquivInfo_s {
     char * name;
     int score;
@@ -61,6 +92,7 @@ typedef struct machEquivInfo_s {
 typedef struct machEquivTable_s {
     int count;
     machEquivInfo list;
+    machScoreHash scores;	/*!< name -> score, rebuilt with the list */
 } * machEquivTable;
 
 struct rpmvarValue {
@@ -330,6 +362,9 @@ static void machFindEquivs(machCache cache, machEquivTable table,
     for (i = 0; i < cache->size; i++)
 	cache->cache[i].visited = 0;
 
+    /* The hash borrows the list's names, drop it before they go */
+    table->scores = machScoreHashFree(table->scores);
+
     while (table->count > 0) {
 	--table->count;
 	table->list[table->count].name = _free(table->list[table->count].name);
@@ -345,6 +380,13 @@ static void machFindEquivs(machCache cache, machEquivTable table,
    	/* FIX: table->list may be NULL. */
     machAddEquiv(table, key, 1);
     machCacheEntryVisit(cache, table, key, 2);
+
+    /* Precompute the score lookup, scoring walks the list no more */
+    table->scores = machScoreHashCreate(table->count,
+					nameCaseHash, rstrcasecmp, NULL, NULL);
+    for (i = 0; i < table->count; i++)
+	machScoreHashAddEntry(table->scores,
+			      table->list[i].name, table->list[i].score);
     return;
 }
 
@@ -1661,8 +1703,9 @@ int rpmReadConfigFiles(const char * file, const char * target)
 	free(os);
     }
 
-    /* Force Lua state initialization */
+    /* Force Lua state initialization, and register librpm's bindings */
     rpmluaGetGlobalState();
+    rpmLuaInit();
     rc = 0;
 
 exit:
@@ -1681,6 +1724,7 @@ void rpmFreeRpmrc(void)
 	tableType t;
 	t = ctx->tables + i;
 	if (t->equiv.list) {
+	    t->equiv.scores = machScoreHashFree(t->equiv.scores);
 	    for (j = 0; j < t->equiv.count; j++)
 		t->equiv.list[j].name = _free(t->equiv.list[j].name);
 	    t->equiv.list = _free(t->equiv.list);
@@ -1820,19 +1864,44 @@ int rpmShowRC(FILE * fp)
     return 0;
 }
 
+static int machScore(rpmrcCtx ctx, int type, const char * name)
+{
+    const machEquivTable table = &ctx->tables[type].equiv;
+    int score = 0;
+
+    if (table->scores != NULL) {
+	int *scorep = NULL;
+	if (machScoreHashGetEntry(table->scores, name, &scorep, NULL, NULL))
+	    score = *scorep;
+    } else {
+	/* Tables not (re)built yet, fall back to the list walk */
+	machEquivInfo info = machEquivSearch(table, name);
+	if (info)
+	    score = info->score;
+    }
+    return score;
+}
+
 int rpmMachineScore(int type, const char * name)
 {
     int score = 0;
     if (name) {
 	rpmrcCtx ctx = rpmrcCtxAcquire(0);
-	machEquivInfo info = machEquivSearch(&ctx->tables[type].equiv, name);
-	if (info)
-	    score = info->score;
+	score = machScore(ctx, type, name);
 	rpmrcCtxRelease(ctx);
     }
     return score;
 }
 
+void rpmMachineScores(int type, int count,
+		      const char * const * names, int * scores)
+{
+    rpmrcCtx ctx = rpmrcCtxAcquire(0);
+    for (int i = 0; i < count; i++)
+	scores[i] = names[i] ? machScore(ctx, type, names[i]) : 0;
+    rpmrcCtxRelease(ctx);
+}
+
 int rpmIsKnownArch(const char *name)
 {
     rpmrcCtx ctx = rpmrcCtxAcquire(0);
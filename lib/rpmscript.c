@@ -1,6 +1,7 @@
 #include "system.h"
 
 #include <sys/types.h>
+#include <sys/socket.h>
 #include <sys/wait.h>
 #include <errno.h>
 #include <fcntl.h>
@@ -13,6 +14,7 @@
 #include <rpm/rpmds.h>
 
 #include "rpmio/rpmlua.h"
+#include "lib/rpmliblua.h"
 #include "lib/rpmscript.h"
 #include "rpmio/rpmio_internal.h"
 
@@ -32,6 +34,7 @@ struct rpmScript_s {
     rpmTagVal tag;		/* script tag */
     char **args;		/* scriptlet call arguments */
     char *body;			/* script body */
+    Header hdr;			/* owning header, for Lua accessors */
     char *descr;		/* description for logging */
     rpmscriptFlags flags;	/* flags to control operation */
     struct scriptNextFileFunc_s nextFileFunc;  /* input function */
@@ -235,6 +238,493 @@ exit:
     return fn;
 }
 
+/*
+ * Shared /dev/null descriptors, one per direction. Transactions with
+ * many scriptlets pay the stdio plumbing per script; most scriptlets
+ * take no input and their output is discarded unless -v, so keep the
+ * descriptors cached for the life of the process instead of opening
+ * /dev/null (or creating a pipe) again for every script.
+ */
+static int devnullFd(int mode)
+{
+    static int rdfd = -1;
+    static int wrfd = -1;
+    int *fdp = (mode == O_RDONLY) ? &rdfd : &wrfd;
+
+    if (*fdp == -1)
+	*fdp = open("/dev/null", mode | O_CLOEXEC);
+    return *fdp;
+}
+
+/* Where the scriptlet stdout goes: the callback fd, or /dev/null unless -v */
+static FD_t scriptOutFd(FD_t scriptFd)
+{
+    FD_t out;
+
+    if (scriptFd != NULL) {
+	if (rpmIsVerbose()) {
+	    out = fdDup(Fileno(scriptFd));
+	} else {
+	    int fdno = devnullFd(O_WRONLY);
+	    out = (fdno >= 0) ? fdDup(fdno) : fdDup(Fileno(scriptFd));
+	}
+    } else {
+	out = fdDup(STDOUT_FILENO);
+    }
+    return out;
+}
+
+/* Feed the scriptlet stdin from the per-script input function (if any) */
+static rpmRC writeScriptInput(FILE *in, scriptNextFileFunc nextFileFunc)
+{
+    const char *line;
+    char *mline = NULL;
+    rpmRC rc = RPMRC_OK;
+
+    if (nextFileFunc->func) {
+	while ((line = nextFileFunc->func(nextFileFunc->param)) != NULL) {
+	    size_t size = strlen(line);
+	    size_t ret_size;
+	    mline = xstrdup(line);
+	    mline[size] = '\n';
+
+	    ret_size = fwrite(mline, size + 1, 1, in);
+	    mline = _free(mline);
+	    if (ret_size != 1) {
+		if (errno == EPIPE) {
+		    break;
+		} else {
+		    rpmlog(RPMLOG_ERR, _("Fwrite failed: %s"), strerror(errno));
+		    rc = RPMRC_FAIL;
+		    break;
+		}
+	    }
+	}
+    }
+    free(mline);
+    return rc;
+}
+
+static rpmRC checkScriptStatus(const char *sname, rpmlogLvl lvl, int status)
+{
+    rpmRC rc = RPMRC_FAIL;
+
+    if (!WIFEXITED(status) || WEXITSTATUS(status)) {
+	if (WIFSIGNALED(status)) {
+	    rpmlog(lvl, _("%s scriptlet failed, signal %d\n"),
+		   sname, WTERMSIG(status));
+	} else {
+	    rpmlog(lvl, _("%s scriptlet failed, exit status %d\n"),
+		   sname, WEXITSTATUS(status));
+	}
+    } else {
+	/* if we get this far we're clear */
+	rc = RPMRC_OK;
+    }
+    return rc;
+}
+
+/*
+ * Preforked scriptlet helper (experimental, %_scriptlet_pool):
+ * a helper process is forked inside the chroot on first use and kept
+ * around for the rest of the transaction. It receives the interpreter
+ * argv, install prefixes, scriptlet body and stdio descriptors over a
+ * socketpair, writes the temporary script file, fork+execs the
+ * interpreter and reports the wait status back. A pool of one is all
+ * that is ever needed as scriptlets execute strictly in order, the
+ * point is paying the process and chroot setup once per transaction
+ * instead of once per scriptlet.
+ */
+struct poolReq_s {
+    int arg1;
+    int arg2;
+    int nargs;
+    int nprefixes;
+    uint32_t slen;		/*!< argv + prefix string blob length */
+    uint32_t blen;		/*!< script body length, 0 for none */
+};
+
+struct poolResp_s {
+    int rc;			/*!< 0: interpreter ran, status is valid */
+    int status;			/*!< wait status of the interpreter */
+};
+
+static struct scriptPool_s {
+    pid_t pid;
+    int sock;
+    rpmPlugins plugins;		/*!< only valid in the helper's copy */
+} scriptPool = { 0, -1, NULL };
+
+static int scriptPoolEnabled(void)
+{
+    static int enabled = -1;
+    if (enabled < 0)
+	enabled = (rpmExpandNumeric("%{?_scriptlet_pool}") > 0);
+    return enabled;
+}
+
+static int readFull(int fd, void *buf, size_t len)
+{
+    char *p = buf;
+    while (len > 0) {
+	ssize_t n = read(fd, p, len);
+	if (n <= 0) {
+	    if (n < 0 && errno == EINTR)
+		continue;
+	    return -1;
+	}
+	p += n;
+	len -= n;
+    }
+    return 0;
+}
+
+static int writeFull(int fd, const void *buf, size_t len)
+{
+    const char *p = buf;
+    while (len > 0) {
+	ssize_t n = write(fd, p, len);
+	if (n < 0) {
+	    if (errno == EINTR)
+		continue;
+	    return -1;
+	}
+	p += n;
+	len -= n;
+    }
+    return 0;
+}
+
+/* Send a request header with stdin/stdout/stderr fds, then the blob */
+static int scriptPoolSendReq(int sock, struct poolReq_s *req,
+			     const int fds[3], const char *blob)
+{
+    struct iovec iov = { req, sizeof(*req) };
+    union { struct cmsghdr hdr; char buf[CMSG_SPACE(3 * sizeof(int))]; } cu;
+    struct msghdr msg;
+    struct cmsghdr *cmsg;
+    ssize_t n;
+
+    memset(&msg, 0, sizeof(msg));
+    memset(&cu, 0, sizeof(cu));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = cu.buf;
+    msg.msg_controllen = sizeof(cu.buf);
+    cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(3 * sizeof(int));
+    memcpy(CMSG_DATA(cmsg), fds, 3 * sizeof(int));
+
+    do {
+	n = sendmsg(sock, &msg, 0);
+    } while (n < 0 && errno == EINTR);
+    if (n < 0)
+	return -1;
+    if ((size_t)n < sizeof(*req) &&
+	writeFull(sock, (char *)req + n, sizeof(*req) - n))
+	return -1;
+    return writeFull(sock, blob, req->slen + req->blen);
+}
+
+static int scriptPoolRecvReq(int sock, struct poolReq_s *req, int fds[3])
+{
+    struct iovec iov = { req, sizeof(*req) };
+    union { struct cmsghdr hdr; char buf[CMSG_SPACE(3 * sizeof(int))]; } cu;
+    struct msghdr msg;
+    struct cmsghdr *cmsg;
+    ssize_t n;
+
+    fds[0] = fds[1] = fds[2] = -1;
+    memset(&msg, 0, sizeof(msg));
+    memset(&cu, 0, sizeof(cu));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = cu.buf;
+    msg.msg_controllen = sizeof(cu.buf);
+
+    do {
+	n = recvmsg(sock, &msg, 0);
+    } while (n < 0 && errno == EINTR);
+    if (n <= 0)
+	return -1;
+    cmsg = CMSG_FIRSTHDR(&msg);
+    if (cmsg == NULL || cmsg->cmsg_level != SOL_SOCKET ||
+	cmsg->cmsg_type != SCM_RIGHTS ||
+	cmsg->cmsg_len != CMSG_LEN(3 * sizeof(int)))
+	return -1;
+    memcpy(fds, CMSG_DATA(cmsg), 3 * sizeof(int));
+    if ((size_t)n < sizeof(*req) &&
+	readFull(sock, (char *)req + n, sizeof(*req) - n))
+	return -1;
+    return 0;
+}
+
+/* Helper main loop, runs as a forked copy of rpm inside the chroot */
+static void scriptPoolServe(int sock)
+{
+    struct poolReq_s req;
+    int fds[3];
+
+    while (scriptPoolRecvReq(sock, &req, fds) == 0) {
+	struct poolResp_s resp = { 1, 0 };
+	ARGV_t argv = NULL;
+	ARGV_t prefixes = NULL;
+	char *fn = NULL;
+	char *blob = xmalloc((size_t)req.slen + req.blen + 1);
+	const char *s = blob;
+	int ok = 1;
+
+	if (readFull(sock, blob, (size_t)req.slen + req.blen)) {
+	    free(blob);
+	    break;
+	}
+	blob[(size_t)req.slen + req.blen] = '\0';
+
+	for (int i = 0; i < req.nargs; i++) {
+	    argvAdd(&argv, s);
+	    s += strlen(s) + 1;
+	}
+	for (int i = 0; i < req.nprefixes; i++) {
+	    argvAdd(&prefixes, s);
+	    s += strlen(s) + 1;
+	}
+
+	if (req.blen > 0) {
+	    char *body = xmalloc(req.blen + 1);
+	    memcpy(body, blob + req.slen, req.blen);
+	    body[req.blen] = '\0';
+	    fn = writeScript(argv[0], body);
+	    free(body);
+	    if (fn != NULL)
+		argvAdd(&argv, fn);
+	    else
+		ok = 0;
+	}
+
+	if (ok) {
+	    pid_t pid;
+
+	    if (req.arg1 >= 0)
+		argvAddNum(&argv, req.arg1);
+	    if (req.arg2 >= 0)
+		argvAddNum(&argv, req.arg2);
+
+	    pid = fork();
+	    if (pid == 0) {
+		dup2(fds[0], STDIN_FILENO);
+		dup2(fds[1], STDOUT_FILENO);
+		dup2(fds[2], STDERR_FILENO);
+
+		/* Run scriptlet post fork hook for all plugins */
+		if (rpmpluginsCallScriptletForkPost(scriptPool.plugins, argv[0], RPMSCRIPTLET_FORK | RPMSCRIPTLET_EXEC) != RPMRC_FAIL) {
+		    doScriptExec(argv, prefixes, NULL, NULL);
+		} else {
+		    _exit(126); /* exit 126 for compatibility with bash(1) */
+		}
+	    } else if (pid > 0) {
+		int status;
+		pid_t reaped;
+		do {
+		    reaped = waitpid(pid, &status, 0);
+		} while (reaped == -1 && errno == EINTR);
+		if (reaped == pid) {
+		    resp.rc = 0;
+		    resp.status = status;
+		}
+	    }
+	}
+
+	for (int i = 0; i < 3; i++) {
+	    if (fds[i] > STDERR_FILENO)
+		close(fds[i]);
+	}
+	if (fn) {
+	    if (!rpmIsDebug())
+		unlink(fn);
+	    free(fn);
+	}
+	argvFree(argv);
+	argvFree(prefixes);
+	free(blob);
+
+	if (writeFull(sock, &resp, sizeof(resp)))
+	    break;
+    }
+    _exit(EXIT_SUCCESS);
+}
+
+/* Fork the helper on first use, while rpm is inside the chroot */
+static int scriptPoolStart(rpmPlugins plugins)
+{
+    int sv[2];
+
+    if (scriptPool.pid > 0)
+	return 0;
+
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) < 0)
+	return -1;
+
+    scriptPool.plugins = plugins;
+    scriptPool.pid = fork();
+    if (scriptPool.pid == 0) {
+	close(sv[0]);
+	scriptPoolServe(sv[1]);	/* does not return */
+    }
+    close(sv[1]);
+    if (scriptPool.pid < 0) {
+	close(sv[0]);
+	scriptPool.pid = 0;
+	rpmlog(RPMLOG_WARNING, _("Couldn't fork scriptlet helper: %s\n"),
+	       strerror(errno));
+	return -1;
+    }
+    scriptPool.sock = sv[0];
+    rpmlog(RPMLOG_DEBUG, "forked scriptlet helper pid %d\n",
+	   (unsigned)scriptPool.pid);
+    return 0;
+}
+
+void rpmScriptPoolFree(void)
+{
+    if (scriptPool.pid > 0) {
+	int status;
+
+	close(scriptPool.sock);
+	scriptPool.sock = -1;
+	while (waitpid(scriptPool.pid, &status, 0) == -1 && errno == EINTR)
+	    ;
+	scriptPool.pid = 0;
+    }
+}
+
+/**
+ * Run an external script via the preforked helper.
+ */
+static rpmRC runPoolScript(ARGV_const_t prefixes,
+		   const char *sname, rpmlogLvl lvl, FD_t scriptFd,
+		   ARGV_t * argvp, const char *script, int arg1, int arg2,
+		   scriptNextFileFunc nextFileFunc)
+{
+    FD_t out = NULL;
+    int inpipe[2] = { 0, 0 };
+    FILE *in = NULL;
+    struct poolReq_s req = { arg1, arg2, 0, 0, 0, 0 };
+    struct poolResp_s resp;
+    char *blob = NULL, *bp;
+    size_t slen = 0;
+    int stdinFd = -1;
+    int fds[3];
+    rpmRC rc = RPMRC_FAIL;
+
+    rpmlog(RPMLOG_DEBUG, "%s: pooled scriptlet start\n", sname);
+
+    /* Most scriptlets take no input, feed those /dev/null without a pipe */
+    if (nextFileFunc->func) {
+	if (pipe(inpipe) < 0) {
+	    rpmlog(RPMLOG_ERR,
+		    ("Couldn't create pipe: %s\n"), strerror(errno));
+	    goto exit;
+	}
+	in = fdopen(inpipe[1], "w");
+	inpipe[1] = 0;
+	stdinFd = inpipe[0];
+    } else {
+	stdinFd = devnullFd(O_RDONLY);
+	if (stdinFd < 0) {
+	    rpmlog(RPMLOG_ERR, _("Couldn't open /dev/null: %s\n"),
+		   strerror(errno));
+	    goto exit;
+	}
+    }
+
+    out = scriptOutFd(scriptFd);
+    if (out == NULL) {
+	rpmlog(RPMLOG_ERR, _("Couldn't duplicate file descriptor: %s: %s\n"),
+	       sname, strerror(errno));
+	goto exit;
+    }
+
+    for (ARGV_const_t av = *argvp; av && *av; av++)
+	slen += strlen(*av) + 1;
+    for (ARGV_const_t pf = prefixes; pf && *pf; pf++)
+	slen += strlen(*pf) + 1;
+    req.slen = slen;
+    req.blen = (script != NULL) ? strlen(script) : 0;
+
+    bp = blob = xmalloc(slen + req.blen + 1);
+    for (ARGV_const_t av = *argvp; av && *av; av++) {
+	size_t l = strlen(*av) + 1;
+	memcpy(bp, *av, l);
+	bp += l;
+	req.nargs++;
+    }
+    for (ARGV_const_t pf = prefixes; pf && *pf; pf++) {
+	size_t l = strlen(*pf) + 1;
+	memcpy(bp, *pf, l);
+	bp += l;
+	req.nprefixes++;
+    }
+    if (req.blen > 0)
+	memcpy(bp, script, req.blen);
+
+    fds[0] = stdinFd;
+    fds[1] = Fileno(out);
+    fds[2] = (scriptFd != NULL) ? Fileno(scriptFd) : STDERR_FILENO;
+
+    if (scriptPoolSendReq(scriptPool.sock, &req, fds, blob)) {
+	rpmlog(lvl, _("%s scriptlet failed, helper not responding\n"), sname);
+	rpmScriptPoolFree();
+	goto exit;
+    }
+    if (inpipe[0]) {
+	close(inpipe[0]);
+	inpipe[0] = 0;
+    }
+
+    rc = RPMRC_OK;
+    if (in) {
+	rc = writeScriptInput(in, nextFileFunc);
+	fclose(in);
+	in = NULL;
+    }
+
+    /* Always collect the status to stay in sync with the helper */
+    if (readFull(scriptPool.sock, &resp, sizeof(resp))) {
+	rpmlog(lvl, _("%s scriptlet failed, helper not responding\n"), sname);
+	rpmScriptPoolFree();
+	rc = RPMRC_FAIL;
+	goto exit;
+    }
+    if (rc != RPMRC_OK)
+	goto exit;
+
+    if (resp.rc != 0) {
+	rpmlog(lvl, _("%s scriptlet failed, helper could not run it\n"),
+	       sname);
+	rc = RPMRC_FAIL;
+    } else {
+	rpmlog(RPMLOG_DEBUG, "%s: helper reports status 0x%x\n",
+	       sname, resp.status);
+	rc = checkScriptStatus(sname, lvl, resp.status);
+    }
+
+exit:
+    if (in)
+	fclose(in);
+
+    if (inpipe[0])
+	close(inpipe[0]);
+
+    if (out)
+	Fclose(out);	/* XXX dup'd STDOUT_FILENO */
+
+    free(blob);
+
+    return rc;
+}
+
 /**
  * Run an external script.
  */
@@ -247,10 +737,9 @@ static rpmRC runExtScript(rpmPlugins plugins, ARGV_const_t prefixes,
     char * fn = NULL;
     pid_t pid, reaped;
     int status;
-    int inpipe[2];
+    int inpipe[2] = { 0, 0 };
+    int stdinFd = -1;
     FILE *in = NULL;
-    const char *line;
-    char *mline = NULL;
     rpmRC rc = RPMRC_FAIL;
 
     rpmlog(RPMLOG_DEBUG, "%s: scriptlet start\n", sname);
@@ -273,27 +762,27 @@ static rpmRC runExtScript(rpmPlugins plugins, ARGV_const_t prefixes,
 	}
     }
 
-    if (pipe(inpipe) < 0) {
-	rpmlog(RPMLOG_ERR,
-		("Couldn't create pipe: %s\n"), strerror(errno));
-	goto exit;
-    }
-    in = fdopen(inpipe[1], "w");
-    inpipe[1] = 0;
-
-    if (scriptFd != NULL) {
-	if (rpmIsVerbose()) {
-	    out = fdDup(Fileno(scriptFd));
-	} else {
-	    out = Fopen("/dev/null", "w.fdio");
-	    if (Ferror(out)) {
-		out = fdDup(Fileno(scriptFd));
-	    }
+    /* Most scriptlets take no input, feed those /dev/null without a pipe */
+    if (nextFileFunc->func) {
+	if (pipe(inpipe) < 0) {
+	    rpmlog(RPMLOG_ERR,
+		    ("Couldn't create pipe: %s\n"), strerror(errno));
+	    goto exit;
 	}
+	in = fdopen(inpipe[1], "w");
+	inpipe[1] = 0;
+	stdinFd = inpipe[0];
     } else {
-	out = fdDup(STDOUT_FILENO);
+	stdinFd = devnullFd(O_RDONLY);
+	if (stdinFd < 0) {
+	    rpmlog(RPMLOG_ERR, _("Couldn't open /dev/null: %s\n"),
+		   strerror(errno));
+	    goto exit;
+	}
     }
-    if (out == NULL) { 
+
+    out = scriptOutFd(scriptFd);
+    if (out == NULL) {
 	rpmlog(RPMLOG_ERR, _("Couldn't duplicate file descriptor: %s: %s\n"),
 	       sname, strerror(errno));
 	goto exit;
@@ -308,8 +797,9 @@ static rpmRC runExtScript(rpmPlugins plugins, ARGV_const_t prefixes,
 	rpmlog(RPMLOG_DEBUG, "%s: execv(%s) pid %d\n",
 	       sname, *argvp[0], (unsigned)getpid());
 
-	fclose(in);
-	dup2(inpipe[0], STDIN_FILENO);
+	if (in)
+	    fclose(in);
+	dup2(stdinFd, STDIN_FILENO);
 
 	/* Run scriptlet post fork hook for all plugins */
 	if (rpmpluginsCallScriptletForkPost(plugins, *argvp[0], RPMSCRIPTLET_FORK | RPMSCRIPTLET_EXEC) != RPMRC_FAIL) {
@@ -318,31 +808,19 @@ static rpmRC runExtScript(rpmPlugins plugins, ARGV_const_t prefixes,
 	    _exit(126); /* exit 126 for compatibility with bash(1) */
 	}
     }
-    close(inpipe[0]);
-    inpipe[0] = 0;
-
-    if (nextFileFunc->func) {
-	while ((line = nextFileFunc->func(nextFileFunc->param)) != NULL) {
-	    size_t size = strlen(line);
-	    size_t ret_size;
-	    mline = xstrdup(line);
-	    mline[size] = '\n';
+    if (inpipe[0]) {
+	close(inpipe[0]);
+	inpipe[0] = 0;
+    }
 
-	    ret_size = fwrite(mline, size + 1, 1, in);
-	    mline = _free(mline);
-	    if (ret_size != 1) {
-		if (errno == EPIPE) {
-		    break;
-		} else {
-		    rpmlog(RPMLOG_ERR, _("Fwrite failed: %s"), strerror(errno));
-		    rc = RPMRC_FAIL;
-		    goto exit;
-		}
-	    }
+    if (in) {
+	if (writeScriptInput(in, nextFileFunc) != RPMRC_OK) {
+	    rc = RPMRC_FAIL;
+	    goto exit;
 	}
+	fclose(in);
+	in = NULL;
     }
-    fclose(in);
-    in = NULL;
 
     do {
 	reaped = waitpid(pid, &status, 0);
@@ -354,17 +832,8 @@ static rpmRC runExtScript(rpmPlugins plugins, ARGV_const_t prefixes,
     if (reaped < 0) {
 	rpmlog(lvl, _("%s scriptlet failed, waitpid(%d) rc %d: %s\n"),
 		 sname, pid, reaped, strerror(errno));
-    } else if (!WIFEXITED(status) || WEXITSTATUS(status)) {
-      	if (WIFSIGNALED(status)) {
-	    rpmlog(lvl, _("%s scriptlet failed, signal %d\n"),
-                   sname, WTERMSIG(status));
-	} else {
-	    rpmlog(lvl, _("%s scriptlet failed, exit status %d\n"),
-		   sname, WEXITSTATUS(status));
-	}
     } else {
-	/* if we get this far we're clear */
-	rc = RPMRC_OK;
+	rc = checkScriptStatus(sname, lvl, status);
     }
 
 exit:
@@ -382,7 +851,6 @@ exit:
 	    unlink(fn);
 	free(fn);
     }
-    free(mline);
 
     return rc;
 }
@@ -413,9 +881,15 @@ rpmRC rpmScriptRun(rpmScript script, int arg1, int arg2, FD_t scriptFd,
 
     if (rc != RPMRC_FAIL) {
 	if (script_type & RPMSCRIPTLET_EXEC) {
-	    rc = runExtScript(plugins, prefixes, script->descr, lvl, scriptFd, &args, script->body, arg1, arg2, &script->nextFileFunc);
+	    if (scriptPoolEnabled() && scriptPoolStart(plugins) == 0)
+		rc = runPoolScript(prefixes, script->descr, lvl, scriptFd, &args, script->body, arg1, arg2, &script->nextFileFunc);
+	    else
+		rc = runExtScript(plugins, prefixes, script->descr, lvl, scriptFd, &args, script->body, arg1, arg2, &script->nextFileFunc);
 	} else {
+	    /* Expose the package header to the scriptlet as "pkg" */
+	    rpmLuaSetPkgHeader(script->hdr);
 	    rc = runLuaScript(plugins, prefixes, script->descr, lvl, scriptFd, &args, script->body, arg1, arg2, &script->nextFileFunc);
+	    rpmLuaSetPkgHeader(NULL);
 	}
     }
 
@@ -461,6 +935,7 @@ static rpmScript rpmScriptNew(Header h, rpmTagVal tag, const char *body,
     script->type = getScriptType(tag);
     script->flags = getDefFlags(tag) | flags;
     script->body = (body != NULL) ? xstrdup(body) : NULL;
+    script->hdr = headerLink(h);
     rasprintf(&script->descr, "%%%s%s(%s)", prefix, tag2sln(tag), nevra);
 
     /* macros need to be expanded before possible queryformat */
@@ -622,6 +1097,7 @@ rpmScript rpmScriptFree(rpmScript script)
     if (script) {
 	free(script->args);
 	free(script->body);
+	headerFree(script->hdr);
 	free(script->descr);
 	free(script);
     }
@@ -58,6 +58,10 @@ rpmTagVal triggertag(rpmsenseFlags sense);
 RPM_GNUC_INTERNAL
 rpmScript rpmScriptFromTag(Header h, rpmTagVal scriptTag);
 
+/* Reap the preforked scriptlet helper process (if any) */
+RPM_GNUC_INTERNAL
+void rpmScriptPoolFree(void);
+
 RPM_GNUC_INTERNAL
 rpmScript rpmScriptFromTriggerTag(Header h, rpmTagVal triggerTag,
 				    rpmscriptTriggerModes tm, uint32_t ix);
@@ -376,6 +376,11 @@ typedef enum rpmTag_e {
     RPMTAG_IDENTITY		= 5095, /* s reservation (unimplemented) */
     RPMTAG_MODULARITYLABEL	= 5096, /* s */
     RPMTAG_PAYLOADDIGESTALT	= 5097, /* s[] */
+    RPMTAG_PAYLOADFRAMEOFFSETS	= 5098, /* l[] payload offset of the compressed frame holding each file */
+    RPMTAG_PAYLOADFILEOFFSETS	= 5099, /* l[] offset of each file's data in the frame's uncompressed output */
+    RPMTAG_PAYLOADSORT		= 5100, /* s policy used to order the files in the payload */
+    RPMTAG_INSTALLFILECTIMES	= 5101, /* i[] file change times as recorded after install */
+    RPMTAG_FILEDATA		= 5102, /* x inlined content of a tiny payload, in file index order */
 
     RPMTAG_FIRSTFREE_TAG	/*!< internal */
 } rpmTag;
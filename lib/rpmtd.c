@@ -4,6 +4,7 @@
 #include <rpm/rpmstring.h>
 #include <rpm/rpmpgp.h>
 #include <rpm/rpmstrpool.h>
+#include <rpm/header.h>		/* RPMTD_BORROWED header pinning */
 #include "lib/misc.h"		/* format function prototypes */
 
 #include "debug.h"
@@ -44,6 +45,8 @@ void rpmtdFreeData(rpmtd td)
 	}
 	free(td->data);
     }
+    if (td && (td->flags & RPMTD_BORROWED))
+	td->h = headerFree(td->h);
     rpmtdReset(td);
 }
 
@@ -416,26 +419,39 @@ rpmtd rpmtdDup(rpmtd td)
 {
     rpmtd newtd = NULL;
     char **data = NULL;
+    size_t dlen = 0;
+    int argv;
+    char *t;
     int i;
 
     if (td == NULL)
 	return NULL;
-    
+
     /* TODO: permit other types too */
     if (td->type != RPM_STRING_ARRAY_TYPE && td->type != RPM_I18NSTRING_TYPE) {
 	return NULL;
     }
+    argv = (td->flags & RPMTD_ARGV) ? 1 : 0;
 
-    /* deep-copy container and data, drop immutable flag */
+    /* deep-copy container and data, drop immutable and borrow flags */
     newtd = rpmtdNew();
     memcpy(newtd, td, sizeof(*td));
-    newtd->flags &= ~(RPMTD_IMMUTABLE);
+    newtd->flags &= ~(RPMTD_IMMUTABLE | RPMTD_BORROWED);
+    newtd->h = NULL;
+
+    while ((i = rpmtdNext(td)) >= 0)
+	dlen += strlen(rpmtdGetString(td)) + 1;
 
-    newtd->flags |= (RPMTD_ALLOCED | RPMTD_PTR_ALLOCED);
-    newtd->data = data = xmalloc(td->count * sizeof(*data));
+    /* pointer table and string data in a single allocation */
+    newtd->flags |= RPMTD_ALLOCED;
+    newtd->data = data = xmalloc((td->count + argv) * sizeof(*data) + dlen);
+    t = (char *)(data + td->count + argv);
     while ((i = rpmtdNext(td)) >= 0) {
-	data[i] = xstrdup(rpmtdGetString(td));
+	data[i] = t;
+	t = stpcpy(t, rpmtdGetString(td)) + 1;
     }
+    if (argv)
+	data[td->count] = NULL;
 
     return newtd;
 }
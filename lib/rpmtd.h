@@ -21,6 +21,7 @@ enum rpmtdFlags_e {
     RPMTD_IMMUTABLE	= (1 << 2),	/* header data or modifiable? */
     RPMTD_ARGV		= (1 << 3),	/* string array is NULL-terminated? */
     RPMTD_INVALID	= (1 << 4),	/* invalid data (in header) */
+    RPMTD_BORROWED	= (1 << 5),	/* data borrowed from a pinned header */
 };
 
 typedef rpmFlags rpmtdFlags;
@@ -37,6 +38,7 @@ struct rpmtd_s {
     rpmtdFlags flags;	/* flags on memory allocation etc */
     int ix;		/* iteration index */
     rpm_count_t size;	/* size of data (only works for RPMTD_IMMUTABLE atm) */
+    Header h;		/* header the data is borrowed from (RPMTD_BORROWED) */
 };
 
 /** \ingroup rpmtd
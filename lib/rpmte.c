@@ -16,6 +16,7 @@
 #include "lib/misc.h"
 #include "lib/rpmplugins.h"
 #include "lib/rpmte_internal.h"
+#include "rpmio/rpmio_internal.h"	/* fdSetNoCache */
 /* strpool-related interfaces */
 #include "lib/rpmfi_internal.h"
 #include "lib/rpmds_internal.h"
@@ -33,6 +34,7 @@ struct rpmte_s {
     Header h;			/*!< Package header. */
     char * NEVR;		/*!< Package name-version-release. */
     char * NEVRA;		/*!< Package name-version-release.arch. */
+    rpmsid nevraId;		/*!< NEVRA id in the transaction pool. */
     char * name;		/*!< Name: */
     char * epoch;
     char * version;		/*!< Version: */
@@ -56,7 +58,7 @@ struct rpmte_s {
     rpmds suggests;		/*!< Suggests: dependencies. */
     rpmds supplements;		/*!< Supplements: dependencies. */
     rpmds enhances;		/*!< Enhances: dependencies. */
-    rpmfiles files;		/*!< File information. */
+    rpmfiles files;		/*!< File information (lazily materialized). */
     rpmfi fi;			/*!< File iterator (backwards compat) */
     rpmps probs;		/*!< Problems (relocations) */
     rpmts ts;			/*!< Parent transaction */
@@ -64,6 +66,8 @@ struct rpmte_s {
     rpm_color_t color;		/*!< Color bit(s) from package dependencies. */
     rpm_loff_t pkgFileSize;	/*!< No. of bytes in package file (approx). */
     unsigned int headerSize;	/*!< No. of bytes in package header */
+    rpm_loff_t archiveSize;	/*!< No. of bytes in uncompressed payload. */
+    int nscripts;		/*!< No. of basic install/erase scriptlets. */
 
     fnpyKey key;		/*!< (TR_ADDED) Retrieval key. */
     rpmRelocation * relocs;	/*!< (TR_ADDED) Payload file relocations. */
@@ -77,6 +81,8 @@ struct rpmte_s {
 #define RPMTE_HAVE_POSTTRANS	(1 << 1)
     int transscripts;		/*!< pre/posttrans script existence */
     int failed;			/*!< (parent) install/erase failed */
+    struct rpmop_s op;		/*!< Cumulative processing time */
+    struct rpmop_s scops[RPMTE_SCOP_MAX]; /*!< Syscall accounting (--syscallstats) */
 
     rpmfs fs;
 };
@@ -84,6 +90,7 @@ struct rpmte_s {
 /* forward declarations */
 static void rpmteColorDS(rpmte te, rpmTag tag);
 static int rpmteClose(rpmte te, int reset_fi);
+static Header rpmteDBHeader(rpmte te);
 
 void rpmteCleanDS(rpmte te)
 {
@@ -122,6 +129,19 @@ static rpmfiles getFiles(rpmte p, Header h)
     return rpmfilesNew(rpmtsPool(p->ts), h, RPMTAG_BASENAMES, fiflags);
 }
 
+/**
+ * Move a (malloc'd) header string into the transaction arena.
+ * @param p		transaction element
+ * @param s		malloc'd string (consumed), or NULL
+ * @return		arena copy of the string, or NULL
+ */
+static char * teArenaStr(rpmte p, char * s)
+{
+    char * as = rpmtsArenaStrdup(p->ts, s);
+    free(s);
+    return as;
+}
+
 /**
  * Initialize transaction element data from header.
  * @param p		transaction element
@@ -135,27 +155,37 @@ static int addTE(rpmte p, Header h, fnpyKey key, rpmRelocation * relocs)
     struct rpmtd_s bnames;
     int rc = 1; /* assume failure */
 
-    p->name = headerGetAsString(h, RPMTAG_NAME);
-    p->version = headerGetAsString(h, RPMTAG_VERSION);
-    p->release = headerGetAsString(h, RPMTAG_RELEASE);
+    p->name = teArenaStr(p, headerGetAsString(h, RPMTAG_NAME));
+    p->version = teArenaStr(p, headerGetAsString(h, RPMTAG_VERSION));
+    p->release = teArenaStr(p, headerGetAsString(h, RPMTAG_RELEASE));
 
     /* name, version and release are required in all packages */
     if (p->name == NULL || p->version == NULL || p->release == NULL)
 	goto exit;
 
-    p->epoch = headerGetAsString(h, RPMTAG_EPOCH);
+    p->epoch = teArenaStr(p, headerGetAsString(h, RPMTAG_EPOCH));
 
-    p->arch = headerGetAsString(h, RPMTAG_ARCH);
-    p->os = headerGetAsString(h, RPMTAG_OS);
+    p->arch = teArenaStr(p, headerGetAsString(h, RPMTAG_ARCH));
+    p->os = teArenaStr(p, headerGetAsString(h, RPMTAG_OS));
 
     /* gpg-pubkey's dont have os or arch (sigh), for others they are required */
     if (!rstreq(p->name, "gpg-pubkey") && (p->arch == NULL || p->os == NULL))
 	goto exit;
 
     p->isSource = headerIsSource(h);
-    
-    p->NEVR = headerGetAsString(h, RPMTAG_NEVR);
-    p->NEVRA = headerGetAsString(h, RPMTAG_NEVRA);
+
+    p->NEVR = teArenaStr(p, headerGetAsString(h, RPMTAG_NEVR));
+
+    /* Intern the NEVRA: one shared copy in the transaction pool serves
+     * as the element identity, comparable and hashable by id. */
+    {
+	char *nevra = headerGetAsString(h, RPMTAG_NEVRA);
+	if (nevra != NULL) {
+	    p->nevraId = rpmstrPoolId(tspool, nevra, 1);
+	    p->NEVRA = (char *) rpmstrPoolStr(tspool, p->nevraId);
+	    free(nevra);
+	}
+    }
 
     p->nrelocs = 0;
     p->relocs = NULL;
@@ -186,11 +216,12 @@ static int addTE(rpmte p, Header h, fnpyKey key, rpmRelocation * relocs)
     p->fs = rpmfsNew(rpmtdCount(&bnames), (p->type == TR_ADDED));
     rpmtdFreeData(&bnames);
 
-    p->files = getFiles(p, h);
-
-    /* Packages with no files return an empty file info set, NULL is an error */
-    if (p->files == NULL)
-	goto exit;
+    /* File info is expensive to decode and often never needed before the
+     * element actually installs: hang on to the header reference instead
+     * and let rpmteFetchFiles() materialize the arrays on first use.
+     * Erased packages are re-fetched from the database by instance. */
+    if (p->type == TR_ADDED)
+	p->h = headerLink(h);
 
     /* See if we have pre/posttrans scripts. */
     p->transscripts |= (headerIsEntry(h, RPMTAG_PRETRANS) ||
@@ -200,12 +231,26 @@ static int addTE(rpmte p, Header h, fnpyKey key, rpmRelocation * relocs)
 			 headerIsEntry(h, RPMTAG_POSTTRANSPROG)) ?
 			RPMTE_HAVE_POSTTRANS : 0;
 
-    rpmteColorDS(p, RPMTAG_PROVIDENAME);
-    rpmteColorDS(p, RPMTAG_REQUIRENAME);
+    /* Dependency colors are only ever acted on in colored transactions,
+     * don't force the file info into existence just to compute them. */
+    if (rpmtsColor(p->ts)) {
+	rpmteColorDS(p, RPMTAG_PROVIDENAME);
+	rpmteColorDS(p, RPMTAG_REQUIRENAME);
+    }
 
     if (p->type == TR_ADDED)
 	p->pkgFileSize = headerGetNumber(h, RPMTAG_LONGSIGSIZE) + 96 + 256;
 
+    /* Progress prediction inputs (see the cost model in transaction.c) */
+    p->archiveSize = headerGetNumber(h, RPMTAG_LONGARCHIVESIZE);
+    if (p->type == TR_ADDED) {
+	p->nscripts = headerIsEntry(h, RPMTAG_PREIN) +
+		      headerIsEntry(h, RPMTAG_POSTIN);
+    } else {
+	p->nscripts = headerIsEntry(h, RPMTAG_PREUN) +
+		      headerIsEntry(h, RPMTAG_POSTUN);
+    }
+
     rc = 0;
 
 exit:
@@ -224,15 +269,6 @@ rpmte rpmteFree(rpmte te)
 	    free(te->badrelocs);
 	}
 
-	free(te->os);
-	free(te->arch);
-	free(te->epoch);
-	free(te->name);
-	free(te->version);
-	free(te->release);
-	free(te->NEVR);
-	free(te->NEVRA);
-
 	fdFree(te->fd);
 	rpmfiFree(te->fi);
 	rpmfilesFree(te->files);
@@ -241,8 +277,9 @@ rpmte rpmteFree(rpmte te)
 	rpmpsFree(te->probs);
 	rpmteCleanDS(te);
 
+	/* Name strings and the element itself reside in the transaction
+	 * arena and are released wholesale on rpmtsEmpty(). */
 	memset(te, 0, sizeof(*te));	/* XXX trash and burn */
-	free(te);
     }
     return NULL;
 }
@@ -250,7 +287,7 @@ rpmte rpmteFree(rpmte te)
 rpmte rpmteNew(rpmts ts, Header h, rpmElementType type, fnpyKey key,
 	       rpmRelocation * relocs, int addop)
 {
-    rpmte p = xcalloc(1, sizeof(*p));
+    rpmte p = rpmtsArenaAlloc(ts, sizeof(*p));
     p->ts = ts;
     p->type = type;
     p->addop = addop;
@@ -356,6 +393,16 @@ unsigned int rpmteHeaderSize(rpmte te)
     return (te != NULL ? te->headerSize : 0);
 }
 
+rpm_loff_t rpmteArchiveSize(rpmte te)
+{
+    return (te != NULL ? te->archiveSize : 0);
+}
+
+int rpmteScriptCount(rpmte te)
+{
+    return (te != NULL ? te->nscripts : 0);
+}
+
 rpmte rpmteParent(rpmte te)
 {
     return (te != NULL ? te->parent : NULL);
@@ -411,6 +458,11 @@ const char * rpmteNEVRA(rpmte te)
     return (te != NULL ? te->NEVRA : NULL);
 }
 
+rpmsid rpmteNEVRAId(rpmte te)
+{
+    return (te != NULL ? te->nevraId : 0);
+}
+
 FD_t rpmteSetFd(rpmte te, FD_t fd)
 {
     if (te != NULL)  {
@@ -467,20 +519,49 @@ void rpmteCleanFiles(rpmte te)
     }
 }
 
+/**
+ * Materialize the file info set on first access. Added packages decode
+ * from the header taken at rpmteNew() time, removed packages re-fetch
+ * theirs from the database. The set lives until rpmteClose() resets it
+ * after the element has been processed.
+ * @param te		transaction element
+ * @return		file info set (weak ref), or NULL
+ */
+static rpmfiles rpmteFetchFiles(rpmte te)
+{
+    if (te->files == NULL) {
+	Header h = NULL;
+	if (te->h != NULL)
+	    h = headerLink(te->h);
+	else if (te->db_instance)
+	    h = rpmteDBHeader(te);
+	if (h != NULL) {
+	    te->files = getFiles(te, h);
+	    headerFree(h);
+	    /* The add-time header was only retained for this: drop it once
+	     * the file info exists. Install re-reads its own header, which
+	     * must stay put while the element is open (te->fd). */
+	    if (te->files != NULL && te->fd == NULL)
+		rpmteSetHeader(te, NULL);
+	}
+    }
+    return te->files;
+}
+
 rpmfi rpmteFI(rpmte te)
 {
     if (te == NULL)
 	return NULL;
 
     if (te->fi == NULL)
-	te->fi = rpmfilesIter(te->files, RPMFI_ITER_FWD);
+	te->fi = rpmfilesIter(rpmteFetchFiles(te), RPMFI_ITER_FWD);
 
     return te->fi; /* XXX take fi reference here? */
 }
 
 rpmfiles rpmteFiles(rpmte te)
 {
-    return (te != NULL) ? rpmfilesLink(te->files) : NULL;
+    return (te != NULL) ? rpmfilesLink(rpmteFetchFiles(te)) : NULL;
 }
 
 static void rpmteColorDS(rpmte te, rpmTag tag)
@@ -496,7 +577,7 @@ static void rpmteColorDS(rpmte te, rpmTag tag)
     unsigned ix;
     int ndx, i;
 
-    if (!(te && (Count = rpmdsCount(ds)) > 0 && rpmfilesFC(te->files) > 0))
+    if (!(te && (Count = rpmdsCount(ds)) > 0 && rpmfilesFC(rpmteFetchFiles(te)) > 0))
 	return;
 
     switch (tag) {
@@ -602,6 +683,7 @@ static int rpmteOpen(rpmte te, int reload_fi)
     if (h != NULL) {
 	if (reload_fi) {
 	    /* This can fail if we get a different, bad header from callback */
+	    rpmteCleanFiles(te);
 	    te->files = getFiles(te, h);
 	    rc = (te->files != NULL);
 	} else {
@@ -647,6 +729,9 @@ FD_t rpmtePayload(rpmte te)
 	const char *compr = headerGetString(te->h, RPMTAG_PAYLOADCOMPRESSOR);
 	char *ioflags = rstrscat(NULL, "r.", compr ? compr : "gzip", NULL);
 	payload = Fdopen(fdDup(Fileno(te->fd)), ioflags);
+	/* the payload streams by exactly once, don't cache it */
+	if (payload != NULL && rpmExpandNumeric("%{?_pkg_nocache}"))
+	    fdSetNoCache(payload);
 	free(ioflags);
     }
     return payload;
@@ -705,8 +790,15 @@ static void appendProblem(rpmte te, rpmProblemType type,
 		const char * str, uint64_t number)
 {
     rpmProblem o;
-    rpmProblem p = rpmProblemCreate(type, te->NEVRA, key, altNEVR, str, number);
-    rpmpsi psi = rpmpsInitIterator(te->probs);
+    rpmProblem p;
+    rpmpsi psi;
+
+    /* Intern problem strings in the ts pool, NEVRAs repeat massively */
+    if (te->probs == NULL)
+	te->probs = rpmpsCreatePool(rpmtsPool(te->ts));
+    p = rpmProblemCreatePool(rpmpsPool(te->probs), type, te->NEVRA,
+			     key, altNEVR, str, number);
+    psi = rpmpsInitIterator(te->probs);
 
     /* Only add new, unique problems to the set */
     while ((o = rpmpsiNext(psi))) {
@@ -716,8 +808,6 @@ static void appendProblem(rpmte te, rpmProblemType type,
     rpmpsFreeIterator(psi);
 
     if (o == NULL) {
-	if (te->probs == NULL)
-	    te->probs = rpmpsCreate();
 	rpmpsAppendProblem(te->probs, p);
 	rpmteMarkFailed(te);
     }
@@ -793,6 +883,16 @@ int rpmteAddOp(rpmte te)
     return te->addop;
 }
 
+rpmop rpmteOp(rpmte te)
+{
+    return te ? &te->op : NULL;
+}
+
+rpmop rpmteScOp(rpmte te, rpmteScOpX opx)
+{
+    return (te && opx >= 0 && opx < RPMTE_SCOP_MAX) ? &te->scops[opx] : NULL;
+}
+
 int rpmteProcess(rpmte te, pkgGoal goal, int num)
 {
     /* Only install/erase resets pkg file info */
@@ -808,6 +908,7 @@ int rpmteProcess(rpmte te, pkgGoal goal, int num)
 	}
     }
 
+    rpmswEnter(&te->op, 0);
     if (rpmteOpen(te, reset_fi)) {
 	if (!scriptstage) {
 	    rpmtsNotify(te->ts, te, RPMCALLBACK_ELEM_PROGRESS, num,
@@ -817,6 +918,7 @@ int rpmteProcess(rpmte te, pkgGoal goal, int num)
 	failed = rpmpsmRun(te->ts, te, goal);
 	rpmteClose(te, reset_fi);
     }
+    rpmswExit(&te->op, 0);
     
     if (failed) {
 	failed = rpmteMarkFailed(te);
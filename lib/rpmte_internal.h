@@ -3,6 +3,8 @@
 
 #include <rpm/rpmte.h>
 #include <rpm/rpmds.h>
+#include <rpm/rpmsw.h>
+#include <rpm/rpmstrpool.h>
 #include "lib/rpmfs.h"
 
 typedef enum pkgGoal_e {
@@ -55,6 +57,14 @@ rpmte rpmteNew(rpmts ts, Header h, rpmElementType type, fnpyKey key,
 RPM_GNUC_INTERNAL
 rpmte rpmteFree(rpmte te);
 
+/** \ingroup rpmte
+ * Return the element's NEVRA id in the transaction string pool.
+ * @param te		transaction element
+ * @return		NEVRA pool id, 0 on NULL element
+ */
+RPM_GNUC_INTERNAL
+rpmsid rpmteNEVRAId(rpmte te);
+
 RPM_GNUC_INTERNAL
 void rpmteCleanFiles(rpmte te);
 
@@ -67,6 +77,24 @@ FD_t rpmtePayload(rpmte te);
 RPM_GNUC_INTERNAL
 int rpmteProcess(rpmte te, pkgGoal goal, int num);
 
+/* Cumulative time spent processing this element (install/erase/scriptlets) */
+RPM_GNUC_INTERNAL
+rpmop rpmteOp(rpmte te);
+
+/* Syscall classes accounted per element (RPMTRANS_FLAG_SYSCALLSTATS) */
+typedef enum rpmteScOpX_e {
+    RPMTE_SCOP_OPEN	= 0,
+    RPMTE_SCOP_WRITE	= 1,
+    RPMTE_SCOP_FSYNC	= 2,
+    RPMTE_SCOP_RENAME	= 3,
+    RPMTE_SCOP_LINK	= 4,
+    RPMTE_SCOP_THROTTLE	= 5,	/*!< reader stalled on write backlog */
+    RPMTE_SCOP_MAX	= 6
+} rpmteScOpX;
+
+RPM_GNUC_INTERNAL
+rpmop rpmteScOp(rpmte te, rpmteScOpX opx);
+
 RPM_GNUC_INTERNAL
 void rpmteAddProblem(rpmte te, rpmProblemType type,
                      const char *altNEVR, const char *str, uint64_t number);
@@ -104,6 +132,23 @@ void rpmteSetVerified(rpmte te, int verified);
 RPM_GNUC_INTERNAL
 unsigned int rpmteHeaderSize(rpmte te);
 
+/** \ingroup rpmte
+ * Retrieve size in bytes of the uncompressed payload.
+ * @param te		transaction element
+ * @return		size in bytes (0 if unknown or erasure)
+ */
+RPM_GNUC_INTERNAL
+rpm_loff_t rpmteArchiveSize(rpmte te);
+
+/** \ingroup rpmte
+ * Retrieve number of basic install/erase scriptlets of the element.
+ * @param te		transaction element
+ * @return		number of %pre/%post (install) or %preun/%postun
+ *			(erase) scriptlets
+ */
+RPM_GNUC_INTERNAL
+int rpmteScriptCount(rpmte te);
+
 /**
  * Package state machine driver.
  * @param ts		transaction set
@@ -114,6 +159,27 @@ unsigned int rpmteHeaderSize(rpmte te);
 RPM_GNUC_INTERNAL
 rpmRC rpmpsmRun(rpmts ts, rpmte te, pkgGoal goal);
 
+/**
+ * Wait for an asynchronously executing scriptlet (if any) to finish.
+ */
+RPM_GNUC_INTERNAL
+void rpmpsmWaitAsync(void);
+
+/**
+ * Wait for asynchronously queued rpmdb commits (if any) to be applied.
+ * @return		RPMRC_OK, or the first failed commit's result
+ *			(sticky until rpmpsmFinishDb() collects it)
+ */
+RPM_GNUC_INTERNAL
+rpmRC rpmpsmWaitDb(void);
+
+/**
+ * Drain the rpmdb commit queue and collect the result.
+ * @return		RPMRC_OK, or the first failed commit's result
+ */
+RPM_GNUC_INTERNAL
+rpmRC rpmpsmFinishDb(void);
+
 RPM_GNUC_INTERNAL
 int rpmteAddOp(rpmte te);
 
@@ -4,6 +4,9 @@
 #include <rpm/rpmdb.h>
 #include <rpm/rpmds.h>
 #include <rpm/rpmfi.h>
+#include <rpm/rpmmacro.h>
+#include <rpm/rpmstring.h>
+#include <rpm/rpmfileutil.h>
 #include <stdlib.h>
 
 #include "lib/rpmtriggers.h"
@@ -16,6 +19,374 @@
 
 #define TRIGGER_PRIORITY_BOUND 10000
 
+struct trigCacheEntry_s {
+    char *pfx;			/* trigger prefix (index key) */
+    int numPkgs;		/* number of packages carrying a trigger on pfx */
+    unsigned int *pkgOffsets;	/* header numbers of those packages */
+    unsigned int *tix;		/* trigger index within each package */
+    unsigned int *priorities;	/* priority of each trigger */
+};
+
+struct rpmtrigCache_s {
+    struct trigCacheEntry_s *entries;
+    int count;
+    int alloced;
+};
+
+static rpmtrigCache trigCacheCreate(rpmts ts, rpmscriptTriggerModes tm)
+{
+    rpmtrigCache cache = xcalloc(1, sizeof(*cache));
+    rpmdbIndexIterator ii;
+    const void *key;
+    size_t keylen;
+    rpmTagVal priorityTag = (tm == RPMSCRIPT_FILETRIGGER) ?
+		RPMTAG_FILETRIGGERPRIORITIES : RPMTAG_TRANSFILETRIGGERPRIORITIES;
+    Header trigH = NULL;
+    unsigned int trigHOffset = 0;
+
+    cache->alloced = 16;
+    cache->entries = xmalloc(sizeof(*cache->entries) * cache->alloced);
+
+    /* The index scan must see database commits still queued */
+    rpmpsmWaitDb();
+
+    ii = rpmdbIndexIteratorInit(rpmtsGetRdb(ts), triggerDsTag(tm));
+
+    while ((rpmdbIndexIteratorNext(ii, &key, &keylen)) == 0) {
+	struct trigCacheEntry_s *e;
+	int numPkgs = rpmdbIndexIteratorNumPkgs(ii);
+
+	if (cache->count == cache->alloced) {
+	    cache->alloced <<= 1;
+	    cache->entries = xrealloc(cache->entries,
+				sizeof(*cache->entries) * cache->alloced);
+	}
+	e = &cache->entries[cache->count++];
+	e->pfx = xmalloc(keylen + 1);
+	memcpy(e->pfx, key, keylen);
+	e->pfx[keylen] = '\0';
+	e->numPkgs = numPkgs;
+	e->pkgOffsets = xmalloc(sizeof(*e->pkgOffsets) * numPkgs);
+	e->tix = xmalloc(sizeof(*e->tix) * numPkgs);
+	e->priorities = xmalloc(sizeof(*e->priorities) * numPkgs);
+
+	for (int i = 0; i < numPkgs; i++) {
+	    struct rpmtd_s priorities;
+	    unsigned int offset = rpmdbIndexIteratorPkgOffset(ii, i);
+
+	    e->pkgOffsets[i] = offset;
+	    e->tix[i] = rpmdbIndexIteratorTagNum(ii, i);
+	    e->priorities[i] = 0;
+
+	    /* The same package tends to carry many triggers, load it once */
+	    if (trigH == NULL || offset != trigHOffset) {
+		headerFree(trigH);
+		trigH = rpmdbGetHeaderAt(rpmtsGetRdb(ts), offset);
+		trigHOffset = offset;
+	    }
+	    if (trigH && headerGet(trigH, priorityTag, &priorities,
+				    HEADERGET_MINMEM)) {
+		rpmtdSetIndex(&priorities, e->tix[i]);
+		e->priorities[i] = *rpmtdGetUint32(&priorities);
+	    }
+	}
+    }
+    headerFree(trigH);
+    rpmdbIndexIteratorFree(ii);
+
+    return cache;
+}
+
+rpmtrigCache rpmtrigCacheFree(rpmtrigCache cache)
+{
+    if (cache) {
+	for (int i = 0; i < cache->count; i++) {
+	    free(cache->entries[i].pfx);
+	    free(cache->entries[i].pkgOffsets);
+	    free(cache->entries[i].tix);
+	    free(cache->entries[i].priorities);
+	}
+	free(cache->entries);
+	free(cache);
+    }
+    return NULL;
+}
+
+/* Drop all triggers owned by one package, entries may become empty */
+static void trigCacheDropOffset(rpmtrigCache cache, unsigned int offset)
+{
+    for (int i = 0; i < cache->count; i++) {
+	struct trigCacheEntry_s *e = &cache->entries[i];
+	int n = 0;
+
+	for (int j = 0; j < e->numPkgs; j++) {
+	    if (e->pkgOffsets[j] == offset)
+		continue;
+	    if (j != n) {
+		e->pkgOffsets[n] = e->pkgOffsets[j];
+		e->tix[n] = e->tix[j];
+		e->priorities[n] = e->priorities[j];
+	    }
+	    n++;
+	}
+	e->numPkgs = n;
+    }
+}
+
+void rpmtrigCacheInvalidate(rpmts ts, Header h)
+{
+    /* A removed header carries its instance, one being added doesn't
+     * have one assigned yet (the db writer may still be queueing it),
+     * so removals are maintained in place and additions drop the cache */
+    unsigned int instance = (h != NULL) ? headerGetInstance(h) : 0;
+
+    if (h == NULL || headerIsEntry(h, RPMTAG_FILETRIGGERNAME)) {
+	if (instance > 0 && ts->fileTrigCache != NULL)
+	    trigCacheDropOffset(ts->fileTrigCache, instance);
+	else
+	    ts->fileTrigCache = rpmtrigCacheFree(ts->fileTrigCache);
+    }
+    if (h == NULL || headerIsEntry(h, RPMTAG_TRANSFILETRIGGERNAME)) {
+	if (instance > 0 && ts->transFileTrigCache != NULL)
+	    trigCacheDropOffset(ts->transFileTrigCache, instance);
+	else
+	    ts->transFileTrigCache = rpmtrigCacheFree(ts->transFileTrigCache);
+    }
+}
+
+/*
+ * Persisted form of the trigger match tables (optional, see
+ * %_trigcache_path): the tables resolved during a transaction are
+ * written back next to the rpmdb and reused by later transactions,
+ * replacing the per-transaction trigger index scans and the header
+ * loads for priorities. Validated against rpmdbCookie(), a stale
+ * file is simply ignored and overwritten.
+ */
+
+static const char trigcache_magic[8] = "RPMTrgC\001";
+
+static char *trigCachePath(rpmts ts)
+{
+    char *path = NULL;
+    char *fn = rpmExpand("%{?_trigcache_path}", NULL);
+    if (*fn != '\0')
+	path = rpmGenPath(rpmtsRootDir(ts), fn, NULL);
+    free(fn);
+    return path;
+}
+
+static int trigCacheWriteTable(FILE *fp, rpmscriptTriggerModes tm,
+			       rpmtrigCache cache)
+{
+    uint32_t v, count = 0;
+    int ok = 1;
+
+    for (int i = 0; i < cache->count; i++)
+	if (cache->entries[i].numPkgs > 0)
+	    count++;
+
+    v = tm;
+    ok &= (fwrite(&v, sizeof(v), 1, fp) == 1);
+    ok &= ok && (fwrite(&count, sizeof(count), 1, fp) == 1);
+    for (int i = 0; ok && i < cache->count; i++) {
+	struct trigCacheEntry_s *e = &cache->entries[i];
+	uint32_t pfxlen = strlen(e->pfx);
+	uint32_t numPkgs = e->numPkgs;
+
+	if (numPkgs == 0)
+	    continue;
+	ok &= (fwrite(&pfxlen, sizeof(pfxlen), 1, fp) == 1);
+	ok &= ok && (fwrite(e->pfx, 1, pfxlen, fp) == pfxlen);
+	ok &= ok && (fwrite(&numPkgs, sizeof(numPkgs), 1, fp) == 1);
+	ok &= ok && (fwrite(e->pkgOffsets, sizeof(*e->pkgOffsets),
+			    numPkgs, fp) == numPkgs);
+	ok &= ok && (fwrite(e->tix, sizeof(*e->tix), numPkgs, fp) == numPkgs);
+	ok &= ok && (fwrite(e->priorities, sizeof(*e->priorities),
+			    numPkgs, fp) == numPkgs);
+    }
+    return ok;
+}
+
+static rpmtrigCache trigCacheReadTable(FILE *fp)
+{
+    rpmtrigCache cache;
+    uint32_t count;
+
+    if (fread(&count, sizeof(count), 1, fp) != 1)
+	return NULL;
+
+    cache = xcalloc(1, sizeof(*cache));
+    cache->alloced = count ? count : 1;
+    cache->entries = xcalloc(cache->alloced, sizeof(*cache->entries));
+    for (uint32_t i = 0; i < count; i++) {
+	struct trigCacheEntry_s *e = &cache->entries[cache->count];
+	uint32_t pfxlen, numPkgs;
+
+	if (fread(&pfxlen, sizeof(pfxlen), 1, fp) != 1 || pfxlen == 0)
+	    goto err;
+	e->pfx = xmalloc(pfxlen + 1);
+	e->pfx[pfxlen] = '\0';
+	cache->count++;
+	if (fread(e->pfx, 1, pfxlen, fp) != pfxlen)
+	    goto err;
+	if (fread(&numPkgs, sizeof(numPkgs), 1, fp) != 1 || numPkgs == 0)
+	    goto err;
+	e->numPkgs = numPkgs;
+	e->pkgOffsets = xmalloc(sizeof(*e->pkgOffsets) * numPkgs);
+	e->tix = xmalloc(sizeof(*e->tix) * numPkgs);
+	e->priorities = xmalloc(sizeof(*e->priorities) * numPkgs);
+	if (fread(e->pkgOffsets, sizeof(*e->pkgOffsets), numPkgs, fp) != numPkgs)
+	    goto err;
+	if (fread(e->tix, sizeof(*e->tix), numPkgs, fp) != numPkgs)
+	    goto err;
+	if (fread(e->priorities, sizeof(*e->priorities), numPkgs, fp) != numPkgs)
+	    goto err;
+    }
+    return cache;
+
+err:
+    return rpmtrigCacheFree(cache);
+}
+
+static void trigCacheLoad(rpmts ts)
+{
+    char *path = trigCachePath(ts);
+    char *cookie = NULL;
+    FILE *fp = NULL;
+    char magic[sizeof(trigcache_magic)];
+    uint32_t ntables, len;
+    rpmtrigCache fileCache = NULL;
+    rpmtrigCache transCache = NULL;
+
+    ts->trigCacheLoaded = 1;
+    if (path == NULL)
+	return;
+    if ((fp = fopen(path, "r")) == NULL)
+	goto exit;
+
+    /* The cookie must see database commits still queued */
+    rpmpsmWaitDb();
+    if ((cookie = rpmdbCookie(rpmtsGetRdb(ts))) == NULL)
+	goto exit;
+
+    if (fread(magic, 1, sizeof(magic), fp) != sizeof(magic) ||
+	    memcmp(magic, trigcache_magic, sizeof(magic)) != 0)
+	goto exit;
+    if (fread(&len, sizeof(len), 1, fp) != 1 || len != strlen(cookie))
+	goto exit;
+    {
+	char fcookie[len + 1];
+	if (fread(fcookie, 1, len, fp) != len)
+	    goto exit;
+	fcookie[len] = '\0';
+	if (!rstreq(fcookie, cookie))
+	    goto exit;
+    }
+    if (fread(&ntables, sizeof(ntables), 1, fp) != 1 || ntables > 2)
+	goto exit;
+
+    for (uint32_t i = 0; i < ntables; i++) {
+	uint32_t tm;
+	rpmtrigCache *cp;
+
+	if (fread(&tm, sizeof(tm), 1, fp) != 1)
+	    goto err;
+	if (tm == RPMSCRIPT_FILETRIGGER)
+	    cp = &fileCache;
+	else if (tm == RPMSCRIPT_TRANSFILETRIGGER)
+	    cp = &transCache;
+	else
+	    goto err;
+	if (*cp != NULL || (*cp = trigCacheReadTable(fp)) == NULL)
+	    goto err;
+    }
+
+    /* Install only fully validated tables, and only into empty slots */
+    if (fileCache != NULL && ts->fileTrigCache == NULL) {
+	ts->fileTrigCache = fileCache;
+	fileCache = NULL;
+    }
+    if (transCache != NULL && ts->transFileTrigCache == NULL) {
+	ts->transFileTrigCache = transCache;
+	transCache = NULL;
+    }
+
+err:
+    rpmtrigCacheFree(fileCache);
+    rpmtrigCacheFree(transCache);
+exit:
+    if (fp)
+	fclose(fp);
+    free(cookie);
+    free(path);
+}
+
+void rpmtrigCachePersist(rpmts ts)
+{
+    char *path = trigCachePath(ts);
+    char *tmppath = NULL;
+    char *cookie = NULL;
+    FILE *fp = NULL;
+    uint32_t ntables, len;
+    int ok = 1;
+
+    if (path == NULL)
+	goto exit;
+    ntables = (ts->fileTrigCache != NULL) + (ts->transFileTrigCache != NULL);
+    /* Nothing was resolved this run: leave the previous file alone, a
+     * cookie mismatch invalidates it by itself if the rpmdb changed */
+    if (ntables == 0)
+	goto exit;
+
+    /* The cookie must cover database commits still queued */
+    rpmpsmWaitDb();
+    if ((cookie = rpmdbCookie(rpmtsGetRdb(ts))) == NULL)
+	goto exit;
+    len = strlen(cookie);
+
+    rasprintf(&tmppath, "%s.tmp.%d", path, (int) getpid());
+    if ((fp = fopen(tmppath, "w")) == NULL)
+	goto exit;
+
+    ok &= (fwrite(trigcache_magic, 1, sizeof(trigcache_magic), fp)
+		== sizeof(trigcache_magic));
+    ok &= ok && (fwrite(&len, sizeof(len), 1, fp) == 1);
+    ok &= ok && (fwrite(cookie, 1, len, fp) == len);
+    ok &= ok && (fwrite(&ntables, sizeof(ntables), 1, fp) == 1);
+    if (ok && ts->fileTrigCache != NULL)
+	ok = trigCacheWriteTable(fp, RPMSCRIPT_FILETRIGGER, ts->fileTrigCache);
+    if (ok && ts->transFileTrigCache != NULL)
+	ok = trigCacheWriteTable(fp, RPMSCRIPT_TRANSFILETRIGGER,
+				 ts->transFileTrigCache);
+    if (fclose(fp) != 0)
+	ok = 0;
+    fp = NULL;
+    if (!ok || rename(tmppath, path) != 0)
+	unlink(tmppath);
+
+exit:
+    if (fp)
+	fclose(fp);
+    free(tmppath);
+    free(cookie);
+    free(path);
+}
+
+static rpmtrigCache rpmtsTrigCache(rpmts ts, rpmscriptTriggerModes tm)
+{
+    rpmtrigCache *cp = (tm == RPMSCRIPT_FILETRIGGER) ?
+		&ts->fileTrigCache : &ts->transFileTrigCache;
+
+    /* The persisted tables can stand in for the index scan, but only
+     * before this transaction changes the rpmdb (the file cookie goes
+     * stale with the first change), so one attempt per transaction */
+    if (*cp == NULL && !ts->trigCacheLoaded)
+	trigCacheLoad(ts);
+    if (*cp == NULL)
+	*cp = trigCacheCreate(ts, tm);
+    return *cp;
+}
+
 rpmtriggers rpmtriggersCreate(unsigned int hint)
 {
     rpmtriggers triggers = xmalloc(sizeof(struct rpmtriggers_s));
@@ -100,38 +471,38 @@ static void rpmtriggersSortAndUniq(rpmtriggers trigs)
 void rpmtriggersPrepPostUnTransFileTrigs(rpmts ts, rpmte te)
 {
     rpmdbMatchIterator mi;
-    rpmdbIndexIterator ii;
+    rpmtrigCache cache;
     Header trigH;
-    const void *key;
-    size_t keylen;
     rpmfiles files;
     rpmds rpmdsTriggers;
     rpmds rpmdsTrigger;
 
-    ii = rpmdbIndexIteratorInit(rpmtsGetRdb(ts), RPMDBI_TRANSFILETRIGGERNAME);
+    cache = rpmtsTrigCache(ts, RPMSCRIPT_TRANSFILETRIGGER);
     mi = rpmdbNewIterator(rpmtsGetRdb(ts), RPMDBI_PACKAGES);
     files = rpmteFiles(te);
 
-    /* Iterate over file triggers in rpmdb */
-    while ((rpmdbIndexIteratorNext(ii, &key, &keylen)) == 0) {
-	char pfx[keylen + 1];
-	memcpy(pfx, key, keylen);
-	pfx[keylen] = '\0';
+    /* Iterate over the cached file trigger index */
+    for (int i = 0; i < cache->count; i++) {
+	struct trigCacheEntry_s *e = &cache->entries[i];
+	rpmfi fi;
+
+	if (e->numPkgs == 0)	/* all owners removed in-transaction */
+	    continue;
 	/* Check if file trigger matches any installed file in this te */
-	rpmfi fi = rpmfilesFindPrefix(files, pfx);
+	fi = rpmfilesFindPrefix(files, e->pfx);
 	while (rpmfiNext(fi) >= 0) {
 	    if (RPMFILE_IS_INSTALLED(rpmfiFState(fi))) {
 		/* If yes then store it */
-		rpmdbAppendIterator(mi, rpmdbIndexIteratorPkgOffsets(ii),
-				rpmdbIndexIteratorNumPkgs(ii));
+		rpmdbAppendIterator(mi, e->pkgOffsets, e->numPkgs);
 		break;
 	    }
 	}
 	rpmfiFree(fi);
     }
-    rpmdbIndexIteratorFree(ii);
 
     if (rpmdbGetIteratorCount(mi)) {
+	/* Trigger headers are read from the database, flush commits */
+	rpmpsmWaitDb();
 	/* Filter triggers and save only trans postun triggers into ts */
 	while ((trigH = rpmdbNextIterator(mi)) != NULL) {
 	    int tix = 0;
@@ -167,6 +538,9 @@ int runPostUnTransFileTrigs(rpmts ts)
     int nerrors = 0;
 
     rpmtriggersSortAndUniq(trigs);
+    /* Trigger headers are read from the database, flush queued commits */
+    if (trigs->count > 0)
+	rpmpsmWaitDb();
     /* Iterate over stored triggers */
     for (i = 0; i < trigs->count; i++) {
 	/* Get header containing trigger script */
@@ -467,6 +841,9 @@ static int matchFilesInTran(rpmts ts, rpmte te, const char *pfx,
     int rc = 1;
     rpmdbMatchIterator pi;
 
+    /* Flush database commits still queued on the writer thread */
+    rpmpsmWaitDb();
+
     /* Get all files from rpmdb starting with pfx */
     pi = rpmdbInitPrefixIterator(rpmtsGetRdb(ts), RPMDBI_DIRNAMES, pfx, 0);
 
@@ -487,39 +864,29 @@ rpmRC runFileTriggers(rpmts ts, rpmte te, rpmsenseFlags sense,
 			rpmscriptTriggerModes tm, int priorityClass)
 {
     int nerrors = 0, i;
-    rpmdbIndexIterator ii;
-    const void *key;
-    char *pfx;
-    size_t keylen;
     Header trigH;
     int (*matchFunc)(rpmts, rpmte, const char*, rpmsenseFlags sense);
-    rpmTagVal priorityTag;
+    rpmtrigCache cache;
     rpmtriggers triggers = rpmtriggersCreate(10);
 
     /* Decide if we match triggers against files in te or in whole ts */
-    if (tm == RPMSCRIPT_FILETRIGGER) {
+    if (tm == RPMSCRIPT_FILETRIGGER)
 	matchFunc = matchFilesInPkg;
-	priorityTag = RPMTAG_FILETRIGGERPRIORITIES;
-    } else {
+    else
 	matchFunc = matchFilesInTran;
-	priorityTag = RPMTAG_TRANSFILETRIGGERPRIORITIES;
-    }
 
-    ii = rpmdbIndexIteratorInit(rpmtsGetRdb(ts), triggerDsTag(tm));
+    cache = rpmtsTrigCache(ts, tm);
 
     /* Loop over all file triggers in rpmdb */
-    while ((rpmdbIndexIteratorNext(ii, &key, &keylen)) == 0) {
-	pfx = xmalloc(keylen + 1);
-	memcpy(pfx, key, keylen);
-	pfx[keylen] = '\0';
+    for (int j = 0; j < cache->count; j++) {
+	struct trigCacheEntry_s *e = &cache->entries[j];
 
+	if (e->numPkgs == 0)	/* all owners removed in-transaction */
+	    continue;
 	/* Check if file trigger is fired by any file in ts/te */
-	if (matchFunc(ts, te, pfx, sense)) {
-	    for (i = 0; i < rpmdbIndexIteratorNumPkgs(ii); i++) {
-		struct rpmtd_s priorities;
-		unsigned int priority;
-		unsigned int offset = rpmdbIndexIteratorPkgOffset(ii, i);
-		unsigned int tix = rpmdbIndexIteratorTagNum(ii, i);
+	if (matchFunc(ts, te, e->pfx, sense)) {
+	    for (i = 0; i < e->numPkgs; i++) {
+		unsigned int offset = e->pkgOffsets[i];
 
 		/*
 		 * Don't handle transaction triggers installed in current
@@ -531,24 +898,19 @@ rpmRC runFileTriggers(rpmts ts, rpmte te, rpmsenseFlags sense,
 		    packageHashHasEntry(ts->members->installedPackages, offset)))
 		    continue;
 
-		/* Get priority of trigger from header */
-		trigH = rpmdbGetHeaderAt(rpmtsGetRdb(ts), offset);
-		headerGet(trigH, priorityTag, &priorities, HEADERGET_MINMEM);
-		rpmtdSetIndex(&priorities, tix);
-		priority = *rpmtdGetUint32(&priorities);
-		headerFree(trigH);
-
 		/* Store file trigger in array */
-		rpmtriggersAdd(triggers, offset, tix, priority);
+		rpmtriggersAdd(triggers, offset, e->tix[i], e->priorities[i]);
 	    }
 	}
-	free(pfx);
     }
-    rpmdbIndexIteratorFree(ii);
 
     /* Sort triggers by priority, offset, trigger index */
     rpmtriggersSortAndUniq(triggers);
 
+    /* Trigger headers are read from the database, flush queued commits */
+    if (triggers->count > 0)
+	rpmpsmWaitDb();
+
     /* Handle stored triggers */
     for (i = 0; i < triggers->count; i++) {
 	if (priorityClass == 1) {
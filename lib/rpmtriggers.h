@@ -16,6 +16,15 @@ typedef struct rpmtriggers_s {
     int alloced;
 } *rpmtriggers;
 
+/*
+ * Cached snapshot of a file trigger index (file triggers or transaction
+ * file triggers), built lazily on first use and shared by all elements
+ * of a transaction. Stores per prefix the carrying packages, trigger
+ * indexes and priorities so matching a transaction element doesn't
+ * re-read the index and the trigger headers over and over.
+ */
+typedef struct rpmtrigCache_s *rpmtrigCache;
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -27,6 +36,29 @@ rpmtriggers rpmtriggersCreate(unsigned int hint);
 RPM_GNUC_INTERNAL
 rpmtriggers rpmtriggersFree(rpmtriggers triggers);
 
+RPM_GNUC_INTERNAL
+rpmtrigCache rpmtrigCacheFree(rpmtrigCache cache);
+
+/*
+ * Update cached file trigger indexes that header h invalidates, i.e.
+ * that cover a trigger tag h carries. Must be called whenever a package
+ * is added to or removed from the rpmdb in mid-transaction so that
+ * triggers installed earlier in the transaction fire for later elements.
+ * Removals are maintained in place, additions drop the affected cache.
+ * A NULL header drops both caches unconditionally.
+ */
+RPM_GNUC_INTERNAL
+void rpmtrigCacheInvalidate(rpmts ts, Header h);
+
+/*
+ * Write the resolved trigger match tables back next to the rpmdb
+ * (see %_trigcache_path) for later transactions to reuse instead of
+ * scanning the trigger indexes. Called before the database is closed;
+ * does nothing when the macro is unset or no table was resolved.
+ */
+RPM_GNUC_INTERNAL
+void rpmtrigCachePersist(rpmts ts);
+
 /*
  * Prepare post trans uninstall file triggers. After transcation uninstalled
  * files are not saved anywhere. So we need during uninstalation of every
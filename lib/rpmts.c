@@ -7,6 +7,9 @@
 #include <inttypes.h>
 #include <libgen.h>
 #include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
 
 #include <rpm/rpmtypes.h>
 #include <rpm/rpmlib.h>			/* rpmReadPackage etc */
@@ -30,10 +33,13 @@
 #include "lib/rpmts_internal.h"
 #include "lib/rpmte_internal.h"
 #include "lib/misc.h"
+#include "lib/rpmscript.h"
 #include "lib/rpmtriggers.h"
 
 #include "debug.h"
 
+static struct tsEvRing_s *evRingFree(struct tsEvRing_s *er);
+
 /**
  * Iterator across transaction elements, forward on install, backward on erase.
  */
@@ -77,8 +83,13 @@ int rpmtsCloseDB(rpmts ts)
 			rpmdbOp(ts->rdb, RPMDB_OP_DBPUT));
 	(void) rpmswAdd(rpmtsOp(ts, RPMTS_OP_DBDEL),
 			rpmdbOp(ts->rdb, RPMDB_OP_DBDEL));
+	/* Persist resolved trigger tables for the next transaction */
+	rpmtrigCachePersist(ts);
 	rc = rpmdbClose(ts->rdb);
 	ts->rdb = NULL;
+	/* Cached trigger indexes refer to the closed db */
+	rpmtrigCacheInvalidate(ts, NULL);
+	ts->trigCacheLoaded = 0;
     }
     return rc;
 }
@@ -177,6 +188,9 @@ rpmdbMatchIterator rpmtsInitIterator(const rpmts ts, rpmDbiTagVal rpmtag,
     if (ts == NULL)
 	return NULL;
 
+    /* Flush database commits still queued on the writer thread */
+    rpmpsmWaitDb();
+
     if (ts->rdb == NULL && rpmtsOpenDB(ts, ts->dbmode))
 	return NULL;
 
@@ -552,29 +566,16 @@ rpmRC rpmtsImportHeader(rpmtxn txn, Header h, rpmFlags flags)
     return rc;
 }
 
-rpmRC rpmtsImportPubkey(const rpmts ts, const unsigned char * pkt, size_t pktlen)
+/* Import one parsed pubkey into keyring and database (txn held) */
+static rpmRC importPubkey(const rpmts ts, rpmtxn txn, rpmKeyring keyring,
+			  rpmPubkey pubkey)
 {
     Header h = NULL;
     rpmRC rc = RPMRC_FAIL;		/* assume failure */
-    rpmPubkey pubkey = NULL;
     rpmPubkey *subkeys = NULL;
     int subkeysCount = 0;
-    rpmVSFlags oflags = rpmtsVSFlags(ts);
-    rpmKeyring keyring;
-    rpmtxn txn = rpmtxnBegin(ts, RPMTXN_WRITE);
     int krc, i;
 
-    if (txn == NULL)
-	return rc;
-
-    /* XXX keyring wont load if sigcheck disabled, force it temporarily */
-    rpmtsSetVSFlags(ts, (oflags & ~RPMVSF_MASK_NOSIGNATURES));
-    keyring = rpmtsGetKeyring(ts, 1);
-    rpmtsSetVSFlags(ts, oflags);
-
-    if ((pubkey = rpmPubkeyNew(pkt, pktlen)) == NULL)
-	goto exit;
-
     if ((subkeys = rpmGetSubkeys(pubkey, &subkeysCount)) == NULL)
 	goto exit;
 
@@ -602,16 +603,53 @@ rpmRC rpmtsImportPubkey(const rpmts ts, const unsigned char * pkt, size_t pktlen
 exit:
     /* Clean up. */
     headerFree(h);
-    rpmPubkeyFree(pubkey);
     for (i = 0; i < subkeysCount; i++)
 	rpmPubkeyFree(subkeys[i]);
     free(subkeys);
+    return rc;
+}
+
+rpmRC rpmtsImportPubkeys(const rpmts ts, rpmPubkey * keys, int nkeys)
+{
+    rpmRC rc = RPMRC_FAIL;		/* assume failure */
+    rpmVSFlags oflags = rpmtsVSFlags(ts);
+    rpmKeyring keyring;
+    rpmtxn txn;
+
+    if (nkeys <= 0)
+	return RPMRC_OK;
+
+    if ((txn = rpmtxnBegin(ts, RPMTXN_WRITE)) == NULL)
+	return rc;
+
+    /* XXX keyring wont load if sigcheck disabled, force it temporarily */
+    rpmtsSetVSFlags(ts, (oflags & ~RPMVSF_MASK_NOSIGNATURES));
+    keyring = rpmtsGetKeyring(ts, 1);
+    rpmtsSetVSFlags(ts, oflags);
+
+    rc = RPMRC_OK;
+    for (int i = 0; i < nkeys; i++) {
+	if (keys[i] == NULL || importPubkey(ts, txn, keyring, keys[i]))
+	    rc = RPMRC_FAIL;
+    }
 
     rpmKeyringFree(keyring);
     rpmtxnEnd(txn);
     return rc;
 }
 
+rpmRC rpmtsImportPubkey(const rpmts ts, const unsigned char * pkt, size_t pktlen)
+{
+    rpmRC rc = RPMRC_FAIL;		/* assume failure */
+    rpmPubkey pubkey;
+
+    if ((pubkey = rpmPubkeyNew(pkt, pktlen)) != NULL)
+	rc = rpmtsImportPubkeys(ts, &pubkey, 1);
+
+    rpmPubkeyFree(pubkey);
+    return rc;
+}
+
 int rpmtsSetSolveCallback(rpmts ts,
 		int (*solve) (rpmts ts, rpmds key, const void * data),
 		const void * solveData)
@@ -636,7 +674,7 @@ int rpmtsSolve(rpmts ts, rpmds key)
 
 rpmps rpmtsProblems(rpmts ts)
 {
-    rpmps ps = rpmpsCreate();
+    rpmps ps = rpmpsCreatePool(rpmtsPool(ts));
     rpmtsi pi = rpmtsiInit(ts);
     rpmte p;
 
@@ -684,6 +722,52 @@ void rpmtsClean(rpmts ts)
     rpmtsCleanProblems(ts);
 }
 
+#define TSARENA_CHUNK (32 * 1024)
+
+struct tsArenaChunk_s {
+    struct tsArenaChunk_s *next;
+    size_t size;		/*!< usable bytes in this chunk */
+    size_t used;
+};
+
+void * rpmtsArenaAlloc(rpmts ts, size_t size)
+{
+    tsMembers tsmem = rpmtsMembers(ts);
+    tsArenaChunk chunk = tsmem->arena;
+    void *ptr;
+
+    /* Keep everything naturally aligned for the types we hand out */
+    size = (size + 7) & ~((size_t)7);
+
+    if (chunk == NULL || chunk->size - chunk->used < size) {
+	size_t csize = (size > TSARENA_CHUNK) ? size : TSARENA_CHUNK;
+	chunk = xcalloc(1, sizeof(*chunk) + csize);
+	chunk->size = csize;
+	chunk->next = tsmem->arena;
+	tsmem->arena = chunk;
+    }
+
+    ptr = (uint8_t *)(chunk + 1) + chunk->used;
+    chunk->used += size;
+    return ptr;
+}
+
+char * rpmtsArenaStrdup(rpmts ts, const char *s)
+{
+    return (s != NULL) ?
+	memcpy(rpmtsArenaAlloc(ts, strlen(s) + 1), s, strlen(s) + 1) : NULL;
+}
+
+static tsArenaChunk tsArenaFree(tsArenaChunk arena)
+{
+    while (arena) {
+	tsArenaChunk next = arena->next;
+	free(arena);
+	arena = next;
+    }
+    return NULL;
+}
+
 /* hash comparison function */
 static int uintCmp(unsigned int a, unsigned int b)
 {
@@ -710,9 +794,12 @@ void rpmtsEmpty(rpmts ts)
     }
 
     tsmem->orderCount = 0;
+    /* All elements are gone, release their backing arena wholesale */
+    tsmem->arena = tsArenaFree(tsmem->arena);
     /* The pool cannot be emptied, there might be references to its contents */
     tsmem->pool = rpmstrPoolFree(tsmem->pool);
     packageHashEmpty(tsmem->removedPackages);
+    packageHashEmpty(tsmem->nevraIndex);
     return;
 }
 
@@ -747,6 +834,83 @@ static void rpmtsPrintStats(rpmts ts)
     rpmtsPrintStat("dbget:       ", rpmtsOp(ts, RPMTS_OP_DBGET));
     rpmtsPrintStat("dbput:       ", rpmtsOp(ts, RPMTS_OP_DBPUT));
     rpmtsPrintStat("dbdel:       ", rpmtsOp(ts, RPMTS_OP_DBDEL));
+    rpmtsPrintStat("fsopen:      ", rpmtsOp(ts, RPMTS_OP_FSOPEN));
+    rpmtsPrintStat("fswrite:     ", rpmtsOp(ts, RPMTS_OP_FSWRITE));
+    rpmtsPrintStat("fssync:      ", rpmtsOp(ts, RPMTS_OP_FSSYNC));
+    rpmtsPrintStat("fsrename:    ", rpmtsOp(ts, RPMTS_OP_FSRENAME));
+    rpmtsPrintStat("fslink:      ", rpmtsOp(ts, RPMTS_OP_FSLINK));
+    rpmtsPrintStat("fsthrottle:  ", rpmtsOp(ts, RPMTS_OP_FSTHROTTLE));
+}
+
+static void rpmtsPrintStatJson(FILE *fp, const char *name,
+			       struct rpmop_s *op, const char *sep)
+{
+    fprintf(fp, "%s\"%s\":{\"count\":%d,\"bytes\":%llu,\"usecs\":%llu}",
+	    sep, name, op->count,
+	    (unsigned long long)op->bytes, (unsigned long long)op->usecs);
+}
+
+void rpmtsPrintStatsJson(rpmts ts)
+{
+    static const struct {
+	const char *name;
+	rpmtsOpX opx;
+    } opstab[] = {
+	{ "check",	RPMTS_OP_CHECK },
+	{ "order",	RPMTS_OP_ORDER },
+	{ "verify",	RPMTS_OP_VERIFY },
+	{ "fingerprint",RPMTS_OP_FINGERPRINT },
+	{ "install",	RPMTS_OP_INSTALL },
+	{ "erase",	RPMTS_OP_ERASE },
+	{ "scriptlets",	RPMTS_OP_SCRIPTLETS },
+	{ "compress",	RPMTS_OP_COMPRESS },
+	{ "uncompress",	RPMTS_OP_UNCOMPRESS },
+	{ "digest",	RPMTS_OP_DIGEST },
+	{ "signature",	RPMTS_OP_SIGNATURE },
+	{ "dbadd",	RPMTS_OP_DBADD },
+	{ "dbremove",	RPMTS_OP_DBREMOVE },
+	{ "dbget",	RPMTS_OP_DBGET },
+	{ "dbput",	RPMTS_OP_DBPUT },
+	{ "dbdel",	RPMTS_OP_DBDEL },
+	{ "fsopen",	RPMTS_OP_FSOPEN },
+	{ "fswrite",	RPMTS_OP_FSWRITE },
+	{ "fssync",	RPMTS_OP_FSSYNC },
+	{ "fsrename",	RPMTS_OP_FSRENAME },
+	{ "fslink",	RPMTS_OP_FSLINK },
+	{ "fsthrottle",	RPMTS_OP_FSTHROTTLE },
+    };
+    tsMembers tsmem = rpmtsMembers(ts);
+    FILE *fp = stderr;
+    /* Snapshot the still running total timer instead of stopping it */
+    struct rpmop_s total = *rpmtsOp(ts, RPMTS_OP_TOTAL);
+
+    (void) rpmswExit(&total, 0);
+
+    fprintf(fp, "{\"ops\":{");
+    rpmtsPrintStatJson(fp, "total", &total, "");
+    for (int i = 0; i < sizeof(opstab) / sizeof(opstab[0]); i++)
+	rpmtsPrintStatJson(fp, opstab[i].name, rpmtsOp(ts, opstab[i].opx), ",");
+    fprintf(fp, "},\"elements\":[");
+    for (int oc = 0; oc < tsmem->orderCount; oc++) {
+	rpmte te = tsmem->order[oc];
+	const char *op = (rpmteType(te) == TR_ADDED) ? "install" :
+			 (rpmteType(te) == TR_REMOVED) ? "erase" : "rpmdb";
+	fprintf(fp, "%s{\"nevra\":\"%s\",\"op\":\"%s\",\"usecs\":%llu",
+		oc ? "," : "", rpmteNEVRA(te), op,
+		(unsigned long long)rpmteOp(te)->usecs);
+	if (rpmtsFlags(ts) & RPMTRANS_FLAG_SYSCALLSTATS) {
+	    static const char * const scnames[RPMTE_SCOP_MAX] = {
+		"open", "write", "fsync", "rename", "link", "throttle",
+	    };
+	    fprintf(fp, ",\"syscalls\":{");
+	    for (int i = 0; i < RPMTE_SCOP_MAX; i++)
+		rpmtsPrintStatJson(fp, scnames[i], rpmteScOp(te, i),
+				   i ? "," : "");
+	    fprintf(fp, "}");
+	}
+	fprintf(fp, "}");
+    }
+    fprintf(fp, "]}\n");
 }
 
 rpmts rpmtsFree(rpmts ts)
@@ -766,6 +930,7 @@ rpmts rpmtsFree(rpmts ts)
 
     tsmem->removedPackages = packageHashFree(tsmem->removedPackages);
     tsmem->installedPackages = packageHashFree(tsmem->installedPackages);
+    tsmem->nevraIndex = packageHashFree(tsmem->nevraIndex);
     tsmem->order = _free(tsmem->order);
     ts->members = _free(ts->members);
 
@@ -780,16 +945,25 @@ rpmts rpmtsFree(rpmts ts)
     ts->lock = rpmlockFree(ts->lock);
 
     ts->keyring = rpmKeyringFree(ts->keyring);
+    ts->dirCache = rpmstrPoolFree(ts->dirCache);
     ts->netsharedPaths = argvFree(ts->netsharedPaths);
     ts->installLangs = argvFree(ts->installLangs);
 
     ts->plugins = rpmpluginsFree(ts->plugins);
 
+    ts->evring = evRingFree(ts->evring);
+
+    rpmScriptPoolFree();
+
     rpmtriggersFree(ts->trigs2run);
+    rpmtrigCacheFree(ts->fileTrigCache);
+    rpmtrigCacheFree(ts->transFileTrigCache);
 
     if (_rpmts_stats)
 	rpmtsPrintStats(ts);
 
+    rpmMemProfDump("rpmtsFree");
+
     (void) rpmtsUnlink(ts);
 
     ts = _free(ts);
@@ -921,10 +1095,231 @@ rpmdb rpmtsGetRdb(rpmts ts)
     return rdb;
 }
 
+/*
+ * Shared-memory transaction event stream (see rpmtsSetEventRing()):
+ * a single-producer ring of fixed-size binary records in a POSIX shm
+ * segment, mirroring everything that goes through rpmtsNotify().
+ * Consumers attach with rpmtsEventRingOpen() and batch-read without
+ * per-event IPC; the producer never blocks or waits for them.
+ */
+
+#define EVRING_MAGIC	0x52744576	/* "RtEv" */
+#define EVRING_VERSION	1
+
+struct evringSeg_s {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t nrecords;		/* ring capacity, power of two */
+    uint32_t unused;
+    uint64_t head;		/* producer position, grows without bound */
+    struct rpmtsEvent_s recs[];
+};
+
+struct tsEvRing_s {		/* producer side */
+    struct evringSeg_s *seg;
+    size_t size;
+    char *name;
+    rpmte lastTe;		/* order index cache */
+    uint32_t lastIdx;
+};
+
+struct rpmtsEventRing_s {	/* consumer side */
+    struct evringSeg_s *seg;
+    size_t size;
+    uint64_t cursor;
+};
+
+static struct tsEvRing_s *evRingFree(struct tsEvRing_s *er)
+{
+    if (er) {
+	munmap(er->seg, er->size);
+	shm_unlink(er->name);
+	free(er->name);
+	free(er);
+    }
+    return NULL;
+}
+
+static void evRingEmit(rpmts ts, rpmte te, rpmCallbackType what,
+		       rpm_loff_t amount, rpm_loff_t total)
+{
+    struct tsEvRing_s *er = ts->evring;
+    struct evringSeg_s *seg = er->seg;
+    uint64_t head = seg->head;
+    struct rpmtsEvent_s *ev = &seg->recs[head & (seg->nrecords - 1)];
+    struct timespec now;
+    uint32_t elem = RPMTS_EVENT_NOELEM;
+
+    if (te != NULL) {
+	if (te == er->lastTe) {
+	    elem = er->lastIdx;
+	} else {
+	    /* Events come in long runs per element, misses are rare */
+	    int nelem = rpmtsNElements(ts);
+	    for (int i = 0; i < nelem; i++) {
+		if (rpmtsElement(ts, i) == te) {
+		    er->lastTe = te;
+		    er->lastIdx = elem = i;
+		    break;
+		}
+	    }
+	}
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    ev->elem = elem;
+    ev->event = what;
+    ev->amount = amount;
+    ev->total = total;
+    ev->time_us = (uint64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+    /* Publish the record before moving the head past it */
+    __atomic_store_n(&seg->head, head + 1, __ATOMIC_RELEASE);
+}
+
+int rpmtsSetEventRing(rpmts ts, const char *name, unsigned int nrecords)
+{
+    struct evringSeg_s *seg = MAP_FAILED;
+    size_t size = 0;
+    uint32_t n = 1024;
+    int fd = -1;
+    int rc = -1;
+
+    if (ts == NULL)
+	return -1;
+
+    ts->evring = evRingFree(ts->evring);
+    if (name == NULL)
+	return 0;
+
+    if (nrecords == 0)
+	nrecords = 65536;
+    while (n < nrecords)
+	n <<= 1;
+    size = sizeof(*seg) + (size_t)n * sizeof(struct rpmtsEvent_s);
+
+    if ((fd = shm_open(name, O_RDWR | O_CREAT, 0600)) < 0)
+	goto exit;
+    if (ftruncate(fd, size) != 0)
+	goto exit;
+    seg = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (seg == MAP_FAILED)
+	goto exit;
+
+    seg->version = EVRING_VERSION;
+    seg->nrecords = n;
+    seg->head = 0;
+    /* Publish the magic last, consumers may already be waiting */
+    __atomic_store_n(&seg->magic, EVRING_MAGIC, __ATOMIC_RELEASE);
+
+    ts->evring = xcalloc(1, sizeof(*ts->evring));
+    ts->evring->seg = seg;
+    ts->evring->size = size;
+    ts->evring->name = xstrdup(name);
+    rc = 0;
+
+exit:
+    if (rc != 0 && seg != MAP_FAILED)
+	munmap(seg, size);
+    if (fd >= 0)
+	close(fd);
+    return rc;
+}
+
+rpmtsEventRing rpmtsEventRingOpen(const char *name)
+{
+    rpmtsEventRing ring = NULL;
+    struct evringSeg_s *seg;
+    struct stat sb;
+    size_t size;
+    uint64_t head;
+    int fd;
+
+    if (name == NULL || (fd = shm_open(name, O_RDONLY, 0)) < 0)
+	return NULL;
+    if (fstat(fd, &sb) != 0 || (size_t)sb.st_size < sizeof(*seg))
+	goto exit;
+    size = sb.st_size;
+    seg = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+    if (seg == MAP_FAILED)
+	goto exit;
+
+    if (__atomic_load_n(&seg->magic, __ATOMIC_ACQUIRE) != EVRING_MAGIC ||
+	seg->version != EVRING_VERSION ||
+	seg->nrecords == 0 || (seg->nrecords & (seg->nrecords - 1)) != 0 ||
+	size < sizeof(*seg) + (size_t)seg->nrecords * sizeof(seg->recs[0])) {
+	munmap(seg, size);
+	goto exit;
+    }
+
+    ring = xcalloc(1, sizeof(*ring));
+    ring->seg = seg;
+    ring->size = size;
+    /* Start from the oldest event still present in the ring */
+    head = __atomic_load_n(&seg->head, __ATOMIC_ACQUIRE);
+    ring->cursor = (head > seg->nrecords) ? head - seg->nrecords : 0;
+
+exit:
+    close(fd);
+    return ring;
+}
+
+int rpmtsEventRingRead(rpmtsEventRing ring, struct rpmtsEvent_s *evs,
+		       int nevs, uint64_t *lost)
+{
+    struct evringSeg_s *seg;
+    uint64_t head, start, safe, nlost = 0;
+    int n = 0;
+
+    if (ring == NULL || evs == NULL || nevs <= 0)
+	return -1;
+    seg = ring->seg;
+
+    head = __atomic_load_n(&seg->head, __ATOMIC_ACQUIRE);
+    if (head - ring->cursor > seg->nrecords) {
+	nlost = head - ring->cursor - seg->nrecords;
+	ring->cursor = head - seg->nrecords;
+    }
+    start = ring->cursor;
+    while (ring->cursor < head && n < nevs) {
+	evs[n++] = seg->recs[ring->cursor & (seg->nrecords - 1)];
+	ring->cursor++;
+    }
+
+    /* Records copied while the producer lapped us may be torn, drop them */
+    head = __atomic_load_n(&seg->head, __ATOMIC_ACQUIRE);
+    safe = (head > seg->nrecords) ? head - seg->nrecords : 0;
+    if (safe > start) {
+	uint64_t drop = safe - start;
+	if (drop >= (uint64_t)n) {
+	    nlost += n;
+	    n = 0;
+	} else {
+	    memmove(evs, evs + drop, (n - drop) * sizeof(*evs));
+	    nlost += drop;
+	    n -= drop;
+	}
+    }
+
+    if (lost)
+	*lost = nlost;
+    return n;
+}
+
+rpmtsEventRing rpmtsEventRingFree(rpmtsEventRing ring)
+{
+    if (ring) {
+	munmap(ring->seg, ring->size);
+	free(ring);
+    }
+    return NULL;
+}
+
 void * rpmtsNotify(rpmts ts, rpmte te,
 		rpmCallbackType what, rpm_loff_t amount, rpm_loff_t total)
 {
     void * ptr = NULL;
+    if (ts && ts->evring)
+	evRingEmit(ts, te, what, amount, total);
     if (ts && ts->notify) {
 	void *arg = NULL;
 	Header h = NULL;
@@ -977,6 +1372,33 @@ rpmte rpmtsElement(rpmts ts, int ix)
     return te;
 }
 
+rpmte rpmtsFindElement(rpmts ts, const char *nevra)
+{
+    rpmte te = NULL;
+    tsMembers tsmem = rpmtsMembers(ts);
+
+    if (tsmem != NULL && tsmem->pool != NULL && nevra != NULL) {
+	rpmsid sid = rpmstrPoolId(tsmem->pool, nevra, 0);
+	rpmte *tes = NULL;
+	int ntes = 0;
+
+	if (sid != 0 &&
+	    packageHashGetEntry(tsmem->nevraIndex, sid, &tes, &ntes, NULL)) {
+	    /* Replaced elements leave stale index entries behind, but their
+	     * memory lives on in the arena, zeroed: a live element still
+	     * carries its id. On duplicates (e.g. a reinstall pairing an
+	     * install with an erasure), the element added first wins. */
+	    for (int i = 0; i < ntes; i++) {
+		if (rpmteNEVRAId(tes[i]) == sid) {
+		    te = tes[i];
+		    break;
+		}
+	    }
+	}
+    }
+    return te;
+}
+
 rpmprobFilterFlags rpmtsFilterFlags(rpmts ts)
 {
     return (ts != NULL ? ts->ignoreSet : 0);
@@ -1100,6 +1522,19 @@ rpmstrPool rpmtsPool(rpmts ts)
     return tspool;
 }
 
+rpmstrPool rpmtsDirCache(rpmts ts)
+{
+    if (ts->dirCache == NULL)
+	ts->dirCache = rpmstrPoolCreate();
+    return ts->dirCache;
+}
+
+void rpmtsDirCacheEmpty(rpmts ts)
+{
+    if (ts != NULL)
+	ts->dirCache = rpmstrPoolFree(ts->dirCache);
+}
+
 static int vfylevel_init(void)
 {
     int vfylevel = -1;
@@ -1172,6 +1607,7 @@ rpmts rpmtsCreate(void)
     tsmem->addedPackages = NULL;
     tsmem->removedPackages = packageHashCreate(128, uintId, uintCmp, NULL, NULL);
     tsmem->installedPackages = packageHashCreate(128, uintId, uintCmp, NULL, NULL);
+    tsmem->nevraIndex = packageHashCreate(128, uintId, uintCmp, NULL, NULL);
     tsmem->orderAlloced = 0;
     tsmem->orderCount = 0;
     tsmem->order = NULL;
@@ -1189,6 +1625,7 @@ rpmts rpmtsCreate(void)
     ts->trigs2run = rpmtriggersCreate(10);
 
     ts->min_writes = (rpmExpandNumeric("%{?_minimize_writes}") > 0);
+    ts->delta_install = (rpmExpandNumeric("%{?_delta_install}") > 0);
 
     return rpmtsLink(ts);
 }
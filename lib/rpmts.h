@@ -37,7 +37,10 @@ enum rpmtransFlags_e {
     RPMTRANS_FLAG_NOPLUGINS	= (1 <<  7),	/*!< from --noplugins */
     RPMTRANS_FLAG_NOCONTEXTS	= (1 <<  8),	/*!< from --nocontexts */
     RPMTRANS_FLAG_NOCAPS	= (1 <<  9),	/*!< from --nocaps */
-    /* bits 10-15 unused */
+    RPMTRANS_FLAG_PARALLELPAYLOAD = (1 << 10),	/*!< from --parallelpayload */
+    RPMTRANS_FLAG_JSONSTATS	= (1 << 11),	/*!< from --jsonstats */
+    RPMTRANS_FLAG_SYSCALLSTATS	= (1 << 12),	/*!< from --syscallstats */
+    /* bits 13-15 unused */
     RPMTRANS_FLAG_NOTRIGGERPREIN= (1 << 16),	/*!< from --notriggerprein */
     RPMTRANS_FLAG_NOPRE		= (1 << 17),	/*!< from --nopre */
     RPMTRANS_FLAG_NOPOST	= (1 << 18),	/*!< from --nopost */
@@ -170,7 +173,13 @@ typedef	enum rpmtsOpX_e {
     RPMTS_OP_DBPUT		= 15,
     RPMTS_OP_DBDEL		= 16,
     RPMTS_OP_VERIFY		= 17,
-    RPMTS_OP_MAX		= 18
+    RPMTS_OP_FSOPEN		= 18,
+    RPMTS_OP_FSWRITE		= 19,
+    RPMTS_OP_FSSYNC		= 20,
+    RPMTS_OP_FSRENAME		= 21,
+    RPMTS_OP_FSLINK		= 22,
+    RPMTS_OP_FSTHROTTLE		= 23,
+    RPMTS_OP_MAX		= 24
 } rpmtsOpX;
 
 enum rpmtxnFlags_e {
@@ -338,6 +347,17 @@ rpmRC rpmtsImportHeader(rpmtxn txn, Header h, rpmFlags flags);
  */
 rpmRC rpmtsImportPubkey(rpmts ts, const unsigned char * pkt, size_t pktlen);
 
+/** \ingroup rpmts
+ * Import a batch of parsed public keys in a single transaction.
+ * The keyring is loaded and the database updated just once for the
+ * whole batch, parse the keys up front (see rpmPubkeyNew()).
+ * @param ts            transaction set
+ * @param keys          parsed pubkeys (NULL entries count as failures)
+ * @param nkeys         number of keys
+ * @return              RPMRC_OK if all keys imported, RPMRC_FAIL otherwise
+ */
+rpmRC rpmtsImportPubkeys(rpmts ts, rpmPubkey * keys, int nkeys);
+
 /** \ingroup rpmts
  * Retrieve handle for keyring used for this transaction set
  * @param ts            transaction set
@@ -522,6 +542,17 @@ int rpmtsNElements(rpmts ts);
  */
 rpmte rpmtsElement(rpmts ts, int ix);
 
+/** \ingroup rpmts
+ * Look up a transaction set element by its NEVRA string.
+ * Constant time regardless of transaction size. If several elements
+ * carry the same NEVRA (e.g. a reinstall pairing an install with an
+ * erasure), the element added first is returned.
+ * @param ts		transaction set
+ * @param nevra		package NEVRA string
+ * @return		transaction element (or NULL)
+ */
+rpmte rpmtsFindElement(rpmts ts, const char *nevra);
+
 /** \ingroup rpmts
  * Get problem ignore bit mask, i.e. bits to filter encountered problems.
  * @param ts		transaction set
@@ -614,6 +645,67 @@ int rpmtsSetNotifyCallback(rpmts ts,
  */
 int rpmtsSetNotifyStyle(rpmts ts, int style);
 
+/** \ingroup rpmts
+ * Transaction event stream record (see rpmtsSetEventRing()).
+ */
+struct rpmtsEvent_s {
+    uint32_t elem;	/*!< element order index, RPMTS_EVENT_NOELEM if none */
+    uint32_t event;	/*!< RPMCALLBACK_* type of the event */
+    uint64_t amount;	/*!< amount as passed to the notify callback */
+    uint64_t total;	/*!< total as passed to the notify callback */
+    uint64_t time_us;	/*!< CLOCK_MONOTONIC timestamp (microseconds) */
+};
+
+#define RPMTS_EVENT_NOELEM	0xffffffffU
+
+typedef struct rpmtsEventRing_s * rpmtsEventRing;
+
+/** \ingroup rpmts
+ * Mirror transaction progress into a shared-memory event ring.
+ * Every notification that would go to the notify callback is also
+ * appended to a ring of fixed-size binary records in a POSIX shared
+ * memory segment, where consumers in other processes can poll and
+ * batch-read it without per-event IPC (see rpmtsEventRingOpen()).
+ * The regular callback path is unaffected. The producer never blocks:
+ * a consumer that falls more than the ring size behind loses the
+ * oldest events.
+ * @param ts		transaction set
+ * @param name		shm segment name (as for shm_open(3)),
+ *			NULL disables the stream
+ * @param nrecords	ring capacity in records, rounded up to a power
+ *			of two (0 uses a built-in default)
+ * @return		0 on success
+ */
+int rpmtsSetEventRing(rpmts ts, const char *name, unsigned int nrecords);
+
+/** \ingroup rpmts
+ * Attach to a transaction event ring as a consumer.
+ * @param name		shm segment name the producer was given
+ * @return		event ring handle, NULL on error
+ */
+rpmtsEventRing rpmtsEventRingOpen(const char *name);
+
+/** \ingroup rpmts
+ * Batch-read new events from a transaction event ring.
+ * Never blocks and performs no syscalls, returns whatever has been
+ * published since the previous read.
+ * @param ring		event ring handle
+ * @param evs		array to read events into
+ * @param nevs		capacity of evs
+ * @param[out] lost	number of events overwritten before they could
+ *			be read (or NULL)
+ * @return		number of events read, -1 on invalid arguments
+ */
+int rpmtsEventRingRead(rpmtsEventRing ring, struct rpmtsEvent_s *evs,
+		       int nevs, uint64_t *lost);
+
+/** \ingroup rpmts
+ * Detach from a transaction event ring.
+ * @param ring		event ring handle
+ * @return		NULL always
+ */
+rpmtsEventRing rpmtsEventRingFree(rpmtsEventRing ring);
+
 /** \ingroup rpmts
  * Get transaction notify callback style.
  *
@@ -13,11 +13,15 @@
 
 typedef struct diskspaceInfo_s * rpmDiskSpaceInfo;
 
+typedef struct tsArenaChunk_s * tsArenaChunk;
+
 /* Transaction set elements information */
 typedef struct tsMembers_s {
     rpmstrPool pool;		/*!< Global string pool */
+    tsArenaChunk arena;		/*!< Element allocation arena */
     packageHash removedPackages;	/*!< Set of packages being removed. */
     packageHash installedPackages;	/*!< Set of installed packages */
+    packageHash nevraIndex;	/*!< Element lookup by interned NEVRA id */
     rpmal addedPackages;	/*!< Set of packages being installed. */
 
     rpmds rpmlib;		/*!< rpmlib() dependency set. */
@@ -55,6 +59,8 @@ struct rpmts_s {
     rpmtsChangeFunction change;	/*!< Change callback function. */
     void *changeData;		/*!< Change callback private data. */
 
+    struct tsEvRing_s *evring;	/*!< Shared-memory event stream (or NULL) */
+
     rpmprobFilterFlags ignoreSet;
 				/*!< Bits to filter current problems. */
 
@@ -89,8 +95,14 @@ struct rpmts_s {
     int nrefs;			/*!< Reference count. */
 
     rpmtriggers trigs2run;   /*!< Transaction file triggers */
+    rpmtrigCache fileTrigCache;	/*!< Cached file trigger index */
+    rpmtrigCache transFileTrigCache; /*!< Cached transaction file trigger index */
+    int trigCacheLoaded;	/*!< Persisted trigger table load attempted */
 
     int min_writes;             /*!< macro minimize_writes used */
+    int delta_install;          /*!< macro delta_install used */
+
+    rpmstrPool dirCache;	/*!< Directories validated by fsm */
 };
 
 #ifdef __cplusplus
@@ -108,6 +120,50 @@ rpmstrPool rpmtsPool(rpmts ts);
 RPM_GNUC_INTERNAL
 tsMembers rpmtsMembers(rpmts ts);
 
+/** \ingroup rpmts
+ * Bump-allocate (zeroed) memory from the per-transaction arena.
+ * Arena memory has no individual free, it is released wholesale
+ * when the transaction is emptied.
+ * @param ts		transaction set
+ * @param size		number of bytes to allocate
+ * @return		pointer to allocated memory
+ */
+RPM_GNUC_INTERNAL
+void * rpmtsArenaAlloc(rpmts ts, size_t size);
+
+RPM_GNUC_INTERNAL
+char * rpmtsArenaStrdup(rpmts ts, const char *s);
+
+/** \ingroup rpmts
+ * Print a machine-readable (JSON) operation and per-element timing
+ * report for the transaction to stderr (from RPMTRANS_FLAG_JSONSTATS).
+ * @param ts		transaction set
+ */
+RPM_GNUC_INTERNAL
+void rpmtsPrintStatsJson(rpmts ts);
+
+/** \ingroup rpmts
+ * Return the cache of directories known to exist on disk during this
+ * transaction, creating it if needed. Must be emptied whenever
+ * directories are removed mid-transaction.
+ * @param ts		transaction set
+ * @return		directory cache (weak ref)
+ */
+RPM_GNUC_INTERNAL
+rpmstrPool rpmtsDirCache(rpmts ts);
+
+RPM_GNUC_INTERNAL
+void rpmtsDirCacheEmpty(rpmts ts);
+
+/** \ingroup rpmts
+ * Is a device known (from the disk space info) to be rotational media?
+ * @param ts		transaction set
+ * @param dev		device number
+ * @return		1 for rotational, 0 for non-rotational or unknown
+ */
+RPM_GNUC_INTERNAL
+int rpmtsDSIDevRotational(rpmts ts, dev_t dev);
+
 /* Return rpmdb iterator with removals optionally pruned out */
 RPM_GNUC_INTERNAL
 rpmdbMatchIterator rpmtsPrunedIterator(rpmts ts, rpmDbiTagVal tag,
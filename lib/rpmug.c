@@ -1,193 +1,280 @@
 #include "system.h"
 
 #include <pthread.h>
+#include <stdio.h>
 #include <pwd.h>
 #include <grp.h>
-#include <netdb.h>
 #include <rpm/rpmlog.h>
 #include <rpm/rpmstring.h>
 
 #include "lib/misc.h"
 #include "lib/rpmug.h"
+#include "lib/rpmchroot.h"
 #include "debug.h"
 
-/* 
- * These really ought to use hash tables. I just made the
- * guess that most files would be owned by root or the same person/group
- * who owned the last file. Those two values are cached, everything else
- * is looked up via getpw() and getgr() functions.  If this performs
- * too poorly I'll have to implement it properly :-(
+/*
+ * User/group caches primed from /etc/passwd and /etc/group the first
+ * time a lookup is made (inside the chroot, as that is where lookups
+ * happen during installation) and dropped at the end of the
+ * transaction. Results are cached negatively too, so no repeated
+ * lookup of any kind lands on the fsm hot path. Inside a chroot the
+ * files are authoritative, matching traditional behavior; outside,
+ * names the files don't know are resolved through NSS (sssd, LDAP and
+ * friends) at most once each before being cached.
  */
 
+#undef HASHTYPE
+#undef HTKEYTYPE
+#undef HTDATATYPE
+#define HASHTYPE nameIdHash
+#define HTKEYTYPE const char *
+#define HTDATATYPE long
+#include "lib/rpmhash.H"
+#include "lib/rpmohash.C"
+#undef HASHTYPE
+#undef HTKEYTYPE
+#undef HTDATATYPE
+
+#define HASHTYPE idNameHash
+#define HTKEYTYPE unsigned int
+#define HTDATATYPE const char *
+#include "lib/rpmhash.H"
+#include "lib/rpmohash.C"
+#undef HASHTYPE
+#undef HTKEYTYPE
+#undef HTDATATYPE
+
+/* Protects the caches, file verification worker threads come through
+ * here concurrently. */
+static pthread_mutex_t ugLock = PTHREAD_MUTEX_INITIALIZER;
+
+static struct ugCache_s {
+    nameIdHash uname;		/* user name -> uid, -1 for unknown */
+    idNameHash uid;		/* uid -> user name */
+    nameIdHash gname;		/* group name -> gid, -1 for unknown */
+    idNameHash gid;		/* gid -> group name */
+    int primed;
+} ugCache;
+
+static unsigned int ugIdHash(unsigned int id)
+{
+    return id;
+}
+
+static int ugIdCmp(unsigned int a, unsigned int b)
+{
+    return a != b;
+}
+
+/*
+ * Parse a passwd/group format file: colon separated fields with the
+ * name first and the numeric id third. First entry for a given name
+ * or id wins, matching traditional files-backed lookup behavior.
+ */
+static void ugLoadFile(const char *path, nameIdHash byName, idNameHash byId)
+{
+    FILE *fp = fopen(path, "r");
+    char *line = NULL;
+    size_t llen = 0;
+
+    if (fp == NULL)
+	return;
+
+    while (getline(&line, &llen, fp) >= 0) {
+	char *name = line;
+	char *end = NULL;
+	char *p = strchr(line, ':');
+	long id;
+
+	if (p == NULL)
+	    continue;
+	*p++ = '\0';
+	if ((p = strchr(p, ':')) == NULL)
+	    continue;
+	p++;
+	id = strtol(p, &end, 10);
+	if (end == p || *end != ':' || id < 0)
+	    continue;
+
+	if (!nameIdHashHasEntry(byName, name))
+	    nameIdHashAddEntry(byName, xstrdup(name), id);
+	if (!idNameHashHasEntry(byId, (unsigned int)id))
+	    idNameHashAddEntry(byId, (unsigned int)id, xstrdup(name));
+    }
+    free(line);
+    fclose(fp);
+}
+
+static void ugPrime(void)
+{
+    if (ugCache.primed)
+	return;
+
+    ugCache.uname = nameIdHashCreate(64, rstrhash, strcmp,
+				     (nameIdHashFreeKey)rfree, NULL);
+    ugCache.uid = idNameHashCreate(64, ugIdHash, ugIdCmp, NULL,
+				   (idNameHashFreeData)rfree);
+    ugCache.gname = nameIdHashCreate(64, rstrhash, strcmp,
+				     (nameIdHashFreeKey)rfree, NULL);
+    ugCache.gid = idNameHashCreate(64, ugIdHash, ugIdCmp, NULL,
+				   (idNameHashFreeData)rfree);
+
+    ugLoadFile("/etc/passwd", ugCache.uname, ugCache.uid);
+    ugLoadFile("/etc/group", ugCache.gname, ugCache.gid);
+    ugCache.primed = 1;
+}
+
+static long ugNssUid(const char *name)
+{
+    struct passwd *pwent = getpwnam(name);
+    return (pwent != NULL) ? pwent->pw_uid : -1;
+}
+
+static long ugNssGid(const char *name)
+{
+    struct group *grent = getgrnam(name);
+    return (grent != NULL) ? grent->gr_gid : -1;
+}
+
+static int ugName2Id(nameIdHash cache, const char *name, unsigned int *id,
+		     long (*nssResolve)(const char *name))
+{
+    long *ids;
+    int rc = 0;
+
+    if (nameIdHashGetEntry(cache, name, &ids, NULL, NULL)) {
+	if (ids[0] >= 0)
+	    *id = ids[0];
+	else
+	    rc = -1;
+    } else {
+	/* Outside a chroot NSS may know names the files don't */
+	long nssId = rpmChrootDone() ? -1 : nssResolve(name);
+	/* Cache misses too, unknown names repeat just as much */
+	nameIdHashAddEntry(cache, xstrdup(name), nssId);
+	if (nssId >= 0)
+	    *id = nssId;
+	else
+	    rc = -1;
+    }
+    return rc;
+}
+
 int rpmugUid(const char * thisUname, uid_t * uid)
 {
-    static char * lastUname = NULL;
-    static size_t lastUnameLen = 0;
-    static size_t lastUnameAlloced;
-    static uid_t lastUid;
-    struct passwd * pwent;
-    size_t thisUnameLen;
-
-    if (!thisUname) {
-	lastUnameLen = 0;
+    unsigned int id;
+    int rc;
+
+    if (thisUname == NULL) {
 	return -1;
     } else if (rstreq(thisUname, UID_0_USER)) {
 	*uid = 0;
 	return 0;
     }
 
-    thisUnameLen = strlen(thisUname);
-    if (lastUname == NULL || thisUnameLen != lastUnameLen ||
-	!rstreq(thisUname, lastUname))
-    {
-	if (lastUnameAlloced < thisUnameLen + 1) {
-	    lastUnameAlloced = thisUnameLen + 10;
-	    lastUname = xrealloc(lastUname, lastUnameAlloced);	/* XXX memory leak */
-	}
-	strcpy(lastUname, thisUname);
-
-	pwent = getpwnam(thisUname);
-	if (pwent == NULL) {
-	    /* FIX: shrug */
-	    endpwent();
-	    pwent = getpwnam(thisUname);
-	    if (pwent == NULL) return -1;
-	}
+    pthread_mutex_lock(&ugLock);
+    ugPrime();
+    rc = ugName2Id(ugCache.uname, thisUname, &id, ugNssUid);
+    pthread_mutex_unlock(&ugLock);
 
-	lastUid = pwent->pw_uid;
-    }
-
-    *uid = lastUid;
-
-    return 0;
+    if (rc == 0)
+	*uid = id;
+    return rc;
 }
 
 int rpmugGid(const char * thisGname, gid_t * gid)
 {
-    static char * lastGname = NULL;
-    static size_t lastGnameLen = 0;
-    static size_t lastGnameAlloced;
-    static gid_t lastGid;
-    size_t thisGnameLen;
-    struct group * grent;
+    unsigned int id;
+    int rc;
 
     if (thisGname == NULL) {
-	lastGnameLen = 0;
 	return -1;
     } else if (rstreq(thisGname, GID_0_GROUP)) {
 	*gid = 0;
 	return 0;
     }
 
-    thisGnameLen = strlen(thisGname);
-    if (lastGname == NULL || thisGnameLen != lastGnameLen ||
-	!rstreq(thisGname, lastGname))
-    {
-	if (lastGnameAlloced < thisGnameLen + 1) {
-	    lastGnameAlloced = thisGnameLen + 10;
-	    lastGname = xrealloc(lastGname, lastGnameAlloced);	/* XXX memory leak */
-	}
-	strcpy(lastGname, thisGname);
-
-	grent = getgrnam(thisGname);
-	if (grent == NULL) {
-	    /* FIX: shrug */
-	    endgrent();
-	    grent = getgrnam(thisGname);
-	    if (grent == NULL) {
-		return -1;
-	    }
-	}
-	lastGid = grent->gr_gid;
-    }
-
-    *gid = lastGid;
+    pthread_mutex_lock(&ugLock);
+    ugPrime();
+    rc = ugName2Id(ugCache.gname, thisGname, &id, ugNssGid);
+    pthread_mutex_unlock(&ugLock);
 
-    return 0;
+    if (rc == 0)
+	*gid = id;
+    return rc;
 }
 
 const char * rpmugUname(uid_t uid)
 {
-    static uid_t lastUid = (uid_t) -1;
-    static char * lastUname = NULL;
-    static size_t lastUnameLen = 0;
+    const char *uname = NULL;
+    const char **names;
 
-    if (uid == (uid_t) -1) {
-	lastUid = (uid_t) -1;
+    if (uid == (uid_t) -1)
 	return NULL;
-    } else if (uid == (uid_t) 0) {
+    if (uid == (uid_t) 0)
 	return UID_0_USER;
-    } else if (uid == lastUid) {
-	return lastUname;
-    } else {
-	struct passwd * pwent = getpwuid(uid);
-	size_t len;
-
-	if (pwent == NULL) return NULL;
 
-	lastUid = uid;
-	len = strlen(pwent->pw_name);
-	if (lastUnameLen < len + 1) {
-	    lastUnameLen = len + 20;
-	    lastUname = xrealloc(lastUname, lastUnameLen);
+    pthread_mutex_lock(&ugLock);
+    ugPrime();
+    if (idNameHashGetEntry(ugCache.uid, uid, &names, NULL, NULL)) {
+	uname = names[0];
+    } else {
+	if (!rpmChrootDone()) {
+	    struct passwd *pwent = getpwuid(uid);
+	    if (pwent != NULL)
+		uname = xstrdup(pwent->pw_name);
 	}
-	strcpy(lastUname, pwent->pw_name);
-
-	return lastUname;
+	/* Cache NSS misses as NULL entries */
+	idNameHashAddEntry(ugCache.uid, uid, uname);
     }
+    pthread_mutex_unlock(&ugLock);
+
+    return uname;
 }
 
 const char * rpmugGname(gid_t gid)
 {
-    static gid_t lastGid = (gid_t) -1;
-    static char * lastGname = NULL;
-    static size_t lastGnameLen = 0;
+    const char *gname = NULL;
+    const char **names;
 
-    if (gid == (gid_t) -1) {
-	lastGid = (gid_t) -1;
+    if (gid == (gid_t) -1)
 	return NULL;
-    } else if (gid == (gid_t) 0) {
+    if (gid == (gid_t) 0)
 	return GID_0_GROUP;
-    } else if (gid == lastGid) {
-	return lastGname;
-    } else {
-	struct group * grent = getgrgid(gid);
-	size_t len;
 
-	if (grent == NULL) return NULL;
-
-	lastGid = gid;
-	len = strlen(grent->gr_name);
-	if (lastGnameLen < len + 1) {
-	    lastGnameLen = len + 20;
-	    lastGname = xrealloc(lastGname, lastGnameLen);
+    pthread_mutex_lock(&ugLock);
+    ugPrime();
+    if (idNameHashGetEntry(ugCache.gid, gid, &names, NULL, NULL)) {
+	gname = names[0];
+    } else {
+	if (!rpmChrootDone()) {
+	    struct group *grent = getgrgid(gid);
+	    if (grent != NULL)
+		gname = xstrdup(grent->gr_name);
 	}
-	strcpy(lastGname, grent->gr_name);
-
-	return lastGname;
+	/* Cache NSS misses as NULL entries */
+	idNameHashAddEntry(ugCache.gid, gid, gname);
     }
-}
+    pthread_mutex_unlock(&ugLock);
 
-static void loadLibs(void)
-{
-    (void) getpwnam(UID_0_USER);
-    endpwent();
-    (void) getgrnam(GID_0_GROUP);
-    endgrent();
+    return gname;
 }
 
 int rpmugInit(void)
 {
-    static pthread_once_t libsLoaded = PTHREAD_ONCE_INIT;
-
-    pthread_once(&libsLoaded, loadLibs);
+    /* Nothing to preload, NSS is only consulted outside a chroot */
     return 0;
 }
 
 void rpmugFree(void)
 {
-    rpmugUid(NULL, NULL);
-    rpmugGid(NULL, NULL);
-    rpmugUname(-1);
-    rpmugGname(-1);
+    pthread_mutex_lock(&ugLock);
+    if (ugCache.primed) {
+	ugCache.uname = nameIdHashFree(ugCache.uname);
+	ugCache.uid = idNameHashFree(ugCache.uid);
+	ugCache.gname = nameIdHashFree(ugCache.gname);
+	ugCache.gid = idNameHashFree(ugCache.gid);
+	ugCache.primed = 0;
+    }
+    pthread_mutex_unlock(&ugLock);
 }
@@ -17,6 +17,7 @@ struct rpmvs_s {
     rpmDigestBundle bundle;
     rpmKeyring keyring;
     int vfylevel;
+    int minimal;	/*!< nothing in the signature header to look at */
 };
 
 struct vfytag_s {
@@ -306,13 +307,23 @@ static void rpmvsAppend(struct rpmvs_s *sis, hdrblob blob,
 	return;
 
     const char *o = (blob->il > blob->ril) ? _("header") : _("package");
+
+    /* Disabled items get a placeholder entry without even retrieving
+     * the tag data, never mind parsing signatures out of it. */
+    if (rpmsinfoDisabled(&vi->vi, sis->vsflags)) {
+	rpmvsReserve(sis, 1);
+	rpmsinfoInit(vi, ti, NULL, o, &sis->sigs[sis->nsigs]);
+	sis->nsigs++;
+	return;
+    }
+
     struct rpmtd_s td;
     rpmRC rc = hdrblobGet(blob, vi->tag, &td);
     int nitems = (rc == RPMRC_OK) ? rpmtdCount(&td) : 1;
 
     rpmvsReserve(sis, nitems);
 
-    if (!rpmsinfoDisabled(&vi->vi, sis->vsflags) && rc == RPMRC_OK) {
+    if (rc == RPMRC_OK) {
 	while (rpmtdNext(&td) >= 0) {
 	    rpmsinfoInit(vi, ti, &td, o, &sis->sigs[sis->nsigs]);
 	    sis->nsigs++;
@@ -334,12 +345,31 @@ void rpmvsAppendTag(struct rpmvs_s *vs, hdrblob blob, rpmTagVal tag)
     }
 }
 
+/*
+ * Is this a minimal verification, ie nothing in the signature header is
+ * either checked or required?  Any remaining items (payload digest) come
+ * from the main header, so the signature items need not be constructed
+ * at all.  Enabled-but-not-required items still rule this out: their
+ * results are reported even when nothing mandates them.
+ */
+static int rpmvsIsMinimal(int vfylevel, rpmVSFlags vsflags)
+{
+    if (vfylevel & (RPMSIG_DIGEST_TYPE|RPMSIG_SIGNATURE_TYPE))
+	return 0;
+    for (const struct vfyinfo_s *si = &rpmvfyitems[0]; si->tag; si++) {
+	if (si->sigh && !rpmsinfoDisabled(&si->vi, vsflags))
+	    return 0;
+    }
+    return 1;
+}
+
 struct rpmvs_s *rpmvsCreate(int vfylevel, rpmVSFlags vsflags, rpmKeyring keyring)
 {
     struct rpmvs_s *sis = xcalloc(1, sizeof(*sis));
     sis->vsflags = vsflags;
     sis->keyring = rpmKeyringLink(keyring);
     sis->vfylevel = vfylevel;
+    sis->minimal = rpmvsIsMinimal(vfylevel, vsflags);
 
     return sis;
 }
@@ -354,11 +384,15 @@ void rpmvsInit(struct rpmvs_s *vs, hdrblob blob, rpmDigestBundle bundle)
     const struct vfyinfo_s *si = &rpmvfyitems[0];
     const struct vfytag_s *ti = &rpmvfytags[0];
 
-    for (; si->tag && ti->tag; si++, ti++) {
-	/* Ignore non-signature tags initially */
-	if (!si->sigh)
-	    continue;
-	rpmvsAppend(vs, blob, si, ti);
+    /* Minimal verification is served by the main header alone (payload
+     * digest), don't walk the signature header at all. */
+    if (!vs->minimal) {
+	for (; si->tag && ti->tag; si++, ti++) {
+	    /* Ignore non-signature tags initially */
+	    if (!si->sigh)
+		continue;
+	    rpmvsAppend(vs, blob, si, ti);
+	}
     }
     vs->bundle = bundle;
 }
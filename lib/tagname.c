@@ -28,8 +28,25 @@ struct headerTagTableEntry_s {
 #define TABLESIZE (sizeof(rpmTagTable) / sizeof(rpmTagTable[0]) - 1)
 static const int rpmTagTableSize = TABLESIZE;
 
+/* Must stay comfortably larger than TABLESIZE for open addressing */
+#define TAGHASH_SIZE 2048
+
 static headerTagTableEntry tagsByName[TABLESIZE]; /*!< tags sorted by name. */
 static headerTagTableEntry tagsByValue[TABLESIZE]; /*!< tags sorted by value. */
+static uint16_t tagsByHash[TAGHASH_SIZE]; /*!< tag table index + 1, by name hash. */
+
+/**
+ * Case-folding name hash, tag name lookup is case-insensitive.
+ * @param s		tag name
+ * @return		hash value
+ */
+static unsigned int tagHash(const char *s)
+{
+    unsigned int hash = 0;
+    for (; *s != '\0'; s++)
+	hash = hash * 33 + rtolower(*s);
+    return hash;
+}
 
 /**
  * Compare tag table entries by name.
@@ -67,8 +84,14 @@ static pthread_once_t tagsLoaded = PTHREAD_ONCE_INIT;
 static void loadTags(void)
 {
     for (int i = 0; i < rpmTagTableSize; i++) {
+	unsigned int slot = tagHash(rpmTagTable[i].shortname) % TAGHASH_SIZE;
+
 	tagsByValue[i] = &rpmTagTable[i];
 	tagsByName[i] = &rpmTagTable[i];
+
+	while (tagsByHash[slot] != 0)
+	    slot = (slot + 1) % TAGHASH_SIZE;
+	tagsByHash[slot] = i + 1;
     }
 
     qsort(tagsByValue, rpmTagTableSize, sizeof(*tagsByValue), tagCmpValue);
@@ -104,25 +127,14 @@ static headerTagTableEntry entryByTag(rpmTagVal tag)
 
 static headerTagTableEntry entryByName(const char *tag)
 {
-    headerTagTableEntry entry = NULL;
-    int i, comparison;
-    int l = 0;
-    int u = rpmTagTableSize;
+    unsigned int slot = tagHash(tag) % TAGHASH_SIZE;
 
-    while (l < u) {
-	i = (l + u) / 2;
-	comparison = rstrcasecmp(tag, tagsByName[i]->shortname);
-
-	if (comparison < 0) {
-	    u = i;
-	} else if (comparison > 0) {
-	    l = i + 1;
-	} else {
-	    entry = tagsByName[i];
-	    break;
-	}
+    for (; tagsByHash[slot] != 0; slot = (slot + 1) % TAGHASH_SIZE) {
+	headerTagTableEntry entry = &rpmTagTable[tagsByHash[slot] - 1];
+	if (rstrcasecmp(tag, entry->shortname) == 0)
+	    return entry;
     }
-    return entry;
+    return NULL;
 }
 
 const char * rpmTagGetName(rpmTagVal tag)
@@ -9,6 +9,7 @@
 #include <errno.h>
 #include <sys/statvfs.h>
 #include <fcntl.h>
+#include <pthread.h>
 
 /* duplicated from cpio.c */
 #if MAJOR_IN_MKDEV
@@ -33,6 +34,7 @@
 #include "lib/misc.h"
 #include "lib/rpmchroot.h"
 #include "lib/rpmlock.h"
+#include "lib/rpmug.h"
 #include "lib/rpmds_internal.h"
 #include "lib/rpmfi_internal.h"	/* only internal apis */
 #include "lib/rpmte_internal.h"	/* only internal apis */
@@ -223,6 +225,21 @@ static int rpmtsGetDSIRotational(rpmts ts)
     return rc;
 }
 
+int rpmtsDSIDevRotational(rpmts ts, dev_t dev)
+{
+    rpmDiskSpaceInfo dsi = ts->dsi;
+
+    while (dsi && dsi->bsize && dsi->dev != dev)
+	dsi++;
+    if (dsi && dsi->bsize) {
+	if (dsi->rotational < 0)
+	    dsi->rotational = getRotational(dsi->mntPoint, dsi->dev);
+	return dsi->rotational;
+    }
+    /* Unknown device, don't throttle what we know nothing about */
+    return 0;
+}
+
 static void rpmtsUpdateDSI(const rpmts ts, dev_t dev, const char *dirName,
 		rpm_loff_t fileSize, rpm_loff_t prevSize, rpm_loff_t fixupSize,
 		rpmFileAction action)
@@ -503,16 +520,28 @@ static void handleInstInstalledFile(const rpmts ts, rpmte p, rpmfiles fi, int fx
     rpmfilesSetFReplacedSize(fi, fx, otherFileSize + 1);
 
     /* Just touch already existing files if minimize_writes is enabled */
-    if (ts->min_writes) {
+    if (ts->min_writes || ts->delta_install) {
 	if ((!isCfgFile) && (rpmfsGetAction(fs, fx) == FA_UNKNOWN)) {
 	    /* XXX fsm can't handle FA_TOUCH of hardlinked files */
 	    int nolinks = (nlink == 1 && rpmfilesFNlink(fi, fx) == 1);
-	    if (nolinks && rpmfileContentsEqual(otherFi, ofx, fi, fx))
-	       rpmfsSetAction(fs, fx, FA_TOUCH);
+	    /*
+	     * delta_install only compares the digests recorded in the
+	     * old and new header, min_writes re-reads the disk contents.
+	     */
+	    if (nolinks) {
+		int equal = ts->delta_install ?
+			rpmfileRecordedContentsEqual(otherFi, ofx, fi, fx) :
+			rpmfileContentsEqual(otherFi, ofx, fi, fx);
+		if (equal)
+		    rpmfsSetAction(fs, fx, FA_TOUCH);
+	    }
 	}
     }
 }
 
+/* Serializes ts->dsi updates when scanning elements in parallel */
+static pthread_mutex_t dsi_lock = PTHREAD_MUTEX_INITIALIZER;
+
 /**
  * Update disk space needs on each partition for this package's files.
  */
@@ -539,8 +568,14 @@ static void handleOverlappedFiles(rpmts ts, fingerPrintCache fpc, rpmte p, rpmfi
 	int nlink;
 	const int *links;
 
-	if (XFA_SKIPPING(rpmfsGetAction(fs, i)))
-	    continue;
+	/* Jump over runs of skipped files in one step */
+	{
+	    unsigned int skiprun = rpmfsSkippedRun(fs, i);
+	    if (skiprun > 0) {
+		i += skiprun - 1;
+		continue;
+	    }
+	}
 
 	FFlags = rpmfilesFFlags(fi, i);
 
@@ -716,11 +751,169 @@ assert(otherFi != NULL);
 	    fixupSize = fixupSize ? 1 : 0;
 	}
 	/* Update disk space info for a file. */
+	pthread_mutex_lock(&dsi_lock);
 	rpmtsUpdateDSI(ts, fpEntryDev(fpc, fiFps), fpEntryDir(fpc, fiFps),
 		       fileSize, rpmfilesFReplacedSize(fi, i),
 		       fixupSize, rpmfsGetAction(fs, i));
+	pthread_mutex_unlock(&dsi_lock);
+
+    }
+}
+
+/*
+ * Parallel variant of the conflict scan. handleOverlappedFiles() reads
+ * and writes the file states of *other* elements it overlaps with, so
+ * elements cannot simply be farmed out one per thread. But all such
+ * cross-element traffic goes through the fingerprint records: elements
+ * that share no fingerprint with each other are completely independent
+ * (save for the dsi accounting, serialized above). We therefore group
+ * the elements into connected components of the "shares a fingerprint"
+ * relation and scan the components concurrently, keeping the elements
+ * inside each component in transaction order.
+ */
+
+struct overlapScan_s {
+    rpmts ts;
+    fingerPrintCache fpc;
+    rpmte *order;		/*!< elements in transaction order */
+    int *elems;			/*!< element indexes grouped by component */
+    int *offs;			/*!< per component start offset, ncomp+1 */
+    int ncomp;
+    int next;			/*!< next component to hand out */
+    pthread_mutex_t lock;
+};
+
+struct overlapUnion_s {
+    rpmte *order;
+    int nelem;
+    int *parent;		/*!< union-find forest over element ixs */
+};
+
+static int overlapFind(int *parent, int x)
+{
+    while (parent[x] != x) {
+	parent[x] = parent[parent[x]];	/* path halving */
+	x = parent[x];
+    }
+    return x;
+}
+
+/* Join the elements recorded under one fingerprint into one component */
+static void overlapUnionFp(struct rpmffi_s *recs, int numRecs, void *userdata)
+{
+    struct overlapUnion_s *u = userdata;
+    int i, j, first = -1;
+
+    if (numRecs < 2)
+	return;
+
+    for (i = 0; i < numRecs; i++) {
+	/* the order array is small enough for a linear lookup per rec */
+	for (j = 0; j < u->nelem; j++) {
+	    if (u->order[j] == recs[i].p)
+		break;
+	}
+	if (j == u->nelem)
+	    continue;
+	if (first < 0)
+	    first = overlapFind(u->parent, j);
+	else
+	    u->parent[overlapFind(u->parent, j)] = first;
+    }
+}
+
+static void * overlapScanThread(void *data)
+{
+    struct overlapScan_s *scan = data;
+
+    for (;;) {
+	int c, i;
+
+	pthread_mutex_lock(&scan->lock);
+	c = scan->next++;
+	pthread_mutex_unlock(&scan->lock);
+	if (c >= scan->ncomp)
+	    break;
+
+	for (i = scan->offs[c]; i < scan->offs[c + 1]; i++) {
+	    rpmte p = scan->order[scan->elems[i]];
+	    rpmfiles files = rpmteFiles(p);
+	    if (files != NULL)
+		handleOverlappedFiles(scan->ts, scan->fpc, p, files);
+	    rpmfilesFree(files);
+	}
+    }
+    return NULL;
+}
+
+static void runOverlapScan(rpmts ts, fingerPrintCache fpc, int nthreads)
+{
+    tsMembers tsmem = rpmtsMembers(ts);
+    int nelem = tsmem->orderCount;
+    struct overlapScan_s scan;
+    struct overlapUnion_s u;
+    int *compid, *fill;
+    int i, ncomp = 0, started = 0;
+    pthread_t *threads;
+
+    if (nelem <= 0)
+	return;
 
+    /* Partition the elements by shared fingerprints */
+    u.order = tsmem->order;
+    u.nelem = nelem;
+    u.parent = xmalloc(nelem * sizeof(*u.parent));
+    for (i = 0; i < nelem; i++)
+	u.parent[i] = i;
+    fpCacheForEachFp(fpc, overlapUnionFp, &u);
+
+    /* Number the components and group the elements, preserving order */
+    compid = xmalloc(nelem * sizeof(*compid));
+    for (i = 0; i < nelem; i++) {
+	if (overlapFind(u.parent, i) == i)
+	    compid[i] = ncomp++;
     }
+    for (i = 0; i < nelem; i++)
+	compid[i] = compid[overlapFind(u.parent, i)];
+
+    scan.ts = ts;
+    scan.fpc = fpc;
+    scan.order = tsmem->order;
+    scan.elems = xmalloc(nelem * sizeof(*scan.elems));
+    scan.offs = xcalloc(ncomp + 1, sizeof(*scan.offs));
+    scan.ncomp = ncomp;
+    scan.next = 0;
+    pthread_mutex_init(&scan.lock, NULL);
+
+    for (i = 0; i < nelem; i++)
+	scan.offs[compid[i] + 1]++;
+    for (i = 0; i < ncomp; i++)
+	scan.offs[i + 1] += scan.offs[i];
+    fill = xcalloc(ncomp, sizeof(*fill));
+    for (i = 0; i < nelem; i++)
+	scan.elems[scan.offs[compid[i]] + fill[compid[i]]++] = i;
+    free(fill);
+
+    rpmlog(RPMLOG_DEBUG, "scanning %d overlap components with %d threads\n",
+	   ncomp, nthreads);
+
+    /* This thread works too, failed thread creation only costs speed */
+    threads = xcalloc(nthreads, sizeof(*threads));
+    for (i = 0; i < nthreads - 1; i++) {
+	if (pthread_create(&threads[started], NULL, overlapScanThread, &scan))
+	    break;
+	started++;
+    }
+    overlapScanThread(&scan);
+    for (i = 0; i < started; i++)
+	pthread_join(threads[i], NULL);
+
+    free(threads);
+    pthread_mutex_destroy(&scan.lock);
+    free(scan.offs);
+    free(scan.elems);
+    free(compid);
+    free(u.parent);
 }
 
 /**
@@ -745,14 +938,61 @@ static void ensureOlder(rpmstrPool tspool, const rpmte p, const Header h)
     rpmdsFree(req);
 }
 
+/* Per-directory netshared classification */
+enum {
+    NS_NONE	= 0,	/* no netshared entry touches this directory */
+    NS_ALL	= 1,	/* the directory itself is netshared */
+    NS_CHECK	= 2,	/* an entry may name a file inside this directory */
+};
+
+/**
+ * Classify every directory of a file set against the netshared paths
+ * once, so the per-file work drops to an array lookup (files dwarf both
+ * directories and netshared entries, comparing every file against every
+ * entry was the dominant cost on big packages).
+ * @param ts            transaction set
+ * @param files         file info set
+ * @returns NS_* class per directory index, caller frees
+ */
+static char *netsharedClassify(const rpmts ts, rpmfiles files)
+{
+    int dc = rpmfilesDC(files);
+    char *cls = xcalloc(dc ? dc : 1, sizeof(*cls));
+
+    for (int jx = 0; jx < dc; jx++) {
+	const char *dn = rpmfilesDN(files, jx);
+	size_t dnlen = strlen(dn);
+
+	for (char **nsp = ts->netsharedPaths; nsp && *nsp; nsp++) {
+	    size_t len = strlen(*nsp);
+
+	    if (dnlen >= len) {
+		if (!rstreqn(dn, *nsp, len))
+		    continue;
+		/* Only directories or complete file paths can be net shared */
+		if (!(dn[len] == '/' || dn[len] == '\0'))
+		    continue;
+		cls[jx] = NS_ALL;
+		break;
+	    } else if (rstreqn(dn, *nsp, dnlen)) {
+		/* Entry below this directory: compare basenames per file,
+		 * but keep scanning - a directory entry still wins */
+		cls[jx] = NS_CHECK;
+	    }
+	}
+    }
+    return cls;
+}
+
 /**
- * Check if the curent file in the file iterator is in the
- * netshardpath and though should be excluded.
+ * Check if the current file in the file iterator is named by a
+ * netshared entry. Only called for NS_CHECK directories, the
+ * per-directory cases are handled by the classification.
  * @param ts            transaction set
  * @param fi            file info set
  * @returns 1 if path is net shared path, otherwise 0
  */
-static int matchNetsharedpath(const rpmts ts, rpmfi fi)
+static int matchNetsharedFile(const rpmts ts, rpmfi fi)
 {
     char ** nsp;
     const char * dn, * bn;
@@ -766,33 +1006,33 @@ static int matchNetsharedpath(const rpmts ts, rpmfi fi)
 	size_t len;
 
 	len = strlen(*nsp);
-	if (dnlen >= len) {
-	    if (!rstreqn(dn, *nsp, len))
-		continue;
-	    /* Only directories or complete file paths can be net shared */
-	    if (!(dn[len] == '/' || dn[len] == '\0'))
-		continue;
-	} else {
-	    if (len < (dnlen + bnlen))
-		continue;
-	    if (!rstreqn(dn, *nsp, dnlen))
-		continue;
-	    /* Insure that only the netsharedpath basename is compared. */
-	    if ((s = strchr((*nsp) + dnlen, '/')) != NULL && s[1] != '\0')
-		continue;
-	    if (!rstreqn(bn, (*nsp) + dnlen, bnlen))
-		continue;
-	    len = dnlen + bnlen;
-	    /* Only directories or complete file paths can be net shared */
-	    if (!((*nsp)[len] == '/' || (*nsp)[len] == '\0'))
-		continue;
-	}
+	if (dnlen >= len)
+	    continue;
+	if (len < (dnlen + bnlen))
+	    continue;
+	if (!rstreqn(dn, *nsp, dnlen))
+	    continue;
+	/* Insure that only the netsharedpath basename is compared. */
+	if ((s = strchr((*nsp) + dnlen, '/')) != NULL && s[1] != '\0')
+	    continue;
+	if (!rstreqn(bn, (*nsp) + dnlen, bnlen))
+	    continue;
+	len = dnlen + bnlen;
+	/* Only directories or complete file paths can be net shared */
+	if (!((*nsp)[len] == '/' || (*nsp)[len] == '\0'))
+	    continue;
 
 	break;
     }
     return (nsp != NULL && *nsp != NULL);
 }
 
+static int netsharedMatches(const rpmts ts, const char *cls, rpmfi fi)
+{
+    int c = cls[rpmfiDX(fi)];
+    return (c == NS_ALL || (c == NS_CHECK && matchNetsharedFile(ts, fi)));
+}
+
 static void skipEraseFiles(const rpmts ts, rpmfiles files, rpmfs fs)
 {
     int i;
@@ -802,13 +1042,15 @@ static void skipEraseFiles(const rpmts ts, rpmfiles files, rpmfs fs)
      * they do need to take package relocations into account).
      */
     if (ts->netsharedPaths) {
+	char *nscls = netsharedClassify(ts, files);
 	rpmfi fi = rpmfilesIter(files, RPMFI_ITER_FWD);
 	while ((i = rpmfiNext(fi)) >= 0)
 	{
-	    if (matchNetsharedpath(ts, fi))
+	    if (netsharedMatches(ts, nscls, fi))
 		rpmfsSetAction(fs, i, FA_SKIPNETSHARED);
 	}
 	rpmfiFree(fi);
+	free(nscls);
     }
 }
 
@@ -828,6 +1070,7 @@ static void skipInstallFiles(const rpmts ts, rpmfiles files, rpmfs fs)
     int noArtifacts = (rpmtsFlags(ts) & RPMTRANS_FLAG_NOARTIFACTS);
     int * drc;
     char * dff;
+    char * nscls = NULL;
     int dc;
     int i, j, ix;
     rpmfi fi = rpmfilesIter(files, RPMFI_ITER_FWD);
@@ -835,6 +1078,9 @@ static void skipInstallFiles(const rpmts ts, rpmfiles files, rpmfs fs)
     if (!noDocs)
 	noDocs = rpmExpandNumeric("%{_excludedocs}");
 
+    if (ts->netsharedPaths)
+	nscls = netsharedClassify(ts, files);
+
     /* Compute directory refcount, skip directory if now empty. */
     dc = rpmfiDC(fi);
     drc = xcalloc(dc, sizeof(*drc));
@@ -867,8 +1113,8 @@ static void skipInstallFiles(const rpmts ts, rpmfiles files, rpmfs fs)
 	 * Net shared paths are not relative to the current root (though
 	 * they do need to take package relocations into account).
 	 */
-	if (ts->netsharedPaths) {
-	    if (matchNetsharedpath(ts, fi)) {
+	if (nscls != NULL) {
+	    if (netsharedMatches(ts, nscls, fi)) {
 		drc[ix]--;	dff[ix] = 1;
 		rpmfsSetAction(fs, i, FA_SKIPNETSHARED);
 		continue;
@@ -988,6 +1234,7 @@ static void skipInstallFiles(const rpmts ts, rpmfiles files, rpmfs fs)
 
     free(drc);
     free(dff);
+    free(nscls);
     rpmfiFree(fi);
 }
 
@@ -998,7 +1245,7 @@ static void skipInstallFiles(const rpmts ts, rpmfiles files, rpmfs fs)
 #define HASHTYPE rpmStringSet
 #define HTKEYTYPE rpmsid
 #include "lib/rpmhash.H"
-#include "lib/rpmhash.C"
+#include "lib/rpmohash.C"
 
 static unsigned int sidHash(rpmsid sid)
 {
@@ -1259,6 +1506,135 @@ static int vfyCb(struct rpmsinfo_s *sinfo, void *cbdata)
     return (sinfo->rc == 0);
 }
 
+/*
+ * Persistent package verify cache (optional, see %_vfycache_path):
+ * successful signature/digest verifications are carried from one
+ * transaction to the next in a simple text file under the rpmdb
+ * directory, keyed by package path, size, mtime and header digest.
+ * Entries are only trusted when the configured verify level and flags
+ * match those they were recorded under.
+ */
+static char *vfyCachePath(rpmts ts)
+{
+    char *path = NULL;
+    char *fn = rpmExpand("%{?_vfycache_path}", NULL);
+    if (*fn != '\0')
+	path = rpmGenPath(rpmtsRootDir(ts), fn, NULL);
+    free(fn);
+    return path;
+}
+
+static ARGV_t vfyCacheLoad(const char *path)
+{
+    ARGV_t lines = NULL;
+    char line[BUFSIZ];
+    FILE *fp = fopen(path, "r");
+
+    if (fp == NULL)
+	return NULL;
+    while (fgets(line, sizeof(line), fp) != NULL) {
+	line[strcspn(line, "\n")] = '\0';
+	if (*line != '\0')
+	    argvAdd(&lines, line);
+    }
+    fclose(fp);
+    return lines;
+}
+
+static void vfyCacheSave(const char *path, ARGV_const_t lines)
+{
+    char *tmppath = NULL;
+    FILE *fp = NULL;
+
+    rasprintf(&tmppath, "%s.tmp.%d", path, (int) getpid());
+    if ((fp = fopen(tmppath, "w")) == NULL)
+	goto exit;
+
+    for (ARGV_const_t line = lines; line && *line; line++)
+	fprintf(fp, "%s\n", *line);
+
+    if (fclose(fp) == 0) {
+	if (rename(tmppath, path) != 0)
+	    unlink(tmppath);
+    } else {
+	unlink(tmppath);
+    }
+
+exit:
+    free(tmppath);
+}
+
+static int vfyCacheParse(const char *line, int *vfylevel, unsigned int *vsflags,
+			 int *verified, long long *size, long long *mtime,
+			 char *digest, const char **path)
+{
+    int off = 0;
+    if (sscanf(line, "%d %u %d %lld %lld %128s %n",
+	       vfylevel, vsflags, verified, size, mtime, digest, &off) < 6
+	|| off == 0)
+	return -1;
+    *path = line + off;
+    return 0;
+}
+
+static int vfyCacheLookup(ARGV_const_t lines, const char *fn,
+			  const struct stat *st, const char *digest,
+			  int vfylevel, rpmVSFlags vsflags, int *verified)
+{
+    for (ARGV_const_t line = lines; line && *line; line++) {
+	int clevel, cverified;
+	unsigned int cflags;
+	long long csize, cmtime;
+	char cdigest[130];
+	const char *cpath;
+
+	if (vfyCacheParse(*line, &clevel, &cflags, &cverified,
+			  &csize, &cmtime, cdigest, &cpath))
+	    continue;
+	if (rstreq(cpath, fn) && clevel == vfylevel &&
+		cflags == (unsigned int) vsflags &&
+		csize == (long long) st->st_size &&
+		cmtime == (long long) st->st_mtime &&
+		rstreq(cdigest, digest))
+	{
+	    *verified = cverified;
+	    return 1;
+	}
+    }
+    return 0;
+}
+
+static void vfyCacheUpdate(ARGV_t *lines, const char *fn,
+			   const struct stat *st, const char *digest,
+			   int vfylevel, rpmVSFlags vsflags, int verified)
+{
+    char *entry = NULL;
+
+    rasprintf(&entry, "%d %u %d %lld %lld %s %s",
+	      vfylevel, (unsigned int) vsflags, verified,
+	      (long long) st->st_size, (long long) st->st_mtime, digest, fn);
+
+    /* Replace a previous entry for the same package path if any */
+    for (ARGV_t line = *lines; line && *line; line++) {
+	int clevel, cverified;
+	unsigned int cflags;
+	long long csize, cmtime;
+	char cdigest[130];
+	const char *cpath;
+
+	if (vfyCacheParse(*line, &clevel, &cflags, &cverified,
+			  &csize, &cmtime, cdigest, &cpath))
+	    continue;
+	if (rstreq(cpath, fn)) {
+	    free(*line);
+	    *line = entry;
+	    return;
+	}
+    }
+    argvAdd(lines, entry);
+    free(entry);
+}
+
 static int verifyPackageFiles(rpmts ts, rpm_loff_t total)
 {
     int rc = 0;
@@ -1268,6 +1644,9 @@ static int verifyPackageFiles(rpmts ts, rpm_loff_t total)
     rpm_loff_t oc = 0;
     rpmVSFlags vsflags = rpmtsVfyFlags(ts);
     int vfylevel = rpmtsVfyLevel(ts);
+    char *cachepath = vfyCachePath(ts);
+    ARGV_t cache = cachepath ? vfyCacheLoad(cachepath) : NULL;
+    int cachedirty = 0;
 
     rpmtsNotify(ts, NULL, RPMCALLBACK_VERIFY_START, 0, total);
 
@@ -1275,7 +1654,7 @@ static int verifyPackageFiles(rpmts ts, rpm_loff_t total)
 
     pi = rpmtsiInit(ts);
     while ((p = rpmtsiNext(pi, TR_ADDED))) {
-	struct rpmvs_s *vs = rpmvsCreate(vfylevel, vsflags, keyring);
+	struct rpmvs_s *vs;
 	struct vfydata_s vd = {
 	    .msg = NULL,
 	    .type = { -1, -1, -1, },
@@ -1283,8 +1662,31 @@ static int verifyPackageFiles(rpmts ts, rpm_loff_t total)
 	};
 	int verified = 0;
 	rpmRC prc = RPMRC_FAIL;
+	const char *fn = (const char *) rpmteKey(p);
+	char *digest = NULL;
+	struct stat st;
+	int stated = 0;
 
 	rpmtsNotify(ts, p, RPMCALLBACK_VERIFY_PROGRESS, oc++, total);
+
+	/* See if we verified this very package file previously */
+	if (cachepath && fn && stat(fn, &st) == 0) {
+	    Header h = rpmteHeader(p);
+	    const char *d = headerGetString(h, RPMTAG_SHA256HEADER);
+	    stated = 1;
+	    if (d && strchr(d, ' ') == NULL)
+		digest = xstrdup(d);
+	    headerFree(h);
+	}
+	if (digest && vfyCacheLookup(cache, fn, &st, digest,
+				     vfylevel, vsflags, &verified)) {
+	    rpmteSetVerified(p, verified);
+	    free(digest);
+	    continue;
+	}
+
+	vs = rpmvsCreate(vfylevel, vsflags, keyring);
+
 	FD_t fd = rpmtsNotify(ts, p, RPMCALLBACK_INST_OPEN_FILE, 0, 0);
 	if (fd != NULL) {
 	    prc = rpmpkgRead(vs, fd, NULL, NULL, &vd.msg);
@@ -1304,6 +1706,18 @@ static int verifyPackageFiles(rpmts ts, rpm_loff_t total)
 	if (prc)
 	    rpmteAddProblem(p, RPMPROB_VERIFY, NULL, vd.msg, 0);
 
+	/* Only remember clean verifications, and only of unchanged files */
+	if (prc == RPMRC_OK && digest && stated) {
+	    struct stat nst;
+	    if (stat(fn, &nst) == 0 && nst.st_size == st.st_size &&
+		    nst.st_mtime == st.st_mtime) {
+		vfyCacheUpdate(&cache, fn, &st, digest,
+			       vfylevel, vsflags, verified);
+		cachedirty = 1;
+	    }
+	}
+
+	free(digest);
 	vd.msg = _free(vd.msg);
 	rpmvsFree(vs);
     }
@@ -1311,8 +1725,13 @@ static int verifyPackageFiles(rpmts ts, rpm_loff_t total)
 
     (void) rpmswExit(rpmtsOp(ts, RPMTS_OP_VERIFY), 0);
 
+    if (cachedirty && cachepath)
+	vfyCacheSave(cachepath, cache);
+
     rpmtsiFree(pi);
     rpmKeyringFree(keyring);
+    argvFree(cache);
+    free(cachepath);
     return rc;
 }
 
@@ -1518,6 +1937,9 @@ static int rpmtsPrepare(rpmts ts)
     uint64_t fileCount = countFiles(ts);
     const char *dbhome = NULL;
     struct stat dbstat;
+    char *fpcpath = NULL;
+    char *fpccookie = NULL;
+    int nthreads = rpmExpandNumeric("%{?_conflict_scan_threads}");
 
     fingerPrintCache fpc = fpCacheCreate(fileCount/2 + 10001, rpmtsPool(ts));
 
@@ -1547,6 +1969,14 @@ static int rpmtsPrepare(rpmts ts)
 	goto exit;
     }
     
+    /* Carry resolved directories over from the previous transaction.
+     * We are inside the chroot here, so the path needs no root prefix. */
+    fpcpath = rpmExpand("%{?_fpcache_path}", NULL);
+    if (*fpcpath != '\0') {
+	fpccookie = rpmdbCookie(rpmtsGetRdb(ts));
+	fpCacheLoad(fpc, fpcpath, fpccookie);
+    }
+
     rpmtsNotify(ts, NULL, RPMCALLBACK_TRANS_START, 6, tsmem->orderCount);
     /* Add fingerprint for each file not skipped. */
     fpCachePopulate(fpc, ts, fileCount);
@@ -1558,6 +1988,13 @@ static int rpmtsPrepare(rpmts ts)
     if (dbhome && stat(dbhome, &dbstat))
 	dbhome = NULL;
 
+    /* Scan independent groups of elements for overlaps concurrently */
+    if (nthreads > 1) {
+	(void) rpmswEnter(rpmtsOp(ts, RPMTS_OP_FINGERPRINT), 0);
+	runOverlapScan(ts, fpc, nthreads);
+	(void) rpmswExit(rpmtsOp(ts, RPMTS_OP_FINGERPRINT), 0);
+    }
+
     pi = rpmtsiInit(ts);
     while ((p = rpmtsiNext(pi, 0)) != NULL) {
 	rpmfiles files = rpmteFiles(p);;
@@ -1567,7 +2004,8 @@ static int rpmtsPrepare(rpmts ts)
 	(void) rpmswEnter(rpmtsOp(ts, RPMTS_OP_FINGERPRINT), 0);
 	/* check files in ts against each other and update disk space
 	   needs on each partition for this package. */
-	handleOverlappedFiles(ts, fpc, p, files);
+	if (nthreads <= 1)
+	    handleOverlappedFiles(ts, fpc, p, files);
 
 	/* Check added package has sufficient space on each partition used. */
 	if (rpmteType(p) == TR_ADDED) {
@@ -1590,6 +2028,10 @@ static int rpmtsPrepare(rpmts ts)
     rpmtsiFree(pi);
     rpmtsNotify(ts, NULL, RPMCALLBACK_TRANS_STOP, 6, tsmem->orderCount);
 
+    /* Save the resolved directories while still inside the chroot */
+    if (*fpcpath != '\0' && fpccookie != NULL)
+	fpCacheSave(fpc, fpcpath, fpccookie);
+
     /* return from chroot if done earlier */
     if (rpmChrootOut())
 	rc = -1;
@@ -1607,6 +2049,8 @@ static int rpmtsPrepare(rpmts ts)
 	setSSD(1);
 
 exit:
+    free(fpcpath);
+    free(fpccookie);
     fpCacheFree(fpc);
     return rc;
 }
@@ -1614,27 +2058,368 @@ exit:
 /*
  * Transaction main loop: install and remove packages
  */
+/*
+ * Hint the kernel to load the next nahead package files into the page
+ * cache so rpmteOpen() doesn't block on cold-cache disk reads during
+ * the install loop. Purely advisory, failures are silently ignored.
+ */
+static void tsPkgReadAhead(rpmts ts, int next, int nahead)
+{
+    tsMembers tsmem = rpmtsMembers(ts);
+
+    for (int oc = next; oc < tsmem->orderCount && nahead > 0; oc++) {
+	rpmte p = tsmem->order[oc];
+	const char *fn = rpmteKey(p);
+
+	if (rpmteType(p) != TR_ADDED || fn == NULL)
+	    continue;
+	int fd = open(fn, O_RDONLY);
+	if (fd >= 0) {
+	    (void) posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+	    close(fd);
+	}
+	nahead--;
+    }
+}
+
+/*
+ * Transaction progress prediction (%_txnrate_path).
+ *
+ * Each element is assigned an estimated cost in seconds from its
+ * payload size, file count and scriptlet presence, converted with
+ * per-host throughput rates persisted from previous transactions.
+ * While the transaction runs, elapsed and predicted total time (in
+ * milliseconds) are reported through RPMCALLBACK_PREDICT_PROGRESS at
+ * every element start; once enough of the transaction has run, the
+ * prediction for the remainder is rescaled by the throughput actually
+ * observed so far. Afterwards the rates are recalibrated from the
+ * measured wall time (exponentially smoothed) and written back.
+ */
+struct txnRates_s {
+    double bytespersec;		/* payload bytes unpacked per second */
+    double filespersec;		/* files created/removed per second */
+    double scriptsecs;		/* seconds per scriptlet */
+};
+
+struct txnPredict_s {
+    struct txnRates_s rates;
+    double *costs;		/* per-element estimated seconds */
+    double total;		/* estimated total seconds */
+    double consumed;		/* estimate for elements already started */
+    struct rpmsw_s start;	/* transaction start time stamp */
+    char *path;			/* rate file path (NULL disables) */
+};
+
+static const struct txnRates_s txnRatesDefault = { 50.0e6, 2000.0, 0.5 };
+
+static void txnRatesLoad(const char *path, struct txnRates_s *rates)
+{
+    FILE *fp = fopen(path, "r");
+
+    *rates = txnRatesDefault;
+    if (fp) {
+	struct txnRates_s r;
+	if (fscanf(fp, "1 %lg %lg %lg", &r.bytespersec, &r.filespersec,
+		   &r.scriptsecs) == 3 &&
+		r.bytespersec > 0 && r.filespersec > 0 && r.scriptsecs > 0)
+	    *rates = r;
+	fclose(fp);
+    }
+}
+
+static void txnRatesSave(const char *path, const struct txnRates_s *rates)
+{
+    char *tmppath = NULL;
+    FILE *fp = NULL;
+
+    rasprintf(&tmppath, "%s.tmp.%d", path, (int) getpid());
+    if ((fp = fopen(tmppath, "w")) == NULL)
+	goto exit;
+
+    fprintf(fp, "1 %g %g %g\n",
+	    rates->bytespersec, rates->filespersec, rates->scriptsecs);
+
+    if (fclose(fp) == 0) {
+	if (rename(tmppath, path) != 0)
+	    unlink(tmppath);
+    } else {
+	unlink(tmppath);
+    }
+
+exit:
+    free(tmppath);
+}
+
+static double txnElemCost(rpmte p, const struct txnRates_s *rates)
+{
+    rpmfiles files = rpmteFiles(p);
+    double cost = rpmfilesFC(files) / rates->filespersec;
+
+    rpmfilesFree(files);
+    if (rpmteType(p) == TR_ADDED)
+	cost += rpmteArchiveSize(p) / rates->bytespersec;
+    cost += rpmteScriptCount(p) * rates->scriptsecs;
+    return cost;
+}
+
+static void txnPredictInit(rpmts ts, struct txnPredict_s *pred)
+{
+    char *fn = rpmExpand("%{?_txnrate_path}", NULL);
+    rpmtsi pi;
+    rpmte p;
+    int i = 0;
+
+    memset(pred, 0, sizeof(*pred));
+    if (*fn != '\0' && !(rpmtsFlags(ts) & RPMTRANS_FLAG_TEST))
+	pred->path = rpmGenPath(rpmtsRootDir(ts), fn, NULL);
+    free(fn);
+    if (pred->path == NULL)
+	return;
+
+    txnRatesLoad(pred->path, &pred->rates);
+    pred->costs = xcalloc(rpmtsNElements(ts), sizeof(*pred->costs));
+    pi = rpmtsiInit(ts);
+    while ((p = rpmtsiNext(pi, 0)) != NULL) {
+	pred->costs[i] = txnElemCost(p, &pred->rates);
+	pred->total += pred->costs[i];
+	i++;
+    }
+    rpmtsiFree(pi);
+
+    rpmswNow(&pred->start);
+    rpmtsNotify(ts, NULL, RPMCALLBACK_PREDICT_PROGRESS,
+		0, (rpm_loff_t)(pred->total * 1000));
+}
+
+static void txnPredictStep(rpmts ts, struct txnPredict_s *pred, int i)
+{
+    struct rpmsw_s now;
+    double elapsed, predicted;
+
+    if (pred->path == NULL)
+	return;
+
+    rpmswNow(&now);
+    elapsed = rpmswDiff(&now, &pred->start) / 1.0e6;
+
+    /* Rescale the remainder by the throughput observed so far */
+    if (elapsed > 1.0 && pred->consumed > 1.0)
+	predicted = elapsed +
+		(pred->total - pred->consumed) * (elapsed / pred->consumed);
+    else
+	predicted = pred->total;
+
+    rpmtsNotify(ts, NULL, RPMCALLBACK_PREDICT_PROGRESS,
+		(rpm_loff_t)(elapsed * 1000), (rpm_loff_t)(predicted * 1000));
+    pred->consumed += pred->costs[i];
+}
+
+static void txnPredictFini(rpmts ts, struct txnPredict_s *pred, int nfailed)
+{
+    struct rpmsw_s now;
+    double elapsed;
+
+    if (pred->path == NULL)
+	return;
+
+    rpmswNow(&now);
+    elapsed = rpmswDiff(&now, &pred->start) / 1.0e6;
+    rpmtsNotify(ts, NULL, RPMCALLBACK_PREDICT_PROGRESS,
+		(rpm_loff_t)(elapsed * 1000), (rpm_loff_t)(elapsed * 1000));
+
+    /* Recalibrate from complete, sufficiently long transactions only */
+    if (nfailed == 0 && elapsed > 1.0 && pred->total > 0) {
+	double k = elapsed / pred->total;
+	pred->rates.bytespersec = (pred->rates.bytespersec +
+				   pred->rates.bytespersec / k) / 2;
+	pred->rates.filespersec = (pred->rates.filespersec +
+				   pred->rates.filespersec / k) / 2;
+	pred->rates.scriptsecs = (pred->rates.scriptsecs +
+				  pred->rates.scriptsecs * k) / 2;
+	txnRatesSave(pred->path, &pred->rates);
+    }
+
+    pred->costs = _free(pred->costs);
+    pred->path = _free(pred->path);
+}
+
+/*
+ * Write-ahead transaction journal (%_txnjournal_path).
+ *
+ * When enabled, rpmtsRun() records each completed transaction element
+ * in a journal next to the rpmdb before starting the next one, and
+ * removes the journal when the transaction finishes with no failures.
+ * If a run is cut short (crash, power loss) or some elements failed,
+ * rerunning the identical transaction finds the journal, verifies that
+ * it describes the same element set, and skips the elements already
+ * recorded instead of redoing them. An element is journaled only after
+ * its files are committed, its scriptlets have run and its header
+ * change has reached the rpmdb, so a crash mid-element redoes just that
+ * element. The journal is only touched while the transaction write
+ * lock is held, serializing it with other rpm instances.
+ */
+struct txnJournal_s {
+    char *path;			/* journal file path (NULL disables) */
+    FILE *fp;			/* journal open for appending */
+    unsigned char *done;	/* per-element completion flags */
+    int nresumed;		/* no. of elements skipped on resume */
+};
+
+/* Identity of the element set, order included */
+static unsigned int txnJournalId(rpmts ts)
+{
+    rpmtsi pi = rpmtsiInit(ts);
+    rpmte p;
+    unsigned int id = rpmtsNElements(ts);
+
+    while ((p = rpmtsiNext(pi, 0)) != NULL)
+	id = id * 31 + rstrhash(rpmteNEVRA(p)) + rpmteType(p);
+    rpmtsiFree(pi);
+    return id;
+}
+
+static void txnJournalInit(rpmts ts, struct txnJournal_s *jrnl)
+{
+    char *fn = rpmExpand("%{?_txnjournal_path}", NULL);
+    int nelem = rpmtsNElements(ts);
+    unsigned int id;
+    FILE *fp;
+
+    memset(jrnl, 0, sizeof(*jrnl));
+    if (*fn != '\0' && !(rpmtsFlags(ts) & RPMTRANS_FLAG_TEST))
+	jrnl->path = rpmGenPath(rpmtsRootDir(ts), fn, NULL);
+    free(fn);
+    if (jrnl->path == NULL)
+	return;
+
+    id = txnJournalId(ts);
+
+    /* Pick up the completed elements of an interrupted identical run */
+    if ((fp = fopen(jrnl->path, "r")) != NULL) {
+	unsigned int pnelem, pid, ix;
+	if (fscanf(fp, "1 %u %u\n", &pnelem, &pid) == 2 &&
+		pnelem == (unsigned int) nelem && pid == id) {
+	    jrnl->done = xcalloc(nelem, sizeof(*jrnl->done));
+	    while (fscanf(fp, "%u\n", &ix) == 1 && ix < (unsigned int) nelem) {
+		if (jrnl->done[ix] == 0)
+		    jrnl->nresumed++;
+		jrnl->done[ix] = 1;
+	    }
+	}
+	fclose(fp);
+    }
+
+    if (jrnl->nresumed > 0) {
+	rpmlog(RPMLOG_WARNING,
+		_("resuming interrupted transaction: "
+		  "%d of %d element(s) already complete\n"),
+		jrnl->nresumed, nelem);
+	jrnl->fp = fopen(jrnl->path, "a");
+    } else {
+	jrnl->done = _free(jrnl->done);
+	jrnl->fp = fopen(jrnl->path, "w");
+	if (jrnl->fp != NULL)
+	    fprintf(jrnl->fp, "1 %u %u\n", (unsigned int) nelem, id);
+    }
+
+    if (jrnl->fp == NULL) {
+	rpmlog(RPMLOG_WARNING, _("cannot write transaction journal %s: %s\n"),
+		jrnl->path, strerror(errno));
+	jrnl->path = _free(jrnl->path);
+	jrnl->done = _free(jrnl->done);
+    } else if (fflush(jrnl->fp) == 0) {
+	fsync(fileno(jrnl->fp));
+    }
+}
+
+/* Was the element already completed by an interrupted run? */
+static int txnJournalDone(struct txnJournal_s *jrnl, int i)
+{
+    return (jrnl->done != NULL && jrnl->done[i]);
+}
+
+static void txnJournalStep(struct txnJournal_s *jrnl, int i)
+{
+    if (jrnl->fp == NULL)
+	return;
+
+    /* A %post still executing asynchronously belongs to this element */
+    rpmpsmWaitAsync();
+    /* ...and so does a database commit still queued on the writer thread.
+     * A failed commit means some element's header never reached the rpmdb:
+     * stop journaling so the retry redoes everything from there on,
+     * rpmpsmFinishDb() surfaces the error at the end of the transaction. */
+    if (rpmpsmWaitDb() != RPMRC_OK)
+	return;
+
+    fprintf(jrnl->fp, "%d\n", i);
+    if (fflush(jrnl->fp) == 0)
+	fsync(fileno(jrnl->fp));
+}
+
+static void txnJournalFini(struct txnJournal_s *jrnl, int nfailed)
+{
+    if (jrnl->fp != NULL) {
+	fclose(jrnl->fp);
+	/* Failed elements were not journaled, keep them for a retry */
+	if (nfailed == 0)
+	    unlink(jrnl->path);
+    }
+    jrnl->done = _free(jrnl->done);
+    jrnl->path = _free(jrnl->path);
+}
+
 static int rpmtsProcess(rpmts ts)
 {
     rpmtsi pi;	rpmte p;
     int rc = 0;
     int i = 0;
+    int nahead = rpmExpandNumeric("%{?_pkg_readahead}");
+    struct txnPredict_s pred;
+    struct txnJournal_s jrnl;
+
+    txnPredictInit(ts, &pred);
+    txnJournalInit(ts, &jrnl);
 
     pi = rpmtsiInit(ts);
     while ((p = rpmtsiNext(pi, 0)) != NULL) {
 	int failed;
 
+	if (txnJournalDone(&jrnl, i)) {
+	    rpmlog(RPMLOG_DEBUG, "========== === %s already complete\n",
+		    rpmteNEVRA(p));
+	    i++;
+	    continue;
+	}
+
 	rpmlog(RPMLOG_DEBUG, "========== +++ %s %s-%s 0x%x\n",
 		rpmteNEVR(p), rpmteA(p), rpmteO(p), rpmteColor(p));
 
+	if (nahead > 0 && !(rpmtsFlags(ts) & RPMTRANS_FLAG_TEST))
+	    tsPkgReadAhead(ts, i + 1, nahead);
+
+	txnPredictStep(ts, &pred, i);
 	failed = rpmteProcess(p, rpmteType(p), i++);
 	if (failed) {
 	    rpmlog(RPMLOG_ERR, "%s: %s %s\n", rpmteNEVRA(p),
 		   rpmteTypeString(p), failed > 1 ? _("skipped") : _("failed"));
 	    rc++;
+	} else {
+	    txnJournalStep(&jrnl, i - 1);
 	}
     }
     rpmtsiFree(pi);
+
+    /* Reap a %post scriptlet possibly still executing asynchronously */
+    rpmpsmWaitAsync();
+
+    /* Flush database commits still queued on the writer thread */
+    if (rpmpsmFinishDb() != RPMRC_OK)
+	rc++;
+
+    txnPredictFini(ts, &pred, rc);
+    txnJournalFini(&jrnl, rc);
+
     return rc;
 }
 
@@ -1693,6 +2478,12 @@ rpmRC runScript(rpmts ts, rpmte te, Header h, ARGV_const_t prefixes,
     FD_t sfd = NULL;
     int warn_only = !(rpmScriptFlags(script) & RPMSCRIPT_FLAG_CRITICAL);
 
+    /* Scriptlets execute strictly in order: reap any in-flight one first */
+    rpmpsmWaitAsync();
+
+    /* Scriptlets may read the database: flush queued commits first */
+    rpmpsmWaitDb();
+
     if (rpmChrootIn())
 	return RPMRC_FAIL;
 
@@ -1727,6 +2518,9 @@ rpmRC runScript(rpmts ts, rpmte te, Header h, ARGV_const_t prefixes,
 	rpmtsNotify(ts, te, RPMCALLBACK_SCRIPT_ERROR, stag, rc);
     }
 
+    /* The scriptlet may have created or removed accounts */
+    rpmugFree();
+
     rpmChrootOut();
 
     if (te != xte)
@@ -1875,9 +2669,13 @@ exit:
     }
     (void) umask(oldmask);
     (void) rpmtsFinish(ts);
+    rpmtsDirCacheEmpty(ts);
+    rpmugFree();
     rpmpsFree(tsprobs);
     rpmtxnEnd(txn);
     /* Restore SIGPIPE *after* unblocking signals in rpmtxnEnd() */
     rpmsqSetAction(SIGPIPE, oact);
+    if (rpmtsFlags(ts) & RPMTRANS_FLAG_JSONSTATS)
+	rpmtsPrintStatsJson(ts);
     return rc;
 }
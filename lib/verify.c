@@ -7,6 +7,7 @@
 
 #include <errno.h>
 #include <fcntl.h>
+#include <pthread.h>
 #if WITH_CAP
 #include <sys/capability.h>
 #endif
@@ -21,9 +22,11 @@
 #include <rpm/rpmts.h>
 #include <rpm/rpmdb.h>
 #include <rpm/rpmfileutil.h>
+#include <rpm/rpmsq.h>
 
 #include "lib/misc.h"
 #include "lib/rpmchroot.h"
+#include "lib/rpmfi_internal.h"	/* rpmfilesDirFd */
 #include "lib/rpmte_internal.h"	/* rpmteProcess() */
 #include "lib/rpmug.h"
 
@@ -54,6 +57,65 @@ static int cap_compare(cap_t acap, cap_t bcap)
 }
 #endif
 	
+enum vfyLevel_e {
+    VFYLEVEL_PARANOID	= 0,	/*!< always digest file contents (default) */
+    VFYLEVEL_FAST	= 1,	/*!< trust an unchanged stat() since install */
+};
+
+static int vfylevel = VFYLEVEL_PARANOID;
+static pthread_once_t vfylevelOnce = PTHREAD_ONCE_INIT;
+
+static void vfylevelInit(void)
+{
+    const char *level = rpmcliVerifyLevel;
+    char *macro = NULL;
+
+    if (level == NULL)
+	level = macro = rpmExpand("%{?_verify_level}", NULL);
+
+    if (rstreq(level, "fast")) {
+	vfylevel = VFYLEVEL_FAST;
+    } else if (*level && !rstreq(level, "paranoid")) {
+	rpmlog(RPMLOG_WARNING,
+		_("unknown verify level '%s', assuming paranoid\n"), level);
+    }
+    free(macro);
+}
+
+/*
+ * At the fast verify level, trust the content of a regular file whose
+ * size and mtime match the install record and whose inode change time
+ * is unchanged since dbAdd() captured it, skipping the expensive digest.
+ * Files installed before %_verify_level was enabled have no recorded
+ * ctime and always get digested.
+ */
+static int vfyDigestTrusted(rpmfiles fi, int ix,
+			    const struct stat *sb, const struct stat *fsb)
+{
+    rpm_time_t fctime;
+
+    pthread_once(&vfylevelOnce, vfylevelInit);
+    if (vfylevel != VFYLEVEL_FAST)
+	return 0;
+
+    fctime = rpmfilesFCtime(fi, ix);
+    return (fctime != 0 && sb->st_ctime == fctime &&
+	    sb->st_size == fsb->st_size && sb->st_mtime == fsb->st_mtime);
+}
+
+/* (l)stat relative to a cached per-directory fd, skipping the repeated
+ * kernel walk over the shared path prefix */
+static int vfyStat(rpmfiles fi, int ix, const char *fn, int dolstat,
+		   struct stat *sb)
+{
+    int dirfd = rpmfilesDirFd(fi, ix);
+    const char *bn = rpmfilesBN(fi, ix);
+
+    if (dirfd >= 0 && bn != NULL)
+	return fstatat(dirfd, bn, sb, dolstat ? AT_SYMLINK_NOFOLLOW : 0);
+    return dolstat ? lstat(fn, sb) : stat(fn, sb);
+}
+
 rpmVerifyAttrs rpmfilesVerify(rpmfiles fi, int ix, rpmVerifyAttrs omitMask)
 {
     rpmfileAttrs fileAttrs = rpmfilesFFlags(fi, ix);
@@ -88,7 +150,8 @@ rpmVerifyAttrs rpmfilesVerify(rpmfiles fi, int ix, rpmVerifyAttrs omitMask)
 	break;
     }
 
-    if (fn == NULL || lstat(fn, &sb) != 0 || rpmfilesStat(fi, ix, 0, &fsb)) {
+    if (fn == NULL || vfyStat(fi, ix, fn, 1, &sb) != 0 ||
+	    rpmfilesStat(fi, ix, 0, &fsb)) {
 	vfy |= RPMVERIFY_LSTATFAIL;
 	goto exit;
     }
@@ -97,7 +160,7 @@ rpmVerifyAttrs rpmfilesVerify(rpmfiles fi, int ix, rpmVerifyAttrs omitMask)
     if (S_ISDIR(fsb.st_mode) && S_ISLNK(sb.st_mode)) {
 	struct stat dsb;
 	/* ...if it actually points to a directory  */
-	if (stat(fn, &dsb) == 0 && S_ISDIR(dsb.st_mode)) {
+	if (vfyStat(fi, ix, fn, 0, &dsb) == 0 && S_ISDIR(dsb.st_mode)) {
 	    /* ...and is by a legit user, to match fsmVerify() behavior */
 	    if (sb.st_uid == 0 || sb.st_uid == dsb.st_uid)
 		sb = dsb; /* struct assignment */
@@ -130,13 +193,17 @@ rpmVerifyAttrs rpmfilesVerify(rpmfiles fi, int ix, rpmVerifyAttrs omitMask)
 	size_t diglen;
 
 	if ((digest = rpmfilesFDigest(fi, ix, &algo, &diglen))) {
-	    unsigned char fdigest[diglen];
-
-	    if (rpmDoDigest(algo, fn, 0, fdigest)) {
-		vfy |= (RPMVERIFY_READFAIL|RPMVERIFY_FILEDIGEST);
+	    if (vfyDigestTrusted(fi, ix, &sb, &fsb)) {
+		/* stat matches the install record, content trusted as-is */
 	    } else {
-		if (memcmp(fdigest, digest, diglen))
-		    vfy |= RPMVERIFY_FILEDIGEST;
+		unsigned char fdigest[diglen];
+
+		if (rpmDoDigest(algo, fn, 0, fdigest)) {
+		    vfy |= (RPMVERIFY_READFAIL|RPMVERIFY_FILEDIGEST);
+		} else {
+		    if (memcmp(fdigest, digest, diglen))
+			vfy |= RPMVERIFY_FILEDIGEST;
+		}
 	    }
 	} else {
 	    vfy |= RPMVERIFY_FILEDIGEST;
@@ -330,8 +397,57 @@ static const char * stateStr(rpmfileState fstate)
     return _("unknown state");
 }
 
+struct vfyfilejob_s {
+    int ix;			/*!< file index in the rpmfiles set */
+    rpmVerifyAttrs result;
+    int verrno;			/*!< errno from a failed lstat() etc */
+    int done;
+};
+
+struct vfyfilepool_s {
+    struct vfyfilejob_s *jobs;
+    int njobs;
+    int next;
+    rpmfiles files;
+    rpmVerifyAttrs omitMask;
+    pthread_mutex_t lock;
+    pthread_cond_t done_cv;
+};
+
+static void vfyfileRun(struct vfyfilepool_s *pool, struct vfyfilejob_s *job)
+{
+    errno = 0;
+    job->result = rpmfilesVerify(pool->files, job->ix, pool->omitMask);
+    job->verrno = errno;
+}
+
+static void *vfyfileWorker(void *data)
+{
+    struct vfyfilepool_s *pool = data;
+
+    /* Signals belong to the coordinating thread */
+    rpmsqBlockThread();
+
+    pthread_mutex_lock(&pool->lock);
+    while (pool->next < pool->njobs) {
+	struct vfyfilejob_s *job = &pool->jobs[pool->next++];
+	pthread_mutex_unlock(&pool->lock);
+
+	vfyfileRun(pool, job);
+
+	pthread_mutex_lock(&pool->lock);
+	job->done = 1;
+	pthread_cond_broadcast(&pool->done_cv);
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
 /**
  * Check file info from header against what's actually installed.
+ * The per-file disk checks run on a worker pool (--jobs), results are
+ * reported strictly in manifest order. Database lookups and output stay
+ * on the calling thread.
  * @param ts		transaction set
  * @param h		header to verify
  * @param omitMask	bits to disable verify checks
@@ -344,17 +460,24 @@ static int verifyHeader(rpmts ts, Header h, rpmVerifyAttrs omitMask,
 {
     rpmVerifyAttrs verifyResult = 0;
     rpmVerifyAttrs verifyAll = 0; /* assume no problems */
-    rpmfi fi = rpmfiNew(ts, h, RPMTAG_BASENAMES, RPMFI_FLAGS_VERIFY);
-
-    if (fi == NULL)
+    rpmfiles files = rpmfilesNew(NULL, h, RPMTAG_BASENAMES, RPMFI_FLAGS_VERIFY);
+    struct vfyfilepool_s pool = {
+	.njobs = 0,
+	.next = 0,
+	.omitMask = omitMask,
+    };
+    pthread_t *threads = NULL;
+    int nthreads = 0;
+    int fc;
+
+    if (files == NULL)
 	return 1;
 
-    rpmfiInit(fi, 0);
-    while (rpmfiNext(fi) >= 0) {
-	rpmfileAttrs fileAttrs = rpmfiFFlags(fi);
-	char *buf = NULL, *attrFormat;
-	const char *fstate = NULL;
-	char ac;
+    fc = rpmfilesFC(files);
+    pool.files = files;
+    pool.jobs = xcalloc(fc ? fc : 1, sizeof(*pool.jobs));
+    for (int ix = 0; ix < fc; ix++) {
+	rpmfileAttrs fileAttrs = rpmfilesFFlags(files, ix);
 
 	/* If filtering by inclusion, skip non-matching (eg --configfiles) */
 	if (incAttrs && !(incAttrs & fileAttrs))
@@ -364,40 +487,77 @@ static int verifyHeader(rpmts ts, Header h, rpmVerifyAttrs omitMask,
 	if (skipAttrs & fileAttrs)
 	    continue;
 
-	verifyResult = rpmfiVerify(fi, omitMask);
+	pool.jobs[pool.njobs++].ix = ix;
+    }
+    pthread_mutex_init(&pool.lock, NULL);
+    pthread_cond_init(&pool.done_cv, NULL);
+
+    if (rpmcliVerifyJobs > 1 && pool.njobs > 1) {
+	nthreads = (rpmcliVerifyJobs < pool.njobs) ?
+			rpmcliVerifyJobs : pool.njobs;
+	threads = xcalloc(nthreads, sizeof(*threads));
+	for (int i = 0; i < nthreads; i++) {
+	    if (pthread_create(&threads[i], NULL, vfyfileWorker, &pool) != 0) {
+		nthreads = i;
+		break;
+	    }
+	}
+    }
+
+    /* Emit results strictly in manifest order as they become available */
+    for (int i = 0; i < pool.njobs; i++) {
+	struct vfyfilejob_s *job = &pool.jobs[i];
+	rpmfileAttrs fileAttrs = rpmfilesFFlags(files, job->ix);
+	char *fn, *buf = NULL, *attrFormat;
+	const char *fstate = NULL;
+	char ac;
+
+	if (nthreads > 0) {
+	    pthread_mutex_lock(&pool.lock);
+	    while (!job->done)
+		pthread_cond_wait(&pool.done_cv, &pool.lock);
+	    pthread_mutex_unlock(&pool.lock);
+	} else {
+	    /* Single job mode, or no workers could be started */
+	    pool.next = i + 1;
+	    vfyfileRun(&pool, job);
+	}
+
+	verifyResult = job->result;
+	fn = rpmfilesFN(files, job->ix);
 
 	/* Filter out timestamp differences of shared files */
 	if (verifyResult & RPMVERIFY_MTIME) {
 	    rpmdbMatchIterator mi;
-	    mi = rpmtsInitIterator(ts, RPMDBI_BASENAMES, rpmfiFN(fi), 0);
-	    if (rpmdbGetIteratorCount(mi) > 1) 
+	    mi = rpmtsInitIterator(ts, RPMDBI_BASENAMES, fn, 0);
+	    if (rpmdbGetIteratorCount(mi) > 1)
 		verifyResult &= ~RPMVERIFY_MTIME;
 	    rpmdbFreeIterator(mi);
 	}
 
 	/* State is only meaningful for installed packages */
 	if (headerGetInstance(h))
-	    fstate = stateStr(rpmfiFState(fi));
+	    fstate = stateStr(rpmfilesFState(files, job->ix));
 
 	attrFormat = rpmFFlagsString(fileAttrs, "");
 	ac = rstreq(attrFormat, "") ? ' ' : attrFormat[0];
 	if (verifyResult & RPMVERIFY_LSTATFAIL) {
 	    if (!(fileAttrs & (RPMFILE_MISSINGOK|RPMFILE_GHOST)) || rpmIsVerbose()) {
-		rasprintf(&buf, _("missing   %c %s"), ac, rpmfiFN(fi));
-		if ((verifyResult & RPMVERIFY_LSTATFAIL) != 0 &&
-		    errno != ENOENT) {
+		rasprintf(&buf, _("missing   %c %s"), ac, fn);
+		if (job->verrno != 0 && job->verrno != ENOENT) {
 		    char *app;
-		    rasprintf(&app, " (%s)", strerror(errno));
+		    rasprintf(&app, " (%s)", strerror(job->verrno));
 		    rstrcat(&buf, app);
 		    free(app);
 		}
 	    }
 	} else if (verifyResult || fstate || rpmIsVerbose()) {
 	    char *verifyFormat = rpmVerifyString(verifyResult, ".");
-	    rasprintf(&buf, "%s  %c %s", verifyFormat, ac, rpmfiFN(fi));
+	    rasprintf(&buf, "%s  %c %s", verifyFormat, ac, fn);
 	    free(verifyFormat);
 	}
 	free(attrFormat);
+	free(fn);
 
 	if (buf) {
 	    if (fstate)
@@ -411,9 +571,17 @@ static int verifyHeader(rpmts ts, Header h, rpmVerifyAttrs omitMask,
 	    verifyResult &= ~RPMVERIFY_LSTATFAIL;
 
 	verifyAll |= verifyResult;
+	rpmsqPoll();
     }
-    rpmfiFree(fi);
-	
+
+    for (int i = 0; i < nthreads; i++)
+	pthread_join(threads[i], NULL);
+    pthread_cond_destroy(&pool.done_cv);
+    pthread_mutex_destroy(&pool.lock);
+    free(pool.jobs);
+    free(threads);
+    rpmfilesFree(files);
+
     return (verifyAll != 0) ? 1 : 0;
 }
 
@@ -12,13 +12,21 @@
 struct fapolicyd_data {
     int fd;
     long changed_files;
+    long total_files;
     const char * fifo_path;
+    char * buf;			/* batched per-element notifications */
+    size_t buf_len;
+    size_t buf_alloc;
 };
 
 static struct fapolicyd_data fapolicyd_state = {
     .fd = -1,
     .changed_files = 0,
+    .total_files = 0,
     .fifo_path = "/run/fapolicyd/fapolicyd.fifo",
+    .buf = NULL,
+    .buf_len = 0,
+    .buf_alloc = 0,
 };
 
 static rpmRC open_fifo(struct fapolicyd_data* state)
@@ -63,14 +71,14 @@ static rpmRC open_fifo(struct fapolicyd_data* state)
     return RPMRC_FAIL;
 }
 
-static rpmRC write_fifo(struct fapolicyd_data* state, const char * str)
+static rpmRC write_fifo_raw(struct fapolicyd_data* state,
+                            const char * data, ssize_t len)
 {
-    ssize_t len = strlen(str);
     ssize_t written = 0;
     ssize_t n = 0;
 
     while (written < len) {
-        if ((n = write(state->fd, str + written, len - written)) < 0) {
+        if ((n = write(state->fd, data + written, len - written)) < 0) {
             if (errno == EINTR || errno == EAGAIN)
                 continue;
             rpmlog(RPMLOG_DEBUG, "Write: %s -> %s\n", state->fifo_path, strerror(errno));
@@ -85,6 +93,39 @@ static rpmRC write_fifo(struct fapolicyd_data* state, const char * str)
     return RPMRC_FAIL;
 }
 
+static rpmRC write_fifo(struct fapolicyd_data* state, const char * str)
+{
+    return write_fifo_raw(state, str, strlen(str));
+}
+
+/* Queue one notification record, sent on the next flush */
+static void buffer_record(struct fapolicyd_data* state, const char * str)
+{
+    size_t len = strlen(str);
+
+    if (state->buf_len + len > state->buf_alloc) {
+        if (state->buf_alloc == 0)
+            state->buf_alloc = 16 * 1024;
+        while (state->buf_len + len > state->buf_alloc)
+            state->buf_alloc *= 2;
+        state->buf = xrealloc(state->buf, state->buf_alloc);
+    }
+    memcpy(state->buf + state->buf_len, str, len);
+    state->buf_len += len;
+}
+
+/* Push the queued records to the daemon in a single write */
+static rpmRC flush_records(struct fapolicyd_data* state)
+{
+    rpmRC rc = RPMRC_OK;
+
+    if (state->buf_len > 0) {
+        rc = write_fifo_raw(state, state->buf, state->buf_len);
+        state->buf_len = 0;
+    }
+    return rc;
+}
+
 static rpmRC fapolicyd_init(rpmPlugin plugin, rpmts ts)
 {
     if (rpmtsFlags(ts) & (RPMTRANS_FLAG_TEST|RPMTRANS_FLAG_BUILD_PROBS))
@@ -105,6 +146,9 @@ static void fapolicyd_cleanup(rpmPlugin plugin)
         (void) close(fapolicyd_state.fd);
 
     fapolicyd_state.fd = -1;
+    fapolicyd_state.buf = _free(fapolicyd_state.buf);
+    fapolicyd_state.buf_len = 0;
+    fapolicyd_state.buf_alloc = 0;
 }
 
 static rpmRC fapolicyd_tsm_post(rpmPlugin plugin, rpmts ts, int res)
@@ -114,6 +158,10 @@ static rpmRC fapolicyd_tsm_post(rpmPlugin plugin, rpmts ts, int res)
 
     /* we are ready */
     if (fapolicyd_state.fd > 0) {
+        /* anything still queued goes out before the signals */
+        (void) flush_records(&fapolicyd_state);
+        rpmlog(RPMLOG_DEBUG, "fapolicyd: notified %ld changed files\n",
+               fapolicyd_state.total_files);
         /* send a signal that transaction is over */
         (void) write_fifo(&fapolicyd_state, "1\n");
         /* flush cache */
@@ -131,6 +179,8 @@ static rpmRC fapolicyd_scriptlet_pre(rpmPlugin plugin, const char *s_name,
         goto end;
 
     if (fapolicyd_state.changed_files > 0) {
+        /* the daemon must see the records before the flush signal */
+        (void) flush_records(&fapolicyd_state);
         /* send signal to flush cache */
         (void) write_fifo(&fapolicyd_state, "2\n");
 
@@ -167,14 +217,16 @@ static rpmRC fapolicyd_fsm_file_prepare(rpmPlugin plugin, rpmfi fi,
     }
 
     fapolicyd_state.changed_files++;
+    fapolicyd_state.total_files++;
 
     char buffer[4096];
 
     rpm_loff_t size = rpmfiFSize(fi);
     char * sha = rpmfiFDigestHex(fi, NULL);
 
+    /* queue instead of write, one fifo write per element is plenty */
     snprintf(buffer, 4096, "%s %lu %64s\n", dest, size, sha);
-    (void) write_fifo(&fapolicyd_state, buffer);
+    buffer_record(&fapolicyd_state, buffer);
 
     free(sha);
 
@@ -182,10 +234,23 @@ static rpmRC fapolicyd_fsm_file_prepare(rpmPlugin plugin, rpmfi fi,
     return RPMRC_OK;
 }
 
+static rpmRC fapolicyd_psm_post(rpmPlugin plugin, rpmte te, int res)
+{
+    /* not ready  */
+    if (fapolicyd_state.fd == -1)
+        goto end;
+
+    (void) flush_records(&fapolicyd_state);
+
+ end:
+    return RPMRC_OK;
+}
+
 struct rpmPluginHooks_s fapolicyd_hooks = {
     .init = fapolicyd_init,
     .cleanup = fapolicyd_cleanup,
     .scriptlet_pre = fapolicyd_scriptlet_pre,
     .tsm_post = fapolicyd_tsm_post,
+    .psm_post = fapolicyd_psm_post,
     .fsm_file_prepare = fapolicyd_fsm_file_prepare,
 };
@@ -18,6 +18,7 @@
 #define XATTR_NAME_IMA "security.ima"
 
 static int write_signatures_on_config_files = 0;
+static int package_has_sigs = 0;
 
 /*
  * check_zero_hdr: Check the signature for a zero header
@@ -42,6 +43,18 @@ static int check_zero_hdr(const unsigned char *fsig, size_t siglen)
 	return (memcmp(fsig, &zero_hdr, sizeof(zero_hdr)) == 0);
 }
 
+static rpmRC ima_fsm_files_pre(rpmPlugin plugin, rpmfiles files)
+{
+	size_t len = 0;
+
+	/* Signatures sit pre-decoded in one per-package array, probe it
+	 * once here instead of once per file in the prepare hook. */
+	package_has_sigs = (rpmfilesFC(files) > 0 &&
+			    rpmfilesFSignature(files, 0, &len) != NULL);
+
+	return RPMRC_OK;
+}
+
 static rpmRC ima_fsm_file_prepare(rpmPlugin plugin, rpmfi fi,
                                   const char *path,
                                   const char *dest,
@@ -52,6 +65,10 @@ static rpmRC ima_fsm_file_prepare(rpmPlugin plugin, rpmfi fi,
 	int rc = RPMRC_OK;
 	rpmFileAction action = XFO_ACTION(op);
 
+	/* Nothing to apply for packages without signatures */
+	if (!package_has_sigs)
+	    goto exit;
+
 	/* Ignore skipped files and unowned directories */
 	if (XFA_SKIPPING(action) || (op & FAF_UNOWNED))
 	    goto exit;
@@ -90,5 +107,6 @@ static rpmRC ima_init(rpmPlugin plugin, rpmts ts)
 
 struct rpmPluginHooks_s ima_hooks = {
         .init = ima_init,
+	.fsm_files_pre = ima_fsm_files_pre,
 	.fsm_file_prepare = ima_fsm_file_prepare,
 };
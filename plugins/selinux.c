@@ -5,20 +5,79 @@
 #include <selinux/label.h>
 #include <selinux/avc.h>
 #include <rpm/rpmlog.h>
+#include <rpm/rpmstring.h>
 #include <rpm/rpmts.h>
 #include "lib/rpmplugin.h"
 
 #include "debug.h"
 
+#define HASHTYPE labelHash
+#define HTKEYTYPE const char *
+#define HTDATATYPE char *
+#include "lib/rpmhash.H"
+#include "lib/rpmhash.C"
+#undef HASHTYPE
+#undef HTKEYTYPE
+#undef HTDATATYPE
+
 static struct selabel_handle * sehandle = NULL;
 
+/*
+ * Transaction-wide label cache: packages sharing path prefixes resolve
+ * the same labels over and over, a lookup result is valid until the
+ * policy changes. Keyed by file type + full path, as file context rules
+ * can match basenames, a dirname prefix alone is not enough.
+ */
+static labelHash labelcache = NULL;
+
 static inline rpmlogLvl loglvl(int iserror)
 {
     return iserror ? RPMLOG_ERR : RPMLOG_DEBUG;
 }
 
+/*
+ * Look up the label for path through the cache.
+ * Returns 0 with *con set (NULL if the policy has no context for path),
+ * -1 on hard lookup errors. The returned label is owned by the cache.
+ */
+static int label_get(const char *path, mode_t mode, const char **con)
+{
+    char *key = NULL;
+    char **labels = NULL;
+    int rc = 0;
+
+    *con = NULL;
+    /* Only the file type part of the mode matters for context matching */
+    rasprintf(&key, "%x;%s", (unsigned)((mode & S_IFMT) >> 12), path);
+
+    if (labelcache == NULL)
+	labelcache = labelHashCreate(1024, rstrhash, strcmp,
+				     (labelHashFreeKey)rfree,
+				     (labelHashFreeData)rfree);
+
+    if (labelHashGetEntry(labelcache, key, &labels, NULL, NULL)) {
+	*con = labels[0];
+	free(key);
+    } else {
+	char *scon = NULL;
+	if (selabel_lookup_raw(sehandle, &scon, path, mode) == 0) {
+	    *con = xstrdup(scon);
+	    labelHashAddEntry(labelcache, key, (char *)*con);
+	    freecon(scon);
+	} else if (errno == ENOENT) {
+	    /* No context for path, worth remembering too */
+	    labelHashAddEntry(labelcache, key, NULL);
+	} else {
+	    free(key);
+	    rc = -1;
+	}
+    }
+    return rc;
+}
+
 static void sehandle_fini(int close_status)
 {
+    labelcache = labelHashFree(labelcache);
     if (sehandle) {
 	selabel_close(sehandle);
 	sehandle = NULL;
@@ -154,6 +213,31 @@ static rpmRC selinux_scriptlet_fork_post(rpmPlugin plugin,
     return rc;
 }
 
+static rpmRC selinux_fsm_files_pre(rpmPlugin plugin, rpmfiles files)
+{
+    if (sehandle) {
+	rpmfi fi = rpmfilesIter(files, RPMFI_ITER_FWD);
+	const char *con = NULL;
+
+	/* Bulk-resolve labels for the package before extraction starts */
+	while (rpmfiNext(fi) >= 0)
+	    (void) label_get(rpmfiFN(fi), rpmfiFMode(fi), &con);
+	fi = rpmfiFree(fi);
+
+	/* ... and for the dirnames, created parents get prepared too */
+	for (int jx = 0; jx < rpmfilesDC(files); jx++) {
+	    char *dn = xstrdup(rpmfilesDN(files, jx));
+	    size_t dnlen = strlen(dn);
+
+	    if (dnlen > 1 && dn[dnlen - 1] == '/')
+		dn[dnlen - 1] = '\0';
+	    (void) label_get(dn, S_IFDIR, &con);
+	    free(dn);
+	}
+    }
+    return RPMRC_OK;
+}
+
 static rpmRC selinux_fsm_file_prepare(rpmPlugin plugin, rpmfi fi,
 					const char *path, const char *dest,
 				        mode_t file_mode, rpmFsmOp op)
@@ -162,21 +246,29 @@ static rpmRC selinux_fsm_file_prepare(rpmPlugin plugin, rpmfi fi,
     rpmFileAction action = XFO_ACTION(op);
 
     if (sehandle && !XFA_SKIPPING(action)) {
-	char *scon = NULL;
-	if (selabel_lookup_raw(sehandle, &scon, dest, file_mode) == 0) {
-	    int conrc = lsetfilecon(path, scon);
-
-	    if (conrc == 0 || (conrc < 0 && errno == EOPNOTSUPP))
-		rc = RPMRC_OK;
-
-	    rpmlog(loglvl(rc != RPMRC_OK), "lsetfilecon: (%s, %s) %s\n",
-		       path, scon, (conrc < 0 ? strerror(errno) : ""));
-
-	    freecon(scon);
-	} else {
-	    /* No context for dest is not our headache */
-	    if (errno == ENOENT)
+	const char *scon = NULL;
+
+	if (label_get(dest, file_mode, &scon) == 0) {
+	    if (scon != NULL) {
+		char *ocon = NULL;
+
+		/* Skip relabeling if the file already carries the label */
+		if (lgetfilecon(path, &ocon) >= 0 && rstreq(scon, ocon)) {
+		    rc = RPMRC_OK;
+		} else {
+		    int conrc = lsetfilecon(path, scon);
+
+		    if (conrc == 0 || (conrc < 0 && errno == EOPNOTSUPP))
+			rc = RPMRC_OK;
+
+		    rpmlog(loglvl(rc != RPMRC_OK), "lsetfilecon: (%s, %s) %s\n",
+			   path, scon, (conrc < 0 ? strerror(errno) : ""));
+		}
+		freecon(ocon);
+	    } else {
+		/* No context for dest is not our headache */
 		rc = RPMRC_OK;
+	    }
 	}
     } else {
 	rc = RPMRC_OK;
@@ -191,4 +283,5 @@ struct rpmPluginHooks_s selinux_hooks = {
     .psm_pre = selinux_psm_pre,
     .scriptlet_fork_post = selinux_scriptlet_fork_post,
     .fsm_file_prepare = selinux_fsm_file_prepare,
+    .fsm_files_pre = selinux_fsm_files_pre,
 };
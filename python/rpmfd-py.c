@@ -228,41 +228,105 @@ static PyObject *rpmfd_tell(rpmfdObject *s)
 static PyObject *rpmfd_read(rpmfdObject *s, PyObject *args, PyObject *kwds)
 {
     char *kwlist[] = { "size", NULL };
-    char buf[BUFSIZ];
-    ssize_t chunksize = sizeof(buf);
     ssize_t left = -1;
     ssize_t nb = 0;
+    Py_ssize_t alloced, total = 0;
     PyObject *res = NULL;
-    
+
     if (!PyArg_ParseTupleAndKeywords(args, kwds, "|l", kwlist, &left))
 	return NULL;
 
     if (s->fd == NULL) return err_closed();
 
-    /* ConcatAndDel() doesn't work on NULL string, meh */
-    res = PyBytes_FromStringAndSize(NULL, 0);
+    /* Read directly into the result object, grow on unbounded reads */
+    alloced = (left >= 0) ? left : BUFSIZ;
+    if ((res = PyBytes_FromStringAndSize(NULL, alloced)) == NULL)
+	return NULL;
+
     do {
-	if (left >= 0 && left < chunksize)
-	    chunksize = left;
+	ssize_t chunksize;
+	char *buf;
 
-	Py_BEGIN_ALLOW_THREADS 
+	if (left < 0 && alloced - total < BUFSIZ) {
+	    alloced += alloced / 2;
+	    if (_PyBytes_Resize(&res, alloced) < 0)
+		return NULL;
+	}
+	if ((chunksize = alloced - total) == 0)
+	    break;
+	buf = PyBytes_AS_STRING(res) + total;
+
+	Py_BEGIN_ALLOW_THREADS
 	nb = Fread(buf, 1, chunksize, s->fd);
-	Py_END_ALLOW_THREADS 
+	Py_END_ALLOW_THREADS
 
-	if (nb > 0) {
-	    PyObject *tmp = PyBytes_FromStringAndSize(buf, nb);
-	    PyBytes_ConcatAndDel(&res, tmp);
-	    left -= nb;
-	}
+	if (nb > 0)
+	    total += nb;
     } while (nb > 0);
 
     if (Ferror(s->fd)) {
 	PyErr_SetString(PyExc_IOError, Fstrerror(s->fd));
 	Py_XDECREF(res);
 	return NULL;
-    } else {
-	return res;
     }
+    if (total != alloced && _PyBytes_Resize(&res, total) < 0)
+	return NULL;
+    return res;
+}
+
+static PyObject *rpmfd_readinto(rpmfdObject *s, PyObject *args, PyObject *kwds)
+{
+    char *kwlist[] = { "buffer", NULL };
+    Py_buffer pybuf;
+    ssize_t nb;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "w*", kwlist, &pybuf))
+	return NULL;
+
+    if (s->fd == NULL) {
+	PyBuffer_Release(&pybuf);
+	return err_closed();
+    }
+
+    Py_BEGIN_ALLOW_THREADS
+    nb = Fread(pybuf.buf, 1, pybuf.len, s->fd);
+    Py_END_ALLOW_THREADS
+
+    PyBuffer_Release(&pybuf);
+
+    if (Ferror(s->fd)) {
+	PyErr_SetString(PyExc_IOError, Fstrerror(s->fd));
+	return NULL;
+    }
+    return Py_BuildValue("n", nb);
+}
+
+static PyObject *rpmfd_copyto(rpmfdObject *s, PyObject *args, PyObject *kwds)
+{
+    char *kwlist[] = { "out", NULL };
+    PyObject *fo = NULL;
+    rpmfdObject *fdo = NULL;
+    off_t nb;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "O", kwlist, &fo))
+	return NULL;
+
+    if (s->fd == NULL) return err_closed();
+
+    if (!rpmfdFromPyObject(fo, &fdo))
+	return NULL;
+
+    Py_BEGIN_ALLOW_THREADS
+    nb = ufdCopy(s->fd, fdo->fd);
+    Py_END_ALLOW_THREADS
+
+    Py_DECREF(fdo);
+
+    if (nb == -1 || Ferror(s->fd)) {
+	PyErr_SetString(PyExc_IOError, Fstrerror(s->fd));
+	return NULL;
+    }
+    return Py_BuildValue("L", (long long)nb);
 }
 
 static PyObject *rpmfd_write(rpmfdObject *s, PyObject *args, PyObject *kwds)
@@ -305,6 +369,10 @@ static struct PyMethodDef rpmfd_methods[] = {
 	NULL },
     { "read",	(PyCFunction) rpmfd_read,	METH_VARARGS|METH_KEYWORDS,
 	NULL },
+    { "readinto", (PyCFunction) rpmfd_readinto,	METH_VARARGS|METH_KEYWORDS,
+	NULL },
+    { "copyto",	(PyCFunction) rpmfd_copyto,	METH_VARARGS|METH_KEYWORDS,
+	NULL },
     { "seek",	(PyCFunction) rpmfd_seek,	METH_VARARGS|METH_KEYWORDS,
 	NULL },
     { "tell",	(PyCFunction) rpmfd_tell,	METH_NOARGS,
@@ -1,5 +1,7 @@
 #include "rpmsystem-py.h"
 
+#include <pthread.h>
+
 #include <rpm/rpmdb.h>
 #include <rpm/header.h>
 
@@ -64,18 +66,137 @@ struct rpmmiObject_s {
     PyObject *md_dict;		/*!< to look like PyModuleObject */
     PyObject *ref;		/* for db/ts refcounting */
     rpmdbMatchIterator mi;
+    int pfdepth;		/* requested prefetch depth (0 disables) */
+    int pfrunning;
+    int pfstop;
+    int pfeof;
+    int pfhead;
+    int pfcount;
+    Header *pfqueue;
+    pthread_t pfthread;
+    pthread_mutex_t pflock;
+    pthread_cond_t pffill;
+    pthread_cond_t pfdrain;
 } ;
 
+/*
+ * Prefetch thread: pull headers from the match iterator (db reads and
+ * header imports happen here, no Python API involved) into a bounded
+ * queue so the consuming Python thread overlaps its own processing
+ * with the database I/O. Owns the iterator cursor while running.
+ */
+static void *rpmmi_prefetch_thread(void *arg)
+{
+    rpmmiObject *s = arg;
+    Header h;
+
+    while ((h = rpmdbNextIterator(s->mi)) != NULL) {
+	headerLink(h);
+
+	pthread_mutex_lock(&s->pflock);
+	while (s->pfcount == s->pfdepth && !s->pfstop)
+	    pthread_cond_wait(&s->pffill, &s->pflock);
+	if (s->pfstop) {
+	    pthread_mutex_unlock(&s->pflock);
+	    headerFree(h);
+	    return NULL;
+	}
+	s->pfqueue[(s->pfhead + s->pfcount) % s->pfdepth] = h;
+	s->pfcount++;
+	pthread_cond_signal(&s->pfdrain);
+	pthread_mutex_unlock(&s->pflock);
+    }
+
+    pthread_mutex_lock(&s->pflock);
+    s->pfeof = 1;
+    pthread_cond_signal(&s->pfdrain);
+    pthread_mutex_unlock(&s->pflock);
+    return NULL;
+}
+
+static void rpmmi_prefetch_start(rpmmiObject *s)
+{
+    s->pfqueue = PyMem_Calloc(s->pfdepth, sizeof(*s->pfqueue));
+    if (s->pfqueue == NULL)
+	return;
+    pthread_mutex_init(&s->pflock, NULL);
+    pthread_cond_init(&s->pffill, NULL);
+    pthread_cond_init(&s->pfdrain, NULL);
+    if (pthread_create(&s->pfthread, NULL, rpmmi_prefetch_thread, s) == 0) {
+	s->pfrunning = 1;
+    } else {
+	pthread_cond_destroy(&s->pfdrain);
+	pthread_cond_destroy(&s->pffill);
+	pthread_mutex_destroy(&s->pflock);
+	PyMem_Free(s->pfqueue);
+	s->pfqueue = NULL;
+    }
+}
+
+static void rpmmi_prefetch_stop(rpmmiObject *s)
+{
+    if (s->pfrunning) {
+	pthread_mutex_lock(&s->pflock);
+	s->pfstop = 1;
+	pthread_cond_signal(&s->pffill);
+	pthread_mutex_unlock(&s->pflock);
+	pthread_join(s->pfthread, NULL);
+
+	while (s->pfcount > 0) {
+	    headerFree(s->pfqueue[s->pfhead]);
+	    s->pfhead = (s->pfhead + 1) % s->pfdepth;
+	    s->pfcount--;
+	}
+	pthread_cond_destroy(&s->pfdrain);
+	pthread_cond_destroy(&s->pffill);
+	pthread_mutex_destroy(&s->pflock);
+	PyMem_Free(s->pfqueue);
+	s->pfqueue = NULL;
+	s->pfrunning = 0;
+	s->pfstop = 0;
+	s->pfeof = 0;
+    }
+    s->pfdepth = 0;
+}
+
 static PyObject *
 rpmmi_iternext(rpmmiObject * s)
 {
-    Header h;
+    Header h = NULL;
+
+    if (s->mi == NULL)
+	return NULL;
+
+    if (s->pfdepth > 1 && !s->pfrunning && !s->pfeof)
+	rpmmi_prefetch_start(s);
 
-    if (s->mi == NULL || (h = rpmdbNextIterator(s->mi)) == NULL) {
+    if (s->pfrunning) {
+	Py_BEGIN_ALLOW_THREADS
+	pthread_mutex_lock(&s->pflock);
+	while (s->pfcount == 0 && !s->pfeof)
+	    pthread_cond_wait(&s->pfdrain, &s->pflock);
+	if (s->pfcount > 0) {
+	    h = s->pfqueue[s->pfhead];
+	    s->pfhead = (s->pfhead + 1) % s->pfdepth;
+	    s->pfcount--;
+	    pthread_cond_signal(&s->pffill);
+	}
+	pthread_mutex_unlock(&s->pflock);
+	Py_END_ALLOW_THREADS
+	if (h == NULL)
+	    rpmmi_prefetch_stop(s);
+    } else {
+	Py_BEGIN_ALLOW_THREADS
+	h = rpmdbNextIterator(s->mi);
+	Py_END_ALLOW_THREADS
+	if (h != NULL)
+	    headerLink(h);
+    }
+
+    if (h == NULL) {
 	s->mi = rpmdbFreeIterator(s->mi);
 	return NULL;
     }
-    headerLink(h);
     return hdr_Wrap(&hdr_Type, h);
 }
 
@@ -114,6 +235,25 @@ rpmmi_Pattern(rpmmiObject * s, PyObject * args, PyObject * kwds)
     Py_RETURN_NONE;
 }
 
+static PyObject *
+rpmmi_Prefetch(rpmmiObject * s, PyObject * args, PyObject * kwds)
+{
+    int depth = 8;
+    char * kwlist[] = {"depth", NULL};
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "|i:Prefetch", kwlist,
+	    &depth))
+	return NULL;
+
+    if (s->pfrunning) {
+	PyErr_SetString(PyExc_ValueError, "iteration already in progress");
+	return NULL;
+    }
+    s->pfdepth = (depth > 1) ? depth : 0;
+
+    Py_RETURN_NONE;
+}
+
 static struct PyMethodDef rpmmi_methods[] = {
     {"instance",    (PyCFunction) rpmmi_Instance,	METH_NOARGS,
      "mi.instance() -- Return the number (db key) of the current header."},
@@ -122,11 +262,18 @@ static struct PyMethodDef rpmmi_methods[] = {
     {"pattern",	    (PyCFunction) rpmmi_Pattern,	METH_VARARGS|METH_KEYWORDS,
 "mi.pattern(TagN, mire_type, pattern)\n\
 - Set a secondary match pattern on tags from retrieved header.\n" },
+    {"prefetch",    (PyCFunction) rpmmi_Prefetch,	METH_VARARGS|METH_KEYWORDS,
+"mi.prefetch(depth=8)\n\
+- Read and import up to depth headers ahead on a background thread\n\
+  (started on the first next()), overlapping database I/O with the\n\
+  consumer's own processing. Call before iterating, after any\n\
+  pattern() calls; depth <= 1 disables prefetching.\n" },
     {NULL,		NULL}		/* sentinel */
 };
 
 static void rpmmi_dealloc(rpmmiObject * s)
 {
+    rpmmi_prefetch_stop(s);
     s->mi = rpmdbFreeIterator(s->mi);
     Py_DECREF(s->ref);
     Py_TYPE(s)->tp_free((PyObject *)s);
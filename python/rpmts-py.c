@@ -15,6 +15,7 @@
 #include "rpmfi-py.h"	/* XXX for rpmfiNew */
 #include "rpmmi-py.h"
 #include "rpmii-py.h"
+#include "rpmtd-py.h"
 #include "rpmps-py.h"
 #include "rpmte-py.h"
 #include "rpmts-py.h"
@@ -699,6 +700,179 @@ exit:
     Py_XDECREF(str);
     return mio;
 }
+
+static PyObject *
+rpmts_dbBatch(rpmtsObject * s, PyObject * args, PyObject * kwds)
+{
+    PyObject *Tags = NULL;
+    PyObject *Key = NULL;
+    PyObject *str = NULL;
+    PyObject *result = NULL;
+    PyObject **cols = NULL;
+    PyObject **arenas = NULL;
+    rpmTagVal *tagv = NULL;
+    rpmdbMatchIterator mi = NULL;
+    Header h;
+    char *key = NULL;
+/* XXX lkey *must* be a 32 bit integer, int "works" on all known platforms. */
+    int lkey = 0;
+    int len = 0;
+    rpmDbiTagVal tag = RPMDBI_PACKAGES;
+    Py_ssize_t ntags;
+    char * kwlist[] = {"tags", "tagNumber", "key", NULL};
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "O|O&O:dbBatch", kwlist,
+	    &Tags, tagNumFromPyObject, &tag, &Key))
+	return NULL;
+
+    Tags = PySequence_Fast(Tags, "dbBatch: tags must be a sequence");
+    if (Tags == NULL)
+	return NULL;
+    ntags = PySequence_Fast_GET_SIZE(Tags);
+
+    if (Key) {
+	if (PyLong_Check(Key)) {
+	    lkey = PyLong_AsLong(Key);
+	    key = (char *)&lkey;
+	    len = sizeof(lkey);
+	} else if (utf8FromPyObject(Key, &str)) {
+	    key = PyBytes_AsString(str);
+	    len = PyBytes_Size(str);
+	} else {
+	    PyErr_SetString(PyExc_TypeError, "unknown key type");
+	    goto exit;
+	}
+	/* One of the conversions above failed, exception is set already */
+	if (PyErr_Occurred()) goto exit;
+    }
+
+    /* XXX If not already opened, open the database O_RDONLY now. */
+    if (rpmtsGetRdb(s->ts) == NULL) {
+	int rc = rpmtsOpenDB(s->ts, O_RDONLY);
+	if (rc || rpmtsGetRdb(s->ts) == NULL) {
+	    PyErr_SetString(pyrpmError, "rpmdb open failed");
+	    goto exit;
+	}
+    }
+
+    tagv = PyMem_Calloc(ntags ? ntags : 1, sizeof(*tagv));
+    cols = PyMem_Calloc(ntags ? ntags : 1, sizeof(*cols));
+    arenas = PyMem_Calloc(ntags ? ntags : 1, sizeof(*arenas));
+    if (tagv == NULL || cols == NULL || arenas == NULL) {
+	PyErr_NoMemory();
+	goto err;
+    }
+    for (Py_ssize_t i = 0; i < ntags; i++) {
+	if (!tagNumFromPyObject(PySequence_Fast_GET_ITEM(Tags, i), &tagv[i]))
+	    goto err;
+	if ((cols[i] = PyList_New(0)) == NULL)
+	    goto err;
+    }
+
+    mi = rpmtsInitIterator(s->ts, tag, key, len);
+
+    /* One pass over the iterator, appending each tag to its column */
+    while (mi != NULL && (h = rpmdbNextIterator(mi)) != NULL) {
+	for (Py_ssize_t i = 0; i < ntags; i++) {
+	    struct rpmtd_s td;
+	    PyObject *val = NULL;
+	    int rc;
+
+	    (void) headerGet(h, tagv[i], &td, HEADERGET_EXT);
+	    if (rpmtdGetFlags(&td) & RPMTD_INVALID) {
+		rpmtdFreeData(&td);
+		PyErr_SetString(pyrpmError, "invalid header data");
+		goto err;
+	    }
+	    if (rpmtdCount(&td) > 0 && rpmtdClass(&td) == RPM_BINARY_CLASS) {
+		/*
+		 * Pack binary data into a per-tag arena, remember the
+		 * location and hand out memoryview slices afterwards:
+		 * one buffer instead of a bytes object per header.
+		 */
+		Py_ssize_t off, blen = rpmtdCount(&td);
+		if (arenas[i] == NULL &&
+		    (arenas[i] = PyByteArray_FromStringAndSize(NULL, 0)) == NULL) {
+		    rpmtdFreeData(&td);
+		    goto err;
+		}
+		off = PyByteArray_GET_SIZE(arenas[i]);
+		if (PyByteArray_Resize(arenas[i], off + blen) < 0) {
+		    rpmtdFreeData(&td);
+		    goto err;
+		}
+		memcpy(PyByteArray_AS_STRING(arenas[i]) + off, td.data, blen);
+		val = Py_BuildValue("(nn)", off, blen);
+	    } else {
+		/* rpmtd_AsPyobj() knows how to handle empty containers */
+		val = rpmtd_AsPyobj(&td);
+	    }
+	    rpmtdFreeData(&td);
+	    if (val == NULL)
+		goto err;
+	    rc = PyList_Append(cols[i], val);
+	    Py_DECREF(val);
+	    if (rc < 0)
+		goto err;
+	}
+    }
+
+    /* Replace deferred (offset, length) pairs with zero-copy views */
+    for (Py_ssize_t i = 0; i < ntags; i++) {
+	PyObject *base;
+	if (arenas[i] == NULL)
+	    continue;
+	if ((base = PyMemoryView_FromObject(arenas[i])) == NULL)
+	    goto err;
+	for (Py_ssize_t j = 0; j < PyList_GET_SIZE(cols[i]); j++) {
+	    PyObject *item = PyList_GET_ITEM(cols[i], j);
+	    PyObject *slice = NULL, *view;
+	    if (!PyTuple_Check(item))
+		continue;	/* tag missing from this header */
+	    PyObject *stop = PyNumber_Add(PyTuple_GET_ITEM(item, 0),
+					  PyTuple_GET_ITEM(item, 1));
+	    if (stop) {
+		slice = PySlice_New(PyTuple_GET_ITEM(item, 0), stop, NULL);
+		Py_DECREF(stop);
+	    }
+	    view = slice ? PyObject_GetItem(base, slice) : NULL;
+	    Py_XDECREF(slice);
+	    if (view == NULL || PyList_SetItem(cols[i], j, view) < 0) {
+		Py_XDECREF(view);
+		Py_DECREF(base);
+		goto err;
+	    }
+	}
+	Py_DECREF(base);
+    }
+
+    if ((result = PyDict_New()) == NULL)
+	goto err;
+    for (Py_ssize_t i = 0; i < ntags; i++) {
+	if (PyDict_SetItem(result, PySequence_Fast_GET_ITEM(Tags, i),
+			   cols[i]) < 0) {
+	    Py_CLEAR(result);
+	    goto err;
+	}
+    }
+
+err:
+    if (mi != NULL)
+	rpmdbFreeIterator(mi);
+    for (Py_ssize_t i = 0; cols && i < ntags; i++) {
+	Py_XDECREF(cols[i]);
+	Py_XDECREF(arenas[i]);
+    }
+    PyMem_Free(tagv);
+    PyMem_Free(cols);
+    PyMem_Free(arenas);
+
+exit:
+    Py_XDECREF(str);
+    Py_DECREF(Tags);
+    return result;
+}
+
 static PyObject *
 rpmts_index(rpmtsObject * s, PyObject * args, PyObject * kwds)
 {
@@ -833,6 +1007,12 @@ Remove all elements from the transaction set\n" },
  {"dbMatch",	(PyCFunction) rpmts_Match,	METH_VARARGS|METH_KEYWORDS,
 "ts.dbMatch([TagN, [key]]) -> mi\n\
 - Create a match iterator for the default transaction rpmdb.\n" },
+ {"dbBatch",	(PyCFunction) rpmts_dbBatch,	METH_VARARGS|METH_KEYWORDS,
+"ts.dbBatch(tags, [TagN, [key]]) -> dict\n\
+- Query the default transaction rpmdb in a single pass, returning a\n\
+  column (one list entry per matching header) for each requested tag.\n\
+  Binary tag data is packed into one buffer per tag and returned as\n\
+  zero-copy memoryview slices.\n" },
  {"dbIndex",     (PyCFunction) rpmts_index,	METH_VARARGS|METH_KEYWORDS,
 "ts.dbIndex(TagN) -> ii\n\
 - Create a key iterator for the default transaction rpmdb.\n" },
@@ -1,12 +1,19 @@
 #include "system.h"
 
+#include <errno.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
 #include <rpm/rpmcli.h>
 #include <rpm/rpmlib.h>			/* RPMSIGTAG, rpmReadPackageFile .. */
+#include <rpm/rpmfileutil.h>
 #include <rpm/rpmlog.h>
+#include <rpm/rpmmacro.h>
 #include <rpm/rpmps.h>
 #include <rpm/rpmts.h>
 
 #include "cliutils.h"
+#include "rpmqd.h"
 
 #include "debug.h"
 
@@ -58,6 +65,162 @@ static struct poptOption optionsTable[] = {
    POPT_TABLEEND
 };
 
+static int qdWrite(int fd, const void *buf, size_t len)
+{
+    const char *p = buf;
+
+    while (len > 0) {
+	ssize_t w = write(fd, p, len);
+	if (w < 0) {
+	    if (errno == EINTR)
+		continue;
+	    return -1;
+	}
+	p += w;
+	len -= w;
+    }
+    return 0;
+}
+
+static int qdSendRec(int fd, int tag, const char *data)
+{
+    char hdr[32];
+    size_t len = data ? strlen(data) : 0;
+
+    snprintf(hdr, sizeof(hdr), "%c %zu\n", tag, len);
+    if (qdWrite(fd, hdr, strlen(hdr)))
+	return -1;
+    return (len > 0) ? qdWrite(fd, data, len) : 0;
+}
+
+static int qdReadLine(int fd, char *buf, size_t size)
+{
+    size_t n = 0;
+
+    while (n + 1 < size) {
+	ssize_t r = read(fd, buf + n, 1);
+	if (r <= 0) {
+	    if (r < 0 && errno == EINTR)
+		continue;
+	    return -1;
+	}
+	if (buf[n++] == '\n')
+	    break;
+    }
+    buf[n] = '\0';
+    return (n > 0 && buf[n-1] == '\n') ? 0 : -1;
+}
+
+/*
+ * Forward a simple database query to rpmqd(8) if one is listening on
+ * %_query_daemon_socket. Returns 1 with *ecp set when the daemon handled
+ * the query, 0 to run it in-process as usual.
+ */
+static int rpmqdForward(QVA_t qva, ARGV_const_t argv, int *ecp)
+{
+    char *path = rpmExpand("%{?_query_daemon_socket}", NULL);
+    struct sockaddr_un sun;
+    int sd = -1;
+    int ret = 0;
+    int printed = 0;
+
+    if (*path == '\0' || strlen(path) >= sizeof(sun.sun_path))
+	goto exit;
+
+    /* Only plain db label queries, anything fancier runs in-process */
+    if (qva->qva_source != RPMQV_ALL && qva->qva_source != RPMQV_PACKAGE)
+	goto exit;
+    if (qva->qva_flags || qva->qva_incattr || qva->qva_excattr)
+	goto exit;
+    if (rpmcliRootDir && !rstreq(rpmcliRootDir, "/"))
+	goto exit;
+    if (qva->qva_source == RPMQV_PACKAGE) {
+	if (argv == NULL)
+	    goto exit;
+	for (ARGV_const_t arg = argv; *arg; arg++) {
+	    if (strchr(*arg, '/') || rpmFileHasSuffix(*arg, ".rpm"))
+		goto exit;
+	}
+    }
+
+    if ((sd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0)
+	goto exit;
+    memset(&sun, 0, sizeof(sun));
+    sun.sun_family = AF_UNIX;
+    strcpy(sun.sun_path, path);
+    if (connect(sd, (struct sockaddr *)&sun, sizeof(sun)) < 0) {
+	rpmlog(RPMLOG_DEBUG, "rpmqd: connect %s: %s\n",
+		path, strerror(errno));
+	goto exit;
+    }
+
+    if (qdWrite(sd, RPMQD_GREETING "\n", strlen(RPMQD_GREETING) + 1))
+	goto broken;
+    if (qva->qva_queryFormat &&
+	    qdSendRec(sd, RPMQD_REC_FORMAT, qva->qva_queryFormat))
+	goto broken;
+    if (qva->qva_source == RPMQV_ALL) {
+	if (qdSendRec(sd, RPMQD_REC_ALL, NULL))
+	    goto broken;
+    } else {
+	for (ARGV_const_t arg = argv; *arg; arg++) {
+	    if (qdSendRec(sd, RPMQD_REC_NAME, *arg))
+		goto broken;
+	}
+    }
+    if (qdSendRec(sd, RPMQD_REC_GO, NULL))
+	goto broken;
+
+    for (;;) {
+	char hdr[64];
+	char tag;
+	long len;
+
+	if (qdReadLine(sd, hdr, sizeof(hdr)))
+	    goto broken;
+	if (sscanf(hdr, "%c %ld", &tag, &len) != 2 || len < 0)
+	    goto broken;
+	if (tag == RPMQD_REC_EXIT) {
+	    *ecp = len;
+	    ret = 1;
+	    break;
+	}
+	if (tag != RPMQD_REC_DATA && tag != RPMQD_REC_ERROR)
+	    goto broken;
+	while (len > 0) {
+	    char buf[BUFSIZ];
+	    ssize_t r = read(sd, buf,
+			(len > (long)sizeof(buf)) ? sizeof(buf) : len);
+	    if (r <= 0) {
+		if (r < 0 && errno == EINTR)
+		    continue;
+		goto broken;
+	    }
+	    fwrite(buf, 1, r, (tag == RPMQD_REC_DATA) ? stdout : stderr);
+	    printed = 1;
+	    len -= r;
+	}
+    }
+    goto exit;
+
+broken:
+    if (printed) {
+	/* Too late for a clean in-process fallback, partial output is out */
+	rpmlog(RPMLOG_ERR, _("lost connection to query daemon\n"));
+	*ecp = 1;
+	ret = 1;
+    } else {
+	rpmlog(RPMLOG_DEBUG, "rpmqd: daemon dropped request, "
+		"running query in-process\n");
+    }
+
+exit:
+    if (sd >= 0)
+	close(sd);
+    free(path);
+    return ret;
+}
+
 int main(int argc, char *argv[])
 {
     rpmts ts = NULL;
@@ -270,7 +433,12 @@ int main(int argc, char *argv[])
 	if (!poptPeekArg(optCon) && !(qva->qva_source == RPMQV_ALL))
 	    argerror(_("no arguments given for query"));
 
-	ec = rpmcliQuery(ts, qva, (ARGV_const_t) poptGetArgs(optCon));
+	{
+	    ARGV_const_t args = (ARGV_const_t) poptGetArgs(optCon);
+
+	    if (!rpmqdForward(qva, args, &ec))
+		ec = rpmcliQuery(ts, qva, args);
+	}
 	break;
 
     case MODE_VERIFY:
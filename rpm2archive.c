@@ -13,6 +13,11 @@
 #include <archive.h>
 #include <archive_entry.h>
 #include <unistd.h>
+#include <fnmatch.h>
+#include <pthread.h>
+#include <errno.h>
+
+#include <rpm/rpmmacro.h>
 
 #include "debug.h"
 
@@ -60,19 +65,158 @@ static void write_file_content(struct archive * a, char * buf, rpmfi fi)
     }
 }
 
-static int process_package(rpmts ts, char * filename)
+/*
+ * Selective extraction using the payload index tags: seek the raw fd
+ * to the compressed frame holding each wanted file, decompress just
+ * that part of the payload and copy the file data out.
+ */
+static int extract_indexed(FD_t fdi, off_t payloadStart, Header h,
+			   struct archive * a, struct archive_entry * entry,
+			   char * buf, const char * pattern)
+{
+    struct rpmtd_s frames, offsets;
+    rpmfiles files = NULL;
+    rpmfi fi = NULL;
+    int found = 0;
+    int rc = 0;
+
+    if (!headerGet(h, RPMTAG_PAYLOADFRAMEOFFSETS, &frames, HEADERGET_MINMEM) ||
+	!headerGet(h, RPMTAG_PAYLOADFILEOFFSETS, &offsets, HEADERGET_MINMEM))
+    {
+	fprintf(stderr, _("package has no payload index\n"));
+	rpmtdFreeData(&frames);
+	return -1;
+    }
+
+    files = rpmfilesNew(NULL, h, 0, RPMFI_KEEPHEADER);
+    fi = rpmfilesIter(files, RPMFI_ITER_FWD);
+
+    while (rc >= 0 && (rc = rpmfiNext(fi)) >= 0) {
+	char * fn = rstrscat(NULL, rpmfiDN(fi), rpmfiBN(fi), NULL);
+	int match = (fnmatch(pattern, fn, 0) == 0);
+	free(fn);
+	if (!match)
+	    continue;
+	found++;
+
+	fill_archive_entry(entry, fi);
+
+	rpm_mode_t mode = rpmfiFMode(fi);
+	uint64_t frameoff = UINT64_MAX, fileoff = UINT64_MAX;
+	rpmtdSetIndex(&frames, rpmfiFX(fi));
+	rpmtdSetIndex(&offsets, rpmfiFX(fi));
+	if (rpmtdGetUint64(&frames))
+	    frameoff = *rpmtdGetUint64(&frames);
+	if (rpmtdGetUint64(&offsets))
+	    fileoff = *rpmtdGetUint64(&offsets);
+
+	if (!(S_ISREG(mode) && rpmfiFSize(fi) > 0)) {
+	    archive_write_header(a, entry);
+	    continue;
+	}
+
+	if (frameoff == UINT64_MAX || fileoff == UINT64_MAX) {
+	    fprintf(stderr, _("file not present in payload index: %s%s\n"),
+		    rpmfiDN(fi), rpmfiBN(fi));
+	    rc = -1;
+	    break;
+	}
+
+	if (Fseek(fdi, payloadStart + frameoff, SEEK_SET) < 0) {
+	    fprintf(stderr, _("cannot seek in payload: %s\n"), Fstrerror(fdi));
+	    rc = -1;
+	    break;
+	}
+
+	FD_t zfd = Fdopen(fdDup(Fileno(fdi)), "r.zstdio");
+	if (zfd == NULL) {
+	    fprintf(stderr, _("cannot open payload frame: %s\n"),
+		    Fstrerror(zfd));
+	    rc = -1;
+	    break;
+	}
+
+	/* Skip to the file data within the frame */
+	rpm_loff_t left = fileoff;
+	while (left > 0) {
+	    size_t len = (left > BUFSIZE ? BUFSIZE : left);
+	    if (Fread(buf, 1, len, zfd) != len)
+		break;
+	    left -= len;
+	}
+
+	if (left == 0) {
+	    archive_write_header(a, entry);
+	    left = rpmfiFSize(fi);
+	    while (left > 0) {
+		size_t len = (left > BUFSIZE ? BUFSIZE : left);
+		if (Fread(buf, 1, len, zfd) != len)
+		    break;
+		archive_write_data(a, buf, len);
+		left -= len;
+	    }
+	}
+	if (left > 0) {
+	    fprintf(stderr, _("error reading file from rpm payload\n"));
+	    rc = -1;
+	}
+	Fclose(zfd);
+    }
+    if (rc == RPMERR_ITER_END)
+	rc = 0;
+
+    if (rc == 0 && found == 0) {
+	fprintf(stderr, _("no file matches %s\n"), pattern);
+	rc = -1;
+    }
+
+    rpmtdFreeData(&frames);
+    rpmtdFreeData(&offsets);
+    rpmfiFree(fi);
+    rpmfilesFree(files);
+    return rc;
+}
+
+static char * output_name(const char * filename, int compress)
+{
+    const char * suffix = compress ? ".tgz" : ".tar";
+
+    if (urlIsURL(filename)) {
+	const char * fname = strrchr(filename, '/');
+	if (fname != NULL) {
+	    fname++;
+	} else {
+	    fname = filename;
+	}
+	return rstrscat(NULL, fname, suffix, NULL);
+    }
+    return rstrscat(NULL, filename, suffix, NULL);
+}
+
+static int process_package(rpmts ts, char * filename, int compress,
+			   const char * pattern, int keep)
 {
     FD_t fdi;
     FD_t gzdi;
     Header h;
     int rc = 0;
     char * rpmio_flags = NULL;
+    char * outname = NULL;
+    char * tmpname = NULL;
     struct archive *a;
     struct archive_entry *entry;
 
     if (!strcmp(filename, "-")) {
 	fdi = fdDup(STDIN_FILENO);
     } else {
+	outname = output_name(filename, compress);
+	/* Conversion runs can resume: completed outputs are kept as is */
+	if (keep && access(outname, F_OK) == 0) {
+	    free(outname);
+	    return 0;
+	}
+	/* Write under a temporary name, only a complete archive is renamed */
+	tmpname = rstrscat(NULL, outname, ".part", NULL);
 	fdi = Fopen(filename, "r.ufdio");
     }
 
@@ -101,25 +245,33 @@ static int process_package(rpmts ts, char * filename)
     }
 
 
-    /* Retrieve payload size and compression type. */
-    {	const char *compr = headerGetString(h, RPMTAG_PAYLOADCOMPRESSOR);
+    /* Selective extraction seeks around the raw fd, don't wrap it */
+    off_t payloadStart = Ftell(fdi);
+    rpmfiles files = NULL;
+    rpmfi fi = NULL;
+
+    if (pattern == NULL) {
+	/* Retrieve payload size and compression type. */
+	const char *compr = headerGetString(h, RPMTAG_PAYLOADCOMPRESSOR);
 	rpmio_flags = rstrscat(NULL, "r.", compr ? compr : "gzip", NULL);
-    }
 
-    gzdi = Fdopen(fdi, rpmio_flags);	/* XXX gzdi == fdi */
-    free(rpmio_flags);
+	gzdi = Fdopen(fdi, rpmio_flags);	/* XXX gzdi == fdi */
+	free(rpmio_flags);
 
-    if (gzdi == NULL) {
-	fprintf(stderr, _("cannot re-open payload: %s\n"), Fstrerror(gzdi));
-	exit(EXIT_FAILURE);
-    }
+	if (gzdi == NULL) {
+	    fprintf(stderr, _("cannot re-open payload: %s\n"), Fstrerror(gzdi));
+	    exit(EXIT_FAILURE);
+	}
 
-    rpmfiles files = rpmfilesNew(NULL, h, 0, RPMFI_KEEPHEADER);
-    rpmfi fi = rpmfiNewArchiveReader(gzdi, files, RPMFI_ITER_READ_ARCHIVE_CONTENT_FIRST);
+	files = rpmfilesNew(NULL, h, 0, RPMFI_KEEPHEADER);
+	fi = rpmfiNewArchiveReader(gzdi, files, RPMFI_ITER_READ_ARCHIVE_CONTENT_FIRST);
+    } else {
+	gzdi = fdi;
+    }
 
     /* create archive */
     a = archive_write_new();
-    if (archive_write_add_filter_gzip(a) != ARCHIVE_OK) {
+    if (compress && archive_write_add_filter_gzip(a) != ARCHIVE_OK) {
 	fprintf(stderr, "Error: Could not create gzip output filter\n");
 	exit(EXIT_FAILURE);
     }
@@ -134,23 +286,10 @@ static int process_package(rpmts ts, char * filename)
 	}
 	archive_write_open_fd(a, STDOUT_FILENO);
     } else {
-	char * outname;
-	if (urlIsURL(filename)) {
-	    const char * fname = strrchr(filename, '/');
-	    if (fname != NULL) {
-		fname++;
-	    } else {
-		fname = filename;
-	    }
-	    outname = rstrscat(NULL, fname, ".tgz", NULL);
-	} else {
-	    outname = rstrscat(NULL, filename, ".tgz", NULL);
-	}
-	if (archive_write_open_filename(a, outname) != ARCHIVE_OK) {
-	    fprintf(stderr, "Error: Can't open output file: %s\n", outname);
+	if (archive_write_open_filename(a, tmpname) != ARCHIVE_OK) {
+	    fprintf(stderr, "Error: Can't open output file: %s\n", tmpname);
 	    exit(EXIT_FAILURE);
 	}
-	_free(outname);
     }
 
     entry = archive_entry_new();
@@ -158,6 +297,11 @@ static int process_package(rpmts ts, char * filename)
     char * buf = xmalloc(BUFSIZE);
     char * hardlink = NULL;
 
+    if (pattern != NULL) {
+	rc = extract_indexed(fdi, payloadStart, h, a, entry, buf, pattern);
+	goto cleanup;
+    }
+
     rc = 0;
     while (rc >= 0) {
 	rc = rpmfiNext(fi);
@@ -190,12 +334,26 @@ static int process_package(rpmts ts, char * filename)
 	rc = 0;
     }
 
+cleanup:
     _free(hardlink);
 
     Fclose(gzdi);	/* XXX gzdi == fdi */
     archive_entry_free(entry);
     archive_write_close(a);
     archive_write_free(a);
+    if (tmpname) {
+	if (rc == 0) {
+	    if (rename(tmpname, outname)) {
+		fprintf(stderr, "Error: Can't rename %s: %s\n",
+			tmpname, strerror(errno));
+		rc = -1;
+	    }
+	} else {
+	    unlink(tmpname);
+	}
+    }
+    free(outname);
+    free(tmpname);
     buf = _free(buf);
     rpmfilesFree(files);
     rpmfiFree(fi);
@@ -203,37 +361,128 @@ static int process_package(rpmts ts, char * filename)
     return rc;
 }
 
+/* XXX retain the ageless behavior of rpm2cpio */
+static rpmts create_ts(void)
+{
+    rpmts ts = rpmtsCreate();
+    rpmVSFlags vsflags = 0;
+
+    vsflags |= RPMVSF_MASK_NODIGESTS;
+    vsflags |= RPMVSF_MASK_NOSIGNATURES;
+    vsflags |= RPMVSF_NOHDRCHK;
+    (void) rpmtsSetVSFlags(ts, vsflags);
+    return ts;
+}
+
+struct job_s {
+    char ** argv;
+    int count;
+    int next;
+    int nfail;
+    int compress;
+    int keep;
+    const char * pattern;
+    pthread_mutex_t lock;
+};
+
+static void * convertWorker(void * data)
+{
+    struct job_s * job = data;
+    rpmts ts = create_ts();
+
+    while (1) {
+	char * fn;
+
+	pthread_mutex_lock(&job->lock);
+	fn = (job->next < job->count) ? job->argv[job->next++] : NULL;
+	pthread_mutex_unlock(&job->lock);
+	if (fn == NULL)
+	    break;
+
+	if (process_package(ts, fn, job->compress, job->pattern, job->keep)) {
+	    pthread_mutex_lock(&job->lock);
+	    job->nfail++;
+	    pthread_mutex_unlock(&job->lock);
+	}
+    }
+    rpmtsFree(ts);
+    return NULL;
+}
+
 int main(int argc, char *argv[])
 {
-    int rc = 0, i;
+    int rc = 0, i = 1;
+    int compress = 1;
+    int keep = 0;
+    int nthreads = 0;
+    const char * pattern = NULL;
 
     xsetprogname(argv[0]);	/* Portability call -- see system.h */
     rpmReadConfigFiles(NULL, NULL);
 
     if (argc > 1 && (rstreq(argv[1], "-h") || rstreq(argv[1], "--help"))) {
-	fprintf(stderr, "Usage: %s [file.rpm ...]\n", argv[0]);
+	fprintf(stderr, "Usage: %s [-n|--nocompression] "
+		"[-e|--extract PATTERN] [-j|--jobs N] [-k|--keep-existing] "
+		"[file.rpm ...]\n",
+		argv[0]);
 	exit(EXIT_FAILURE);
     }
 
-    if (argc == 1)
-	argv[argc++] = "-";	/* abuse NULL pointer at the end of argv */
+    if (argc > 1 && (rstreq(argv[1], "-n") || rstreq(argv[1], "--nocompression"))) {
+	compress = 0;
+	i++;
+    }
 
-    rpmts ts = rpmtsCreate();
-    rpmVSFlags vsflags = 0;
+    if (argc > i + 1 && (rstreq(argv[i], "-e") || rstreq(argv[i], "--extract"))) {
+	pattern = argv[i + 1];
+	i += 2;
+    }
 
-    /* XXX retain the ageless behavior of rpm2cpio */
-    vsflags |= RPMVSF_MASK_NODIGESTS;
-    vsflags |= RPMVSF_MASK_NOSIGNATURES;
-    vsflags |= RPMVSF_NOHDRCHK;
-    (void) rpmtsSetVSFlags(ts, vsflags);
+    nthreads = rpmExpandNumeric("%{?_rpm2archive_threads}");
+    if (argc > i + 1 && (rstreq(argv[i], "-j") || rstreq(argv[i], "--jobs"))) {
+	nthreads = atoi(argv[i + 1]);
+	i += 2;
+    }
 
-    for (i = 1; i < argc; i++) {
+    if (argc > i && (rstreq(argv[i], "-k") || rstreq(argv[i], "--keep-existing"))) {
+	keep = 1;
+	i++;
+    }
+
+    if (argc == i)
+	argv[argc++] = "-";	/* abuse NULL pointer at the end of argv */
 
-	rc = process_package(ts, argv[i]);
-	if (rc != 0)
-	    return rc;
+    /* Converting from stdin interleaves with stdout, keep that serial */
+    for (int j = i; j < argc; j++) {
+	if (rstreq(argv[j], "-"))
+	    nthreads = 1;
     }
+    if (nthreads > argc - i)
+	nthreads = argc - i;
+
+    if (nthreads > 1) {
+	struct job_s job = {
+	    argv + i, argc - i, 0, 0, compress, keep, pattern,
+	    PTHREAD_MUTEX_INITIALIZER,
+	};
+	pthread_t *tids = xcalloc(nthreads, sizeof(*tids));
+
+	for (int t = 0; t < nthreads; t++)
+	    pthread_create(&tids[t], NULL, convertWorker, &job);
+	for (int t = 0; t < nthreads; t++)
+	    pthread_join(tids[t], NULL);
+
+	free(tids);
+	rc = (job.nfail > 0) ? 1 : 0;
+    } else {
+	rpmts ts = create_ts();
 
-    (void) rpmtsFree(ts);
+	for (; i < argc; i++) {
+	    rc = process_package(ts, argv[i], compress, pattern, keep);
+	    if (rc != 0)
+		return rc;
+	}
+	(void) rpmtsFree(ts);
+    }
     return rc;
 }
@@ -18,25 +18,31 @@ int main(int argc, char *argv[])
     Header h;
     char * rpmio_flags = NULL;
     int rc;
+    int raw = 0;
+    int ai = 1;
     off_t payload_size;
     FD_t gzdi;
-    
+
     xsetprogname(argv[0]); /* Portability call -- see system.h */
 
     rpmReadConfigFiles(NULL, NULL);
-    if (argc == 1)
+    if (argc > ai && rstreq(argv[ai], "--raw")) {
+	raw = 1;
+	ai++;
+    }
+    if (argc <= ai)
 	fdi = fdDup(STDIN_FILENO);
     else {
-	if (rstreq(argv[1], "-h") || rstreq(argv[1], "--help")) {
-	    fprintf(stderr, "Usage: rpm2cpio file.rpm\n");
+	if (rstreq(argv[ai], "-h") || rstreq(argv[ai], "--help")) {
+	    fprintf(stderr, "Usage: rpm2cpio [--raw] file.rpm\n");
 	    exit(EXIT_FAILURE);
 	}
-	fdi = Fopen(argv[1], "r.ufdio");
+	fdi = Fopen(argv[ai], "r.ufdio");
     }
 
     if (Ferror(fdi)) {
 	fprintf(stderr, "%s: %s: %s\n", argv[0],
-		(argc == 1 ? "<stdin>" : argv[1]), Fstrerror(fdi));
+		(argc <= ai ? "<stdin>" : argv[ai]), Fstrerror(fdi));
 	exit(EXIT_FAILURE);
     }
     if (isatty(STDOUT_FILENO)) {
@@ -80,6 +86,19 @@ int main(int argc, char *argv[])
 	exit(EXIT_FAILURE);
     }
 
+    /*
+     * Raw mode: pass the payload through exactly as stored, compression
+     * and all. The descriptor sits right after the header here, so the
+     * remaining bytes can be moved without decoding them (in-kernel
+     * when the system supports it, see ufdCopy()).
+     */
+    if (raw) {
+	rc = (ufdCopy(fdi, fdo) >= 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+	Fclose(fdo);
+	Fclose(fdi);
+	return rc;
+    }
+
     /* Retrieve payload size and compression type. */
     {	const char *compr = headerGetString(h, RPMTAG_PAYLOADCOMPRESSOR);
 	rpmio_flags = rstrscat(NULL, "r.", compr ? compr : "gzip", NULL);
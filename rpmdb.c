@@ -1,5 +1,6 @@
 #include "system.h"
 
+#include <fcntl.h>
 #include <popt.h>
 #include <rpm/rpmcli.h>
 #include <rpm/rpmdb.h>
@@ -53,13 +54,9 @@ static int exportDB(rpmts ts)
     rpmtxn txn = rpmtxnBegin(ts, RPMTXN_READ);
     int rc = 0;
 
-    if (txn && fd) {
-	Header h;
-	rpmdbMatchIterator mi = rpmtsInitIterator(ts, RPMDBI_PACKAGES, NULL, 0);
-	while ((h = rpmdbNextIterator(mi))) {
-	    rc += headerWrite(fd, h, HEADER_MAGIC_YES);
-	}
-	rpmdbFreeIterator(mi);
+    if (txn && fd && rpmtsOpenDB(ts, O_RDONLY) == 0) {
+	/* stream blobs straight from the db, no header round trip */
+	rc = rpmdbExportToFd(rpmtsGetRdb(ts), fd);
     } else {
 	rc = -1;
     }
@@ -75,11 +72,9 @@ static int importDB(rpmts ts)
     rpmtxn txn = rpmtxnBegin(ts, RPMTXN_WRITE);
     int rc = 0;
 
-    if (txn && fd) {
-	Header h;
-	while ((h = headerRead(fd, HEADER_MAGIC_YES))) {
-	    rc += rpmtsImportHeader(txn, h, 0);
-	}
+    if (txn && fd && rpmtsOpenDB(ts, (O_RDWR|O_CREAT)) == 0) {
+	/* bulk-loads on an empty db, one index pass instead of n */
+	rc = rpmdbImportFromFd(rpmtsGetRdb(ts), fd);
     } else {
 	rc = -1;
     }
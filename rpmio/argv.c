@@ -5,11 +5,35 @@
 #include "system.h"
 
 #include <stdlib.h>
+#ifdef HAVE_MALLOC_USABLE_SIZE
+#include <malloc.h>
+#endif
 #include <rpm/argv.h>
 #include <rpm/rpmstring.h>
 
 #include "debug.h"
 
+/*
+ * Amortized growth for the bare NULL-terminated arrays: only move the
+ * block when the need crosses a power of two, and where the allocator
+ * can tell us the real block size, don't touch blocks with room to
+ * spare at all. The latter is what makes argvReserve() stick across
+ * subsequent adds - an ARGV_t carries no explicit capacity.
+ */
+static ARGV_t argvGrow(ARGV_t argv, int argc, int more)
+{
+    size_t need = (argc + more + 1) * sizeof(*argv);
+    size_t cap = 16 * sizeof(*argv);
+
+#ifdef HAVE_MALLOC_USABLE_SIZE
+    if (argv != NULL && malloc_usable_size(argv) >= need)
+	return argv;
+#endif
+    while (cap < need)
+	cap *= 2;
+    return xrealloc(argv, cap);
+}
+
 void argvPrint(const char * msg, ARGV_const_t argv, FILE * fp)
 {
     ARGV_const_t av;
@@ -141,7 +165,7 @@ int argvAddN(ARGV_t * argvp, const char *val, size_t len)
     if (argvp == NULL)
 	return -1;
     argc = argvCount(*argvp);
-    *argvp = xrealloc(*argvp, (argc + 1 + 1) * sizeof(**argvp));
+    *argvp = argvGrow(*argvp, argc, 1);
     argv = *argvp;
 
     argv[argc] = rstrndup(val, len);
@@ -149,6 +173,18 @@ int argvAddN(ARGV_t * argvp, const char *val, size_t len)
     return 0;
 }
 
+int argvReserve(ARGV_t * argvp, int n)
+{
+    int argc;
+
+    if (argvp == NULL || n <= 0)
+	return -1;
+    argc = argvCount(*argvp);
+    *argvp = argvGrow(*argvp, argc, n);
+    (*argvp)[argc] = NULL;
+    return 0;
+}
+
 int argvAddNum(ARGV_t *argvp, int val)
 {
     char *valstr = NULL;
@@ -166,7 +202,7 @@ int argvAppend(ARGV_t * argvp, ARGV_const_t av)
     int ac = argvCount(av);
     int i;
 
-    argv = xrealloc(argv, (argc + ac + 1) * sizeof(*argv));
+    argv = argvGrow(argv, argc, ac);
     for (i = 0; i < ac; i++)
 	argv[argc + i] = xstrdup(av[i]);
     argv[argc + ac] = NULL;
@@ -174,6 +210,21 @@ int argvAppend(ARGV_t * argvp, ARGV_const_t av)
     return 0;
 }
 
+int argvAppendN(ARGV_t * argvp, char * const * av, int ac)
+{
+    ARGV_t argv;
+    int argc;
+
+    if (argvp == NULL || ac < 0)
+	return -1;
+    argc = argvCount(*argvp);
+    argv = argvGrow(*argvp, argc, ac);
+    memcpy(argv + argc, av, ac * sizeof(*argv));
+    argv[argc + ac] = NULL;
+    *argvp = argv;
+    return 0;
+}
+
 ARGV_t argvSplitString(const char * str, const char * seps, argvFlags flags)
 {
     char *dest = NULL;
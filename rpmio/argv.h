@@ -134,6 +134,15 @@ int argvAdd(ARGV_t * argvp, const char *val);
  */
 int argvAddN(ARGV_t * argvp, const char *val, size_t len);
 
+/** \ingroup rpmargv
+ * Ensure an argv array has room for n more elements, so the adds or
+ * appends that follow need not reallocate.
+ * @param[out] *argvp	argv array
+ * @param n		no. of elements to make room for
+ * @return		0 on success, -1 on bad arguments
+ */
+int argvReserve(ARGV_t * argvp, int n);
+
 /** \ingroup rpmargv
  * Add a number to an argv array (converting to a string).
  * @param[out] *argvp	argv array
@@ -150,6 +159,18 @@ int argvAddNum(ARGV_t * argvp, int val);
  */
 int argvAppend(ARGV_t * argvp, ARGV_const_t av);
 
+/** \ingroup rpmargv
+ * Append a counted array of strings to an argv array, taking ownership
+ * of the strings instead of copying them. The caller remains
+ * responsible for av itself, but must not free or use its elements
+ * afterwards.
+ * @param[out] *argvp	argv array
+ * @param av		array of malloc'ed strings to append
+ * @param ac		no. of elements in av
+ * @return		0 on success, -1 on bad arguments
+ */
+int argvAppendN(ARGV_t * argvp, char * const * av, int ac);
+
 enum argvFlags_e {
     ARGV_NONE		= 0,
     ARGV_SKIPEMPTY	= (1 << 0),	/* omit empty strings from result */
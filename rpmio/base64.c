@@ -3,70 +3,66 @@
 
 #include <arpa/inet.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include <rpm/rpmbase64.h>
 
+static const char base64_encoding[] =
+	"ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
 
-static char base64_encode_value(char value_in)
-{
-	static const char encoding[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
-	if (value_in > 63) return '=';
-	return encoding[(int)value_in];
-}
+/* maps characters to their 6 bit value, -1 for invalid, -2 for '=' */
+static const signed char base64_decoding[256] = {
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 62, -1, -1, -1, 63,
+    52, 53, 54, 55, 56, 57, 58, 59, 60, 61, -1, -1, -1, -2, -1, -1,
+    -1,  0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12, 13, 14,
+    15, 16, 17, 18, 19, 20, 21, 22, 23, 24, 25, -1, -1, -1, -1, -1,
+    -1, 26, 27, 28, 29, 30, 31, 32, 33, 34, 35, 36, 37, 38, 39, 40,
+    41, 42, 43, 44, 45, 46, 47, 48, 49, 50, 51, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+};
 
 static char *base64_encode_block(const char *plaintext_in, int length_in, char *codechar)
 {
-	const char *plainchar = plaintext_in;
-	const char *const plaintextend = plaintext_in + length_in;
-	char result;
-	char fragment;
-	
-	while (1) {
-		if (plainchar == plaintextend) {
-			return codechar;
-		}
-		fragment = *plainchar++;
-		result = (fragment & 0x0fc) >> 2;
-		*codechar++ = base64_encode_value(result);
-		result = (fragment & 0x003) << 4;
-		if (plainchar == plaintextend)
-		{
-			*codechar++ = base64_encode_value(result);
-			*codechar++ = '=';
-			*codechar++ = '=';
-			return codechar;
-		}
-		fragment = *plainchar++;
-		result |= (fragment & 0x0f0) >> 4;
-		*codechar++ = base64_encode_value(result);
-		result = (fragment & 0x00f) << 2;
-		if (plainchar == plaintextend)
-		{
-			*codechar++ = base64_encode_value(result);
-			*codechar++ = '=';
-			return codechar;
-		}
-		fragment = *plainchar++;
-		result |= (fragment & 0x0c0) >> 6;
-		*codechar++ = base64_encode_value(result);
-		result  = (fragment & 0x03f) >> 0;
-		*codechar++ = base64_encode_value(result);
+	const unsigned char *plainchar = (const unsigned char *)plaintext_in;
+
+	/* three input bytes at a time, no per-character branches */
+	for (; length_in >= 3; length_in -= 3, plainchar += 3) {
+		unsigned int v = (plainchar[0] << 16) | (plainchar[1] << 8) |
+				  plainchar[2];
+		*codechar++ = base64_encoding[(v >> 18) & 0x3f];
+		*codechar++ = base64_encoding[(v >> 12) & 0x3f];
+		*codechar++ = base64_encoding[(v >>  6) & 0x3f];
+		*codechar++ = base64_encoding[ v        & 0x3f];
+	}
+	if (length_in == 1) {
+		*codechar++ = base64_encoding[(plainchar[0] >> 2) & 0x3f];
+		*codechar++ = base64_encoding[(plainchar[0] << 4) & 0x3f];
+		*codechar++ = '=';
+		*codechar++ = '=';
+	} else if (length_in == 2) {
+		unsigned int v = (plainchar[0] << 8) | plainchar[1];
+		*codechar++ = base64_encoding[(v >> 10) & 0x3f];
+		*codechar++ = base64_encoding[(v >>  4) & 0x3f];
+		*codechar++ = base64_encoding[(v <<  2) & 0x3f];
+		*codechar++ = '=';
 	}
-	/* control should not reach here */
 	return codechar;
 }
 
 #define BASE64_DEFAULT_LINE_LENGTH 64
 
-char *rpmBase64Encode(const void *data, size_t len, int linelen)
+size_t rpmBase64EncodedLen(size_t len, int linelen)
 {
 	size_t encodedlen;
-	const char *dataptr = data;
-	char *output;
-	char *outptr;
-	
-	if (data == NULL)
-		return NULL;
 
 	if (linelen < 0)
 		linelen = BASE64_DEFAULT_LINE_LENGTH;
@@ -77,12 +73,18 @@ char *rpmBase64Encode(const void *data, size_t len, int linelen)
 		encodedlen += encodedlen/(linelen * 4) + 1;
 	}
 	++encodedlen; /* for zero termination */
+	return encodedlen;
+}
 
-	output = malloc(encodedlen);
-	if (output == NULL)
-		return NULL;
-		
-	outptr = output;	
+size_t rpmBase64EncodeTo(const void *data, size_t len, int linelen, char *output)
+{
+	const char *dataptr = data;
+	char *outptr = output;
+
+	if (linelen < 0)
+		linelen = BASE64_DEFAULT_LINE_LENGTH;
+
+	linelen /= 4;
 	while (len > 0) {
 		if (linelen > 0 && len > linelen * 3) {
 			outptr = base64_encode_block(dataptr, linelen * 3, outptr);
@@ -97,63 +99,86 @@ char *rpmBase64Encode(const void *data, size_t len, int linelen)
 		}
 	}
 	*outptr = '\0';
-	return output;
+	return outptr - output;
 }
 
-static int base64_decode_value(unsigned char value_in)
+char *rpmBase64Encode(const void *data, size_t len, int linelen)
 {
-	static const int decoding[] = {62,-1,-1,-1,63,52,53,54,55,56,57,58,59,60,61,-1,-1,-1,-2,-1,-1,-1,0,1,2,3,4,5,6,7,8,9,10,11,12,13,14,15,16,17,18,19,20,21,22,23,24,25,-1,-1,-1,-1,-1,-1,26,27,28,29,30,31,32,33,34,35,36,37,38,39,40,41,42,43,44,45,46,47,48,49,50,51};
-	value_in -= 43;
-	if (value_in >= sizeof(decoding)/sizeof(int))
-		return -1;
-	return decoding[value_in];
+	char *output;
+
+	if (data == NULL)
+		return NULL;
+
+	output = malloc(rpmBase64EncodedLen(len, linelen));
+	if (output == NULL)
+		return NULL;
+
+	rpmBase64EncodeTo(data, len, linelen, output);
+	return output;
 }
 
 static size_t base64_decode_block(const char *code_in, const size_t length_in, char *plaintext_out)
 {
 	const char *codechar = code_in;
+	const char *const codeend = code_in + length_in;
 	char *plainchar = plaintext_out;
 	int fragment;
-	
+
 	*plainchar = 0;
-	
+
 	while (1)
 	{
+		/* four valid characters at a time, padding, whitespace and
+		 * the tail are left to the per-character loops below */
+		while (codechar + 4 <= codeend) {
+			int a = base64_decoding[(unsigned char)codechar[0]];
+			int b = base64_decoding[(unsigned char)codechar[1]];
+			int c = base64_decoding[(unsigned char)codechar[2]];
+			int d = base64_decoding[(unsigned char)codechar[3]];
+			if ((a | b | c | d) < 0)
+				break;
+			*plainchar++ = (char)((a << 2) | (b >> 4));
+			*plainchar++ = (char)((b << 4) | (c >> 2));
+			*plainchar++ = (char)((c << 6) | d);
+			codechar += 4;
+		}
+		*plainchar = 0;
+
 		do {
-			if (codechar == code_in+length_in)
+			if (codechar == codeend)
 			{
 				return plainchar - plaintext_out;
 			}
-			fragment = base64_decode_value(*codechar++);
+			fragment = base64_decoding[(unsigned char)*codechar++];
 		} while (fragment < 0);
 		*plainchar    = (char)((fragment & 0x03f) << 2);
 
 		do {
-			if (codechar == code_in+length_in)
+			if (codechar == codeend)
 			{
 				return plainchar - plaintext_out;
 			}
-			fragment = base64_decode_value(*codechar++);
+			fragment = base64_decoding[(unsigned char)*codechar++];
 		} while (fragment < 0);
 		*plainchar++ |= (char)((fragment & 0x030) >> 4);
 		*plainchar    = (char)((fragment & 0x00f) << 4);
 
 		do {
-			if (codechar == code_in+length_in)
+			if (codechar == codeend)
 			{
 				return plainchar - plaintext_out;
 			}
-			fragment = base64_decode_value(*codechar++);
+			fragment = base64_decoding[(unsigned char)*codechar++];
 		} while (fragment < 0);
 		*plainchar++ |= (char)((fragment & 0x03c) >> 2);
 		*plainchar    = (char)((fragment & 0x003) << 6);
 
 		do {
-			if (codechar == code_in+length_in)
+			if (codechar == codeend)
 			{
 				return plainchar - plaintext_out;
 			}
-			fragment = base64_decode_value(*codechar++);
+			fragment = base64_decoding[(unsigned char)*codechar++];
 		} while (fragment < 0);
 		*plainchar++   |= (char)(fragment & 0x03f);
 	}
@@ -161,21 +186,16 @@ static size_t base64_decode_block(const char *code_in, const size_t length_in, c
 	return plainchar - plaintext_out;
 }
 
-int rpmBase64Decode(const char *in, void **out, size_t *outlen)
+/* validate the input, counting base64 characters and total length */
+static int base64_validate(const char *in, size_t *outcntp, size_t *inlenp)
 {
 	size_t outcnt = 0;
 	const char *inptr = in;
 
-	*out = NULL;
-
-	if (in == NULL) {
-		return 1;
-	}
-	
 	while (*inptr != '\0') {
 		/* assume all ASCII control chars as whitespace */
 		if (*inptr > 32) {
-			if (base64_decode_value(*inptr) != -1) {
+			if (base64_decoding[(unsigned char)*inptr] != -1) {
 				++outcnt;
 			} else {
 				return 3;
@@ -183,18 +203,58 @@ int rpmBase64Decode(const char *in, void **out, size_t *outlen)
 		}
 		++inptr;
 	}
-	
+
 	if (outcnt % 4 != 0)
 		return 2;
-	
+
+	*outcntp = outcnt;
+	*inlenp = inptr - in;
+	return 0;
+}
+
+size_t rpmBase64DecodedLen(const char *in)
+{
+	return in ? (strlen(in) / 4) * 3 + 4 : 0;
+}
+
+int rpmBase64DecodeTo(const char *in, void *out, size_t *outlen)
+{
+	size_t outcnt, inlen;
+	int rc;
+
+	if (in == NULL)
+		return 1;
+
+	if ((rc = base64_validate(in, &outcnt, &inlen)) != 0)
+		return rc;
+
+	*outlen = base64_decode_block(in, inlen, out);
+	return 0;
+}
+
+int rpmBase64Decode(const char *in, void **out, size_t *outlen)
+{
+	size_t outcnt = 0;
+	size_t inlen = 0;
+	int rc;
+
+	*out = NULL;
+
+	if (in == NULL) {
+		return 1;
+	}
+
+	if ((rc = base64_validate(in, &outcnt, &inlen)) != 0)
+		return rc;
+
 	outcnt = (outcnt / 4) * 3;
-	
+
 	*out = malloc(outcnt + 1); /* base64_decode_block can write one extra character */
-	
+
 	if (*out == NULL)
 		return 4;
-	
-	*outlen = base64_decode_block(in, inptr - in, *out);
+
+	*outlen = base64_decode_block(in, inlen, *out);
 
 	return 0;
 }
@@ -225,7 +285,7 @@ char *rpmBase64CRC(const unsigned char *data, size_t len)
 #include <stdio.h>
 #include <string.h>
 
-int main(int argc, char *argv[]) 
+int main(int argc, char *argv[])
 {
 	static char tst[]="wtrt8122čLýáj\x20s ~ýhž\t4\x02šjjmBvž^%$RTš#á.íěj\x1hčýčŤc+";
 	char *encoded;
@@ -252,4 +312,3 @@ int main(int argc, char *argv[])
 	return 0;
 }
 #endif
-
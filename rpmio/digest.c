@@ -4,16 +4,36 @@
 
 #include "system.h"
 
+#include <pthread.h>
+
 #include "rpmio/digest.h"
 
 #include "debug.h"
 
 #define DIGESTS_MAX 12
+
+/* Minimum update size worth waking the hashing threads for */
+#define ASYNC_UPDATE_MIN (16*1024)
+
 struct rpmDigestBundle_s {
     int index_max;			/*!< Largest index of active digest */
     off_t nbytes;			/*!< Length of total input data */
     DIGEST_CTX digests[DIGESTS_MAX];	/*!< Digest contexts identified by id */
     int ids[DIGESTS_MAX];		/*!< Digest ID (arbitrary non-zero) */
+
+    /* Hashing thread pool, spawned on demand when a bundle carries
+     * multiple digests. One thread per context, fed the same buffer. */
+    int nthreads;			/*!< Number of threads (0: serial) */
+    pthread_t threads[DIGESTS_MAX];
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    pthread_cond_t done;
+    unsigned long long seq;		/*!< Update generation counter */
+    const void *data;			/*!< Current update buffer */
+    size_t len;
+    int pending;			/*!< Threads still hashing seq */
+    int rc;				/*!< Accumulated update rc */
+    int shutdown;
 };
 
 static int findID(rpmDigestBundle bundle, int id)
@@ -30,6 +50,98 @@ static int findID(rpmDigestBundle bundle, int id)
     return ix;
 }
 
+struct digestThread_s {
+    rpmDigestBundle bundle;
+    int slot;
+};
+
+static void * digestThread(void *arg)
+{
+    struct digestThread_s *dt = arg;
+    rpmDigestBundle bundle = dt->bundle;
+    int slot = dt->slot;
+    unsigned long long seq = 0;
+
+    free(dt);
+
+    pthread_mutex_lock(&bundle->lock);
+    for (;;) {
+	while (!bundle->shutdown && bundle->seq == seq)
+	    pthread_cond_wait(&bundle->wake, &bundle->lock);
+	if (bundle->shutdown)
+	    break;
+	seq = bundle->seq;
+	if (bundle->ids[slot] > 0 && bundle->digests[slot] != NULL) {
+	    const void *data = bundle->data;
+	    size_t len = bundle->len;
+	    int rc;
+
+	    pthread_mutex_unlock(&bundle->lock);
+	    rc = rpmDigestUpdate(bundle->digests[slot], data, len);
+	    pthread_mutex_lock(&bundle->lock);
+	    bundle->rc += rc;
+	}
+	if (--bundle->pending == 0)
+	    pthread_cond_signal(&bundle->done);
+    }
+    pthread_mutex_unlock(&bundle->lock);
+    return NULL;
+}
+
+static int activeDigests(rpmDigestBundle bundle)
+{
+    int n = 0;
+    for (int i = 0; i <= bundle->index_max; i++) {
+	if (bundle->ids[i] > 0)
+	    n++;
+    }
+    return n;
+}
+
+static void bundleSpawnPool(rpmDigestBundle bundle)
+{
+    pthread_mutex_init(&bundle->lock, NULL);
+    pthread_cond_init(&bundle->wake, NULL);
+    pthread_cond_init(&bundle->done, NULL);
+
+    for (int i = 0; i <= bundle->index_max; i++) {
+	struct digestThread_s *dt = xmalloc(sizeof(*dt));
+	dt->bundle = bundle;
+	dt->slot = i;
+	if (pthread_create(&bundle->threads[bundle->nthreads], NULL,
+			   digestThread, dt)) {
+	    free(dt);
+	    break;
+	}
+	bundle->nthreads++;
+    }
+
+    /* All or nothing: a partial pool would skip contexts */
+    if (bundle->nthreads <= bundle->index_max) {
+	pthread_mutex_lock(&bundle->lock);
+	bundle->shutdown = 1;
+	pthread_cond_broadcast(&bundle->wake);
+	pthread_mutex_unlock(&bundle->lock);
+	for (int i = 0; i < bundle->nthreads; i++)
+	    pthread_join(bundle->threads[i], NULL);
+	bundle->nthreads = 0;
+	bundle->shutdown = -1;	/* don't try again */
+    }
+}
+
+static void bundleReapPool(rpmDigestBundle bundle)
+{
+    if (bundle->nthreads > 0) {
+	pthread_mutex_lock(&bundle->lock);
+	bundle->shutdown = 1;
+	pthread_cond_broadcast(&bundle->wake);
+	pthread_mutex_unlock(&bundle->lock);
+	for (int i = 0; i < bundle->nthreads; i++)
+	    pthread_join(bundle->threads[i], NULL);
+	bundle->nthreads = 0;
+    }
+}
+
 rpmDigestBundle rpmDigestBundleNew(void)
 {
     rpmDigestBundle bundle = xcalloc(1, sizeof(*bundle));
@@ -39,6 +151,7 @@ rpmDigestBundle rpmDigestBundleNew(void)
 rpmDigestBundle rpmDigestBundleFree(rpmDigestBundle bundle)
 {
     if (bundle) {
+	bundleReapPool(bundle);
 	for (int i = 0; i <= bundle->index_max ; i++) {
 	    if (bundle->digests[i] == NULL)
 		continue;
@@ -79,9 +192,32 @@ int rpmDigestBundleUpdate(rpmDigestBundle bundle, const void *data, size_t len)
 {
     int rc = 0;
     if (bundle && data && len > 0) {
-	for (int i = 0; i <= bundle->index_max; i++) {
-	    if (bundle->ids[i] > 0)
-		rc += rpmDigestUpdate(bundle->digests[i], data, len);
+	/* Hashing the same data with several algorithms is independent
+	 * work, spread it over the pool for large enough updates. */
+	if (bundle->nthreads == 0 && bundle->shutdown == 0 &&
+	    len >= ASYNC_UPDATE_MIN && activeDigests(bundle) > 1) {
+	    bundleSpawnPool(bundle);
+	}
+
+	/* The pool covers slots up to its size; digests added after the
+	 * spawn may lie beyond it and force the serial path */
+	if (bundle->nthreads > bundle->index_max && len >= ASYNC_UPDATE_MIN) {
+	    pthread_mutex_lock(&bundle->lock);
+	    bundle->data = data;
+	    bundle->len = len;
+	    bundle->rc = 0;
+	    bundle->pending = bundle->nthreads;
+	    bundle->seq++;
+	    pthread_cond_broadcast(&bundle->wake);
+	    while (bundle->pending > 0)
+		pthread_cond_wait(&bundle->done, &bundle->lock);
+	    rc = bundle->rc;
+	    pthread_mutex_unlock(&bundle->lock);
+	} else {
+	    for (int i = 0; i <= bundle->index_max; i++) {
+		if (bundle->ids[i] > 0)
+		    rc += rpmDigestUpdate(bundle->digests[i], data, len);
+	    }
 	}
 	bundle->nbytes += len;
     }
@@ -108,4 +244,3 @@ DIGEST_CTX rpmDigestBundleDupCtx(rpmDigestBundle bundle, int id)
     DIGEST_CTX dup = (ix >= 0) ? rpmDigestDup(bundle->digests[ix]) : NULL;
     return dup;
 }
-
@@ -13,8 +13,11 @@
 
 #include "system.h"
 
+#include <pthread.h>
+
 #include <rpm/rpmlog.h>
 #include <rpm/rpmmacro.h>
+#include <rpm/rpmstring.h>
 #include <rpm/rpmver.h>
 #include "rpmio/rpmmacro_internal.h"
 #include "debug.h"
@@ -396,32 +399,39 @@ static int rdToken(ParseState state)
 
   default:
     if (risdigit(*p) || (*p == '%' && expand)) {
-      char *temp;
       size_t ts;
+      int hasmacro = 0;
 
       for (ts=0; p[ts]; ts++) {
-	if (p[ts] == '%' && expand)
+	if (p[ts] == '%' && expand) {
 	  ts = skipMacro(p, ts + 1) - 1;
-	else if (!risdigit(p[ts]))
+	  hasmacro = 1;
+	} else if (!risdigit(p[ts]))
 	  break;
       }
-      temp = getValuebuf(state, p, ts);
-      if (!temp)
-	goto err;
-      /* make sure that the expanded buffer only contains digits */
-      if (expand && !wellformedInteger(temp)) {
-	if (risalpha(*temp))
-	  exprErr(state, _("macro expansion returned a bare word, please use \"...\""), p + 1);
-	else
-	  exprErr(state, _("macro expansion did not return an integer"), p + 1);
-	rpmlog(RPMLOG_ERR, _("expanded string: %s\n"), temp);
+      if (!hasmacro) {
+	/* Plain digits, no scratch copy needed */
+	token = TOK_INTEGER;
+	v = valueMakeInteger(atoi(p));
+      } else {
+	char *temp = getValuebuf(state, p, ts);
+	if (!temp)
+	  goto err;
+	/* make sure that the expanded buffer only contains digits */
+	if (expand && !wellformedInteger(temp)) {
+	  if (risalpha(*temp))
+	    exprErr(state, _("macro expansion returned a bare word, please use \"...\""), p + 1);
+	  else
+	    exprErr(state, _("macro expansion did not return an integer"), p + 1);
+	  rpmlog(RPMLOG_ERR, _("expanded string: %s\n"), temp);
+	  free(temp);
+	  goto err;
+	}
+	token = TOK_INTEGER;
+	v = valueMakeInteger(atoi(temp));
 	free(temp);
-	goto err;
       }
       p += ts-1;
-      token = TOK_INTEGER;
-      v = valueMakeInteger(atoi(temp));
-      free(temp);
 
     } else if (*p == '\"' || (*p == 'v' && *(p+1) == '\"')) {
       char *temp;
@@ -871,14 +881,115 @@ err:
   return NULL;
 }
 
+/**
+ * Format a value the way rpmExprStr() returns it.
+ * @param v		value
+ * @return		malloc'd string representation
+ */
+static char *valueAsString(Value v)
+{
+  char *result = NULL;
+
+  switch (v->type) {
+  case VALUE_TYPE_INTEGER: {
+    rasprintf(&result, "%d", v->data.i);
+  } break;
+  case VALUE_TYPE_STRING:
+    result = xstrdup(v->data.s);
+    break;
+  case VALUE_TYPE_VERSION:
+    result = rpmverEVR(v->data.v);
+    break;
+  default:
+    break;
+  }
+  return result;
+}
+
+/*
+ * Result cache for expressions evaluated without RPMEXPR_EXPAND:
+ * those are pure functions of the expression string, and the %if
+ * guards of macro-heavy specs arrive here pre-expanded and get
+ * re-evaluated hundreds of times across subpackages. Results of
+ * expanding evaluations depend on the macro state and are left to
+ * the macro level memoization instead. Only successful evaluations
+ * are cached, errors are deterministic too but must re-log.
+ */
+#define EXPRCACHE_NUMBUCKETS 256
+#define EXPRCACHE_MAXENTRIES 4096
+
+struct exprCacheEntry {
+    struct exprCacheEntry *next;
+    char *expr;
+    int flags;
+    int boolResult;
+    char *strResult;
+};
+
+static struct exprCacheEntry *exprCache[EXPRCACHE_NUMBUCKETS];
+static int exprCacheCount = 0;
+static pthread_mutex_t exprCacheLock = PTHREAD_MUTEX_INITIALIZER;
+
+static int exprCacheGet(const char *expr, int flags, int *boolp, char **strp)
+{
+    unsigned int h = rstrhash(expr) % EXPRCACHE_NUMBUCKETS;
+    struct exprCacheEntry *ce;
+    int found = 0;
+
+    pthread_mutex_lock(&exprCacheLock);
+    for (ce = exprCache[h]; ce != NULL; ce = ce->next) {
+	if (ce->flags == flags && rstreq(ce->expr, expr)) {
+	    if (boolp)
+		*boolp = ce->boolResult;
+	    if (strp)
+		*strp = xstrdup(ce->strResult);
+	    found = 1;
+	    break;
+	}
+    }
+    pthread_mutex_unlock(&exprCacheLock);
+    return found;
+}
+
+static void exprCachePut(const char *expr, int flags, Value v)
+{
+    unsigned int h = rstrhash(expr) % EXPRCACHE_NUMBUCKETS;
+    struct exprCacheEntry *ce;
+
+    ce = xmalloc(sizeof(*ce));
+    ce->expr = xstrdup(expr);
+    ce->flags = flags;
+    ce->boolResult = boolifyValue(v);
+    ce->strResult = valueAsString(v);
+
+    pthread_mutex_lock(&exprCacheLock);
+    if (exprCacheCount < EXPRCACHE_MAXENTRIES) {
+	ce->next = exprCache[h];
+	exprCache[h] = ce;
+	exprCacheCount++;
+	ce = NULL;
+    }
+    pthread_mutex_unlock(&exprCacheLock);
+
+    if (ce) {	/* cache full, or raced with an identical insert: drop it */
+	free(ce->expr);
+	free(ce->strResult);
+	free(ce);
+    }
+}
+
 int rpmExprBoolFlags(const char *expr, int flags)
 {
   struct _parseState state;
   int result = -1;
+  int cacheable = (flags & RPMEXPR_EXPAND) == 0;
   Value v = NULL;
 
   DEBUG(printf("parseExprBoolean(?, '%s')\n", expr));
 
+  if (cacheable && exprCacheGet(expr, flags, &result, NULL))
+    return result;
+
   /* Initialize the expression parser state. */
   state.p = state.str = xstrdup(expr);
   state.nextToken = 0;
@@ -901,6 +1012,8 @@ int rpmExprBoolFlags(const char *expr, int flags)
   DEBUG(valueDump("parseExprBoolean:", v, stdout));
 
   result = boolifyValue(v);
+  if (cacheable)
+    exprCachePut(expr, flags, v);
 
 exit:
   state.str = _free(state.str);
@@ -912,10 +1025,14 @@ char *rpmExprStrFlags(const char *expr, int flags)
 {
   struct _parseState state;
   char *result = NULL;
+  int cacheable = (flags & RPMEXPR_EXPAND) == 0;
   Value v = NULL;
 
   DEBUG(printf("parseExprString(?, '%s')\n", expr));
 
+  if (cacheable && exprCacheGet(expr, flags, NULL, &result))
+    return result;
+
   /* Initialize the expression parser state. */
   state.p = state.str = xstrdup(expr);
   state.nextToken = 0;
@@ -937,19 +1054,9 @@ char *rpmExprStrFlags(const char *expr, int flags)
 
   DEBUG(valueDump("parseExprString:", v, stdout));
 
-  switch (v->type) {
-  case VALUE_TYPE_INTEGER: {
-    rasprintf(&result, "%d", v->data.i);
-  } break;
-  case VALUE_TYPE_STRING:
-    result = xstrdup(v->data.s);
-    break;
-  case VALUE_TYPE_VERSION:
-    result = rpmverEVR(v->data.v);
-    break;
-  default:
-    break;
-  }
+  result = valueAsString(v);
+  if (cacheable)
+    exprCachePut(expr, flags, v);
 
 exit:
   state.str = _free(state.str);
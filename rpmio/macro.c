@@ -17,12 +17,16 @@
 
 #define MACROBUFSIZ (BUFSIZ * 2)
 
+#include <limits.h>
+#include <sys/stat.h>
+
 #include <rpm/rpmio.h>
 #include <rpm/rpmstring.h>
 #include <rpm/rpmfileutil.h>
 #include <rpm/rpmurl.h>
 #include <rpm/rpmlog.h>
 #include <rpm/rpmmacro.h>
+#include <rpm/rpmstrpool.h>
 #include <rpm/argv.h>
 
 #include "rpmio/rpmlua.h"
@@ -53,13 +57,26 @@ struct rpmMacroEntry_s {
     int nargs;		/*!< Number of required args */
     int flags;		/*!< Macro state bits. */
     int level;          /*!< Scoping level. */
+    char *exp;		/*!< Memoized expansion (or NULL) */
+    ARGV_t deps;	/*!< Macro names the memoized expansion read */
     char arena[];   	/*!< String arena. */
 };
 
+/*! Open addressing hash table slot for one macro name. */
+typedef struct macroSlot_s {
+    rpmsid sid;		/*!< Interned macro name (0 if the slot is free) */
+    rpmMacroEntry me;	/*!< Macro entry stack (NULL if currently undefined) */
+} macroSlot;
+
 /*! The structure used to store the set of macros in a context. */
 struct rpmMacroContext_s {
-    rpmMacroEntry *tab;  /*!< Macro entry table (array of pointers). */
-    int n;      /*!< No. of macros. */
+    rpmMacroContext parent; /*!< Inherited context of a fork (or NULL). */
+    rpmstrPool pool;	/*!< String pool for interned macro names. */
+    macroSlot *slots;	/*!< Macro table (open addressing, linear probing). */
+    int nslots; /*!< No. of allocated slots (power of two). */
+    int nused;	/*!< No. of slots with an interned name. */
+    int n;      /*!< No. of defined macros. */
+    int nmemo;	/*!< No. of memoized expansions in the table. */
     int depth;		 /*!< Depth tracking when recursing from Lua  */
     int level;		 /*!< Scope level tracking when recursing from Lua  */
     pthread_mutex_t lock;
@@ -112,6 +129,9 @@ struct MacroBuf_s {
     rpmMacroEntry me;		/*!< Current macro (or NULL if anonymous) */
     ARGV_t args;		/*!< Current macro arguments (or NULL) */
     rpmMacroContext mc;
+    ARGV_t memodeps;		/*!< Names read by the expansion in progress */
+    int memopure;		/*!< Expansion free of side effects so far? */
+    int memodepth;		/*!< No. of memoizable expansions in progress */
 };
 
 /**
@@ -138,6 +158,7 @@ static void pushMacro(rpmMacroContext mc,
 	const char * n, const char * o, const char * b, int level, int flags);
 static void popMacro(rpmMacroContext mc, const char * n);
 static int loadMacroFile(rpmMacroContext mc, const char * fn);
+static int loadMacroBundle(rpmMacroContext mc, FILE *fd, const char *fn);
 /* =============================================================== */
 
 static rpmMacroContext rpmmctxAcquire(rpmMacroContext mc)
@@ -156,45 +177,165 @@ static rpmMacroContext rpmmctxRelease(rpmMacroContext mc)
 }
 
 /**
- * Find entry in macro table.
+ * Locate the slot of an interned name in the macro table.
+ * @param mc		macro context
+ * @param sid		interned macro name
+ * @param create	claim a free slot for sid if not present?
+ * @return		slot of sid (or NULL)
+ */
+static macroSlot *macroSlotFind(rpmMacroContext mc, rpmsid sid, int create)
+{
+    size_t mask, ix;
+    macroSlot *slot;
+
+    if (mc->nslots == 0)
+	return NULL;
+
+    /* Fibonacci hashing spreads out the sequentially allocated sids */
+    mask = mc->nslots - 1;
+    ix = (sid * 0x9e3779b9U) & mask;
+    while (mc->slots[ix].sid != 0 && mc->slots[ix].sid != sid)
+	ix = (ix + 1) & mask;
+
+    slot = &mc->slots[ix];
+    if (slot->sid == 0) {
+	if (!create)
+	    return NULL;
+	slot->sid = sid;
+	mc->nused++;
+    }
+    return slot;
+}
+
+/**
+ * Resize the macro table, dropping slots whose macro stack has emptied.
+ * @param mc		macro context
+ * @param nslots	new no. of slots (power of two)
+ */
+static void macroTableRehash(rpmMacroContext mc, int nslots)
+{
+    macroSlot *oslots = mc->slots;
+    int onslots = mc->nslots;
+
+    mc->slots = xcalloc(nslots, sizeof(*mc->slots));
+    mc->nslots = nslots;
+    mc->nused = 0;
+    for (int i = 0; i < onslots; i++) {
+	if (oslots[i].me != NULL)
+	    macroSlotFind(mc, oslots[i].sid, 1)->me = oslots[i].me;
+    }
+    free(oslots);
+}
+
+/**
+ * Find entry in the local macro table of one context, ignoring any
+ * inherited context of a fork.
+ * @param mc		macro context
+ * @param name		macro name
+ * @param namelen	no. of bytes (or 0 for strlen())
+ * @return		address of macro stack head with name (or NULL)
+ */
+static rpmMacroEntry *
+findEntryLocal(rpmMacroContext mc, const char *name, size_t namelen)
+{
+    rpmsid sid;
+    macroSlot *slot;
+
+    if (mc->pool == NULL)
+	return NULL;
+    sid = namelen ? rpmstrPoolIdn(mc->pool, name, namelen, 0) :
+		    rpmstrPoolId(mc->pool, name, 0);
+    if (sid == 0)
+	return NULL;
+    slot = macroSlotFind(mc, sid, 0);
+    if (slot == NULL || slot->me == NULL)
+	return NULL;
+    return &slot->me;
+}
+
+/**
+ * Find entry in macro table. Local definitions of a forked context
+ * shadow the inherited ones.
  * @param mc		macro context
  * @param name		macro name
- * @param namelen	no. of bytes
- * @param pos		found/insert position
- * @return		address of slot in macro table with name (or NULL)
+ * @param namelen	no. of bytes (or 0 for strlen())
+ * @return		address of macro stack head with name (or NULL)
  */
 static rpmMacroEntry *
-findEntry(rpmMacroContext mc, const char *name, size_t namelen, size_t *pos)
-{
-    /* bsearch */
-    int cmp = 1;
-    size_t l = 0;
-    size_t u = mc->n;
-    size_t i = 0;
-    while (l < u) {
-	i = (l + u) / 2;
-	rpmMacroEntry me = mc->tab[i];
-	if (namelen == 0)
-	    cmp = strcmp(me->name, name);
-	else {
-	    cmp = strncmp(me->name, name, namelen);
-	    /* longer me->name compares greater */
-	    if (cmp == 0)
-		cmp = (me->name[namelen] != '\0');
+findEntry(rpmMacroContext mc, const char *name, size_t namelen)
+{
+    rpmMacroEntry *mep = NULL;
+
+    for (; mc != NULL && mep == NULL; mc = mc->parent)
+	mep = findEntryLocal(mc, name, namelen);
+    return mep;
+}
+
+/**
+ * Discard memoized expansions that read macro name n, including entries
+ * memoized while n was undefined. Called whenever a macro definition for
+ * n is pushed or popped.
+ * @param mc		macro context
+ * @param n		macro name being (re)defined or undefined
+ */
+static void memoInvalidate(rpmMacroContext mc, const char *n)
+{
+    if (mc->nmemo <= 0)
+	return;
+    for (int i = 0; i < mc->nslots && mc->nmemo > 0; i++) {
+	for (rpmMacroEntry me = mc->slots[i].me; me; me = me->prev) {
+	    if (me->exp == NULL)
+		continue;
+	    for (ARGV_t dep = me->deps; dep && *dep; dep++) {
+		if (rstreq(*dep, n)) {
+		    me->exp = _free(me->exp);
+		    me->deps = argvFree(me->deps);
+		    mc->nmemo--;
+		    break;
+		}
+	    }
 	}
-	if (cmp < 0)
-	    l = i + 1;
-	else if (cmp > 0)
-	    u = i;
-	else
+    }
+}
+
+/**
+ * Can a memoized expansion be replayed in this context? A fork shares the
+ * inherited tables read-only, so pushing a macro there invalidates only
+ * the local memos: an inherited memo is stale whenever the fork overlays
+ * a definition of any macro name it read.
+ * @param mc		macro context the expansion runs in
+ * @param me		macro entry carrying the memo
+ * @return		1 if the memo is current, 0 if shadowed
+ */
+static int memoReplayable(rpmMacroContext mc, rpmMacroEntry me)
+{
+    for (rpmMacroContext c = mc; c->parent != NULL; c = c->parent) {
+	/* the owning context invalidates its own memos, stop there */
+	rpmMacroEntry *mep = findEntryLocal(c, me->name, 0);
+	if (mep != NULL && *mep == me)
 	    break;
+	for (ARGV_t dep = me->deps; dep && *dep; dep++) {
+	    if (findEntryLocal(c, *dep, 0))
+		return 0;
+	}
     }
+    return 1;
+}
 
-    if (pos)
-	*pos = (cmp < 0) ? i + 1 : i;
-    if (cmp == 0)
-	return &mc->tab[i];
-    return NULL;
+/**
+ * Can this context store a memoized expansion into the entry? Forks may
+ * only write their own entries, the inherited tables are shared with the
+ * parent and possibly with sibling forks in other threads.
+ * @param mc		macro context the expansion runs in
+ * @param me		macro entry the memo would be stored in
+ * @return		1 if the entry is owned by mc
+ */
+static int memoWritable(rpmMacroContext mc, rpmMacroEntry me)
+{
+    if (mc->parent == NULL)
+	return 1;
+    rpmMacroEntry *mep = findEntryLocal(mc, me->name, 0);
+    return (mep != NULL && *mep == me);
 }
 
 /* =============================================================== */
@@ -417,6 +558,9 @@ expandThis(MacroBuf mb, const char * src, size_t slen, char **target)
     umb = *mb;
     umb.buf = NULL;
     umb.error = 0;
+    /* ...and our own memoization state, the deps belong to the parent */
+    umb.memodeps = NULL;
+    umb.memodepth = 0;
     /* In case of error, flag it in the "parent"... */
     if (expandMacro(&umb, src, slen))
 	mb->error = 1;
@@ -499,6 +643,25 @@ static void mbAppendStr(MacroBuf mb, const char *str)
     mb->nb -= len;
 }
 
+/**
+ * Record a macro name read by a memoizable expansion in progress.
+ * @param mb		macro expansion state
+ * @param name		macro name
+ * @param namelen	no. of bytes (or 0 for strlen())
+ */
+static void mbMemoDep(MacroBuf mb, const char *name, size_t namelen)
+{
+    if (mb->memodepth <= 0)
+	return;
+    if (namelen == 0)
+	namelen = strlen(name);
+    for (ARGV_t dep = mb->memodeps; dep && *dep; dep++) {
+	if (strncmp(*dep, name, namelen) == 0 && (*dep)[namelen] == '\0')
+	    return;
+    }
+    argvAddN(&mb->memodeps, name, namelen);
+}
+
 static size_t doDnl(MacroBuf mb, rpmMacroEntry me, ARGV_t argv)
 {
     const char *se = argv[1];
@@ -599,7 +762,7 @@ validName(MacroBuf mb, const char *name, size_t namelen, const char *action)
 	goto exit;
     }
 
-    mep = findEntry(mb->mc, name, namelen, NULL);
+    mep = findEntry(mb->mc, name, namelen);
     if (mep && (*mep)->flags & ME_BUILTIN) {
 	mbErr(mb, 1, _("Macro %%%s is a built-in (%s)\n"), name, action);
 	goto exit;
@@ -896,10 +1059,9 @@ freeArgs(MacroBuf mb)
     rpmMacroContext mc = mb->mc;
 
     /* Delete dynamic macro definitions */
-    for (int i = 0; i < mc->n; i++) {
-	rpmMacroEntry me = mc->tab[i];
-	assert(me);
-	if (me->level < mb->level)
+    for (int i = 0; i < mc->nslots; i++) {
+	rpmMacroEntry me = mc->slots[i].me;
+	if (me == NULL || me->level < mb->level)
 	    continue;
 	/* Warn on defined but unused non-automatic, scoped macros */
 	if (!(me->flags & (ME_AUTO|ME_USED))) {
@@ -909,9 +1071,6 @@ freeArgs(MacroBuf mb)
 	    me->flags |= ME_USED;
 	}
 
-	/* compensate if the slot is to go away */
-	if (me->prev == NULL)
-	    i--;
 	popMacro(mc, me->name);
     }
     mb->level--;
@@ -977,7 +1136,7 @@ static size_t doBody(MacroBuf mb, rpmMacroEntry me, ARGV_t argv)
     if (*argv[1]) {
 	char *buf = NULL;
 	if (expandThis(mb, argv[1], 0, &buf) == 0) {
-	    rpmMacroEntry *mep = findEntry(mb->mc, buf, 0, NULL);
+	    rpmMacroEntry *mep = findEntry(mb->mc, buf, 0);
 	    if (mep) {
 		mbAppendStr(mb, (*mep)->body);
 	    } else {
@@ -1344,6 +1503,8 @@ doExpandThisMacro(MacroBuf mb, rpmMacroEntry me, ARGV_t args, size_t *parsed)
 		    _("argument expected") : _("unexpected argument"));
 	    goto exit;
 	}
+	/* Builtins can have side effects and external inputs, don't memoize */
+	mb->memopure = 0;
 	size_t np = me->func(mb, me, args);
 	if (parsed)
 	    *parsed += np;
@@ -1352,10 +1513,48 @@ doExpandThisMacro(MacroBuf mb, rpmMacroEntry me, ARGV_t args, size_t *parsed)
 	if (args != NULL)
 	    setupArgs(mb, me, args);
 
-	if ((me->flags & ME_LITERAL) != 0)
+	if ((me->flags & ME_LITERAL) != 0) {
 	    mbAppendStr(mb, me->body);
-	else
+	} else if (args == NULL && me->exp != NULL &&
+		   memoReplayable(mb->mc, me)) {
+	    /* Replay memoized expansion, propagating its dependencies */
+	    mbAppendStr(mb, me->exp);
+	    for (ARGV_t dep = me->deps; dep && *dep; dep++)
+		mbMemoDep(mb, *dep, 0);
+	} else if (args == NULL && !(me->flags & ME_AUTO)) {
+	    /*
+	     * Parameterless macro: memoize the expansion if it turns out
+	     * side-effect-free, recording the macro names it read so the
+	     * cache can be invalidated when any of them changes.
+	     */
+	    size_t start = mb->tpos;
+	    ARGV_t prevdeps = mb->memodeps;
+	    int prevpure = mb->memopure;
+
+	    mb->memodeps = NULL;
+	    mb->memopure = 1;
+	    mb->memodepth++;
 	    expandMacro(mb, me->body, 0);
+	    mb->memodepth--;
+
+	    ARGV_t deps = mb->memodeps;
+	    int pure = mb->memopure;
+	    mb->memodeps = prevdeps;
+	    mb->memopure = (prevpure && pure);
+	    /* An enclosing memoized expansion shares the dependencies */
+	    for (ARGV_t dep = deps; dep && *dep; dep++)
+		mbMemoDep(mb, *dep, 0);
+
+	    if (pure && mb->error == 0 && memoWritable(mb->mc, me)) {
+		me->exp = xstrdup(mb->buf + start);
+		me->deps = deps;
+		mb->mc->nmemo++;
+	    } else {
+		argvFree(deps);
+	    }
+	} else {
+	    expandMacro(mb, me->body, 0);
+	}
 	/* Free args for "%name " macros with opts */
 	if (args != NULL)
 	    freeArgs(mb);
@@ -1442,6 +1641,8 @@ expandMacro(MacroBuf mb, const char *src, size_t slen)
 	    if (mb->macro_trace)
 		printMacro(mb, s, se);
 	    s++;	/* skip ( */
+	    /* Shell output can differ between invocations */
+	    mb->memopure = 0;
 	    doShellEscape(mb, s, (se - 1 - s));
 	    s = se;
 	    continue;
@@ -1449,6 +1650,8 @@ expandMacro(MacroBuf mb, const char *src, size_t slen)
 	    if (mb->macro_trace)
 		printMacro(mb, s, se);
 	    s++;	/* skip [ */
+	    /* Expressions expand macros out of band, deps go unrecorded */
+	    mb->memopure = 0;
 	    doExpressionExpansion(mb, s, (se - 1 - s));
 	    s = se;
 	    continue;
@@ -1489,9 +1692,15 @@ expandMacro(MacroBuf mb, const char *src, size_t slen)
 	    printMacro(mb, s, se);
 
 	/* Expand defined macros */
-	mep = findEntry(mb->mc, f, fn, NULL);
+	mep = findEntry(mb->mc, f, fn);
 	me = (mep ? *mep : NULL);
 
+	/* The result depends on this name, whether defined or not */
+	mbMemoDep(mb, f, fn);
+	/* Automatic macros are scope-local state, not cacheable */
+	if (me && (me->flags & ME_AUTO))
+	    mb->memopure = 0;
+
 	if (me) {
 	    if ((me->flags & ME_AUTO) && mb->level > me->level) {
 		/* Ignore out-of-scope automatic macros */
@@ -1631,47 +1840,34 @@ static void pushMacroAny(rpmMacroContext mc,
     size_t olen = o ? strlen(o) : 0;
     size_t blen = b ? strlen(b) : 0;
     size_t mesize = sizeof(*me) + blen + 1 + (olen ? olen + 1 : 0);
-
-    size_t pos;
-    rpmMacroEntry *mep = findEntry(mc, n, 0, &pos);
-    if (mep) {
-	/* entry with shared name */
-	me = xmalloc(mesize);
-	/* copy body */
-	me->body = p = me->arena;
-	if (blen)
-	    memcpy(p, b, blen + 1);
-	else
-	    *p = '\0';
-	p += blen + 1;
-	/* set name */
-	me->name = (*mep)->name;
-    }
-    else {
-	/* extend macro table */
-	const int delta = 256;
-	if (mc->n % delta == 0)
-	    mc->tab = xrealloc(mc->tab, sizeof(me) * (mc->n + delta));
-	/* shift pos+ entries to the right */
-	memmove(mc->tab + pos + 1, mc->tab + pos, sizeof(me) * (mc->n - pos));
+    rpmsid sid;
+    macroSlot *slot;
+
+    if (mc->pool == NULL)
+	mc->pool = rpmstrPoolCreate();
+    /* grow ahead of the lookup so the returned slot stays valid */
+    if ((mc->nused + 1) * 3 > mc->nslots * 2) {
+	int nslots = (mc->nslots < 512) ? 512 : mc->nslots;
+	while ((mc->n + 1) * 3 > nslots * 2)
+	    nslots *= 2;
+	macroTableRehash(mc, nslots);
+    }
+
+    sid = rpmstrPoolId(mc->pool, n, 1);
+    slot = macroSlotFind(mc, sid, 1);
+    if (slot->me == NULL)
 	mc->n++;
-	/* make slot */
-	mc->tab[pos] = NULL;
-	mep = &mc->tab[pos];
-	/* entry with new name */
-	size_t nlen = strlen(n);
-	me = xmalloc(mesize + nlen + 1);
-	/* copy body */
-	me->body = p = me->arena;
-	if (blen)
-	    memcpy(p, b, blen + 1);
-	else
-	    *p = '\0';
-	p += blen + 1;
-	/* copy name */
-	me->name = memcpy(p, n, nlen + 1);
-	p += nlen + 1;
-    }
+
+    me = xmalloc(mesize);
+    /* copy body */
+    me->body = p = me->arena;
+    if (blen)
+	memcpy(p, b, blen + 1);
+    else
+	*p = '\0';
+    p += blen + 1;
+    /* interned name, stable for the lifetime of the pool */
+    me->name = rpmstrPoolStr(mc->pool, sid);
 
     /* copy options */
     if (olen)
@@ -1684,9 +1880,14 @@ static void pushMacroAny(rpmMacroContext mc,
     me->flags = flags;
     me->flags &= ~(ME_USED);
     me->level = level;
+    me->exp = NULL;
+    me->deps = NULL;
     /* push over previous definition */
-    me->prev = *mep;
-    *mep = me;
+    me->prev = slot->me;
+    slot->me = me;
+
+    /* new definition shadows whatever expansions read this name */
+    memoInvalidate(mc, me->name);
 }
 
 static void pushMacro(rpmMacroContext mc,
@@ -1697,23 +1898,23 @@ static void pushMacro(rpmMacroContext mc,
 
 static void popMacro(rpmMacroContext mc, const char * n)
 {
-    size_t pos;
-    rpmMacroEntry *mep = findEntry(mc, n, 0, &pos);
+    /* local entries only: a fork must not pop what it shares read-only */
+    rpmMacroEntry *mep = findEntryLocal(mc, n, 0);
     if (mep == NULL)
 	return;
     /* parting entry */
     rpmMacroEntry me = *mep;
     assert(me);
-    /* detach/pop definition */
-    mc->tab[pos] = me->prev;
-    /* shrink macro table */
-    if (me->prev == NULL) {
+    /* undefining re-exposes any previous definition */
+    memoInvalidate(mc, me->name);
+    /* detach/pop definition, the emptied slot is reclaimed on rehash */
+    *mep = me->prev;
+    if (me->prev == NULL)
 	mc->n--;
-	/* move pos+ elements to the left */
-	memmove(mc->tab + pos, mc->tab + pos + 1, sizeof(me) * (mc->n - pos));
-	/* deallocate */
-	if (mc->n == 0)
-	    mc->tab = _free(mc->tab);
+    if (me->exp) {
+	free(me->exp);
+	argvFree(me->deps);
+	mc->nmemo--;
     }
     /* comes in a single chunk */
     free(me);
@@ -1732,6 +1933,15 @@ static int defineMacro(rpmMacroContext mc, const char * macro, int level)
     return rc;
 }
 
+/*
+ * Compiled macro bundles carry the same serialized records as the binary
+ * macro file cache below, minus the file manifest: a bundle is an explicit
+ * artifact (written with --dumpmacros-compiled) standing in for a set of
+ * text macro files, typically the distro macro set. Bundles are picked up
+ * through the regular macro file paths, the loader sniffs the magic.
+ */
+#define MACRO_BUNDLE_MAGIC "RPMMB01\n"
+
 static int loadMacroFile(rpmMacroContext mc, const char * fn)
 {
     FILE *fd = fopen(fn, "r");
@@ -1745,6 +1955,18 @@ static int loadMacroFile(rpmMacroContext mc, const char * fn)
     if (fd == NULL)
 	goto exit;
 
+    /* A compiled macro bundle replaces the textual parse entirely */
+    {
+	char magic[sizeof(MACRO_BUNDLE_MAGIC) - 1];
+	if (fread(magic, 1, sizeof(magic), fd) == sizeof(magic) &&
+		memcmp(magic, MACRO_BUNDLE_MAGIC, sizeof(magic)) == 0) {
+	    rc = loadMacroBundle(mc, fd, fn);
+	    fclose(fd);
+	    goto exit;
+	}
+	rewind(fd);
+    }
+
     pushMacro(mc, "__file_name", NULL, fn, RMIL_MACROFILES, ME_LITERAL);
 
     buf[0] = '\0';
@@ -1776,12 +1998,227 @@ exit:
     return rc;
 }
 
+/*
+ * Binary macro file cache (pointed to by $RPM_MACRO_CACHE): a serialized
+ * dump of the macro table as loaded from the macro files, validated
+ * against the resolved file list and each file's size and mtime so any
+ * change falls back to regular text parsing (and rewrites the cache).
+ * The format is native-endian and private to the host: it is a cache,
+ * not an interchange format.
+ */
+#define MACRO_CACHE_MAGIC "RPMMC01\n"
+
+static int mcacheRead(FILE *fd, void *buf, size_t len)
+{
+    return (fread(buf, 1, len, fd) == len) ? 0 : -1;
+}
+
+/* Read a length-prefixed string (length includes the NUL, 0 means NULL) */
+static int mcacheReadStr(FILE *fd, char **sp, uint32_t maxlen)
+{
+    uint32_t len;
+    char *s = NULL;
+
+    *sp = NULL;
+    if (mcacheRead(fd, &len, sizeof(len)) || len > maxlen)
+	return -1;
+    if (len > 0) {
+	s = xmalloc(len);
+	if (mcacheRead(fd, s, len) || s[len - 1] != '\0') {
+	    free(s);
+	    return -1;
+	}
+    }
+    *sp = s;
+    return 0;
+}
+
+static void mcacheWriteStr(FILE *fd, const char *s)
+{
+    uint32_t len = s ? (uint32_t)strlen(s) + 1 : 0;
+    fwrite(&len, sizeof(len), 1, fd);
+    if (len > 0)
+	fwrite(s, 1, len, fd);
+}
+
+/* Read nmacros serialized macro records and define them all-or-nothing */
+static int mcacheReadMacros(rpmMacroContext mc, FILE *fd, uint32_t nmacros)
+{
+    char **names = NULL, **opts = NULL, **bodies = NULL;
+    uint32_t nread = 0;
+    int rc = -1;
+
+    /* Read everything up front, only push after the whole set parsed */
+    names = xcalloc(nmacros, sizeof(*names));
+    opts = xcalloc(nmacros, sizeof(*opts));
+    bodies = xcalloc(nmacros, sizeof(*bodies));
+    for (nread = 0; nread < nmacros; nread++) {
+	if (mcacheReadStr(fd, &names[nread], 4096) ||
+		names[nread] == NULL ||
+		mcacheReadStr(fd, &opts[nread], 4096) ||
+		mcacheReadStr(fd, &bodies[nread], 64*1024*1024))
+	    goto exit;
+    }
+
+    for (uint32_t i = 0; i < nmacros; i++) {
+	pushMacro(mc, names[i], opts[i], bodies[i],
+		  RMIL_MACROFILES, ME_NONE);
+    }
+    rc = 0;
+
+exit:
+    for (uint32_t i = 0; i < nread; i++) {
+	free(names[i]);
+	free(opts[i]);
+	free(bodies[i]);
+    }
+    free(names);
+    free(opts);
+    free(bodies);
+    return rc;
+}
+
+/* Count and write the macro file level macro records */
+static uint32_t mcacheWriteMacros(rpmMacroContext mc, FILE *fd, int count_only)
+{
+    uint32_t nmacros = 0;
+
+    for (int i = 0; i < mc->nslots; i++) {
+	rpmMacroEntry me = mc->slots[i].me;
+	if (me == NULL || me->level != RMIL_MACROFILES)
+	    continue;
+	if (count_only) {
+	    nmacros++;
+	} else {
+	    mcacheWriteStr(fd, me->name);
+	    mcacheWriteStr(fd, me->opts);
+	    mcacheWriteStr(fd, me->body);
+	}
+    }
+    return nmacros;
+}
+
+/* Load a compiled macro bundle, the magic has already been consumed */
+static int loadMacroBundle(rpmMacroContext mc, FILE *fd, const char *fn)
+{
+    uint32_t nmacros;
+    int rc = -1;
+
+    if (mcacheRead(fd, &nmacros, sizeof(nmacros)) || nmacros > 1024*1024)
+	goto exit;
+    if (mcacheReadMacros(mc, fd, nmacros))
+	goto exit;
+    rpmlog(RPMLOG_DEBUG, "loaded macro bundle %s: %u macros\n", fn, nmacros);
+    rc = 0;
+
+exit:
+    if (rc)
+	rpmlog(RPMLOG_ERR, _("invalid macro bundle: %s\n"), fn);
+    return rc;
+}
+
+static int loadMacroCache(rpmMacroContext mc, const char *fn,
+			  ARGV_const_t files)
+{
+    FILE *fd = fopen(fn, "r");
+    char magic[sizeof(MACRO_CACHE_MAGIC) - 1];
+    uint32_t nfiles, nmacros;
+    int rc = -1;
+
+    if (fd == NULL)
+	return -1;
+
+    if (mcacheRead(fd, magic, sizeof(magic)) ||
+	    memcmp(magic, MACRO_CACHE_MAGIC, sizeof(magic)) != 0 ||
+	    mcacheRead(fd, &nfiles, sizeof(nfiles)) ||
+	    mcacheRead(fd, &nmacros, sizeof(nmacros)) ||
+	    nfiles != (uint32_t)argvCount((ARGV_t)files) ||
+	    nmacros > 1024*1024)
+	goto exit;
+
+    /* Valid only for the identical, unmodified set of macro files */
+    for (uint32_t i = 0; i < nfiles; i++) {
+	struct stat sb;
+	int64_t mtime, size;
+	char *path = NULL;
+	int ok = 0;
+
+	if (mcacheReadStr(fd, &path, PATH_MAX) == 0 && path != NULL &&
+		mcacheRead(fd, &mtime, sizeof(mtime)) == 0 &&
+		mcacheRead(fd, &size, sizeof(size)) == 0 &&
+		rstreq(path, files[i]) &&
+		stat(path, &sb) == 0 &&
+		(int64_t)sb.st_mtime == mtime && (int64_t)sb.st_size == size)
+	    ok = 1;
+	free(path);
+	if (!ok)
+	    goto exit;
+    }
+
+    if (mcacheReadMacros(mc, fd, nmacros))
+	goto exit;
+    rpmlog(RPMLOG_DEBUG, "loaded macro cache %s: %u macros\n", fn, nmacros);
+    rc = 0;
+
+exit:
+    fclose(fd);
+    return rc;
+}
+
+static void writeMacroCache(rpmMacroContext mc, const char *fn,
+			    ARGV_const_t files)
+{
+    char *tmpfn = NULL;
+    FILE *fd = NULL;
+    uint32_t nfiles = argvCount((ARGV_t)files);
+    uint32_t nmacros = 0;
+    int fdno;
+
+    rasprintf(&tmpfn, "%s.XXXXXX", fn);
+    if ((fdno = mkstemp(tmpfn)) < 0)
+	goto exit;
+    if ((fd = fdopen(fdno, "w")) == NULL) {
+	close(fdno);
+	goto exit;
+    }
+
+    nmacros = mcacheWriteMacros(mc, NULL, 1);
+
+    fwrite(MACRO_CACHE_MAGIC, 1, sizeof(MACRO_CACHE_MAGIC) - 1, fd);
+    fwrite(&nfiles, sizeof(nfiles), 1, fd);
+    fwrite(&nmacros, sizeof(nmacros), 1, fd);
+    for (ARGV_const_t path = files; path && *path; path++) {
+	struct stat sb;
+	int64_t mtime = 0, size = 0;
+	if (stat(*path, &sb) == 0) {
+	    mtime = sb.st_mtime;
+	    size = sb.st_size;
+	}
+	mcacheWriteStr(fd, *path);
+	fwrite(&mtime, sizeof(mtime), 1, fd);
+	fwrite(&size, sizeof(size), 1, fd);
+    }
+    mcacheWriteMacros(mc, fd, 0);
+
+    if (fflush(fd) == 0 && ferror(fd) == 0 && rename(tmpfn, fn) == 0) {
+	rpmlog(RPMLOG_DEBUG, "wrote macro cache %s: %u macros\n",
+		fn, nmacros);
+    } else {
+	unlink(tmpfn);
+    }
+
+exit:
+    if (fd != NULL)
+	fclose(fd);
+    free(tmpfn);
+}
+
 static void copyMacros(rpmMacroContext src, rpmMacroContext dst, int level)
 {
-    for (int i = 0; i < src->n; i++) {
-	rpmMacroEntry me = src->tab[i];
-	assert(me);
-	pushMacro(dst, me->name, me->opts, me->body, level, me->flags);
+    for (int i = 0; i < src->nslots; i++) {
+	rpmMacroEntry me = src->slots[i].me;
+	if (me != NULL)
+	    pushMacro(dst, me->name, me->opts, me->body, level, me->flags);
     }
 }
 
@@ -1812,7 +2249,7 @@ int rpmExpandThisMacro(rpmMacroContext mc, const char *n,  ARGV_const_t args, ch
     int rc = 1; /* assume failure */
 
     mc = rpmmctxAcquire(mc);
-    mep = findEntry(mc, n, 0, NULL);
+    mep = findEntry(mc, n, 0);
     if (mep) {
 	MacroBuf mb = mbCreate(mc, flags);
 	rc = expandThisMacro(mb, *mep, args, flags);
@@ -1830,16 +2267,32 @@ int rpmExpandThisMacro(rpmMacroContext mc, const char *n,  ARGV_const_t args, ch
     }
 }
 
+static int dumpCmp(const void *ap, const void *bp)
+{
+    return strcmp((*(const rpmMacroEntry *)ap)->name,
+		  (*(const rpmMacroEntry *)bp)->name);
+}
+
 void
 rpmDumpMacroTable(rpmMacroContext mc, FILE * fp)
 {
+    rpmMacroEntry *entries;
+    int nentries = 0;
+
     mc = rpmmctxAcquire(mc);
     if (fp == NULL) fp = stderr;
-    
+
+    /* keep the traditional alphabetical dump order */
+    entries = xmalloc(mc->n * sizeof(*entries) + 1);
+    for (int i = 0; i < mc->nslots; i++) {
+	if (mc->slots[i].me != NULL)
+	    entries[nentries++] = mc->slots[i].me;
+    }
+    qsort(entries, nentries, sizeof(*entries), dumpCmp);
+
     fprintf(fp, "========================\n");
-    for (int i = 0; i < mc->n; i++) {
-	rpmMacroEntry me = mc->tab[i];
-	assert(me);
+    for (int i = 0; i < nentries; i++) {
+	rpmMacroEntry me = entries[i];
 	fprintf(fp, "%3d%c %s", me->level,
 		    ((me->flags & ME_USED) ? '=' : ':'), me->name);
 	if (me->opts && *me->opts)
@@ -1849,8 +2302,35 @@ rpmDumpMacroTable(rpmMacroContext mc, FILE * fp)
 	fprintf(fp, "\n");
     }
     fprintf(fp, _("======================== active %d empty %d\n"),
-		mc->n, 0);
+		nentries, 0);
+    free(entries);
+    rpmmctxRelease(mc);
+}
+
+int rpmDumpMacrosCompiled(rpmMacroContext mc, const char *fn)
+{
+    FILE *fd;
+    int rc = -1;
+
+    mc = rpmmctxAcquire(mc);
+    if ((fd = fopen(fn, "w")) != NULL) {
+	uint32_t nmacros = mcacheWriteMacros(mc, NULL, 1);
+
+	fwrite(MACRO_BUNDLE_MAGIC, 1, sizeof(MACRO_BUNDLE_MAGIC) - 1, fd);
+	fwrite(&nmacros, sizeof(nmacros), 1, fd);
+	mcacheWriteMacros(mc, fd, 0);
+
+	rc = (fflush(fd) != 0 || ferror(fd)) ? -1 : 0;
+	fclose(fd);
+	if (rc == 0)
+	    rpmlog(RPMLOG_DEBUG, "wrote macro bundle %s: %u macros\n",
+		   fn, nmacros);
+    }
     rpmmctxRelease(mc);
+
+    if (rc)
+	rpmlog(RPMLOG_ERR, _("failed to write macro bundle %s\n"), fn);
+    return rc;
 }
 
 int rpmPushMacroFlags(rpmMacroContext mc,
@@ -1891,7 +2371,7 @@ int rpmMacroIsDefined(rpmMacroContext mc, const char *n)
 {
     int defined = 0;
     if ((mc = rpmmctxAcquire(mc)) != NULL) {
-	if (findEntry(mc, n, 0, NULL))
+	if (findEntry(mc, n, 0))
 	    defined = 1;
 	rpmmctxRelease(mc);
     }
@@ -1902,7 +2382,7 @@ int rpmMacroIsParametric(rpmMacroContext mc, const char *n)
 {
     int parametric = 0;
     if ((mc = rpmmctxAcquire(mc)) != NULL) {
-	rpmMacroEntry *mep = findEntry(mc, n, 0, NULL);
+	rpmMacroEntry *mep = findEntry(mc, n, 0);
 	if (mep && (*mep)->opts)
 	    parametric = 1;
 	rpmmctxRelease(mc);
@@ -1942,7 +2422,10 @@ void
 rpmInitMacros(rpmMacroContext mc, const char * macrofiles)
 {
     ARGV_t pattern, globs = NULL;
+    ARGV_t files = NULL;
     rpmMacroContext climc;
+    const char *cachefn = getenv("RPM_MACRO_CACHE");
+
     mc = rpmmctxAcquire(mc);
 
     /* Define built-in macros */
@@ -1953,26 +2436,34 @@ rpmInitMacros(rpmMacroContext mc, const char * macrofiles)
 
     argvSplit(&globs, macrofiles, ":");
     for (pattern = globs; pattern && *pattern; pattern++) {
-	ARGV_t path, files = NULL;
-    
+	ARGV_t path, pfiles = NULL;
+
 	/* Glob expand the macro file path element, expanding ~ to $HOME. */
-	if (rpmGlob(*pattern, NULL, &files) != 0) {
+	if (rpmGlob(*pattern, NULL, &pfiles) != 0) {
 	    continue;
 	}
 
-	/* Read macros from each file. */
-	for (path = files; *path; path++) {
-	    if (rpmFileHasSuffix(*path, ".rpmnew") || 
+	for (path = pfiles; *path; path++) {
+	    if (rpmFileHasSuffix(*path, ".rpmnew") ||
 		rpmFileHasSuffix(*path, ".rpmsave") ||
 		rpmFileHasSuffix(*path, ".rpmorig")) {
 		continue;
 	    }
-	    (void) loadMacroFile(mc, *path);
+	    argvAdd(&files, *path);
 	}
-	argvFree(files);
+	argvFree(pfiles);
     }
     argvFree(globs);
 
+    /* Read macros from each file, preferring a still-valid binary cache */
+    if (!(cachefn && *cachefn && loadMacroCache(mc, cachefn, files) == 0)) {
+	for (ARGV_const_t path = files; path && *path; path++)
+	    (void) loadMacroFile(mc, *path);
+	if (cachefn && *cachefn)
+	    writeMacroCache(mc, cachefn, files);
+    }
+    argvFree(files);
+
     /* Reload cmdline macros */
     climc = rpmmctxAcquire(rpmCLIMacroContext);
     copyMacros(climc, mc, RMIL_CMDLINE);
@@ -1985,12 +2476,45 @@ void
 rpmFreeMacros(rpmMacroContext mc)
 {
     mc = rpmmctxAcquire(mc);
-    while (mc->n > 0) {
-	/* remove from the end to avoid memmove */
-	rpmMacroEntry me = mc->tab[mc->n - 1];
-	popMacro(mc, me->name);
-    }
+    for (int i = 0; i < mc->nslots; i++) {
+	while (mc->slots[i].me != NULL)
+	    popMacro(mc, mc->slots[i].me->name);
+    }
+    mc->slots = _free(mc->slots);
+    mc->nslots = 0;
+    mc->nused = 0;
+    mc->pool = rpmstrPoolFree(mc->pool);
+    rpmmctxRelease(mc);
+}
+
+rpmMacroContext rpmMacroContextFork(rpmMacroContext mc)
+{
+    rpmMacroContext fmc = xcalloc(1, sizeof(*fmc));
+
+    mc = rpmmctxAcquire(mc);
+    fmc->parent = mc;
+    fmc->level = mc->level;
+    fmc->depth = mc->depth;
     rpmmctxRelease(mc);
+
+    /* no table or pool yet, local definitions allocate them on demand */
+    pthread_mutexattr_init(&fmc->lockattr);
+    pthread_mutexattr_settype(&fmc->lockattr, PTHREAD_MUTEX_RECURSIVE);
+    pthread_mutex_init(&fmc->lock, &fmc->lockattr);
+    return fmc;
+}
+
+rpmMacroContext rpmMacroContextFree(rpmMacroContext mc)
+{
+    /* the static contexts are initialized on first use, never freed */
+    if (mc == NULL || mc->parent == NULL)
+	return NULL;
+
+    rpmFreeMacros(mc);
+    pthread_mutex_destroy(&mc->lock);
+    pthread_mutexattr_destroy(&mc->lockattr);
+    free(mc);
+    return NULL;
 }
 
 char * 
@@ -22,6 +22,17 @@ extern "C" {
  */
 char *rpmBase64Encode(const void *data, size_t len, int linelen);
 
+/* returns the buffer size (including the zero termination) that
+ * rpmBase64EncodeTo() needs for len bytes of input
+ */
+size_t rpmBase64EncodedLen(size_t len, int linelen);
+
+/* like rpmBase64Encode() but encodes into a caller provided buffer of
+ * at least rpmBase64EncodedLen(len, linelen) bytes
+ * returns the string length of the result
+ */
+size_t rpmBase64EncodeTo(const void *data, size_t len, int linelen, char *output);
+
 /* decodes from zero terminated base64 encoded string to a newly malloced buffer
  * ignores whitespace characters in the input string
  * return values:
@@ -33,6 +44,17 @@ char *rpmBase64Encode(const void *data, size_t len, int linelen);
  */
 int rpmBase64Decode(const char *in, void **out, size_t *outlen);
 
+/* returns the buffer size rpmBase64DecodeTo() may write for the given
+ * input string, 0 when in is NULL
+ */
+size_t rpmBase64DecodedLen(const char *in);
+
+/* like rpmBase64Decode() but decodes into a caller provided buffer of
+ * at least rpmBase64DecodedLen(in) bytes, same return values except
+ * that 4 (malloc failed) cannot occur
+ */
+int rpmBase64DecodeTo(const char *in, void *out, size_t *outlen);
+
 /* counts CRC24 and base64 encodes it in a malloced string
  * returns NULL on failures
  */
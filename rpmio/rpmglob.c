@@ -798,6 +798,119 @@ glob_in_dir(const char *pattern, const char *directory, int flags,
     return nfound == 0 ? GLOB_NOMATCH : 0;
 }
 
+/*
+ * Directory snapshot cache for pattern sets: one rpmGlob() call can
+ * expand to many patterns (brace alternatives, multiple globs in the
+ * string), each of which re-reads the same directories through the
+ * engine above. Snapshot every directory on first read and classify
+ * all patterns of the call against the snapshots, turning the
+ * O(patterns x tree) walk into O(tree). The cache is plugged in via
+ * GLOB_ALTDIRFUNC and only lives for the duration of one call, so it
+ * cannot go stale across operations.
+ */
+struct cachedir {
+    struct cachedir *next;
+    char *path;
+    struct dirent **ents;	/* snapshot of the directory entries */
+    int nents;
+    int valid;			/* did opendir succeed? */
+    int errnum;			/* errno from opendir when it did not */
+};
+
+struct cachedirstream {
+    struct cachedir *dir;
+    int cur;
+};
+
+static struct cachedir *dircache = NULL;
+
+static void *cache_opendir(const char *path)
+{
+    struct cachedir *cd;
+    struct cachedirstream *stream;
+
+    for (cd = dircache; cd != NULL; cd = cd->next)
+	if (strcmp(cd->path, path) == 0)
+	    break;
+
+    if (cd == NULL) {
+	DIR *dirp = opendir(path);
+
+	cd = xcalloc(1, sizeof(*cd));
+	cd->path = xstrdup(path);
+	cd->next = dircache;
+	dircache = cd;
+	if (dirp != NULL) {
+	    struct dirent *d;
+	    int alloced = 0;
+
+	    cd->valid = 1;
+	    while ((d = readdir(dirp)) != NULL) {
+		size_t nb = offsetof(struct dirent, d_name) +
+			    strlen(d->d_name) + 1;
+		if (cd->nents >= alloced) {
+		    alloced = alloced ? alloced * 2 : 64;
+		    cd->ents = xrealloc(cd->ents,
+					alloced * sizeof(*cd->ents));
+		}
+		cd->ents[cd->nents++] = memcpy(xmalloc(nb), d, nb);
+	    }
+	    closedir(dirp);
+	} else {
+	    cd->errnum = errno;
+	}
+    }
+
+    if (!cd->valid) {
+	__set_errno(cd->errnum);
+	return NULL;
+    }
+    stream = xmalloc(sizeof(*stream));
+    stream->dir = cd;
+    stream->cur = 0;
+    return stream;
+}
+
+static struct dirent *cache_readdir(void *vstream)
+{
+    struct cachedirstream *stream = vstream;
+
+    if (stream->cur >= stream->dir->nents)
+	return NULL;
+    return stream->dir->ents[stream->cur++];
+}
+
+static void cache_closedir(void *vstream)
+{
+    free(vstream);
+}
+
+/* Plain passthroughs, GLOB_ALTDIRFUNC switches all accessors at once */
+static int cache_stat(const char *path, struct stat *st)
+{
+    return stat(path, st);
+}
+
+static int cache_lstat(const char *path, struct stat *st)
+{
+    return lstat(path, st);
+}
+
+static void dircache_free(void)
+{
+    struct cachedir *cd;
+
+    while ((cd = dircache) != NULL) {
+	int i;
+	dircache = cd->next;
+	for (i = 0; i < cd->nents; i++)
+	    free(cd->ents[i]);
+	free(cd->ents);
+	free(cd->path);
+	free(cd);
+    }
+}
+
 /* librpmio exported interfaces */
 
 int rpmGlob(const char * patterns, int * argcPtr, ARGV_t * argvPtr)
@@ -848,6 +961,7 @@ int rpmGlob(const char * patterns, int * argcPtr, ARGV_t * argvPtr)
 	size_t plen = strlen(path);
 	int flags = gflags;
 	int dir_only = (plen > 0 && path[plen-1] == '/');
+	unsigned char * dirmask = NULL;
 	glob_t gl;
 
 	if (!local || (!rpmIsGlob(av[j], 0) && strchr(path, '~') == NULL)) {
@@ -857,11 +971,16 @@ int rpmGlob(const char * patterns, int * argcPtr, ARGV_t * argvPtr)
 
 	if (dir_only)
 	    flags |= GLOB_ONLYDIR;
-	
+
 	gl.gl_pathc = 0;
 	gl.gl_pathv = NULL;
-	
-	rc = glob(av[j], flags, NULL, &gl);
+	gl.gl_opendir = cache_opendir;
+	gl.gl_readdir = cache_readdir;
+	gl.gl_closedir = cache_closedir;
+	gl.gl_stat = cache_stat;
+	gl.gl_lstat = cache_lstat;
+
+	rc = glob(av[j], flags | GLOB_ALTDIRFUNC, NULL, &gl);
 	if (rc)
 	    goto exit;
 
@@ -893,15 +1012,25 @@ int rpmGlob(const char * patterns, int * argcPtr, ARGV_t * argvPtr)
 	globRoot += nb;
 	*globRoot = '\0';
 
+	if (dir_only) {
+	    /* Weed out non-directories up front: the stat calls are
+	       independent, so let them run in parallel where enabled,
+	       only their latency matters on large expansions.  */
+	    dirmask = xcalloc(gl.gl_pathc + 1, sizeof(*dirmask));
+	    #pragma omp parallel for schedule(dynamic)
+	    for (i = 0; i < gl.gl_pathc; i++) {
+		struct stat sb;
+		if (lstat(gl.gl_pathv[i], &sb) == 0 && S_ISDIR(sb.st_mode))
+		    dirmask[i] = 1;
+	    }
+	}
+
 	for (i = 0; i < gl.gl_pathc; i++) {
 	    const char * globFile = &(gl.gl_pathv[i][0]);
 
-	    if (dir_only) {
-		struct stat sb;
-		if (lstat(gl.gl_pathv[i], &sb) || !S_ISDIR(sb.st_mode))
-		    continue;
-	    }
-		
+	    if (dirmask && !dirmask[i])
+		continue;
+
 	    if (globRoot > globURL && globRoot[-1] == '/')
 		while (*globFile == '/') globFile++;
 	    strcpy(globRoot, globFile);
@@ -909,6 +1038,7 @@ int rpmGlob(const char * patterns, int * argcPtr, ARGV_t * argvPtr)
 	}
 	globfree(&gl);
 	free(globURL);
+	free(dirmask);
     }
 
     argc = argvCount(argv);
@@ -923,7 +1053,8 @@ int rpmGlob(const char * patterns, int * argcPtr, ARGV_t * argvPtr)
 
 
 exit:
-#ifdef ENABLE_NLS	
+    dircache_free();
+#ifdef ENABLE_NLS
     if (old_collate) {
 	(void) setlocale(LC_COLLATE, old_collate);
 	free(old_collate);
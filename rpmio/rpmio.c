@@ -8,8 +8,12 @@
 #include <ctype.h>
 #include <dirent.h>
 #include <fcntl.h>
+#include <pthread.h>
+#include <sys/uio.h>
 #if defined(__linux__)
 #include <sys/personality.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
 #endif
 #include <sys/utsname.h>
 #include <sys/resource.h>
@@ -58,6 +62,9 @@ struct _FD_s {
     char	*descr;		/* file name (or other description) */
     FDSTAT_t	stats;		/* I/O statistics */
 
+    int		nocache;	/* drop the page cache as data is consumed */
+    off_t	nocache_drop;	/* start of the not yet dropped range */
+
     rpmDigestBundle digests;
 };
 
@@ -117,6 +124,74 @@ rpmDigestBundle fdGetBundle(FD_t fd, int create)
     return bundle;
 }
 
+/* =============================================================== */
+/*
+ * Pool of page-aligned I/O buffers shared across FD_t lifetimes.
+ * The compressed layers each allocate (and drop) the same few buffer
+ * sizes on every open; recycling them through a small freelist avoids
+ * the allocator round trips and the page faults on first touch, and
+ * the alignment keeps the buffers friendly to O_DIRECT-ish kernels
+ * and to vectorized (de)compressors alike.
+ */
+#define IOBUF_ALIGN	4096
+#define IOBUF_NPOOLED	16	/* max buffers kept on the freelist */
+
+struct iobuf_s {
+    size_t size;		/*!< usable bytes, excluding this header */
+    struct iobuf_s *next;
+};
+
+static struct iobuf_s *iobufFreelist = NULL;
+static int iobufNpooled = 0;
+static pthread_mutex_t iobufLock = PTHREAD_MUTEX_INITIALIZER;
+
+static void *iobufGet(size_t size)
+{
+    struct iobuf_s *b = NULL;
+    struct iobuf_s **bp, **bestp = NULL;
+
+    pthread_mutex_lock(&iobufLock);
+    /* Best fit: the smallest pooled buffer that is large enough */
+    for (bp = &iobufFreelist; *bp; bp = &(*bp)->next) {
+	if ((*bp)->size >= size && (bestp == NULL || (*bp)->size < (*bestp)->size))
+	    bestp = bp;
+    }
+    if (bestp) {
+	b = *bestp;
+	*bestp = b->next;
+	iobufNpooled--;
+    }
+    pthread_mutex_unlock(&iobufLock);
+
+    if (b == NULL) {
+	/* The buffer proper starts one alignment unit past the header */
+	void *mem = NULL;
+	if (posix_memalign(&mem, IOBUF_ALIGN, IOBUF_ALIGN + size) != 0)
+	    mem = xmalloc(IOBUF_ALIGN + size);	/* aligned is only a bonus */
+	b = mem;
+	b->size = size;
+    }
+    return (char *)b + IOBUF_ALIGN;
+}
+
+static void *iobufPut(void *buf)
+{
+    if (buf != NULL) {
+	struct iobuf_s *b = (struct iobuf_s *)((char *)buf - IOBUF_ALIGN);
+
+	pthread_mutex_lock(&iobufLock);
+	if (iobufNpooled < IOBUF_NPOOLED) {
+	    b->next = iobufFreelist;
+	    iobufFreelist = b;
+	    iobufNpooled++;
+	    b = NULL;
+	}
+	pthread_mutex_unlock(&iobufLock);
+	free(b);
+    }
+    return NULL;
+}
+
 /** \ingroup rpmio
  * \name RPMIO Vectors.
  */
@@ -425,12 +500,75 @@ static const struct FDIO_s fdio_s = {
 };
 static const FDIO_t fdio = &fdio_s ;
 
+int fdPlain(FD_t fd)
+{
+    return (fd != NULL && fd->fps->prev == NULL &&
+	    (fd->fps->io == fdio || fd->fps->io == ufdio));
+}
+
+/*
+ * A plain descriptor stream: single layer, no compression and no
+ * digests calculated on the side, so the bytes can be moved without
+ * ever looking at them.
+ */
+static int fdRawStream(FD_t fd)
+{
+    return (fdPlain(fd) && fd->digests == NULL);
+}
+
+#if defined(__linux__)
+/*
+ * Move data between two raw streams inside the kernel where possible:
+ * sendfile(2) out of regular files, splice(2) when a pipe is involved.
+ * Returns bytes copied, -1 on error, or 0 to have the caller fall back
+ * to copying through userspace.
+ */
+static off_t fdKernelCopy(FD_t sfd, FD_t tfd)
+{
+    int sfdno = Fileno(sfd);
+    int tfdno = Fileno(tfd);
+    struct stat sb, tb;
+    off_t total = 0;
+    ssize_t nb;
+
+    if (sfdno < 0 || tfdno < 0 || fstat(sfdno, &sb) || fstat(tfdno, &tb))
+	return 0;
+
+    if (S_ISREG(sb.st_mode)) {
+	while ((nb = sendfile(tfdno, sfdno, NULL, BUFSIZ * 32)) > 0)
+	    total += nb;
+    } else if (S_ISFIFO(sb.st_mode) || S_ISFIFO(tb.st_mode)) {
+	while ((nb = splice(sfdno, NULL, tfdno, NULL,
+			    BUFSIZ * 32, SPLICE_F_MORE)) > 0)
+	    total += nb;
+    } else {
+	return 0;
+    }
+
+    if (nb < 0) {
+	/* Nothing moved yet: let the read/write loop have a go */
+	if (total == 0 && (errno == EINVAL || errno == ENOSYS))
+	    return 0;
+	total = -1;
+    }
+    return total;
+}
+#endif
+
 off_t ufdCopy(FD_t sfd, FD_t tfd)
 {
     char buf[BUFSIZ];
     ssize_t rdbytes, wrbytes;
     off_t total = 0;
 
+#if defined(__linux__)
+    if (fdRawStream(sfd) && fdRawStream(tfd)) {
+	total = fdKernelCopy(sfd, tfd);
+	if (total != 0)
+	    return total;
+    }
+#endif
+
     while (1) {
 	rdbytes = Fread(buf, sizeof(buf[0]), sizeof(buf), sfd);
 
@@ -451,11 +589,197 @@ off_t ufdCopy(FD_t sfd, FD_t tfd)
     return total;
 }
 
+/*
+ * Lazily range-fetched remote files (http/https only).
+ *
+ * Header-only operations on remote packages read a few tens of
+ * kilobytes from the front of the file; downloading the entire package
+ * first wastes nearly all of the transfer. When a range-capable url
+ * helper is configured (%_urlhelper_range), reads fetch geometrically
+ * growing byte ranges on demand into an anonymous local cache file
+ * holding a contiguous prefix of the remote file. Each follow-up range
+ * re-requests the last cached byte: a server that ignores the range
+ * header replies with the entire file from byte 0, which is detected
+ * from the reply size and the verify byte, and simply becomes the
+ * complete cache. A range fd is never fdPlain(), so mmap-style access
+ * to the partially filled cache is not reachable.
+ */
+typedef struct urlRange_s {
+    char *url;		/* remote url */
+    off_t avail;	/* contiguous bytes cached from the start */
+    off_t chunk;	/* next range fetch size */
+    int complete;	/* entire file cached? */
+} urlRange;
+
+#define URL_RANGE_CHUNK		(64 * 1024)
+#define URL_RANGE_CHUNK_MAX	(32 * 1024 * 1024)
+
+/* Copy a downloaded file into the cache at the given offset */
+static int rangeStash(int fdno, const char *path, off_t skip, off_t at)
+{
+    char buf[BUFSIZ];
+    ssize_t n = -1;
+    int sfd = open(path, O_RDONLY);
+
+    if (sfd >= 0 && lseek(sfd, skip, SEEK_SET) != -1) {
+	while ((n = read(sfd, buf, sizeof(buf))) > 0) {
+	    if (pwrite(fdno, buf, n, at) != n) {
+		n = -1;
+		break;
+	    }
+	    at += n;
+	}
+    }
+    if (sfd >= 0)
+	close(sfd);
+    return (n < 0) ? -1 : 0;
+}
+
+/* Extend the cached prefix by (at least) one range fetch */
+static int rangeFetch(FDSTACK_t fps)
+{
+    urlRange *r = fps->fp;
+    char *tmp = NULL;
+    FD_t tfd = rpmMkTempFile(NULL, &tmp);
+    struct stat sb;
+    off_t start, want, got;
+    int rc = -1;
+
+    if (tfd == NULL)
+	goto exit;
+    Fclose(tfd);
+
+    /* re-request the last cached byte to detect ignored range requests */
+    start = (r->avail > 0) ? r->avail - 1 : 0;
+    want = r->avail + r->chunk - start;
+    if (urlGetFileRange(r->url, tmp, start, want) == 0 &&
+	    stat(tmp, &sb) == 0 && sb.st_size > 0) {
+	int honored = ((got = sb.st_size) <= want);
+
+	if (honored && r->avail > 0) {
+	    char ob, nb;
+	    int vfd = open(tmp, O_RDONLY);
+	    honored = (vfd >= 0 && read(vfd, &nb, 1) == 1 &&
+		       pread(fps->fdno, &ob, 1, r->avail - 1) == 1 && nb == ob);
+	    if (vfd >= 0)
+		close(vfd);
+	}
+
+	if (honored) {
+	    off_t skip = (r->avail > 0) ? 1 : 0;
+	    if (rangeStash(fps->fdno, tmp, skip, r->avail) == 0) {
+		r->avail += got - skip;
+		/* a short reply means the remote end was reached */
+		if (got < want)
+		    r->complete = 1;
+		rc = 0;
+	    }
+	} else {
+	    /* range ignored: the reply is the entire file, keep it all */
+	    if (rangeStash(fps->fdno, tmp, 0, 0) == 0 &&
+		    ftruncate(fps->fdno, got) == 0) {
+		r->avail = got;
+		r->complete = 1;
+		rc = 0;
+	    }
+	}
+	if (r->chunk < URL_RANGE_CHUNK_MAX)
+	    r->chunk *= 2;
+    } else if (urlGetFile(r->url, tmp) == 0 && stat(tmp, &sb) == 0 &&
+	       rangeStash(fps->fdno, tmp, 0, 0) == 0 &&
+	       ftruncate(fps->fdno, sb.st_size) == 0) {
+	/* range fetch failed outright, last resort whole-file fetch */
+	r->avail = sb.st_size;
+	r->complete = 1;
+	rc = 0;
+    }
+
+exit:
+    if (tmp) {
+	unlink(tmp);
+	free(tmp);
+    }
+    return rc;
+}
+
+static ssize_t rangeRead(FDSTACK_t fps, void * buf, size_t count)
+{
+    urlRange *r = fps->fp;
+    off_t pos = lseek(fps->fdno, 0, SEEK_CUR);
+
+    while (!r->complete && pos + (off_t) count > r->avail) {
+	if (rangeFetch(fps))
+	    return -1;
+    }
+    return read(fps->fdno, buf, count);
+}
+
+static int rangeSeek(FDSTACK_t fps, off_t pos, int whence)
+{
+    urlRange *r = fps->fp;
+
+    /* the cache must be complete for end-relative seeks to resolve */
+    while (!r->complete && whence == SEEK_END) {
+	if (rangeFetch(fps))
+	    return -1;
+    }
+    return fdSeek(fps, pos, whence);
+}
+
+static int rangeClose(FDSTACK_t fps)
+{
+    urlRange *r = fps->fp;
+
+    if (r != NULL) {
+	free(r->url);
+	free(r);
+	fps->fp = NULL;
+    }
+    return fdClose(fps);
+}
+
+static const struct FDIO_s rangeio_s = {
+  "rangeio", NULL,
+  rangeRead, fdWrite, rangeSeek, rangeClose,
+  NULL, NULL, fdFlush, fdTell, fdError, fdStrerr
+};
+static const FDIO_t rangeio = &rangeio_s;
+
+static FD_t urlRangeOpen(const char * url, int flags, mode_t mode)
+{
+    urltype type = urlIsURL(url);
+    char *helper = rpmExpand("%{?_urlhelper_range}", NULL);
+    char *dest = NULL;
+    FD_t fd = NULL;
+    int fdno = -1;
+
+    if ((type == URL_IS_HTTP || type == URL_IS_HTTPS) && *helper != '\0') {
+	FD_t tfd = rpmMkTempFile(NULL, &dest);
+	if (tfd != NULL) {
+	    Fclose(tfd);
+	    fdno = open(dest, O_RDWR);
+	    unlink(dest);
+	}
+	if (fdno >= 0) {
+	    urlRange *r = xcalloc(1, sizeof(*r));
+	    r->url = xstrdup(url);
+	    r->chunk = URL_RANGE_CHUNK;
+	    fd = fdNew(fdno, url);
+	    fd->flags = flags;
+	    fd->fps->io = rangeio;
+	    fd->fps->fp = r;
+	}
+	free(dest);
+    }
+    free(helper);
+    return fd;
+}
+
 /*
  * Deal with remote url's by fetching them with a helper application
  * and treat as local file afterwards.
  * TODO:
- * - better error checking + reporting 
+ * - better error checking + reporting
  * - curl & friends don't know about hkp://, transform to http?
  */
 
@@ -465,6 +789,13 @@ static FD_t urlOpen(const char * url, int flags, mode_t mode)
     char *dest = NULL;
     int rc = 1; /* assume failure */
 
+    /* read-only consumers mostly want the front, fetch ranges lazily */
+    if ((flags & O_ACCMODE) == O_RDONLY) {
+	fd = urlRangeOpen(url, flags, mode);
+	if (fd != NULL)
+	    return fd;
+    }
+
     fd = rpmMkTempFile(NULL, &dest);
     if (fd == NULL) {
 	return NULL;
@@ -517,7 +848,9 @@ fprintf(stderr, "*** ufdOpen(%s,0x%x,0%o)\n", url, (unsigned)flags, (unsigned)mo
     }
 
     if (fd != NULL) {
-	fd->fps->io = ufdio;
+	/* range-fetched remote files keep their own io */
+	if (fd->fps->io != rangeio)
+	    fd->fps->io = ufdio;
 	fd->urlType = urlType;
     }
     return fd;
@@ -755,8 +1088,8 @@ static const FDIO_t bzdio = &bzdio_s ;
 #define kBufferSize (1 << 15)
 
 typedef struct lzfile {
-  /* IO buffer */
-    uint8_t buf[kBufferSize];
+  /* IO buffer (pooled, kBufferSize bytes) */
+    uint8_t *buf;
 
     lzma_stream strm;
 
@@ -810,6 +1143,7 @@ static LZFILE *lzopen_internal(const char *mode, int fd, int xz)
     if (!fp)
 	return NULL;
     lzfile = calloc(1, sizeof(*lzfile));
+    lzfile->buf = iobufGet(kBufferSize);
     lzfile->file = fp;
     lzfile->encoding = encoding;
     lzfile->eof = 0;
@@ -858,6 +1192,7 @@ static LZFILE *lzopen_internal(const char *mode, int fd, int xz)
 		break;
 	}
 	fclose(fp);
+	iobufPut(lzfile->buf);
 	free(lzfile);
 	return NULL;
     }
@@ -888,6 +1223,7 @@ static int lzclose(LZFILE *lzfile)
     }
     lzma_end(&lzfile->strm);
     rc = fclose(lzfile->file);
+    iobufPut(lzfile->buf);
     free(lzfile);
     return rc;
 }
@@ -1036,6 +1372,33 @@ static const FDIO_t lzdio = &lzdio_s;
 
 #include <zstd.h>
 
+/*
+ * Read-side prefetch: with the 'T' mode flag (the read equivalent of
+ * the threaded "w7T" write mode) a dedicated thread keeps decompressing
+ * the stream into a small ring of buffers ahead of fdRead consumers, so
+ * decompression overlaps with whatever the caller does with the data.
+ */
+#define ZSTD_PREFETCH_NBUF 8
+
+struct zstdPrefetch_s {
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t filled;	/*!< producer -> consumer */
+    pthread_cond_t emptied;	/*!< consumer -> producer */
+    struct {
+	uint8_t *b;
+	size_t len;		/*!< decompressed bytes in buffer */
+	size_t pos;		/*!< consumer read offset */
+    } ring[ZSTD_PREFETCH_NBUF];
+    size_t bufsize;
+    int head;			/*!< producer fill index */
+    int tail;			/*!< consumer drain index */
+    int count;			/*!< filled buffers in ring */
+    int eof;			/*!< producer reached end of stream */
+    int shutdown;		/*!< consumer is closing down */
+    const char *err;		/*!< producer side error (sticky) */
+};
+
 typedef struct rpmzstd_s {
     int flags;			/*!< open flags. */
     int fdno;
@@ -1046,8 +1409,415 @@ typedef struct rpmzstd_s {
     void * b;
     ZSTD_inBuffer zib;          /*!< ZSTD_inBuffer */
     ZSTD_outBuffer zob;         /*!< ZSTD_outBuffer */
+    struct zstdPrefetch_s *pfc; /*!< read-ahead state (NULL if disabled) */
+    struct zstdChunkPool_s *cpool; /*!< chunked writer state (NULL if disabled) */
 } * rpmzstd;
 
+/* Decompress one ring buffer full (or whatever is left of the stream) */
+static int zstdPrefetchFill(rpmzstd zstd, ZSTD_outBuffer *zob)
+{
+    while (zob->pos < zob->size) {
+	/* Re-fill compressed data buffer. */
+	if (zstd->zib.pos >= zstd->zib.size) {
+	    zstd->zib.size = fread(zstd->b, 1, zstd->nb, zstd->fp);
+	    if (zstd->zib.size == 0)
+		break;		/* EOF */
+	    zstd->zib.src  = zstd->b;
+	    zstd->zib.pos  = 0;
+	}
+
+	/* Decompress next chunk. */
+	int xx = ZSTD_decompressStream(zstd->_stream, zob, &zstd->zib);
+	if (ZSTD_isError(xx)) {
+	    zstd->pfc->err = ZSTD_getErrorName(xx);
+	    return -1;
+	}
+    }
+    return (zob->pos > 0) ? 1 : 0;
+}
+
+static void * zstdPrefetchThread(void *data)
+{
+    rpmzstd zstd = (rpmzstd) data;
+    struct zstdPrefetch_s *pfc = zstd->pfc;
+
+    pthread_mutex_lock(&pfc->lock);
+    while (!pfc->shutdown) {
+	int rc;
+
+	if (pfc->count == ZSTD_PREFETCH_NBUF) {
+	    pthread_cond_wait(&pfc->emptied, &pfc->lock);
+	    continue;
+	}
+
+	ZSTD_outBuffer zob = { pfc->ring[pfc->head].b, pfc->bufsize, 0 };
+	/* The stream state is producer-private, decompress unlocked. */
+	pthread_mutex_unlock(&pfc->lock);
+	rc = zstdPrefetchFill(zstd, &zob);
+	pthread_mutex_lock(&pfc->lock);
+
+	if (rc > 0) {
+	    pfc->ring[pfc->head].len = zob.pos;
+	    pfc->ring[pfc->head].pos = 0;
+	    pfc->head = (pfc->head + 1) % ZSTD_PREFETCH_NBUF;
+	    pfc->count++;
+	    pthread_cond_signal(&pfc->filled);
+	} else {
+	    /* EOF or error, either way we're done here */
+	    pfc->eof = 1;
+	    pthread_cond_signal(&pfc->filled);
+	    break;
+	}
+    }
+    pthread_mutex_unlock(&pfc->lock);
+    return NULL;
+}
+
+static struct zstdPrefetch_s * zstdPrefetchNew(rpmzstd zstd)
+{
+    struct zstdPrefetch_s *pfc = xcalloc(1, sizeof(*pfc));
+
+    pfc->bufsize = ZSTD_DStreamOutSize();
+    for (int i = 0; i < ZSTD_PREFETCH_NBUF; i++)
+	pfc->ring[i].b = iobufGet(pfc->bufsize);
+    pthread_mutex_init(&pfc->lock, NULL);
+    pthread_cond_init(&pfc->filled, NULL);
+    pthread_cond_init(&pfc->emptied, NULL);
+
+    zstd->pfc = pfc;
+    if (pthread_create(&pfc->thread, NULL, zstdPrefetchThread, zstd)) {
+	/* No thread, no read-ahead: fall back to on-demand reads */
+	pthread_mutex_destroy(&pfc->lock);
+	pthread_cond_destroy(&pfc->filled);
+	pthread_cond_destroy(&pfc->emptied);
+	for (int i = 0; i < ZSTD_PREFETCH_NBUF; i++)
+	    iobufPut(pfc->ring[i].b);
+	pfc = _free(pfc);
+	zstd->pfc = NULL;
+    }
+    return pfc;
+}
+
+static void zstdPrefetchFree(rpmzstd zstd)
+{
+    struct zstdPrefetch_s *pfc = zstd->pfc;
+
+    pthread_mutex_lock(&pfc->lock);
+    pfc->shutdown = 1;
+    pthread_cond_signal(&pfc->emptied);
+    pthread_mutex_unlock(&pfc->lock);
+    pthread_join(pfc->thread, NULL);
+
+    pthread_mutex_destroy(&pfc->lock);
+    pthread_cond_destroy(&pfc->filled);
+    pthread_cond_destroy(&pfc->emptied);
+    for (int i = 0; i < ZSTD_PREFETCH_NBUF; i++)
+	iobufPut(pfc->ring[i].b);
+    zstd->pfc = _free(pfc);
+}
+
+static ssize_t zstdPrefetchRead(rpmzstd zstd, void * buf, size_t count)
+{
+    struct zstdPrefetch_s *pfc = zstd->pfc;
+    size_t total = 0;
+
+    pthread_mutex_lock(&pfc->lock);
+    while (total < count) {
+	if (pfc->count == 0) {
+	    if (pfc->eof)
+		break;
+	    pthread_cond_wait(&pfc->filled, &pfc->lock);
+	    continue;
+	}
+
+	size_t left = pfc->ring[pfc->tail].len - pfc->ring[pfc->tail].pos;
+	size_t n = (count - total) < left ? (count - total) : left;
+	memcpy((uint8_t *)buf + total,
+	       pfc->ring[pfc->tail].b + pfc->ring[pfc->tail].pos, n);
+	pfc->ring[pfc->tail].pos += n;
+	total += n;
+
+	if (pfc->ring[pfc->tail].pos == pfc->ring[pfc->tail].len) {
+	    pfc->tail = (pfc->tail + 1) % ZSTD_PREFETCH_NBUF;
+	    pfc->count--;
+	    pthread_cond_signal(&pfc->emptied);
+	}
+    }
+    int failed = (total == 0 && pfc->err != NULL);
+    pthread_mutex_unlock(&pfc->lock);
+
+    return failed ? -1 : total;
+}
+
+/*
+ * Write-side chunked compression: with the 'C' mode flag (in addition
+ * to 'T') the stream is cut into fixed-size chunks, each compressed
+ * into an independent zstd frame by a pool of worker threads and
+ * written out in input order.  Concatenated frames are a standard
+ * zstd stream to any decoder, and the frame boundaries permit
+ * parallel decompression of the result.
+ */
+#define ZSTD_CHUNK_SIZE (4 << 20)
+#define ZSTD_CHUNK_NSLOT 16
+
+enum zstdChunkState {
+    CHUNK_EMPTY	= 0,		/*!< free, or being filled by producer */
+    CHUNK_FILLED,		/*!< full, waiting for a worker */
+    CHUNK_BUSY,			/*!< being compressed by a worker */
+    CHUNK_DONE,			/*!< compressed, waiting for write-out */
+};
+
+struct zstdChunkSlot_s {
+    uint8_t *in;		/*!< uncompressed chunk (ZSTD_CHUNK_SIZE) */
+    size_t inlen;
+    uint8_t *out;		/*!< compressed frame (worker-allocated) */
+    size_t outlen;
+    enum zstdChunkState state;
+    const char *err;		/*!< worker side error (sticky) */
+};
+
+struct zstdChunkPool_s {
+    struct zstdChunkSlot_s slot[ZSTD_CHUNK_NSLOT];
+    pthread_t *threads;
+    int nthreads;
+    pthread_mutex_t lock;
+    pthread_cond_t work;	/*!< producer -> workers: slot filled */
+    pthread_cond_t done;	/*!< workers -> producer: slot compressed */
+    int head;			/*!< next slot the producer fills */
+    int tail;			/*!< next slot to write out */
+    int level;			/*!< compression level */
+    int started;		/*!< at least one chunk was submitted */
+    int shutdown;
+    uint64_t *framecofs;	/*!< compressed offset of each frame */
+    uint64_t *frameuofs;	/*!< uncompressed offset of each frame */
+    size_t nframes;
+    size_t nframealloc;
+    uint64_t coff;		/*!< compressed bytes written so far */
+    uint64_t uoff;		/*!< uncompressed bytes written so far */
+};
+
+static void *zstdChunkWorker(void *data)
+{
+    struct zstdChunkPool_s *pool = data;
+    ZSTD_CCtx *cctx = ZSTD_createCCtx();
+
+    if (cctx == NULL)
+	return NULL;
+    ZSTD_CCtx_setParameter(cctx, ZSTD_c_compressionLevel, pool->level);
+
+    pthread_mutex_lock(&pool->lock);
+    for (;;) {
+	struct zstdChunkSlot_s *slot = NULL;
+
+	/* Claim the oldest filled slot to keep workers roughly in order */
+	for (int i = 0; i < ZSTD_CHUNK_NSLOT; i++) {
+	    int j = (pool->tail + i) % ZSTD_CHUNK_NSLOT;
+	    if (pool->slot[j].state == CHUNK_FILLED) {
+		slot = &pool->slot[j];
+		break;
+	    }
+	}
+
+	if (slot == NULL) {
+	    if (pool->shutdown)
+		break;
+	    pthread_cond_wait(&pool->work, &pool->lock);
+	    continue;
+	}
+
+	slot->state = CHUNK_BUSY;
+	pthread_mutex_unlock(&pool->lock);
+
+	size_t bound = ZSTD_compressBound(slot->inlen);
+	slot->out = iobufGet(bound);
+	size_t n = ZSTD_compress2(cctx, slot->out, bound,
+				  slot->in, slot->inlen);
+
+	pthread_mutex_lock(&pool->lock);
+	if (ZSTD_isError(n))
+	    slot->err = ZSTD_getErrorName(n);
+	else
+	    slot->outlen = n;
+	slot->state = CHUNK_DONE;
+	pthread_cond_broadcast(&pool->done);
+    }
+    pthread_mutex_unlock(&pool->lock);
+
+    ZSTD_freeCCtx(cctx);
+    return NULL;
+}
+
+/* Write out the oldest chunk in order; lock must be held. */
+static int zstdChunkReap(rpmzstd zstd, const char **errp)
+{
+    struct zstdChunkPool_s *pool = zstd->cpool;
+    struct zstdChunkSlot_s *slot = &pool->slot[pool->tail];
+
+    while (slot->state == CHUNK_FILLED || slot->state == CHUNK_BUSY)
+	pthread_cond_wait(&pool->done, &pool->lock);
+
+    if (slot->state != CHUNK_DONE)
+	return 0;
+
+    if (slot->err) {
+	*errp = slot->err;
+	return -1;
+    }
+    if (slot->outlen != fwrite(slot->out, 1, slot->outlen, zstd->fp)) {
+	*errp = "zstdWrite fwrite failed.";
+	return -1;
+    }
+
+    /* Record the frame location for a possible payload index */
+    if (pool->nframes == pool->nframealloc) {
+	pool->nframealloc = pool->nframealloc ? pool->nframealloc * 2 : 64;
+	pool->framecofs = xrealloc(pool->framecofs,
+				pool->nframealloc * sizeof(*pool->framecofs));
+	pool->frameuofs = xrealloc(pool->frameuofs,
+				pool->nframealloc * sizeof(*pool->frameuofs));
+    }
+    pool->framecofs[pool->nframes] = pool->coff;
+    pool->frameuofs[pool->nframes] = pool->uoff;
+    pool->nframes++;
+    pool->coff += slot->outlen;
+    pool->uoff += slot->inlen;
+
+    slot->out = iobufPut(slot->out);
+    slot->outlen = 0;
+    slot->inlen = 0;
+    slot->state = CHUNK_EMPTY;
+    pool->tail = (pool->tail + 1) % ZSTD_CHUNK_NSLOT;
+    return 0;
+}
+
+/* Hand the (full or final partial) head slot to the workers; lock held. */
+static void zstdChunkSubmit(struct zstdChunkPool_s *pool)
+{
+    pool->slot[pool->head].state = CHUNK_FILLED;
+    pool->head = (pool->head + 1) % ZSTD_CHUNK_NSLOT;
+    pool->started = 1;
+    pthread_cond_signal(&pool->work);
+}
+
+static ssize_t zstdChunkWrite(rpmzstd zstd, const void *buf, size_t count,
+			      const char **errp)
+{
+    struct zstdChunkPool_s *pool = zstd->cpool;
+    const uint8_t *p = buf;
+    size_t left = count;
+
+    while (left > 0) {
+	struct zstdChunkSlot_s *slot = &pool->slot[pool->head];
+
+	pthread_mutex_lock(&pool->lock);
+	/* Ring full: wait for the oldest chunk and write it out */
+	while (slot->state != CHUNK_EMPTY) {
+	    if (zstdChunkReap(zstd, errp)) {
+		pthread_mutex_unlock(&pool->lock);
+		return -1;
+	    }
+	}
+	pthread_mutex_unlock(&pool->lock);
+
+	/* Producer owns empty slots, no lock needed to fill them */
+	size_t n = ZSTD_CHUNK_SIZE - slot->inlen;
+	if (n > left)
+	    n = left;
+	memcpy(slot->in + slot->inlen, p, n);
+	slot->inlen += n;
+	p += n;
+	left -= n;
+
+	if (slot->inlen == ZSTD_CHUNK_SIZE) {
+	    pthread_mutex_lock(&pool->lock);
+	    zstdChunkSubmit(pool);
+	    pthread_mutex_unlock(&pool->lock);
+	}
+    }
+    return count;
+}
+
+/*
+ * Submit any partial chunk and write out everything in flight.
+ * At close time (final) an empty stream still gets its empty frame.
+ */
+static int zstdChunkFlush(rpmzstd zstd, int final, const char **errp)
+{
+    struct zstdChunkPool_s *pool = zstd->cpool;
+    int rc = 0;
+
+    pthread_mutex_lock(&pool->lock);
+    struct zstdChunkSlot_s *slot = &pool->slot[pool->head];
+    if (slot->state == CHUNK_EMPTY &&
+	(slot->inlen > 0 || (final && !pool->started)))
+    {
+	zstdChunkSubmit(pool);
+    }
+
+    while (pool->slot[pool->tail].state != CHUNK_EMPTY) {
+	if ((rc = zstdChunkReap(zstd, errp)) != 0)
+	    break;
+    }
+    pthread_mutex_unlock(&pool->lock);
+
+    return rc;
+}
+
+static struct zstdChunkPool_s *zstdChunkPoolNew(int level, int nthreads)
+{
+    struct zstdChunkPool_s *pool = xcalloc(1, sizeof(*pool));
+
+    pool->level = level;
+    pool->nthreads = 0;
+    pool->threads = xcalloc(nthreads, sizeof(*pool->threads));
+    for (int i = 0; i < ZSTD_CHUNK_NSLOT; i++)
+	pool->slot[i].in = iobufGet(ZSTD_CHUNK_SIZE);
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->work, NULL);
+    pthread_cond_init(&pool->done, NULL);
+
+    for (int i = 0; i < nthreads; i++) {
+	if (pthread_create(&pool->threads[i], NULL, zstdChunkWorker, pool))
+	    break;
+	pool->nthreads++;
+    }
+
+    if (pool->nthreads == 0) {
+	pthread_mutex_destroy(&pool->lock);
+	pthread_cond_destroy(&pool->work);
+	pthread_cond_destroy(&pool->done);
+	for (int i = 0; i < ZSTD_CHUNK_NSLOT; i++)
+	    iobufPut(pool->slot[i].in);
+	free(pool->threads);
+	pool = _free(pool);
+    }
+    return pool;
+}
+
+static void zstdChunkPoolFree(rpmzstd zstd)
+{
+    struct zstdChunkPool_s *pool = zstd->cpool;
+
+    pthread_mutex_lock(&pool->lock);
+    pool->shutdown = 1;
+    pthread_cond_broadcast(&pool->work);
+    pthread_mutex_unlock(&pool->lock);
+    for (int i = 0; i < pool->nthreads; i++)
+	pthread_join(pool->threads[i], NULL);
+
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->work);
+    pthread_cond_destroy(&pool->done);
+    for (int i = 0; i < ZSTD_CHUNK_NSLOT; i++) {
+	iobufPut(pool->slot[i].in);
+	iobufPut(pool->slot[i].out);
+    }
+    free(pool->framecofs);
+    free(pool->frameuofs);
+    free(pool->threads);
+    zstd->cpool = _free(pool);
+}
+
 static rpmzstd rpmzstdNew(int fdno, const char *fmode)
 {
     int flags = 0;
@@ -1058,6 +1828,7 @@ static rpmzstd rpmzstdNew(int fdno, const char *fmode)
     char *te = t + sizeof(stdio) - 2;
     int c;
     int threads = 0;
+    int chunked = 0;
 
     switch ((c = *s++)) {
     case 'a':
@@ -1094,6 +1865,9 @@ static rpmzstd rpmzstdNew(int fdno, const char *fmode)
 		    threads = -1;
 	    }
 	    continue;
+	case 'C':
+	    chunked = 1;
+	    continue;
 	default:
 	    if (c >= (int)'0' && c <= (int)'9') {
 		level = strtol(s-1, (char **)&s, 10);
@@ -1131,8 +1905,11 @@ static rpmzstd rpmzstdNew(int fdno, const char *fmode)
 	    goto err;
 	}
 
+	/* 'C' without an explicit thread count implies auto detection */
+	if (chunked && threads == 0)
+	    threads = -1;
 	threads = get_compression_threads(threads);
-	if (threads > 0) {
+	if (threads > 0 && !chunked) {
 	    if (ZSTD_isError (ZSTD_CCtx_setParameter(_stream, ZSTD_c_nbWorkers, threads)))
 		rpmlog(RPMLOG_DEBUG, "zstd library does not support multi-threading\n");
 	}
@@ -1147,7 +1924,15 @@ static rpmzstd rpmzstdNew(int fdno, const char *fmode)
     zstd->fp = fp;
     zstd->_stream = _stream;
     zstd->nb = nb;
-    zstd->b = xmalloc(nb);
+    zstd->b = iobufGet(nb);
+
+    /* On read, the 'T' flag enables decompression read-ahead */
+    if ((flags & O_ACCMODE) == O_RDONLY && threads != 0)
+	(void) zstdPrefetchNew(zstd);
+
+    /* On write, the 'C' flag cuts the stream into worker-compressed frames */
+    if ((flags & O_ACCMODE) != O_RDONLY && chunked && threads > 0)
+	zstd->cpool = zstdChunkPoolNew(level, threads);
 
     return zstd;
 
@@ -1180,6 +1965,11 @@ assert(zstd);
 
     if ((zstd->flags & O_ACCMODE) == O_RDONLY) { /* decompressing */
 	rc = 0;
+    } else if (zstd->cpool) {			/* chunked compression */
+	const char *err = NULL;
+	rc = zstdChunkFlush(zstd, 0, &err);
+	if (err)
+	    fps->errcookie = err;
     } else {					/* compressing */
 	/* close frame */
 	int xx;
@@ -1210,6 +2000,13 @@ static ssize_t zstdRead(FDSTACK_t fps, void * buf, size_t count)
 assert(zstd);
     ZSTD_outBuffer zob = { buf, count, 0 };
 
+    if (zstd->pfc) {
+	ssize_t rc = zstdPrefetchRead(zstd, buf, count);
+	if (rc < 0)
+	    fps->errcookie = zstd->pfc->err;
+	return rc;
+    }
+
     while (zob.pos < zob.size) {
 	/* Re-fill compressed data buffer. */
 	if (zstd->zib.pos >= zstd->zib.size) {
@@ -1236,6 +2033,14 @@ static ssize_t zstdWrite(FDSTACK_t fps, const void * buf, size_t count)
 assert(zstd);
     ZSTD_inBuffer zib = { buf, count, 0 };
 
+    if (zstd->cpool) {
+	const char *err = NULL;
+	ssize_t rc = zstdChunkWrite(zstd, buf, count, &err);
+	if (err)
+	    fps->errcookie = err;
+	return rc;
+    }
+
     while (zib.pos < zib.size) {
 
 	/* Reset to beginning of compressed data buffer. */
@@ -1270,7 +2075,16 @@ assert(zstd);
 
     if ((zstd->flags & O_ACCMODE) == O_RDONLY) { /* decompressing */
 	rc = 0;
+	if (zstd->pfc)
+	    zstdPrefetchFree(zstd);
 	ZSTD_freeDStream(zstd->_stream);
+    } else if (zstd->cpool) {			/* chunked compression */
+	const char *err = NULL;
+	rc = zstdChunkFlush(zstd, 1, &err);
+	if (err)
+	    fps->errcookie = err;
+	zstdChunkPoolFree(zstd);
+	ZSTD_freeCCtx(zstd->_stream);
     } else {					/* compressing */
 	/* close frame */
 	int xx;
@@ -1297,7 +2111,7 @@ assert(zstd);
     if (zstd->fp && fileno(zstd->fp) > 2)
 	(void) fclose(zstd->fp);
 
-    if (zstd->b) free(zstd->b);
+    iobufPut(zstd->b);
     free(zstd);
 
     return rc;
@@ -1312,6 +2126,28 @@ static const FDIO_t zstdio = &zstdio_s ;
 
 #endif	/* HAVE_ZSTD */
 
+int fdZstdFrameIndex(FD_t fd, uint64_t **compofsp, uint64_t **ucompofsp,
+		     size_t *nframesp)
+{
+#ifdef HAVE_ZSTD
+    FDSTACK_t fps = fdGetFps(fd);
+
+    if (fps && fps->io == zstdio) {
+	rpmzstd zstd = (rpmzstd) fps->fp;
+	struct zstdChunkPool_s *pool = zstd->cpool;
+
+	if (pool && pool->nframes > 0) {
+	    size_t nb = pool->nframes * sizeof(*pool->framecofs);
+	    *compofsp = memcpy(xmalloc(nb), pool->framecofs, nb);
+	    *ucompofsp = memcpy(xmalloc(nb), pool->frameuofs, nb);
+	    *nframesp = pool->nframes;
+	    return 0;
+	}
+    }
+#endif
+    return -1;
+}
+
 /* =============================================================== */
 
 #define	FDIOVEC(_fps, _vec)	\
@@ -1332,6 +2168,47 @@ const char *Fstrerror(FD_t fd)
     return err;
 }
 
+/*
+ * One-shot data: advise the kernel to drop the consumed pages from the
+ * page cache every once in a while so that reading a large compose does
+ * not evict everybody else's cached data. The last partial page is kept,
+ * a reader may still be positioned inside it.
+ */
+#define FDNOCACHE_CHUNK	(1 << 24)
+
+int fdSetNoCache(FD_t fd)
+{
+    int fdno = Fileno(fd);
+    if (fdno < 0)
+	return -1;
+    fd->nocache = 1;
+    fd->nocache_drop = 0;
+    /* the data is read exactly once, but readahead is still welcome */
+    return posix_fadvise(fdno, 0, 0, POSIX_FADV_SEQUENTIAL);
+}
+
+static void fdNoCacheDrop(FD_t fd, int final)
+{
+    int fdno = Fileno(fd);
+    off_t pos;
+
+    if (fdno < 0)
+	return;
+    if (final) {
+	(void) posix_fadvise(fdno, 0, 0, POSIX_FADV_DONTNEED);
+	return;
+    }
+    pos = lseek(fdno, 0, SEEK_CUR);
+    if (pos == (off_t)-1 || pos - fd->nocache_drop < FDNOCACHE_CHUNK)
+	return;
+    pos &= ~((off_t)4095);
+    if (pos > fd->nocache_drop) {
+	(void) posix_fadvise(fdno, fd->nocache_drop,
+			     pos - fd->nocache_drop, POSIX_FADV_DONTNEED);
+	fd->nocache_drop = pos;
+    }
+}
+
 ssize_t Fread(void *buf, size_t size, size_t nmemb, FD_t fd)
 {
     ssize_t rc = -1;
@@ -1348,6 +2225,9 @@ ssize_t Fread(void *buf, size_t size, size_t nmemb, FD_t fd)
 
 	if (fd->digests && rc > 0)
 	    fdUpdateDigests(fd, buf, rc);
+
+	if (fd->nocache && rc > 0)
+	    fdNoCacheDrop(fd, 0);
     }
 
     DBGIO(fd, (stderr, "==>\tFread(%p,%p,%ld) rc %ld %s\n",
@@ -1380,6 +2260,91 @@ ssize_t Fwrite(const void *buf, size_t size, size_t nmemb, FD_t fd)
     return rc;
 }
 
+ssize_t Fwritev(FD_t fd, const struct iovec *iov, int iovcnt)
+{
+    ssize_t rc = -1;
+
+    if (fd != NULL) {
+	FDSTACK_t fps = fdGetFps(fd);
+
+	if (fps->io == fdio || fps->io == ufdio) {
+	    fdstat_enter(fd, FDSTAT_WRITE);
+	    do {
+		rc = writev(fps->fdno, iov, iovcnt);
+	    } while (rc == -1 && errno == EINTR);
+	    fdstat_exit(fd, FDSTAT_WRITE, rc);
+
+	    if (fd->digests && rc > 0) {
+		size_t left = rc;
+		for (int i = 0; i < iovcnt && left > 0; i++) {
+		    size_t nb = (left < iov[i].iov_len) ? left : iov[i].iov_len;
+		    fdUpdateDigests(fd, iov[i].iov_base, nb);
+		    left -= nb;
+		}
+	    }
+	} else {
+	    /* This layer can't take vectors, write out the segments */
+	    rc = 0;
+	    for (int i = 0; i < iovcnt; i++) {
+		ssize_t nb = Fwrite(iov[i].iov_base, 1, iov[i].iov_len, fd);
+		if (nb > 0)
+		    rc += nb;
+		if (nb != (ssize_t)iov[i].iov_len)
+		    break;
+	    }
+	}
+    }
+
+    DBGIO(fd, (stderr, "==>\tFwritev(%p,%p,%d) rc %ld %s\n",
+	  fd, iov, iovcnt, (long)rc, fdbg(fd)));
+
+    return rc;
+}
+
+ssize_t Freadv(FD_t fd, const struct iovec *iov, int iovcnt)
+{
+    ssize_t rc = -1;
+
+    if (fd != NULL) {
+	FDSTACK_t fps = fdGetFps(fd);
+
+	if (fps->io == fdio || fps->io == ufdio) {
+	    fdstat_enter(fd, FDSTAT_READ);
+	    do {
+		rc = readv(fps->fdno, iov, iovcnt);
+	    } while (rc == -1 && errno == EINTR);
+	    fdstat_exit(fd, FDSTAT_READ, rc);
+
+	    if (fd->digests && rc > 0) {
+		size_t left = rc;
+		for (int i = 0; i < iovcnt && left > 0; i++) {
+		    size_t nb = (left < iov[i].iov_len) ? left : iov[i].iov_len;
+		    fdUpdateDigests(fd, iov[i].iov_base, nb);
+		    left -= nb;
+		}
+	    }
+
+	    if (fd->nocache && rc > 0)
+		fdNoCacheDrop(fd, 0);
+	} else {
+	    /* This layer can't take vectors, read into the segments */
+	    rc = 0;
+	    for (int i = 0; i < iovcnt; i++) {
+		ssize_t nb = Fread(iov[i].iov_base, 1, iov[i].iov_len, fd);
+		if (nb > 0)
+		    rc += nb;
+		if (nb != (ssize_t)iov[i].iov_len)
+		    break;
+	    }
+	}
+    }
+
+    DBGIO(fd, (stderr, "==>\tFreadv(%p,%p,%d) rc %ld %s\n",
+	  fd, iov, iovcnt, (long)rc, fdbg(fd)));
+
+    return rc;
+}
+
 int Fseek(FD_t fd, off_t offset, int whence)
 {
     int rc = -1;
@@ -1407,6 +2372,8 @@ int Fclose(FD_t fd)
 	return -1;
 
     fd = fdLink(fd);
+    if (fd->nocache)
+	fdNoCacheDrop(fd, 1);
     fdstat_enter(fd, FDSTAT_CLOSE);
     for (FDSTACK_t fps = fd->fps; fps != NULL; fps = fdPop(fd)) {
 	if (fps->fdno >= 0) {
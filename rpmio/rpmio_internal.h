@@ -5,6 +5,8 @@
  * \file rpmio/rpmio_internal.h
  */
 
+#include <sys/uio.h>
+
 #include <rpm/rpmio.h>
 #include <rpm/rpmpgp.h>
 
@@ -12,6 +14,46 @@
 extern "C" {
 #endif
 
+/** \ingroup rpmio
+ * Fwrite(3) clone for a vector of buffers, avoiding an intermediate
+ * copy of the data. Uses writev(2) where the fd permits, otherwise
+ * the segments are written one by one.
+ * @param fd		file handle
+ * @param iov		array of buffers to write
+ * @param iovcnt	number of buffers
+ * @return		number of bytes written
+ */
+ssize_t Fwritev(FD_t fd, const struct iovec *iov, int iovcnt);
+
+/** \ingroup rpmio
+ * Fread(3) clone for a vector of buffers, avoiding an intermediate
+ * copy of the data. Uses readv(2) where the fd permits, otherwise
+ * the segments are filled one by one.
+ * @param fd		file handle
+ * @param iov		array of buffers to fill
+ * @param iovcnt	number of buffers
+ * @return		number of bytes read
+ */
+ssize_t Freadv(FD_t fd, const struct iovec *iov, int iovcnt);
+
+/** \ingroup rpmio
+ * Mark the data behind fd as one-shot: advise the kernel to read ahead
+ * sequentially and to drop consumed pages from the page cache, so that
+ * streaming large amounts of package data does not evict other caches.
+ * Purely advisory, remaining pages are dropped on Fclose().
+ * @param fd		file handle
+ * @return		0 on success
+ */
+int fdSetNoCache(FD_t fd);
+
+/** \ingroup rpmio
+ * Is fd a plain single layer descriptor stream without compression,
+ * i.e. do descriptor offsets match stream offsets?
+ * @param fd		file handle
+ * @return		1 if plain, 0 otherwise
+ */
+int fdPlain(FD_t fd);
+
 void fdSetBundle(FD_t fd, rpmDigestBundle bundle);
 rpmDigestBundle fdGetBundle(FD_t fd, int create);
 
@@ -31,6 +73,18 @@ void fdFiniDigest(FD_t fd, int id,
 
 DIGEST_CTX fdDupDigest(FD_t fd, int id);
 
+/** \ingroup rpmio
+ * Retrieve the frame index of a chunked zstd writer fd ('C' mode flag).
+ * Only complete once all data has been flushed out, i.e. after Fflush().
+ * @param fd		chunked zstd writer fd
+ * @param[out] compofsp	(malloc'd) compressed offset of each frame
+ * @param[out] ucompofsp (malloc'd) uncompressed offset of each frame
+ * @param[out] nframesp	number of frames
+ * @return		0 on success, -1 if fd has no frame index
+ */
+int fdZstdFrameIndex(FD_t fd, uint64_t **compofsp, uint64_t **ucompofsp,
+		     size_t *nframesp);
+
 /**
  * Read an entire file into a buffer.
  * @param fn		file name to read
@@ -24,13 +24,79 @@ struct rpmPubkey_s {
     pthread_rwlock_t lock;
 };
 
+/*
+ * Memo of successful signature verifications. Re-verification of
+ * just-verified content is common (eg download check followed by the
+ * install-time open of the same package), and each public key operation
+ * costs on the order of a millisecond. An entry binds the finalized
+ * digest of the signed range to the signature metadata; only RPMRC_OK
+ * is ever memoized, so importing additional keys (which can only turn
+ * NOKEY into OK) never makes an entry stale. The memo lives in the
+ * keyring because a verdict is only valid against the set of keys it
+ * was computed with.
+ */
+#define VSMEMO_MAXENTS 256
+
+struct vsMemoEnt_s {
+    pgpKeyID_t signid;		/*!< issuer key id */
+    uint32_t time;		/*!< signature creation time */
+    uint8_t pubkey_algo;
+    uint8_t hash_algo;
+    uint8_t signhash16[2];
+    uint8_t dig[64];		/*!< finalized range digest */
+    size_t diglen;
+    uint64_t stamp;		/*!< LRU clock */
+};
+
 struct rpmKeyring_s {
     struct rpmPubkey_s **keys;
     size_t numkeys;
     int nrefs;
     pthread_rwlock_t lock;
+    struct vsMemoEnt_s *memo;	/*!< verified signature memo */
+    size_t nmemo;
+    uint64_t memoclock;
+    pthread_mutex_t memolock;
 };
 
+/*
+ * Process-global cache of parsed pubkeys. Keys are immutable once
+ * created, so instances can be shared freely between keyrings; parsing
+ * the packets is by far the most expensive part of a key load and the
+ * same keys get reloaded for every new keyring (eg per transaction set
+ * in long-lived API users). Capped as a sanity measure, anything
+ * beyond the cap is simply parsed anew.
+ */
+#define PKCACHE_MAXKEYS 128
+static rpmPubkey *pkcache;
+static size_t npkcache;
+static pthread_mutex_t pkcache_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static rpmPubkey pkcacheGet(const uint8_t *pkt, size_t pktlen)
+{
+    rpmPubkey key = NULL;
+    pthread_mutex_lock(&pkcache_mutex);
+    for (size_t i = 0; i < npkcache; i++) {
+	if (pkcache[i]->pktlen == pktlen &&
+		memcmp(pkcache[i]->pkt, pkt, pktlen) == 0) {
+	    key = rpmPubkeyLink(pkcache[i]);
+	    break;
+	}
+    }
+    pthread_mutex_unlock(&pkcache_mutex);
+    return key;
+}
+
+static void pkcachePut(rpmPubkey key)
+{
+    pthread_mutex_lock(&pkcache_mutex);
+    if (npkcache < PKCACHE_MAXKEYS) {
+	pkcache = xrealloc(pkcache, (npkcache + 1) * sizeof(*pkcache));
+	pkcache[npkcache++] = rpmPubkeyLink(key);
+    }
+    pthread_mutex_unlock(&pkcache_mutex);
+}
+
 static int keyidcmp(const void *k1, const void *k2)
 {
     const struct rpmPubkey_s *key1 = *(const struct rpmPubkey_s **) k1;
@@ -46,6 +112,7 @@ rpmKeyring rpmKeyringNew(void)
     keyring->numkeys = 0;
     keyring->nrefs = 1;
     pthread_rwlock_init(&keyring->lock, NULL);
+    pthread_mutex_init(&keyring->memolock, NULL);
     return keyring;
 }
 
@@ -64,6 +131,8 @@ rpmKeyring rpmKeyringFree(rpmKeyring keyring)
 	}
 	pthread_rwlock_unlock(&keyring->lock);
 	pthread_rwlock_destroy(&keyring->lock);
+	pthread_mutex_destroy(&keyring->memolock);
+	free(keyring->memo);
 	free(keyring);
     } else {
 	pthread_rwlock_unlock(&keyring->lock);
@@ -138,6 +207,9 @@ rpmPubkey rpmPubkeyNew(const uint8_t *pkt, size_t pktlen)
     if (pkt == NULL || pktlen == 0)
 	goto exit;
 
+    if ((key = pkcacheGet(pkt, pktlen)) != NULL)
+	goto exit;
+
     if (pgpPubkeyKeyID(pkt, pktlen, keyid))
 	goto exit;
 
@@ -152,6 +224,7 @@ rpmPubkey rpmPubkeyNew(const uint8_t *pkt, size_t pktlen)
     memcpy(key->pkt, pkt, pktlen);
     memcpy(key->keyid, keyid, sizeof(keyid));
     pthread_rwlock_init(&key->lock, NULL);
+    pkcachePut(key);
 
 exit:
     return key;
@@ -312,6 +385,79 @@ rpmRC rpmKeyringLookup(rpmKeyring keyring, pgpDig sig)
     return res;
 }
 
+/* Build the memo key for a signature over ctx, 0 on success */
+static int vsMemoKey(pgpDigParams sig, DIGEST_CTX ctx, struct vsMemoEnt_s *ent)
+{
+    uint8_t *dig = NULL;
+    size_t diglen = 0;
+    DIGEST_CTX clone = rpmDigestDup(ctx);
+    int rc = -1;
+
+    memset(ent, 0, sizeof(*ent));
+    if (clone && rpmDigestFinal(clone, (void **)&dig, &diglen, 0) == 0 &&
+	    diglen > 0 && diglen <= sizeof(ent->dig)) {
+	memcpy(ent->dig, dig, diglen);
+	ent->diglen = diglen;
+	memcpy(ent->signid, sig->signid, sizeof(ent->signid));
+	ent->time = sig->time;
+	ent->pubkey_algo = sig->pubkey_algo;
+	ent->hash_algo = sig->hash_algo;
+	memcpy(ent->signhash16, sig->signhash16, sizeof(ent->signhash16));
+	rc = 0;
+    }
+    free(dig);
+    return rc;
+}
+
+static int vsMemoCmp(const struct vsMemoEnt_s *a, const struct vsMemoEnt_s *b)
+{
+    return !(a->diglen == b->diglen &&
+	    a->time == b->time &&
+	    a->pubkey_algo == b->pubkey_algo &&
+	    a->hash_algo == b->hash_algo &&
+	    memcmp(a->signhash16, b->signhash16, sizeof(a->signhash16)) == 0 &&
+	    memcmp(a->signid, b->signid, sizeof(a->signid)) == 0 &&
+	    memcmp(a->dig, b->dig, a->diglen) == 0);
+}
+
+static int vsMemoLookup(rpmKeyring keyring, const struct vsMemoEnt_s *ent)
+{
+    int found = 0;
+
+    pthread_mutex_lock(&keyring->memolock);
+    for (size_t i = 0; i < keyring->nmemo; i++) {
+	if (vsMemoCmp(&keyring->memo[i], ent) == 0) {
+	    keyring->memo[i].stamp = ++keyring->memoclock;
+	    found = 1;
+	    break;
+	}
+    }
+    pthread_mutex_unlock(&keyring->memolock);
+    return found;
+}
+
+static void vsMemoAdd(rpmKeyring keyring, const struct vsMemoEnt_s *ent)
+{
+    struct vsMemoEnt_s *slot;
+
+    pthread_mutex_lock(&keyring->memolock);
+    if (keyring->nmemo < VSMEMO_MAXENTS) {
+	keyring->memo = xrealloc(keyring->memo,
+			(keyring->nmemo + 1) * sizeof(*keyring->memo));
+	slot = &keyring->memo[keyring->nmemo++];
+    } else {
+	/* Full up, recycle the least recently used entry */
+	slot = &keyring->memo[0];
+	for (size_t i = 1; i < keyring->nmemo; i++) {
+	    if (keyring->memo[i].stamp < slot->stamp)
+		slot = &keyring->memo[i];
+	}
+    }
+    *slot = *ent;
+    slot->stamp = ++keyring->memoclock;
+    pthread_mutex_unlock(&keyring->memolock);
+}
+
 rpmRC rpmKeyringVerifySig(rpmKeyring keyring, pgpDigParams sig, DIGEST_CTX ctx)
 {
     rpmRC rc = RPMRC_FAIL;
@@ -322,12 +468,22 @@ rpmRC rpmKeyringVerifySig(rpmKeyring keyring, pgpDigParams sig, DIGEST_CTX ctx)
     if (sig && ctx) {
 	pgpDigParams pgpkey = NULL;
 	rpmPubkey key = findbySig(keyring, sig);
+	struct vsMemoEnt_s ent;
+	int memoable;
 
 	if (key)
 	    pgpkey = key->pgpkey;
 
-	/* We call verify even if key not found for a signature sanity check */
-	rc = pgpVerifySignature(pgpkey, sig, ctx);
+	memoable = (keyring != NULL && pgpkey != NULL &&
+		    vsMemoKey(sig, ctx, &ent) == 0);
+	if (memoable && vsMemoLookup(keyring, &ent)) {
+	    rc = RPMRC_OK;
+	} else {
+	    /* Call verify even if key not found for signature sanity check */
+	    rc = pgpVerifySignature(pgpkey, sig, ctx);
+	    if (memoable && rc == RPMRC_OK)
+		vsMemoAdd(keyring, &ent);
+	}
     }
 
     if (keyring)
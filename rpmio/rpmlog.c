@@ -28,6 +28,13 @@ struct rpmlogRec_s {
     char * message;		/* log message string */
 };
 
+/* Unlocked copy of the priority mask for the filtered-out fast path,
+ * kept in sync by rpmlogSetMask(). Reading a momentarily stale mask
+ * only delays a filtering change, it cannot corrupt anything. */
+static unsigned _rpmlogMask = RPMLOG_UPTO(RPMLOG_NOTICE);
+
+static void logbufFlushSelf(void);
+
 /* Force log context acquisition through a function */
 static rpmlogCtx rpmlogCtxAcquire(int write)
 {
@@ -119,7 +126,11 @@ void rpmlogPrint(FILE *f)
 
 void rpmlogClose (void)
 {
-    rpmlogCtx ctx = rpmlogCtxAcquire(1);
+    rpmlogCtx ctx;
+
+    logbufFlushSelf();
+
+    ctx = rpmlogCtxAcquire(1);
 
     if (ctx == NULL)
 	return;
@@ -150,8 +161,10 @@ int rpmlogSetMask (int mask)
     int omask = -1;
     if (ctx) {
 	omask = ctx->mask;
-	if (mask)
+	if (mask) {
 	    ctx->mask = mask;
+	    _rpmlogMask = mask;
+	}
     }
 
     rpmlogCtxRelease(ctx);
@@ -353,13 +366,140 @@ static int rpmlogDefault(FILE *stdlog, rpmlogRec rec)
     return (rec->pri <= RPMLOG_CRIT ? RPMLOG_EXIT : 0);
 }
 
+static pthread_mutex_t serialize = PTHREAD_MUTEX_INITIALIZER;
+
+/* Emit a single record, serialize mutex must be held */
+static int dologEmit(rpmlogCallback cbfunc, rpmlogCallbackData cbdata,
+		     FILE *clog, rpmlogRec rec)
+{
+    int cbrc = RPMLOG_DEFAULT;
+    int needexit = 0;
+
+    if (cbfunc) {
+	cbrc = cbfunc(rec, cbdata);
+	needexit += cbrc & RPMLOG_EXIT;
+    }
+
+    if (cbrc & RPMLOG_DEFAULT) {
+	cbrc = rpmlogDefault(clog, rec);
+	needexit += cbrc & RPMLOG_EXIT;
+    }
+    return needexit;
+}
+
+/*
+ * Per-thread buffer for debug level messages. Debug floods from
+ * concurrent threads would otherwise take the serializing mutex for
+ * every single message; instead they are collected here and pushed to
+ * the callback/output in batches. Only RPMLOG_DEBUG is ever buffered
+ * so no saved records or fatal exits can get stuck in a buffer, and
+ * any non-debug message from the same thread flushes the buffer first
+ * to keep per-thread ordering intact.
+ */
+#define LOGBUF_NRECS 16
+
+struct logbuf {
+    int nrecs;
+    struct rpmlogRec_s recs[LOGBUF_NRECS];
+};
+
+static pthread_key_t logbufkey;
+static pthread_once_t logbufonce = PTHREAD_ONCE_INIT;
+static int logbufkeyok = 0;
+
+static void logbufFlush(struct logbuf *buf)
+{
+    rpmlogCallback cbfunc = NULL;
+    rpmlogCallbackData cbdata = NULL;
+    FILE *clog = NULL;
+    int needexit = 0;
+    rpmlogCtx ctx;
+
+    if (buf == NULL || buf->nrecs == 0)
+	return;
+
+    if ((ctx = rpmlogCtxAcquire(0)) != NULL) {
+	cbfunc = ctx->cbfunc;
+	cbdata = ctx->cbdata;
+	clog = ctx->stdlog;
+	ctx = rpmlogCtxRelease(ctx);
+    }
+
+    if (pthread_mutex_lock(&serialize) == 0) {
+	for (int i = 0; i < buf->nrecs; i++)
+	    needexit += dologEmit(cbfunc, cbdata, clog, &buf->recs[i]);
+	pthread_mutex_unlock(&serialize);
+    }
+
+    for (int i = 0; i < buf->nrecs; i++)
+	buf->recs[i].message = _free(buf->recs[i].message);
+    buf->nrecs = 0;
+
+    if (needexit)
+	exit(EXIT_FAILURE);
+}
+
+static void logbufDestroy(void *data)
+{
+    struct logbuf *buf = data;
+    if (buf) {
+	logbufFlush(buf);
+	free(buf);
+    }
+}
+
+/* Thread destructors don't run for the thread calling exit() */
+static void logbufAtExit(void)
+{
+    logbufDestroy(pthread_getspecific(logbufkey));
+    pthread_setspecific(logbufkey, NULL);
+}
+
+static void logbufInit(void)
+{
+    if (pthread_key_create(&logbufkey, logbufDestroy) == 0) {
+	logbufkeyok = 1;
+	atexit(logbufAtExit);
+    }
+}
+
+/* Flush the calling thread's buffer (if any) */
+static void logbufFlushSelf(void)
+{
+    if (logbufkeyok)
+	logbufFlush(pthread_getspecific(logbufkey));
+}
+
+/* Stash a copy of rec in the calling thread's buffer, 0 on failure */
+static int logbufAdd(rpmlogRec rec)
+{
+    struct logbuf *buf;
+
+    pthread_once(&logbufonce, logbufInit);
+    if (!logbufkeyok)
+	return 0;
+
+    buf = pthread_getspecific(logbufkey);
+    if (buf == NULL) {
+	buf = xcalloc(1, sizeof(*buf));
+	if (pthread_setspecific(logbufkey, buf) != 0) {
+	    free(buf);
+	    return 0;
+	}
+    }
+
+    buf->recs[buf->nrecs].code = rec->code;
+    buf->recs[buf->nrecs].pri = rec->pri;
+    buf->recs[buf->nrecs].message = xstrdup(rec->message);
+    if (++buf->nrecs == LOGBUF_NRECS)
+	logbufFlush(buf);
+    return 1;
+}
+
 /* FIX: rpmlogMsgPrefix[] dependent, not unqualified */
 /* FIX: rpmlogMsgPrefix[] may be NULL */
 static void dolog(struct rpmlogRec_s *rec, int saverec)
 {
-    static pthread_mutex_t serialize = PTHREAD_MUTEX_INITIALIZER;
-
-    int cbrc = RPMLOG_DEFAULT;
     int needexit = 0;
     FILE *clog = NULL;
     rpmlogCallbackData *cbdata = NULL;
@@ -388,18 +528,10 @@ static void dolog(struct rpmlogRec_s *rec, int saverec)
 
     /* Always serialize callback and output to avoid interleaved messages. */
     if (pthread_mutex_lock(&serialize) == 0) {
-	if (cbfunc) {
-	    cbrc = cbfunc(rec, cbdata);
-	    needexit += cbrc & RPMLOG_EXIT;
-	}
-
-	if (cbrc & RPMLOG_DEFAULT) {
-	    cbrc = rpmlogDefault(clog, rec);
-	    needexit += cbrc & RPMLOG_EXIT;
-	}
+	needexit = dologEmit(cbfunc, cbdata, clog, rec);
 	pthread_mutex_unlock(&serialize);
     }
-    
+
     if (needexit)
 	exit(EXIT_FAILURE);
 
@@ -411,32 +543,42 @@ void rpmlog (int code, const char *fmt, ...)
     unsigned pri = RPMLOG_PRI(code);
     unsigned mask = RPMLOG_MASK(pri);
     int saverec = (pri <= RPMLOG_WARNING);
+    char buf[BUFSIZ];
     va_list ap;
     int n;
 
-    if ((mask & rpmlogSetMask(0)) == 0)
+    /* Filtered-out messages are dropped without taking any locks */
+    if ((mask & _rpmlogMask) == 0)
 	goto exit;
 
     va_start(ap, fmt);
-    n = vsnprintf(NULL, 0, fmt, ap);
+    n = vsnprintf(buf, sizeof(buf), fmt, ap);
     va_end(ap);
 
-    if (n >= -1) {
+    if (n >= 0) {
 	struct rpmlogRec_s rec;
-	size_t nb = n + 1;
-	char *msg = xmalloc(nb);
-
-	va_start(ap, fmt);
-	n = vsnprintf(msg, nb, fmt, ap);
-	va_end(ap);
+	char *msg = buf;
+
+	/* Reformat into a malloced buffer if the message didn't fit */
+	if ((size_t)n >= sizeof(buf)) {
+	    msg = xmalloc(n + 1);
+	    va_start(ap, fmt);
+	    n = vsnprintf(msg, n + 1, fmt, ap);
+	    va_end(ap);
+	}
 
 	rec.code = code;
 	rec.pri = pri;
 	rec.message = msg;
 
-	dolog(&rec, saverec);
+	/* Debug messages can be buffered, everything else flushes first */
+	if (pri != RPMLOG_DEBUG || !logbufAdd(&rec)) {
+	    logbufFlushSelf();
+	    dolog(&rec, saverec);
+	}
 
-	free(msg);
+	if (msg != buf)
+	    free(msg);
     }
 exit:
     errno = saved_errno;
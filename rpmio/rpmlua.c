@@ -26,6 +26,7 @@
 #include <rpm/rpmurl.h>
 #include <rpm/rpmfileutil.h>
 #include <rpm/rpmbase64.h>
+#include <rpm/rpmpgp.h>
 #include <rpm/rpmver.h>
 #include "rpmio/rpmhook.h"
 
@@ -275,6 +276,40 @@ static int luaopt(int c, const char *oarg, int oint, void *data)
     return 0;
 }
 
+/*
+ * Load a script, reusing previously compiled chunks where possible.
+ * Compiled chunks are cached in the Lua registry keyed by body digest:
+ * templated packages share identical scriptlets, no point recompiling
+ * them hundreds of times per transaction. Chunks keep the name they
+ * were first compiled under, callers wanting exact attribution in
+ * diagnostics must log their own name separately.
+ */
+static int luaLoadCached(lua_State *L, const char *buf, const char *name)
+{
+    int ret;
+    char *key = NULL;
+    DIGEST_CTX ctx = rpmDigestInit(PGPHASHALGO_SHA256, RPMDIGEST_NONE);
+
+    rpmDigestUpdate(ctx, buf, strlen(buf));
+    rpmDigestFinal(ctx, (void **)&key, NULL, 1);
+    if (key == NULL)
+	return luaL_loadbuffer(L, buf, strlen(buf), name);
+
+    lua_getfield(L, LUA_REGISTRYINDEX, key);
+    if (lua_isfunction(L, -1)) {
+	ret = 0;
+    } else {
+	lua_pop(L, 1);
+	ret = luaL_loadbuffer(L, buf, strlen(buf), name);
+	if (ret == 0) {
+	    lua_pushvalue(L, -1);
+	    lua_setfield(L, LUA_REGISTRYINDEX, key);
+	}
+    }
+    free(key);
+    return ret;
+}
+
 int rpmluaRunScript(rpmlua _lua, const char *script, const char *name,
 		    const char *opts, ARGV_t args)
 {
@@ -292,7 +327,7 @@ int rpmluaRunScript(rpmlua _lua, const char *script, const char *name,
 
     char *buf = rstrscat(NULL, lualocal, script, NULL);
 
-    if (luaL_loadbuffer(L, buf, strlen(buf), name) != 0) {
+    if (luaLoadCached(L, buf, name) != 0) {
 	rpmlog(RPMLOG_ERR, _("invalid syntax in lua script: %s\n"),
 		 lua_tostring(L, -1));
 	lua_pop(L, 1);
@@ -323,7 +358,8 @@ int rpmluaRunScript(rpmlua _lua, const char *script, const char *name,
     }
 
     if (lua_pcall(L, 2, 0, 0) != 0) {
-	rpmlog(RPMLOG_ERR, _("lua script failed: %s\n"),
+	/* A cached chunk may carry another name, log ours explicitly */
+	rpmlog(RPMLOG_ERR, _("lua script %s failed: %s\n"), name,
 		 lua_tostring(L, -1));
 	lua_pop(L, 1);
 	goto exit;
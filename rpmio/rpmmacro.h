@@ -69,6 +69,17 @@ typedef enum rpmMacroFlags_e {
 void	rpmDumpMacroTable	(rpmMacroContext mc,
 					FILE * fp);
 
+/** \ingroup rpmmacro
+ * Write the macro file level macros as a compiled macro bundle.
+ * A bundle stands in for a set of text macro files: named in a macro
+ * file path (or passed to rpmLoadMacroFile()), it loads without any
+ * textual parsing. The format is native-endian and rpm-version private.
+ * @param mc		macro context (NULL uses global context).
+ * @param fn		bundle file name
+ * @return		negative on failure
+ */
+int	rpmDumpMacrosCompiled	(rpmMacroContext mc, const char * fn);
+
 /** \ingroup rpmmacro
  * Expand macro into buffer.
  * @param mc		macro context (NULL uses global context).
@@ -182,6 +193,28 @@ void	rpmInitMacros	(rpmMacroContext mc, const char * macrofiles);
  */
 void	rpmFreeMacros	(rpmMacroContext mc);
 
+/** \ingroup rpmmacro
+ * Fork a macro context for a nested scope.
+ * The fork shares the parent tables read-only and starts with no local
+ * definitions, so creating one is O(1) regardless of the parent size.
+ * Macros defined through the fork overlay the inherited ones, and popping
+ * a local definition re-exposes whatever it shadowed; inherited macros
+ * themselves cannot be popped through a fork. The parent context must not
+ * be modified for the lifetime of the fork, but any number of forks of
+ * the same parent may be used concurrently from separate threads.
+ * @param mc		macro context to fork (NULL uses global context).
+ * @return		forked macro context
+ */
+rpmMacroContext rpmMacroContextFork(rpmMacroContext mc);
+
+/** \ingroup rpmmacro
+ * Free a forked macro context, discarding its local definitions.
+ * The parent context is unaffected.
+ * @param mc		forked macro context (or NULL)
+ * @return		NULL always
+ */
+rpmMacroContext rpmMacroContextFree(rpmMacroContext mc);
+
 /** \ingroup rpmmacro
  * Return (malloc'ed) concatenated macro expansion(s).
  * @param arg		macro(s) to expand (NULL terminates list)
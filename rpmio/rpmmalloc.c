@@ -7,12 +7,183 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <rpm/rpmstring.h>
 
 #include "debug.h"
 
 static rpmMemFailFunc failfunc = NULL;
 static void *failfunc_data = NULL;
 
+/*
+ * Opt-in allocation accounting (see RPM_MEM_PROFILE): when enabled,
+ * every allocation made through these wrappers is recorded in a side
+ * table with its size and the subsystem tag in effect on the calling
+ * thread, maintaining live/peak/total counters per tag. Allocations
+ * released behind our back with a plain free() stay on the books -
+ * this is a profiler, not an exact leak detector. Disabled (the
+ * default), the only cost is one predictable branch per call.
+ */
+
+static int profEnabled = 0;
+static FILE *profFp = NULL;
+static pthread_mutex_t profLock = PTHREAD_MUTEX_INITIALIZER;
+
+static const char * const profTagNames[RPMMEM_NTAGS] = {
+    "misc", "header", "files", "strpool",
+};
+
+static struct profCount_s {
+    uint64_t live;
+    uint64_t peak;
+    uint64_t total;
+    uint64_t nallocs;
+} profCounts[RPMMEM_NTAGS];
+
+/* Pointer -> (size, tag) open addressing table, raw malloc only */
+static struct profEnt_s {
+    void *ptr;			/* NULL empty, (void *)-1 deleted */
+    size_t size;
+    int tag;
+} *profTab = NULL;
+static size_t profTabSize = 0;	/* power of two */
+static size_t profTabUsed = 0;
+
+static __thread int profTagStack[8] = { RPMMEM_MISC };
+static __thread int profTagDepth = 0;
+
+static void profInitOnce(void)
+{
+    const char *path = getenv("RPM_MEM_PROFILE");
+    if (path == NULL || *path == '\0')
+	return;
+    if (rstreq(path, "-") || rstreq(path, "1"))
+	profFp = stderr;
+    else
+	profFp = fopen(path, "a");
+    if (profFp != NULL)
+	profEnabled = 1;
+}
+
+static int profInit(void)
+{
+    static pthread_once_t once = PTHREAD_ONCE_INIT;
+    pthread_once(&once, profInitOnce);
+    return profEnabled;
+}
+
+static size_t profSlot(const struct profEnt_s *tab, size_t size, void *ptr)
+{
+    /* Fibonacci hash of the pointer value */
+    size_t h = ((uintptr_t)ptr >> 4) * 0x9e3779b97f4a7c15ULL;
+    size_t mask = size - 1;
+    size_t s = h & mask;
+    size_t del = size;		/* first tombstone, if any */
+
+    while (tab[s].ptr != NULL) {
+	if (tab[s].ptr == ptr)
+	    return s;
+	if (tab[s].ptr == (void *)-1 && del == size)
+	    del = s;
+	s = (s + 1) & mask;
+    }
+    return (del < size) ? del : s;
+}
+
+static void profTabGrow(void)
+{
+    size_t nsize = profTabSize ? profTabSize * 2 : 4096;
+    struct profEnt_s *ntab = calloc(nsize, sizeof(*ntab));
+
+    if (ntab == NULL)
+	return;
+    for (size_t i = 0; i < profTabSize; i++) {
+	if (profTab[i].ptr && profTab[i].ptr != (void *)-1)
+	    ntab[profSlot(ntab, nsize, profTab[i].ptr)] = profTab[i];
+    }
+    free(profTab);
+    profTab = ntab;
+    profTabSize = nsize;
+}
+
+static void profAlloc(void *ptr, size_t size)
+{
+    int tag = profTagStack[profTagDepth];
+    struct profCount_s *pc = &profCounts[tag];
+    size_t s;
+
+    pthread_mutex_lock(&profLock);
+    if (profTabUsed * 4 >= profTabSize * 3)
+	profTabGrow();
+    if (profTabSize > 0) {
+	s = profSlot(profTab, profTabSize, ptr);
+	if (profTab[s].ptr != ptr)
+	    profTabUsed++;
+	profTab[s].ptr = ptr;
+	profTab[s].size = size;
+	profTab[s].tag = tag;
+
+	pc->live += size;
+	pc->total += size;
+	pc->nallocs++;
+	if (pc->live > pc->peak)
+	    pc->peak = pc->live;
+    }
+    pthread_mutex_unlock(&profLock);
+}
+
+static void profFree(void *ptr)
+{
+    size_t s;
+
+    if (ptr == NULL || profTabSize == 0)
+	return;
+    pthread_mutex_lock(&profLock);
+    s = profSlot(profTab, profTabSize, ptr);
+    if (profTab[s].ptr == ptr) {
+	profCounts[profTab[s].tag].live -= profTab[s].size;
+	profTab[s].ptr = (void *)-1;
+	profTab[s].size = 0;
+    }
+    pthread_mutex_unlock(&profLock);
+}
+
+void rpmMemTagPush(rpmMemTag tag)
+{
+    if (!profInit())
+	return;
+    if (profTagDepth + 1 < (int)(sizeof(profTagStack)/sizeof(profTagStack[0])))
+	profTagStack[++profTagDepth] = tag;
+}
+
+void rpmMemTagPop(void)
+{
+    if (!profEnabled)
+	return;
+    if (profTagDepth > 0)
+	profTagDepth--;
+}
+
+void rpmMemProfDump(const char *when)
+{
+    if (!profEnabled)
+	return;
+    pthread_mutex_lock(&profLock);
+    for (int i = 0; i < RPMMEM_NTAGS; i++) {
+	struct profCount_s *pc = &profCounts[i];
+	if (pc->nallocs == 0)
+	    continue;
+	fprintf(profFp,
+		"rpmmem: when=%s tag=%s live=%llu peak=%llu total=%llu allocs=%llu\n",
+		when ? when : "-", profTagNames[i],
+		(unsigned long long)pc->live, (unsigned long long)pc->peak,
+		(unsigned long long)pc->total, (unsigned long long)pc->nallocs);
+    }
+    fflush(profFp);
+    pthread_mutex_unlock(&profLock);
+}
+
 /*
  * Give memfail callback a chance to try to give us memory or perform
  * it's own cleanup. If we dont get memory we die anyway as rpm doesn't 
@@ -44,6 +215,8 @@ void * rmalloc (size_t size)
     value = malloc (size);
     if (value == NULL)
 	value = vmefail(size);
+    if (profInit())
+	profAlloc(value, size);
     return value;
 }
 
@@ -55,6 +228,8 @@ void * rcalloc (size_t nmemb, size_t size)
     value = calloc (nmemb, size);
     if (value == NULL)
 	value = vmefail(size);
+    if (profInit())
+	profAlloc(value, nmemb * size);
     return value;
 }
 
@@ -65,6 +240,10 @@ void * rrealloc (void *ptr, size_t size)
     value = realloc (ptr, size);
     if (value == NULL)
 	value = vmefail(size);
+    if (profInit()) {
+	profFree(ptr);
+	profAlloc(value, size);
+    }
     return value;
 }
 
@@ -76,6 +255,8 @@ char * rstrndup(const char *str, size_t n)
 	newstr = (char *) vmefail(size);
     strncpy(newstr, str, n);
     newstr[n] = '\0';
+    if (profInit())
+	profAlloc(newstr, size);
     return newstr;
 }
 
@@ -86,6 +267,8 @@ char * rstrdup (const char *str)
 
 void * rfree (void *ptr)
 {
+    if (profEnabled)
+	profFree(ptr);
     free(ptr);
     return NULL;
 }
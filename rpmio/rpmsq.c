@@ -6,6 +6,7 @@
 
 #include <signal.h>
 #include <sys/signal.h>
+#include <pthread.h>
 #include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -19,6 +20,8 @@
 static int disableInterruptSafety;
 static sigset_t rpmsqCaught;
 static sigset_t rpmsqActive;
+static volatile sig_atomic_t rpmsqPending;
+static pthread_mutex_t rpmsqBlockLock = PTHREAD_MUTEX_INITIALIZER;
 
 typedef struct rpmsig_s * rpmsig;
 
@@ -81,6 +84,8 @@ static void rpmsqHandler(int signum, siginfo_t * info, void * context)
 	    if (rpmsigGet(signum, &sig)) {
 		(void) sigaddset(&rpmsqCaught, signum);
 		memcpy(&sig->siginfo, info, sizeof(*info));
+		/* set last: once visible, the caught bit is in place */
+		rpmsqPending = 1;
 	    }
 	}
     }
@@ -147,6 +152,13 @@ int rpmsqPoll(void)
     sigset_t newMask, oldMask;
     int n = 0;
 
+    /* fast path: called from per-item loops, stay syscall-free until
+     * a handler has actually run (cleared before checking the caught
+     * set, so a signal racing in is picked up by the next poll) */
+    if (!rpmsqPending)
+	return 0;
+    rpmsqPending = 0;
+
     /* block all signals while processing the queue */
     (void) sigfillset(&newMask);
     (void) pthread_sigmask(SIG_BLOCK, &newMask, &oldMask);
@@ -176,6 +188,7 @@ int rpmsqBlock(int op)
     sigset_t newMask;
     int ret = 0;
 
+    pthread_mutex_lock(&rpmsqBlockLock);
     if (op == SIG_BLOCK) {
 	blocked++;
 	if (blocked == 1) {
@@ -198,10 +211,25 @@ int rpmsqBlock(int op)
 	    ret = -1;
 	}
     }
+    pthread_mutex_unlock(&rpmsqBlockLock);
 
     return ret;
 }
 
+int rpmsqBlockThread(void)
+{
+    sigset_t mask;
+
+    sigfillset(&mask);
+    sigdelset(&mask, SIGABRT);
+    sigdelset(&mask, SIGBUS);
+    sigdelset(&mask, SIGFPE);
+    sigdelset(&mask, SIGILL);
+    sigdelset(&mask, SIGSEGV);
+    sigdelset(&mask, SIGTSTP);
+    return pthread_sigmask(SIG_BLOCK, &mask, NULL);
+}
+
 /** \ingroup rpmio
  * 
  * By default, librpm will trap various unix signals such as SIGINT and SIGTERM,
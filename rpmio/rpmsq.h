@@ -60,6 +60,15 @@ rpmsqAction_t rpmsqSetAction(int signum, rpmsqAction_t handler);
  */
 int rpmsqBlock(int op);
 
+/** \ingroup rpmsq
+ * Permanently block (almost) all signals in the calling thread.
+ * Meant to be called once on entry to worker threads so signals are
+ * only ever delivered to (and handled by) the coordinating thread,
+ * without any per-operation signal mask traffic in the workers.
+ * @return		0 on success, -1 on error
+ */
+int rpmsqBlockThread(void);
+
 /** \ingroup rpmsq
  * Poll for caught signals, executing their handlers.
  * @return		no. active signals found
@@ -242,11 +242,16 @@ static void rpmstrPoolRehash(rpmstrPool pool)
 	poolHashAddEntry(pool, id2str(pool, i), i);
 }
 
-rpmstrPool rpmstrPoolCreate(void)
+rpmstrPool rpmstrPoolCreateSized(rpmsid nstrings)
 {
-    rpmstrPool pool = xcalloc(1, sizeof(*pool));
+    rpmstrPool pool;
+
+    rpmMemTagPush(RPMMEM_STRPOOL);
+    pool = xcalloc(1, sizeof(*pool));
 
     pool->offs_alloced = STROFFS_CHUNK;
+    if (pool->offs_alloced < nstrings + 2)
+	pool->offs_alloced = nstrings + 2;
     pool->offs = xcalloc(pool->offs_alloced, sizeof(*pool->offs));
 
     pool->chunks_allocated = STRDATA_CHUNKS;
@@ -256,12 +261,23 @@ rpmstrPool rpmstrPoolCreate(void)
     pool->chunks[pool->chunks_size] = xcalloc(1, pool->chunk_allocated);
     pool->offs[1] = pool->chunks[pool->chunks_size];
 
-    rpmstrPoolRehash(pool);
+    /* size the hash for the expected number of strings so that interning
+     * them does not have to grow it (load factor stays at or below 0.5) */
+    if (nstrings > STRHASH_INITSIZE / 2)
+	pool->hash = poolHashCreate(nstrings * 2);
+    else
+	rpmstrPoolRehash(pool);
     pool->nrefs = 1;
     pthread_rwlock_init(&pool->lock, NULL);
+    rpmMemTagPop();
     return pool;
 }
 
+rpmstrPool rpmstrPoolCreate(void)
+{
+    return rpmstrPoolCreateSized(0);
+}
+
 rpmstrPool rpmstrPoolFree(rpmstrPool pool)
 {
     if (pool) {
@@ -331,6 +347,8 @@ static rpmsid rpmstrPoolPut(rpmstrPool pool, const char *s, size_t slen, unsigne
     char *t = NULL;
     size_t ssize = slen + 1;
 
+    rpmMemTagPush(RPMMEM_STRPOOL);
+
     pool->offs_size += 1;
     if (pool->offs_alloced <= pool->offs_size) {
 	pool->offs_alloced += STROFFS_CHUNK;
@@ -366,6 +384,8 @@ static rpmsid rpmstrPoolPut(rpmstrPool pool, const char *s, size_t slen, unsigne
     pool->offs[pool->offs_size] = t;
     poolHashAddHEntry(pool, t, hash, pool->offs_size);
 
+    rpmMemTagPop();
+
     return pool->offs_size;
 }
 
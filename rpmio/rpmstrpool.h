@@ -20,6 +20,16 @@ extern "C" {
  */
 rpmstrPool rpmstrPoolCreate(void);
 
+/** \ingroup rpmstrpool
+ * Create a new, empty string pool, sized for an expected number of
+ * strings. Interning up to that many strings will not grow the
+ * string -> id hash, so callers that know their string count up front
+ * (such as per-file data of a transaction) avoid all rehashes.
+ * @param nstrings	expected number of strings in the pool
+ * @return		new string pool
+ */
+rpmstrPool rpmstrPoolCreateSized(rpmsid nstrings);
+
 /** \ingroup rpmstrpool
  * Free a string pool and its contents. While other references exist,
  * this only decrements the reference count.
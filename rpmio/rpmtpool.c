@@ -0,0 +1,249 @@
+/** \ingroup rpmio
+ * \file rpmio/rpmtpool.c
+ */
+
+#include "system.h"
+
+#include <pthread.h>
+#include <signal.h>
+#include <unistd.h>
+
+#include <rpm/rpmmacro.h>
+#include <rpm/rpmlog.h>
+
+#include "rpmio/rpmtpool.h"
+
+#include "debug.h"
+
+struct rpmtpTask_s {
+    rpmtpTaskFn fn;
+    void *arg;
+    void *result;
+    int done;
+    rpmtpGroup group;
+    struct rpmtpTask_s *next;	/*!< queue link */
+};
+
+struct rpmtpGroup_s {
+    struct rpmtpTask_s **tasks;	/*!< in submission order */
+    int ntasks;
+    int nalloced;
+    int ndone;
+    int nextout;		/*!< next index rpmtpGroupNext() hands out */
+};
+
+/*
+ * The process-wide pool. One shared FIFO feeds all workers: at the
+ * task sizes the library submits (a package, a file, a chunk) the
+ * contention on a single queue is negligible, and sharing one queue
+ * is what lets unrelated subsystems borrow each other's idle workers.
+ */
+static struct {
+    pthread_mutex_t lock;
+    pthread_cond_t work;	/*!< submitters -> workers */
+    pthread_cond_t done;	/*!< workers -> waiters */
+    struct rpmtpTask_s *head;	/*!< task queue */
+    struct rpmtpTask_s *tail;
+    int started;
+    int nthreads;
+    uint64_t ntasks;
+    uint64_t ninline;
+    uint64_t depth;
+    uint64_t maxdepth;
+} pool = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .work = PTHREAD_COND_INITIALIZER,
+    .done = PTHREAD_COND_INITIALIZER,
+};
+
+int rpmtpThreads(void)
+{
+    static int nthreads = 0;
+
+    if (nthreads == 0) {
+	int n = rpmExpandNumeric("%{?_rpmtpool_threads}");
+	if (n <= 0)
+	    n = sysconf(_SC_NPROCESSORS_ONLN);
+	nthreads = (n > 0) ? n : 1;
+    }
+    return nthreads;
+}
+
+static void *rpmtpWorker(void *data)
+{
+    sigset_t mask;
+
+    /* Signals stay with the submitting thread (and rpmsq) */
+    sigfillset(&mask);
+    pthread_sigmask(SIG_BLOCK, &mask, NULL);
+
+    pthread_mutex_lock(&pool.lock);
+    for (;;) {
+	struct rpmtpTask_s *task = pool.head;
+
+	if (task == NULL) {
+	    pthread_cond_wait(&pool.work, &pool.lock);
+	    continue;
+	}
+	pool.head = task->next;
+	if (pool.head == NULL)
+	    pool.tail = NULL;
+	pool.depth--;
+	pthread_mutex_unlock(&pool.lock);
+
+	task->result = task->fn(task->arg);
+
+	pthread_mutex_lock(&pool.lock);
+	task->done = 1;
+	task->group->ndone++;
+	pthread_cond_broadcast(&pool.done);
+    }
+    return NULL;	/* not reached */
+}
+
+/*
+ * A fork()ed child inherits no worker threads. Reset the pool to its
+ * pristine state so the child can lazily start workers of its own;
+ * whatever was queued or in flight belongs to the parent.
+ */
+static void atforkPrepare(void)
+{
+    pthread_mutex_lock(&pool.lock);
+}
+
+static void atforkParent(void)
+{
+    pthread_mutex_unlock(&pool.lock);
+}
+
+static void atforkChild(void)
+{
+    pthread_mutex_init(&pool.lock, NULL);
+    pthread_cond_init(&pool.work, NULL);
+    pthread_cond_init(&pool.done, NULL);
+    pool.head = pool.tail = NULL;
+    pool.started = 0;
+    pool.nthreads = 0;
+    pool.depth = 0;
+}
+
+/* Lazily start the workers; pool lock must be held. */
+static void rpmtpStart(void)
+{
+    int nthreads = rpmtpThreads();
+
+    pool.started = 1;
+    pthread_atfork(atforkPrepare, atforkParent, atforkChild);
+
+    for (int i = 0; i < nthreads; i++) {
+	pthread_t tid;
+	pthread_attr_t attr;
+
+	/* Workers live for the rest of the process, don't join them */
+	pthread_attr_init(&attr);
+	pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+	if (pthread_create(&tid, &attr, rpmtpWorker, NULL) == 0)
+	    pool.nthreads++;
+	pthread_attr_destroy(&attr);
+    }
+    rpmlog(RPMLOG_DEBUG, "started thread pool with %d workers\n",
+	   pool.nthreads);
+}
+
+rpmtpGroup rpmtpGroupCreate(void)
+{
+    return xcalloc(1, sizeof(struct rpmtpGroup_s));
+}
+
+int rpmtpGroupPush(rpmtpGroup grp, rpmtpTaskFn fn, void *arg)
+{
+    struct rpmtpTask_s *task = xcalloc(1, sizeof(*task));
+    int ix = grp->ntasks;
+
+    task->fn = fn;
+    task->arg = arg;
+    task->group = grp;
+
+    if (grp->ntasks == grp->nalloced) {
+	grp->nalloced = grp->nalloced ? grp->nalloced * 2 : 16;
+	grp->tasks = xrealloc(grp->tasks,
+			      grp->nalloced * sizeof(*grp->tasks));
+    }
+    grp->tasks[grp->ntasks++] = task;
+
+    pthread_mutex_lock(&pool.lock);
+    if (!pool.started && rpmtpThreads() > 1)
+	rpmtpStart();
+    pool.ntasks++;
+
+    if (pool.nthreads > 0) {
+	if (pool.tail)
+	    pool.tail->next = task;
+	else
+	    pool.head = task;
+	pool.tail = task;
+	if (++pool.depth > pool.maxdepth)
+	    pool.maxdepth = pool.depth;
+	pthread_cond_signal(&pool.work);
+	pthread_mutex_unlock(&pool.lock);
+    } else {
+	/* Single threaded (or thread creation failed): run it here */
+	pool.ninline++;
+	pthread_mutex_unlock(&pool.lock);
+	task->result = task->fn(task->arg);
+	pthread_mutex_lock(&pool.lock);
+	task->done = 1;
+	grp->ndone++;
+	pthread_mutex_unlock(&pool.lock);
+    }
+    return ix;
+}
+
+int rpmtpGroupNext(rpmtpGroup grp, void **resultp)
+{
+    int ix = -1;
+
+    if (grp->nextout < grp->ntasks) {
+	struct rpmtpTask_s *task = grp->tasks[grp->nextout];
+
+	pthread_mutex_lock(&pool.lock);
+	while (!task->done)
+	    pthread_cond_wait(&pool.done, &pool.lock);
+	pthread_mutex_unlock(&pool.lock);
+
+	if (resultp)
+	    *resultp = task->result;
+	ix = grp->nextout++;
+    }
+    return ix;
+}
+
+void rpmtpGroupWait(rpmtpGroup grp)
+{
+    pthread_mutex_lock(&pool.lock);
+    while (grp->ndone < grp->ntasks)
+	pthread_cond_wait(&pool.done, &pool.lock);
+    pthread_mutex_unlock(&pool.lock);
+}
+
+rpmtpGroup rpmtpGroupFree(rpmtpGroup grp)
+{
+    if (grp) {
+	rpmtpGroupWait(grp);
+	for (int i = 0; i < grp->ntasks; i++)
+	    free(grp->tasks[i]);
+	free(grp->tasks);
+	free(grp);
+    }
+    return NULL;
+}
+
+void rpmtpGetStats(struct rpmtpStats_s *stats)
+{
+    pthread_mutex_lock(&pool.lock);
+    stats->ntasks = pool.ntasks;
+    stats->ninline = pool.ninline;
+    stats->maxdepth = pool.maxdepth;
+    stats->nthreads = pool.nthreads;
+    pthread_mutex_unlock(&pool.lock);
+}
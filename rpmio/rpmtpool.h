@@ -0,0 +1,112 @@
+#ifndef	H_RPMTPOOL
+#define	H_RPMTPOOL
+
+/** \ingroup rpmio
+ * \file rpmio/rpmtpool.h
+ *
+ * Process-wide worker thread pool.
+ *
+ * A single, lazily started pool of worker threads shared by all
+ * threaded operations in the library, so concurrent subsystems draw
+ * from one set of workers instead of oversubscribing the CPUs with
+ * pools of their own.  Work is submitted in task groups; completed
+ * results can be collected either unordered (wait for the group) or
+ * in submission order.
+ *
+ * Workers run with all signals blocked: signal delivery and the
+ * rpmsq queue remain the business of the submitting thread.  The
+ * pool is fork-safe in the usual limited sense: a fork()ed child
+ * sees an empty, unstarted pool and may use it independently;
+ * tasks in flight at fork time belong to the parent.
+ */
+
+#include <rpm/rpmutil.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct rpmtpGroup_s * rpmtpGroup;
+
+/** \ingroup rpmio
+ * Task callback: executed on a worker thread (or inline, see below).
+ * @param arg		task argument
+ * @return		task result, retrievable via rpmtpGroupNext()
+ */
+typedef void * (*rpmtpTaskFn)(void *arg);
+
+/** \ingroup rpmio
+ * Number of workers the pool runs (or would run) with, from the
+ * %_rpmtpool_threads macro, defaulting to the number of online CPUs.
+ * Callers can use this to size their data partitioning.
+ * @return		worker count (>= 1)
+ */
+RPM_GNUC_INTERNAL
+int rpmtpThreads(void);
+
+/** \ingroup rpmio
+ * Create a task group for submitting related work to the pool.
+ * @return		new task group
+ */
+RPM_GNUC_INTERNAL
+rpmtpGroup rpmtpGroupCreate(void);
+
+/** \ingroup rpmio
+ * Submit a task to the pool. Starts the workers on first use.
+ * When the pool is sized to a single worker (or can't start threads),
+ * the task is executed inline during this call instead.
+ * @param grp		task group
+ * @param fn		task callback
+ * @param arg		task argument
+ * @return		task index within the group (for bookkeeping)
+ */
+RPM_GNUC_INTERNAL
+int rpmtpGroupPush(rpmtpGroup grp, rpmtpTaskFn fn, void *arg);
+
+/** \ingroup rpmio
+ * Retrieve the next task result in submission order, waiting for its
+ * completion as necessary.
+ * @param grp		task group
+ * @param[out] resultp	task result (or NULL if uninterested)
+ * @return		task index, -1 when all results have been handed out
+ */
+RPM_GNUC_INTERNAL
+int rpmtpGroupNext(rpmtpGroup grp, void **resultp);
+
+/** \ingroup rpmio
+ * Wait for all tasks of a group to complete.
+ * @param grp		task group
+ */
+RPM_GNUC_INTERNAL
+void rpmtpGroupWait(rpmtpGroup grp);
+
+/** \ingroup rpmio
+ * Wait for remaining tasks and free a task group.
+ * @param grp		task group
+ * @return		NULL always
+ */
+RPM_GNUC_INTERNAL
+rpmtpGroup rpmtpGroupFree(rpmtpGroup grp);
+
+/** \ingroup rpmio
+ * Pool instrumentation counters, all cumulative for the process.
+ */
+struct rpmtpStats_s {
+    uint64_t ntasks;		/*!< tasks submitted */
+    uint64_t ninline;		/*!< tasks executed inline in the caller */
+    uint64_t maxdepth;		/*!< high-water mark of the task queue */
+    int nthreads;		/*!< workers currently running */
+};
+
+/** \ingroup rpmio
+ * Retrieve pool instrumentation counters.
+ * @param[out] stats	counter block to fill in
+ */
+RPM_GNUC_INTERNAL
+void rpmtpGetStats(struct rpmtpStats_s *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif	/* H_RPMTPOOL */
@@ -47,6 +47,43 @@ urltype	urlPath(const char * url, const char ** pathp);
  */
 int urlGetFile(const char * url, const char * dest);
 
+/** \ingroup rpmurl
+ * In-flight asynchronous URL transfer.
+ */
+typedef struct urlFetch_s * urlFetch;
+
+/** \ingroup rpmurl
+ * Start copying data from URL to local file without waiting for the
+ * transfer to finish. Several transfers may be in flight at once,
+ * overlapping the per-transfer connection setup.
+ * @param url		url string of source
+ * @param dest		file name of destination
+ * @return		transfer handle to pass to urlGetFileWait()
+ */
+urlFetch urlGetFileAsync(const char * url, const char * dest);
+
+/** \ingroup rpmurl
+ * Wait for an asynchronous URL transfer to finish and free its handle.
+ * @param fetchp	transfer handle pointer (NULLed on return)
+ * @return		0 on success, -1 on error
+ */
+int urlGetFileWait(urlFetch * fetchp);
+
+/** \ingroup rpmurl
+ * Copy a byte range from URL to local file, using the range-capable
+ * url helper (%_urlhelper_range). A server that does not honor range
+ * requests replies with the entire file; callers must detect this from
+ * the result size.
+ * @param url		url string of source
+ * @param dest		file name of destination
+ * @param offset	offset of first byte to fetch
+ * @param count		no. of bytes to fetch
+ * @return		0 on success, -1 on error,
+ *			-2 when no range helper is configured
+ */
+int urlGetFileRange(const char * url, const char * dest,
+		    off_t offset, off_t count);
+
 #ifdef __cplusplus
 }
 #endif
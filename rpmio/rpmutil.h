@@ -134,6 +134,38 @@ char * rstrndup(const char *str, size_t n);
 /* Rpm specific free() which returns NULL */
 void * rfree(void *ptr);
 
+/** \ingroup rpmutil
+ * Subsystem tags for the opt-in allocation profiler. Enabled by
+ * setting RPM_MEM_PROFILE in the environment to an output path
+ * ("-" for stderr); disabled it costs one branch per allocation.
+ */
+typedef enum rpmMemTag_e {
+    RPMMEM_MISC		= 0,	/*!< everything not otherwise tagged */
+    RPMMEM_HEADER	= 1,	/*!< header data arenas */
+    RPMMEM_FILES	= 2,	/*!< rpmfi/rpmfiles arrays */
+    RPMMEM_STRPOOL	= 3,	/*!< string pool blocks */
+    RPMMEM_NTAGS	= 4
+} rpmMemTag;
+
+/** \ingroup rpmutil
+ * Attribute subsequent allocations on this thread to a subsystem.
+ * Push/pop pairs nest; no-op unless the profiler is enabled.
+ * @param tag		subsystem tag
+ */
+void rpmMemTagPush(rpmMemTag tag);
+
+/** \ingroup rpmutil
+ * Undo the most recent rpmMemTagPush() on this thread.
+ */
+void rpmMemTagPop(void);
+
+/** \ingroup rpmutil
+ * Write per-subsystem live/peak/total allocation counters to the
+ * profiler output. No-op unless the profiler is enabled.
+ * @param when		label for the dump (or NULL)
+ */
+void rpmMemProfDump(const char *when);
+
 /** \ingroup rpmutil
  * Memory allocation failure callback prototype. When registered through
  * rpmSetMemFail(), this gets called if memory allocation through rmalloc()
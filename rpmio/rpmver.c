@@ -10,9 +10,36 @@ struct rpmver_s {
     const char *e;
     const char *v;
     const char *r;
+    size_t arenalen;	/*!< for cheap equality of the packed strings */
     char arena[];
 };
 
+/*
+ * Versions created the same way from identical input have identical
+ * arenas, turning the common identical-operand comparison in depsolver
+ * loops into a memcmp() instead of three rpmvercmp() walks. Equal
+ * bytes alone can still shadow different EVR splits ("1:2" and "1-2"
+ * pack identically), so the e/v/r segment boundaries must match too.
+ * The epoch may point at a static "0" instead of into the arena, so it
+ * is compared as a string. Inequality tells nothing, the caller falls
+ * through to the real thing.
+ */
+static int verStreq(rpmver v1, rpmver v2)
+{
+    if (v1 == v2)
+	return 1;
+    if ((v1->e == NULL) != (v2->e == NULL) ||
+	(v1->r == NULL) != (v2->r == NULL))
+	return 0;
+    if (v1->e && !rstreq(v1->e, v2->e))
+	return 0;
+    if (v1->arenalen != v2->arenalen ||
+	v1->v - v1->arena != v2->v - v2->arena ||
+	(v1->r && v1->r - v1->arena != v2->r - v2->arena))
+	return 0;
+    return (memcmp(v1->arena, v2->arena, v1->arenalen) == 0);
+}
+
 /**
  * Split EVR into epoch, version, and release components.
  * @param evr		[epoch:]version[-release] string
@@ -61,6 +88,9 @@ int rpmverOverlap(rpmver v1, rpmsenseFlags f1, rpmver v2, rpmsenseFlags f2)
     int sense = 0;
     int result = 0;
 
+    if (verStreq(v1, v2))
+	goto overlap;
+
     /* Compare {A,B} [epoch:]version[-release] */
     if (v1->e && *v1->e && v2->e && *v2->e)
 	sense = rpmvercmp(v1->e, v2->e);
@@ -85,6 +115,7 @@ int rpmverOverlap(rpmver v1, rpmsenseFlags f1, rpmver v2, rpmsenseFlags f2)
 	}
     }
 
+overlap:
     /* Detect overlap of {A,B} range. */
     if (sense < 0 && ((f1 & RPMSENSE_GREATER) || (f2 & RPMSENSE_LESS))) {
 	result = 1;
@@ -114,6 +145,9 @@ static int compare_values(const char *str1, const char *str2)
 
 int rpmverCmp(rpmver v1, rpmver v2)
 {
+    if (verStreq(v1, v2))
+	return 0;
+
     const char *e1 = (v1->e != NULL) ? v1->e : "0";
     const char *e2 = (v2->e != NULL) ? v2->e : "0";
 
@@ -163,6 +197,7 @@ rpmver rpmverParse(const char *evr)
     if (evr && *evr) {
 	size_t evrlen = strlen(evr) + 1;
 	rv = xmalloc(sizeof(*rv) + evrlen);
+	rv->arenalen = evrlen;
 	memcpy(rv->arena, evr, evrlen);
 	parseEVR(rv->arena, &rv->e, &rv->v, &rv->r);
     }
@@ -179,6 +214,7 @@ rpmver rpmverNew(const char *e, const char *v, const char *r)
 	nb += (r != NULL) ? strlen(r) + 1 : 0;
 	rv = xmalloc(sizeof(*rv) + nb);
 
+	rv->arenalen = nb;
 	rv->e = NULL;
 	rv->v = NULL;
 	rv->r = NULL;
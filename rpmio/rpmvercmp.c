@@ -18,20 +18,13 @@ int rpmvercmp(const char * a, const char * b)
     /* easy comparison to see if versions are identical */
     if (rstreq(a, b)) return 0;
 
-    char oldch1, oldch2;
-    char abuf[strlen(a)+1], bbuf[strlen(b)+1];
-    char *str1 = abuf, *str2 = bbuf;
-    char * one, * two;
+    const char *one = a, *two = b;
+    const char *str1, *str2;
+    size_t onelen, twolen;
     int rc;
     int isnum;
 
-    strcpy(str1, a);
-    strcpy(str2, b);
-
-    one = str1;
-    two = str2;
-
-    /* loop through each version segment of str1 and str2 and compare them */
+    /* loop through each version segment of a and b and compare them */
     while (*one || *two) {
 	while (*one && !risalnum(*one) && *one != '~' && *one != '^') one++;
 	while (*two && !risalnum(*two) && *two != '~' && *two != '^') two++;
@@ -79,13 +72,6 @@ int rpmvercmp(const char * a, const char * b)
 	    isnum = 0;
 	}
 
-	/* save character at the end of the alpha or numeric segment */
-	/* so that they can be restored after the comparison */
-	oldch1 = *str1;
-	*str1 = '\0';
-	oldch2 = *str2;
-	*str2 = '\0';
-
 	/* this cannot happen, as we previously tested to make sure that */
 	/* the first string has a non-null segment */
 	if (one == str1) return -1;	/* arbitrary */
@@ -97,7 +83,6 @@ int rpmvercmp(const char * a, const char * b)
 	if (two == str2) return (isnum ? 1 : -1);
 
 	if (isnum) {
-	    size_t onelen, twolen;
 	    /* this used to be done by converting the digit segments */
 	    /* to ints using atoi() - it's changed because long  */
 	    /* digit segments can overflow an int - this should fix that. */
@@ -107,23 +92,24 @@ int rpmvercmp(const char * a, const char * b)
 	    while (*two == '0') two++;
 
 	    /* whichever number has more digits wins */
-	    onelen = strlen(one);
-	    twolen = strlen(two);
+	    onelen = str1 - one;
+	    twolen = str2 - two;
 	    if (onelen > twolen) return 1;
 	    if (twolen > onelen) return -1;
 	}
 
-	/* strcmp will return which one is greater - even if the two */
-	/* segments are alpha or if they are numeric.  don't return  */
-	/* if they are equal because there might be more segments to */
-	/* compare */
-	rc = strcmp(one, two);
-	if (rc) return (rc < 1 ? -1 : 1);
+	/* memcmp over the common length will return which one is greater, */
+	/* even if the two segments are alpha or if they are numeric. */
+	/* don't return if they are equal because there might be more */
+	/* segments to compare. a shorter alpha segment that is a prefix */
+	/* of the longer one sorts older, just like strcmp() would say. */
+	onelen = str1 - one;
+	twolen = str2 - two;
+	rc = memcmp(one, two, onelen < twolen ? onelen : twolen);
+	if (rc) return (rc < 0 ? -1 : 1);
+	if (onelen != twolen) return (onelen < twolen ? -1 : 1);
 
-	/* restore character that was replaced by null above */
-	*str1 = oldch1;
 	one = str1;
-	*str2 = oldch2;
 	two = str2;
     }
 
@@ -92,13 +92,43 @@ urltype urlPath(const char * url, const char ** pathp)
     return type;
 }
 
+struct urlFetch_s {
+    pid_t pid;
+};
+
+static pid_t urlHelperStart(char *cmd)
+{
+    pid_t pid;
+
+    if ((pid = fork()) == 0) {
+        ARGV_t argv = NULL;
+        argvSplit(&argv, cmd, " ");
+        execvp(argv[0], argv);
+        exit(127); /* exit with 127 for compatibility with bash(1) */
+    }
+    free(cmd);
+
+    return pid;
+}
+
+static int urlHelperWait(pid_t pid)
+{
+    int status;
+
+    return ((pid > 0) && (waitpid(pid, &status, 0) != -1) &&
+	    WIFEXITED(status) && (WEXITSTATUS(status) == 0)) ? 0 : -1;
+}
+
+static int urlHelperRun(char *cmd)
+{
+    return urlHelperWait(urlHelperStart(cmd));
+}
+
 int urlGetFile(const char * url, const char * dest)
 {
     char *cmd = NULL;
     const char *target = NULL;
     char *urlhelper = NULL;
-    int status;
-    pid_t pid;
 
     urlhelper = rpmExpand("%{?_urlhelper}", NULL);
 
@@ -111,16 +141,58 @@ int urlGetFile(const char * url, const char * dest)
     /* XXX TODO: sanity checks like target == dest... */
 
     rasprintf(&cmd, "%s %s %s", urlhelper, target, url);
+    free(urlhelper);
 
-    if ((pid = fork()) == 0) {
-        ARGV_t argv = NULL;
-        argvSplit(&argv, cmd, " ");
-        execvp(argv[0], argv);
-        exit(127); /* exit with 127 for compatibility with bash(1) */
+    return urlHelperRun(cmd);
+}
+
+urlFetch urlGetFileAsync(const char * url, const char * dest)
+{
+    urlFetch fetch = xcalloc(1, sizeof(*fetch));
+    char *cmd = NULL;
+    char *urlhelper = NULL;
+
+    urlhelper = rpmExpand("%{?_urlhelper}", NULL);
+    rasprintf(&cmd, "%s %s %s", urlhelper, dest, url);
+    free(urlhelper);
+
+    fetch->pid = urlHelperStart(cmd);
+
+    return fetch;
+}
+
+int urlGetFileWait(urlFetch * fetchp)
+{
+    int rc = -1;
+
+    if (fetchp && *fetchp) {
+	rc = urlHelperWait((*fetchp)->pid);
+	*fetchp = _free(*fetchp);
+    }
+    return rc;
+}
+
+int urlGetFileRange(const char * url, const char * dest,
+		    off_t offset, off_t count)
+{
+    char *cmd = NULL;
+    char *urlhelper = NULL;
+    char *opts = NULL;
+    int rc = -2;
+
+    if (dest == NULL || count <= 0)
+	return -1;
+
+    urlhelper = rpmExpand("%{?_urlhelper_range}", NULL);
+    if (*urlhelper != '\0') {
+	opts = rpmExpand("%{?__urlhelperopts}", NULL);
+	rasprintf(&cmd, "%s %lld-%lld %s %s %s", urlhelper,
+		  (long long) offset, (long long) (offset + count - 1),
+		  opts, dest, url);
+	rc = urlHelperRun(cmd);
+	free(opts);
     }
-    free(cmd);
     free(urlhelper);
 
-    return ((waitpid(pid, &status, 0) != -1) &&
-	    WIFEXITED(status) && (WEXITSTATUS(status) == 0)) ? 0 : -1;
+    return rc;
 }
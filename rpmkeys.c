@@ -22,6 +22,8 @@ static struct poptOption keyOptsTable[] = {
 	N_("import an armored public key"), NULL },
     { "test", '\0', POPT_ARG_NONE, &test, 0,
 	N_("don't import, but tell if it would work or not"), NULL },
+    { "jobs", '\0', POPT_ARG_INT, &rpmcliVerifyJobs, 0,
+	N_("verify up to N packages concurrently"), N_("N") },
 #if 0
     { "delete-key", '\0', (POPT_ARG_VAL|POPT_ARGFLAG_OR), &mode, MODE_DELKEY,
 	N_("list keys from RPM keyring"), NULL },
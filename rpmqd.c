@@ -0,0 +1,434 @@
+#include "system.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#include <popt.h>
+#include <rpm/rpmcli.h>
+#include <rpm/rpmdb.h>
+#include <rpm/rpmlog.h>
+#include <rpm/rpmmacro.h>
+#include <rpm/rpmstring.h>
+#include <rpm/rpmts.h>
+#include <rpm/header.h>
+#include <rpm/argv.h>
+#include "cliutils.h"
+#include "rpmqd.h"
+#include "debug.h"
+
+/* First fd passed in by systemd-style socket activation */
+#define SD_LISTEN_FDS_START	3
+
+/* Cached lookups kept between queries, flushed when the db changes */
+#define QD_CACHE_SIZE		256
+
+static char *socketPath = NULL;
+static int idleTimeout = -1;
+
+static struct poptOption qdOptsTable[] = {
+    { "socket", '\0', POPT_ARG_STRING, &socketPath, 0,
+	N_("path of the socket to listen on"), N_("PATH") },
+    { "idle-exit", '\0', POPT_ARG_INT, &idleTimeout, 0,
+	N_("exit after this many seconds without queries"), N_("SECONDS") },
+    POPT_TABLEEND
+};
+
+static struct poptOption optionsTable[] = {
+    { NULL, '\0', POPT_ARG_INCLUDE_TABLE, qdOptsTable, 0,
+	N_("Query daemon options:"), NULL },
+    { NULL, '\0', POPT_ARG_INCLUDE_TABLE, rpmcliAllPoptTable, 0,
+	N_("Common options for all rpm modes and executables:"), NULL },
+
+    POPT_AUTOALIAS
+    POPT_AUTOHELP
+    POPT_TABLEEND
+};
+
+typedef struct qdEntry_s {
+    char *arg;			/*!< query label as sent by the client */
+    Header *hdrs;		/*!< linked headers matching the label */
+    int nhdrs;
+} qdEntry;
+
+static qdEntry hdrCache[QD_CACHE_SIZE];
+static int nCached = 0;
+static struct stat dbStat;	/*!< db file state the cache was filled from */
+
+static void cacheFlush(void)
+{
+    for (int i = 0; i < nCached; i++) {
+	for (int j = 0; j < hdrCache[i].nhdrs; j++)
+	    headerFree(hdrCache[i].hdrs[j]);
+	free(hdrCache[i].hdrs);
+	free(hdrCache[i].arg);
+    }
+    nCached = 0;
+}
+
+/*
+ * Look up a package label, filling the cache on misses. Negative
+ * results are cached too, an entry with no headers means not installed.
+ */
+static qdEntry *qdLookup(rpmts ts, const char *arg)
+{
+    qdEntry *e = NULL;
+
+    for (int i = 0; i < nCached; i++) {
+	if (rstreq(hdrCache[i].arg, arg)) {
+	    e = &hdrCache[i];
+	    break;
+	}
+    }
+
+    if (e == NULL) {
+	Header h;
+	rpmdbMatchIterator mi = rpmtsInitIterator(ts, RPMDBI_LABEL, arg, 0);
+
+	if (nCached == QD_CACHE_SIZE)
+	    cacheFlush();
+	e = &hdrCache[nCached++];
+	e->arg = xstrdup(arg);
+	e->hdrs = NULL;
+	e->nhdrs = 0;
+	while ((h = rpmdbNextIterator(mi)) != NULL) {
+	    e->hdrs = xrealloc(e->hdrs, (e->nhdrs + 1) * sizeof(*e->hdrs));
+	    e->hdrs[e->nhdrs++] = headerLink(h);
+	}
+	rpmdbFreeIterator(mi);
+    }
+    return e;
+}
+
+/* (Re)open the database, dropping cached headers if it changed on disk */
+static int qdCheckDb(rpmts ts)
+{
+    struct stat sb;
+
+    if (rpmtsGetRdb(ts) == NULL && rpmtsOpenDB(ts, O_RDONLY))
+	return -1;
+
+    if (rpmdbFStat(rpmtsGetRdb(ts), &sb) == 0) {
+	if (sb.st_ino != dbStat.st_ino || sb.st_size != dbStat.st_size ||
+		sb.st_mtime != dbStat.st_mtime) {
+	    cacheFlush();
+	    rpmtsCloseDB(ts);
+	    if (rpmtsOpenDB(ts, O_RDONLY))
+		return -1;
+	    if (rpmdbFStat(rpmtsGetRdb(ts), &sb) != 0)
+		memset(&sb, 0, sizeof(sb));
+	    dbStat = sb;
+	}
+    }
+    return 0;
+}
+
+static int qdWrite(int fd, const void *buf, size_t len)
+{
+    const char *p = buf;
+
+    while (len > 0) {
+	ssize_t w = write(fd, p, len);
+	if (w < 0) {
+	    if (errno == EINTR)
+		continue;
+	    return -1;
+	}
+	p += w;
+	len -= w;
+    }
+    return 0;
+}
+
+static int qdSendRec(int fd, int tag, const char *data, size_t len)
+{
+    char hdr[32];
+
+    snprintf(hdr, sizeof(hdr), "%c %zu\n", tag, len);
+    if (qdWrite(fd, hdr, strlen(hdr)))
+	return -1;
+    return (len > 0) ? qdWrite(fd, data, len) : 0;
+}
+
+static int qdReadLine(int fd, char *buf, size_t size)
+{
+    size_t n = 0;
+
+    while (n + 1 < size) {
+	ssize_t r = read(fd, buf + n, 1);
+	if (r <= 0) {
+	    if (r < 0 && errno == EINTR)
+		continue;
+	    return -1;
+	}
+	if (buf[n++] == '\n')
+	    break;
+    }
+    buf[n] = '\0';
+    return (n > 0 && buf[n-1] == '\n') ? 0 : -1;
+}
+
+static int qdRead(int fd, char *buf, size_t len)
+{
+    size_t n = 0;
+
+    while (n < len) {
+	ssize_t r = read(fd, buf + n, len - n);
+	if (r <= 0) {
+	    if (r < 0 && errno == EINTR)
+		continue;
+	    return -1;
+	}
+	n += r;
+    }
+    return 0;
+}
+
+/*
+ * Format one header for the client. Returns -1 only on connection
+ * failure, query errors are accumulated into ec.
+ */
+static int qdShowHeader(int cd, Header h, const char *fmt, int *ec)
+{
+    const char *errstr = "(unknown error)";
+    char *str = headerFormat(h, fmt, &errstr);
+    int rc;
+
+    if (str == NULL) {
+	char *msg = NULL;
+	rasprintf(&msg, _("incorrect format: %s\n"), errstr);
+	rc = qdSendRec(cd, RPMQD_REC_ERROR, msg, strlen(msg));
+	free(msg);
+	*ec = 1;
+    } else {
+	rc = qdSendRec(cd, RPMQD_REC_DATA, str, strlen(str));
+	free(str);
+    }
+    return rc;
+}
+
+/* Handle one client connection, returns 0 if a response was sent */
+static int qdServe(int cd, rpmts ts)
+{
+    char line[64];
+    char *fmt = NULL;
+    ARGV_t names = NULL;
+    int all = 0;
+    int ec = 0;
+    int rc = -1;
+
+    if (qdReadLine(cd, line, sizeof(line)) ||
+	    !rstreq(line, RPMQD_GREETING "\n"))
+	goto exit;
+
+    for (;;) {
+	char tag;
+	long len;
+	char *data = NULL;
+
+	if (qdReadLine(cd, line, sizeof(line)))
+	    goto exit;
+	if (sscanf(line, "%c %ld", &tag, &len) != 2 ||
+		len < 0 || len > RPMQD_MAX_RECLEN)
+	    goto exit;
+	if (len > 0) {
+	    data = xmalloc(len + 1);
+	    if (qdRead(cd, data, len)) {
+		free(data);
+		goto exit;
+	    }
+	    data[len] = '\0';
+	}
+
+	if (tag == RPMQD_REC_FORMAT) {
+	    free(fmt);
+	    fmt = data;
+	    data = NULL;
+	} else if (tag == RPMQD_REC_NAME && data != NULL) {
+	    argvAdd(&names, data);
+	} else if (tag == RPMQD_REC_ALL) {
+	    all = 1;
+	} else if (tag != RPMQD_REC_GO) {
+	    free(data);
+	    goto exit;
+	}
+	free(data);
+	if (tag == RPMQD_REC_GO)
+	    break;
+    }
+
+    /* Same default as rpmcliQuery() */
+    if (fmt == NULL) {
+	fmt = rpmExpand("%{?_query_all_fmt}\n", NULL);
+	if (strlen(fmt) <= 1) {
+	    free(fmt);
+	    fmt = xstrdup("%{nvra}\n");
+	}
+    }
+
+    if (qdCheckDb(ts)) {
+	const char *msg = _("cannot open Packages database\n");
+	(void) qdSendRec(cd, RPMQD_REC_ERROR, msg, strlen(msg));
+	ec = 1;
+	goto done;
+    }
+
+    if (all) {
+	Header h;
+	rpmdbMatchIterator mi = rpmtsInitIterator(ts, RPMDBI_PACKAGES,
+						  NULL, 0);
+	while ((h = rpmdbNextIterator(mi)) != NULL) {
+	    if (qdShowHeader(cd, h, fmt, &ec)) {
+		rpmdbFreeIterator(mi);
+		goto exit;
+	    }
+	}
+	rpmdbFreeIterator(mi);
+    }
+
+    for (ARGV_const_t name = names; name && *name; name++) {
+	qdEntry *e = qdLookup(ts, *name);
+
+	if (e->nhdrs == 0) {
+	    /* rpm prints this through RPMLOG_NOTICE, ie to stdout */
+	    char *msg = NULL;
+	    int src;
+	    rasprintf(&msg, _("package %s is not installed\n"), *name);
+	    src = qdSendRec(cd, RPMQD_REC_DATA, msg, strlen(msg));
+	    free(msg);
+	    if (src)
+		goto exit;
+	    ec = 1;
+	} else {
+	    for (int i = 0; i < e->nhdrs; i++) {
+		if (qdShowHeader(cd, e->hdrs[i], fmt, &ec))
+		    goto exit;
+	    }
+	}
+    }
+
+done:
+    snprintf(line, sizeof(line), "%c %d\n", RPMQD_REC_EXIT, ec);
+    rc = qdWrite(cd, line, strlen(line));
+
+exit:
+    free(fmt);
+    argvFree(names);
+    return rc;
+}
+
+static int qdListenSocket(void)
+{
+    char *path = NULL;
+    struct sockaddr_un sun;
+    const char *env;
+    int sd = -1;
+
+    /* systemd-style socket activation, one inherited listening socket */
+    env = getenv("LISTEN_PID");
+    if (env && atol(env) == getpid()) {
+	env = getenv("LISTEN_FDS");
+	if (env && atol(env) >= 1)
+	    return SD_LISTEN_FDS_START;
+    }
+
+    path = socketPath ? xstrdup(socketPath)
+		      : rpmExpand("%{?_query_daemon_socket}", NULL);
+    if (*path == '\0') {
+	rpmlog(RPMLOG_ERR, _("no socket path configured "
+			"(--socket or %%_query_daemon_socket)\n"));
+	goto exit;
+    }
+    if (strlen(path) >= sizeof(sun.sun_path)) {
+	rpmlog(RPMLOG_ERR, _("socket path too long: %s\n"), path);
+	goto exit;
+    }
+
+    if ((sd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0) {
+	rpmlog(RPMLOG_ERR, _("failed to create socket: %s\n"),
+		strerror(errno));
+	goto exit;
+    }
+
+    memset(&sun, 0, sizeof(sun));
+    sun.sun_family = AF_UNIX;
+    strcpy(sun.sun_path, path);
+    (void) unlink(path);	/* stale socket from a previous run */
+    if (bind(sd, (struct sockaddr *)&sun, sizeof(sun)) < 0 ||
+	    listen(sd, SOMAXCONN) < 0) {
+	rpmlog(RPMLOG_ERR, _("failed to listen on %s: %s\n"),
+		path, strerror(errno));
+	close(sd);
+	sd = -1;
+    }
+
+exit:
+    free(path);
+    return sd;
+}
+
+static int qdMainLoop(int lsd, rpmts ts)
+{
+    for (;;) {
+	struct pollfd pfd = { .fd = lsd, .events = POLLIN };
+	int cd;
+	int rc = poll(&pfd, 1, (idleTimeout > 0) ? idleTimeout * 1000 : -1);
+
+	if (rc == 0)
+	    break;	/* idle exit, socket activation restarts us */
+	if (rc < 0) {
+	    if (errno == EINTR)
+		continue;
+	    rpmlog(RPMLOG_ERR, _("poll failed: %s\n"), strerror(errno));
+	    return EXIT_FAILURE;
+	}
+
+	if ((cd = accept(lsd, NULL, NULL)) < 0)
+	    continue;
+	(void) qdServe(cd, ts);
+	close(cd);
+    }
+    return EXIT_SUCCESS;
+}
+
+int main(int argc, char *argv[])
+{
+    int ec = EXIT_FAILURE;
+    poptContext optCon = NULL;
+    rpmts ts = NULL;
+    rpmVSFlags vsflags;
+    int lsd = -1;
+
+    xsetprogname(argv[0]); /* Portability call -- see system.h */
+
+    optCon = rpmcliInit(argc, argv, optionsTable);
+
+    if (poptPeekArg(optCon))
+	argerror(_("unexpected arguments to rpmqd"));
+
+    if ((lsd = qdListenSocket()) < 0)
+	goto exit;
+
+    /* A client vanishing mid-response must not kill the daemon */
+    signal(SIGPIPE, SIG_IGN);
+
+    ts = rpmtsCreate();
+    (void) rpmtsSetRootDir(ts, rpmcliRootDir);
+    vsflags = rpmExpandNumeric("%{?_vsflags_query}");
+    vsflags |= rpmcliVSFlags;
+    (void) rpmtsSetVSFlags(ts, vsflags);
+
+    ec = qdMainLoop(lsd, ts);
+
+exit:
+    if (lsd >= 0)
+	close(lsd);
+    cacheFlush();
+    rpmtsFree(ts);
+    rpmcliFini(optCon);
+    return ec;
+}
@@ -0,0 +1,42 @@
+#ifndef _RPMQD_H
+#define _RPMQD_H
+
+/** \file rpmqd.h
+ *
+ * Wire protocol between rpm's query forwarding client and rpmqd(8).
+ *
+ * The client connects to the unix socket %_query_daemon_socket, sends
+ * the greeting line followed by a sequence of records and reads response
+ * records back. A record is a header line "<tag> <len>\n" followed by
+ * exactly len bytes of payload. Client record tags:
+ *
+ *	F	query format (at most once, default format when absent)
+ *	N	package label to look up (repeatable)
+ *	A	query all installed packages (len 0)
+ *	Q	end of request, run the query (len 0)
+ *
+ * Daemon response tags:
+ *
+ *	D	output data, goes to the client's stdout
+ *	E	error text, goes to the client's stderr
+ *	X	end of response, len is the query's exit code
+ *
+ * Anything the daemon cannot serve makes it drop the connection, upon
+ * which the client runs the query in-process as if no daemon existed.
+ */
+
+#define RPMQD_GREETING		"RPMQD 0"
+
+#define RPMQD_REC_FORMAT	'F'
+#define RPMQD_REC_NAME		'N'
+#define RPMQD_REC_ALL		'A'
+#define RPMQD_REC_GO		'Q'
+
+#define RPMQD_REC_DATA		'D'
+#define RPMQD_REC_ERROR		'E'
+#define RPMQD_REC_EXIT		'X'
+
+/* Upper bound for a single record payload (format strings, labels) */
+#define RPMQD_MAX_RECLEN	(64*1024)
+
+#endif /* _RPMQD_H */
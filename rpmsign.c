@@ -2,10 +2,12 @@
 #include <errno.h>
 #include <sys/wait.h>
 #include <termios.h>
+#include <pthread.h>
 
 #include <popt.h>
 #include <rpm/rpmcli.h>
 #include <rpm/rpmsign.h>
+#include <rpm/argv.h>
 #include "cliutils.h"
 #include "debug.h"
 
@@ -122,6 +124,34 @@ exit:
 }
 #endif
 
+struct signJob_s {
+    ARGV_const_t paths;		/* packages to sign */
+    struct rpmSignArgs *sargs;
+    int next;			/* next unclaimed path, under lock */
+    int nfail;			/* failed packages, under lock */
+    pthread_mutex_t lock;
+};
+
+static void *signWorker(void *data)
+{
+    struct signJob_s *job = data;
+
+    pthread_mutex_lock(&job->lock);
+    while (job->paths[job->next] != NULL) {
+	const char *path = job->paths[job->next++];
+	int rc;
+
+	pthread_mutex_unlock(&job->lock);
+	rc = rpmPkgSign(path, job->sargs);
+	pthread_mutex_lock(&job->lock);
+
+	if (rc < 0)
+	    job->nfail++;
+    }
+    pthread_mutex_unlock(&job->lock);
+    return NULL;
+}
+
 /* TODO: permit overriding macro setup on the command line */
 static int doSign(poptContext optCon, struct rpmSignArgs *sargs)
 {
@@ -171,11 +201,36 @@ static int doSign(poptContext optCon, struct rpmSignArgs *sargs)
 #endif
 
     const char *arg;
+    ARGV_t paths = NULL;
+    int nthreads = rpmExpandNumeric("%{?_sign_threads}");
+
     rc = 0;
-    while ((arg = poptGetArg(optCon)) != NULL) {
-	if (rpmPkgSign(arg, sargs) < 0)
-	    rc++;
+    while ((arg = poptGetArg(optCon)) != NULL)
+	argvAdd(&paths, arg);
+
+    if (nthreads > argvCount(paths))
+	nthreads = argvCount(paths);
+
+    if (nthreads > 1) {
+	/* Overlap the gpg round trips of several packages (bounded) */
+	struct signJob_s job = { .paths = paths, .sargs = sargs };
+	pthread_t *tids = xcalloc(nthreads, sizeof(*tids));
+
+	pthread_mutex_init(&job.lock, NULL);
+	for (int i = 0; i < nthreads; i++)
+	    pthread_create(&tids[i], NULL, signWorker, &job);
+	for (int i = 0; i < nthreads; i++)
+	    pthread_join(tids[i], NULL);
+	pthread_mutex_destroy(&job.lock);
+	free(tids);
+	rc = job.nfail;
+    } else if (paths != NULL) {
+	for (ARGV_const_t p = paths; *p != NULL; p++) {
+	    if (rpmPkgSign(*p, sargs) < 0)
+		rc++;
+	}
     }
+    argvFree(paths);
 
 exit:
     free(name);
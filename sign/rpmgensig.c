@@ -9,6 +9,7 @@
 #include <sys/wait.h>
 #include <popt.h>
 #include <fcntl.h>
+#include <pthread.h>
 #ifdef WITH_FSVERITY
 #include <libfsverity.h>
 #endif
@@ -197,6 +198,15 @@ static int runGPG(sigTarget sigt, const char *sigfile)
         goto exit;
     }
 
+    /*
+     * The filename macros pushed here must still be in effect when the
+     * child snapshots the macro state in fork(), so when packages are
+     * signed concurrently the push+fork+pop window needs to be atomic.
+     * gpg itself runs outside the lock.
+     */
+    static pthread_mutex_t fork_lock = PTHREAD_MUTEX_INITIALIZER;
+    pthread_mutex_lock(&fork_lock);
+
     rpmPushMacro(NULL, "__plaintext_filename", NULL, "-", -1);
     rpmPushMacro(NULL, "__signature_filename", NULL, sigfile, -1);
 
@@ -230,6 +240,8 @@ static int runGPG(sigTarget sigt, const char *sigfile)
     rpmPopMacro(NULL, "__plaintext_filename");
     rpmPopMacro(NULL, "__signature_filename");
 
+    pthread_mutex_unlock(&fork_lock);
+
     close(pipefd[0]);
     fpipe = fdopen(pipefd[1], "w");
     if (!fpipe) {
@@ -633,13 +645,29 @@ static int rpmSign(const char *rpm, int deleting, int flags)
 	res = -1;
     }
 
-    /* Try to make new signature smaller to have size of original signature */
+    /*
+     * Adjust the reserved space so the new signature header has the size
+     * of the original one, permitting an in-place rewrite of just the
+     * signature region instead of copying the multi-GB rest of the
+     * package through a temp file. Only when the change doesn't fit in
+     * the reserved padding (see %__gpg_reserved_space) do we fall back
+     * to the full copy.
+     */
     if (headerGet(sigh, RPMSIGTAG_RESERVEDSPACE, &utd, HEADERGET_MINMEM)) {
 	int diff = headerSizeof(sigh, HEADER_MAGIC_YES) - origSigSize;
 
-	if (diff > 0 && diff < utd.count) {
-	    utd.count -= diff;
-	    headerMod(sigh, &utd);
+	if (diff < (int)utd.count) {
+	    if (diff != 0) {
+		char *zeros = NULL;
+		utd.count -= diff;
+		if (diff < 0) {
+		    /* new signature is smaller, grow the padding to match */
+		    zeros = xcalloc(utd.count, 1);
+		    utd.data = zeros;
+		}
+		headerMod(sigh, &utd);
+		free(zeros);
+	    }
 	    insSig = 1;
 	}
     }
@@ -0,0 +1,352 @@
+/*
+ * Microbenchmark driver for core librpm primitives (make bench).
+ *
+ * Covers rpmvercmp(), headerImport(), rpmstrPoolId(), macro expansion
+ * and provide-name index lookups. Each benchmark runs on a synthetic
+ * corpus by default; representative corpora can be supplied from the
+ * command line (recorded header lists, provide-string dumps, macro
+ * traces). Results are reported as ns/op with the standard deviation
+ * over the measured runs, one line per benchmark, for acceptance-gate
+ * consumption.
+ */
+
+#include "system.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <popt.h>
+
+#include <rpm/rpmlib.h>
+#include <rpm/header.h>
+#include <rpm/rpmio.h>
+#include <rpm/rpmmacro.h>
+#include <rpm/rpmstrpool.h>
+#include <rpm/rpmts.h>
+#include <rpm/rpmdb.h>
+#include <rpm/argv.h>
+
+#include "rpmio/rpmver.h"
+
+#include "debug.h"
+
+static int ops = 100000;	/* operations per run */
+static int reps = 5;		/* measured runs per benchmark */
+static char *headerPath = NULL;
+static char *providesPath = NULL;
+static char *macroPath = NULL;
+static char *dbPath = NULL;
+
+static struct poptOption optionsTable[] = {
+    { "ops", 'n', POPT_ARG_INT, &ops, 0,
+	"operations per run", "N" },
+    { "runs", 'r', POPT_ARG_INT, &reps, 0,
+	"measured runs per benchmark", "N" },
+    { "headers", 'H', POPT_ARG_STRING, &headerPath, 0,
+	"recorded header list (as from rpmdb --exportdb)", "FILE" },
+    { "provides", 'p', POPT_ARG_STRING, &providesPath, 0,
+	"provide-string dump, one per line", "FILE" },
+    { "macros", 'm', POPT_ARG_STRING, &macroPath, 0,
+	"macro trace, one expression per line", "FILE" },
+    { "dbpath", 'd', POPT_ARG_STRING, &dbPath, 0,
+	"benchmark provide lookups against this rpmdb", "DIR" },
+    POPT_AUTOHELP
+    POPT_TABLEEND
+};
+
+static double nowNs(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+typedef void (*benchFunc)(int nops, void *data);
+
+static void report(const char *name, benchFunc fn, void *data)
+{
+    double *samples = xmalloc(reps * sizeof(*samples));
+    double mean = 0, var = 0;
+
+    /* One warmup run, then the measured ones */
+    fn(ops, data);
+    for (int r = 0; r < reps; r++) {
+	double t = nowNs();
+	fn(ops, data);
+	samples[r] = (nowNs() - t) / ops;
+	mean += samples[r];
+    }
+    mean /= reps;
+    for (int r = 0; r < reps; r++)
+	var += (samples[r] - mean) * (samples[r] - mean);
+    var = (reps > 1) ? var / (reps - 1) : 0;
+
+    printf("%-20s %12.1f ns/op  +-%8.1f  (%d runs of %d ops)\n",
+	   name, mean, sqrt(var), reps, ops);
+    free(samples);
+}
+
+/* Load a line-per-entry corpus, NULL if the file can't be read */
+static ARGV_t loadLines(const char *path)
+{
+    ARGV_t av = NULL;
+    FILE *fp;
+    char *line = NULL;
+    size_t llen = 0;
+
+    if (path == NULL || (fp = fopen(path, "r")) == NULL)
+	return NULL;
+    while (getline(&line, &llen, fp) >= 0) {
+	line[strcspn(line, "\n")] = '\0';
+	if (*line != '\0')
+	    argvAdd(&av, line);
+    }
+    free(line);
+    fclose(fp);
+    return av;
+}
+
+/*
+ * rpmvercmp: compare version strings pairwise across the corpus.
+ */
+static const char * const vercmpDefaults[] = {
+    "1.0", "1.0.1", "1.0.1a", "2.4.6-1", "2.4.6-2", "0:1.2-3", "20210101",
+    "4.19.0", "4.19.90", "1.2.3.4.5.6", "1.fc33", "1.2~rc1", "1.2^post1",
+    "3.10.0-1160.el7", "5.15.12", "0.0.0", "10.20.30", "1a2b3c",
+    NULL
+};
+
+struct vercmpData_s { ARGV_t av; int n; };
+
+static void benchVercmp(int nops, void *data)
+{
+    struct vercmpData_s *vd = data;
+    for (int i = 0; i < nops; i++) {
+	(void) rpmvercmp(vd->av[i % vd->n], vd->av[(i * 7 + 3) % vd->n]);
+    }
+}
+
+/*
+ * headerImport: re-import recorded (or synthesized) header blobs,
+ * copy mode so every iteration pays the full load.
+ */
+struct hdrData_s { void **blobs; unsigned int *sizes; int n; };
+
+static Header synthHeader(void)
+{
+    Header h = headerNew();
+    char buf[64];
+
+    headerPutString(h, RPMTAG_NAME, "benchpkg");
+    headerPutString(h, RPMTAG_VERSION, "1.0");
+    headerPutString(h, RPMTAG_RELEASE, "1");
+    headerPutString(h, RPMTAG_ARCH, "noarch");
+    headerPutString(h, RPMTAG_SUMMARY, "synthetic benchmark header");
+    headerPutString(h, RPMTAG_DESCRIPTION, "synthetic benchmark header");
+    for (int i = 0; i < 500; i++) {
+	uint32_t ix = i / 50;
+	snprintf(buf, sizeof(buf), "file%04d.dat", i);
+	headerPutString(h, RPMTAG_BASENAMES, buf);
+	headerPutUint32(h, RPMTAG_DIRINDEXES, &ix, 1);
+    }
+    for (int i = 0; i < 10; i++) {
+	snprintf(buf, sizeof(buf), "/usr/share/benchpkg/dir%02d/", i);
+	headerPutString(h, RPMTAG_DIRNAMES, buf);
+    }
+    return h;
+}
+
+static int hdrDataInit(struct hdrData_s *hd, const char *path)
+{
+    Header hdrs[32];
+    int n = 0;
+
+    if (path != NULL) {
+	FD_t fd = Fopen(path, "r.ufdio");
+	if (fd != NULL && !Ferror(fd)) {
+	    Header h;
+	    while (n < 32 && (h = headerRead(fd, HEADER_MAGIC_YES)) != NULL)
+		hdrs[n++] = h;
+	}
+	if (fd != NULL)
+	    Fclose(fd);
+    }
+    if (n == 0)
+	hdrs[n++] = synthHeader();
+
+    hd->n = n;
+    hd->blobs = xmalloc(n * sizeof(*hd->blobs));
+    hd->sizes = xmalloc(n * sizeof(*hd->sizes));
+    for (int i = 0; i < n; i++) {
+	hd->blobs[i] = headerExport(hdrs[i], &hd->sizes[i]);
+	headerFree(hdrs[i]);
+	if (hd->blobs[i] == NULL)
+	    return -1;
+    }
+    return 0;
+}
+
+static void benchHeaderImport(int nops, void *data)
+{
+    struct hdrData_s *hd = data;
+    for (int i = 0; i < nops; i++) {
+	int ix = i % hd->n;
+	Header h = headerImport(hd->blobs[ix], hd->sizes[ix],
+				HEADERIMPORT_COPY);
+	headerFree(h);
+    }
+}
+
+/*
+ * rpmstrPoolId: intern the provide corpus into a pool over and over,
+ * a hit-dominated mix as dependency processing sees it.
+ */
+struct poolData_s { ARGV_t av; int n; rpmstrPool pool; };
+
+static ARGV_t synthProvides(void)
+{
+    ARGV_t av = NULL;
+    char buf[64];
+
+    for (int i = 0; i < 2000; i++) {
+	snprintf(buf, sizeof(buf), "libbench%d.so.%d()(64bit)",
+		 i % 400, i % 7);
+	argvAdd(&av, buf);
+    }
+    return av;
+}
+
+static void benchStrPoolId(int nops, void *data)
+{
+    struct poolData_s *pd = data;
+    for (int i = 0; i < nops; i++) {
+	(void) rpmstrPoolId(pd->pool, pd->av[i % pd->n], 1);
+    }
+}
+
+/*
+ * Macro expansion: expand trace lines (or representative synthetic
+ * expressions) through the full macro engine.
+ */
+static const char * const macroDefaults[] = {
+    "%{_libdir}/bench", "%{?_smp_mflags}", "%{expand:%{_bindir}}",
+    "%(echo noop >/dev/null)x", "%{lua:print('')}", "%{_localstatedir}",
+    NULL
+};
+
+struct macroData_s { ARGV_t av; int n; };
+
+static void benchExpand(int nops, void *data)
+{
+    struct macroData_s *md = data;
+    for (int i = 0; i < nops; i++) {
+	char *s = rpmExpand(md->av[i % md->n], NULL);
+	free(s);
+    }
+}
+
+/*
+ * Provide-name index lookups through the regular rpmdb stack.
+ */
+struct dbData_s { rpmts ts; ARGV_t av; int n; };
+
+static void benchDbLookup(int nops, void *data)
+{
+    struct dbData_s *dd = data;
+    for (int i = 0; i < nops; i++) {
+	rpmdbMatchIterator mi = rpmtsInitIterator(dd->ts, RPMDBI_PROVIDENAME,
+						  dd->av[i % dd->n], 0);
+	while (rpmdbNextIterator(mi) != NULL)
+	    ;
+	rpmdbFreeIterator(mi);
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    poptContext optCon;
+    struct vercmpData_s vd = { NULL, 0 };
+    struct hdrData_s hd = { NULL, NULL, 0 };
+    struct poolData_s pd = { NULL, 0, NULL };
+    struct macroData_s md = { NULL, 0 };
+    int rc;
+
+    optCon = poptGetContext("rpmbench", argc, (const char **)argv,
+			    optionsTable, 0);
+    while ((rc = poptGetNextOpt(optCon)) > 0)
+	;
+    if (rc < -1) {
+	fprintf(stderr, "rpmbench: %s: %s\n",
+		poptBadOption(optCon, POPT_BADOPTION_NOALIAS),
+		poptStrerror(rc));
+	exit(EXIT_FAILURE);
+    }
+    if (ops <= 0 || reps <= 0) {
+	fprintf(stderr, "rpmbench: ops and runs must be positive\n");
+	exit(EXIT_FAILURE);
+    }
+
+    if (rpmReadConfigFiles(NULL, NULL) != 0) {
+	fprintf(stderr, "rpmbench: failed to read rpm configuration\n");
+	exit(EXIT_FAILURE);
+    }
+
+    vd.av = loadLines(providesPath);	/* versions benefit from any corpus */
+    if (vd.av == NULL)
+	vd.av = argvNew();
+    if (argvCount(vd.av) < 2) {
+	vd.av = argvFree(vd.av);
+	for (int i = 0; vercmpDefaults[i]; i++)
+	    argvAdd(&vd.av, vercmpDefaults[i]);
+    }
+    vd.n = argvCount(vd.av);
+    report("rpmvercmp", benchVercmp, &vd);
+
+    if (hdrDataInit(&hd, headerPath) == 0)
+	report("headerImport", benchHeaderImport, &hd);
+    else
+	fprintf(stderr, "rpmbench: header corpus unusable, skipped\n");
+
+    pd.av = loadLines(providesPath);
+    if (pd.av == NULL)
+	pd.av = synthProvides();
+    pd.n = argvCount(pd.av);
+    pd.pool = rpmstrPoolCreate();
+    report("rpmstrPoolId", benchStrPoolId, &pd);
+
+    md.av = loadLines(macroPath);
+    if (md.av == NULL) {
+	for (int i = 0; macroDefaults[i]; i++)
+	    argvAdd(&md.av, macroDefaults[i]);
+    }
+    md.n = argvCount(md.av);
+    report("expandMacro", benchExpand, &md);
+
+    if (dbPath != NULL) {
+	struct dbData_s dd = { NULL, NULL, 0 };
+	char *dbpath = rstrscat(NULL, "_dbpath ", dbPath, NULL);
+	rpmDefineMacro(NULL, dbpath, 0);
+	free(dbpath);
+	dd.ts = rpmtsCreate();
+	dd.av = pd.av;
+	dd.n = pd.n;
+	report("dbProvideLookup", benchDbLookup, &dd);
+	rpmtsFree(dd.ts);
+    }
+
+    vd.av = argvFree(vd.av);
+    pd.av = argvFree(pd.av);
+    md.av = argvFree(md.av);
+    pd.pool = rpmstrPoolFree(pd.pool);
+    for (int i = 0; i < hd.n; i++)
+	free(hd.blobs[i]);
+    free(hd.blobs);
+    free(hd.sizes);
+
+    rpmFreeRpmrc();
+    rpmFreeMacros(NULL);
+    poptFreeContext(optCon);
+    return 0;
+}
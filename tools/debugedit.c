@@ -88,6 +88,7 @@ int list_file_fd = -1;
 int do_build_id = 0;
 int no_recompute_build_id = 0;
 char *build_id_seed = NULL;
+char *files_list = NULL;
 
 int show_version = 0;
 
@@ -676,6 +677,8 @@ update_rela_data (DSO *dso, struct debug_section *sec)
   elf_flagdata (data, ELF_C_SET, ELF_F_DIRTY);
 
   free (sec->relbuf);
+  sec->relbuf = NULL;
+  sec->relend = NULL;
 }
 
 struct abbrev_attr
@@ -3020,6 +3023,9 @@ static struct poptOption optionsTable[] = {
       "if recomputing the build ID note use this string as hash seed", NULL },
     { "no-recompute-build-id",  'n', POPT_ARG_NONE, &no_recompute_build_id, 0,
       "do not recompute build ID note even when -i or -s are given", NULL },
+    { "files",  'F', POPT_ARG_STRING, &files_list, 0,
+      "process all files listed (newline separated) in this file, "
+      "'-' reads the list from standard input", NULL },
     { "version", '\0', POPT_ARG_NONE, &show_version, 0,
       "print the debugedit version", NULL },
       POPT_AUTOHELP
@@ -3233,18 +3239,49 @@ handle_build_id (DSO *dso, Elf_Data *build_id,
   }
 }
 
+/* Reset the global per-file state for the next file in batch mode.  */
+static void
+clean_dwarf_state (void)
+{
+  for (int s = 0; debug_sections[s].name; s++)
+    {
+      debug_section *secp = &debug_sections[s];
+      /* In case there were multiple (COMDAT) .debug_macro or
+	 .debug_types sections, free them.  */
+      struct debug_section *sec = secp->next;
+      while (sec != NULL)
+	{
+	  struct debug_section *next = sec->next;
+	  free (sec->relbuf);
+	  free (sec);
+	  sec = next;
+	}
+      free (secp->relbuf);
+      secp->data = NULL;
+      secp->elf_data = NULL;
+      secp->size = 0;
+      secp->sec = 0;
+      secp->relsec = 0;
+      secp->relbuf = NULL;
+      secp->relend = NULL;
+      secp->next = NULL;
+    }
+  need_string_replacement = false;
+  need_strp_update = false;
+  need_line_strp_update = false;
+  need_stmt_update = false;
+  rel_updated = false;
+  dirty_elf = 0;
+}
+
+static void edit_file (const char *file);
+
 int
 main (int argc, char *argv[])
 {
-  DSO *dso;
-  int fd, i;
-  const char *file;
   poptContext optCon;   /* context for parsing command-line options */
   int nextopt;
   const char **args;
-  struct stat stat_buf;
-  Elf_Data *build_id = NULL;
-  size_t build_id_offset = 0, build_id_size = 0;
 
   optCon = poptGetContext("debugedit", argc, (const char **)argv, optionsTable, 0);
 
@@ -3267,7 +3304,9 @@ main (int argc, char *argv[])
     }
 
   args = poptGetArgs (optCon);
-  if (args == NULL || args[0] == NULL || args[1] != NULL)
+  if (files_list != NULL
+      ? (args != NULL && args[0] != NULL)
+      : (args == NULL || args[0] == NULL || args[1] != NULL))
     {
       poptPrintHelp(optCon, stdout, 0);
       exit (1);
@@ -3307,14 +3346,57 @@ main (int argc, char *argv[])
       list_file_fd = open (list_file, O_WRONLY|O_CREAT|O_APPEND, 0644);
     }
 
-  file = args[0];
-
   if (elf_version(EV_CURRENT) == EV_NONE)
     {
       fprintf (stderr, "library out of date\n");
       exit (1);
     }
 
+  if (files_list != NULL)
+    {
+      FILE *fl = strcmp (files_list, "-") == 0 ? stdin
+						: fopen (files_list, "r");
+      char *line = NULL;
+      size_t linesz = 0;
+      ssize_t len;
+
+      if (fl == NULL)
+	{
+	  fprintf (stderr, "Failed to open file list '%s': %s\n",
+		   files_list, strerror (errno));
+	  exit (1);
+	}
+      while ((len = getline (&line, &linesz, fl)) > 0)
+	{
+	  if (line[len - 1] == '\n')
+	    line[--len] = '\0';
+	  if (len > 0)
+	    edit_file (line);
+	}
+      free (line);
+      if (fl != stdin)
+	fclose (fl);
+    }
+  else
+    edit_file (args[0]);
+
+  poptFreeContext (optCon);
+
+  return 0;
+}
+
+/* Process a single ELF file in place. The base/dest dir rewrites,
+   list file and build-id options are globals shared by all files
+   when running in batch (--files) mode.  */
+static void
+edit_file (const char *file)
+{
+  DSO *dso;
+  int fd, i;
+  struct stat stat_buf;
+  Elf_Data *build_id = NULL;
+  size_t build_id_offset = 0, build_id_size = 0;
+
   if (stat(file, &stat_buf) < 0)
     {
       fprintf (stderr, "Failed to open input file '%s': %s\n", file, strerror(errno));
@@ -3541,29 +3623,7 @@ main (int argc, char *argv[])
   destroy_lines (&dso->lines);
   free (dso);
 
-  /* In case there were multiple (COMDAT) .debug_macro sections,
-     free them.  */
-  struct debug_section *macro_sec = &debug_sections[DEBUG_MACRO];
-  macro_sec = macro_sec->next;
-  while (macro_sec != NULL)
-    {
-      struct debug_section *next = macro_sec->next;
-      free (macro_sec);
-      macro_sec = next;
-    }
-
-  /* In case there were multiple (COMDAT) .debug_types sections,
-     free them.  */
-  struct debug_section *types_sec = &debug_sections[DEBUG_TYPES];
-  types_sec = types_sec->next;
-  while (types_sec != NULL)
-    {
-      struct debug_section *next = types_sec->next;
-      free (types_sec);
-      types_sec = next;
-    }
-
-  poptFreeContext (optCon);
-
-  return 0;
+  /* Reset global per-file state (including any COMDAT .debug_macro
+     and .debug_types chains) for the next file in batch mode.  */
+  clean_dwarf_state ();
 }
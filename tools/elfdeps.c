@@ -19,6 +19,7 @@ int filter_soname = 1;
 int require_interp = 0;
 int add_arch = 0;
 int add_nonarch = 1;
+char *files_from = NULL;
 
 typedef struct elfInfo_s {
     Elf *elf;
@@ -369,8 +370,7 @@ static int processFile(const char *fn, int dtype)
     if (fdno < 0 || fstat(fdno, &st) < 0)
 	goto exit;
 
-    (void) elf_version(EV_CURRENT);
-    ei->elf = elf_begin(fdno, ELF_C_READ, NULL);
+    ei->elf = elf_begin(fdno, ELF_C_READ_MMAP, NULL);
     if (ei->elf == NULL || elf_kind(ei->elf) != ELF_K_ELF)
 	goto exit;
 
@@ -437,6 +437,24 @@ exit:
     return rc;
 }
 
+/* Process a stream of newline separated file names */
+static int processAll(FILE *fp, int dtype)
+{
+    char fn[BUFSIZ];
+    int rc = 0;
+
+    while (fgets(fn, sizeof(fn), fp) != NULL) {
+	size_t len = strlen(fn);
+	if (len > 0 && fn[len-1] == '\n')
+	    fn[--len] = '\0';
+	if (len == 0)
+	    continue;
+	if (processFile(fn, dtype))
+	    rc = EXIT_FAILURE;
+    }
+    return rc;
+}
+
 int main(int argc, char *argv[])
 {
     int rc = 0;
@@ -453,6 +471,7 @@ int main(int argc, char *argv[])
 	{ "no-filter-soname", 0, POPT_ARG_VAL, &filter_soname, 0, NULL, NULL },
 	{ "no-nonarch", 0, POPT_ARG_VAL, &add_nonarch, 0, NULL, NULL },
 	{ "require-interp", 0, POPT_ARG_VAL, &require_interp, -1, NULL, NULL },
+	{ "files-from", 0, POPT_ARG_STRING, &files_from, 0, NULL, NULL },
 	POPT_AUTOHELP 
 	POPT_TABLEEND
     };
@@ -465,20 +484,27 @@ int main(int argc, char *argv[])
 	exit(EXIT_FAILURE);
     }
 
-    /* Normally our data comes from stdin, but permit args too */
-    if (poptPeekArg(optCon)) {
+    (void) elf_version(EV_CURRENT);
+
+    /* Normally our data comes from stdin, but permit a list file and args */
+    if (files_from != NULL) {
+	FILE *fp = rstreq(files_from, "-") ? stdin : fopen(files_from, "r");
+	if (fp == NULL) {
+	    fprintf(stderr, "%s: %s\n", files_from, strerror(errno));
+	    rc = EXIT_FAILURE;
+	} else {
+	    rc = processAll(fp, requires);
+	    if (fp != stdin)
+		fclose(fp);
+	}
+    } else if (poptPeekArg(optCon)) {
 	const char *fn;
 	while ((fn = poptGetArg(optCon)) != NULL) {
 	    if (processFile(fn, requires))
 		rc = EXIT_FAILURE;
 	}
     } else {
-	char fn[BUFSIZ];
-	while (fgets(fn, sizeof(fn), stdin) != NULL) {
-	    fn[strlen(fn)-1] = '\0';
-	    if (processFile(fn, requires))
-		rc = EXIT_FAILURE;
-	}
+	rc = processAll(stdin, requires);
     }
 
     poptFreeContext(optCon);
@@ -1,12 +1,20 @@
 #include "system.h"
 
+#include <errno.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
 #include <rpm/rpmbuild.h>
+#include <rpm/rpmlog.h>
 #include <rpm/argv.h>
 #include <rpm/rpmds.h>
 #include <rpm/rpmfc.h>
 
 #include "debug.h"
 
+static char * serve_socket = NULL;
+
 static int print_provides;
 
 static int print_requires;
@@ -39,11 +47,152 @@ static void rpmdsPrint(const char * msg, rpmds ds, FILE * fp)
 	fprintf(fp, "%s\n", rpmdsDNEVR(ds)+2);
 }
 
+/*
+ * Classify one batch of files and print the requested dependencies.
+ * This is a single command line invocation's worth of work, the server
+ * mode runs it once per request from an already initialized process.
+ */
+static int classifyAndPrint(ARGV_t av, FILE * fp)
+{
+    rpmfc fc = NULL;
+    int rc = 1;
+
+    /* Make sure file names are sorted. */
+    argvSort(av, NULL);
+
+    /* Build file/package class and dependency dictionaries. */
+    fc = rpmfcCreate(getenv("RPM_BUILD_ROOT"), 0);
+    if (rpmfcClassify(fc, av, NULL) || rpmfcApply(fc))
+	goto exit;
+
+    if (print_alldeps || _rpmfc_debug)
+	rpmfcPrint(NULL, fc, print_alldeps ? fp : NULL);
+
+    if (!print_alldeps) {
+	if (print_provides)
+	    rpmdsPrint(NULL, rpmfcProvides(fc), fp);
+	if (print_requires)
+	    rpmdsPrint(NULL, rpmfcRequires(fc), fp);
+	if (print_recommends)
+	    rpmdsPrint(NULL, rpmfcRecommends(fc), fp);
+	if (print_suggests)
+	    rpmdsPrint(NULL, rpmfcSuggests(fc), fp);
+	if (print_supplements)
+	    rpmdsPrint(NULL, rpmfcSupplements(fc), fp);
+	if (print_enhances)
+	    rpmdsPrint(NULL, rpmfcEnhances(fc), fp);
+	if (print_conflicts)
+	    rpmdsPrint(NULL, rpmfcConflicts(fc), fp);
+	if (print_obsoletes)
+	    rpmdsPrint(NULL, rpmfcObsoletes(fc), fp);
+	if (print_orderwithrequires)
+	    rpmdsPrint(NULL, rpmfcOrderWithRequires(fc), fp);
+    }
+
+    rc = 0;
+
+exit:
+    rpmfcFree(fc);
+    return rc;
+}
+
+/*
+ * Answer classification requests on a unix socket from this warm
+ * process, saving the rpm configuration and macro setup that dominates
+ * short rpmdeps runs. The protocol matches the stdin convention: a
+ * request is newline-delimited file names terminated by an empty line,
+ * the response is the dependency lines terminated by an empty line.
+ * A connection can carry any number of requests.
+ */
+static int serveRequests(const char * path)
+{
+    int sock = socket(AF_UNIX, SOCK_STREAM, 0);
+    struct sockaddr_un sun;
+    int ec = 1;
+
+    memset(&sun, 0, sizeof(sun));
+    sun.sun_family = AF_UNIX;
+    if (sock < 0 || strlen(path) >= sizeof(sun.sun_path)) {
+	rpmlog(RPMLOG_ERR, _("cannot create server socket %s: %s\n"),
+	       path, (sock < 0) ? strerror(errno) : "path too long");
+	goto exit;
+    }
+    strcpy(sun.sun_path, path);
+
+    (void) unlink(path);
+    if (bind(sock, (struct sockaddr *)&sun, sizeof(sun)) < 0 ||
+	    listen(sock, SOMAXCONN) < 0) {
+	rpmlog(RPMLOG_ERR, _("cannot listen on %s: %s\n"),
+	       path, strerror(errno));
+	goto exit;
+    }
+
+    for (;;) {
+	int cfd = accept(sock, NULL, NULL);
+	FILE *in = NULL;
+	FILE *out = NULL;
+
+	if (cfd < 0) {
+	    if (errno == EINTR)
+		continue;
+	    rpmlog(RPMLOG_ERR, _("accept on %s failed: %s\n"),
+		   path, strerror(errno));
+	    break;
+	}
+
+	in = fdopen(cfd, "r");
+	out = fdopen(dup(cfd), "w");
+	if (in == NULL || out == NULL) {
+	    if (in) fclose(in); else close(cfd);
+	    if (out) fclose(out);
+	    continue;
+	}
+
+	for (;;) {
+	    ARGV_t av = NULL;
+	    char buf[BUFSIZ];
+	    int eof = 1;
+
+	    while (fgets(buf, sizeof(buf), in) != NULL) {
+		char *be = buf + strlen(buf) - 1;
+		while (be >= buf && strchr("\r\n", *be) != NULL)
+		    *be-- = '\0';
+		if (buf[0] == '\0') {
+		    eof = 0;
+		    break;
+		}
+		argvAdd(&av, buf);
+	    }
+
+	    if (av != NULL) {
+		(void) classifyAndPrint(av, out);
+		av = argvFree(av);
+	    }
+	    fputs("\n", out);
+	    fflush(out);
+
+	    if (eof)
+		break;
+	}
+
+	fclose(in);
+	fclose(out);
+    }
+    ec = 0;
+
+exit:
+    if (sock >= 0) {
+	close(sock);
+	(void) unlink(path);
+    }
+    return ec;
+}
+
 static struct poptOption optionsTable[] = {
 
  { NULL, '\0', POPT_ARG_INCLUDE_TABLE, rpmcliAllPoptTable, 0,
 	N_("Common options for all rpm modes and executables:"),
-	NULL }, 
+	NULL },
 
  { "provides", 'P', POPT_ARG_VAL, &print_provides, -1,
         NULL, NULL },
@@ -65,6 +214,9 @@ static struct poptOption optionsTable[] = {
         NULL, NULL },
  { "alldeps", '\0', POPT_ARG_VAL, &print_alldeps, -1,
         NULL, NULL },
+ { "serve", '\0', POPT_ARG_STRING, &serve_socket, 0,
+	N_("answer classification requests on unix socket SOCKET"),
+	N_("SOCKET") },
 
    POPT_AUTOALIAS
    POPT_AUTOHELP
@@ -76,7 +228,6 @@ main(int argc, char *argv[])
 {
     poptContext optCon = NULL;
     ARGV_t av = NULL;
-    rpmfc fc = NULL;
     int ec = 1;
     char buf[BUFSIZ];
 
@@ -86,6 +237,11 @@ main(int argc, char *argv[])
     if (optCon == NULL)
 	goto exit;
 
+    if (serve_socket != NULL) {
+	ec = serveRequests(serve_socket);
+	goto exit;
+    }
+
     /* normally files get passed through stdin but also accept files as args */
     if (poptPeekArg(optCon)) {
 	const char *arg;
@@ -100,43 +256,11 @@ main(int argc, char *argv[])
 	    argvAdd(&av, buf);
 	}
     }
-    /* Make sure file names are sorted. */
-    argvSort(av, NULL);
 
-    /* Build file/package class and dependency dictionaries. */
-    fc = rpmfcCreate(getenv("RPM_BUILD_ROOT"), 0);
-    if (rpmfcClassify(fc, av, NULL) || rpmfcApply(fc))
-	goto exit;
-
-    if (print_alldeps || _rpmfc_debug)
-	rpmfcPrint(NULL, fc, print_alldeps ? stdout : NULL);
-
-    if (!print_alldeps) {
-	if (print_provides)
-	    rpmdsPrint(NULL, rpmfcProvides(fc), stdout);
-	if (print_requires)
-	    rpmdsPrint(NULL, rpmfcRequires(fc), stdout);
-	if (print_recommends)
-	    rpmdsPrint(NULL, rpmfcRecommends(fc), stdout);
-	if (print_suggests)
-	    rpmdsPrint(NULL, rpmfcSuggests(fc), stdout);
-	if (print_supplements)
-	    rpmdsPrint(NULL, rpmfcSupplements(fc), stdout);
-	if (print_enhances)
-	    rpmdsPrint(NULL, rpmfcEnhances(fc), stdout);
-	if (print_conflicts)
-	    rpmdsPrint(NULL, rpmfcConflicts(fc), stdout);
-	if (print_obsoletes)
-	    rpmdsPrint(NULL, rpmfcObsoletes(fc), stdout);
-	if (print_orderwithrequires)
-	    rpmdsPrint(NULL, rpmfcOrderWithRequires(fc), stdout);
-    }
-
-    ec = 0;
+    ec = classifyAndPrint(av, stdout);
 
 exit:
     argvFree(av);
-    rpmfcFree(fc);
     rpmcliFini(optCon);
     return ec;
 }
@@ -10,14 +10,118 @@
 
 #include <rpm/rpmlog.h>
 #include <rpm/rpmfileutil.h>
+#include <rpm/rpmsw.h>
 
 #include "lib/manifest.h"
 #include "debug.h"
 
+#include <pthread.h>
+#include <rpm/rpmmacro.h>
+#include <rpm/rpmkeyring.h>
+
 static int noDeps = 1;
 
+static int orderBench = 0;
+
 static rpmVSFlags vsflags = 0;
 
+struct hdrPrefetch_s {
+    Header h;
+    rpmRC rpmrc;
+    int done;
+};
+
+struct hdrPrefetchJob_s {
+    rpmts ts;
+    char ** pkgURL;
+    struct hdrPrefetch_s * slots;
+    int first;
+    int last;
+    int nthreads;
+    int tid;
+};
+
+static void * prefetchWorker(void * data)
+{
+    struct hdrPrefetchJob_s * job = data;
+
+    for (int i = job->first + job->tid; i < job->last; i += job->nthreads) {
+	struct hdrPrefetch_s * slot = &job->slots[i];
+	FD_t fd = Fopen(job->pkgURL[i], "r.ufdio");
+
+	/* Leave open failures for the serial pass to diagnose. */
+	if (fd == NULL || Ferror(fd)) {
+	    if (fd != NULL)
+		Fclose(fd);
+	    continue;
+	}
+	slot->rpmrc = rpmReadPackageFile(job->ts, fd, job->pkgURL[i], &slot->h);
+	Fclose(fd);
+	slot->done = 1;
+    }
+    return NULL;
+}
+
+/*
+ * Read the headers of the batch [first..last) on worker threads ahead
+ * of the serial graph building loop, same scheme as rpmInstall() and
+ * controlled by the same %_install_readahead macro. Only the headers
+ * are read, payloads never enter the picture; concurrent
+ * rpmReadPackageFile() calls share just the (rwlock protected)
+ * transaction keyring, which is loaded up front.
+ */
+static void prefetchHeaders(rpmts ts, char ** pkgURL,
+			    struct hdrPrefetch_s ** slotsp, int * allocedp,
+			    int first, int last, int numPkgs)
+{
+    int nthreads = rpmExpandNumeric("%{?_install_readahead}");
+    int count = last - first;
+    struct hdrPrefetchJob_s *jobs = NULL;
+    pthread_t *threads = NULL;
+    int started = 0;
+
+    /* Manifest restarts must find valid slots for the new range. */
+    if (*slotsp != NULL && numPkgs > *allocedp) {
+	*slotsp = xrealloc(*slotsp, numPkgs * sizeof(**slotsp));
+	memset(*slotsp + *allocedp, 0,
+	       (numPkgs - *allocedp) * sizeof(**slotsp));
+	*allocedp = numPkgs;
+    }
+
+    if (nthreads <= 1 || count < 16)
+	return;
+    if (nthreads > count)
+	nthreads = count;
+
+    if (*slotsp == NULL) {
+	*slotsp = xcalloc(numPkgs, sizeof(**slotsp));
+	*allocedp = numPkgs;
+    }
+
+    rpmKeyringFree(rpmtsGetKeyring(ts, 1));
+
+    jobs = xcalloc(nthreads, sizeof(*jobs));
+    threads = xcalloc(nthreads, sizeof(*threads));
+    for (started = 0; started < nthreads; started++) {
+	struct hdrPrefetchJob_s *job = &jobs[started];
+	job->ts = ts;
+	job->pkgURL = pkgURL;
+	job->slots = *slotsp;
+	job->first = first;
+	job->last = last;
+	job->nthreads = nthreads;
+	job->tid = started;
+	if (pthread_create(&threads[started], NULL, prefetchWorker, job))
+	    break;
+    }
+    /* Unfetched slots just fall back to the serial read. */
+    for (int i = 0; i < started; i++)
+	pthread_join(threads[i], NULL);
+
+    free(threads);
+    free(jobs);
+}
+
 static int
 rpmGraph(rpmts ts, struct rpmInstallArguments_s * ia, const char ** fileArgv)
 {
@@ -33,6 +137,8 @@ rpmGraph(rpmts ts, struct rpmInstallArguments_s * ia, const char ** fileArgv)
     int argc = 0;
     char ** av = NULL;
     int ac = 0;
+    struct hdrPrefetch_s * prefetch = NULL;
+    int prefetchAlloced = 0;
     Header h;
     rpmRC rpmrc;
     int rc = 0;
@@ -78,6 +184,12 @@ restart:
     }
     fileURL = _free(fileURL);
 
+    /* Read the headers of this batch in parallel if so configured. */
+    ovsflags = rpmtsSetVSFlags(ts, vsflags);
+    prefetchHeaders(ts, pkgURL, &prefetch, &prefetchAlloced,
+		    prevx, pkgx, numPkgs);
+    rpmtsSetVSFlags(ts, ovsflags);
+
     /* Continue processing file arguments, building transaction set. */
     for (fnp = (const char **) pkgURL+prevx; *fnp != NULL; fnp++, prevx++) {
 	const char * fileName;
@@ -85,6 +197,17 @@ restart:
 
 	(void) urlPath(*fnp, &fileName);
 
+	/* Use the header read ahead by prefetchHeaders() if there is one. */
+	if (prefetch != NULL && prefetch[prevx].done) {
+	    struct hdrPrefetch_s * slot = &prefetch[prevx];
+
+	    rpmrc = slot->rpmrc;
+	    h = slot->h;
+	    slot->h = NULL;
+	    slot->done = 0;
+	    goto gotheader;
+	}
+
 	/* Try to read the header from a package file. */
 	fd = Fopen(*fnp, "r.ufdio");
 	if (fd == NULL || Ferror(fd)) {
@@ -105,6 +228,8 @@ restart:
 	Fclose(fd);
 	fd = NULL;
 
+gotheader:
+
 	switch (rpmrc) {
 	case RPMRC_FAIL:
 	default:
@@ -171,6 +296,23 @@ maybe_manifest:
 	rpmpsFree(ps);
     }
 
+    /* Replay ordering repeatedly to benchmark rpmtsOrder() */
+    if (orderBench > 0) {
+	struct rpmop_s op;
+
+	memset(&op, 0, sizeof(op));
+	for (i = 0; i < orderBench && rc == 0; i++) {
+	    (void) rpmswEnter(&op, 0);
+	    rc = rpmtsOrder(ts);
+	    (void) rpmswExit(&op, 0);
+	}
+	if (rc == 0)
+	    fprintf(stdout, "ordered %d elements %d times: %lu us total, %lu us/run\n",
+		    rpmtsNElements(ts), orderBench,
+		    op.usecs, op.usecs / orderBench);
+	goto exit;
+    }
+
     rc = rpmtsOrder(ts);
     if (rc)
 	goto exit;
@@ -203,6 +345,13 @@ maybe_manifest:
     rc = 0;
 
 exit:
+    if (prefetch != NULL) {
+	for (i = 0; i < prefetchAlloced; i++) {
+	    if (prefetch[i].done)
+		prefetch[i].h = headerFree(prefetch[i].h);
+	}
+	prefetch = _free(prefetch);
+    }
     for (i = 0; i < numPkgs; i++)
         pkgURL[i] = _free(pkgURL[i]);
     pkgState = _free(pkgState);
@@ -215,6 +364,9 @@ exit:
 static struct poptOption optionsTable[] = {
  { "check", '\0', POPT_ARG_VAL|POPT_ARGFLAG_DOC_HIDDEN, &noDeps, 0,
 	N_("don't verify package dependencies"), NULL },
+ { "bench", '\0', POPT_ARG_INT, &orderBench, 0,
+	N_("benchmark transaction ordering COUNT times instead of printing the graph"),
+	N_("COUNT") },
  { "nolegacy", '\0', POPT_BIT_SET,	&vsflags, RPMVSF_NEEDPAYLOAD,
         N_("don't verify header+payload signature"), NULL },
  { NULL, '\0', POPT_ARG_INCLUDE_TABLE, rpmcliAllPoptTable, 0,
@@ -0,0 +1,270 @@
+/*
+ * Replay recorded transactions through the depcheck/order/run pipeline
+ * and report the per-phase rpmtsOp counters, without touching the
+ * filesystem: the transaction runs with RPMTRANS_FLAG_TEST set, so
+ * verification, fingerprinting and problem detection all happen but no
+ * payload is ever unpacked and no scriptlet runs.
+ *
+ * Install elements come from package files on the command line or from
+ * a recorded header list (as produced by rpmdb --exportdb or a fleet
+ * capture), erase elements from --erase lookups against the rpmdb.
+ */
+
+#include "system.h"
+
+#include <rpm/rpmcli.h>
+#include <rpm/rpmlib.h>		/* rpmReadPackageFile */
+#include <rpm/rpmdb.h>
+#include <rpm/rpmps.h>
+#include <rpm/rpmte.h>
+#include <rpm/rpmts.h>
+#include <rpm/rpmsw.h>
+
+#include <rpm/rpmlog.h>
+#include <rpm/rpmmacro.h>
+#include <rpm/argv.h>
+
+#include "debug.h"
+
+static int repeat = 1;
+static char * headerPath = NULL;
+static ARGV_t eraseNames = NULL;
+
+static void benchArgCallback(poptContext con,
+		enum poptCallbackReason reason,
+		const struct poptOption * opt, const char * arg,
+		const void * data)
+{
+    if (opt->val == 'e')
+	argvAdd(&eraseNames, arg);
+}
+
+static struct poptOption optionsTable[] = {
+ { NULL, '\0', POPT_ARG_CALLBACK, (void *)&benchArgCallback, 0,
+	NULL, NULL },
+ { "erase", 'e', POPT_ARG_STRING, NULL, 'e',
+	N_("replay an erase element for installed package NAME"),
+	N_("NAME") },
+ { "headers", 'H', POPT_ARG_STRING, &headerPath, 0,
+	N_("replay install elements from recorded header list FILE"),
+	N_("FILE") },
+ { "repeat", 'r', POPT_ARG_INT, &repeat, 0,
+	N_("replay the transaction COUNT times"), N_("COUNT") },
+ { NULL, '\0', POPT_ARG_INCLUDE_TABLE, rpmcliAllPoptTable, 0,
+	N_("Common options for all rpm modes and executables:"),
+	NULL },
+
+   POPT_AUTOALIAS
+   POPT_AUTOHELP
+   POPT_TABLEEND
+};
+
+/* Collect the install element headers up front so replays don't pay I/O */
+static int loadHeaders(rpmts ts, const char ** fileArgv,
+		       Header ** hdrsp, ARGV_t * keysp)
+{
+    Header * hdrs = NULL;
+    ARGV_t keys = NULL;
+    int nhdrs = 0;
+    int nfailed = 0;
+
+    if (headerPath != NULL) {
+	FD_t fd = Fopen(headerPath, "r.ufdio");
+	Header h;
+
+	if (fd == NULL || Ferror(fd)) {
+	    rpmlog(RPMLOG_ERR, _("open of %s failed: %s\n"), headerPath,
+			Fstrerror(fd));
+	    if (fd)
+		Fclose(fd);
+	    return -1;
+	}
+	while ((h = headerRead(fd, HEADER_MAGIC_YES)) != NULL) {
+	    hdrs = xrealloc(hdrs, (nhdrs + 1) * sizeof(*hdrs));
+	    hdrs[nhdrs++] = h;
+	    argvAdd(&keys, headerPath);
+	}
+	Fclose(fd);
+    }
+
+    for (const char ** fnp = fileArgv; fnp && *fnp; fnp++) {
+	FD_t fd = Fopen(*fnp, "r.ufdio");
+	Header h = NULL;
+	rpmRC rpmrc;
+
+	if (fd == NULL || Ferror(fd)) {
+	    rpmlog(RPMLOG_ERR, _("open of %s failed: %s\n"), *fnp,
+			Fstrerror(fd));
+	    if (fd)
+		Fclose(fd);
+	    nfailed++;
+	    continue;
+	}
+	rpmrc = rpmReadPackageFile(ts, fd, *fnp, &h);
+	Fclose(fd);
+	if (rpmrc != RPMRC_OK && rpmrc != RPMRC_NOTTRUSTED
+	 && rpmrc != RPMRC_NOKEY) {
+	    rpmlog(RPMLOG_ERR, _("%s cannot be replayed\n"), *fnp);
+	    h = headerFree(h);
+	    nfailed++;
+	    continue;
+	}
+	hdrs = xrealloc(hdrs, (nhdrs + 1) * sizeof(*hdrs));
+	hdrs[nhdrs++] = h;
+	argvAdd(&keys, *fnp);
+    }
+
+    if (nfailed > 0) {
+	for (int i = 0; i < nhdrs; i++)
+	    headerFree(hdrs[i]);
+	free(hdrs);
+	argvFree(keys);
+	return -1;
+    }
+    *hdrsp = hdrs;
+    *keysp = keys;
+    return nhdrs;
+}
+
+static int replayOnce(rpmts ts, Header * hdrs, ARGV_t keys, int nhdrs)
+{
+    int nprobs = 0;
+    int rc = 0;
+
+    for (int i = 0; i < nhdrs && rc == 0; i++)
+	rc = rpmtsAddInstallElement(ts, hdrs[i], (fnpyKey)keys[i], 0, NULL);
+
+    for (ARGV_const_t name = eraseNames; name && *name && rc == 0; name++) {
+	rpmdbMatchIterator mi;
+	Header h;
+	int found = 0;
+
+	mi = rpmtsInitIterator(ts, RPMDBI_LABEL, *name, 0);
+	while ((h = rpmdbNextIterator(mi)) != NULL) {
+	    rc = rpmtsAddEraseElement(ts, h, rpmdbGetIteratorOffset(mi));
+	    found++;
+	}
+	rpmdbFreeIterator(mi);
+	if (found == 0) {
+	    rpmlog(RPMLOG_ERR, _("package %s is not installed\n"), *name);
+	    rc = 1;
+	}
+    }
+    if (rc)
+	goto exit;
+
+    /* Dependency problems don't stop the replay, only report them */
+    (void) rpmtsCheck(ts);
+    {	rpmps ps = rpmtsProblems(ts);
+	nprobs = rpmpsNumProblems(ps);
+	rpmpsFree(ps);
+    }
+
+    rc = rpmtsOrder(ts);
+    if (rc)
+	goto exit;
+
+    /* The test flag makes this a null-fsm run: no payload, no scripts */
+    rc = rpmtsRun(ts, NULL, RPMPROB_FILTER_NONE);
+    if (rc < 0)
+	goto exit;
+    nprobs += rc;
+    rc = 0;
+
+    if (nprobs > 0)
+	rpmlog(RPMLOG_WARNING, _("%d problems found during replay\n"), nprobs);
+
+exit:
+    rpmtsEmpty(ts);
+    return rc;
+}
+
+static void printPhase(const char * name, rpmop op)
+{
+    if (op == NULL || (op->count == 0 && op->usecs == 0))
+	return;
+    fprintf(stdout, "%-12s %6d calls %10lu us %10lu us/replay\n",
+	    name, op->count, op->usecs, op->usecs / repeat);
+}
+
+static void printReport(rpmts ts, rpmop total, int nelems)
+{
+    static const struct { const char * name; rpmtsOpX opx; } phases[] = {
+	{ "check",	RPMTS_OP_CHECK },
+	{ "order",	RPMTS_OP_ORDER },
+	{ "verify",	RPMTS_OP_VERIFY },
+	{ "fingerprint", RPMTS_OP_FINGERPRINT },
+	{ "install",	RPMTS_OP_INSTALL },
+	{ "erase",	RPMTS_OP_ERASE },
+	{ "scriptlets",	RPMTS_OP_SCRIPTLETS },
+	{ "uncompress",	RPMTS_OP_UNCOMPRESS },
+	{ "digest",	RPMTS_OP_DIGEST },
+	{ "signature",	RPMTS_OP_SIGNATURE },
+	{ "dbget",	RPMTS_OP_DBGET },
+	{ "dbput",	RPMTS_OP_DBPUT },
+	{ "dbdel",	RPMTS_OP_DBDEL },
+    };
+
+    fprintf(stdout, "replayed %d elements %d times: %lu us total, %lu us/replay\n",
+	    nelems, repeat, total->usecs, total->usecs / repeat);
+    for (size_t i = 0; i < sizeof(phases) / sizeof(phases[0]); i++)
+	printPhase(phases[i].name, rpmtsOp(ts, phases[i].opx));
+}
+
+int main(int argc, char *argv[])
+{
+    rpmts ts = NULL;
+    poptContext optCon;
+    Header * hdrs = NULL;
+    ARGV_t keys = NULL;
+    struct rpmop_s total;
+    int nhdrs;
+    int ec = EXIT_FAILURE;
+
+    xsetprogname(argv[0]); /* Portability call -- see system.h */
+
+    optCon = rpmcliInit(argc, argv, optionsTable);
+    if (optCon == NULL)
+	exit(EXIT_FAILURE);
+    if (repeat < 1)
+	repeat = 1;
+
+    ts = rpmtsCreate();
+    rpmtsSetRootDir(ts, rpmcliRootDir);
+    rpmtsSetVSFlags(ts, rpmcliVSFlags);
+    rpmtsSetFlags(ts, (rpmtsFlags(ts) | RPMTRANS_FLAG_TEST |
+		       RPMTRANS_FLAG_NOSCRIPTS | RPMTRANS_FLAG_NOTRIGGERS));
+
+    nhdrs = loadHeaders(ts, poptGetArgs(optCon), &hdrs, &keys);
+    if (nhdrs < 0)
+	goto exit;
+    if (nhdrs == 0 && argvCount(eraseNames) == 0) {
+	rpmlog(RPMLOG_ERR,
+	       _("no transaction elements given, nothing to replay\n"));
+	goto exit;
+    }
+
+    memset(&total, 0, sizeof(total));
+    (void) rpmswEnter(&total, 0);
+    for (int r = 0; r < repeat; r++) {
+	if (replayOnce(ts, hdrs, keys, nhdrs)) {
+	    rpmlog(RPMLOG_ERR, _("replay %d failed\n"), r + 1);
+	    goto exit;
+	}
+    }
+    (void) rpmswExit(&total, 0);
+
+    printReport(ts, &total, nhdrs + argvCount(eraseNames));
+    ec = EXIT_SUCCESS;
+
+exit:
+    for (int i = 0; i < nhdrs; i++)
+	headerFree(hdrs[i]);
+    free(hdrs);
+    argvFree(keys);
+    eraseNames = argvFree(eraseNames);
+    rpmtsFree(ts);
+    rpmcliFini(optCon);
+
+    return ec;
+}